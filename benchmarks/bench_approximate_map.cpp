@@ -16,6 +16,13 @@
  *     - Space: Retrieval.bits_per_key + Oracle.bits_per_key
  *     - Use: when the value can be folded into the structure itself
  *
+ *   verified_value_array<PHF, FPBits, M>
+ *     - Query: lookup(k) = optional M-bit value from one fused record
+ *     - Space: PHF.bits_per_key + FPBits + M
+ *     - Rows marked "lookup" time lookup(k) rather than contains(k), and
+ *       are paired with the unfused perfect_filter + phf_value_array
+ *       over the same PHF, which reads two arrays after the PHF.
+ *
  * This benchmark runs both patterns side by side so you can compare them
  * on the same axes: build time, total bits/key, contains() latency, and
  * empirical FPR. Different information content on hit (slot vs value)
@@ -29,6 +36,7 @@
 #include <maph/algorithms/recsplit.hpp>
 #include <maph/composition/bloomier.hpp>
 #include <maph/composition/perfect_filter.hpp>
+#include <maph/composition/verified_value_array.hpp>
 #include <maph/filters/binary_fuse_filter.hpp>
 #include <maph/filters/ribbon_filter.hpp>
 #include <maph/filters/xor_filter.hpp>
@@ -60,51 +68,61 @@ std::vector<std::string> gen_unknown_keys(size_t count, uint64_t seed) {
     return keys;
 }
 
-// perfect_filter::contains(key) is the oracle-style API we benchmark here.
-template<typename Map>
-query_stats measure_map(const Map& m,
-                        const std::vector<std::string>& keys,
-                        size_t total_queries = 1'000'000,
-                        size_t sub_batch_size = 1000,
-                        uint64_t seed = 12345) {
+// Time query(key) over the workload's keys (random members by default).
+template<typename Query>
+query_stats measure_query(Query&& query,
+                          const std::vector<std::string>& keys,
+                          size_t total_queries = 1'000'000,
+                          size_t sub_batch_size = 1000,
+                          uint64_t seed = 12345) {
     using clock = std::chrono::high_resolution_clock;
     using std::chrono::duration_cast;
     using std::chrono::nanoseconds;
 
-    std::mt19937_64 rng{seed};
-    std::uniform_int_distribution<size_t> kd(0, keys.size() - 1);
-    std::vector<size_t> indices(total_queries);
-    for (auto& i : indices) i = kd(rng);
+    const query_stream<std::string> queries(keys, total_queries, seed);
 
     for (size_t i = 0; i < 10000 && i < total_queries; ++i) {
-        consume(m.contains(keys[indices[i]]));
+        consume(query(queries[i]));
     }
 
     const size_t M = total_queries / sub_batch_size;
     std::vector<double> batch_ns;
     batch_ns.reserve(M);
 
+    counter_scope counted;
+    double timed_ns = 0;
     auto global_start = clock::now();
     for (size_t i = 0; i < M; ++i) {
+        cool_caches(counted);
         size_t base = i * sub_batch_size;
         auto t0 = clock::now();
         for (size_t b = 0; b < sub_batch_size; ++b) {
-            consume(m.contains(keys[indices[base + b]]));
+            consume(query(queries[base + b]));
         }
         auto t1 = clock::now();
-        batch_ns.push_back(
-            static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count())
-            / static_cast<double>(sub_batch_size));
+        const double ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count());
+        timed_ns += ns;
+        batch_ns.push_back(ns / static_cast<double>(sub_batch_size));
     }
     auto global_end = clock::now();
+    const counter_sample counts = counted.stop();
 
     std::sort(batch_ns.begin(), batch_ns.end());
     double median = batch_ns[M / 2];
     double p99 = batch_ns[static_cast<size_t>(M * 0.99)];
-    double total_ns = static_cast<double>(
+    double total_ns = current_workload().cold ? timed_ns : static_cast<double>(
         duration_cast<nanoseconds>(global_end - global_start).count());
     double mqps = (static_cast<double>(M * sub_batch_size) / total_ns) * 1000.0;
-    return {median, p99, mqps};
+    return {median, p99, mqps, counts.per(static_cast<double>(M * sub_batch_size)),
+            std::move(batch_ns)};
+}
+
+// perfect_filter::contains(key) is the oracle-style API we benchmark here.
+template<typename Map>
+query_stats measure_map(const Map& m, const std::vector<std::string>& keys,
+                        size_t total_queries = 1'000'000) {
+    return measure_query([&m](std::string_view k) { return m.contains(k); },
+                         keys, total_queries);
 }
 
 // Deterministic value-from-key for bloomier build. Same shape as
@@ -135,6 +153,7 @@ result_row run_perfect_filter(const std::string& phf_name,
     r.ok = false;
 
     reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     auto phf_built = typename PHF::builder{}.add_all(keys).build();
     if (!phf_built.has_value()) {
@@ -145,6 +164,7 @@ result_row run_perfect_filter(const std::string& phf_name,
     }
     auto map = Map::build(std::move(*phf_built), keys);
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     r.build_peak_rss_kb = get_peak_rss_kb();
 
@@ -159,6 +179,8 @@ result_row run_perfect_filter(const std::string& phf_name,
     r.query_median_ns = qs.median_ns;
     r.query_p99_ns = qs.p99_ns;
     r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     // Empirical FPR on unknown keys.
     size_t fp = 0;
@@ -187,12 +209,14 @@ result_row run_bloomier_composition(const std::string& name,
     r.ok = false;
 
     reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = typename Map::builder{}
         .add_all_with(std::span<const std::string>{keys},
                       [](std::string_view k) { return det_value(k); })
         .build();
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     r.build_peak_rss_kb = get_peak_rss_kb();
     if (!built.has_value()) return r;
@@ -209,6 +233,8 @@ result_row run_bloomier_composition(const std::string& name,
     r.query_median_ns = qs.median_ns;
     r.query_p99_ns = qs.p99_ns;
     r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     size_t fp = 0;
     for (const auto& k : unknowns) {
@@ -218,14 +244,121 @@ result_row run_bloomier_composition(const std::string& name,
     return r;
 }
 
+// lookup(k) through perfect_filter<PHF, FPBits> and phf_value_array<PHF,
+// M> over the same PHF (both builders are deterministic in the keys): the
+// fingerprint and the value are two reads at unrelated addresses.
+template<typename PHF, unsigned FPBits, unsigned M>
+result_row run_split_lookup(const std::string& name,
+                            const std::vector<std::string>& keys,
+                            const std::vector<std::string>& unknowns,
+                            size_t total_queries) {
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using values_type = phf_value_array<PHF, M>;
+
+    result_row r{};
+    r.algorithm = name;
+    r.key_count = keys.size();
+    r.ok = false;
+
+    reset_peak_rss();
+    counter_scope counted;
+    auto t0 = clock::now();
+    auto phf_built = typename PHF::builder{}.add_all(keys).build();
+    auto values = typename values_type::builder{}
+        .add_all_with(std::span<const std::string>{keys},
+                      [](std::string_view k) { return det_value(k); })
+        .build();
+    auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
+    r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+    r.build_peak_rss_kb = get_peak_rss_kb();
+    if (!phf_built.has_value() || !values.has_value()) return r;
+    auto pf = perfect_filter<PHF, FPBits>::build(std::move(*phf_built), keys);
+
+    r.ok = true;
+    r.range_size = pf.range_size();
+    r.bits_per_key = values->bits_per_key() + static_cast<double>(FPBits);
+    r.memory_bytes = values->memory_bytes() + (pf.range_size() * FPBits + 7) / 8;
+    r.serialized_bytes = pf.serialize().size() + values->values().serialize().size();
+
+    auto lookup = [&](std::string_view k) -> std::optional<typename values_type::value_type> {
+        hashed_key hk{k};
+        auto slot = pf.slot_for(hk);
+        if (!slot) return std::nullopt;
+        return values->values().get(static_cast<size_t>(slot->value));
+    };
+    auto qs = measure_query(lookup, keys, total_queries);
+    r.query_median_ns = qs.median_ns;
+    r.query_p99_ns = qs.p99_ns;
+    r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+
+    size_t fp = 0;
+    for (const auto& k : unknowns) {
+        if (lookup(k)) ++fp;
+    }
+    r.fp_rate = static_cast<double>(fp) / static_cast<double>(unknowns.size());
+    return r;
+}
+
+template<typename PHF, unsigned FPBits, unsigned M>
+result_row run_verified_lookup(const std::string& name,
+                               const std::vector<std::string>& keys,
+                               const std::vector<std::string>& unknowns,
+                               size_t total_queries) {
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using Map = verified_value_array<PHF, FPBits, M>;
+
+    result_row r{};
+    r.algorithm = name;
+    r.key_count = keys.size();
+    r.ok = false;
+
+    reset_peak_rss();
+    counter_scope counted;
+    auto t0 = clock::now();
+    auto built = typename Map::builder{}
+        .add_all_with(std::span<const std::string>{keys},
+                      [](std::string_view k) { return det_value(k); })
+        .build();
+    auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
+    r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+    r.build_peak_rss_kb = get_peak_rss_kb();
+    if (!built.has_value()) return r;
+
+    r.ok = true;
+    r.range_size = built->range_size();
+    r.bits_per_key = built->bits_per_key();
+    r.memory_bytes = built->memory_bytes();
+    r.serialized_bytes = built->serialize().size();
+
+    auto qs = measure_query([&](std::string_view k) { return built->lookup(k); },
+                            keys, total_queries);
+    r.query_median_ns = qs.median_ns;
+    r.query_p99_ns = qs.p99_ns;
+    r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+
+    size_t fp = 0;
+    for (const auto& k : unknowns) {
+        if (built->lookup(k)) ++fp;
+    }
+    r.fp_rate = static_cast<double>(fp) / static_cast<double>(unknowns.size());
+    return r;
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
-    std::vector<size_t> key_counts = {10'000, 100'000};
-    if (argc > 1) {
-        key_counts.clear();
-        for (int i = 1; i < argc; ++i) key_counts.push_back(std::stoul(argv[i]));
-    }
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({10'000, 100'000});
 
     const size_t total_queries = 1'000'000;
     const size_t num_unknowns = 100'000;
@@ -289,6 +422,14 @@ int main(int argc, char** argv) {
         do_one("bloomier<rib1,binfuse8>",
             [&]{ return run_bloomier_composition<ribbon_retrieval<1>, binary_fuse_filter<8>, 1, 8>(
                     "bloomier<rib1,binfuse8>", keys, unknowns, total_queries); });
+
+        // === fused fingerprint + value records (lookup latency) ===
+        do_one("phobic5 pf8+pva16 lookup",
+            [&]{ return run_split_lookup<phobic5, 8, 16>(
+                    "phobic5 pf8+pva16 lookup", keys, unknowns, total_queries); });
+        do_one("phobic5 verified<8,16> lookup",
+            [&]{ return run_verified_lookup<phobic5, 8, 16>(
+                    "phobic5 verified<8,16> lookup", keys, unknowns, total_queries); });
     }
     return 0;
 }
@@ -16,6 +16,7 @@
  * Usage:
  *   bench_bloomier                       # default 100K + 1M keys
  *   bench_bloomier --keys=10000,100000   # custom sizes
+ *   bench_bloomier --counters            # + hardware counters per op
  */
 
 #include "bench_harness.hpp"
@@ -52,6 +53,9 @@ struct row {
     double query_median_ns;
     double fp_rate;
     bool ok;
+    counter_sample build_counters{};
+    counter_sample query_counters{};
+    std::vector<double> query_samples{};
 };
 
 uint64_t det_value(std::string_view key) noexcept {
@@ -96,12 +100,14 @@ row run_one(const std::string& name, unsigned M, unsigned fp_bits,
 
     std::cerr << "  " << name << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
     auto builder = typename B::builder{};
     builder.add_all_with(std::span<const std::string>{keys},
                          [](std::string_view k) { return det_value(k); });
     auto built = builder.build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = static_cast<double>(duration_cast<microseconds>(t1 - t0).count()) / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -111,29 +117,31 @@ row run_one(const std::string& name, unsigned M, unsigned fp_bits,
     r.bits_per_key = built->bits_per_key();
     r.memory_kb = built->memory_bytes() / 1024;
 
-    // Query latency on in-set keys (hot path).
+    // Query latency over the workload's keys (in-set keys by default).
     static constexpr size_t inner = 1000;
     size_t outer = total_queries / inner;
     if (outer == 0) outer = 1;
+    const query_stream<std::string> queries(keys, outer * inner, 12345);
     std::vector<double> per_batch;
     per_batch.reserve(outer);
     uint64_t sink = 0;
-    size_t idx = 0;
+    counter_scope query_counted;
     for (size_t i = 0; i < outer; ++i) {
+        cool_caches(query_counted);
         auto a = clock::now();
         for (size_t j = 0; j < inner; ++j) {
-            auto v = built->lookup(keys[idx]);
+            auto v = built->lookup(queries[i * inner + j]);
             sink ^= v.has_value() ? static_cast<uint64_t>(*v) : 0;
-            idx++;
-            if (idx >= keys.size()) idx = 0;
         }
         auto b = clock::now();
         per_batch.push_back(
             static_cast<double>(duration_cast<nanoseconds>(b - a).count()) / inner);
     }
+    r.query_counters = query_counted.stop().per(static_cast<double>(outer * inner));
     consume(sink != 0);
     std::sort(per_batch.begin(), per_batch.end());
     r.query_median_ns = per_batch[per_batch.size() / 2];
+    r.query_samples = std::move(per_batch);
 
     // Empirical FPR on a disjoint unknown set.
     auto unknowns = gen_unknown_for_bloomier(20000, 99999);
@@ -179,7 +187,20 @@ void print_row(const row& r) {
         << std::setw(12) << std::setprecision(6) << r.fp_rate
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters);
+    report_counters(std::cout, "query", r.query_counters);
     std::cout.flush();
+    record_result()
+        .config("config", r.config).config("value_bits", static_cast<double>(r.value_bits))
+        .config("oracle_bits", static_cast<double>(r.oracle_bits))
+        .config("keys", static_cast<double>(r.keys))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_ms", r.build_ms)
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("memory_kb", static_cast<double>(r.memory_kb))
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("fp_rate", r.fp_rate)
+        .samples("query_med_ns", r.query_samples);
 }
 
 } // namespace
@@ -0,0 +1,251 @@
+/**
+ * @file bench_build_memory.cpp
+ * @brief Peak memory during build, and what the result holds afterwards,
+ *        for every algorithm.
+ *
+ * VmHWM is a process-wide high-water mark: once one build has peaked,
+ * every later build in the same process reads the same number. So each
+ * build here runs in a child forked from a parent that holds only the
+ * keys. The child starts with the keys resident and nothing else; its
+ * peak minus that starting RSS is the build's own peak, and its RSS
+ * after the build (scratch freed) minus the start is what the result
+ * retains, allocator slack included. measure_memory() gives the
+ * structure's own accounting next to it.
+ *
+ * Columns (TSV):
+ *   algorithm, keys, ok, build_ms
+ *   peak_build_mb      VmHWM - starting VmRSS
+ *   peak_bytes_per_key
+ *   retained_mb        VmRSS after build - starting VmRSS
+ *   resident_mb        measure_memory().resident_bytes
+ *   encoded_mb         memory_bytes()
+ *   serialized_mb      serialize().size()
+ *   resident_bpk, entropy_bpk
+ *
+ * retained_mb is page-granular and includes freed scratch the allocator
+ * kept; at small key counts it is dominated by that and resident_mb is
+ * the better figure.
+ *
+ * Usage:
+ *   bench_build_memory                    # default: 1000000 10000000
+ *   bench_build_memory 100000000          # custom key counts
+ *   bench_build_memory --threads=8        # threaded builds where supported
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/algorithms/bbhash.hpp>
+#include <maph/algorithms/chd.hpp>
+#include <maph/algorithms/fch.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/pthash.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/algorithms/shock_hash.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/detail/memory_report.hpp>
+#include <maph/filters/binary_fuse_filter.hpp>
+#include <maph/filters/ribbon_filter.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+// What a child writes back through its pipe.
+struct child_result {
+    bool ok{false};
+    double build_ms{0};
+    size_t start_rss_kb{0};
+    size_t peak_rss_kb{0};
+    size_t end_rss_kb{0};
+    memory_report memory{};
+};
+
+using build_fn = std::function<child_result(const std::vector<std::string>&)>;
+
+struct algo_entry {
+    std::string name;
+    build_fn run;
+    size_t max_keys;
+};
+
+template<typename Build>
+child_result measure_build(const std::vector<std::string>& keys, Build build) {
+    using clock = std::chrono::steady_clock;
+    child_result r;
+    r.start_rss_kb = get_rss_kb();
+    auto t0 = clock::now();
+    auto built = build();
+    r.build_ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    r.peak_rss_kb = get_peak_rss_kb();
+    r.end_rss_kb = get_rss_kb();
+    if (!built) return r;
+    r.ok = true;
+    r.memory = measure_memory(*built, keys.size());
+    return r;
+}
+
+template<typename Builder>
+build_fn phf_build(Builder make_builder) {
+    return [make_builder](const std::vector<std::string>& keys) {
+        return measure_build(keys, [&] {
+            auto b = make_builder().add_all(keys).build();
+            return b.has_value() ? std::optional{std::move(*b)} : std::nullopt;
+        });
+    };
+}
+
+template<typename Filter>
+build_fn filter_build() {
+    return [](const std::vector<std::string>& keys) {
+        return measure_build(keys, [&] {
+            Filter f;
+            return f.build(keys) ? std::optional{std::move(f)} : std::nullopt;
+        });
+    };
+}
+
+// Fork, run one build in the child, read its result back.
+child_result run_isolated(const build_fn& run, const std::vector<std::string>& keys) {
+    int fds[2];
+    if (::pipe(fds) != 0) return {};
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return {};
+    }
+    if (pid == 0) {
+        ::close(fds[0]);
+        const child_result r = run(keys);
+        const auto* p = reinterpret_cast<const char*>(&r);
+        size_t left = sizeof(r);
+        while (left > 0) {
+            const ssize_t n = ::write(fds[1], p, left);
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        ::_exit(0);
+    }
+    ::close(fds[1]);
+    child_result r;
+    auto* p = reinterpret_cast<char*>(&r);
+    size_t got = 0;
+    while (got < sizeof(r)) {
+        const ssize_t n = ::read(fds[0], p + got, sizeof(r) - got);
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    ::close(fds[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    if (got != sizeof(r)) return {};
+    return r;
+}
+
+double mb(double bytes) { return bytes / (1024.0 * 1024.0); }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({1'000'000, 10'000'000});
+    const size_t threads = args.get_size("threads", 1);
+
+    std::vector<algo_entry> algos = {
+        {"phobic5", phf_build([=] { return phobic5::builder{}.with_threads(threads); }), SIZE_MAX},
+        {"phobic5_compact", phf_build([=] { return phobic5_compact::builder{}.with_threads(threads); }), SIZE_MAX},
+        {"partitioned<phobic5>", phf_build([=] {
+            return partitioned_phf<phobic5>::builder{}.with_threads(threads);
+        }), SIZE_MAX},
+        {"recsplit8", phf_build([=] { return recsplit8::builder{}.with_threads(threads); }), SIZE_MAX},
+        {"pthash98", phf_build([] { return pthash98::builder{}; }), SIZE_MAX},
+        {"chd", phf_build([] { return chd_hasher::builder{}; }), SIZE_MAX},
+        {"fch", phf_build([] { return fch_hasher::builder{}; }), SIZE_MAX},
+        {"bbhash3", phf_build([=] { return bbhash3::builder{}.with_threads(threads); }), SIZE_MAX},
+        {"shock_hash64", phf_build([] { return shock_hash<64>::builder{}; }), 10'000'000},
+        {"xor8", filter_build<xor_filter<8>>(), SIZE_MAX},
+        {"binary_fuse8", filter_build<binary_fuse_filter<8>>(), SIZE_MAX},
+        {"ribbon8", filter_build<ribbon_filter<8>>(), SIZE_MAX},
+        {"ribbon_retrieval8", [=](const std::vector<std::string>& keys) {
+            std::vector<uint8_t> values(keys.size());
+            for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint8_t>(i);
+            return measure_build(keys, [&] {
+                auto b = ribbon_retrieval<8>::builder{}
+                             .add_all(std::span<const std::string>{keys},
+                                      std::span<const uint8_t>{values})
+                             .with_threads(threads)
+                             .build();
+                return b.has_value() ? std::optional{std::move(*b)} : std::nullopt;
+            });
+        }, SIZE_MAX},
+    };
+
+    std::cerr << "maph build memory benchmark\n  key counts: ";
+    for (auto kc : key_counts) std::cerr << kc << ' ';
+    std::cerr << "\n  threads: " << threads << "\n\n";
+
+    std::printf("algorithm\tkeys\tok\tbuild_ms\tpeak_build_mb\tpeak_bytes_per_key"
+                "\tretained_mb\tresident_mb\tencoded_mb\tserialized_mb"
+                "\tresident_bpk\tentropy_bpk\n");
+
+    for (size_t kc : key_counts) {
+        std::cerr << "=== " << kc << " keys ===\n";
+        auto keys = gen_random_keys(kc);
+
+        for (const auto& algo : algos) {
+            if (keys.size() > algo.max_keys) {
+                std::cerr << "  skip " << algo.name << " (> " << algo.max_keys << " keys)\n";
+                continue;
+            }
+            std::cerr << "  " << algo.name << " ..." << std::flush;
+            const auto r = run_isolated(algo.run, keys);
+            const double peak = r.peak_rss_kb > r.start_rss_kb
+                ? static_cast<double>(r.peak_rss_kb - r.start_rss_kb) * 1024.0 : 0.0;
+            const double retained = r.end_rss_kb > r.start_rss_kb
+                ? static_cast<double>(r.end_rss_kb - r.start_rss_kb) * 1024.0 : 0.0;
+            std::cerr << (r.ok ? " " : " BUILD FAILED ") << mb(peak) << " MB peak\n";
+
+            std::printf("%s\t%zu\t%d\t%.1f\t%.1f\t%.1f\t%.1f\t%.2f\t%.2f\t%.2f\t%.3f\t%.3f\n",
+                        algo.name.c_str(), keys.size(), r.ok ? 1 : 0, r.build_ms,
+                        mb(peak), keys.empty() ? 0.0 : peak / static_cast<double>(keys.size()),
+                        mb(retained),
+                        mb(static_cast<double>(r.memory.resident_bytes)),
+                        mb(static_cast<double>(r.memory.encoded_bytes)),
+                        mb(static_cast<double>(r.memory.serialized_bytes)),
+                        r.memory.resident_bits_per_key(), r.memory.entropy_bits_per_key());
+            std::fflush(stdout);
+            record_result()
+                .config("algorithm", algo.name).config("keys", static_cast<double>(keys.size()))
+                .metric("ok", r.ok ? 1 : 0)
+                .metric("build_ms", r.build_ms)
+                .metric("peak_build_mb", mb(peak))
+                .metric("retained_mb", mb(retained))
+                .metric("resident_mb", mb(static_cast<double>(r.memory.resident_bytes)))
+                .metric("encoded_mb", mb(static_cast<double>(r.memory.encoded_bytes)))
+                .metric("serialized_mb", mb(static_cast<double>(r.memory.serialized_bytes)))
+                .metric("resident_bpk", r.memory.resident_bits_per_key())
+                .metric("entropy_bpk", r.memory.entropy_bits_per_key());
+        }
+    }
+    return 0;
+}
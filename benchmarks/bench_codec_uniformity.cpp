@@ -22,8 +22,13 @@
  * Usage:
  *   bench_codec_uniformity                      # default sweep
  *   bench_codec_uniformity --keys=5000 --queries=50000
+ *   bench_codec_uniformity --counters           # + hardware counters per decode
  *
- * Output is one row per (M, codec, diversity_label) with deviations.
+ * Output is one row per (M, codec, diversity_label) with deviations
+ * and the cost of one codec decode (decode_ns, random patterns). A last
+ * sweep builds a Huffman code over a wide Zipf alphabet and compares
+ * decode_ns with the retrieval lookup it follows (lookup_ns), both
+ * per call and through encoded_retrieval::lookup_batch.
  */
 
 #include "bench_harness.hpp"
@@ -33,6 +38,7 @@
 #include <maph/retrieval/ribbon_retrieval.hpp>
 
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -67,6 +73,25 @@ double kl_divergence(const std::vector<double>& observed,
     return kl;
 }
 
+// ns per decode over `count` random M-bit patterns; per-decode counts
+// into *counters when given.
+template <typename Codec>
+double time_decode(const Codec& codec, size_t count, counter_sample* counters = nullptr,
+                   uint64_t seed = 1) {
+    std::mt19937_64 rng{seed};
+    std::vector<uint64_t> patterns(count);
+    for (auto& p : patterns) p = rng() & (Codec::alphabet_size - 1);
+    counter_scope counted;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t acc = 0;
+    for (uint64_t p : patterns) acc += static_cast<uint64_t>(codec.decode(p));
+    auto t1 = std::chrono::steady_clock::now();
+    const counter_sample counts = counted.stop();
+    if (counters != nullptr) *counters = counts.per(double(count));
+    sink = sink ^ acc;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / double(count);
+}
+
 double total_variation(const std::vector<double>& a,
                        const std::vector<double>& b) {
     double tv = 0.0;
@@ -83,6 +108,8 @@ struct experiment_result {
     double kl;
     double tv;
     bool ok;
+    double decode_ns;
+    counter_sample decode_counters;
     std::vector<double> observed;
     std::vector<double> predicted;
 };
@@ -139,6 +166,7 @@ experiment_result run_one(
         observed[i] = double(obs_counts[i]) / double(n_unknowns);
     }
 
+    r.decode_ns = time_decode(codec, n_unknowns, &r.decode_counters);
     r.kl = kl_divergence(observed, predicted);
     r.tv = total_variation(observed, predicted);
     r.observed = observed;
@@ -156,6 +184,7 @@ void print_header() {
         << std::setw(12) << "KL_div"
         << std::setw(12) << "TV_dist"
         << std::setw(7)  << "ok"
+        << std::setw(11) << "decode_ns"
         << '\n';
 }
 
@@ -168,8 +197,17 @@ void print_row(const experiment_result& r) {
         << std::setw(12) << std::setprecision(5) << r.kl
         << std::setw(12) << std::setprecision(5) << r.tv
         << std::setw(7)  << (r.ok ? "1" : "0")
+        << std::setw(11) << std::setprecision(2) << r.decode_ns
         << '\n';
+    report_counters(std::cout, "decode", r.decode_counters);
     std::cout.flush();
+    record_result()
+        .config("label", r.label).config("M", static_cast<double>(r.M))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("distinct_stored", static_cast<double>(r.distinct_stored))
+        .metric("kl", r.kl)
+        .metric("tv", r.tv)
+        .metric("decode_ns", r.decode_ns);
 }
 
 std::vector<std::string> gen_keys(size_t n, uint64_t seed = 42) {
@@ -209,6 +247,66 @@ std::vector<V> storage_skewed_to_v0(size_t n, size_t k) {
     return out;
 }
 
+// Wide alphabet: `values` symbols with Zipf(1) frequencies, Huffman-coded
+// in M bits. Members store values drawn from the same distribution.
+template <unsigned M>
+void run_wide(size_t values, const std::vector<std::string>& keys, size_t n_queries) {
+    std::vector<std::pair<uint32_t, double>> freqs;
+    for (size_t v = 0; v < values; ++v) freqs.push_back({uint32_t(v), 1.0 / double(v + 1)});
+    auto codec = prefix_codec<uint32_t, M>::from_frequencies(freqs, 0);
+
+    std::mt19937_64 rng{5};
+    std::discrete_distribution<uint32_t> zipf(values, 0.0, double(values),
+        [](double x) { return 1.0 / (x + 0.5); });
+    std::vector<uint32_t> stored(keys.size());
+    for (auto& v : stored) v = zipf(rng);
+
+    using Enc = encoded_retrieval<ribbon_retrieval<M>, prefix_codec<uint32_t, M>>;
+    auto built = typename Enc::builder(codec)
+        .add_all(std::span<const std::string>{keys}, std::span<const uint32_t>{stored})
+        .build();
+    if (!built) {
+        std::cout << "wide M=" << M << ": build failed\n";
+        return;
+    }
+
+    const query_stream<std::string> stream(keys, n_queries, 6);
+    const std::vector<std::string_view> queries = stream.views();
+    auto time_ns = [&](counter_sample& counters, auto&& fn) {
+        cool_caches();
+        counter_scope counted;
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        counters = counted.stop().per(double(n_queries));
+        return std::chrono::duration<double, std::nano>(t1 - t0).count() / double(n_queries);
+    };
+    uint64_t acc = 0;
+    counter_sample lookup_counters, encoded_counters, batch_counters, decode_counters;
+    const double lookup_ns = time_ns(lookup_counters, [&] {
+        for (auto q : queries) acc += uint64_t(built->base().lookup(q));
+    });
+    const double encoded_ns = time_ns(encoded_counters, [&] {
+        for (auto q : queries) acc += built->lookup(q);
+    });
+    std::vector<uint32_t> out(n_queries);
+    const double batch_ns = time_ns(batch_counters, [&] { built->lookup_batch(queries, out); });
+    for (auto v : out) acc += v;
+    sink = sink ^ acc;
+    const double decode_ns = time_decode(codec, n_queries, &decode_counters);
+
+    std::cout << "wide M=" << M << " values=" << values
+              << std::fixed << std::setprecision(2)
+              << "  decode_ns=" << decode_ns
+              << "  lookup_ns=" << lookup_ns
+              << "  encoded_lookup_ns=" << encoded_ns
+              << "  encoded_lookup_batch_ns=" << batch_ns << '\n';
+    report_counters(std::cout, "decode", decode_counters);
+    report_counters(std::cout, "lookup", lookup_counters);
+    report_counters(std::cout, "encoded lookup", encoded_counters);
+    report_counters(std::cout, "encoded batch lookup", batch_counters);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -296,5 +394,10 @@ int main(int argc, char** argv) {
         std::cout << '\n';
     }
 
+    // ── Sweep 5: decode cost over wide alphabets. ─────────────────────────
+    // One table lookup at M = 12, two at M = 20.
+    run_wide<12>(256, keys, n_unknowns);
+    run_wide<20>(4096, keys, n_unknowns);
+
     return 0;
 }
@@ -0,0 +1,432 @@
+/**
+ * @file bench_compare.cpp
+ * @brief Compare two --json result files and flag significant changes.
+ *
+ * Every benchmark run with --json=FILE writes one JSON line per row
+ * (result_log.hpp). bench_compare matches rows of a baseline and a
+ * candidate file by benchmark and config, and for each metric both have:
+ *
+ *   - with sub-batch samples on both sides (the latency metrics): a
+ *     bootstrap confidence interval for the difference of the medians,
+ *     resampling each side's samples;
+ *   - with the row repeated in both files (run the benchmark twice into
+ *     one file, or concatenate files): a Welch interval for the
+ *     difference of the means of the repeats;
+ *   - otherwise: the difference alone, with no verdict.
+ *
+ * A change is significant when the interval excludes zero, and flagged
+ * when it is also at least --min_pct percent of the baseline (or
+ * --min_abs in the metric's unit). Metrics whose name says throughput
+ * (mqps, per_s, gbps, speedup, success_rate, ok) are better higher; the
+ * rest (ns, ms, bytes, bits) better lower. So a slot_for that got 2 ns
+ * slower over 1000 sub-batches of a 30 ns query is flagged.
+ *
+ * Output is TSV, one line per compared metric; --all includes the
+ * unchanged ones (and the unchanged ones with no interval). Exit status
+ * is 1 if any metric regressed, 2 on a usage or read error, else 0.
+ *
+ * Usage:
+ *   bench_phf 1000000 --json=base.jsonl
+ *   ... change ...
+ *   bench_phf 1000000 --json=new.jsonl
+ *   bench_compare base.jsonl new.jsonl
+ *   bench_compare base.jsonl new.jsonl --confidence=0.99 --min_pct=2 --all
+ */
+
+#include "bench_harness.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace maph::bench;
+
+namespace {
+
+// ===== JSON (the subset result_log writes) =====
+
+struct json {
+    enum class kind { null, boolean, number, string, array, object } type{kind::null};
+    double num{0};
+    std::string str{};
+    std::vector<json> arr{};
+    std::vector<std::pair<std::string, json>> obj{};
+
+    [[nodiscard]] const json* find(std::string_view key) const {
+        for (const auto& [k, v] : obj) if (k == key) return &v;
+        return nullptr;
+    }
+};
+
+class json_parser {
+    std::string_view s_;
+    size_t i_{0};
+
+    void skip() { while (i_ < s_.size() && std::isspace(static_cast<unsigned char>(s_[i_]))) ++i_; }
+    bool eat(char c) {
+        skip();
+        if (i_ < s_.size() && s_[i_] == c) { ++i_; return true; }
+        return false;
+    }
+
+    // The four hex digits of a \u escape.
+    std::optional<unsigned> hex4() {
+        if (s_.size() - i_ < 4) return std::nullopt;
+        unsigned cp = 0;
+        for (int k = 0; k < 4; ++k) {
+            const char h = s_[i_++];
+            unsigned d;
+            if (h >= '0' && h <= '9') d = static_cast<unsigned>(h - '0');
+            else if (h >= 'a' && h <= 'f') d = static_cast<unsigned>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') d = static_cast<unsigned>(h - 'A' + 10);
+            else return std::nullopt;
+            cp = cp << 4 | d;
+        }
+        return cp;
+    }
+
+    // A BMP code point; surrogate halves are kept as they come.
+    static void append_utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | cp >> 6);
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            out += static_cast<char>(0xe0 | cp >> 12);
+            out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+
+    std::optional<std::string> string() {
+        if (!eat('"')) return std::nullopt;
+        std::string out;
+        while (i_ < s_.size() && s_[i_] != '"') {
+            char c = s_[i_++];
+            if (c == '\\' && i_ < s_.size()) {
+                c = s_[i_++];
+                switch (c) {
+                    case '"': case '\\': case '/': out += c; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        auto cp = hex4();
+                        if (!cp) return std::nullopt;
+                        append_utf8(out, *cp);
+                        break;
+                    }
+                    default: return std::nullopt;
+                }
+            } else {
+                out += c;
+            }
+        }
+        if (i_ >= s_.size()) return std::nullopt;
+        ++i_;
+        return out;
+    }
+
+public:
+    explicit json_parser(std::string_view s) : s_(s) {}
+
+    std::optional<json> value() {
+        skip();
+        if (i_ >= s_.size()) return std::nullopt;
+        json v;
+        const char c = s_[i_];
+        if (c == '{') {
+            ++i_;
+            v.type = json::kind::object;
+            if (eat('}')) return v;
+            do {
+                auto k = string();
+                if (!k || !eat(':')) return std::nullopt;
+                auto x = value();
+                if (!x) return std::nullopt;
+                v.obj.emplace_back(std::move(*k), std::move(*x));
+            } while (eat(','));
+            return eat('}') ? std::optional{std::move(v)} : std::nullopt;
+        }
+        if (c == '[') {
+            ++i_;
+            v.type = json::kind::array;
+            if (eat(']')) return v;
+            do {
+                auto x = value();
+                if (!x) return std::nullopt;
+                v.arr.push_back(std::move(*x));
+            } while (eat(','));
+            return eat(']') ? std::optional{std::move(v)} : std::nullopt;
+        }
+        if (c == '"') {
+            auto str = string();
+            if (!str) return std::nullopt;
+            v.type = json::kind::string;
+            v.str = std::move(*str);
+            return v;
+        }
+        for (auto [word, type, num] : {std::tuple{"null", json::kind::null, 0.0},
+                                        std::tuple{"true", json::kind::boolean, 1.0},
+                                        std::tuple{"false", json::kind::boolean, 0.0}}) {
+            if (s_.substr(i_).starts_with(word)) {
+                i_ += std::string_view{word}.size();
+                v.type = type;
+                v.num = num;
+                return v;
+            }
+        }
+        const std::string rest{s_.substr(i_, std::min<size_t>(32, s_.size() - i_))};
+        size_t used = 0;
+        try { v.num = std::stod(rest, &used); } catch (...) { return std::nullopt; }
+        i_ += used;
+        v.type = json::kind::number;
+        return v;
+    }
+};
+
+// ===== RESULT FILES =====
+
+// One metric of one row, over every repeat of the row in a file.
+struct metric_values {
+    std::vector<double> values;   // one per repeat
+    std::vector<double> samples;  // pooled sub-batch samples, if any
+};
+
+using row_key = std::pair<std::string, std::string>;  // bench, config
+using result_set = std::map<row_key, std::map<std::string, metric_values>>;
+
+std::string describe_config(const json& config) {
+    std::string out;
+    for (const auto& [k, v] : config.obj) {
+        if (!out.empty()) out += ' ';
+        out += k + '=';
+        if (v.type == json::kind::string) {
+            out += v.str;
+        } else {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.15g", v.num);
+            out += buf;
+        }
+    }
+    return out;
+}
+
+std::optional<result_set> load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "bench_compare: cannot read " << path << '\n';
+        return std::nullopt;
+    }
+    result_set out;
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        if (line.empty()) continue;
+        auto row = json_parser{line}.value();
+        const json* bench = row ? row->find("bench") : nullptr;
+        const json* config = row ? row->find("config") : nullptr;
+        const json* metrics = row ? row->find("metrics") : nullptr;
+        if (bench == nullptr || config == nullptr || metrics == nullptr) {
+            std::cerr << "bench_compare: " << path << ':' << lineno << ": not a result row\n";
+            continue;
+        }
+        auto& row_metrics = out[{bench->str, describe_config(*config)}];
+        for (const auto& [name, v] : metrics->obj) {
+            if (v.type == json::kind::number || v.type == json::kind::boolean) {
+                row_metrics[name].values.push_back(v.num);
+            }
+        }
+        if (const json* samples = row->find("samples")) {
+            for (const auto& [name, arr] : samples->obj) {
+                auto& dst = row_metrics[name].samples;
+                for (const auto& x : arr.arr) {
+                    if (x.type == json::kind::number) dst.push_back(x.num);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+// ===== STATISTICS =====
+
+struct interval {
+    double lo, hi;
+};
+
+double median_of(std::vector<double>& v) {
+    const auto mid = v.begin() + static_cast<std::ptrdiff_t>(v.size() / 2);
+    std::nth_element(v.begin(), mid, v.end());
+    return *mid;
+}
+
+double mean_of(const std::vector<double>& v) {
+    double sum = 0;
+    for (double x : v) sum += x;
+    return sum / static_cast<double>(v.size());
+}
+
+// Percentile bootstrap for median(b) - median(a).
+interval bootstrap_median_diff(const std::vector<double>& a, const std::vector<double>& b,
+                               double confidence, size_t resamples) {
+    std::mt19937_64 rng{0x5eed};
+    std::vector<double> diffs, ra(a.size()), rb(b.size());
+    diffs.reserve(resamples);
+    std::uniform_int_distribution<size_t> pick_a(0, a.size() - 1), pick_b(0, b.size() - 1);
+    for (size_t r = 0; r < resamples; ++r) {
+        for (auto& x : ra) x = a[pick_a(rng)];
+        for (auto& x : rb) x = b[pick_b(rng)];
+        diffs.push_back(median_of(rb) - median_of(ra));
+    }
+    std::sort(diffs.begin(), diffs.end());
+    const double tail = (1.0 - confidence) / 2.0;
+    const auto at = [&](double q) {
+        return diffs[std::min(diffs.size() - 1, static_cast<size_t>(q * static_cast<double>(diffs.size())))];
+    };
+    return {at(tail), at(1.0 - tail)};
+}
+
+// P(T <= t) for Student's t with `df` degrees of freedom, integrating the
+// density (Simpson); the quantile below bisects it. Accurate to well past
+// what an interval's width needs.
+double student_t_cdf(double t, double df) {
+    const double c = std::exp(std::lgamma((df + 1) / 2) - std::lgamma(df / 2))
+                   / std::sqrt(df * std::numbers::pi);
+    const auto pdf = [&](double x) { return c * std::pow(1 + x * x / df, -(df + 1) / 2); };
+    const double x = std::fabs(t);
+    const int steps = 2000;
+    const double h = x / steps;
+    double area = pdf(0) + pdf(x);
+    for (int k = 1; k < steps; ++k) area += pdf(k * h) * (k % 2 ? 4 : 2);
+    area *= h / 3;
+    return t >= 0 ? 0.5 + area : 0.5 - area;
+}
+
+double student_t_quantile(double p, double df) {
+    double lo = 0, hi = 1000;
+    for (int it = 0; it < 100; ++it) {
+        const double mid = (lo + hi) / 2;
+        (student_t_cdf(mid, df) < p ? lo : hi) = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+// Welch interval for mean(b) - mean(a).
+interval welch_mean_diff(const std::vector<double>& a, const std::vector<double>& b,
+                         double confidence) {
+    const auto var = [](const std::vector<double>& v, double m) {
+        double s = 0;
+        for (double x : v) s += (x - m) * (x - m);
+        return s / static_cast<double>(v.size() - 1);
+    };
+    const double ma = mean_of(a), mb = mean_of(b);
+    const double sa = var(a, ma) / static_cast<double>(a.size());
+    const double sb = var(b, mb) / static_cast<double>(b.size());
+    const double se = std::sqrt(sa + sb);
+    const double d = mb - ma;
+    if (se == 0) return {d, d};
+    const double df = (sa + sb) * (sa + sb)
+        / (sa * sa / static_cast<double>(a.size() - 1) + sb * sb / static_cast<double>(b.size() - 1));
+    const double t = student_t_quantile(1.0 - (1.0 - confidence) / 2.0, df);
+    return {d - t * se, d + t * se};
+}
+
+bool higher_is_better(std::string_view metric) {
+    for (std::string_view word : {"mqps", "per_s", "gbps", "speedup", "success_rate"}) {
+        if (metric.find(word) != std::string_view::npos) return true;
+    }
+    return metric == "ok";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    if (args.positional().size() != 2) {
+        std::cerr << "usage: bench_compare BASELINE.jsonl CANDIDATE.jsonl"
+                     " [--confidence=0.95] [--min_pct=1] [--min_abs=0] [--resamples=1000] [--all]\n";
+        return 2;
+    }
+    const double confidence = std::clamp(args.get_double("confidence", 0.95), 0.5, 0.9999);
+    const double min_pct = args.get_double("min_pct", 1.0);
+    const double min_abs = args.get_double("min_abs", 0.0);
+    const size_t resamples = std::max<size_t>(100, args.get_size("resamples", 1000));
+    const bool all = args.has("all");
+
+    auto base = load(args.positional()[0]);
+    auto cand = load(args.positional()[1]);
+    if (!base || !cand) return 2;
+
+    std::cout << "bench\tconfig\tmetric\tbaseline\tcandidate\tdelta\tdelta_pct\tci_lo\tci_hi\tverdict\n";
+    size_t compared = 0, regressions = 0, improvements = 0, unmatched = 0;
+    for (const auto& [key, base_metrics] : *base) {
+        auto it = cand->find(key);
+        if (it == cand->end()) { ++unmatched; continue; }
+        for (const auto& [name, a] : base_metrics) {
+            auto jt = it->second.find(name);
+            if (jt == it->second.end() || a.values.empty() || jt->second.values.empty()) continue;
+            const auto& b = jt->second;
+            ++compared;
+
+            const double va = mean_of(a.values), vb = mean_of(b.values);
+            const double delta = vb - va;
+            const double pct = va != 0 ? 100.0 * delta / std::fabs(va) : 0.0;
+
+            std::optional<interval> ci;
+            if (a.samples.size() >= 2 && b.samples.size() >= 2) {
+                ci = bootstrap_median_diff(a.samples, b.samples, confidence, resamples);
+            } else if (a.values.size() >= 2 && b.values.size() >= 2) {
+                ci = welch_mean_diff(a.values, b.values, confidence);
+            }
+
+            std::string verdict = "n/a";
+            if (ci) {
+                const bool significant = ci->lo > 0 || ci->hi < 0;
+                const bool large = std::fabs(pct) >= min_pct || (min_abs > 0 && std::fabs(delta) >= min_abs);
+                if (!significant || !large) {
+                    verdict = "same";
+                } else if ((delta > 0) == higher_is_better(name)) {
+                    verdict = "improved";
+                    ++improvements;
+                } else {
+                    verdict = "REGRESSED";
+                    ++regressions;
+                }
+            }
+            if (!all && (verdict == "same" || (verdict == "n/a" && delta == 0))) continue;
+
+            std::printf("%s\t%s\t%s\t%.6g\t%.6g\t%+.6g\t%+.2f", key.first.c_str(), key.second.c_str(),
+                        name.c_str(), va, vb, delta, pct);
+            if (ci) std::printf("\t%+.6g\t%+.6g", ci->lo, ci->hi);
+            else std::printf("\t\t");
+            std::printf("\t%s\n", verdict.c_str());
+        }
+    }
+    for (const auto& [key, _] : *cand) {
+        if (!base->contains(key)) ++unmatched;
+    }
+
+    std::fflush(stdout);
+    std::cerr << compared << " metrics compared, " << regressions << " regressed, "
+              << improvements << " improved";
+    if (unmatched != 0) std::cerr << ", " << unmatched << " rows in only one file";
+    std::cerr << '\n';
+    return regressions != 0 ? 1 : 0;
+}
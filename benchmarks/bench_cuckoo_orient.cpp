@@ -0,0 +1,175 @@
+/**
+ * @file bench_cuckoo_orient.cpp
+ * @brief Seed trials per second: cuckoo_orient vs cuckoo_orient_fixed.
+ *
+ * shock_hash tries seeds for each bucket until one's 2-choice graph
+ * orients, and a full bucket can need millions of trials, so the cost of
+ * one orientation attempt bounds build time. This program times both
+ * variants on the same pool of random bucket graphs:
+ *
+ *   vector   detail::cuckoo_orient (adjacency in vectors of vectors)
+ *   fixed    detail::cuckoo_orient_fixed<B> (stack CSR, no allocation)
+ *
+ * Each graph has `load% * B` edges with distinct random endpoints in
+ * [0, B), as shock_hash's positions are. Low loads mostly orient and
+ * exercise the whole algorithm; full buckets mostly fail early.
+ *
+ * Usage:
+ *   bench_cuckoo_orient                          # loads 25,50,75,100 %
+ *   bench_cuckoo_orient --trials=200000 --loads=50,100
+ *   bench_cuckoo_orient --counters               # + hardware counters per trial
+ *
+ * Output is one TSV row per (variant, B, load) with the median of 7 runs;
+ * the counter columns, when on, are averaged over all 7.
+ * Both variants must agree on every graph; a mismatch is reported on
+ * stderr and the exit code is 1.
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/detail/cuckoo_orient.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+constexpr size_t POOL_SIZE = 4096;
+constexpr int REPETITIONS = 7;
+
+struct graph {
+    std::vector<uint8_t> first, second;
+};
+
+std::vector<graph> make_pool(size_t bucket_size, size_t edges) {
+    std::mt19937_64 rng{42};
+    std::uniform_int_distribution<uint32_t> pos(0, static_cast<uint32_t>(bucket_size - 1));
+    std::vector<graph> pool(POOL_SIZE);
+    for (auto& g : pool) {
+        for (size_t i = 0; i < edges; ++i) {
+            uint32_t a = pos(rng);
+            uint32_t b = pos(rng);
+            if (a == b) b = (b + 1) % static_cast<uint32_t>(bucket_size);
+            g.first.push_back(static_cast<uint8_t>(a));
+            g.second.push_back(static_cast<uint8_t>(b));
+        }
+    }
+    return pool;
+}
+
+struct timing {
+    double trials_per_s;
+    counter_sample counters;  // per trial
+};
+
+// Median trials per second over REPETITIONS runs of `trials` calls.
+template<typename Fn>
+timing time_trials(const std::vector<graph>& pool, size_t trials, Fn&& fn) {
+    std::vector<double> samples;
+    samples.reserve(REPETITIONS);
+    counter_scope counted;
+    for (int rep = 0; rep < REPETITIONS; ++rep) {
+        size_t ok = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < trials; ++i) ok += fn(pool[i % POOL_SIZE]) ? 1 : 0;
+        auto t1 = std::chrono::steady_clock::now();
+        consume(slot_index{ok});
+        samples.push_back(static_cast<double>(trials) /
+                          std::chrono::duration<double>(t1 - t0).count());
+    }
+    const counter_sample counts = counted.stop();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2],
+            counts.per(static_cast<double>(trials) * REPETITIONS)};
+}
+
+template<size_t B>
+bool run(size_t load_pct, size_t trials) {
+    const size_t edges = std::clamp<size_t>(load_pct * B / 100, 1, B);
+    auto pool = make_pool(B, edges);
+
+    auto orient_vector = [](const graph& g, std::vector<uint8_t>* out = nullptr) {
+        std::vector<std::pair<uint32_t, uint32_t>> e;
+        e.reserve(g.first.size());
+        for (size_t i = 0; i < g.first.size(); ++i) e.emplace_back(g.first[i], g.second[i]);
+        auto r = detail::cuckoo_orient(e, B);
+        if (r && out) *out = r->assignment;
+        return r.has_value();
+    };
+    auto orient_fixed = [](const graph& g, uint8_t* out) {
+        return detail::cuckoo_orient_fixed<B>(g.first, g.second,
+                                              std::span<uint8_t>{out, g.first.size()});
+    };
+
+    // Agreement and success rate.
+    size_t succeeded = 0;
+    bool agree = true;
+    for (const auto& g : pool) {
+        std::vector<uint8_t> expected;
+        std::array<uint8_t, B> got{};
+        const bool a = orient_vector(g, &expected);
+        const bool b = orient_fixed(g, got.data());
+        if (a != b || (a && !std::equal(expected.begin(), expected.end(), got.begin()))) {
+            agree = false;
+        }
+        succeeded += a ? 1 : 0;
+    }
+    if (!agree) std::cerr << "MISMATCH at B=" << B << " load=" << load_pct << "%\n";
+
+    const timing vec = time_trials(pool, trials, [&](const graph& g) { return orient_vector(g); });
+    const timing fix = time_trials(pool, trials, [&](const graph& g) {
+        std::array<uint8_t, B> out;
+        return orient_fixed(g, out.data());
+    });
+    const double rate = static_cast<double>(succeeded) / static_cast<double>(POOL_SIZE);
+    for (auto [name, t] : {std::pair{"vector", vec}, std::pair{"fixed", fix}}) {
+        std::cout << name << '\t' << B << '\t' << edges << '\t'
+                  << std::fixed << std::setprecision(3) << rate << '\t'
+                  << std::setprecision(2) << t.trials_per_s / 1e6 << '\t'
+                  << std::setprecision(1) << 1e9 / t.trials_per_s;
+        if (counters_active()) print_counter_tsv(std::cout, t.counters);
+        std::cout << '\n';
+        record_result()
+            .config("variant", name).config("bucket_size", static_cast<double>(B))
+            .config("edges", static_cast<double>(edges))
+            .metric("success_rate", rate)
+            .metric("mtrials_per_s", t.trials_per_s / 1e6)
+            .metric("ns_per_trial", 1e9 / t.trials_per_s);
+    }
+    return agree;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    size_t trials = args.get_size("trials", 1'000'000);
+    auto loads = args.get_size_list("loads", {25, 50, 75, 100});
+
+    std::cerr << "cuckoo_orient seed trials\n"
+              << "  trials per run: " << trials << "\n\n";
+
+    std::cout << "variant\tbucket_size\tedges\tsuccess_rate\tmtrials_per_s\tns_per_trial";
+    if (counters_active()) print_counter_tsv_header(std::cout, "");
+    std::cout << '\n';
+    bool ok = true;
+    for (size_t load : loads) {
+        ok &= run<32>(load, trials);
+        ok &= run<64>(load, trials);
+        ok &= run<128>(load, trials);
+        std::cout << '\n';
+    }
+    return ok ? 0 : 1;
+}
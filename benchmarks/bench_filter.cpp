@@ -11,23 +11,39 @@
  *   - bits per key (actual, including any structural overhead)
  *   - in-memory bytes, serialized bytes
  *   - verify() median/p99 latency (ns/query), throughput (MQPS)
+ *   - batched verify cost (ns/key through maph::verify_batch, which uses
+ *     the filters' window-prefetch / gather verify_batch)
  *   - empirical false positive rate (unknown keys misreported as members)
  *
+ * block_bloom rows are the one-cache-line baseline: their "<N>" is bits
+ * per key, not fingerprint bits, and they are built with 8 threads.
+ * The space/latency trade-off of the xor family reads down the rows at
+ * one width: xor (3 reads), xor_plus (3 rank + 3 value reads, ~M + 1.4
+ * b/k), binary_fuse (3 reads, ~1.125 M) and binary_fuse4 (4 reads,
+ * ~1.075 M).
+ *
  * Usage:
  *   bench_filter                    # default: 10000 100000
  *   bench_filter 1000 50000         # custom
+ *   bench_filter --counters         # add hardware counter columns
  */
 
 #include "bench_harness.hpp"
 
+#include <maph/concepts/membership_oracle.hpp>
 #include <maph/filters/binary_fuse_filter.hpp>
+#include <maph/filters/block_bloom_filter.hpp>
 #include <maph/filters/ribbon_filter.hpp>
 #include <maph/filters/xor_filter.hpp>
+#include <maph/filters/xor_plus_filter.hpp>
 
 #include <chrono>
+#include <concepts>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -62,40 +78,75 @@ query_stats measure_oracle(const Oracle& o,
     using std::chrono::duration_cast;
     using std::chrono::nanoseconds;
 
-    std::mt19937_64 rng{seed};
-    std::uniform_int_distribution<size_t> kd(0, keys.size() - 1);
-    std::vector<size_t> indices(total_queries);
-    for (auto& i : indices) i = kd(rng);
+    const query_stream<std::string> queries(keys, total_queries, seed);
 
     for (size_t i = 0; i < 10000 && i < total_queries; ++i) {
-        consume(o.verify(keys[indices[i]]));
+        consume(o.verify(queries[i]));
     }
 
     const size_t M = total_queries / sub_batch_size;
     std::vector<double> batch_ns;
     batch_ns.reserve(M);
 
+    counter_scope counted;
+    double timed_ns = 0;
     auto global_start = clock::now();
     for (size_t m = 0; m < M; ++m) {
+        cool_caches(counted);
         size_t base = m * sub_batch_size;
         auto t0 = clock::now();
         for (size_t b = 0; b < sub_batch_size; ++b) {
-            consume(o.verify(keys[indices[base + b]]));
+            consume(o.verify(queries[base + b]));
         }
         auto t1 = clock::now();
-        batch_ns.push_back(
-            static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count())
-            / static_cast<double>(sub_batch_size));
+        const double ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count());
+        timed_ns += ns;
+        batch_ns.push_back(ns / static_cast<double>(sub_batch_size));
     }
     auto global_end = clock::now();
+    const counter_sample counts = counted.stop();
 
     std::sort(batch_ns.begin(), batch_ns.end());
     double median = batch_ns[M / 2];
     double p99 = batch_ns[static_cast<size_t>(M * 0.99)];
-    double total_ns = static_cast<double>(
+    double total_ns = current_workload().cold ? timed_ns : static_cast<double>(
         duration_cast<nanoseconds>(global_end - global_start).count());
     double mqps = (static_cast<double>(M * sub_batch_size) / total_ns) * 1000.0;
-    return {median, p99, mqps};
+    return {median, p99, mqps, counts.per(static_cast<double>(M * sub_batch_size)),
+            std::move(batch_ns)};
+}
+
+// Median ns/key of maph::verify_batch over the measure_oracle() index
+// sequence, pre-resolved to string_views.
+template<typename Oracle>
+double measure_oracle_batch(const Oracle& o,
+                            const std::vector<std::string>& keys,
+                            size_t total_queries = 1'000'000,
+                            size_t batch_size = 1000,
+                            uint64_t seed = 12345) {
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    const auto queries = query_stream<std::string>(keys, total_queries, seed).views();
+    auto out = std::make_unique<bool[]>(batch_size);
+    std::span<bool> out_span{out.get(), batch_size};
+
+    const size_t M = total_queries / batch_size;
+    std::vector<double> batch_ns;
+    batch_ns.reserve(M);
+    for (size_t m = 0; m < M; ++m) {
+        cool_caches();
+        auto t0 = clock::now();
+        verify_batch(o, std::span(queries).subspan(m * batch_size, batch_size), out_span);
+        auto t1 = clock::now();
+        for (bool b : out_span) consume(b);
+        batch_ns.push_back(static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count())
+                           / static_cast<double>(batch_size));
+    }
+    if (batch_ns.empty()) return 0.0;
+    std::sort(batch_ns.begin(), batch_ns.end());
+    return batch_ns[batch_ns.size() / 2];
 }
 
 template<typename Oracle>
@@ -127,9 +178,11 @@ result_row run_oracle(const std::string& name,
 
     Oracle o;
     reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     bool built = build_into(o);
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     r.build_peak_rss_kb = get_peak_rss_kb();
 
@@ -144,6 +197,9 @@ result_row run_oracle(const std::string& name,
     r.query_median_ns = qs.median_ns;
     r.query_p99_ns = qs.p99_ns;
     r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+    r.query_batch_ns = measure_oracle_batch(o, keys, total_queries);
 
     r.fp_rate = measure_fpr(o, unknowns);
     return r;
@@ -152,11 +208,8 @@ result_row run_oracle(const std::string& name,
 } // namespace
 
 int main(int argc, char** argv) {
-    std::vector<size_t> key_counts = {10'000, 100'000};
-    if (argc > 1) {
-        key_counts.clear();
-        for (int i = 1; i < argc; ++i) key_counts.push_back(std::stoul(argv[i]));
-    }
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({10'000, 100'000});
 
     const size_t total_queries = 1'000'000;
     const size_t num_unknowns = 100'000;  // for FPR estimation
@@ -182,52 +235,105 @@ int main(int argc, char** argv) {
                 [&](F& o) { return o.build(keys); },
                 total_queries);
             if (r.ok) std::cerr << " " << r.build_ms << "ms, " << r.bits_per_key
-                                << " b/k, " << r.query_median_ns << " ns/q, fp="
+                                << " b/k, " << r.query_median_ns << " ns/q, "
+                                << r.query_batch_ns << " ns/q batched, fp="
                                 << r.fp_rate << "\n";
             else      std::cerr << " BUILD FAILED\n";
             print_tsv_row(std::cout, r);
             std::cout.flush();
         };
 
-        auto run_ribbon = [&](auto tag, unsigned bits) {
-            using F = ribbon_filter<decltype(tag)::value>;
-            std::cerr << "  ribbon<" << bits << "> ..." << std::flush;
+        auto run_ribbon = [&](auto tag, unsigned bits, auto layout) {
+            using L = decltype(layout);
+            using F = ribbon_filter<decltype(tag)::value, L>;
+            const std::string name =
+                std::same_as<L, interleaved_solution> ? "ribbon_il" : "ribbon";
+            std::cerr << "  " << name << "<" << bits << "> ..." << std::flush;
             auto r = run_oracle<F>(
-                "ribbon", bits, keys, unknowns,
+                name, bits, keys, unknowns,
                 [&](F& o) { return o.build(keys); },
                 total_queries);
             if (r.ok) std::cerr << " " << r.build_ms << "ms, " << r.bits_per_key
-                                << " b/k, " << r.query_median_ns << " ns/q, fp="
+                                << " b/k, " << r.query_median_ns << " ns/q, "
+                                << r.query_batch_ns << " ns/q batched, fp="
                                 << r.fp_rate << "\n";
             else      std::cerr << " BUILD FAILED\n";
             print_tsv_row(std::cout, r);
             std::cout.flush();
         };
 
-        auto run_binary_fuse = [&](auto tag, unsigned bits) {
-            using F = binary_fuse_filter<decltype(tag)::value>;
-            std::cerr << "  binary_fuse<" << bits << "> ..." << std::flush;
+        auto run_xor_plus = [&](auto tag, unsigned bits) {
+            using F = xor_plus_filter<decltype(tag)::value>;
+            std::cerr << "  xor_plus<" << bits << "> ..." << std::flush;
             auto r = run_oracle<F>(
-                "binary_fuse", bits, keys, unknowns,
+                "xor_plus", bits, keys, unknowns,
                 [&](F& o) { return o.build(keys); },
                 total_queries);
             if (r.ok) std::cerr << " " << r.build_ms << "ms, " << r.bits_per_key
-                                << " b/k, " << r.query_median_ns << " ns/q, fp="
+                                << " b/k, " << r.query_median_ns << " ns/q, "
+                                << r.query_batch_ns << " ns/q batched, fp="
+                                << r.fp_rate << "\n";
+            else      std::cerr << " BUILD FAILED\n";
+            print_tsv_row(std::cout, r);
+            std::cout.flush();
+        };
+
+        auto run_binary_fuse = [&](auto tag, unsigned bits, auto arity) {
+            using F = binary_fuse_filter<decltype(tag)::value, decltype(arity)::value>;
+            const std::string name = arity() == 4 ? "binary_fuse4" : "binary_fuse";
+            std::cerr << "  " << name << "<" << bits << "> ..." << std::flush;
+            auto r = run_oracle<F>(
+                name, bits, keys, unknowns,
+                [&](F& o) { return o.build(keys); },
+                total_queries);
+            if (r.ok) std::cerr << " " << r.build_ms << "ms, " << r.bits_per_key
+                                << " b/k, " << r.query_median_ns << " ns/q, "
+                                << r.query_batch_ns << " ns/q batched, fp="
+                                << r.fp_rate << "\n";
+            else      std::cerr << " BUILD FAILED\n";
+            print_tsv_row(std::cout, r);
+            std::cout.flush();
+        };
+
+        auto run_block_bloom = [&](auto tag, unsigned bits) {
+            using F = block_bloom_filter<decltype(tag)::value>;
+            std::cerr << "  block_bloom<" << bits << "> ..." << std::flush;
+            auto r = run_oracle<F>(
+                "block_bloom", bits, keys, unknowns,
+                [&](F& o) { return o.build(keys, 8); },
+                total_queries);
+            if (r.ok) std::cerr << " " << r.build_ms << "ms, " << r.bits_per_key
+                                << " b/k, " << r.query_median_ns << " ns/q, "
+                                << r.query_batch_ns << " ns/q batched, fp="
                                 << r.fp_rate << "\n";
             else      std::cerr << " BUILD FAILED\n";
             print_tsv_row(std::cout, r);
             std::cout.flush();
         };
 
+        run_block_bloom(std::integral_constant<unsigned, 10>{}, 10);
+        run_block_bloom(std::integral_constant<unsigned, 12>{}, 12);
+        run_block_bloom(std::integral_constant<unsigned, 16>{}, 16);
         run_xor(std::integral_constant<unsigned, 8>{}, 8);
         run_xor(std::integral_constant<unsigned, 16>{}, 16);
         run_xor(std::integral_constant<unsigned, 32>{}, 32);
-        run_ribbon(std::integral_constant<unsigned, 8>{}, 8);
-        run_ribbon(std::integral_constant<unsigned, 16>{}, 16);
-        run_ribbon(std::integral_constant<unsigned, 32>{}, 32);
-        run_binary_fuse(std::integral_constant<unsigned, 8>{}, 8);
-        run_binary_fuse(std::integral_constant<unsigned, 16>{}, 16);
-        run_binary_fuse(std::integral_constant<unsigned, 32>{}, 32);
+        run_xor_plus(std::integral_constant<unsigned, 8>{}, 8);
+        run_xor_plus(std::integral_constant<unsigned, 16>{}, 16);
+        run_xor_plus(std::integral_constant<unsigned, 32>{}, 32);
+        run_ribbon(std::integral_constant<unsigned, 8>{}, 8, flat_solution{});
+        run_ribbon(std::integral_constant<unsigned, 16>{}, 16, flat_solution{});
+        run_ribbon(std::integral_constant<unsigned, 32>{}, 32, flat_solution{});
+        run_ribbon(std::integral_constant<unsigned, 8>{}, 8, interleaved_solution{});
+        run_ribbon(std::integral_constant<unsigned, 16>{}, 16, interleaved_solution{});
+        run_ribbon(std::integral_constant<unsigned, 32>{}, 32, interleaved_solution{});
+        using three_wise = std::integral_constant<unsigned, 3>;
+        using four_wise = std::integral_constant<unsigned, 4>;
+        run_binary_fuse(std::integral_constant<unsigned, 8>{}, 8, three_wise{});
+        run_binary_fuse(std::integral_constant<unsigned, 16>{}, 16, three_wise{});
+        run_binary_fuse(std::integral_constant<unsigned, 32>{}, 32, three_wise{});
+        run_binary_fuse(std::integral_constant<unsigned, 8>{}, 8, four_wise{});
+        run_binary_fuse(std::integral_constant<unsigned, 16>{}, 16, four_wise{});
+        run_binary_fuse(std::integral_constant<unsigned, 32>{}, 32, four_wise{});
     }
     return 0;
 }
@@ -15,21 +15,46 @@
  *
  * - **Volatile sink**: prevents DCE of slot_for() results without requiring
  *   Google benchmark's DoNotOptimize or inline asm.
+ *
+ * - **Hardware counters** (perf_counters.hpp): with --counters, the timed
+ *   query and build loops also count cycles, instructions and misses.
+ *   query_stats and result_row carry them per query and per key.
+ *
+ * - **Workloads** (workload.hpp): the query loops draw their keys from
+ *   query_stream, which follows the run's workload (uniform, Zipf,
+ *   hot/cold, a share of non-members) and, with --cold, flushes the
+ *   caches between timed batches.
+ *
+ * - **JSON results** (result_log.hpp): with --json=FILE each printed row is
+ *   also written to FILE as a JSON line, with the sub-batch samples behind
+ *   its latency figures, for bench_compare.
  */
 
 #pragma once
 
 #include <maph/core.hpp>
+#include <maph/concepts/perfect_hash_function.hpp>
+#include <maph/detail/hash.hpp>
+
+#include "perf_counters.hpp"
+#include "result_log.hpp"
+#include "workload.hpp"
 
 #include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace maph::bench {
@@ -43,6 +68,11 @@ inline volatile uint64_t sink = 0;
 inline void consume(slot_index s) noexcept { sink ^= s.value; }
 inline void consume(bool b) noexcept { sink ^= b ? 1 : 0; }
 
+template<typename T>
+inline void consume(const std::optional<T>& v) noexcept {
+    sink = sink ^ (v ? static_cast<uint64_t>(*v) + 1 : 0);
+}
+
 // ===== KEY GENERATION =====
 //
 // Multiple distributions are supported. All are deterministic given the seed.
@@ -117,6 +147,26 @@ inline std::vector<std::string> gen_variable_length_keys(
     return keys;
 }
 
+// Distinct random 64-bit integer keys, sorted. Built and queried through
+// the integer-key overloads (integer_key): each is the key of its 8
+// little-endian bytes, hashed without a string.
+inline std::vector<uint64_t> gen_u64_keys(size_t count, uint64_t seed = 42) {
+    std::vector<uint64_t> keys(count);
+    std::mt19937_64 rng{seed};
+    for (auto& k : keys) k = rng();
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// The string keys gen_u64_keys() stands for, for like-for-like runs.
+inline std::vector<std::string> u64_key_strings(const std::vector<uint64_t>& keys) {
+    std::vector<std::string> out;
+    out.reserve(keys.size());
+    for (const auto& k : keys) out.emplace_back(integer_key_bytes(k));
+    return out;
+}
+
 // Dispatch by name. Useful for CLI: "--distribution=url".
 inline std::vector<std::string>
 gen_keys_by_name(const std::string& name, size_t count, uint64_t seed = 42) {
@@ -150,6 +200,20 @@ inline size_t get_peak_rss_kb() {
     return 0;
 }
 
+// Current resident set size (VmRSS), same source and fallback.
+inline size_t get_rss_kb() {
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            size_t kb = 0;
+            for (char c : line) if (c >= '0' && c <= '9') kb = kb * 10 + (c - '0');
+            return kb;
+        }
+    }
+    return 0;
+}
+
 inline void reset_peak_rss() {
     // Write "5" to clear_refs to reset VmHWM. See proc(5) / kernel docs.
     std::ofstream f("/proc/self/clear_refs");
@@ -158,22 +222,40 @@ inline void reset_peak_rss() {
 
 // ===== QUERY TIMING =====
 
+// Between two timed batches: with --cold, evict the caches, outside both
+// the timed and the counted region.
+inline void cool_caches(counter_scope& counted) {
+    if (!current_workload().cold) return;
+    counted.pause();
+    sink = sink ^ shared_flusher().flush();
+    counted.resume();
+}
+
+inline void cool_caches() {
+    if (!current_workload().cold) return;
+    sink = sink ^ shared_flusher().flush();
+}
+
 struct query_stats {
     double median_ns;     // ns per query, median of sub-batch averages
     double p99_ns;        // ns per query, 99th percentile of sub-batch averages
     double throughput_mqps;  // millions of queries per second, from single batch
+    counter_sample counters{};  // per query over all sub-batches; NaN unless --counters
+    std::vector<double> samples{};  // ns per query of each sub-batch, sorted
 };
 
 /**
  * Measure query throughput and per-query latency percentiles.
  *
  * total_queries = M * B. Each of M sub-batches times B queries, producing
- * M samples. Throughput is derived from total elapsed time over total_queries.
+ * M samples. Throughput is derived from total elapsed time over total_queries
+ * (over the sum of the sub-batch times with --cold, which flushes between
+ * them). The keys follow the run's workload.
  */
-template<typename PHF>
+template<typename PHF, typename Key>
 query_stats measure_queries(
     const PHF& phf,
-    const std::vector<std::string>& keys,
+    const std::vector<Key>& keys,
     size_t total_queries = 1'000'000,
     size_t sub_batch_size = 1000,
     uint64_t seed = 12345)
@@ -182,15 +264,12 @@ query_stats measure_queries(
     using std::chrono::duration_cast;
     using std::chrono::nanoseconds;
 
-    // Precompute a random sequence of key indices.
-    std::mt19937_64 rng{seed};
-    std::uniform_int_distribution<size_t> kd(0, keys.size() - 1);
-    std::vector<size_t> indices(total_queries);
-    for (auto& i : indices) i = kd(rng);
+    // Precompute the query sequence.
+    const query_stream<Key> queries(keys, total_queries, seed);
 
     // Warm up: caches, TLB, branch predictors. Discarded.
     for (size_t i = 0; i < 10000 && i < total_queries; ++i) {
-        consume(phf.slot_for(keys[indices[i]]));
+        consume(phf.slot_for(queries[i]));
     }
 
     // Sub-batch timing for percentiles.
@@ -198,41 +277,105 @@ query_stats measure_queries(
     std::vector<double> batch_ns_per_query;
     batch_ns_per_query.reserve(M);
 
+    counter_scope counted;
+    double timed_ns = 0;
     auto global_start = clock::now();
     for (size_t m = 0; m < M; ++m) {
+        cool_caches(counted);
         size_t base = m * sub_batch_size;
         auto t0 = clock::now();
         for (size_t b = 0; b < sub_batch_size; ++b) {
-            consume(phf.slot_for(keys[indices[base + b]]));
+            consume(phf.slot_for(queries[base + b]));
         }
         auto t1 = clock::now();
         double batch_ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count());
+        timed_ns += batch_ns;
         batch_ns_per_query.push_back(batch_ns / static_cast<double>(sub_batch_size));
     }
     auto global_end = clock::now();
+    const counter_sample counts = counted.stop();
 
     std::sort(batch_ns_per_query.begin(), batch_ns_per_query.end());
     double median = batch_ns_per_query[M / 2];
     double p99 = batch_ns_per_query[static_cast<size_t>(M * 0.99)];
 
-    double total_ns = static_cast<double>(
+    double total_ns = current_workload().cold ? timed_ns : static_cast<double>(
         duration_cast<nanoseconds>(global_end - global_start).count());
     double mqps = (static_cast<double>(M * sub_batch_size) / total_ns) * 1000.0;
 
-    return {median, p99, mqps};
+    return {median, p99, mqps, counts.per(static_cast<double>(M * sub_batch_size)),
+            std::move(batch_ns_per_query)};
+}
+
+/**
+ * Measure batched lookup cost through maph::slot_for_batch().
+ *
+ * Same query index sequence as measure_queries(), issued in batches of
+ * batch_size keys. Returns the median ns/key over the batches. PHFs
+ * without a native slot_for_batch() go through the scalar fallback; that
+ * fallback, not query_median_ns, is the like-for-like baseline (the
+ * queries are pre-resolved to string_views, so the index indirection of
+ * measure_queries() is absent from both). With counters, *counters
+ * receives the per-key counts over the timed batches.
+ */
+template<perfect_hash_function PHF>
+double measure_batch_queries(
+    const PHF& phf,
+    const std::vector<std::string>& keys,
+    size_t total_queries = 1'000'000,
+    size_t batch_size = 1000,
+    uint64_t seed = 12345,
+    counter_sample* counters = nullptr)
+{
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    const auto queries = query_stream<std::string>(keys, total_queries, seed).views();
+    std::vector<slot_index> out(batch_size);
+
+    const size_t M = total_queries / batch_size;
+    for (size_t m = 0; m < M && m * batch_size < 10000; ++m) {
+        slot_for_batch(phf, std::span(queries).subspan(m * batch_size, batch_size), out);
+        consume(out[0]);
+    }
+
+    std::vector<double> batch_ns_per_query;
+    batch_ns_per_query.reserve(M);
+    counter_scope counted;
+    for (size_t m = 0; m < M; ++m) {
+        cool_caches(counted);
+        auto t0 = clock::now();
+        slot_for_batch(phf, std::span(queries).subspan(m * batch_size, batch_size), out);
+        auto t1 = clock::now();
+        for (auto s : out) consume(s);
+        double batch_ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count());
+        batch_ns_per_query.push_back(batch_ns / static_cast<double>(batch_size));
+    }
+    const counter_sample counts = counted.stop();
+    if (counters != nullptr) *counters = counts.per(static_cast<double>(M * batch_size));
+    if (batch_ns_per_query.empty()) return 0.0;
+
+    std::sort(batch_ns_per_query.begin(), batch_ns_per_query.end());
+    return batch_ns_per_query[M / 2];
 }
 
 // ===== BUILD TIMING =====
 
+// With counters, *counters receives the build's totals; divide by the key
+// count for the per-key figures result_row reports.
 template<typename BuildFn>
-double measure_build_ms(BuildFn&& fn) {
+double measure_build_ms(BuildFn&& fn, counter_sample* counters = nullptr) {
     using clock = std::chrono::high_resolution_clock;
     using std::chrono::duration_cast;
     using std::chrono::microseconds;
 
+    counter_scope counted;
     auto t0 = clock::now();
     fn();
     auto t1 = clock::now();
+    const counter_sample counts = counted.stop();
+    if (counters != nullptr) *counters = counts;
     return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
 }
 
@@ -250,14 +393,25 @@ struct result_row {
     double query_median_ns;
     double query_p99_ns;
     double query_mqps;
+    double query_batch_ns = std::numeric_limits<double>::quiet_NaN();  // slot_for_batch ns/key; NaN if not measured
     double fp_rate;  // empirical false-positive rate; 0 for pure PHF, NaN if not measured
     bool ok;
+    counter_sample query_counters{};  // per query (measure_queries)
+    counter_sample build_counters{};  // per key
+    std::vector<double> query_samples{};  // measure_queries sub-batch samples, for --json
 };
 
+// With counters active, rows gain q_* (per query) and b_* (per built key)
+// columns after ok; without, the columns are exactly as before.
 inline void print_tsv_header(std::ostream& os) {
     os << "algorithm\tkeys\trange\tbuild_ms\tbuild_peak_kb\tbits_per_key\t"
           "mem_bytes\tser_bytes\tquery_med_ns\tquery_p99_ns\tthroughput_mqps\t"
-          "fp_rate\tok\n";
+          "query_batch_ns\tfp_rate\tok";
+    if (counters_active()) {
+        print_counter_tsv_header(os, "q_");
+        print_counter_tsv_header(os, "b_");
+    }
+    os << '\n';
 }
 
 inline void print_tsv_row(std::ostream& os, const result_row& r) {
@@ -273,8 +427,30 @@ inline void print_tsv_row(std::ostream& os, const result_row& r) {
        << std::setprecision(2) << r.query_median_ns << '\t'
        << r.query_p99_ns << '\t'
        << r.query_mqps << '\t'
+       << r.query_batch_ns << '\t'
        << std::setprecision(10) << r.fp_rate << '\t'
-       << (r.ok ? "1" : "0") << '\n';
+       << (r.ok ? "1" : "0");
+    if (counters_active()) {
+        print_counter_tsv(os, r.query_counters);
+        print_counter_tsv(os, r.build_counters);
+    }
+    os << '\n';
+
+    record_result()
+        .config("algorithm", r.algorithm).config("keys", static_cast<double>(r.key_count))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("range", static_cast<double>(r.range_size))
+        .metric("build_ms", r.build_ms)
+        .metric("build_peak_kb", static_cast<double>(r.build_peak_rss_kb))
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("mem_bytes", static_cast<double>(r.memory_bytes))
+        .metric("ser_bytes", static_cast<double>(r.serialized_bytes))
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("query_p99_ns", r.query_p99_ns)
+        .metric("throughput_mqps", r.query_mqps)
+        .metric("query_batch_ns", r.query_batch_ns)
+        .metric("fp_rate", r.fp_rate)
+        .samples("query_med_ns", r.query_samples);
 }
 
 // ===== CLI ARGUMENT PARSING =====
@@ -294,6 +470,8 @@ class cli_args {
     std::vector<std::pair<std::string, std::string>> named_;
 
 public:
+    // --counters turns on hardware counters (perf_counters.hpp) for the
+    // whole run; --json=FILE opens the result log (result_log.hpp).
     cli_args(int argc, char** argv) {
         for (int i = 1; i < argc; ++i) {
             std::string arg = argv[i];
@@ -309,6 +487,49 @@ public:
                 positional_.push_back(std::move(arg));
             }
         }
+        if (has("counters")) counters_requested() = true;
+        if (auto path = get_string("json", ""); !path.empty()) {
+            std::string bench = argc > 0 ? argv[0] : "bench";
+            bench = bench.substr(bench.find_last_of('/') + 1);
+            if (!open_result_log(path, std::move(bench))) {
+                std::cerr << "--json: cannot write " << path << '\n';
+            }
+        }
+        // Open them now, so that an "unavailable" note comes before any output.
+        (void)shared_counters();
+        set_workload();
+    }
+
+    // The workload flags of workload.hpp, into current_workload().
+    void set_workload() const {
+        workload& wl = current_workload();
+        const auto kind = get_string("workload", has("zipf_s") ? "zipf" : "uniform");
+        if (kind == "zipf") wl.dist = workload::distribution::zipf;
+        else if (kind == "hotcold") wl.dist = workload::distribution::hot_cold;
+        wl.zipf_s = get_double("zipf_s", wl.zipf_s);
+        wl.hot_keys = std::clamp(get_double("hot_keys", wl.hot_keys), 0.0, 1.0);
+        wl.hot_share = std::clamp(get_double("hot_share", wl.hot_share), 0.0, 1.0);
+        wl.negative = std::clamp(get_double("negative", wl.negative), 0.0, 1.0);
+        wl.cold = has("cold");
+        wl.flush_bytes = get_size("flush_mb", 0) << 20;
+        if (!wl.is_default()) std::cerr << "workload: " << wl.describe() << '\n';
+    }
+
+    // Positional arguments as sizes (key counts); fallback when there are
+    // none. Anything but a positive integer ends the run with status 2.
+    std::vector<size_t> positional_sizes(std::vector<size_t> fallback) const {
+        if (positional_.empty()) return fallback;
+        std::vector<size_t> out;
+        for (const auto& p : positional_) {
+            size_t v = 0;
+            auto [end, ec] = std::from_chars(p.data(), p.data() + p.size(), v);
+            if (ec != std::errc{} || end != p.data() + p.size() || v == 0) {
+                std::cerr << "bad key count '" << p << "': expected a positive integer\n";
+                std::exit(2);
+            }
+            out.push_back(v);
+        }
+        return out;
     }
 
     const std::vector<std::string>& positional() const { return positional_; }
@@ -0,0 +1,253 @@
+/**
+ * @file bench_hash.cpp
+ * @brief Key-hash throughput: format-v2 FNV-1a vs the word-at-a-time digest.
+ *
+ * Every PHF and filter starts each query (and each build step) by hashing
+ * the key, so for short keys the hash is a large share of query latency
+ * and for long keys it dominates build time. This program times each hash
+ * variant over a fixed pool of random keys at several key lengths:
+ *
+ *   fnv_seeded        phf_hash_with_seed_fnv (v2 PHF hash, byte loop)
+ *   wide_seeded       phf_hash_with_seed (v3 default)
+ *   digest_scalar     phf_hash128 with the scalar stripe loop
+ *   digest_simd       phf_hash128 with the AVX2/NEON stripe loop
+ *   fingerprint_fnv   membership_fingerprint_fnv (v2 filter hash)
+ *   fingerprint_wide  membership_fingerprint (v3 default)
+ *   digest_int        phf_hash128_u64 / _u128 of the key read as an
+ *                     integer (8- and 16-byte keys only)
+ *
+ * digest_scalar and digest_simd only differ above 256 bytes, where keys
+ * go through the striped accumulator.
+ *
+ * A second table times a build's hash pass over keys of mixed lengths,
+ * packed in one buffer as a key_store packs them: phf_hash128 one key at
+ * a time (digest_loop) against phf_hash128_batch (digest_batch), over a
+ * cache-resident pool and over one of --batch_keys keys.
+ *
+ * Usage:
+ *   bench_hash                                   # default lengths
+ *   bench_hash --lengths=8,16,64 --keys=1000000  # hashes per measurement
+ *   bench_hash --counters                        # + hardware counters per hash
+ *   bench_hash --ranges=4-16,20-160 --batch_keys=4000000
+ *
+ * Output is one TSV row per (hash, key_len) with the median of 7 runs;
+ * the counter columns, when on, are averaged over all 7.
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/detail/fingerprint_hash.hpp>
+#include <maph/detail/hash.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+// Small enough to stay cache-resident at 1 KiB keys, so the numbers
+// measure hashing rather than memory bandwidth.
+constexpr size_t POOL_SIZE = 1024;
+constexpr int REPETITIONS = 7;
+
+std::vector<std::string> make_pool(size_t len) {
+    std::mt19937_64 rng{42};
+    std::vector<std::string> pool(POOL_SIZE);
+    for (auto& s : pool) {
+        s.resize(len);
+        for (auto& c : s) c = static_cast<char>(rng());
+    }
+    return pool;
+}
+
+struct timing {
+    double ns;
+    counter_sample counters;
+    std::vector<double> samples{};  // per pass, sorted; for --json
+};
+
+// Median ns per hash over REPETITIONS runs of `total` calls.
+template<typename Fn>
+timing time_hash(const std::vector<std::string>& pool, size_t total, Fn&& fn) {
+    std::vector<std::string_view> views(pool.begin(), pool.end());
+    std::vector<double> samples;
+    samples.reserve(REPETITIONS);
+    counter_scope counted;
+    for (int rep = 0; rep < REPETITIONS; ++rep) {
+        uint64_t acc = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < total; ++i) {
+            acc += fn(views[i % POOL_SIZE], i);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        consume(slot_index{acc});
+        samples.push_back(
+            std::chrono::duration<double, std::nano>(t1 - t0).count() /
+            static_cast<double>(total));
+    }
+    const counter_sample counts = counted.stop();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2],
+            counts.per(static_cast<double>(total) * REPETITIONS),
+            std::move(samples)};
+}
+
+void print_header() {
+    std::cout << "hash\tkey_len\tns_per_key\tgb_per_s";
+    if (counters_active()) print_counter_tsv_header(std::cout, "");
+    std::cout << '\n';
+}
+
+void print_row(const char* name, size_t len, const timing& t) {
+    std::cout << name << '\t' << len << '\t'
+              << std::fixed << std::setprecision(2) << t.ns << '\t'
+              << std::setprecision(2) << static_cast<double>(len) / t.ns;
+    if (counters_active()) print_counter_tsv(std::cout, t.counters);
+    std::cout << '\n';
+    record_result()
+        .config("hash", name).config("key_len", static_cast<double>(len))
+        .metric("ns_per_key", t.ns)
+        .metric("gb_per_s", static_cast<double>(len) / t.ns)
+        .samples("ns_per_key", t.samples);
+}
+
+// `count` keys of uniform random length in [lo, hi], packed in `blob`.
+std::vector<std::string_view> make_mixed(size_t count, size_t lo, size_t hi, std::string& blob) {
+    std::mt19937_64 rng{43};
+    std::vector<size_t> lens(count);
+    size_t total = 0;
+    for (auto& l : lens) total += l = lo + rng() % (hi - lo + 1);
+    blob.resize(total);
+    for (auto& c : blob) c = static_cast<char>(rng());
+    std::vector<std::string_view> views(count);
+    size_t at = 0;
+    for (size_t i = 0; i < count; ++i) {
+        views[i] = {blob.data() + at, lens[i]};
+        at += lens[i];
+    }
+    return views;
+}
+
+// Median ns per key of fn(keys, out) over REPETITIONS passes, each
+// repeating the pass until about `total` keys are hashed.
+template<typename Fn>
+timing time_pass(std::span<const std::string_view> keys, size_t total, Fn&& fn) {
+    std::vector<hash128> out(keys.size());
+    const size_t passes = std::max<size_t>(1, total / keys.size());
+    std::vector<double> samples;
+    counter_scope counted;
+    for (int rep = 0; rep < REPETITIONS; ++rep) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < passes; ++p) fn(keys, std::span<hash128>(out));
+        auto t1 = std::chrono::steady_clock::now();
+        consume(slot_index{out[keys.size() / 2].lo});
+        samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() /
+                          static_cast<double>(passes * keys.size()));
+    }
+    const counter_sample counts = counted.stop();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2],
+            counts.per(static_cast<double>(passes * keys.size()) * REPETITIONS),
+            std::move(samples)};
+}
+
+void print_batch_header() {
+    std::cout << "hash\tlengths\tkeys\tns_per_key";
+    if (counters_active()) print_counter_tsv_header(std::cout, "");
+    std::cout << '\n';
+}
+
+void print_batch_row(const char* name, const std::string& range, size_t count, const timing& t) {
+    std::cout << name << '\t' << range << '\t' << count << '\t'
+              << std::fixed << std::setprecision(2) << t.ns;
+    if (counters_active()) print_counter_tsv(std::cout, t.counters);
+    std::cout << '\n';
+    record_result()
+        .config("hash", name).config("lengths", range).config("keys", static_cast<double>(count))
+        .metric("ns_per_key", t.ns)
+        .samples("ns_per_key", t.samples);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    auto lengths = args.get_size_list("lengths", {8, 16, 32, 64, 128, 256, 1024, 4096});
+    size_t keys = args.get_size("keys", 2'000'000);
+
+    std::cerr << "key hash throughput\n"
+              << "  hashes per run: " << keys << "\n"
+              << "  simd stripe loop: "
+              << (detail::hash_has_simd ? "available" : "scalar fallback") << "\n\n";
+
+    print_header();
+    for (size_t len : lengths) {
+        auto pool = make_pool(len);
+        // Long keys take proportionally longer; cap total bytes per run.
+        size_t total = std::max<size_t>(POOL_SIZE,
+            std::min(keys, (size_t{1} << 30) / std::max<size_t>(len, 1)));
+
+        print_row("fnv_seeded", len, time_hash(pool, total,
+            [](std::string_view k, size_t i) { return phf_hash_with_seed_fnv(k, i); }));
+        print_row("wide_seeded", len, time_hash(pool, total,
+            [](std::string_view k, size_t i) { return phf_hash_with_seed(k, i); }));
+        print_row("digest_scalar", len, time_hash(pool, total,
+            [](std::string_view k, size_t) { return detail::phf_hash128_impl<false>(k).lo; }));
+        print_row("digest_simd", len, time_hash(pool, total,
+            [](std::string_view k, size_t) { return detail::phf_hash128_impl<true>(k).lo; }));
+        print_row("fingerprint_fnv", len, time_hash(pool, total,
+            [](std::string_view k, size_t) { return membership_fingerprint_fnv(k); }));
+        print_row("fingerprint_wide", len, time_hash(pool, total,
+            [](std::string_view k, size_t) { return membership_fingerprint(k); }));
+        if (len == 8) {
+            print_row("digest_int", len, time_hash(pool, total, [](std::string_view k, size_t) {
+                uint64_t x;
+                std::memcpy(&x, k.data(), sizeof(x));
+                return phf_hash128_u64(x).lo;
+            }));
+        } else if (len == 16) {
+            print_row("digest_int", len, time_hash(pool, total, [](std::string_view k, size_t) {
+                __uint128_t x;
+                std::memcpy(&x, k.data(), sizeof(x));
+                return phf_hash128_u128(x).lo;
+            }));
+        }
+        std::cout << '\n';
+    }
+
+    auto ranges = args.get_string("ranges", "4-16,8-64,20-160,0-300");
+    size_t batch_keys = args.get_size("batch_keys", 2'000'000);
+    print_batch_header();
+    for (size_t at = 0; at < ranges.size();) {
+        size_t comma = std::min(ranges.find(',', at), ranges.size());
+        const std::string range = ranges.substr(at, comma - at);
+        at = comma + 1;
+        const size_t dash = range.find('-');
+        if (dash == std::string::npos) continue;
+        const size_t lo = std::stoul(range.substr(0, dash)), hi = std::stoul(range.substr(dash + 1));
+        for (size_t count : {POOL_SIZE * 4, batch_keys}) {
+            std::string blob;
+            auto views = make_mixed(count, lo, hi, blob);
+            const size_t total = std::max(count, size_t{4'000'000});
+            print_batch_row("digest_loop", range, count, time_pass(views, total,
+                [](std::span<const std::string_view> k, std::span<hash128> out) {
+                    for (size_t i = 0; i < k.size(); ++i) out[i] = phf_hash128(k[i]);
+                }));
+            print_batch_row("digest_batch", range, count, time_pass(views, total,
+                [](std::span<const std::string_view> k, std::span<hash128> out) {
+                    phf_hash128_batch(k, out);
+                }));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file bench_huge_pages.cpp
+ * @brief Query latency with 4 KiB pages vs huge pages (detail/page_allocator.hpp).
+ *
+ * One phf_value_array<phobic5, 32> and one xor_filter<16> are built on the
+ * heap, serialized, and loaded into each storage policy:
+ *
+ *   heap         std::vector (whatever the system THP setting gives malloc)
+ *   base         mapped_storage<page_size::base>: an explicit 4 KiB mapping
+ *   transparent  mapped_storage<page_size::transparent>: madvise(MADV_HUGEPAGE)
+ *   huge_2m      mapped_storage<page_size::huge_2m>: MAP_HUGETLB, falling
+ *                back to transparent when no pages are reserved
+ *
+ * Two query modes over the same shuffled queries (the run's workload,
+ * members by default):
+ *
+ *   throughput   independent lookups, ns/query
+ *   latency      each query's key index depends on the previous result,
+ *                so misses (data and page walk) cannot overlap
+ *
+ * The huge_kb column is the process's AnonHugePages + Private_Hugetlb from
+ * /proc/self/smaps_rollup with only that policy's copy loaded, i.e. how
+ * much of it the kernel actually backed with huge pages. The gap between
+ * base and the huge rows grows with the table: raise --keys until the
+ * arrays exceed what the TLB covers with 4 KiB pages (a few MiB).
+ *
+ * Usage:
+ *   bench_huge_pages                         # 4M keys, 2M queries
+ *   bench_huge_pages --keys=50000000 --queries=4000000
+ *   bench_huge_pages --counters              # + t_/l_ counters per query
+ *
+ * Reserve explicit huge pages first to measure huge_2m itself:
+ *   echo 2048 | sudo tee /proc/sys/vm/nr_hugepages
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/detail/page_allocator.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+constexpr int PASSES = 5;
+
+// AnonHugePages + Private_Hugetlb of the whole process, in KiB.
+size_t huge_page_kb() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string field;
+    size_t kb = 0, total = 0;
+    while (in >> field >> kb) {
+        if (field == "AnonHugePages:" || field == "Private_Hugetlb:") total += kb;
+        in.ignore(64, '\n');
+    }
+    return total;
+}
+
+struct timing {
+    double ns;
+    counter_sample counters;  // averaged over the PASSES timed passes
+    std::vector<double> samples{};  // per pass, sorted; for --json
+};
+
+template<typename Fn>
+timing median_ns(size_t queries, Fn&& fn) {
+    std::vector<double> samples;
+    fn();  // warm-up
+    counter_scope counted;
+    for (int p = 0; p < PASSES; ++p) {
+        cool_caches(counted);
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() /
+                          static_cast<double>(queries));
+    }
+    const counter_sample counts = counted.stop();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2],
+            counts.per(static_cast<double>(queries) * PASSES),
+            std::move(samples)};
+}
+
+void print_row(const char* structure, const char* storage, size_t huge_kb,
+               const timing& throughput, const timing& latency) {
+    std::cout << structure << '\t' << storage << '\t' << huge_kb << '\t'
+              << std::fixed << std::setprecision(2) << throughput.ns << '\t'
+              << latency.ns;
+    if (counters_active()) {
+        print_counter_tsv(std::cout, throughput.counters);
+        print_counter_tsv(std::cout, latency.counters);
+    }
+    std::cout << '\n';
+    record_result()
+        .config("structure", structure).config("storage", storage)
+        .metric("huge_kb", static_cast<double>(huge_kb))
+        .metric("throughput_ns", throughput.ns)
+        .metric("latency_ns", latency.ns)
+        .samples("throughput_ns", throughput.samples)
+        .samples("latency_ns", latency.samples);
+}
+
+template<typename Storage>
+void bench_pva(const char* storage, std::span<const std::byte> bytes,
+               std::span<const std::string_view> queries) {
+    using pva = phf_value_array<phobic_phf<5, flat_pilots, Storage>, 32, Storage>;
+    const size_t before = huge_page_kb();
+    auto r = pva::deserialize(bytes);
+    if (!r) { std::cerr << "  " << storage << ": load failed\n"; return; }
+    const size_t after = huge_page_kb();
+    const size_t huge = after > before ? after - before : 0;
+
+    const size_t n = queries.size();
+    const timing tput = median_ns(n, [&] {
+        uint64_t acc = 0;
+        for (auto q : queries) acc += r->lookup(q);
+        consume(slot_index{acc});
+    });
+    const timing lat = median_ns(n, [&] {
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; ++i) v = r->lookup(queries[(i ^ (v & 1)) % n]);
+        consume(slot_index{v});
+    });
+    print_row("pva32", storage, huge, tput, lat);
+}
+
+template<typename Storage>
+void bench_xor(const char* storage, std::span<const std::byte> bytes,
+               std::span<const std::string_view> queries) {
+    const size_t before = huge_page_kb();
+    auto f = xor_filter<16, Storage>::deserialize(bytes);
+    if (!f) { std::cerr << "  " << storage << ": load failed\n"; return; }
+    const size_t after = huge_page_kb();
+    const size_t huge = after > before ? after - before : 0;
+
+    const size_t n = queries.size();
+    const timing tput = median_ns(n, [&] {
+        size_t hits = 0;
+        for (auto q : queries) hits += f->verify(q);
+        consume(slot_index{hits});
+    });
+    const timing lat = median_ns(n, [&] {
+        bool hit = false;
+        for (size_t i = 0; i < n; ++i) hit = f->verify(queries[(i ^ size_t{hit}) % n]);
+        consume(hit);
+    });
+    print_row("xor16", storage, huge, tput, lat);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    const size_t n = args.get_size("keys", 4'000'000);
+    const size_t total_queries = args.get_size("queries", 2'000'000);
+
+    std::cerr << "huge pages\n"
+              << "  keys: " << n << ", queries: " << total_queries << "\n";
+
+    auto owned = gen_random_keys(n);
+    std::vector<std::string_view> keys(owned.begin(), owned.end());
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 2654435761u);
+
+    const query_stream<std::string> stream(owned, total_queries, 12345);
+    const std::vector<std::string_view> queries = stream.views();
+
+    std::cerr << "  building...\n";
+    auto pva = phf_value_array<phobic5, 32>::builder{}.add_all(keys, values).build();
+    xor_filter<16> filter;
+    if (!pva || !filter.build(owned)) {
+        std::cerr << "build failed\n";
+        return 1;
+    }
+    const auto pva_bytes = pva->serialize();
+    const auto xor_bytes = filter.serialize();
+    pva = std::unexpected(error::invalid_format);  // free the heap build
+    filter = xor_filter<16>{};
+
+    std::cout << "structure\tstorage\thuge_kb\tthroughput_ns\tlatency_ns";
+    if (counters_active()) {
+        print_counter_tsv_header(std::cout, "t_");
+        print_counter_tsv_header(std::cout, "l_");
+    }
+    std::cout << '\n';
+    bench_pva<heap_storage>("heap", pva_bytes, queries);
+    bench_pva<mapped_storage<page_size::base>>("base", pva_bytes, queries);
+    bench_pva<mapped_storage<page_size::transparent>>("transparent", pva_bytes, queries);
+    bench_pva<mapped_storage<page_size::huge_2m>>("huge_2m", pva_bytes, queries);
+    std::cout << '\n';
+    bench_xor<heap_storage>("heap", xor_bytes, queries);
+    bench_xor<mapped_storage<page_size::base>>("base", xor_bytes, queries);
+    bench_xor<mapped_storage<page_size::transparent>>("transparent", xor_bytes, queries);
+    bench_xor<mapped_storage<page_size::huge_2m>>("huge_2m", xor_bytes, queries);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file bench_interleaved.cpp
+ * @brief Query throughput vs number of lookups in flight.
+ *
+ * Each structure answers the same shuffled queries (the run's workload,
+ * members by default) three ways:
+ *
+ *   scalar       one lookup at a time
+ *   batch        the window-pass lookup_batch / contains_batch
+ *   interleaved  lookup_interleaved<G> / contains_interleaved<G>, G lookups
+ *                in flight (detail/amac.hpp), for G in 1..64
+ *
+ * Structures:
+ *   pva32        phf_value_array<phobic5, 32>
+ *   part_pva32   phf_value_array<partitioned_phf<phobic5>, 32>
+ *   filter16     perfect_filter<phobic5, 16>
+ *   bloomier8    bloomier<phf_value_array<phobic5, 8>, xor_filter<8>>
+ *
+ * Interleaving pays once the tables and the key bytes miss the last-level
+ * cache, where the stall between a PHF slot and the value stored at it
+ * dominates; raise --keys past the LLC to see it. While everything is
+ * cached, out-of-order execution already overlaps a few scalar lookups
+ * and G matters less.
+ *
+ * Usage:
+ *   bench_interleaved                         # 1M keys, 1M queries
+ *   bench_interleaved --keys=20000000 --queries=4000000
+ *   bench_interleaved --counters              # + hardware counters per query
+ *
+ * Output is one TSV row per (structure, mode, G) with the median of 5
+ * passes over the query set; the counter columns, when on, are averaged
+ * over all 5.
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/bloomier.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+constexpr int PASSES = 5;
+
+struct timing {
+    double ns;
+    counter_sample counters;
+    std::vector<double> samples{};  // per pass, sorted; for --json
+};
+
+// Median ns per query over PASSES calls of fn(queries).
+template<typename Fn>
+timing time_passes(std::span<const std::string_view> queries, Fn&& fn) {
+    std::vector<double> samples;
+    samples.reserve(PASSES);
+    fn(queries);  // warm-up
+    counter_scope counted;
+    for (int p = 0; p < PASSES; ++p) {
+        cool_caches(counted);
+        auto t0 = std::chrono::steady_clock::now();
+        fn(queries);
+        auto t1 = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() /
+                          static_cast<double>(queries.size()));
+    }
+    const counter_sample counts = counted.stop();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2],
+            counts.per(static_cast<double>(queries.size()) * PASSES),
+            std::move(samples)};
+}
+
+void print_row(const char* structure, const char* mode, size_t group, const timing& t) {
+    std::cout << structure << '\t' << mode << '\t' << group << '\t'
+              << std::fixed << std::setprecision(2) << t.ns << '\t'
+              << std::setprecision(1) << 1e3 / t.ns;
+    if (counters_active()) print_counter_tsv(std::cout, t.counters);
+    std::cout << '\n';
+    record_result()
+        .config("structure", structure).config("mode", mode)
+        .config("group", static_cast<double>(group))
+        .metric("ns_per_query", t.ns)
+        .metric("mqps", 1e3 / t.ns)
+        .samples("ns_per_query", t.samples);
+}
+
+template<size_t... Gs, typename Fn>
+void sweep(const char* structure, std::span<const std::string_view> queries, Fn&& run) {
+    (print_row(structure, "interleaved", Gs,
+               time_passes(queries, [&](auto q) { run.template operator()<Gs>(q); })),
+     ...);
+}
+
+template<size_t... Gs, typename R>
+void bench_retrieval(const char* structure, const R& r,
+                     std::span<const std::string_view> queries) {
+    using V = typename R::value_type;
+    std::vector<V> out(queries.size());
+    print_row(structure, "scalar", 1, time_passes(queries, [&](auto q) {
+        for (size_t i = 0; i < q.size(); ++i) out[i] = r.lookup(q[i]);
+        consume(slot_index{out[q.size() / 2]});
+    }));
+    print_row(structure, "batch", detail::lookup_batch_window, time_passes(queries, [&](auto q) {
+        r.lookup_batch(q, out);
+        consume(slot_index{out[q.size() / 2]});
+    }));
+    sweep<Gs...>(structure, queries, [&]<size_t G>(auto q) {
+        r.template lookup_interleaved<G>(q, out);
+        consume(slot_index{out[q.size() / 2]});
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    const size_t n = args.get_size("keys", 1'000'000);
+    const size_t total_queries = args.get_size("queries", 1'000'000);
+
+    std::cerr << "interleaved lookups\n"
+              << "  keys: " << n << ", queries: " << total_queries << "\n";
+
+    auto keys = gen_random_keys(n);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 2654435761u);
+    std::vector<uint8_t> small(keys.size());
+    for (size_t i = 0; i < small.size(); ++i) small[i] = static_cast<uint8_t>(values[i]);
+
+    const query_stream<std::string> stream(keys, total_queries, 12345);
+    const std::vector<std::string_view> queries = stream.views();
+
+    std::cerr << "  building...\n";
+    auto pva = phf_value_array<phobic5, 32>::builder{}.add_all(keys, values).build();
+    auto part = phf_value_array<partitioned_phf<phobic5>, 32>::builder{}
+                    .add_all(keys, values).build();
+    auto filter = perfect_filter<phobic5, 16>::build(
+        phobic5::builder{}.add_all(keys).build().value(), keys);
+    auto bmap = bloomier<phf_value_array<phobic5, 8>, xor_filter<8>>::builder{}
+                    .add_all(keys, small).build();
+    if (!pva || !part || !bmap) {
+        std::cerr << "build failed\n";
+        return 1;
+    }
+
+    std::cout << "structure\tmode\tgroup\tns_per_query\tmqps";
+    if (counters_active()) print_counter_tsv_header(std::cout, "");
+    std::cout << '\n';
+    bench_retrieval<1, 2, 4, 8, 16, 32, 64>("pva32", *pva, queries);
+    std::cout << '\n';
+    bench_retrieval<1, 2, 4, 8, 16, 32, 64>("part_pva32", *part, queries);
+    std::cout << '\n';
+
+    auto hits = std::make_unique<bool[]>(queries.size());
+    std::span<bool> hit_span{hits.get(), queries.size()};
+    print_row("filter16", "scalar", 1, time_passes(queries, [&](auto q) {
+        for (size_t i = 0; i < q.size(); ++i) hit_span[i] = filter.contains(q[i]);
+        consume(hit_span[q.size() / 2]);
+    }));
+    print_row("filter16", "batch", detail::lookup_batch_window, time_passes(queries, [&](auto q) {
+        filter.contains_batch(q, hit_span);
+        consume(hit_span[q.size() / 2]);
+    }));
+    sweep<1, 2, 4, 8, 16, 32, 64>("filter16", queries, [&]<size_t G>(auto q) {
+        filter.template contains_interleaved<G>(q, hit_span);
+        consume(hit_span[q.size() / 2]);
+    });
+    std::cout << '\n';
+
+    std::vector<std::optional<uint8_t>> found(queries.size());
+    print_row("bloomier8", "scalar", 1, time_passes(queries, [&](auto q) {
+        for (size_t i = 0; i < q.size(); ++i) found[i] = bmap->lookup(q[i]);
+        consume(found[q.size() / 2]);
+    }));
+    sweep<1, 2, 4, 8, 16, 32, 64>("bloomier8", queries, [&]<size_t G>(auto q) {
+        bmap->template lookup_interleaved<G>(q, found);
+        consume(found[q.size() / 2]);
+    });
+    return 0;
+}
@@ -0,0 +1,441 @@
+/**
+ * @file bench_load.cpp
+ * @brief Cold-start cost: time to first query and memory, for a full
+ *        deserialize() versus the zero-copy view over a mapped file.
+ *
+ * Each structure is built once, serialized to a file and freed. Every
+ * load then runs in a child forked from a parent that holds only the
+ * keys (as in bench_build_memory), so its RSS and page faults are its
+ * own. A load opens the file, turns it into a queryable structure and
+ * answers one query; then it answers --probes more, spread across the
+ * key set, to show how much of the file the queries touch.
+ *
+ * Paths:
+ *   read   read() the whole file into memory, then T::deserialize()
+ *   mmap   mapped_file, then T::deserialize() from the mapping (no read
+ *          copy, but still decoded into owned arrays)
+ *   view   mapped_file, then the *_view type bound in place (phobic,
+ *          partitioned_phf, phf_value_array, ribbon_retrieval)
+ *
+ * bloomier has no deserialize(); it is stored with to_container() and
+ * loaded with from_container(), which is what read and mmap time for it.
+ *
+ * Page cache:
+ *   warm   the file was read just before the load
+ *   cold   posix_fadvise(DONTNEED) dropped its pages just before the load
+ *          (the file was fsync'd, so its pages are clean and can go)
+ *
+ * Columns (TSV):
+ *   structure, keys, path, cache, ok, file_mb
+ *   load_ms        open to a queryable structure
+ *   first_us       the first query after that
+ *   ttfq_ms        open to the first answer (load_ms + first_us)
+ *   loaded_mb      RSS after the first query - RSS before the load
+ *   probed_mb      RSS after --probes queries - RSS before the load
+ *
+ * A view's loaded_mb is the pages the first query touched; a deserialize
+ * pays for the whole structure up front, twice over for read while the
+ * file buffer and the decoded copy coexist.
+ *
+ * Usage:
+ *   bench_load                            # default: 1000000 10000000
+ *   bench_load 100000000 --probes=1000000
+ *   bench_load --dir=/data --threads=8    # file location; threads for
+ *                                         # partitioned deserialize()
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/algorithms/bbhash.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/composition/bloomier.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/detail/container.hpp>
+#include <maph/detail/mapped_file.hpp>
+#include <maph/filters/binary_fuse_filter.hpp>
+#include <maph/filters/ribbon_filter.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+// What a child writes back through its pipe.
+struct child_result {
+    bool ok{false};
+    double load_ms{0};
+    double first_us{0};
+    size_t start_rss_kb{0};
+    size_t loaded_rss_kb{0};
+    size_t probed_rss_kb{0};
+};
+
+// ===== FILES =====
+
+bool write_file(const std::string& path, std::span<const std::byte> bytes) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const auto* p = reinterpret_cast<const char*>(bytes.data());
+    size_t left = bytes.size();
+    while (left > 0) {
+        const ssize_t n = ::write(fd, p, left);
+        if (n <= 0) break;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    // Clean pages are what posix_fadvise(DONTNEED) can drop.
+    const bool ok = left == 0 && ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+std::optional<std::vector<std::byte>> read_file(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    const off_t size = ::lseek(fd, 0, SEEK_END);
+    ::lseek(fd, 0, SEEK_SET);
+    std::vector<std::byte> out(size > 0 ? static_cast<size_t>(size) : 0);
+    size_t got = 0;
+    while (got < out.size()) {
+        const ssize_t n = ::read(fd, out.data() + got, out.size() - got);
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    if (got != out.size()) return std::nullopt;
+    return out;
+}
+
+void drop_page_cache(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+// ===== ONE LOAD =====
+
+// Time open -> load(bytes) -> query(first probe), then the other probes.
+// The bytes (file buffer or mapping) live until the end, as a view needs.
+template<typename Load, typename Query>
+child_result measure_load(const std::string& path, bool mapped,
+                          const std::vector<std::string>& probes,
+                          Load load, Query query) {
+    using clock = std::chrono::steady_clock;
+    child_result r;
+    r.start_rss_kb = get_rss_kb();
+
+    auto t0 = clock::now();
+    std::optional<mapped_file> mapping;
+    std::optional<std::vector<std::byte>> buffer;
+    std::span<const std::byte> bytes;
+    if (mapped) {
+        auto m = mapped_file::open(path);
+        if (!m) return r;
+        mapping.emplace(std::move(*m));
+        bytes = mapping->bytes();
+    } else {
+        buffer = read_file(path);
+        if (!buffer) return r;
+        bytes = *buffer;
+    }
+    auto loaded = load(bytes);
+    auto t1 = clock::now();
+    if (!loaded) return r;
+    sink = sink ^ query(*loaded, probes.front());
+    auto t2 = clock::now();
+
+    r.ok = true;
+    r.load_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    r.first_us = std::chrono::duration<double, std::micro>(t2 - t1).count();
+    r.loaded_rss_kb = get_rss_kb();
+    for (size_t i = 1; i < probes.size(); ++i) sink = sink ^ query(*loaded, probes[i]);
+    r.probed_rss_kb = get_rss_kb();
+    return r;
+}
+
+using load_fn = std::function<child_result(const std::string& path, bool mapped,
+                                           const std::vector<std::string>& probes)>;
+
+template<typename T, typename Query>
+load_fn deserialize_with(Query query, size_t threads = 1) {
+    return [=](const std::string& path, bool mapped, const std::vector<std::string>& probes) {
+        return measure_load(path, mapped, probes, [&](std::span<const std::byte> b) {
+            if constexpr (requires { T::deserialize(b, threads); }) {
+                return T::deserialize(b, threads);
+            } else {
+                return T::deserialize(b);
+            }
+        }, query);
+    };
+}
+
+template<typename T, typename Query>
+load_fn container_with(Query query) {
+    return [=](const std::string& path, bool mapped, const std::vector<std::string>& probes) {
+        return measure_load(path, mapped, probes, [](std::span<const std::byte> b) {
+            return from_container<T>(b);
+        }, query);
+    };
+}
+
+// ===== STRUCTURES =====
+
+struct path_entry {
+    std::string name;
+    bool mapped;
+    load_fn run;
+};
+
+struct structure_entry {
+    std::string name;
+    // Build over the keys and return the bytes to store; empty on failure.
+    std::function<std::vector<std::byte>(const std::vector<std::string>&)> store;
+    std::vector<path_entry> paths;
+};
+
+// Deterministic 16-bit value derived from the key bytes.
+uint16_t det_value(std::string_view key) noexcept {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (char c : key) {
+        h ^= static_cast<uint64_t>(static_cast<unsigned char>(c));
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 31;
+    }
+    return static_cast<uint16_t>(h);
+}
+
+template<typename PHF>
+auto phf_store(size_t threads) {
+    return [=](const std::vector<std::string>& keys) {
+        typename PHF::builder b{};
+        if constexpr (requires { b.with_threads(threads); }) b.with_threads(threads);
+        auto built = b.add_all(keys).build();
+        return built ? built->serialize() : std::vector<std::byte>{};
+    };
+}
+
+template<typename Filter>
+auto filter_store() {
+    return [](const std::vector<std::string>& keys) {
+        Filter f;
+        return f.build(keys) ? f.serialize() : std::vector<std::byte>{};
+    };
+}
+
+// Each answers one query as a word for the value sink.
+constexpr auto phf_query = [](const auto& phf, const std::string& k) -> uint64_t {
+    return phf.slot_for(k).value;
+};
+constexpr auto lookup_query = [](const auto& m, const std::string& k) -> uint64_t {
+    return static_cast<uint64_t>(m.lookup(k));
+};
+constexpr auto verify_query = [](const auto& f, const std::string& k) -> uint64_t {
+    return f.verify(k) ? 1 : 0;
+};
+constexpr auto bloomier_query = [](const auto& m, const std::string& k) -> uint64_t {
+    return m.lookup(k).value_or(0);
+};
+
+template<typename T, typename Query>
+std::vector<path_entry> owned_paths(Query query, size_t threads = 1) {
+    return {{"read", false, deserialize_with<T>(query, threads)},
+            {"mmap", true, deserialize_with<T>(query, threads)}};
+}
+
+template<typename T, typename View, typename Query>
+std::vector<path_entry> viewed_paths(Query query, size_t threads = 1) {
+    auto paths = owned_paths<T>(query, threads);
+    paths.push_back({"view", true, deserialize_with<View>(query)});
+    return paths;
+}
+
+std::vector<structure_entry> structures(size_t threads) {
+    using pva16 = phf_value_array<phobic5, 16>;
+    using bloomier16 = bloomier<ribbon_retrieval<16>, xor_filter<8>>;
+    return {
+        {"phobic5", phf_store<phobic5>(threads),
+         viewed_paths<phobic5, phobic_phf_view<5>>(phf_query)},
+        {"recsplit8", phf_store<recsplit8>(threads), owned_paths<recsplit8>(phf_query)},
+        {"bbhash3", phf_store<bbhash3>(threads), owned_paths<bbhash3>(phf_query)},
+        {"partitioned<phobic5>", phf_store<partitioned_phf<phobic5>>(threads),
+         viewed_paths<partitioned_phf<phobic5>, partitioned_phf_view<phobic_phf_view<5>>>(
+             phf_query, threads)},
+        {"phf_value_array<phobic5,16>", [=](const std::vector<std::string>& keys) {
+            auto built = pva16::builder{}.add_all_with(std::span<const std::string>{keys}, det_value)
+                             .build();
+            return built ? built->serialize() : std::vector<std::byte>{};
+         },
+         viewed_paths<pva16, phf_value_array_view<phobic_phf_view<5>, 16>>(lookup_query, threads)},
+        {"ribbon_retrieval16", [=](const std::vector<std::string>& keys) {
+            std::vector<uint16_t> values(keys.size());
+            for (size_t i = 0; i < keys.size(); ++i) values[i] = det_value(keys[i]);
+            auto built = ribbon_retrieval<16>::builder{}
+                             .add_all(std::span<const std::string>{keys},
+                                      std::span<const uint16_t>{values})
+                             .with_threads(threads)
+                             .build();
+            return built ? built->serialize() : std::vector<std::byte>{};
+         },
+         viewed_paths<ribbon_retrieval<16>, ribbon_retrieval_view<16, flat_solution>>(lookup_query)},
+        {"xor8", filter_store<xor_filter<8>>(), owned_paths<xor_filter<8>>(verify_query)},
+        {"binary_fuse8", filter_store<binary_fuse_filter<8>>(),
+         owned_paths<binary_fuse_filter<8>>(verify_query)},
+        {"ribbon8", filter_store<ribbon_filter<8>>(), owned_paths<ribbon_filter<8>>(verify_query)},
+        {"bloomier<ribbon16,xor8>", [](const std::vector<std::string>& keys) {
+            auto b = bloomier16::builder{};
+            b.add_all_with(std::span<const std::string>{keys}, det_value);
+            auto built = b.build();
+            return built ? to_container(*built) : std::vector<std::byte>{};
+         },
+         {{"read", false, container_with<bloomier16>(bloomier_query)},
+          {"mmap", true, container_with<bloomier16>(bloomier_query)}}},
+    };
+}
+
+// Fork, run one load in the child, read its result back.
+child_result run_isolated(const load_fn& run, const std::string& path, bool mapped,
+                          const std::vector<std::string>& probes) {
+    int fds[2];
+    if (::pipe(fds) != 0) return {};
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return {};
+    }
+    if (pid == 0) {
+        ::close(fds[0]);
+        const child_result r = run(path, mapped, probes);
+        const auto* p = reinterpret_cast<const char*>(&r);
+        size_t left = sizeof(r);
+        while (left > 0) {
+            const ssize_t n = ::write(fds[1], p, left);
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        ::_exit(0);
+    }
+    ::close(fds[1]);
+    child_result r;
+    auto* p = reinterpret_cast<char*>(&r);
+    size_t got = 0;
+    while (got < sizeof(r)) {
+        const ssize_t n = ::read(fds[0], p + got, sizeof(r) - got);
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    ::close(fds[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    if (got != sizeof(r)) return {};
+    return r;
+}
+
+double mb(double bytes) { return bytes / (1024.0 * 1024.0); }
+
+double rss_growth_mb(size_t from_kb, size_t to_kb) {
+    return to_kb > from_kb ? mb(static_cast<double>(to_kb - from_kb) * 1024.0) : 0.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({1'000'000, 10'000'000});
+    const size_t threads = args.get_size("threads", 1);
+    const size_t probe_count = std::max<size_t>(1, args.get_size("probes", 100'000));
+    const std::filesystem::path dir = args.get_string(
+        "dir", std::filesystem::temp_directory_path().string());
+
+    std::cerr << "maph cold-start load benchmark\n  key counts: ";
+    for (auto kc : key_counts) std::cerr << kc << ' ';
+    std::cerr << "\n  threads: " << threads << ", probes: " << probe_count
+              << ", dir: " << dir.string() << "\n\n";
+
+    std::printf("structure\tkeys\tpath\tcache\tok\tfile_mb\tload_ms\tfirst_us\tttfq_ms"
+                "\tloaded_mb\tprobed_mb\n");
+
+    const auto entries = structures(threads);
+    for (size_t kc : key_counts) {
+        std::cerr << "=== " << kc << " keys ===\n";
+        auto keys = gen_random_keys(kc);
+        std::vector<std::string> probes;
+        const size_t stride = std::max<size_t>(1, keys.size() / probe_count);
+        for (size_t i = 0; i < keys.size() && probes.size() < probe_count; i += stride) {
+            probes.push_back(keys[i]);
+        }
+
+        for (size_t e = 0; e < entries.size(); ++e) {
+            const auto& entry = entries[e];
+            std::cerr << "  " << entry.name << " ..." << std::flush;
+            const std::string path =
+                (dir / ("maph_bench_load_" + std::to_string(::getpid()) + "_" + std::to_string(e)))
+                    .string();
+            const auto bytes = entry.store(keys);
+            if (bytes.empty() || !write_file(path, bytes)) {
+                std::cerr << " BUILD OR WRITE FAILED\n";
+                std::filesystem::remove(path);
+                continue;
+            }
+            std::cerr << ' ' << mb(static_cast<double>(bytes.size())) << " MB\n";
+
+            for (const auto& lp : entry.paths) {
+                for (const bool cold : {false, true}) {
+                    if (cold) drop_page_cache(path);
+                    else (void)read_file(path);
+                    const auto r = run_isolated(lp.run, path, lp.mapped, probes);
+                    const double ttfq_ms = r.load_ms + r.first_us / 1000.0;
+                    const double loaded = rss_growth_mb(r.start_rss_kb, r.loaded_rss_kb);
+                    const double probed = rss_growth_mb(r.start_rss_kb, r.probed_rss_kb);
+
+                    std::printf("%s\t%zu\t%s\t%s\t%d\t%.2f\t%.3f\t%.2f\t%.3f\t%.2f\t%.2f\n",
+                                entry.name.c_str(), keys.size(), lp.name.c_str(),
+                                cold ? "cold" : "warm", r.ok ? 1 : 0,
+                                mb(static_cast<double>(bytes.size())), r.load_ms, r.first_us,
+                                ttfq_ms, loaded, probed);
+                    std::fflush(stdout);
+                    record_result()
+                        .config("structure", entry.name)
+                        .config("keys", static_cast<double>(keys.size()))
+                        .config("path", lp.name)
+                        .config("cache", cold ? "cold" : "warm")
+                        .metric("ok", r.ok ? 1 : 0)
+                        .metric("file_bytes", static_cast<double>(bytes.size()))
+                        .metric("load_ms", r.load_ms)
+                        .metric("first_us", r.first_us)
+                        .metric("ttfq_ms", ttfq_ms)
+                        .metric("loaded_mb", loaded)
+                        .metric("probed_mb", probed);
+                }
+            }
+            std::filesystem::remove(path);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -9,6 +9,7 @@
  * Usage:
  *   bench_partitioned_algos                         # 1M keys, 8 threads
  *   bench_partitioned_algos --keys=1000000 --threads=8 --distribution=url
+ *   bench_partitioned_algos --counters              # + hardware counters per op
  */
 
 #include "bench_harness.hpp"
@@ -18,6 +19,7 @@
 #include <maph/algorithms/chd.hpp>
 #include <maph/algorithms/bbhash.hpp>
 #include <maph/algorithms/fch.hpp>
+#include <maph/algorithms/pthash.hpp>
 #include <maph/composition/partitioned.hpp>
 
 #include <chrono>
@@ -42,6 +44,9 @@ struct row {
     double query_median_ns;
     double throughput_mqps;
     bool ok;
+    counter_sample build_counters{};
+    counter_sample query_counters{};
+    std::vector<double> query_samples{};  // sub-batch ns per query, for --json
 };
 
 template<typename Inner>
@@ -61,12 +66,14 @@ row run_partitioned(const std::string& name,
 
     std::cerr << "  " << name << " T=" << threads << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
     auto built = typename partitioned_phf<Inner>::builder{}
         .add_all(keys)
         .with_threads(threads)
         .build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -77,6 +84,8 @@ row run_partitioned(const std::string& name,
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     std::cerr << " " << r.build_ms << " ms, " << r.bits_per_key
               << " b/k, " << r.query_median_ns << " ns/q\n";
@@ -101,6 +110,7 @@ row run_plain(const std::string& name,
 
     std::cerr << "  " << name << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
     auto builder = typename PHF::builder{};
     builder.add_all(keys);
@@ -110,6 +120,7 @@ row run_plain(const std::string& name,
     }
     auto built = builder.build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -120,6 +131,8 @@ row run_plain(const std::string& name,
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     std::cerr << " " << r.build_ms << " ms, " << r.bits_per_key
               << " b/k, " << r.query_median_ns << " ns/q\n";
@@ -152,6 +165,18 @@ void print_row(const row& r) {
         << std::setw(12) << std::setprecision(2) << r.throughput_mqps
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters);
+    report_counters(std::cout, "query", r.query_counters);
+    record_result()
+        .config("config", r.config)
+        .config("keys", static_cast<double>(r.keys))
+        .config("threads", static_cast<double>(r.threads))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_ms", r.build_ms)
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("throughput_mqps", r.throughput_mqps)
+        .samples("query_med_ns", r.query_samples);
 }
 
 } // namespace
@@ -183,12 +208,13 @@ int main(int argc, char** argv) {
     print_row(run_partitioned<recsplit8>("partitioned<recsplit8>", keys, threads, total_queries));
     print_row(run_partitioned<chd_hasher>("partitioned<chd>", keys, threads, total_queries));
     print_row(run_partitioned<fch_hasher>("partitioned<fch>", keys, threads, total_queries));
+    print_row(run_partitioned<pthash98>("partitioned<pthash98>", keys, threads, total_queries));
 
     std::cout << '\n';
 
-    // Plain (single PHF) for comparison. phobic5 uses fat-bucket parallelism;
-    // others are single-threaded (and will be slow at 1M).
-    print_row(run_plain<phobic5>("phobic5 (fat+bucket)", keys, threads, total_queries));
+    // Plain (single PHF) for comparison. phobic5 uses its windowed parallel
+    // pilot search; others are single-threaded (and will be slow at 1M).
+    print_row(run_plain<phobic5>("phobic5 (window)", keys, threads, total_queries));
     print_row(run_plain<bbhash5>("bbhash5 (serial)", keys, threads, total_queries, false));
     print_row(run_plain<recsplit8>("recsplit8 (serial)", keys, threads, total_queries, false));
 
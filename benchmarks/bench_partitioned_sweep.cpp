@@ -11,6 +11,7 @@
  *   bench_partitioned_sweep --keys=1000000
  *   bench_partitioned_sweep --keys=10000000 --threads=1,4,8 --shards=32,128,512
  *   bench_partitioned_sweep --distribution=url --keys=1000000
+ *   bench_partitioned_sweep --counters              # + hardware counters per op
  */
 
 #include "bench_harness.hpp"
@@ -41,6 +42,9 @@ struct row {
     double query_median_ns;
     double throughput_mqps;
     bool ok;
+    counter_sample build_counters{};
+    counter_sample query_counters{};
+    std::vector<double> query_samples{};  // sub-batch ns per query, for --json
 };
 
 row run(const std::vector<std::string>& keys,
@@ -62,6 +66,7 @@ row run(const std::vector<std::string>& keys,
 
     std::cerr << "  shards=" << shards << " T=" << threads << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
     auto built = partitioned_phf<phobic5>::builder{}
         .add_all(keys)
@@ -69,6 +74,7 @@ row run(const std::vector<std::string>& keys,
         .with_threads(threads)
         .build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -80,6 +86,8 @@ row run(const std::vector<std::string>& keys,
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
     std::cerr << " " << r.build_ms << " ms, " << r.bits_per_key
               << " b/k, " << r.query_median_ns << " ns/q\n";
     return r;
@@ -118,6 +126,20 @@ void print_row(const row& r) {
         << std::setw(12) << std::setprecision(2) << r.throughput_mqps
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters);
+    report_counters(std::cout, "query", r.query_counters);
+    record_result()
+        .config("distribution", r.distribution)
+        .config("keys", static_cast<double>(r.keys))
+        .config("shards", static_cast<double>(r.shards))
+        .config("threads", static_cast<double>(r.threads))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_ms", r.build_ms)
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("memory_kb", static_cast<double>(r.memory_kb))
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("throughput_mqps", r.throughput_mqps)
+        .samples("query_med_ns", r.query_samples);
 }
 
 } // namespace
@@ -10,6 +10,10 @@
  *   - serialized bytes
  *   - query latency (median, p99 ns/query)
  *   - query throughput (millions of queries per second)
+ *   - batched query cost (ns/key through slot_for_batch)
+ *
+ * phobic5_u64 rows build and query 64-bit integer keys directly;
+ * phobic5_u64_str is the same keys as 8-byte strings.
  *
  * All algorithms get the same key set and the same query index sequence.
  * Seeds are fixed for reproducibility.
@@ -17,6 +21,7 @@
  * Usage:
  *   bench_phf                    # default: 10000 100000 1000000
  *   bench_phf 1000 10000         # custom key counts
+ *   bench_phf --counters         # add hardware counter columns
  */
 
 #include "bench_harness.hpp"
@@ -30,6 +35,7 @@
 #include <maph/algorithms/shock_hash.hpp>
 
 #include <chrono>
+#include <concepts>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
@@ -45,9 +51,9 @@ using namespace maph::bench;
  * Builder is deduced from the factory lambda; the PHF type comes from the
  * builder's build() return (inside result<PHF>).
  */
-template<typename BuilderFactory>
+template<typename Key, typename BuilderFactory>
 result_row run_algo(const std::string& name,
-                    const std::vector<std::string>& keys,
+                    const std::vector<Key>& keys,
                     BuilderFactory make_builder,
                     size_t total_queries)
 {
@@ -62,9 +68,11 @@ result_row run_algo(const std::string& name,
     r.fp_rate = 0.0;  // pure PHF has no FP semantics
 
     reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = make_builder().add_all(keys).build();
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     r.build_peak_rss_kb = get_peak_rss_kb();
 
@@ -81,6 +89,11 @@ result_row run_algo(const std::string& name,
     r.query_median_ns = qs.median_ns;
     r.query_p99_ns = qs.p99_ns;
     r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+    if constexpr (std::same_as<Key, std::string>) {
+        r.query_batch_ns = measure_batch_queries(phf, keys, total_queries);
+    }
 
     return r;
 }
@@ -92,11 +105,8 @@ struct algo_entry {
 };
 
 int main(int argc, char** argv) {
-    std::vector<size_t> key_counts = {10'000, 100'000, 1'000'000};
-    if (argc > 1) {
-        key_counts.clear();
-        for (int i = 1; i < argc; ++i) key_counts.push_back(std::stoul(argv[i]));
-    }
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({10'000, 100'000, 1'000'000});
 
     const size_t total_queries = 1'000'000;
 
@@ -105,6 +115,10 @@ int main(int argc, char** argv) {
             return run_algo("phobic5", keys, [] { return phobic5::builder{}; }, q);
         }, /*max_keys=*/1'000'000'000},
 
+        {"phobic5_compact", [&](const auto& keys, size_t q) {
+            return run_algo("phobic5_compact", keys, [] { return phobic5_compact::builder{}; }, q);
+        }, /*max_keys=*/1'000'000'000},
+
         {"phobic3", [&](const auto& keys, size_t q) {
             return run_algo("phobic3", keys, [] { return phobic3::builder{}; }, q);
         }, /*max_keys=*/1'000'000'000},
@@ -120,7 +134,8 @@ int main(int argc, char** argv) {
             return run_algo("recsplit8", keys, [] { return recsplit8::builder{}; }, q);
         }, /*max_keys=*/1'000'000'000},
 
-        // recsplit16 works at 10K but fails at 100K+. Cap accordingly.
+        // recsplit16 leaves need ~e^16/sqrt(32 pi) seed trials each, about 2 ms
+        // of build per key. Cap accordingly.
         {"recsplit16", [&](const auto& keys, size_t q) {
             return run_algo("recsplit16", keys, [] { return recsplit16::builder{}; }, q);
         }, /*max_keys=*/50'000},
@@ -141,14 +156,17 @@ int main(int argc, char** argv) {
             return run_algo("fch", keys, [] { return fch_hasher::builder{}; }, q);
         }, /*max_keys=*/1'000'000'000},
 
-        // PTHash can't build large sets in the current implementation.
         {"pthash98", [&](const auto& keys, size_t q) {
             return run_algo("pthash98", keys, [] { return pthash98::builder{}; }, q);
-        }, /*max_keys=*/500},
+        }, /*max_keys=*/1'000'000'000},
+
+        {"pthash98_dict", [&](const auto& keys, size_t q) {
+            return run_algo("pthash98_dict", keys, [] { return pthash98_dictionary::builder{}; }, q);
+        }, /*max_keys=*/1'000'000'000},
 
         // shock_hash: bucketed 2-choice cuckoo with choice bits via ribbon<1>.
         // Non-minimal (range ~1.67 * num_keys at default settings) but
-        // achieves ~1.9 b/k structurally, well below PHOBIC's 2.7.
+        // achieves ~1.9 b/k structurally, well below PHOBIC's 2.5-3.2.
         {"shock_hash64", [&](const auto& keys, size_t q) {
             return run_algo("shock_hash64", keys,
                 [] { return shock_hash<64>::builder{}; }, q);
@@ -186,13 +204,24 @@ int main(int argc, char** argv) {
             if (r.ok) {
                 std::cerr << " " << r.build_ms << "ms build, "
                           << r.bits_per_key << " bits/key, "
-                          << r.query_median_ns << " ns/query\n";
+                          << r.query_median_ns << " ns/query, "
+                          << r.query_batch_ns << " ns/key batched\n";
             } else {
                 std::cerr << " BUILD FAILED\n";
             }
             print_tsv_row(std::cout, r);
             std::cout.flush();
         }
+
+        // Integer keys through slot_for(uint64_t), against the same keys
+        // as 8-byte strings.
+        auto ints = gen_u64_keys(kc);
+        std::cerr << "  phobic5_u64 / phobic5_u64_str ...\n";
+        print_tsv_row(std::cout, run_algo("phobic5_u64", ints,
+            [] { return phobic5::builder{}; }, total_queries));
+        print_tsv_row(std::cout, run_algo("phobic5_u64_str", u64_key_strings(ints),
+            [] { return phobic5::builder{}; }, total_queries));
+        std::cout.flush();
     }
 
     return 0;
@@ -14,6 +14,7 @@
  * Usage:
  *   bench_phf_sweep                # 50K keys
  *   bench_phf_sweep 100000         # custom
+ *   bench_phf_sweep --counters     # add hardware counter columns
  */
 
 #include "bench_harness.hpp"
@@ -47,9 +48,11 @@ result_row run_one(const std::string& name,
     r.fp_rate = 0.0;
 
     reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = make_builder().add_all(keys).build();
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     r.build_peak_rss_kb = get_peak_rss_kb();
 
@@ -66,12 +69,14 @@ result_row run_one(const std::string& name,
     r.query_median_ns = qs.median_ns;
     r.query_p99_ns = qs.p99_ns;
     r.query_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
     return r;
 }
 
 int main(int argc, char** argv) {
-    size_t kc = 50'000;
-    if (argc > 1) kc = std::stoul(argv[1]);
+    cli_args args(argc, argv);
+    const size_t kc = args.positional_sizes({50'000}).at(0);
 
     const size_t total_queries = 1'000'000;
 
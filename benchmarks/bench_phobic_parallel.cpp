@@ -1,38 +1,43 @@
 /**
  * @file bench_phobic_parallel.cpp
- * @brief Compares four PHOBIC build strategies at scale.
+ * @brief Compares PHOBIC build strategies at scale.
  *
  * Strategies:
- *   - serial:     threads=1 (original sequential algorithm)
- *   - bucket:     threads=N, no fat-bucket pre-pass (each bucket processed
- *                 by one worker; straggler-prone on the largest buckets)
- *   - fat+bucket: threads=N, fat buckets processed cooperatively first,
- *                 then thin buckets via work-stealing
+ *   - serial:     threads=1 (the sequential algorithm)
+ *   - window:     threads=N, hashing and pilot search on a persistent
+ *                 task_pool; pilots are searched a window of buckets at a
+ *                 time with range work-stealing and committed in order, so
+ *                 the result is the serial one
  *   - partitioned: partitioned_phf<phobic_K> with auto shard count; each
  *                 shard is a serial inner build, parallelized across shards
  *
- * The third strategy is what the current with_threads(N) implements (it
- * transparently uses the fat-bucket pre-pass). Reproducing the "bucket-only"
- * strategy would require an extra flag; for now the "bucket" column is
- * reported via the threads=N numbers from the previous implementation (see
- * docs/BENCHMARK_RESULTS.md history) and the current with_threads(N) is
- * labeled "fat+bucket" since that is what actually runs.
+ * bbhash3 is swept as the fast-build reference: its with_threads(N) splits
+ * each level across threads (shared atomic bitsets, parallel compaction of
+ * the colliding keys), reported as strategy "level".
+ *
+ * Threads sweep 2, 4, 8, ... up to the larger of 8 and the hardware
+ * concurrency, so a 64- or 128-core machine reports its whole curve;
+ * MAPH_BENCH_MAX_THREADS overrides the ceiling.
  *
  * Usage:
  *   bench_phobic_parallel                        # default: 100K 1M
  *   bench_phobic_parallel 100000 250000 1000000  # custom
+ *   bench_phobic_parallel --counters             # hardware counters per row
  */
 
 #include "bench_harness.hpp"
 
+#include <maph/algorithms/bbhash.hpp>
 #include <maph/algorithms/phobic.hpp>
 #include <maph/composition/partitioned.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace maph;
@@ -51,6 +56,9 @@ struct row {
     double query_median_ns;
     double speedup;   // vs the serial baseline in the same (algo, keys) group
     bool ok;
+    counter_sample build_counters{};  // per key, --counters only
+    counter_sample query_counters{};  // per query
+    std::vector<double> query_samples{};  // sub-batch ns per query, for --json
 };
 
 template<typename PHF>
@@ -63,19 +71,21 @@ row run_phobic(const std::string& algo,
     using std::chrono::microseconds;
 
     row r{};
-    r.strategy = (threads <= 1) ? "serial" : "fat+bucket";
+    r.strategy = (threads <= 1) ? "serial" : "window";
     r.algo = algo;
     r.keys = keys.size();
     r.threads = threads;
     r.shards = 0;
     r.ok = false;
 
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = typename PHF::builder{}
         .add_all(keys)
         .with_threads(threads)
         .build();
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     if (!built.has_value()) return r;
 
@@ -83,6 +93,8 @@ row run_phobic(const std::string& algo,
     r.bits_per_key = built->bits_per_key();
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
     return r;
 }
 
@@ -104,6 +116,7 @@ row run_partitioned(const std::string& algo,
     r.shards = shards;
     r.ok = false;
 
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = typename partitioned_phf<Inner>::builder{}
         .add_all(keys)
@@ -111,6 +124,7 @@ row run_partitioned(const std::string& algo,
         .with_shards(shards)
         .build();
     auto t1 = clock::now();
+    r.build_counters = counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = duration_cast<microseconds>(t1 - t0).count() / 1000.0;
     if (!built.has_value()) return r;
 
@@ -119,6 +133,8 @@ row run_partitioned(const std::string& algo,
     r.shards = shards ? shards : (built->range_size() ? /* auto used */ r.shards : 0);
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
     return r;
 }
 
@@ -152,6 +168,31 @@ void print_row(const row& r) {
         << std::setw(10) << std::setprecision(2) << r.speedup
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters);
+    report_counters(std::cout, "query", r.query_counters);
+    record_result()
+        .config("strategy", r.strategy)
+        .config("algo", r.algo)
+        .config("keys", static_cast<double>(r.keys))
+        .config("threads", static_cast<double>(r.threads))
+        .config("shards", static_cast<double>(r.shards))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_ms", r.build_ms)
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("speedup", r.speedup)
+        .samples("query_med_ns", r.query_samples);
+}
+
+// 2, 4, 8, ... up to max(8, hardware threads) or MAPH_BENCH_MAX_THREADS.
+std::vector<size_t> thread_counts() {
+    size_t ceiling = std::max<size_t>(8, std::thread::hardware_concurrency());
+    if (const char* env = std::getenv("MAPH_BENCH_MAX_THREADS")) {
+        ceiling = std::max<size_t>(2, std::strtoul(env, nullptr, 10));
+    }
+    std::vector<size_t> counts;
+    for (size_t t = 2; t <= ceiling; t *= 2) counts.push_back(t);
+    return counts;
 }
 
 template<typename PHF>
@@ -165,16 +206,17 @@ void sweep_one_algo(const std::string& algo, size_t kc, size_t total_queries) {
     std::cerr << (serial.ok ? " ok" : " FAILED") << " (" << serial.build_ms << " ms)\n";
     rows.push_back(serial);
 
-    // Current parallel (fat-bucket + work-stealing) at 2, 4, 8 threads.
-    for (size_t t : {size_t{2}, size_t{4}, size_t{8}}) {
-        std::cerr << "  " << algo << " keys=" << kc << " fat+bucket T=" << t << " ..." << std::flush;
+    for (size_t t : thread_counts()) {
+        std::cerr << "  " << algo << " keys=" << kc << " window T=" << t << " ..." << std::flush;
         auto r = run_phobic<PHF>(algo, keys, t, total_queries);
         std::cerr << (r.ok ? " ok" : " FAILED") << " (" << r.build_ms << " ms)\n";
         rows.push_back(r);
     }
 
-    // Partitioned: auto shards, 1 / 2 / 4 / 8 threads.
-    for (size_t t : {size_t{1}, size_t{2}, size_t{4}, size_t{8}}) {
+    // Partitioned: auto shards, 1 thread and the same sweep.
+    std::vector<size_t> partitioned_threads{1};
+    for (size_t t : thread_counts()) partitioned_threads.push_back(t);
+    for (size_t t : partitioned_threads) {
         std::cerr << "  partitioned<" << algo << "> keys=" << kc
                   << " T=" << t << " ..." << std::flush;
         auto r = run_partitioned<PHF>(algo, keys, t, total_queries, 0);
@@ -190,21 +232,38 @@ void sweep_one_algo(const std::string& algo, size_t kc, size_t total_queries) {
     std::cout << '\n';
 }
 
+void sweep_bbhash(size_t kc, size_t total_queries) {
+    auto keys = gen_random_keys(kc);
+    std::vector<row> rows;
+    for (size_t t : {size_t{1}, size_t{2}, size_t{4}, size_t{8}}) {
+        std::cerr << "  bbhash3 keys=" << kc << " T=" << t << " ..." << std::flush;
+        auto r = run_phobic<bbhash3>("bbhash3", keys, t, total_queries);
+        if (t > 1) r.strategy = "level";
+        std::cerr << (r.ok ? " ok" : " FAILED") << " (" << r.build_ms << " ms)\n";
+        rows.push_back(r);
+    }
+
+    double base = rows[0].ok ? rows[0].build_ms : 0.0;
+    for (auto& r : rows) {
+        r.speedup = (r.ok && base > 0.0) ? base / r.build_ms : 0.0;
+        print_row(r);
+    }
+    std::cout << '\n';
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
-    std::vector<size_t> key_counts = {100'000, 1'000'000};
-    if (argc > 1) {
-        key_counts.clear();
-        for (int i = 1; i < argc; ++i) key_counts.push_back(std::stoul(argv[i]));
-    }
+    cli_args args(argc, argv);
+    std::vector<size_t> key_counts = args.positional_sizes({100'000, 1'000'000});
 
     const size_t total_queries = 250'000;
 
     std::cerr << "PHOBIC parallel build strategies\n"
               << "  key counts: ";
     for (auto k : key_counts) std::cerr << k << ' ';
-    std::cerr << "\n  strategies: serial, fat+bucket (T=2,4,8), partitioned (T=1,2,4,8)\n\n";
+    std::cerr << "\n  strategies: serial, window (T=2.." << thread_counts().back()
+              << "), partitioned; bbhash3 serial and level (T=2,4,8)\n\n";
 
     print_header();
 
@@ -212,6 +271,7 @@ int main(int argc, char** argv) {
         sweep_one_algo<phobic3>("phobic3", kc, total_queries);
         sweep_one_algo<phobic4>("phobic4", kc, total_queries);
         sweep_one_algo<phobic5>("phobic5", kc, total_queries);
+        sweep_bbhash(kc, total_queries);
     }
     return 0;
 }
@@ -0,0 +1,466 @@
+/**
+ * @file bench_query_mt.cpp
+ * @brief Query throughput with 1..N threads sharing one read-only structure.
+ *
+ * Every other benchmark queries from one thread. Served for real, one
+ * structure is read by every core at once and the limit becomes memory
+ * bandwidth, not the latency of one lookup. This program builds each
+ * structure once and queries it from T threads at a time, for each T in
+ * --threads:
+ *
+ *   phobic5      phobic_phf<5>::slot_for
+ *   part5        partitioned_phf<phobic5>::slot_for
+ *   filter16     perfect_filter<phobic5, 16>::contains
+ *   pva32        phf_value_array<phobic5, 32>::lookup
+ *   xor16        xor_filter<16>::verify
+ *   fuse16       binary_fuse_filter<16>::verify
+ *   ribbon16     ribbon_filter<16>::verify
+ *
+ * and two rows that query pva32 through a holder while a writer thread
+ * swaps in a new instance every --swap_us microseconds (both are views
+ * over the same serialized bytes, so only the holder differs):
+ *
+ *   pva32_snapshot   snapshot<phf_value_array_view<..>>: one read()
+ *                    guard per query
+ *   pva32_shared     std::atomic<std::shared_ptr<..>>: one load, so one
+ *                    shared reference count bump, per query
+ *
+ * Each thread draws its own query stream from the run's workload (uniform
+ * members unless --workload, --negative or --cold say otherwise; seeded
+ * by the thread's index), waits at a start barrier, then times batches
+ * of --batch queries. With --cold each thread flushes the shared caches
+ * before each of its batches; those flushes are outside the timings but
+ * inside the counters, which cannot stop per thread.
+ * Columns:
+ *
+ *   mqps          all threads' queries over the wall time from the first
+ *                 start to the last finish
+ *   mqps_thread   mqps / T; flat while the structure scales
+ *   p50_ns        median over threads of each thread's median batch
+ *                 ns/query
+ *   p99_ns        median over threads of each thread's p99
+ *   worst_p99_ns  the slowest thread's p99
+ *   mem_mb        the structure's memory_bytes()
+ *   dram_gbps     LLC misses x 64 bytes over the wall time: the DRAM read
+ *                 bandwidth the queries drew. Needs --counters and a PMU;
+ *                 nan otherwise
+ *
+ * With --counters the per-query counter columns follow, summed over
+ * every query thread.
+ *
+ * Placement (--pin):
+ *   none     the scheduler decides (default)
+ *   compact  thread t on the t-th CPU this process may run on
+ *   numa     threads dealt round-robin over the NUMA nodes
+ *            (/sys/devices/system/node), each pinned to its node's next
+ *            CPU, so T threads split evenly across sockets. The
+ *            structure stays wherever the build thread allocated it.
+ *
+ * Usage:
+ *   bench_query_mt                                # 1M keys, T = 1, 2, 4, .. cores
+ *   bench_query_mt --keys=50000000 --threads=1,8,24,48 --pin=numa
+ *   bench_query_mt --queries=2000000 --per_thread  # + one line per thread
+ *   bench_query_mt --counters                      # + dram_gbps, counters
+ *   bench_query_mt --swap_us=100                   # swap the holders more often
+ */
+
+#include "bench_harness.hpp"
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/composition/snapshot.hpp>
+#include <maph/filters/binary_fuse_filter.hpp>
+#include <maph/filters/ribbon_filter.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace maph;
+using namespace maph::bench;
+
+namespace {
+
+// ===== CPU placement =====
+
+// CPUs this process may run on.
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &set)) cpus.push_back(c);
+        }
+    }
+#endif
+    return cpus;
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> parse_cpulist(const std::string& s) {
+    std::vector<int> out;
+    size_t start = 0;
+    while (start < s.size()) {
+        auto end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        const std::string part = s.substr(start, end - start);
+        const auto dash = part.find('-');
+        try {
+            const int lo = std::stoi(part.substr(0, dash));
+            const int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+            for (int c = lo; c <= hi; ++c) out.push_back(c);
+        } catch (...) { /* skip */ }
+        start = end + 1;
+    }
+    return out;
+}
+
+// The allowed CPUs of each NUMA node that has any; one node holding all
+// of them when the system reports none.
+std::vector<std::vector<int>> numa_nodes(const std::vector<int>& allowed) {
+    namespace fs = std::filesystem;
+    std::vector<std::vector<int>> nodes;
+    std::error_code ec;
+    const fs::path root{"/sys/devices/system/node"};
+    std::vector<fs::path> dirs;
+    for (const auto& e : fs::directory_iterator(root, ec)) {
+        const auto name = e.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+            std::isdigit(static_cast<unsigned char>(name[4]))) {
+            dirs.push_back(e.path());
+        }
+    }
+    std::sort(dirs.begin(), dirs.end());
+    for (const auto& d : dirs) {
+        std::ifstream in(d / "cpulist");
+        std::string line;
+        std::getline(in, line);
+        std::vector<int> cpus;
+        for (int c : parse_cpulist(line)) {
+            if (std::find(allowed.begin(), allowed.end(), c) != allowed.end()) cpus.push_back(c);
+        }
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+    if (nodes.empty()) nodes.push_back(allowed);
+    return nodes;
+}
+
+// The CPU of each of `threads` threads, -1 for unpinned.
+std::vector<int> placement(size_t threads, const std::string& mode) {
+    std::vector<int> cpu(threads, -1);
+    const auto allowed = allowed_cpus();
+    if (allowed.empty() || mode == "none") return cpu;
+    if (mode == "numa") {
+        const auto nodes = numa_nodes(allowed);
+        for (size_t t = 0; t < threads; ++t) {
+            const auto& node = nodes[t % nodes.size()];
+            cpu[t] = node[(t / nodes.size()) % node.size()];
+        }
+    } else {
+        for (size_t t = 0; t < threads; ++t) cpu[t] = allowed[t % allowed.size()];
+    }
+    return cpu;
+}
+
+void pin_to(std::thread& th, int cpu) {
+#if defined(__linux__)
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(th.native_handle(), sizeof(set), &set);
+#else
+    (void)th;
+    (void)cpu;
+#endif
+}
+
+// ===== Measurement =====
+
+struct run_config {
+    size_t queries_per_thread;
+    size_t batch;
+    std::string pin;
+    bool per_thread;
+};
+
+struct thread_stats {
+    std::chrono::steady_clock::time_point start, end;
+    double p50_ns{0};
+    double p99_ns{0};
+    double timed_ns{0};  // inside the timed batches, i.e. without --cold flushes
+    int cpu{-1};
+};
+
+double percentile(std::vector<double>& v, double q) {
+    if (v.empty()) return std::numeric_limits<double>::quiet_NaN();
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(static_cast<double>(v.size()) * q))];
+}
+
+void print_header() {
+    std::cout << "structure\tthreads\tmqps\tmqps_thread\tp50_ns\tp99_ns\tworst_p99_ns"
+                 "\tmem_mb\tdram_gbps";
+    if (counters_active()) print_counter_tsv_header(std::cout, "");
+    std::cout << '\n';
+}
+
+// probe(key) -> uint64_t is one query; its results feed a per-thread sink
+// so that threads never write a shared line while timed.
+template<typename Probe>
+void run_threads(const char* name, size_t mem_bytes, size_t threads,
+                 const std::vector<std::string>& keys, const run_config& cfg,
+                 const Probe& probe) {
+    const auto cpus = placement(threads, cfg.pin);
+    std::vector<thread_stats> stats(threads);
+    std::vector<uint64_t> sinks(threads * 8);  // one cache line apart
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    const bool cold = current_workload().cold;
+
+    auto body = [&](size_t t) {
+        const query_stream<std::string> stream(keys, cfg.queries_per_thread, 12345 + t);
+        const std::vector<std::string_view> queries = stream.views();
+        const size_t batches = std::max<size_t>(1, queries.size() / cfg.batch);
+        std::vector<double> batch_ns;
+        batch_ns.reserve(batches);
+        uint64_t acc = 0;
+        for (size_t i = 0; i < std::min<size_t>(queries.size(), 10'000); ++i) acc += probe(queries[i]);
+
+        ready.fetch_add(1, std::memory_order_acq_rel);
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+        auto& st = stats[t];
+        st.start = std::chrono::steady_clock::now();
+        auto prev = st.start;
+        for (size_t b = 0; b < batches; ++b) {
+            if (cold) {
+                cool_caches();
+                prev = std::chrono::steady_clock::now();
+            }
+            const size_t lo = b * cfg.batch;
+            const size_t hi = std::min(queries.size(), lo + cfg.batch);
+            for (size_t i = lo; i < hi; ++i) acc += probe(queries[i]);
+            const auto now = std::chrono::steady_clock::now();
+            const double ns = std::chrono::duration<double, std::nano>(now - prev).count();
+            st.timed_ns += ns;
+            batch_ns.push_back(ns / static_cast<double>(hi - lo));
+            prev = now;
+        }
+        st.end = prev;
+        st.p50_ns = percentile(batch_ns, 0.50);
+        st.p99_ns = percentile(batch_ns, 0.99);
+        sinks[t * 8] = acc;
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back(body, t);
+        pin_to(pool.back(), cpus[t]);
+        stats[t].cpu = cpus[t];
+    }
+    while (ready.load(std::memory_order_acquire) < threads) std::this_thread::yield();
+
+    // Counted from the release of the barrier to the last join, so query
+    // generation and warm-up stay out of the figures.
+    counter_scope counted;
+    go.store(true, std::memory_order_release);
+    for (auto& th : pool) th.join();
+    const counter_sample counts = counted.stop();
+    for (uint64_t s : sinks) consume(slot_index{s});
+
+    auto first = stats[0].start;
+    auto last = stats[0].end;
+    std::vector<double> p50s, p99s;
+    for (const auto& st : stats) {
+        first = std::min(first, st.start);
+        last = std::max(last, st.end);
+        p50s.push_back(st.p50_ns);
+        p99s.push_back(st.p99_ns);
+    }
+    // With --cold, the slowest thread's time inside its batches: flushes
+    // are not queries.
+    double wall_ns = std::chrono::duration<double, std::nano>(last - first).count();
+    if (cold) {
+        wall_ns = 0;
+        for (const auto& st : stats) wall_ns = std::max(wall_ns, st.timed_ns);
+    }
+    const size_t per_thread = std::max<size_t>(1, cfg.queries_per_thread / cfg.batch) *
+                              std::min(cfg.batch, cfg.queries_per_thread);
+    const double total = static_cast<double>(per_thread * threads);
+    const double mqps = total / wall_ns * 1e3;
+    const double worst = *std::max_element(p99s.begin(), p99s.end());
+    const double dram_gbps = counts.value[3] * 64.0 / wall_ns;  // bytes per ns = GB/s
+
+    std::cout << name << '\t' << threads << '\t'
+              << std::fixed << std::setprecision(2) << mqps << '\t'
+              << mqps / static_cast<double>(threads) << '\t'
+              << percentile(p50s, 0.5) << '\t' << percentile(p99s, 0.5) << '\t' << worst << '\t'
+              << static_cast<double>(mem_bytes) / (1024.0 * 1024.0) << '\t'
+              << dram_gbps;
+    if (counters_active()) print_counter_tsv(std::cout, counts.per(total));
+    std::cout << '\n';
+    record_result()
+        .config("structure", name).config("threads", static_cast<double>(threads))
+        .metric("mqps", mqps)
+        .metric("mqps_thread", mqps / static_cast<double>(threads))
+        .metric("p50_ns", percentile(p50s, 0.5))
+        .metric("p99_ns", percentile(p99s, 0.5))
+        .metric("worst_p99_ns", worst)
+        .metric("mem_mb", static_cast<double>(mem_bytes) / (1024.0 * 1024.0))
+        .metric("dram_gbps", dram_gbps)
+        .samples("p50_ns", p50s)
+        .samples("p99_ns", p99s);
+    if (cfg.per_thread) {
+        for (size_t t = 0; t < threads; ++t) {
+            std::cout << "#   thread " << t << " cpu " << stats[t].cpu
+                      << std::setprecision(2) << "  p50_ns=" << stats[t].p50_ns
+                      << "  p99_ns=" << stats[t].p99_ns << '\n';
+        }
+    }
+    std::cout.flush();
+}
+
+template<typename Probe>
+void run_structure(const char* name, size_t mem_bytes, std::span<const size_t> thread_counts,
+                   const std::vector<std::string>& keys, const run_config& cfg,
+                   const Probe& probe) {
+    std::cerr << "  " << name << " ...\n";
+    for (size_t t : thread_counts) run_threads(name, mem_bytes, t, keys, cfg, probe);
+    std::cout << '\n';
+}
+
+// Run `body` while another thread calls publish() every `period_us`.
+template<typename Publish, typename Body>
+void with_swaps(const char* name, size_t period_us, const Publish& publish, const Body& body) {
+    std::atomic<bool> stop{false};
+    size_t swaps = 0;
+    std::thread writer([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(period_us));
+            publish();
+            ++swaps;
+        }
+    });
+    body();
+    stop = true;
+    writer.join();
+    std::cerr << "    " << name << ": " << swaps << " swaps\n";
+}
+
+std::vector<size_t> default_thread_counts() {
+    const size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<size_t> out;
+    for (size_t t = 1; t < hw; t *= 2) out.push_back(t);
+    out.push_back(hw);
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    cli_args args(argc, argv);
+    const size_t n = args.get_size("keys", 1'000'000);
+    const auto thread_counts = args.get_size_list("threads", default_thread_counts());
+    const std::string dist = args.get_string("distribution", "random");
+    run_config cfg{
+        .queries_per_thread = args.get_size("queries", 1'000'000),
+        .batch = std::max<size_t>(1, args.get_size("batch", 1000)),
+        .pin = args.get_string("pin", "none"),
+        .per_thread = args.has("per_thread"),
+    };
+    const size_t swap_us = args.get_size("swap_us", 1000);
+    const size_t build_threads = args.get_size("build_threads",
+        std::max<size_t>(1, std::thread::hardware_concurrency()));
+
+    std::cerr << "multi-threaded queries\n"
+              << "  keys: " << n << " (" << dist << "), queries per thread: "
+              << cfg.queries_per_thread << "\n  threads:";
+    for (size_t t : thread_counts) std::cerr << ' ' << t;
+    std::cerr << "\n  pin: " << cfg.pin;
+    if (cfg.pin == "numa") std::cerr << " (" << numa_nodes(allowed_cpus()).size() << " nodes)";
+    std::cerr << "\n";
+
+    auto keys = gen_keys_by_name(dist, n);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 2654435761u);
+
+    std::cerr << "  building...\n";
+    auto phf = phobic5::builder{}.add_all(keys).with_threads(build_threads).build();
+    auto part = partitioned_phf<phobic5>::builder{}.add_all(keys).with_threads(build_threads).build();
+    auto pva = phf_value_array<phobic5, 32>::builder{}
+                   .add_all(std::span<const std::string>{keys}, std::span<const uint32_t>{values})
+                   .build();
+    xor_filter<16> xf;
+    binary_fuse_filter<16> bf;
+    ribbon_filter<16> rf;
+    if (!phf || !part || !pva || !xf.build(keys, build_threads) ||
+        !bf.build(keys, build_threads) || !rf.build(keys)) {
+        std::cerr << "build failed\n";
+        return 1;
+    }
+    // perfect_filter owns its PHF, so it gets a build of its own.
+    auto filter = perfect_filter<phobic5, 16>::build(
+        phobic5::builder{}.add_all(keys).with_threads(build_threads).build().value(), keys);
+
+    print_header();
+    run_structure("phobic5", phf->memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(phf->slot_for(k).value); });
+    run_structure("part5", part->memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(part->slot_for(k).value); });
+    const size_t filter_bytes = filter.phf().memory_bytes() + (filter.range_size() * 16 + 7) / 8;
+    run_structure("filter16", filter_bytes, thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(filter.contains(k)); });
+    run_structure("pva32", pva->memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(pva->lookup(k)); });
+
+    using pva_view = phf_value_array_view<phobic_phf_view<5>, 32>;
+    const auto pva_bytes = pva->serialize();
+    auto fresh_view = [&] { return pva_view::deserialize(pva_bytes).value(); };
+    snapshot<pva_view> live{fresh_view()};
+    with_swaps("pva32_snapshot", swap_us, [&] { live.publish(fresh_view()); }, [&] {
+        run_structure("pva32_snapshot", pva->memory_bytes(), thread_counts, keys, cfg,
+            [&](std::string_view k) {
+                thread_local auto reader = live.make_reader();
+                return static_cast<uint64_t>(reader.read()->lookup(k));
+            });
+    });
+    std::atomic<std::shared_ptr<const pva_view>> shared{std::make_shared<const pva_view>(fresh_view())};
+    with_swaps("pva32_shared", swap_us,
+        [&] { shared.store(std::make_shared<const pva_view>(fresh_view())); }, [&] {
+        run_structure("pva32_shared", pva->memory_bytes(), thread_counts, keys, cfg,
+            [&](std::string_view k) { return static_cast<uint64_t>(shared.load()->lookup(k)); });
+    });
+    run_structure("xor16", xf.memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(xf.verify(k)); });
+    run_structure("fuse16", bf.memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(bf.verify(k)); });
+    run_structure("ribbon16", rf.memory_bytes(), thread_counts, keys, cfg,
+        [&](std::string_view k) { return static_cast<uint64_t>(rf.verify(k)); });
+    return 0;
+}
@@ -6,8 +6,13 @@
  * which retrieval method minimizes bits/key at what build-time and query cost?
  *
  * Sweeps:
- *   - methods: ribbon_retrieval<M>, phf_value_array<phobic5, M>,
- *              phf_value_array<bbhash5, M>
+ *   - methods: ribbon_retrieval<M> (flat and interleaved solution),
+ *              phf_value_array<phobic5, M>, phf_value_array<bbhash5, M>,
+ *              compressed_retrieval<uint32_t, 8> over skewed labels (one
+ *              label on ~90% of keys; the M-bit methods cost the same for
+ *              any values), tiered_value_array<part<phobic4>, M, phobic5>
+ *              with weights counted from a query log drawn from the
+ *              workload (pays off under --workload=zipf or hotcold)
  *   - value widths M in {1, 8, 16, 32, 64}
  *   - key counts (from --keys argument; default 100000, 1000000)
  *
@@ -16,6 +21,8 @@
  *   bench_retrieval --keys=100000,1000000             # custom scales
  *   bench_retrieval --keys=10000 --queries=1000000    # small, heavy queries
  *   bench_retrieval --distribution=url                # distribution sensitivity
+ *   bench_retrieval --workload=zipf --keys=10000000   # skewed queries: tiered vs flat
+ *   bench_retrieval --counters                        # + hardware counters per op
  */
 
 #include "bench_harness.hpp"
@@ -23,10 +30,13 @@
 #include <maph/algorithms/bbhash.hpp>
 #include <maph/algorithms/phobic.hpp>
 #include <maph/composition/partitioned.hpp>
+#include <maph/composition/tiered.hpp>
+#include <maph/retrieval/compressed_retrieval.hpp>
 #include <maph/retrieval/phf_value_array.hpp>
 #include <maph/retrieval/ribbon_retrieval.hpp>
 
 #include <chrono>
+#include <concepts>
 #include <cstdint>
 #include <cstdlib>
 #include <iomanip>
@@ -50,6 +60,9 @@ struct row {
     double query_median_ns;
     double throughput_mqps;
     bool ok;
+    counter_sample build_counters{};
+    counter_sample query_counters{};
+    std::vector<double> query_samples{};  // sub-batch ns per query, for --json
 };
 
 // Deterministic value derived from key bytes; truncated to M bits at the
@@ -68,9 +81,12 @@ uint64_t deterministic_value(std::string_view key) noexcept {
 struct query_stats {
     double median_ns;
     double throughput_mqps;
+    counter_sample counters{};
+    std::vector<double> samples{};
 };
 
-// Measure lookup latency over in-set keys. Value sink prevents DCE.
+// Measure lookup latency over the workload's keys (random members by
+// default). Value sink prevents DCE.
 template <typename Retrieval>
 query_stats measure_lookups(const Retrieval& r,
                             const std::vector<std::string>& keys,
@@ -86,56 +102,63 @@ query_stats measure_lookups(const Retrieval& r,
     std::vector<double> per_batch_ns;
     per_batch_ns.reserve(outer);
 
+    const query_stream<std::string> queries(keys, outer * inner_batch, 12345);
+
     uint64_t sink = 0;
+    counter_scope counted;
+    double timed_ns = 0;
     auto t_total0 = clock::now();
-    size_t idx = 0;
     for (size_t i = 0; i < outer; ++i) {
+        cool_caches(counted);
         auto t0 = clock::now();
         for (size_t j = 0; j < inner_batch; ++j) {
-            sink ^= static_cast<uint64_t>(r.lookup(keys[idx]));
-            idx++;
-            if (idx >= keys.size()) idx = 0;
+            sink ^= static_cast<uint64_t>(r.lookup(queries[i * inner_batch + j]));
         }
         auto t1 = clock::now();
-        double ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count())
-                  / static_cast<double>(inner_batch);
-        per_batch_ns.push_back(ns);
+        const double batch_ns = static_cast<double>(duration_cast<nanoseconds>(t1 - t0).count());
+        timed_ns += batch_ns;
+        per_batch_ns.push_back(batch_ns / static_cast<double>(inner_batch));
     }
     auto t_total1 = clock::now();
+    const counter_sample counts = counted.stop();
     consume(sink != 0);
 
     std::sort(per_batch_ns.begin(), per_batch_ns.end());
     double median = per_batch_ns[per_batch_ns.size() / 2];
 
-    double total_s = static_cast<double>(
-        duration_cast<nanoseconds>(t_total1 - t_total0).count()) * 1e-9;
+    double total_s = (current_workload().cold ? timed_ns : static_cast<double>(
+        duration_cast<nanoseconds>(t_total1 - t_total0).count())) * 1e-9;
     double total_q = static_cast<double>(outer * inner_batch);
     double mqps = total_q / total_s / 1e6;
 
-    return {median, mqps};
+    return {median, mqps, counts.per(total_q), std::move(per_batch_ns)};
 }
 
 // ===== Per-method runners =====
 
-template <unsigned M>
-row run_ribbon(const std::vector<std::string>& keys, size_t total_queries) {
+template <unsigned M, typename Layout = flat_solution>
+row run_ribbon(const std::vector<std::string>& keys, size_t total_queries, size_t threads) {
     using clock = std::chrono::high_resolution_clock;
     using std::chrono::duration_cast;
     using std::chrono::microseconds;
 
     row r{};
-    r.method = "ribbon<" + std::to_string(M) + ">";
+    r.method = (std::same_as<Layout, interleaved_solution> ? "ribbon_il<" : "ribbon<")
+             + std::to_string(M) + ">";
     r.value_bits = M;
     r.keys = keys.size();
 
     std::cerr << "  " << r.method << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
-    auto built = typename ribbon_retrieval<M>::builder{}
+    auto built = typename ribbon_retrieval<M, Layout>::builder{}
         .add_all_with(std::span<const std::string>{keys},
                       [](std::string_view k) { return deterministic_value(k); })
+        .with_threads(threads)
         .build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = static_cast<double>(duration_cast<microseconds>(t1 - t0).count()) / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -148,6 +171,8 @@ row run_ribbon(const std::vector<std::string>& keys, size_t total_queries) {
     auto qs = measure_lookups(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     std::cerr << " " << r.build_ms << " ms, "
               << r.bits_per_key << " b/k, "
@@ -155,6 +180,56 @@ row run_ribbon(const std::vector<std::string>& keys, size_t total_queries) {
     return r;
 }
 
+// Label 0 on ~90% of keys, the rest over 1..40: an entropy of ~0.8 bits.
+uint32_t skewed_label(std::string_view key) noexcept {
+    const uint64_t h = deterministic_value(key);
+    return h % 10 == 0 ? 1 + static_cast<uint32_t>((h >> 8) % 40) : 0;
+}
+
+row run_compressed(const std::vector<std::string>& keys, size_t total_queries, size_t threads) {
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using labels = compressed_retrieval<uint32_t, 8>;
+
+    row r{};
+    r.method = "compressed<8>,p0=0.9";
+    r.value_bits = 8;
+    r.keys = keys.size();
+
+    std::cerr << "  " << r.method << " ..." << std::flush;
+
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values[i] = skewed_label(keys[i]);
+    counter_scope build_counted;
+    auto t0 = clock::now();
+    auto built = labels::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const uint32_t>{values})
+        .with_threads(threads)
+        .build();
+    auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
+    r.build_ms = static_cast<double>(duration_cast<microseconds>(t1 - t0).count()) / 1000.0;
+    if (!built.has_value()) {
+        std::cerr << " BUILD FAILED\n";
+        r.ok = false;
+        return r;
+    }
+    r.ok = true;
+    r.bits_per_key = built->bits_per_key();
+    r.memory_kb = built->memory_bytes() / 1024;
+    auto qs = measure_lookups(*built, keys, total_queries);
+    r.query_median_ns = qs.median_ns;
+    r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+
+    std::cerr << " " << r.build_ms << " ms, "
+              << r.bits_per_key << " b/k (" << built->mean_code_length() << " code bits), "
+              << r.query_median_ns << " ns/q\n";
+    return r;
+}
+
 template <typename PHF, unsigned M>
 row run_phf_array(const std::string& phf_name,
                   const std::vector<std::string>& keys,
@@ -171,6 +246,7 @@ row run_phf_array(const std::string& phf_name,
 
     std::cerr << "  " << r.method << " ..." << std::flush;
 
+    counter_scope build_counted;
     auto t0 = clock::now();
     auto builder = typename phf_value_array<PHF, M>::builder{};
     builder.add_all_with(std::span<const std::string>{keys},
@@ -180,6 +256,7 @@ row run_phf_array(const std::string& phf_name,
     }
     auto built = builder.build();
     auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
     r.build_ms = static_cast<double>(duration_cast<microseconds>(t1 - t0).count()) / 1000.0;
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED\n";
@@ -192,6 +269,8 @@ row run_phf_array(const std::string& phf_name,
     auto qs = measure_lookups(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     std::cerr << " " << r.build_ms << " ms, "
               << r.bits_per_key << " b/k, "
@@ -199,6 +278,67 @@ row run_phf_array(const std::string& phf_name,
     return r;
 }
 
+// Hot tier picked from the access counts of a query log drawn from the
+// run's workload (another seed than the timed stream's).
+template <typename PHF, typename HotPHF, unsigned M>
+row run_tiered(const std::string& phf_name,
+               const std::vector<std::string>& keys,
+               size_t total_queries,
+               size_t threads) {
+    using clock = std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using tiered = tiered_value_array<PHF, M, HotPHF>;
+
+    row r{};
+    r.method = "tiered<" + phf_name + "," + std::to_string(M) + ">";
+    r.value_bits = M;
+    r.keys = keys.size();
+
+    std::cerr << "  " << r.method << " ..." << std::flush;
+
+    const query_stream<std::string> log(keys, std::max<size_t>(total_queries, keys.size()), 999);
+    std::vector<double> weights(keys.size(), 0.0);
+    for (size_t i = 0; i < log.size(); ++i) {
+        const std::string* k = &log[i];
+        if (k >= keys.data() && k < keys.data() + keys.size()) weights[static_cast<size_t>(k - keys.data())] += 1.0;
+    }
+    std::vector<typename tiered::value_type> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        values[i] = static_cast<typename tiered::value_type>(deterministic_value(keys[i]));
+    }
+
+    counter_scope build_counted;
+    auto t0 = clock::now();
+    auto built = typename tiered::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const typename tiered::value_type>{values},
+                 std::span<const double>{weights})
+        .with_threads(threads)
+        .build();
+    auto t1 = clock::now();
+    r.build_counters = build_counted.stop().per(static_cast<double>(keys.size()));
+    r.build_ms = static_cast<double>(duration_cast<microseconds>(t1 - t0).count()) / 1000.0;
+    if (!built.has_value()) {
+        std::cerr << " BUILD FAILED\n";
+        r.ok = false;
+        return r;
+    }
+    r.ok = true;
+    r.bits_per_key = built->bits_per_key();
+    r.memory_kb = built->memory_bytes() / 1024;
+    auto qs = measure_lookups(*built, keys, total_queries);
+    r.query_median_ns = qs.median_ns;
+    r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
+
+    std::cerr << " " << r.build_ms << " ms, "
+              << r.bits_per_key << " b/k (" << built->hot_keys() << " hot, "
+              << built->hot_bytes() / 1024 << " KiB), "
+              << r.query_median_ns << " ns/q\n";
+    return r;
+}
+
 void print_header() {
     std::cout << std::left
         << std::setw(28) << "method"
@@ -227,7 +367,20 @@ void print_row(const row& r) {
         << std::setw(12) << std::setprecision(2) << r.throughput_mqps
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters);
+    report_counters(std::cout, "query", r.query_counters);
     std::cout.flush();
+    record_result()
+        .config("method", r.method)
+        .config("value_bits", static_cast<double>(r.value_bits))
+        .config("keys", static_cast<double>(r.keys))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_ms", r.build_ms)
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("memory_kb", static_cast<double>(r.memory_kb))
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("throughput_mqps", r.throughput_mqps)
+        .samples("query_med_ns", r.query_samples);
 }
 
 } // namespace
@@ -249,7 +402,7 @@ int main(int argc, char** argv) {
               << "  distribution: " << dist << "\n"
               << "  keys:";
     for (auto k : key_counts) std::cerr << ' ' << k;
-    std::cerr << "\n  threads (pva only): " << threads << "\n"
+    std::cerr << "\n  threads: " << threads << "\n"
               << "  queries per config: " << total_queries << "\n\n";
 
     print_header();
@@ -260,11 +413,17 @@ int main(int argc, char** argv) {
         auto keys = gen_keys_by_name(dist, kc);
         std::cerr << " done (" << keys.size() << " unique)\n";
 
-        print_row(run_ribbon<1>(keys, total_queries));
-        print_row(run_ribbon<8>(keys, total_queries));
-        print_row(run_ribbon<16>(keys, total_queries));
-        print_row(run_ribbon<32>(keys, total_queries));
-        print_row(run_ribbon<64>(keys, total_queries));
+        print_row(run_ribbon<1>(keys, total_queries, threads));
+        print_row(run_ribbon<8>(keys, total_queries, threads));
+        print_row(run_ribbon<16>(keys, total_queries, threads));
+        print_row(run_ribbon<32>(keys, total_queries, threads));
+        print_row(run_ribbon<64>(keys, total_queries, threads));
+        print_row(run_ribbon<1, interleaved_solution>(keys, total_queries, threads));
+        print_row(run_ribbon<8, interleaved_solution>(keys, total_queries, threads));
+        print_row(run_ribbon<16, interleaved_solution>(keys, total_queries, threads));
+        print_row(run_ribbon<32, interleaved_solution>(keys, total_queries, threads));
+        print_row(run_ribbon<64, interleaved_solution>(keys, total_queries, threads));
+        print_row(run_compressed(keys, total_queries, threads));
 
         std::cout << '\n';
 
@@ -298,6 +457,8 @@ int main(int argc, char** argv) {
         print_row(run_phf_array<part_phobic4, 16>("part<phobic4>", keys, total_queries, threads));
         print_row(run_phf_array<part_phobic4, 32>("part<phobic4>", keys, total_queries, threads));
         print_row(run_phf_array<part_phobic4, 64>("part<phobic4>", keys, total_queries, threads));
+        print_row(run_tiered<part_phobic4, phobic5, 8>("part<phobic4>", keys, total_queries, threads));
+        print_row(run_tiered<part_phobic4, phobic5, 32>("part<phobic4>", keys, total_queries, threads));
 
         std::cout << '\n';
     }
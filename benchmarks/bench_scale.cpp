@@ -3,25 +3,54 @@
  * @brief Tests PHOBIC scaling at large key counts.
  *
  * At 10M+ keys, serial phobic5 takes >15 minutes per run, so this benchmark
- * focuses on partitioned_phf (the fast path) and a single fat+bucket
+ * focuses on partitioned_phf (the fast path) and a single parallel phobic5
  * datapoint for reference. Use bench_phobic_parallel for full strategy
  * comparisons at 10K-1M scales.
  *
+ * flat<phobic5> is the partitioned build converted to flat_partitioned_phf,
+ * whose queries read one shard header and one pilot.
+ *
+ * --stream feeds partitioned<Inner>::stream_builder from a key generator
+ * instead of a key vector, so the process never holds all keys: they are
+ * spilled to per-shard temporary files and each shard is built from its
+ * file. This is the mode for 100M-1B keys; peak_rss_mb shows the build's
+ * high-water mark (O(largest shard x threads) plus the spill budget), and
+ * queries run over a regenerated 1M-key sample spread across the whole
+ * key set. It covers phobic5, recsplit8 and bbhash3 shards (--algos).
+ *
+ * Every row also reports build throughput per core (mkeys_s_core, keys
+ * per second divided by threads; for --stream it includes generating and
+ * spilling the keys) and the structure's size against the last-level
+ * cache (x_llc) and the dTLB reach (x_tlb, --tlb_reach_mb, default 6 MiB:
+ * 1536 STLB entries of 4 KiB pages). Query latency steps up as x_llc, then
+ * x_tlb, passes 1.
+ *
  * Usage:
  *   bench_scale                        # default: 1M 10M
  *   bench_scale 5000000 10000000       # custom
+ *   bench_scale --stream 100000000 1000000000
+ *   bench_scale --stream --algos=recsplit8,bbhash3 --threads=8,16 1000000000
+ *                                      # --threads applies to --stream only
+ *   MAPH_SPILL_DIR=/data bench_scale --stream 1000000000
+ *   bench_scale --counters 1000000     # hardware counters per row
  */
 
 #include "bench_harness.hpp"
 
+#include <maph/algorithms/bbhash.hpp>
 #include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/composition/flat_partitioned.hpp>
 #include <maph/composition/partitioned.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace maph;
@@ -36,9 +65,13 @@ struct row {
     double build_s;
     double bits_per_key;
     size_t memory_kb;
+    size_t peak_rss_kb;
     double query_median_ns;
     double throughput_mqps;
     bool ok;
+    counter_sample build_counters{};  // whole build; per key at print time
+    counter_sample query_counters{};  // per query
+    std::vector<double> query_samples{};  // sub-batch ns per query, for --json
 };
 
 template<typename PHF, typename BuilderFn>
@@ -60,10 +93,14 @@ row run(const std::string& config,
     std::cerr << "  " << config << " T=" << threads
               << " n=" << keys.size() << " ..." << std::flush;
 
+    reset_peak_rss();
+    counter_scope counted;
     auto t0 = clock::now();
     auto built = make_builder();
     auto t1 = clock::now();
+    r.build_counters = counted.stop();
     r.build_s = duration_cast<microseconds>(t1 - t0).count() / 1'000'000.0;
+    r.peak_rss_kb = get_peak_rss_kb();
 
     if (!built.has_value()) {
         std::cerr << " BUILD FAILED (" << r.build_s << " s)\n";
@@ -76,6 +113,8 @@ row run(const std::string& config,
     auto qs = measure_queries(*built, keys, total_queries);
     r.query_median_ns = qs.median_ns;
     r.throughput_mqps = qs.throughput_mqps;
+    r.query_counters = qs.counters;
+    r.query_samples = std::move(qs.samples);
 
     std::cerr << " built " << r.build_s << "s, "
               << r.bits_per_key << " b/k, "
@@ -83,6 +122,27 @@ row run(const std::string& config,
     return r;
 }
 
+// Sizes the x_llc / x_tlb columns divide by; set once in main().
+struct reach {
+    size_t llc_bytes{0};
+    size_t tlb_bytes{size_t{6} << 20};
+};
+
+reach& current_reach() {
+    static reach r;
+    return r;
+}
+
+double mkeys_per_s_core(const row& r) {
+    if (r.build_s <= 0) return 0;
+    return static_cast<double>(r.keys) / r.build_s / static_cast<double>(std::max<size_t>(1, r.threads)) / 1e6;
+}
+
+double over(size_t memory_kb, size_t reach_bytes) {
+    if (reach_bytes == 0) return 0;
+    return static_cast<double>(memory_kb) * 1024.0 / static_cast<double>(reach_bytes);
+}
+
 void print_header() {
     std::cout << std::left
         << std::setw(30) << "config"
@@ -90,8 +150,12 @@ void print_header() {
         << std::setw(12) << "keys"
         << std::setw(8)  << "threads"
         << std::setw(12) << "build_s"
+        << std::setw(14) << "mkeys_s_core"
         << std::setw(14) << "bits_per_key"
         << std::setw(12) << "mem_mb"
+        << std::setw(13) << "peak_rss_mb"
+        << std::setw(9)  << "x_llc"
+        << std::setw(9)  << "x_tlb"
         << std::setw(12) << "query_ns"
         << std::setw(12) << "mqps"
         << std::setw(5)  << "ok"
@@ -105,34 +169,131 @@ void print_row(const row& r) {
         << std::setw(12) << r.keys
         << std::setw(8)  << r.threads
         << std::setw(12) << std::setprecision(3) << r.build_s
+        << std::setw(14) << std::setprecision(3) << mkeys_per_s_core(r)
         << std::setw(14) << std::setprecision(3) << r.bits_per_key
         << std::setw(12) << std::setprecision(2) << (r.memory_kb / 1024.0)
+        << std::setw(13) << std::setprecision(1) << (r.peak_rss_kb / 1024.0)
+        << std::setw(9)  << std::setprecision(2) << over(r.memory_kb, current_reach().llc_bytes)
+        << std::setw(9)  << std::setprecision(2) << over(r.memory_kb, current_reach().tlb_bytes)
         << std::setw(12) << std::setprecision(2) << r.query_median_ns
         << std::setw(12) << std::setprecision(2) << r.throughput_mqps
         << std::setw(5)  << (r.ok ? "1" : "0")
         << '\n';
+    report_counters(std::cout, "built key", r.build_counters.per(static_cast<double>(r.keys)));
+    report_counters(std::cout, "query", r.query_counters);
+    record_result()
+        .config("config", r.config)
+        .config("keys", static_cast<double>(r.keys))
+        .config("threads", static_cast<double>(r.threads))
+        .metric("ok", r.ok ? 1 : 0)
+        .metric("build_s", r.build_s)
+        .metric("mkeys_per_s_core", mkeys_per_s_core(r))
+        .metric("bits_per_key", r.bits_per_key)
+        .metric("memory_kb", static_cast<double>(r.memory_kb))
+        .metric("peak_rss_kb", static_cast<double>(r.peak_rss_kb))
+        .metric("x_llc", over(r.memory_kb, current_reach().llc_bytes))
+        .metric("x_tlb", over(r.memory_kb, current_reach().tlb_bytes))
+        .metric("query_med_ns", r.query_median_ns)
+        .metric("throughput_mqps", r.throughput_mqps)
+        .samples("query_med_ns", r.query_samples);
+}
+
+// Key i of the streamed key set: 16 bytes from splitmix64, so any sample
+// of the set can be regenerated without storing it.
+std::string stream_key(uint64_t i) {
+    auto mix = [](uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    };
+    uint64_t words[2] = {mix(2 * i), mix(2 * i + 1)};
+    std::string key(16, '\0');
+    std::memcpy(key.data(), words, sizeof(words));
+    return key;
+}
+
+template<typename Inner>
+void run_stream(const std::string& name, size_t count, const std::vector<std::string>& sample,
+                const std::vector<size_t>& thread_counts, size_t total_queries) {
+    const char* spill_dir = std::getenv("MAPH_SPILL_DIR");
+    for (size_t t : thread_counts) {
+        auto r = run<partitioned_phf<Inner>>(
+            "stream<" + name + ">", sample, t,
+            [&] {
+                typename partitioned_phf<Inner>::stream_builder b;
+                b.with_expected_keys(count).with_threads(t);
+                if (spill_dir != nullptr) b.with_temp_dir(spill_dir);
+                for (size_t i = 0; i < count; ++i) b.add(stream_key(i));
+                return b.build();
+            },
+            total_queries);
+        r.keys = count;
+        print_row(r);
+        std::cout.flush();
+    }
+}
+
+void run_stream_all(size_t count, const std::vector<std::string>& algos,
+                    const std::vector<size_t>& thread_counts, size_t total_queries) {
+    std::vector<std::string> sample;
+    const size_t sample_size = std::min<size_t>(count, 1'000'000);
+    sample.reserve(sample_size);
+    for (size_t i = 0; i < sample_size; ++i) sample.push_back(stream_key(i * (count / sample_size)));
+
+    for (const auto& algo : algos) {
+        if (algo == "phobic5") {
+            run_stream<phobic5>(algo, count, sample, thread_counts, total_queries);
+        } else if (algo == "recsplit8") {
+            run_stream<recsplit8>(algo, count, sample, thread_counts, total_queries);
+        } else if (algo == "bbhash3") {
+            run_stream<bbhash3>(algo, count, sample, thread_counts, total_queries);
+        } else {
+            std::cerr << "  unknown --algos entry: " << algo << " (phobic5, recsplit8, bbhash3)\n";
+        }
+    }
+}
+
+std::vector<std::string> split_list(std::string_view s) {
+    std::vector<std::string> out;
+    while (!s.empty()) {
+        const size_t comma = s.find(',');
+        if (comma != 0) out.emplace_back(s.substr(0, comma));
+        if (comma == std::string_view::npos) break;
+        s.remove_prefix(comma + 1);
+    }
+    return out;
 }
 
 } // namespace
 
 int main(int argc, char** argv) {
-    std::vector<size_t> key_counts = {1'000'000, 10'000'000};
-    if (argc > 1) {
-        key_counts.clear();
-        for (int i = 1; i < argc; ++i) key_counts.push_back(std::stoul(argv[i]));
-    }
+    cli_args args(argc, argv);
+    const bool stream = args.has("stream");
+    std::vector<size_t> key_counts = args.positional_sizes(
+        stream ? std::vector<size_t>{100'000'000} : std::vector<size_t>{1'000'000, 10'000'000});
 
     const size_t total_queries = 500'000;  // smaller: query cost is well-characterized from bench_phf
+    const auto algos = split_list(args.get_string("algos", "phobic5,recsplit8,bbhash3"));
+    const auto stream_threads = args.get_size_list("threads", {1, 4, 8});
+    current_reach().llc_bytes = last_level_cache_bytes();
+    current_reach().tlb_bytes = args.get_size("tlb_reach_mb", 6) << 20;
 
     std::cerr << "Large-scale partitioned PHOBIC benchmark\n"
               << "  key counts: ";
     for (auto k : key_counts) std::cerr << k << ' ';
-    std::cerr << "\n\n";
+    std::cerr << "\n  LLC " << (current_reach().llc_bytes >> 10) << " KiB, dTLB reach "
+              << (current_reach().tlb_bytes >> 10) << " KiB\n\n";
 
     print_header();
 
     for (size_t kc : key_counts) {
         std::cerr << "=== " << kc << " keys ===\n";
+        if (stream) {
+            run_stream_all(kc, algos, stream_threads, total_queries);
+            std::cout << '\n';
+            continue;
+        }
         std::cerr << "generating keys ..." << std::flush;
         auto keys = gen_random_keys(kc);
         std::cerr << " done (" << keys.size() << " unique)\n";
@@ -172,12 +333,27 @@ int main(int argc, char** argv) {
             std::cout.flush();
         }
 
-        // One fat+bucket reference for comparison. At 10M, phobic5 serial
-        // would take ~17 minutes; fat+bucket at 8T takes ~4-5 minutes.
-        // Skip fat+bucket at >= 5M for phobic5.
+        // The same PHF flattened for queries (composition/flat_partitioned.hpp);
+        // build_s includes the conversion.
+        {
+            auto r = run<flat_partitioned_phf<5>>(
+                "flat<phobic5> T=8", keys, 8,
+                [&]() -> result<flat_partitioned_phf<5>> {
+                    auto p = partitioned_phf<phobic5>::builder{}
+                        .add_all(keys).with_threads(8).build();
+                    if (!p) return std::unexpected(p.error());
+                    return flat_partitioned_phf<5>::from(*p);
+                },
+                total_queries);
+            print_row(r);
+            std::cout.flush();
+        }
+
+        // One parallel phobic5 reference for comparison. At 10M, phobic5
+        // serial would take ~17 minutes. Skipped at >= 5M.
         if (kc < 5'000'000) {
             auto r = run<phobic5>(
-                "fat+bucket<phobic5> T=8", keys, 8,
+                "window<phobic5> T=8", keys, 8,
                 [&] {
                     return phobic5::builder{}.add_all(keys).with_threads(8).build();
                 },
@@ -0,0 +1,297 @@
+/**
+ * @file perf_counters.hpp
+ * @brief Optional hardware counters around timed benchmark regions.
+ *
+ * Wall-clock ns/query cannot tell a change that removed cache misses from
+ * one that removed instructions. With counters enabled (--counters on any
+ * bench, or MAPH_BENCH_COUNTERS=1 in the environment) every timed query
+ * and build region also reads, through perf_event_open(2):
+ *
+ *   cycles, instructions, L1d read misses, LLC misses, dTLB read misses,
+ *   branch misses
+ *
+ * in user space, for the calling thread and the threads it starts after
+ * the counters were opened (inherit), i.e. the build's own workers but not
+ * an executor created before them. Events are opened one by one and read
+ * with their enabled/running times, so a PMU that has to multiplex them
+ * gives scaled estimates rather than nothing.
+ *
+ * Graceful degradation: off Linux, in a VM without a PMU, or under a
+ * restrictive perf_event_paranoid, the events that fail to open read as
+ * NaN; if none opens, one line on stderr says why and the benchmarks
+ * print exactly what they print with counters disabled.
+ */
+
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace maph::bench {
+
+inline constexpr size_t hw_event_count = 6;
+
+inline constexpr std::array<std::string_view, hw_event_count> hw_event_names{
+    "cycles", "instr", "l1d_miss", "llc_miss", "dtlb_miss", "br_miss"};
+
+/// One reading per event; NaN where the event is not counted.
+struct counter_sample {
+    std::array<double, hw_event_count> value{
+        std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN(),
+        std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN(),
+        std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()};
+
+    [[nodiscard]] bool any() const noexcept {
+        for (double v : value) if (!std::isnan(v)) return true;
+        return false;
+    }
+
+    /// Every reading divided by n (queries, keys): the per-op figures.
+    [[nodiscard]] counter_sample per(double n) const noexcept {
+        counter_sample out = *this;
+        for (double& v : out.value) v = n > 0 ? v / n : std::numeric_limits<double>::quiet_NaN();
+        return out;
+    }
+
+    [[nodiscard]] double ipc() const noexcept { return value[1] / value[0]; }
+};
+
+#if defined(__linux__)
+constexpr uint64_t hw_cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+// (type, config) of each event, in hw_event_names order.
+inline constexpr std::array<std::pair<uint32_t, uint64_t>, hw_event_count> hw_event_configs{{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, hw_cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                        PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, hw_cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                        PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+}};
+#endif
+
+class counter_set {
+    std::array<int, hw_event_count> fd_{-1, -1, -1, -1, -1, -1};
+    int open_{0};
+    int last_errno_{0};
+
+#if defined(__linux__)
+    struct reading {
+        uint64_t value;
+        uint64_t enabled;
+        uint64_t running;
+    };
+
+    // Totals at start(). RESET does not clear what exited inherited
+    // threads folded into an event, so a region is the difference of two
+    // reads rather than one read after a reset.
+    std::array<reading, hw_event_count> base_{};
+
+    bool read_one(size_t e, reading& r) const noexcept {
+        return fd_[e] >= 0 && read(fd_[e], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+    }
+#endif
+
+public:
+    counter_set() {
+#if defined(__linux__)
+        for (size_t e = 0; e < hw_event_count; ++e) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = hw_event_configs[e].first;
+            attr.config = hw_event_configs[e].second;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fd < 0) {
+                last_errno_ = errno;
+                continue;
+            }
+            fd_[e] = static_cast<int>(fd);
+            ++open_;
+        }
+#else
+        last_errno_ = ENOSYS;
+#endif
+    }
+
+    ~counter_set() {
+#if defined(__linux__)
+        for (int fd : fd_) if (fd >= 0) close(fd);
+#endif
+    }
+
+    counter_set(const counter_set&) = delete;
+    counter_set& operator=(const counter_set&) = delete;
+
+    [[nodiscard]] bool available() const noexcept { return open_ > 0; }
+    [[nodiscard]] int opened() const noexcept { return open_; }
+    [[nodiscard]] int error() const noexcept { return last_errno_; }
+
+    void start() noexcept {
+#if defined(__linux__)
+        for (size_t e = 0; e < hw_event_count; ++e) {
+            if (!read_one(e, base_[e])) continue;
+            ioctl(fd_[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /// Stop and restart counting inside a region (start() to stop()).
+    void pause() noexcept {
+#if defined(__linux__)
+        for (int fd : fd_) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    void resume() noexcept {
+#if defined(__linux__)
+        for (int fd : fd_) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    /// Counts since start(), scaled up where the event was multiplexed.
+    [[nodiscard]] counter_sample stop() noexcept {
+        counter_sample s;
+#if defined(__linux__)
+        for (size_t e = 0; e < hw_event_count; ++e) {
+            if (fd_[e] >= 0) ioctl(fd_[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (size_t e = 0; e < hw_event_count; ++e) {
+            reading r{};
+            if (!read_one(e, r)) continue;
+            const uint64_t value = r.value - base_[e].value;
+            const uint64_t enabled = r.enabled - base_[e].enabled;
+            const uint64_t running = r.running - base_[e].running;
+            if (running == 0) continue;  // never scheduled
+            s.value[e] = static_cast<double>(value) *
+                         (static_cast<double>(enabled) / static_cast<double>(running));
+        }
+#endif
+        return s;
+    }
+};
+
+/// Set by --counters (cli_args, bench_harness.hpp) or MAPH_BENCH_COUNTERS=1.
+inline bool& counters_requested() noexcept {
+    static bool on = [] {
+        const char* env = std::getenv("MAPH_BENCH_COUNTERS");
+        return env != nullptr && *env != '\0' && std::string_view{env} != "0";
+    }();
+    return on;
+}
+
+/// The process's counters, opened on first use once requested. Null when
+/// not requested or when no event could be opened.
+inline counter_set* shared_counters() {
+    if (!counters_requested()) return nullptr;
+    static counter_set* set = [] {
+        auto* s = new counter_set();
+        if (!s->available()) {
+            std::cerr << "hardware counters unavailable (perf_event_open: "
+                      << std::strerror(s->error()) << "); reporting time only\n";
+            delete s;
+            return static_cast<counter_set*>(nullptr);
+        }
+        return s;
+    }();
+    return set;
+}
+
+[[nodiscard]] inline bool counters_active() { return shared_counters() != nullptr; }
+
+/**
+ * Counts one region: construct before the timed loop, stop() after it.
+ * Regions do not nest. With counters off it costs one branch and stop()
+ * returns an all-NaN sample.
+ */
+class counter_scope {
+    counter_set* set_;
+
+public:
+    counter_scope() : set_(shared_counters()) {
+        if (set_ != nullptr) set_->start();
+    }
+
+    /// Leave work out of the region, e.g. a cache flush between batches.
+    void pause() noexcept { if (set_ != nullptr) set_->pause(); }
+    void resume() noexcept { if (set_ != nullptr) set_->resume(); }
+
+    [[nodiscard]] counter_sample stop() noexcept {
+        counter_set* set = set_;
+        set_ = nullptr;
+        return set != nullptr ? set->stop() : counter_sample{};
+    }
+
+    ~counter_scope() {
+        if (set_ != nullptr) (void)set_->stop();
+    }
+
+    counter_scope(const counter_scope&) = delete;
+    counter_scope& operator=(const counter_scope&) = delete;
+};
+
+// ===== REPORTING =====
+
+/// Tab-separated column names, one per event, each prefixed (e.g. "q_").
+inline void print_counter_tsv_header(std::ostream& os, std::string_view prefix) {
+    for (auto name : hw_event_names) os << '\t' << prefix << name;
+}
+
+inline void print_counter_tsv(std::ostream& os, const counter_sample& s) {
+    const auto flags = os.flags();
+    const auto prec = os.precision();
+    os << std::fixed << std::setprecision(3);
+    for (double v : s.value) os << '\t' << v;
+    os.flags(flags);
+    os.precision(prec);
+}
+
+/**
+ * One indented line of per-op counts under a bench's own table row,
+ *   "    counters per query: cycles=41.2 instr=88.0 ipc=2.14 ...",
+ * or nothing when counters are off or none was counted.
+ */
+inline void report_counters(std::ostream& os, std::string_view per,
+                            const counter_sample& s) {
+    if (!s.any()) return;
+    const auto flags = os.flags();
+    const auto prec = os.precision();
+    os << "    counters per " << per << ':' << std::fixed << std::setprecision(2);
+    for (size_t e = 0; e < hw_event_count; ++e) {
+        if (std::isnan(s.value[e])) continue;
+        os << ' ' << hw_event_names[e] << '=' << s.value[e];
+        if (e == 1 && !std::isnan(s.value[0])) os << " ipc=" << s.ipc();
+    }
+    os << '\n';
+    os.flags(flags);
+    os.precision(prec);
+}
+
+} // namespace maph::bench
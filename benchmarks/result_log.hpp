@@ -0,0 +1,157 @@
+/**
+ * @file result_log.hpp
+ * @brief Machine-readable benchmark results: one JSON object per row.
+ *
+ * With --json=FILE every benchmark also writes each row it prints to FILE
+ * as one line of JSON (JSON Lines), for bench_compare:
+ *
+ *   {"bench":"bench_phf","config":{"algorithm":"phobic5","keys":100000},
+ *    "metrics":{"build_ms":41.2,"query_med_ns":28.1,...},
+ *    "samples":{"query_med_ns":[27.9,28.0,...]}}
+ *
+ * `config` names the row (what was measured), `metrics` holds its numbers
+ * and `samples` the per-sub-batch values a metric summarizes, so a
+ * comparison can put a confidence interval on a difference rather than
+ * eyeball two medians. A file written twice by the same benchmark holds
+ * each row twice; bench_compare pools repeats as samples.
+ *
+ * Without --json, record_result() returns an inert record and every call
+ * on it is a no-op.
+ *
+ *   record_result().config("hash", name).config("key_len", len)
+ *                  .metric("ns_per_key", ns);
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace maph::bench {
+
+struct result_log {
+    std::unique_ptr<std::ofstream> out{};
+    std::string bench{};
+
+    [[nodiscard]] bool active() const noexcept { return out != nullptr; }
+};
+
+inline result_log& current_result_log() noexcept {
+    static result_log log;
+    return log;
+}
+
+/// Send every later record of this process to `path` (truncated).
+inline bool open_result_log(const std::string& path, std::string bench) {
+    auto out = std::make_unique<std::ofstream>(path, std::ios::trunc);
+    if (!*out) return false;
+    current_result_log() = result_log{std::move(out), std::move(bench)};
+    return true;
+}
+
+inline void append_json_string(std::string& out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+inline void append_json_number(std::string& out, double v) {
+    if (!std::isfinite(v)) { out += "null"; return; }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", v);
+    out += buf;
+}
+
+/// One row; written to the log when it goes out of scope.
+class result_record {
+    result_log* log_;
+    std::string config_{}, metrics_{}, samples_{};
+
+    static void field(std::string& section, std::string_view key) {
+        if (!section.empty()) section += ',';
+        append_json_string(section, key);
+        section += ':';
+    }
+
+public:
+    explicit result_record(result_log* log) noexcept : log_(log) {}
+    result_record(const result_record&) = delete;
+    result_record& operator=(const result_record&) = delete;
+
+    ~result_record() {
+        if (log_ == nullptr) return;
+        std::string line = "{\"bench\":";
+        append_json_string(line, log_->bench);
+        line += ",\"config\":{" + config_ + "},\"metrics\":{" + metrics_
+              + "},\"samples\":{" + samples_ + "}}\n";
+        *log_->out << line;
+        log_->out->flush();
+    }
+
+    result_record& config(std::string_view key, std::string_view value) {
+        if (log_ == nullptr) return *this;
+        field(config_, key);
+        append_json_string(config_, value);
+        return *this;
+    }
+    result_record& config(std::string_view key, const char* value) {
+        return config(key, std::string_view{value});
+    }
+    result_record& config(std::string_view key, const std::string& value) {
+        return config(key, std::string_view{value});
+    }
+    result_record& config(std::string_view key, double value) {
+        if (log_ == nullptr) return *this;
+        field(config_, key);
+        append_json_number(config_, value);
+        return *this;
+    }
+
+    result_record& metric(std::string_view key, double value) {
+        if (log_ == nullptr) return *this;
+        field(metrics_, key);
+        append_json_number(metrics_, value);
+        return *this;
+    }
+
+    /// The values metric `key` summarizes; skipped when empty.
+    result_record& samples(std::string_view key, std::span<const double> values) {
+        if (log_ == nullptr || values.empty()) return *this;
+        field(samples_, key);
+        samples_ += '[';
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i != 0) samples_ += ',';
+            append_json_number(samples_, values[i]);
+        }
+        samples_ += ']';
+        return *this;
+    }
+};
+
+[[nodiscard]] inline result_record record_result() {
+    auto& log = current_result_log();
+    return result_record{log.active() ? &log : nullptr};
+}
+
+} // namespace maph::bench
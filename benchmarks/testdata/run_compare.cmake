@@ -0,0 +1,20 @@
+# Run bench_compare on two result files and check its exit status and
+# output. Invoked by the bench_compare_* tests in ../CMakeLists.txt with
+# -DBENCH_COMPARE, -DBASELINE, -DCANDIDATE, -DEXPECT_STATUS and optional
+# -DEXPECT_STDOUT / -DEXPECT_STDERR regular expressions.
+
+execute_process(
+    COMMAND ${BENCH_COMPARE} ${BASELINE} ${CANDIDATE}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE err)
+
+if(NOT status STREQUAL EXPECT_STATUS)
+    message(FATAL_ERROR "bench_compare exited with ${status}, expected ${EXPECT_STATUS}\n${out}${err}")
+endif()
+if(DEFINED EXPECT_STDOUT AND NOT out MATCHES "${EXPECT_STDOUT}")
+    message(FATAL_ERROR "stdout does not match '${EXPECT_STDOUT}':\n${out}")
+endif()
+if(DEFINED EXPECT_STDERR AND NOT err MATCHES "${EXPECT_STDERR}")
+    message(FATAL_ERROR "stderr does not match '${EXPECT_STDERR}':\n${err}")
+endif()
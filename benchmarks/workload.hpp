@@ -0,0 +1,299 @@
+/**
+ * @file workload.hpp
+ * @brief Query workloads: which keys the timed loops ask for, and how warm
+ *        the caches are when they do.
+ *
+ * Uniform member queries over the build set flatter every structure: past
+ * a few million keys each query misses, and no query is ever answered
+ * "absent". Real traffic is skewed, has a hot set that lives in L2,
+ * and mixes in keys that are not there. The workload (set once per run
+ * from the command line by cli_args) picks:
+ *
+ *   --workload=uniform   every key equally likely (default)
+ *   --workload=zipf      key of rank r with probability ~ 1 / r^s,
+ *                        --zipf_s=S (default 0.99); --zipf_s alone implies it
+ *   --workload=hotcold   --hot_share (default 0.9) of the queries go
+ *                        uniformly to --hot_keys (default 0.01) of the keys,
+ *                        the rest uniformly to the others
+ *   --negative=F         fraction F of the queries are non-members
+ *   --cold               between timed batches, read a buffer twice the
+ *                        LLC (--flush_mb to override) so each batch starts
+ *                        with cold caches; the flush is neither timed nor
+ *                        counted
+ *
+ * Ranks map to keys through a fixed bijection, so the hot keys are spread
+ * over the key vector rather than its sorted prefix. Zipf draws use
+ * rejection-inversion (Hörmann and Derflinger, 1996): O(1) memory and
+ * time per draw at any key count. Every stream is a function of the
+ * workload, the key count and a seed.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace maph::bench {
+
+struct workload {
+    enum class distribution { uniform, zipf, hot_cold };
+
+    distribution dist{distribution::uniform};
+    double zipf_s{0.99};
+    double hot_keys{0.01};   // share of the keys that are hot
+    double hot_share{0.9};   // share of the queries that go to them
+    double negative{0.0};    // share of the queries that are non-members
+    bool cold{false};
+    size_t flush_bytes{0};   // 0: twice the last-level cache
+
+    [[nodiscard]] bool is_default() const noexcept {
+        return dist == distribution::uniform && negative == 0.0 && !cold;
+    }
+
+    /// "zipf(s=0.99), 50% negative, cold (614 MiB flush)"
+    [[nodiscard]] std::string describe() const;
+};
+
+/// The run's workload; cli_args sets it from the command line.
+inline workload& current_workload() noexcept {
+    static workload wl{};
+    return wl;
+}
+
+// ===== SAMPLERS =====
+
+/**
+ * Zipf over ranks [0, n): P(r) ~ 1 / (r + 1)^s, s > 0, by
+ * rejection-inversion. Accepts ~all draws for s near 1.
+ */
+class zipf_sampler {
+    double s_;
+    double n_;
+    double h_x1_;
+    double h_n_;
+    double threshold_;
+
+    // (e^x - 1) / x and log(1 + x) / x, both -> 1 as x -> 0.
+    static double expm1_over(double x) noexcept {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5;
+    }
+    static double log1p_over(double x) noexcept {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * 0.5;
+    }
+
+    [[nodiscard]] double h(double x) const noexcept { return std::exp(-s_ * std::log(x)); }
+
+    // Integral of h, and its inverse.
+    [[nodiscard]] double h_integral(double x) const noexcept {
+        const double lx = std::log(x);
+        return expm1_over((1.0 - s_) * lx) * lx;
+    }
+    [[nodiscard]] double h_integral_inverse(double x) const noexcept {
+        const double t = std::max(-1.0, x * (1.0 - s_));
+        return std::exp(log1p_over(t) * x);
+    }
+
+public:
+    zipf_sampler(size_t n, double s)
+        : s_(s), n_(static_cast<double>(std::max<size_t>(n, 1))),
+          h_x1_(h_integral(1.5) - 1.0),
+          h_n_(h_integral(n_ + 0.5)),
+          threshold_(2.0 - h_integral_inverse(h_integral(2.5) - h(2.0))) {}
+
+    template<typename Rng>
+    [[nodiscard]] size_t operator()(Rng& rng) const {
+        std::uniform_real_distribution<double> u01(0.0, 1.0);
+        for (;;) {
+            const double u = h_n_ + u01(rng) * (h_x1_ - h_n_);
+            const double x = h_integral_inverse(u);
+            double k = std::floor(x + 0.5);
+            k = std::clamp(k, 1.0, n_);
+            if (k - x <= threshold_ || u >= h_integral(k + 0.5) - h(k)) {
+                return static_cast<size_t>(k) - 1;
+            }
+        }
+    }
+};
+
+/// Draws key indices in [0, n) as the workload's distribution says.
+class key_sampler {
+    size_t n_;
+    workload::distribution dist_;
+    size_t hot_;
+    double hot_share_;
+    uint64_t step_{1};   // rank -> index: (rank * step_ + 1) mod n_
+    zipf_sampler zipf_;
+
+    [[nodiscard]] size_t to_index(size_t rank) const noexcept {
+        return static_cast<size_t>(
+            (static_cast<unsigned __int128>(rank) * step_ + 1) % n_);
+    }
+
+public:
+    key_sampler(size_t n, const workload& wl)
+        : n_(std::max<size_t>(n, 1)), dist_(wl.dist),
+          hot_(std::clamp<size_t>(static_cast<size_t>(wl.hot_keys * static_cast<double>(n)),
+                                  1, std::max<size_t>(n, 1))),
+          hot_share_(wl.hot_share),
+          zipf_(n, wl.zipf_s > 0 ? wl.zipf_s : 0.99) {
+        // A step coprime to n near n / phi makes the map a bijection that
+        // scatters consecutive ranks.
+        step_ = std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(n_) * 0.6180339887));
+        while (std::gcd(step_, static_cast<uint64_t>(n_)) != 1) ++step_;
+    }
+
+    template<typename Rng>
+    [[nodiscard]] size_t operator()(Rng& rng) const {
+        switch (dist_) {
+        case workload::distribution::zipf:
+            return to_index(zipf_(rng));
+        case workload::distribution::hot_cold: {
+            std::uniform_real_distribution<double> u01(0.0, 1.0);
+            if (u01(rng) < hot_share_ || hot_ == n_) {
+                return to_index(std::uniform_int_distribution<size_t>(0, hot_ - 1)(rng));
+            }
+            return to_index(std::uniform_int_distribution<size_t>(hot_, n_ - 1)(rng));
+        }
+        case workload::distribution::uniform:
+            break;
+        }
+        return std::uniform_int_distribution<size_t>(0, n_ - 1)(rng);
+    }
+};
+
+// A key of the type of the build set that is not in it. A string is a
+// member with one non-ASCII byte appended, so it hashes like the members
+// do: never a member of the text sets (sequential, url), one by chance
+// alone in the binary ones. A random 64-bit integer collides with n
+// members with probability n / 2^64.
+template<typename Key, typename Rng>
+[[nodiscard]] Key negative_key(const Key& like, Rng& rng) {
+    if constexpr (std::is_same_v<Key, std::string>) {
+        std::string k = like;
+        k.push_back(static_cast<char>(0x80 | (rng() & 0x7f)));
+        return k;
+    } else {
+        (void)like;
+        return static_cast<Key>(rng());
+    }
+}
+
+/**
+ * The `count` queries of one timed run: pointers into the build keys,
+ * or into a pool of non-members the stream owns, in query order.
+ */
+template<typename Key>
+class query_stream {
+    std::vector<Key> negatives_;
+    std::vector<const Key*> q_;
+
+public:
+    query_stream(const std::vector<Key>& keys, size_t count, uint64_t seed,
+                 const workload& wl = current_workload()) {
+        std::mt19937_64 rng{seed};
+        const key_sampler pick(keys.size(), wl);
+        std::uniform_real_distribution<double> u01(0.0, 1.0);
+        std::vector<uint8_t> neg(count, 0);
+        size_t n_neg = 0;
+        if (wl.negative > 0.0) {
+            for (auto& b : neg) { b = u01(rng) < wl.negative; n_neg += b; }
+        }
+        // Each non-member is asked about once, so none is cached by reuse.
+        negatives_.reserve(n_neg);
+        for (size_t i = 0; i < n_neg; ++i) negatives_.push_back(negative_key(keys[pick(rng)], rng));
+        q_.resize(count);
+        size_t next_neg = 0;
+        for (size_t i = 0; i < count; ++i) {
+            q_[i] = neg[i] ? &negatives_[next_neg++] : &keys[pick(rng)];
+        }
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return q_.size(); }
+    [[nodiscard]] size_t negatives() const noexcept { return negatives_.size(); }
+    [[nodiscard]] const Key& operator[](size_t i) const noexcept { return *q_[i]; }
+
+    /// The queries as string_views, for the batched and interleaved paths.
+    [[nodiscard]] std::vector<std::string_view> views() const
+        requires std::is_same_v<Key, std::string>
+    {
+        std::vector<std::string_view> out(q_.size());
+        for (size_t i = 0; i < q_.size(); ++i) out[i] = *q_[i];
+        return out;
+    }
+};
+
+// ===== COLD CACHES =====
+
+/// Bytes of the largest CPU cache sysfs reports, or 0.
+inline size_t last_level_cache_bytes() {
+    size_t best = 0;
+    for (int i = 0; i < 8; ++i) {
+        std::ifstream in("/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/size");
+        if (!in) continue;
+        std::string s;
+        in >> s;
+        size_t v = 0;
+        size_t pos = 0;
+        while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') v = v * 10 + size_t(s[pos++] - '0');
+        if (pos < s.size() && (s[pos] == 'K' || s[pos] == 'k')) v <<= 10;
+        else if (pos < s.size() && (s[pos] == 'M' || s[pos] == 'm')) v <<= 20;
+        best = std::max(best, v);
+    }
+    return best;
+}
+
+/// Reads one word of every line of a buffer larger than the LLC.
+class cache_flusher {
+    std::vector<uint64_t> buf_;
+
+public:
+    explicit cache_flusher(size_t bytes) : buf_(std::max<size_t>(bytes, 4096) / 8) {
+        for (size_t i = 0; i < buf_.size(); ++i) buf_[i] = i;
+    }
+
+    [[nodiscard]] size_t bytes() const noexcept { return buf_.size() * 8; }
+
+    /// Sum of the words read, so the loop is not elided.
+    uint64_t flush() const noexcept {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < buf_.size(); i += 8) acc += buf_[i];
+        return acc;
+    }
+};
+
+/// The run's flusher, sized by the workload on first use.
+inline const cache_flusher& shared_flusher() {
+    static const cache_flusher f{[] {
+        const workload& wl = current_workload();
+        if (wl.flush_bytes != 0) return wl.flush_bytes;
+        const size_t llc = last_level_cache_bytes();
+        return llc != 0 ? 2 * llc : size_t{64} << 20;
+    }()};
+    return f;
+}
+
+inline std::string workload::describe() const {
+    std::ostringstream os;
+    switch (dist) {
+    case distribution::uniform: os << "uniform"; break;
+    case distribution::zipf: os << "zipf(s=" << zipf_s << ")"; break;
+    case distribution::hot_cold:
+        os << "hotcold(" << hot_share * 100 << "% of queries to " << hot_keys * 100 << "% of keys)";
+        break;
+    }
+    if (negative > 0.0) os << ", " << negative * 100 << "% negative";
+    if (cold) os << ", cold (" << (shared_flusher().bytes() >> 20) << " MiB flush)";
+    return os.str();
+}
+
+} // namespace maph::bench
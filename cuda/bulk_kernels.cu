@@ -0,0 +1,174 @@
+// Kernels and device copies behind include/maph/device/cuda_bulk.hpp.
+// One thread per key, each running the device_query.hpp query.
+
+#include <maph/device/cuda_bulk.hpp>
+
+#include <cuda_runtime.h>
+
+#include <utility>
+
+namespace maph::device {
+
+namespace {
+
+constexpr unsigned threads_per_block = 256;
+
+cuda_status status_of(cudaError_t e) noexcept {
+    switch (e) {
+        case cudaSuccess: return cuda_status::ok;
+        case cudaErrorMemoryAllocation: return cuda_status::out_of_memory;
+        case cudaErrorNoDevice:
+        case cudaErrorInsufficientDriver: return cuda_status::no_device;
+        default: return cuda_status::failed;
+    }
+}
+
+__device__ uint64_t thread_index() {
+    return uint64_t{blockIdx.x} * blockDim.x + threadIdx.x;
+}
+
+__global__ void slot_for_kernel(phobic_image f, key_batch keys, uint64_t* out) {
+    const uint64_t i = thread_index();
+    if (i < keys.count) out[i] = slot_for(f, keys.hash(i));
+}
+
+__global__ void value_array_kernel(value_array_image a, key_batch keys, uint64_t* out) {
+    const uint64_t i = thread_index();
+    if (i < keys.count) out[i] = lookup(a, keys.hash(i));
+}
+
+__global__ void ribbon_kernel(ribbon_image r, key_batch keys, uint64_t* out) {
+    const uint64_t i = thread_index();
+    if (i < keys.count) out[i] = lookup(r, keys.hash(i));
+}
+
+template<typename Kernel, typename Image>
+cuda_status launch(Kernel kernel, const Image& image, const key_batch& keys, uint64_t* out) {
+    if (keys.count == 0) return cuda_status::ok;
+    const auto blocks = static_cast<unsigned>((keys.count + threads_per_block - 1) / threads_per_block);
+    kernel<<<blocks, threads_per_block>>>(image, keys, out);
+    cudaError_t e = cudaGetLastError();
+    if (e == cudaSuccess) e = cudaDeviceSynchronize();
+    return status_of(e);
+}
+
+template<typename T>
+const T* typed(const device_buffer& b) noexcept {
+    return static_cast<const T*>(b.data());
+}
+
+} // namespace
+
+bool cuda_available() noexcept {
+    int n = 0;
+    return cudaGetDeviceCount(&n) == cudaSuccess && n > 0;
+}
+
+// ===== device_buffer =====
+
+device_buffer::~device_buffer() {
+    if (ptr_ != nullptr) cudaFree(ptr_);
+}
+
+device_buffer::device_buffer(device_buffer&& other) noexcept
+    : ptr_(std::exchange(other.ptr_, nullptr)), bytes_(std::exchange(other.bytes_, 0)) {}
+
+device_buffer& device_buffer::operator=(device_buffer&& other) noexcept {
+    if (this != &other) {
+        if (ptr_ != nullptr) cudaFree(ptr_);
+        ptr_ = std::exchange(other.ptr_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+    }
+    return *this;
+}
+
+cuda_status device_buffer::allocate(size_t bytes) {
+    if (ptr_ != nullptr) cudaFree(ptr_);
+    ptr_ = nullptr;
+    bytes_ = 0;
+    if (bytes == 0) return cuda_status::ok;
+    if (const cudaError_t e = cudaMalloc(&ptr_, bytes); e != cudaSuccess) {
+        ptr_ = nullptr;
+        return status_of(e);
+    }
+    bytes_ = bytes;
+    return cuda_status::ok;
+}
+
+cuda_status device_buffer::upload(const void* host, size_t bytes) {
+    if (const cuda_status s = allocate(bytes); s != cuda_status::ok || bytes == 0) return s;
+    return status_of(cudaMemcpy(ptr_, host, bytes, cudaMemcpyHostToDevice));
+}
+
+cuda_status device_buffer::download(void* host, size_t bytes) const {
+    if (bytes > bytes_) return cuda_status::failed;
+    if (bytes == 0) return cuda_status::ok;
+    return status_of(cudaMemcpy(host, ptr_, bytes, cudaMemcpyDeviceToHost));
+}
+
+// ===== device copies =====
+
+cuda_status device_phobic::upload(const phobic_image& host) {
+    const cuda_status s = pilots_.upload(host.pilots, host.num_buckets * sizeof(uint16_t));
+    if (s != cuda_status::ok) return s;
+    image_ = host;
+    image_.pilots = typed<uint16_t>(pilots_);
+    return cuda_status::ok;
+}
+
+cuda_status device_value_array::upload(const value_array_image& host) {
+    cuda_status s = phf_.upload(host.phf);
+    if (s == cuda_status::ok) {
+        s = words_.upload(host.values.words, host.values.num_words * sizeof(uint64_t));
+    }
+    if (s != cuda_status::ok) return s;
+    image_ = {phf_.image(), host.values};
+    image_.values.words = typed<uint64_t>(words_);
+    return cuda_status::ok;
+}
+
+cuda_status device_ribbon::upload(const ribbon_image& host) {
+    const size_t shard_rows = host.num_shards == 0 ? 0 : host.num_shards + 1;
+    cuda_status s = rows_.upload(host.rows, host.num_rows * host.row_bytes);
+    if (s == cuda_status::ok) s = shard_rows_.upload(host.shard_rows, shard_rows * sizeof(uint64_t));
+    if (s == cuda_status::ok) {
+        s = shard_seeds_.upload(host.shard_seeds, host.num_shards * sizeof(uint64_t));
+    }
+    if (s != cuda_status::ok) return s;
+    image_ = host;
+    image_.rows = rows_.data();
+    image_.shard_rows = typed<uint64_t>(shard_rows_);
+    image_.shard_seeds = typed<uint64_t>(shard_seeds_);
+    return cuda_status::ok;
+}
+
+cuda_status device_keys::upload(const key_batch& host) {
+    if (host.count == 0) {
+        batch_ = {};
+        return cuda_status::ok;
+    }
+    // Offsets are uploaded as given, so the bytes start at host.bytes.
+    cuda_status s = bytes_.upload(host.bytes, host.offsets[host.count]);
+    if (s == cuda_status::ok) {
+        s = offsets_.upload(host.offsets, (host.count + 1) * sizeof(uint64_t));
+    }
+    if (s != cuda_status::ok) return s;
+    batch_ = {static_cast<const unsigned char*>(bytes_.data()), typed<uint64_t>(offsets_), host.count};
+    return cuda_status::ok;
+}
+
+// ===== bulk queries =====
+
+cuda_status bulk_slot_for(const device_phobic& f, const key_batch& keys, uint64_t* out) {
+    return launch(slot_for_kernel, f.image(), keys, out);
+}
+
+cuda_status bulk_lookup(const device_value_array& a, const key_batch& keys, uint64_t* out) {
+    return launch(value_array_kernel, a.image(), keys, out);
+}
+
+cuda_status bulk_lookup(const device_ribbon& r, const key_batch& keys, uint64_t* out) {
+    return launch(ribbon_kernel, r.image(), keys, out);
+}
+
+} // namespace maph::device
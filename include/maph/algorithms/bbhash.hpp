@@ -10,23 +10,32 @@
  * - Limasset et al. "Fast and Scalable Minimal Perfect Hashing for Massive Key Sets" (2017)
  * - Space: ~2.0-3.0 bits per key (depends on gamma)
  * - Query time: O(1), typically 30-50ns
- * - Build time: O(n/p) with p threads
+ * - Build time: O(n/p) with p threads (builder::with_threads)
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/build_report.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cmath>
+#include <optional>
 #include <random>
 #include <span>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace maph {
@@ -41,6 +50,9 @@ namespace maph {
  * 3. Collision detection via bit-level operations (fast and parallel)
  * 4. Space parameter gamma controls bits/key (higher = faster build)
  *
+ * All levels share one array of 64-byte rank blocks (a 64-bit rank plus
+ * 448 bitset bits each), so probing a level touches one cache line.
+ *
  * @tparam NumLevels Maximum number of collision resolution levels (default 3)
  */
 template<size_t NumLevels = 3>
@@ -51,60 +63,32 @@ public:
     class builder;
 
 private:
-    // Bit array for each level indicating which slots are occupied
-    struct level {
-        std::vector<uint64_t> bits;    // Bit array
-        std::vector<size_t> rank_checkpoints;  // Rank checkpoints for O(1) rank queries
-        size_t num_keys{0};            // Keys assigned to this level
-        uint64_t seed{0};              // Hash seed for this level
-
-        [[nodiscard]] bool get_bit(size_t idx) const noexcept {
-            if (idx / 64 >= bits.size()) return false;
-            return (bits[idx / 64] >> (idx % 64)) & 1;
-        }
-
-        void set_bit(size_t idx) noexcept {
-            size_t word_idx = idx / 64;
-            if (word_idx < bits.size()) {
-                bits[word_idx] |= (1ULL << (idx % 64));
-            }
-        }
-
-        // Build rank structure for O(1) rank queries
-        void build_rank_structure() noexcept {
-            rank_checkpoints.resize(bits.size());
-            size_t cumulative_rank = 0;
-            for (size_t i = 0; i < bits.size(); ++i) {
-                rank_checkpoints[i] = cumulative_rank;
-                cumulative_rank += std::popcount(bits[i]);
-            }
-        }
-
-        // O(1) rank query: count set bits before position idx
-        [[nodiscard]] size_t rank(size_t idx) const noexcept {
-            if (idx / 64 >= bits.size()) return num_keys;
-
-            size_t word_idx = idx / 64;
-            size_t bit_offset = idx % 64;
-
-            // Checkpoint gives us rank up to start of this word
-            size_t result = rank_checkpoints[word_idx];
-
-            // Add popcount of bits before idx within this word
-            if (bit_offset > 0) {
-                uint64_t mask = (1ULL << bit_offset) - 1;
-                result += std::popcount(bits[word_idx] & mask);
-            }
+    // Rank directory block: one cache line holding the global rank of its
+    // first bit (keys on earlier levels plus set bits in earlier blocks of
+    // this level) and the next 448 bits of the level's bitset. A probe
+    // reads one block; its slot is the stored rank plus up to 7 popcounts.
+    static constexpr size_t BLOCK_DATA_WORDS = 7;
+    static constexpr size_t BLOCK_BITS = BLOCK_DATA_WORDS * 64;
+
+    struct alignas(64) rank_block {
+        uint64_t rank{0};
+        std::array<uint64_t, BLOCK_DATA_WORDS> bits{};
+    };
+    static_assert(sizeof(rank_block) == 64);
 
-            return result;
-        }
+    struct level {
+        size_t first_block{0};  // into blocks_; unused when num_keys == 0
+        size_t num_keys{0};     // Keys assigned to this level
+        uint64_t seed{0};       // Hash seed for this level
     };
 
     std::array<level, NumLevels> levels_;
+    std::vector<rank_block> blocks_;  // every non-empty level, back to back
     size_t key_count_{0};
     size_t total_slots_{0};  // gamma * key_count
     double gamma_{2.0};      // Space-time trade-off parameter
     uint64_t base_seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
     explicit bbhash_hasher(size_t key_count, double gamma, uint64_t base_seed)
         : key_count_(key_count)
@@ -112,18 +96,90 @@ private:
         , gamma_(gamma)
         , base_seed_(base_seed) {
 
-        // Initialize level seeds and pre-allocate bit arrays
+        // Initialize level seeds
         std::mt19937_64 rng(base_seed);
-        size_t words_needed = (total_slots_ + 63) / 64;
         for (size_t i = 0; i < NumLevels; ++i) {
             levels_[i].seed = rng();
-            levels_[i].bits.resize(words_needed, 0);
         }
     }
 
+    [[nodiscard]] size_t words_per_level() const noexcept { return (total_slots_ + 63) / 64; }
+    [[nodiscard]] size_t blocks_per_level() const noexcept {
+        return (total_slots_ + BLOCK_BITS - 1) / BLOCK_BITS;
+    }
+
+    // Interleave the per-level bitsets (words_per_level() words each) into
+    // blocks_ and fill in the ranks. False if a level's popcount disagrees
+    // with its num_keys.
+    [[nodiscard]] bool assemble(const std::array<std::vector<uint64_t>, NumLevels>& bits) {
+        const size_t per_level = blocks_per_level();
+        size_t active = 0;
+        for (const auto& lvl : levels_) active += lvl.num_keys > 0 ? 1 : 0;
+        blocks_.assign(active * per_level, rank_block{});
+
+        size_t next_block = 0, rank = 0;
+        for (size_t i = 0; i < NumLevels; ++i) {
+            auto& lvl = levels_[i];
+            if (lvl.num_keys == 0) continue;
+            lvl.first_block = next_block;
+            next_block += per_level;
+            for (size_t w = 0; w < bits[i].size(); ++w) {
+                blocks_[lvl.first_block + w / BLOCK_DATA_WORDS].bits[w % BLOCK_DATA_WORDS] = bits[i][w];
+            }
+            const size_t level_start = rank;
+            for (size_t blk = 0; blk < per_level; ++blk) {
+                auto& block = blocks_[lvl.first_block + blk];
+                block.rank = rank;
+                for (uint64_t w : block.bits) rank += static_cast<size_t>(std::popcount(w));
+            }
+            if (rank - level_start != lvl.num_keys) return false;
+        }
+        return true;
+    }
+
+    // Word w of level i's bitset, or 0 for an empty level.
+    [[nodiscard]] uint64_t level_word(size_t i, size_t w) const noexcept {
+        if (levels_[i].num_keys == 0) return 0;
+        return blocks_[levels_[i].first_block + w / BLOCK_DATA_WORDS].bits[w % BLOCK_DATA_WORDS];
+    }
+
+    [[nodiscard]] const rank_block* block_for(size_t level_idx, uint64_t slot) const noexcept {
+        const level& lvl = levels_[level_idx];
+        if (lvl.num_keys == 0) return nullptr;
+        return &blocks_[lvl.first_block + static_cast<size_t>(slot / BLOCK_BITS)];
+    }
+
+    // Global slot of `slot` in `block` if its bit is set.
+    [[nodiscard]] static std::optional<size_t> rank_in(const rank_block& block, uint64_t slot) noexcept {
+        const size_t bit = static_cast<size_t>(slot % BLOCK_BITS);
+        const size_t word = bit / 64;
+        const uint64_t below = block.bits[word] & ((uint64_t{2} << (bit % 64)) - 1);
+        if ((below >> (bit % 64)) == 0) return std::nullopt;
+        size_t r = static_cast<size_t>(block.rank) + static_cast<size_t>(std::popcount(below)) - 1;
+        for (size_t i = 0; i < word; ++i) r += static_cast<size_t>(std::popcount(block.bits[i]));
+        return r;
+    }
+
     // Hash with level-specific seed
     [[nodiscard]] uint64_t hash_at_level(std::string_view key, size_t level_idx) const noexcept {
-        return phf_hash_with_seed(key, levels_[level_idx].seed) % total_slots_;
+        return phf_hash_with_seed(key, levels_[level_idx].seed, hash_rev_) % total_slots_;
+    }
+
+    [[nodiscard]] uint64_t hash_at_level(const hashed_key& hk, size_t level_idx) const noexcept {
+        return phf_hash_with_seed(hk, levels_[level_idx].seed, hash_rev_) % total_slots_;
+    }
+
+    // Walk levels [start_level, NumLevels) until the key's bit is set.
+    [[nodiscard]] slot_index slot_from_level(const hashed_key& key, size_t start_level) const noexcept {
+        for (size_t level_idx = start_level; level_idx < NumLevels; ++level_idx) {
+            const uint64_t slot = hash_at_level(key, level_idx);
+            const rank_block* block = block_for(level_idx, slot);
+            if (block == nullptr) continue;
+            if (auto r = rank_in(*block, slot)) return slot_index{*r};
+        }
+
+        // Key not in build set, return arbitrary valid index
+        return slot_index{0};
     }
 
 public:
@@ -138,19 +194,55 @@ public:
      */
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
         if (key_count_ == 0) return slot_index{0};
+        return slot_from_level(hashed_key{key}, 0);
+    }
 
-        size_t cumulative_offset = 0;
-        for (size_t level_idx = 0; level_idx < NumLevels; ++level_idx) {
-            uint64_t slot = hash_at_level(key, level_idx);
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        if (key_count_ == 0) return slot_index{0};
+        return slot_from_level(hk, 0);
+    }
 
-            if (levels_[level_idx].get_bit(slot)) {
-                return slot_index{cumulative_offset + levels_[level_idx].rank(slot)};
+    // Batched lookup: hash a window of keys at level 0 and prefetch the
+    // rank block each one needs before testing any bit. Most keys resolve
+    // at level 0; the rest continue on the scalar path.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (key_count_ == 0) {
+            std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(n), slot_index{0});
+            return;
+        }
+        hashed_key hks[W];
+        const rank_block* blocks[W];
+        uint64_t slots[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                slots[i] = hash_at_level(hks[i], 0);
+                blocks[i] = block_for(0, slots[i]);
+                if (blocks[i] != nullptr) detail::prefetch_read(blocks[i]);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                std::optional<size_t> r;
+                if (blocks[i] != nullptr) r = rank_in(*blocks[i], slots[i]);
+                out[base + i] = r ? slot_index{*r} : slot_from_level(hks[i], 1);
             }
-            cumulative_offset += levels_[level_idx].num_keys;
         }
+    }
 
-        // Key not in build set, return arbitrary valid index
-        return slot_index{0};
+    // Prefetch the level-0 block slot_for(key) will read.
+    void prefetch(std::string_view key) const noexcept {
+        prefetch(hashed_key{key});
+    }
+
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (key_count_ == 0) return;
+        if (const rank_block* block = block_for(0, hash_at_level(hk, 0))) {
+            detail::prefetch_read(block);
+        }
     }
 
     [[nodiscard]] size_t num_keys() const noexcept { return key_count_; }
@@ -158,33 +250,15 @@ public:
 
     [[nodiscard]] double bits_per_key() const noexcept {
         if (key_count_ == 0) return 0.0;
-        // BBHash space usage is approximately gamma bits per key
-        size_t active_levels = 0;
-        for (const auto& level : levels_) {
-            if (level.num_keys > 0) ++active_levels;
-        }
-        size_t total_bits = active_levels * total_slots_;
-        size_t rank_bytes = 0;
-        for (const auto& level : levels_) {
-            rank_bytes += level.rank_checkpoints.size() * sizeof(size_t);
-        }
-        size_t total_bytes = (total_bits / 8) + rank_bytes + sizeof(*this);
-        return (total_bytes * 8.0) / key_count_;
+        return (memory_bytes() * 8.0) / key_count_;
     }
 
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        size_t active_levels = 0;
-        for (const auto& level : levels_) {
-            if (level.num_keys > 0) ++active_levels;
-        }
-        size_t total_bits = active_levels * total_slots_;
-        size_t rank_bytes = 0;
-        for (const auto& level : levels_) {
-            rank_bytes += level.rank_checkpoints.size() * sizeof(size_t);
-        }
-        return (total_bits / 8) + rank_bytes + sizeof(*this);
+        return blocks_.size() * sizeof(rank_block) + sizeof(*this);
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return detail::allocated_bytes(blocks_); }
+
     [[nodiscard]] double gamma() const noexcept { return gamma_; }
 
     // Algorithm identifier for serialization
@@ -192,18 +266,29 @@ public:
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::write_header(out, ALGORITHM_ID, static_cast<uint32_t>(NumLevels));
+        phf_serial::write_header(out, ALGORITHM_ID, static_cast<uint32_t>(NumLevels), hash_rev_);
 
         phf_serial::append(out, static_cast<uint64_t>(key_count_));
         phf_serial::append(out, static_cast<uint64_t>(total_slots_));
         phf_serial::append(out, gamma_);
         phf_serial::append(out, base_seed_);
 
-        for (const auto& lvl : levels_) {
-            phf_serial::append_vector(out, lvl.bits);
-            phf_serial::append_vector_size(out, lvl.rank_checkpoints);
-            phf_serial::append(out, static_cast<uint64_t>(lvl.num_keys));
-            phf_serial::append(out, lvl.seed);
+        // The wire format predates the rank blocks: each level is a plain
+        // bitset plus a per-word rank checkpoint array.
+        const size_t words = words_per_level();
+        std::vector<uint64_t> bits(words);
+        std::vector<size_t> checkpoints(words);
+        for (size_t i = 0; i < NumLevels; ++i) {
+            size_t cumulative = 0;
+            for (size_t w = 0; w < words; ++w) {
+                bits[w] = level_word(i, w);
+                checkpoints[w] = cumulative;
+                cumulative += static_cast<size_t>(std::popcount(bits[w]));
+            }
+            phf_serial::append_vector(out, bits);
+            phf_serial::append_vector_size(out, checkpoints);
+            phf_serial::append(out, static_cast<uint64_t>(levels_[i].num_keys));
+            phf_serial::append(out, levels_[i].seed);
         }
         return out;
     }
@@ -211,9 +296,8 @@ public:
     [[nodiscard]] static result<bbhash_hasher> deserialize(std::span<const std::byte> data) {
         phf_serial::reader r(data);
 
-        if (!phf_serial::verify_header(r, ALGORITHM_ID, static_cast<uint32_t>(NumLevels))) {
-            return std::unexpected(error::invalid_format);
-        }
+        auto version = phf_serial::read_header(r, ALGORITHM_ID, static_cast<uint32_t>(NumLevels));
+        if (!version) return std::unexpected(error::invalid_format);
 
         uint64_t key_count_u64{}, total_slots_u64{}, base_seed{};
         double gamma{};
@@ -227,15 +311,29 @@ public:
 
         bbhash_hasher hasher(static_cast<size_t>(key_count_u64), gamma, base_seed);
         hasher.total_slots_ = static_cast<size_t>(total_slots_u64);
+        hasher.hash_rev_ = phf_serial::revision_for_version(*version);
+
+        if (hasher.key_count_ > 0 && hasher.total_slots_ == 0) {
+            return std::unexpected(error::invalid_format);
+        }
 
-        for (auto& lvl : hasher.levels_) {
+        // Checkpoints are rebuilt as rank blocks, so the stored ones are
+        // only skipped.
+        std::array<std::vector<uint64_t>, NumLevels> bits;
+        std::vector<size_t> checkpoints;
+        for (size_t i = 0; i < NumLevels; ++i) {
+            auto& lvl = hasher.levels_[i];
             uint64_t num_keys{};
-            if (!r.read_vector(lvl.bits) || !r.read_vector_size(lvl.rank_checkpoints) ||
+            if (!r.read_vector(bits[i]) || !r.read_vector_size(checkpoints) ||
                 !r.read(num_keys) || !r.read(lvl.seed)) {
                 return std::unexpected(error::invalid_format);
             }
+            if (bits[i].size() != hasher.words_per_level()) {
+                return std::unexpected(error::invalid_format);
+            }
             lvl.num_keys = static_cast<size_t>(num_keys);
         }
+        if (!hasher.assemble(bits)) return std::unexpected(error::invalid_format);
         return hasher;
     }
 
@@ -243,30 +341,121 @@ public:
      * @class builder
      * @brief Builder for BBHash perfect hash
      *
-     * Note: BBHash level construction is inherently sequential (each level
-     * depends on knowing which keys collided at the previous level).
-     * Use RecSplit with_threads() for parallel construction.
+     * Levels are built one after another (a level's keys are the previous
+     * level's collisions), but each level is parallel inside: threads hash
+     * disjoint key ranges into shared "seen" and "collided" bitsets, set
+     * the level bit of every key that did not collide, and compact the
+     * colliding keys into the next level's input. The result does not
+     * depend on the thread count.
      */
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        key_dedup dedup_{key_dedup::sort};
         double gamma_{2.0};  // Default space parameter (2x space = faster)
         uint64_t seed_{0x123456789abcdef0ULL};
+        size_t threads_{1};  // 0 = auto (hardware_concurrency), 1 = sequential, N = N threads
+        executor* executor_{nullptr};
+
+        // Set bit idx of words; returns whether it was already set. Atomic
+        // only when several threads share the words.
+        static bool test_and_set(std::vector<uint64_t>& words, size_t idx, bool shared) noexcept {
+            const uint64_t mask = uint64_t{1} << (idx % 64);
+            uint64_t& w = words[idx / 64];
+            if (!shared) {
+                bool was = (w & mask) != 0;
+                w |= mask;
+                return was;
+            }
+            return (std::atomic_ref<uint64_t>{w}.fetch_or(mask, std::memory_order_relaxed) & mask) != 0;
+        }
+
+        // Place every key of `keys` whose level slot no other key shares and
+        // return the rest, in input order.
+        static std::vector<std::string_view> place_level(bbhash_hasher& hasher, size_t level_idx,
+                                                         std::vector<uint64_t>& level_bits,
+                                                         std::span<const std::string_view> keys,
+                                                         size_t threads) {
+            auto& current_level = hasher.levels_[level_idx];
+            const size_t n = keys.size();
+            const size_t nt = detail::effective_threads(n, threads);
+            const bool shared = nt > 1;
+            const size_t words = hasher.words_per_level();
+            level_bits.assign(words, 0);
+
+            // One bit per slot for "some key hashed here" and "two or more
+            // did"; replaces a size_t counter per slot.
+            std::vector<uint64_t> seen(words, 0), collided(words, 0);
+            std::vector<uint64_t> slots(n);
+            detail::parallel_chunks(n, nt, [&](size_t, size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; ++i) {
+                    slots[i] = hasher.hash_at_level(keys[i], level_idx);
+                    if (test_and_set(seen, slots[i], shared)) {
+                        test_and_set(collided, slots[i], shared);
+                    }
+                }
+            });
+
+            // Non-colliding keys get their level bit; colliding ones are
+            // counted per thread so they can be compacted in order.
+            std::vector<size_t> spill(nt, 0);
+            detail::parallel_chunks(n, nt, [&](size_t t, size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; ++i) {
+                    const uint64_t slot = slots[i];
+                    if ((collided[slot / 64] >> (slot % 64)) & 1) {
+                        ++spill[t];
+                    } else {
+                        test_and_set(level_bits, slot, shared);
+                    }
+                }
+            });
+
+            size_t total = 0;
+            for (auto& c : spill) c = std::exchange(total, total + c);
+            current_level.num_keys = n - total;
+
+            std::vector<std::string_view> next_level_keys(total);
+            detail::parallel_chunks(n, nt, [&](size_t t, size_t lo, size_t hi) {
+                size_t pos = spill[t];
+                for (size_t i = lo; i < hi; ++i) {
+                    const uint64_t slot = slots[i];
+                    if ((collided[slot / 64] >> (slot % 64)) & 1) next_level_keys[pos++] = keys[i];
+                }
+            });
+            return next_level_keys;
+        }
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(keys);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
             return *this;
         }
 
@@ -282,19 +471,54 @@ public:
             return *this;
         }
 
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
+
+        // See build_report.hpp.
+        builder& with_report(build_report& report) {
+            report_ = &report;
+            return *this;
+        }
+
+        // Threads per level. 0 = auto-detect via
+        // std::thread::hardware_concurrency().
+        builder& with_threads(size_t n) {
+            threads_ = n;
+            return *this;
+        }
+
+        // Run each level on a shared pool; its size replaces with_threads.
+        builder& with_executor(executor& ex) {
+            executor_ = &ex;
+            return *this;
+        }
+
         [[nodiscard]] result<bbhash_hasher> build() {
             if (keys_.empty()) {
                 return std::unexpected(error::optimization_failed);
             }
+            const detail::build_recorder rec{report_};
+
+            size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+            if (nthreads == 0) {
+                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            }
+            detail::executor_scope scope{executor_};
 
             // Remove duplicates
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                keys_.dedup(dedup_, nthreads);
+            }
 
             double current_gamma = gamma_;
 
             for (int attempt = 0; attempt < 100; ++attempt) {
                 uint64_t attempt_seed = seed_ ^ (attempt * 0x9e3779b97f4a7c15ULL);
+                rec.attempt(attempt_seed);
 
                 // Bump gamma every 5 attempts (more aggressive for large key sets)
                 if (attempt > 0 && attempt % 5 == 0) {
@@ -304,50 +528,26 @@ public:
                 bbhash_hasher hasher(keys_.size(), current_gamma, attempt_seed);
 
                 // Build BBHash structure level by level
-                std::vector<std::string> remaining_keys = keys_;
+                std::vector<std::string_view> remaining_keys(keys_.begin(), keys_.end());
+                std::array<std::vector<uint64_t>, NumLevels> level_bits;
 
                 for (size_t level_idx = 0; level_idx < NumLevels && !remaining_keys.empty(); ++level_idx) {
-                    auto& current_level = hasher.levels_[level_idx];
-                    std::vector<std::string> next_level_keys;
-
-                    // Track collisions using a temporary collision map
-                    std::vector<size_t> slot_counts(hasher.total_slots_, 0);
-
-                    // Hash all remaining keys to this level
-                    for (const auto& key : remaining_keys) {
-                        uint64_t slot = hasher.hash_at_level(key, level_idx);
-                        slot_counts[slot]++;
-                    }
-
-                    // Assign non-colliding keys to this level
-                    for (const auto& key : remaining_keys) {
-                        uint64_t slot = hasher.hash_at_level(key, level_idx);
-                        if (slot_counts[slot] == 1) {
-                            // No collision - assign to this level
-                            current_level.set_bit(slot);
-                            current_level.num_keys++;
-                        } else {
-                            // Collision - push to next level
-                            next_level_keys.push_back(key);
-                        }
-                    }
-
-                    remaining_keys = std::move(next_level_keys);
+                    remaining_keys = place_level(hasher, level_idx, level_bits[level_idx],
+                                                 remaining_keys, nthreads);
                 }
-
                 // All keys must be placed (no remaining)
                 if (!remaining_keys.empty()) {
                     continue;  // Retry with different seed
                 }
 
-                // Build rank structures for O(1) queries
-                for (auto& level : hasher.levels_) {
-                    level.build_rank_structure();
-                }
+                // Interleave the levels into rank blocks for O(1) queries
+                if (!hasher.assemble(level_bits)) continue;
 
+                rec.finish(keys_.size(), hasher.range_size());
                 return hasher;
             }
 
+            rec.finish(keys_.size(), 0);
             return std::unexpected(error::optimization_failed);
         }
     };
@@ -373,5 +573,7 @@ make_bbhash(std::span<const std::string> keys, double gamma = 2.0, uint64_t seed
 // ===== STATIC ASSERTIONS =====
 
 static_assert(perfect_hash_function<bbhash_hasher<3>>);
+static_assert(batched_perfect_hash_function<bbhash_hasher<3>>);
+static_assert(hashed_perfect_hash_function<bbhash_hasher<3>>);
 
 } // namespace maph
@@ -5,17 +5,26 @@
  * CHD is a classic minimal perfect hash function with good performance.
  * It's been extensively tested and is used in many production systems.
  *
+ * Displacements are stored compressed, as an Elias-Fano coded sequence of
+ * their prefix sums (2 + log2 of the mean displacement bits per bucket),
+ * and the table's occupied positions as a rank bit vector, so a key's slot
+ * is the number of occupied positions before its own.
+ *
  * References:
  * - Belazzougui et al. "Hash, displace, and compress" (2009)
- * - Space: ~2.0-2.5 bits per key
- * - Query time: O(1), typically 30-50ns
+ * - Space: ~3.2 bits per key (2.3 of them the rank bit vector over 2n slots)
+ * - Query time: O(1), one bucket lookup plus one rank
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/elias_fano.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/rank_bitvector.hpp"
 #include "../detail/serialization.hpp"
 #include <algorithm>
 #include <cmath>
@@ -36,22 +45,25 @@ public:
     class builder;
 
 private:
-    std::vector<uint32_t> displacements_;  // Displacement per bucket
-    std::vector<int64_t> slot_map_;        // Sparse position -> dense slot (-1 if unused)
+    detail::elias_fano displacement_sums_;  // num_buckets_ + 1 prefix sums of the displacements
+    detail::rank_bitvector occupied_;       // table positions holding a key
     size_t key_count_{0};
     size_t num_buckets_{0};
     size_t table_size_{0};  // Total slots in hash table (larger than key_count_)
     double lambda_{5.0};    // Average bucket size
     uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
     // First hash: determines bucket
-    [[nodiscard]] size_t bucket_hash(std::string_view key) const noexcept {
-        return phf_hash_with_seed(key, seed_) % num_buckets_;
+    template<typename Key>
+    [[nodiscard]] size_t bucket_hash(const Key& key) const noexcept {
+        return phf_hash_with_seed(key, seed_, hash_rev_) % num_buckets_;
     }
 
     // Second hash: determines slot within table given displacement
-    [[nodiscard]] size_t slot_hash(std::string_view key, uint32_t displacement) const noexcept {
-        return (phf_hash_with_seed(key, seed_ ^ 0xCAFEBABE12345678ULL) + displacement) % table_size_;
+    template<typename Key>
+    [[nodiscard]] size_t slot_hash(const Key& key, uint32_t displacement) const noexcept {
+        return (phf_hash_with_seed(key, seed_ ^ 0xCAFEBABE12345678ULL, hash_rev_) + displacement) % table_size_;
     }
 
     explicit chd_hasher(size_t key_count, double lambda, uint64_t seed)
@@ -59,9 +71,11 @@ private:
         , num_buckets_(std::max(size_t{1}, static_cast<size_t>(std::ceil(key_count / lambda))))
         , table_size_(static_cast<size_t>(std::ceil(key_count * 2.0)))  // 2x overhead for reliable displacement finding
         , lambda_(lambda)
-        , seed_(seed) {
-        displacements_.resize(num_buckets_, 0);
-        slot_map_.assign(table_size_, -1);  // Initialize all to unused
+        , seed_(seed) {}
+
+    [[nodiscard]] uint64_t displacement(size_t bucket) const noexcept {
+        auto [lo, hi] = displacement_sums_.pair(bucket);
+        return hi - lo;
     }
 
 public:
@@ -75,14 +89,17 @@ public:
      * @return Slot index in [0, num_keys())
      */
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
         if (key_count_ == 0) return slot_index{0};
 
-        size_t bucket = bucket_hash(key);
-        uint32_t displacement = displacements_[bucket];
-        size_t sparse_slot = slot_hash(key, displacement);
+        size_t bucket = bucket_hash(hk);
+        size_t sparse_slot = slot_hash(hk, displacement(bucket));
 
-        if (sparse_slot < table_size_ && slot_map_[sparse_slot] >= 0) {
-            return slot_index{static_cast<uint64_t>(slot_map_[sparse_slot])};
+        if (auto slot = occupied_.rank_if_set(sparse_slot)) {
+            return slot_index{*slot};
         }
 
         // Key not in build set, return arbitrary valid index
@@ -94,26 +111,29 @@ public:
 
     [[nodiscard]] double bits_per_key() const noexcept {
         if (key_count_ == 0) return 0.0;
-        size_t total_bytes = displacements_.size() * sizeof(uint32_t) +
-                            slot_map_.size() * sizeof(int64_t) +
-                            sizeof(*this);
-        return (total_bytes * 8.0) / key_count_;
+        return (memory_bytes() * 8.0) / key_count_;
     }
 
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        return displacements_.size() * sizeof(uint32_t) +
-               slot_map_.size() * sizeof(int64_t) +
-               sizeof(*this);
+        return displacement_sums_.memory_bytes() + occupied_.memory_bytes() +
+               sizeof(key_count_) + sizeof(num_buckets_) + sizeof(table_size_) +
+               sizeof(lambda_) + sizeof(seed_);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return displacement_sums_.heap_bytes() + occupied_.heap_bytes();
     }
 
     [[nodiscard]] size_t table_size() const noexcept { return table_size_; }
 
-    // Algorithm identifier for serialization
-    static constexpr uint32_t ALGORITHM_ID = 2;  // CHD
+    // Algorithm identifier for serialization. The id-2 layout (a uint32
+    // displacement per bucket and an int64 slot per table position) is no
+    // longer read.
+    static constexpr uint32_t ALGORITHM_ID = 10;  // CHD
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::write_header(out, ALGORITHM_ID);
+        phf_serial::write_header(out, ALGORITHM_ID, std::nullopt, hash_rev_);
 
         phf_serial::append(out, static_cast<uint64_t>(key_count_));
         phf_serial::append(out, static_cast<uint64_t>(num_buckets_));
@@ -121,17 +141,16 @@ public:
         phf_serial::append(out, lambda_);
         phf_serial::append(out, seed_);
 
-        phf_serial::append_vector(out, displacements_);
-        phf_serial::append_vector(out, slot_map_);
+        displacement_sums_.serialize(out);
+        occupied_.serialize(out);
         return out;
     }
 
     [[nodiscard]] static result<chd_hasher> deserialize(std::span<const std::byte> data) {
         phf_serial::reader r(data);
 
-        if (!phf_serial::verify_header(r, ALGORITHM_ID)) {
-            return std::unexpected(error::invalid_format);
-        }
+        auto version = phf_serial::read_header(r, ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
 
         uint64_t key_count_u64{}, num_buckets_u64{}, table_size_u64{}, seed{};
         double lambda{};
@@ -139,35 +158,66 @@ public:
             !r.read(table_size_u64) || !r.read(lambda) || !r.read(seed)) {
             return std::unexpected(error::invalid_format);
         }
-        if (key_count_u64 > MAX_SERIALIZED_ELEMENT_COUNT) {
+        if (key_count_u64 > MAX_SERIALIZED_ELEMENT_COUNT || num_buckets_u64 == 0 ||
+            num_buckets_u64 > MAX_SERIALIZED_ELEMENT_COUNT || table_size_u64 < key_count_u64) {
             return std::unexpected(error::invalid_format);
         }
 
         chd_hasher hasher(static_cast<size_t>(key_count_u64), lambda, seed);
         hasher.num_buckets_ = static_cast<size_t>(num_buckets_u64);
         hasher.table_size_ = static_cast<size_t>(table_size_u64);
+        hasher.hash_rev_ = phf_serial::revision_for_version(*version);
 
-        if (!r.read_vector(hasher.displacements_) || !r.read_vector(hasher.slot_map_)) {
+        if (!hasher.displacement_sums_.deserialize(r) || !hasher.occupied_.deserialize(r)) {
+            return std::unexpected(error::invalid_format);
+        }
+        if (hasher.displacement_sums_.size() != num_buckets_u64 + 1 ||
+            hasher.displacement_sums_[0] != 0 ||
+            hasher.occupied_.size() != table_size_u64 ||
+            hasher.occupied_.count() != key_count_u64) {
             return std::unexpected(error::invalid_format);
         }
         return hasher;
     }
 
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        key_dedup dedup_{key_dedup::sort};
         double lambda_{5.0};
         uint64_t seed_{0x123456789abcdef0ULL};
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string> keys) {
+            keys_.add_all(keys);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
             return *this;
         }
 
@@ -181,19 +231,36 @@ public:
             return *this;
         }
 
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
+
+        // See build_report.hpp.
+        builder& with_report(build_report& report) {
+            report_ = &report;
+            return *this;
+        }
+
         [[nodiscard]] result<chd_hasher> build() {
             if (keys_.empty()) {
                 return std::unexpected(error::optimization_failed);
             }
+            const detail::build_recorder rec{report_};
 
             // Remove duplicates
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                keys_.dedup(dedup_);
+            }
 
             for (int attempt = 0; attempt < 50; ++attempt) {
                 uint64_t attempt_seed = seed_ ^ (attempt * 0x9e3779b97f4a7c15ULL);
+                rec.attempt(attempt_seed);
 
                 chd_hasher hasher(keys_.size(), lambda_, attempt_seed);
+                std::vector<uint64_t> displacements(hasher.num_buckets_, 0);
 
                 // Group keys by bucket
                 std::vector<std::vector<size_t>> bucket_keys(hasher.num_buckets_);
@@ -212,16 +279,14 @@ public:
 
                 // Track which slots are used
                 std::vector<bool> used_slots(hasher.table_size_, false);
-                size_t next_dense_slot = 0;
+                std::vector<uint64_t> occupied((hasher.table_size_ + 63) / 64, 0);
+                size_t placed = 0;
                 bool all_placed = true;
 
                 // Find displacement for each bucket
                 for (size_t bucket_idx : bucket_order) {
                     const auto& keys_in_bucket = bucket_keys[bucket_idx];
-                    if (keys_in_bucket.empty()) {
-                        hasher.displacements_[bucket_idx] = 0;
-                        continue;
-                    }
+                    if (keys_in_bucket.empty()) continue;
 
                     // Find a displacement that gives no collisions
                     bool found = false;
@@ -248,14 +313,12 @@ public:
 
                         if (!collision) {
                             // Found valid displacement
-                            hasher.displacements_[bucket_idx] = d;
-                            for (size_t i = 0; i < keys_in_bucket.size(); ++i) {
-                                size_t sparse_slot = tentative_slots[i];
+                            displacements[bucket_idx] = d;
+                            for (size_t sparse_slot : tentative_slots) {
                                 used_slots[sparse_slot] = true;
-                                // Map sparse slot to dense slot
-                                hasher.slot_map_[sparse_slot] = static_cast<int64_t>(next_dense_slot);
-                                ++next_dense_slot;
+                                occupied[sparse_slot / 64] |= uint64_t{1} << (sparse_slot % 64);
                             }
+                            placed += tentative_slots.size();
                             found = true;
                             break;
                         }
@@ -267,12 +330,21 @@ public:
                     }
                 }
 
-                if (all_placed && next_dense_slot == keys_.size()) {
+                if (all_placed && placed == keys_.size()) {
+                    // Dense slots are ranks of the occupied positions.
+                    std::vector<uint64_t> sums(hasher.num_buckets_ + 1, 0);
+                    for (size_t b = 0; b < hasher.num_buckets_; ++b) {
+                        sums[b + 1] = sums[b] + displacements[b];
+                    }
+                    hasher.displacement_sums_ = detail::elias_fano{sums};
+                    hasher.occupied_ = detail::rank_bitvector{occupied, hasher.table_size_};
+                    rec.finish(keys_.size(), hasher.range_size());
                     return hasher;
                 }
                 // Retry with different seed
             }
 
+            rec.finish(keys_.size(), 0);
             return std::unexpected(error::optimization_failed);
         }
     };
@@ -286,7 +358,7 @@ public:
 [[nodiscard]] inline result<chd_hasher>
 make_chd(std::span<const std::string> keys, double lambda = 5.0, uint64_t seed = 0) {
     return chd_hasher::builder{}
-        .add_all(std::vector<std::string>(keys.begin(), keys.end()))
+        .add_all(keys)
         .with_lambda(lambda)
         .with_seed(seed)
         .build();
@@ -295,5 +367,6 @@ make_chd(std::span<const std::string> keys, double lambda = 5.0, uint64_t seed =
 // ===== STATIC ASSERTIONS =====
 
 static_assert(perfect_hash_function<chd_hasher>);
+static_assert(hashed_perfect_hash_function<chd_hasher>);
 
 } // namespace maph
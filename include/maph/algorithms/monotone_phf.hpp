@@ -0,0 +1,330 @@
+/**
+ * @file monotone_phf.hpp
+ * @brief Monotone minimal perfect hashing: slot_for(key) is the key's rank
+ *        in sorted order.
+ *
+ * An index into a sorted external column needs rank(key), not just some
+ * distinct slot. A phf_value_array of ranks on top of a PHF does it for
+ * log2(n) bits per key plus the PHF's; monotone_phf<M> does it for about
+ * M bits per key (M = 16 by default), independent of n.
+ *
+ * The scheme is LCP bucketing (Belazzougui, Boldi, Pagh, Vigna 2009).
+ * Keys are sorted and cut into buckets of 2^b consecutive keys. Within a
+ * bucket the keys share a longest common prefix, and because the bucket
+ * holds keys on both sides of the bit after it, no other bucket has the
+ * same prefix. So:
+ *
+ *   per key     its offset in the bucket (b bits) and which of the
+ *               distinct prefix lengths its bucket has (M - b bits), in
+ *               one ribbon_retrieval<M>;
+ *   per bucket  prefix -> bucket number, in a ribbon_retrieval<32> over
+ *               n / 2^b prefixes.
+ *
+ * A query reads the first, hashes the key's prefix of that length, reads
+ * the second, and returns bucket * 2^b + offset. build() picks the
+ * largest b whose distinct prefix lengths fit in the remaining M - b
+ * bits; the bucket table then costs 32 * 1.04 / 2^b bits per key.
+ *
+ * Prefixes are measured in bits of a prefix-free encoding of the key:
+ * each byte is a 1 bit and its 8 bits, and the key ends with a 0 bit.
+ * The encoding sorts like the bytes, and a key that is a prefix of
+ * another still differs from it at a bit both have.
+ *
+ * Order is bytewise lexicographic (std::string_view's). Keys added more
+ * than once count once. As with every PHF here, a key outside the build
+ * set gets an arbitrary slot in [0, n).
+ *
+ * Space:  ~1.04 * M bits per key, plus the bucket table and 4 bytes per
+ *         distinct prefix length.
+ * Query:  two key hashes (the key and its prefix) and two ribbon lookups.
+ * Build:  one sort of the keys, two ribbon solves.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/serialization.hpp"
+#include "../retrieval/ribbon_retrieval.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace maph {
+
+template<unsigned M = 16>
+    requires (M >= 2 && M <= 32)
+class monotone_phf {
+public:
+    static constexpr unsigned value_bits_v = M;
+
+    // Byte-wide fields are stored flat at exactly M bits per row; other
+    // widths interleave to avoid rounding up to the next byte.
+    using values_type = ribbon_retrieval<M, std::conditional_t<
+        M == 8 || M == 16 || M == 32, flat_solution, interleaved_solution>>;
+    using buckets_type = ribbon_retrieval<32>;
+
+    static constexpr uint32_t ALGORITHM_ID = 15;
+
+private:
+    values_type values_{};          // offset | prefix-length index << bucket_bits_
+    buckets_type buckets_{};        // prefix digest -> bucket number
+    std::vector<uint32_t> lcp_{};   // distinct bucket prefix lengths, ascending
+    size_t num_keys_{0};
+    unsigned bucket_bits_{0};
+
+    // Encoded bits two keys a < b share.
+    static uint32_t common_bits(std::string_view a, std::string_view b) noexcept {
+        const size_t n = std::min(a.size(), b.size());
+        size_t c = 0;
+        while (c < n && a[c] == b[c]) ++c;
+        if (c == n) return static_cast<uint32_t>(9 * c);
+        const auto x = static_cast<uint8_t>(static_cast<uint8_t>(a[c]) ^ static_cast<uint8_t>(b[c]));
+        return static_cast<uint32_t>(9 * c + 1 + static_cast<size_t>(std::countl_zero(x)));
+    }
+
+    // Encoded length of a key: the whole key, end bit included.
+    static uint32_t full_bits(std::string_view key) noexcept {
+        return static_cast<uint32_t>(9 * key.size() + 1);
+    }
+
+    // Digest of the first `bits` encoded bits of `key`. Past the end of a
+    // (non-member) key the missing bits read as zero.
+    static hash128 prefix_digest(std::string_view key, uint32_t bits) noexcept {
+        const size_t whole = bits / 9;
+        const uint32_t rest = bits % 9;
+        hash128 d = phf_hash128(key.substr(0, std::min<size_t>(whole, key.size())));
+        uint64_t tail = 0;
+        if (rest > 0 && whole < key.size()) {
+            tail = (uint64_t{1} << (rest - 1)) |
+                   (static_cast<uint8_t>(key[whole]) >> (9 - rest));
+        }
+        const uint64_t tag = (static_cast<uint64_t>(bits) << 16) | tail;
+        d.lo ^= phf_remix(tag ^ 0x2545f4914f6cdd1dULL);
+        d.hi ^= phf_remix(tag + 0x9e3779b97f4a7c15ULL);
+        return d;
+    }
+
+public:
+    monotone_phf() = default;
+
+    // ===== Queries =====
+
+    /// Rank of `key` among the build keys in sorted order.
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        if (num_keys_ == 0) return slot_index{0};
+        const uint64_t v = static_cast<uint64_t>(values_.lookup(key));
+        const uint64_t offset = v & ((uint64_t{1} << bucket_bits_) - 1);
+        const size_t which = std::min<size_t>(static_cast<size_t>(v >> bucket_bits_), lcp_.size() - 1);
+        const uint64_t bucket = buckets_.lookup(prefix_digest(key, lcp_[which]));
+        const uint64_t rank = (bucket << bucket_bits_) + offset;
+        return slot_index{static_cast<size_t>(std::min<uint64_t>(rank, num_keys_ - 1))};
+    }
+
+    /// slot_for(key), by its meaning here.
+    [[nodiscard]] size_t rank(std::string_view key) const noexcept {
+        return slot_for(key).value;
+    }
+
+    // ===== Statistics =====
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return num_keys_; }
+    /// log2 of the keys per bucket.
+    [[nodiscard]] unsigned bucket_bits() const noexcept { return bucket_bits_; }
+    /// Distinct bucket prefix lengths.
+    [[nodiscard]] size_t num_prefix_lengths() const noexcept { return lcp_.size(); }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0 / static_cast<double>(num_keys_);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return values_.memory_bytes() + buckets_.memory_bytes() +
+               lcp_.size() * sizeof(uint32_t) + sizeof(num_keys_) + sizeof(bucket_bits_);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return values_.heap_bytes() + buckets_.heap_bytes() + lcp_.capacity() * sizeof(uint32_t);
+    }
+
+    // ===== Serialization =====
+
+    /// [header][u64 n][u32 bucket_bits][u32 lengths][u32 length...]
+    /// [u64 size][values][u64 size][buckets]
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        phf_serial::write_header(out, ALGORITHM_ID, M);
+        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
+        phf_serial::append(out, static_cast<uint32_t>(bucket_bits_));
+        phf_serial::append(out, static_cast<uint32_t>(lcp_.size()));
+        for (uint32_t l : lcp_) phf_serial::append(out, l);
+        for (const auto& bytes : {values_.serialize(), buckets_.serialize()}) {
+            phf_serial::append(out, static_cast<uint64_t>(bytes.size()));
+            out.insert(out.end(), bytes.begin(), bytes.end());
+        }
+        return out;
+    }
+
+    [[nodiscard]] static result<monotone_phf> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        if (!phf_serial::verify_header(r, ALGORITHM_ID, M)) return std::unexpected(error::invalid_format);
+        uint64_t n{};
+        uint32_t bucket_bits{}, lengths{};
+        if (!r.read(n) || n > MAX_SERIALIZED_ELEMENT_COUNT || !r.read(bucket_bits) ||
+            bucket_bits > M || !r.read(lengths) || (lengths == 0) != (n == 0) ||
+            (M - bucket_bits < 32 && lengths > (uint64_t{1} << (M - bucket_bits))) ||
+            lengths > r.remaining() / sizeof(uint32_t)) {
+            return std::unexpected(error::invalid_format);
+        }
+        monotone_phf out;
+        out.num_keys_ = static_cast<size_t>(n);
+        out.bucket_bits_ = bucket_bits;
+        out.lcp_.resize(lengths);
+        for (size_t i = 0; i < out.lcp_.size(); ++i) {
+            if (!r.read(out.lcp_[i]) || (i > 0 && out.lcp_[i] <= out.lcp_[i - 1])) {
+                return std::unexpected(error::invalid_format);
+            }
+        }
+        std::span<const std::byte> parts[2];
+        for (auto& part : parts) {
+            uint64_t size{};
+            if (!r.read(size) || !r.read_span(part, static_cast<size_t>(size))) {
+                return std::unexpected(error::invalid_format);
+            }
+        }
+        auto values = values_type::deserialize(parts[0]);
+        auto buckets = buckets_type::deserialize(parts[1]);
+        if (!values || !buckets) return std::unexpected(error::invalid_format);
+        const uint64_t num_buckets = (n + (uint64_t{1} << bucket_bits) - 1) >> bucket_bits;
+        if (values->num_keys() != n || buckets->num_keys() != num_buckets) {
+            return std::unexpected(error::invalid_format);
+        }
+        out.values_ = std::move(*values);
+        out.buckets_ = std::move(*buckets);
+        return out;
+    }
+
+    // ===== Builder =====
+
+    class builder {
+        detail::key_store keys_{};
+        uint64_t seed_{42};
+        size_t threads_{1};
+
+    public:
+        builder() = default;
+
+        builder& add(std::string_view key) {
+            keys_.add(key);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        builder& add_all(const std::vector<std::string>& keys) {
+            keys_.add_all(std::span<const std::string>{keys});
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& with_seed(uint64_t s) { seed_ = s; return *this; }
+        // Threads for the two ribbon solves.
+        builder& with_threads(size_t n) { threads_ = n; return *this; }
+
+        /// error::value_too_large if no bucket size leaves room in M bits
+        /// for the distinct prefix lengths.
+        [[nodiscard]] result<monotone_phf> build() {
+            if (keys_.empty()) return std::unexpected(error::optimization_failed);
+            keys_.dedup(key_dedup::sort, threads_);
+            const auto keys = keys_.views();
+            const size_t n = keys.size();
+
+            std::vector<uint32_t> adjacent(n > 1 ? n - 1 : 0);
+            for (size_t i = 0; i + 1 < n; ++i) adjacent[i] = common_bits(keys[i], keys[i + 1]);
+
+            // The largest bucket whose prefix lengths fit beside its offsets.
+            const unsigned max_bits = std::min<unsigned>(M, static_cast<unsigned>(std::bit_width(n - 1)));
+            std::vector<uint32_t> prefix;
+            std::vector<uint32_t> lengths;
+            unsigned b = max_bits + 1;
+            while (b-- > 0) {
+                const size_t size = size_t{1} << b;
+                const size_t num_buckets = (n + size - 1) / size;
+                prefix.assign(num_buckets, 0);
+                for (size_t k = 0; k < num_buckets; ++k) {
+                    const size_t lo = k * size, hi = std::min(n, lo + size);
+                    if (hi - lo == 1) {
+                        prefix[k] = full_bits(keys[lo]);
+                    } else {
+                        prefix[k] = *std::min_element(adjacent.begin() + static_cast<ptrdiff_t>(lo),
+                                                      adjacent.begin() + static_cast<ptrdiff_t>(hi - 1));
+                    }
+                }
+                lengths = prefix;
+                std::sort(lengths.begin(), lengths.end());
+                lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+                if (M - b >= 32 || lengths.size() <= (size_t{1} << (M - b))) break;
+            }
+            if (b > max_bits) return std::unexpected(error::value_too_large);
+
+            monotone_phf out;
+            out.num_keys_ = n;
+            out.bucket_bits_ = b;
+            out.lcp_ = std::move(lengths);
+
+            using value_t = typename values_type::value_type;
+            std::vector<value_t> values(n);
+            for (size_t i = 0; i < n; ++i) {
+                const auto which = static_cast<uint64_t>(
+                    std::lower_bound(out.lcp_.begin(), out.lcp_.end(), prefix[i >> b]) - out.lcp_.begin());
+                values[i] = static_cast<value_t>((which << b) | (i & ((size_t{1} << b) - 1)));
+            }
+            auto v = typename values_type::builder{}
+                .borrow_all(keys, values).with_seed(seed_).with_threads(threads_).build();
+            if (!v) return std::unexpected(v.error());
+
+            std::vector<hash128> digests(prefix.size());
+            std::vector<uint32_t> numbers(prefix.size());
+            for (size_t k = 0; k < prefix.size(); ++k) {
+                digests[k] = prefix_digest(keys[k << b], prefix[k]);
+                numbers[k] = static_cast<uint32_t>(k);
+            }
+            auto t = buckets_type::builder{}
+                .add_hashes(digests, numbers).with_seed(seed_ ^ 0x9e3779b97f4a7c15ULL)
+                .with_threads(threads_).build();
+            if (!t) return std::unexpected(t.error());
+
+            out.values_ = std::move(*v);
+            out.buckets_ = std::move(*t);
+            return out;
+        }
+    };
+};
+
+static_assert(perfect_hash_function<monotone_phf<>>);
+
+} // namespace maph
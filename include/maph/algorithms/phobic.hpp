@@ -7,26 +7,40 @@
  * pilot produces a distinct slot. Query: hash to bucket, read pilot,
  * hash with pilot to get slot.
  *
- * Space: ~2.0-2.5 bits/key. Query: ~15-25ns. Build: O(n) expected.
+ * Space: ~3.2 bits/key with flat uint16_t pilots, ~2.6 with compact_pilots
+ * (see detail/pilot_encoding.hpp). Query: ~15-25ns. Build: O(n) expected.
  *
  * Based on: Lehmann & Walzer, "PHOBIC: Perfect Hashing with Optimized
  * Bucket sizes and Interleaved Coding" (2024).
  *
  * @tparam BucketSize Average keys per bucket (default 5)
+ * @tparam Pilots     Pilot storage policy: flat_pilots (default) or compact_pilots
+ * @tparam Storage    Array storage for the pilots: heap_storage (default) or
+ *                    mapped_storage<...> (see detail/page_allocator.hpp)
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/build_scratch.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/page_allocator.hpp"
+#include "../detail/pilot_encoding.hpp"
+#include "../detail/pilot_search.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 #include <vector>
 #include <cstdint>
 #include <cstring>
 #include <cmath>
 #include <algorithm>
-#include <atomic>
 #include <numeric>
+#include <optional>
 #include <bit>
 #include <random>
 #include <span>
@@ -34,7 +48,14 @@
 
 namespace maph {
 
-template<size_t BucketSize = 5>
+template<size_t BucketSize, typename Pilots>
+class phobic_phf_view;
+
+template<size_t BucketSize, typename Storage>
+class flat_partitioned_phf;
+
+template<size_t BucketSize = 5, typename Pilots = flat_pilots,
+         storage_policy Storage = heap_storage>
 class phobic_phf {
     static_assert(BucketSize >= 2 && BucketSize <= 20,
         "BucketSize must be between 2 and 20");
@@ -43,51 +64,74 @@ public:
     class builder;
 
 private:
+    friend class phobic_phf_view<BucketSize, Pilots>;
+    template<size_t, typename> friend class flat_partitioned_phf;
+
     struct dual_hash {
         uint64_t h1, h2;
     };
 
-    // wyhash-style mix: multiply-xor-shift for strong avalanche
-    static uint64_t wymix(uint64_t a, uint64_t b) noexcept {
-        __uint128_t full = static_cast<__uint128_t>(a) * b;
-        return static_cast<uint64_t>(full) ^ static_cast<uint64_t>(full >> 64);
+    // Two independent seeded mixes of the 128-bit digest.
+    static dual_hash hash_digest(const hash128& d, uint64_t seed) noexcept {
+        return {detail::wymix(d.lo ^ seed, d.hi ^ 0xbf58476d1ce4e5b9ULL),
+                detail::wymix(d.hi ^ seed, d.lo ^ 0x94d049bb133111ebULL)};
     }
 
-    static dual_hash hash_key(std::string_view key, uint64_t seed) noexcept {
-        // Compute a single strong hash, then split into two independent
-        // 64-bit values via wyhash-inspired mixing.
+    // Format v2: one wymix per byte, then split into two hashes.
+    static dual_hash hash_bytes_v2(std::string_view key, uint64_t seed) noexcept {
         uint64_t h = seed ^ 0x2d358dccaa6c78a5ULL;
         for (unsigned char c : key) {
-            h = wymix(h ^ c, 0x9e3779b97f4a7c15ULL);
+            h = detail::wymix(h ^ c, 0x9e3779b97f4a7c15ULL);
         }
-        // Finalize into two independent hashes
-        uint64_t h1 = wymix(h, 0xbf58476d1ce4e5b9ULL);
-        uint64_t h2 = wymix(h, 0x94d049bb133111ebULL);
-        return {h1, h2};
+        return {detail::wymix(h, 0xbf58476d1ce4e5b9ULL), detail::wymix(h, 0x94d049bb133111ebULL)};
+    }
+
+    static dual_hash hash_key(std::string_view key, uint64_t seed, hash_revision rev) noexcept {
+        return rev == hash_revision::wide ? hash_digest(phf_hash128(key), seed)
+                                          : hash_bytes_v2(key, seed);
+    }
+
+    static dual_hash hash_key(const hashed_key& hk, uint64_t seed, hash_revision rev) noexcept {
+        return rev == hash_revision::wide ? hash_digest(hk.digest, seed)
+                                          : hash_bytes_v2(hk.key, seed);
     }
 
     size_t bucket_for(uint64_t h1) const noexcept {
         return static_cast<size_t>(h1 % num_buckets_);
     }
 
+    // Full splitmix64 finalizer on h2 + pilot for strong independence
+    static uint64_t pilot_mix(uint64_t h2, uint16_t pilot) noexcept {
+        return detail::phobic_pilot_mix(h2, pilot);
+    }
+
+    static size_t pilot_slot(uint64_t h2, uint16_t pilot, size_t range_size) noexcept {
+        return static_cast<size_t>(pilot_mix(h2, pilot) % range_size);
+    }
+
     size_t slot_with_pilot(uint64_t h2, uint16_t pilot) const noexcept {
-        // Full splitmix64 finalizer on h2 + pilot for strong independence
-        uint64_t mixed = h2 + static_cast<uint64_t>(pilot) * 0x9e3779b97f4a7c15ULL;
-        mixed ^= mixed >> 30;
-        mixed *= 0xbf58476d1ce4e5b9ULL;
-        mixed ^= mixed >> 27;
-        mixed *= 0x94d049bb133111ebULL;
-        mixed ^= mixed >> 31;
-        return static_cast<size_t>(mixed % range_size_);
-    }
-
-    // Pilots stored as uint16_t for compact representation.
-    // With BucketSize=5 and good hashing, virtually all pilots fit in 16 bits.
-    std::vector<uint16_t> pilots_;
+        return pilot_slot(h2, pilot, range_size_);
+    }
+
+    // Pilots are searched as uint16_t; the policy decides how they are
+    // stored at runtime.
+    using pilot_table = typename Pilots::template table<Storage::template array>;
+
+    pilot_table pilots_;
     size_t num_keys_{0};
     size_t range_size_{0};
     size_t num_buckets_{0};
     uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
+
+    template<typename Key>
+    dual_hash hash_key(const Key& key) const noexcept {
+        return hash_key(key, seed_, hash_rev_);
+    }
+
+    slot_index slot_from(const dual_hash& h) const noexcept {
+        return slot_index{slot_with_pilot(h.h2, get_pilot(bucket_for(h.h1)))};
+    }
 
     uint16_t get_pilot(size_t bucket_id) const noexcept {
         return pilots_[bucket_id];
@@ -99,10 +143,56 @@ public:
     phobic_phf& operator=(phobic_phf&&) = default;
 
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
-        auto [h1, h2] = hash_key(key, seed_);
-        size_t bucket_id = bucket_for(h1);
-        uint16_t pilot = get_pilot(bucket_id);
-        return slot_index{slot_with_pilot(h2, pilot)};
+        return slot_from(hash_key(key));
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        return slot_from(hash_key(hk));
+    }
+
+    /// Integer keys hash in registers: phf_hash128_u64 / _u128.
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_from(hash_key(hashed_key{key}));
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_from(hash_key(hashed_key{digest}));
+    }
+
+    // Batched lookup: hash a window of keys and prefetch their pilots
+    // before reading any of them, so the pilot misses overlap.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        uint64_t h2s[W];
+        size_t buckets[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                auto [h1, h2] = hash_key(keys[base + i]);
+                h2s[i] = h2;
+                buckets[i] = bucket_for(h1);
+                detail::prefetch_read(pilots_.address(buckets[i]));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                out[base + i] = slot_index{slot_with_pilot(h2s[i], get_pilot(buckets[i]))};
+            }
+        }
+    }
+
+    // Prefetch the pilot slot_for(key) will read. Lets compositions
+    // (partitioned_phf) overlap misses across inner PHFs.
+    void prefetch(std::string_view key) const noexcept {
+        detail::prefetch_read(pilots_.address(bucket_for(hash_key(key).h1)));
+    }
+
+    void prefetch(const hashed_key& hk) const noexcept {
+        detail::prefetch_read(pilots_.address(bucket_for(hash_key(hk).h1)));
     }
 
     [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
@@ -113,25 +203,26 @@ public:
         return static_cast<double>(memory_bytes() * 8) / static_cast<double>(num_keys_);
     }
 
+    /// Bytes actually allocated for the pilots, plus the scalar fields.
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        // Compact encoding: pilots < 256 use 1 byte, others use 3 bytes
-        // (1-byte marker + 2-byte value). This reflects the information
-        // content, not the runtime representation which uses uint16_t
-        // for O(1) lookup.
-        size_t pilot_bytes = 0;
-        for (auto p : pilots_) {
-            pilot_bytes += (p < 256) ? 1 : 3;
-        }
-        return pilot_bytes
+        return pilots_.memory_bytes()
             + sizeof(uint64_t)  // seed_
             + 3 * sizeof(size_t);  // num_keys_, range_size_, num_buckets_
     }
 
-    static constexpr uint32_t ALGORITHM_ID = 6;
+    [[nodiscard]] size_t heap_bytes() const noexcept { return pilots_.heap_bytes(); }
+
+    [[nodiscard]] const pilot_table& pilots() const noexcept { return pilots_; }
+    [[nodiscard]] size_t num_buckets() const noexcept { return num_buckets_; }
+    [[nodiscard]] uint64_t seed() const noexcept { return seed_; }
+    [[nodiscard]] hash_revision revision() const noexcept { return hash_rev_; }
+
+    // 6 for flat pilots (the original layout), 8 for compact pilots.
+    static constexpr uint32_t ALGORITHM_ID = Pilots::algorithm_id;
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::write_header(out, ALGORITHM_ID);
+        phf_serial::write_header(out, ALGORITHM_ID, std::nullopt, hash_rev_);
 
         phf_serial::append(out, seed_);
         phf_serial::append(out, static_cast<uint64_t>(num_keys_));
@@ -139,16 +230,15 @@ public:
         phf_serial::append(out, static_cast<uint64_t>(num_buckets_));
         phf_serial::append(out, static_cast<uint64_t>(BucketSize));
 
-        phf_serial::append_vector(out, pilots_);
+        pilots_.serialize(out);
         return out;
     }
 
     [[nodiscard]] static result<phobic_phf> deserialize(std::span<const std::byte> data) {
         phf_serial::reader rd(data);
 
-        if (!phf_serial::verify_header(rd, ALGORITHM_ID)) {
-            return std::unexpected(error::invalid_format);
-        }
+        auto version = phf_serial::read_header(rd, ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
 
         uint64_t seed{}, nkeys{}, rsize{}, nbuckets{}, bsize{};
         if (!rd.read(seed) || !rd.read(nkeys) || !rd.read(rsize) ||
@@ -159,34 +249,89 @@ public:
 
         phobic_phf r;
         r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_version(*version);
         r.num_keys_ = static_cast<size_t>(nkeys);
         r.range_size_ = static_cast<size_t>(rsize);
         r.num_buckets_ = static_cast<size_t>(nbuckets);
-        if (!rd.read_vector(r.pilots_)) return std::unexpected(error::invalid_format);
+        if (!r.pilots_.deserialize(rd, r.num_buckets_)) {
+            return std::unexpected(error::invalid_format);
+        }
         return r;
     }
 
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        std::vector<hash128> hashes_{};  // add_hashes()
+        key_dedup dedup_{key_dedup::sort};
         uint64_t seed_{0x123456789abcdef0ULL};
         double alpha_{1.0};
         size_t threads_{1};  // 0 = auto (hardware_concurrency), 1 = sequential, N = N threads
+        executor* executor_{nullptr};
+        build_scratch* scratch_{nullptr};
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
+            return *this;
+        }
+
+        template<integer_key K>
+        builder& add(const K& key) {
+            keys_.add(key);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        builder& add_all(std::span<const uint64_t> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        builder& add_all(std::span<const __uint128_t> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_all(std::span<const uint64_t> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
+            return *this;
+        }
+
+        // Keys known only by their digest, phf_hash128(key): 16 bytes a
+        // key are kept and the key bytes never are. May be mixed with the
+        // other adds; build() returns error::duplicate_key if two digests
+        // are equal. Query with slot_for(hash128).
+        builder& add_hashes(std::span<const hash128> digests) {
+            hashes_.insert(hashes_.end(), digests.begin(), digests.end());
             return *this;
         }
 
@@ -204,22 +349,69 @@ public:
         // 1 = sequential (single-threaded, same as before).
         // N > 1 = use N worker threads for parallel pilot search.
         //
-        // Only the pilot-search phase of construction is parallelized; key
-        // hashing and bucket assignment are still serial (they are fast).
-        // For small key counts the parallel path adds overhead without
-        // speedup, so keys < 2048 falls back to the sequential algorithm.
+        // Key hashing and the pilot search run on a pool of N threads kept
+        // for the whole build (detail/task_pool.hpp); bucket grouping is
+        // serial. The result is the same for every N. For small key counts
+        // the parallel path adds overhead without speedup, so keys < 2048
+        // falls back to the sequential algorithm.
         builder& with_threads(size_t n) {
             threads_ = n;
             return *this;
         }
 
+        // Run on a shared pool instead of threads of its own; its size
+        // replaces with_threads. ex must outlive build().
+        builder& with_executor(executor& ex) {
+            executor_ = &ex;
+            return *this;
+        }
+
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
+
+        // Build in the caller's working memory (detail/build_scratch.hpp),
+        // which must outlive build(). Without one, build() allocates its
+        // own and reuses it across seed retries.
+        builder& with_scratch(build_scratch& scratch) {
+            scratch_ = &scratch;
+            return *this;
+        }
+
+        // See build_report.hpp.
+        builder& with_report(build_report& report) {
+            report_ = &report;
+            return *this;
+        }
+
         [[nodiscard]] result<phobic_phf> build() {
-            if (keys_.empty()) return std::unexpected(error::optimization_failed);
+            if (keys_.empty() && hashes_.empty()) return std::unexpected(error::optimization_failed);
+            const detail::build_recorder rec{report_};
 
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+            size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+            if (nthreads == 0) {
+                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            }
+            detail::executor_scope scope{executor_};
+            // Once there are digests, keys are reduced to theirs and the
+            // build runs on digests alone. They are merged into a copy, so
+            // a failed build leaves the builder as it was.
+            std::vector<hash128> digests;
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                if (hashes_.empty()) {
+                    keys_.dedup(dedup_, nthreads);
+                } else {
+                    digests = hashes_;
+                    if (!detail::merge_digests(digests, keys_.views())) {
+                        return std::unexpected(error::duplicate_key);
+                    }
+                }
+            }
 
-            size_t n = keys_.size();
+            size_t n = digests.empty() ? keys_.size() : digests.size();
             size_t num_buckets = std::max(size_t{1}, (n + BucketSize - 1) / BucketSize);
 
             // Retry with different seeds derived from the base seed.
@@ -234,6 +426,22 @@ public:
             static constexpr size_t MAX_SEED_ATTEMPTS = 32;
             static constexpr size_t MAX_ALPHA_BUMPS = 8;
 
+            build_scratch own;
+            build_scratch& scratch = scratch_ != nullptr ? *scratch_ : own;
+
+            // One pool for every attempt, the shared one if given. Below
+            // 2K keys thread overhead exceeds the win.
+            std::optional<executor> own_pool;
+            executor* pool = nullptr;
+            if (nthreads > 1 && n >= 2048) {
+                if (executor_ == nullptr) own_pool.emplace(nthreads);
+                pool = executor_ != nullptr ? executor_ : &*own_pool;
+                if (!pool->parallel()) pool = nullptr;  // nested in one of its tasks
+            }
+            auto try_seed = [&](auto keys, size_t range_size, uint64_t attempt_seed) {
+                return try_build(keys, n, num_buckets, range_size, attempt_seed, scratch, pool, rec);
+            };
+
             double alpha = alpha_;
             for (size_t bump = 0; bump <= MAX_ALPHA_BUMPS; ++bump) {
                 size_t range_size = static_cast<size_t>(
@@ -248,396 +456,422 @@ public:
                         attempt_seed *= 0xbf58476d1ce4e5b9ULL;
                         attempt_seed ^= attempt_seed >> 27;
                     }
-
-                    // Decide sequential vs parallel. Below the 2K-key
-                    // threshold, thread overhead exceeds the win.
-                    size_t nthreads = threads_;
-                    if (nthreads == 0) {
-                        nthreads = std::max<size_t>(1u,
-                            std::thread::hardware_concurrency());
+                    rec.attempt(attempt_seed);
+
+                    auto maybe = digests.empty()
+                        ? try_seed(keys_.views(), range_size, attempt_seed)
+                        : try_seed(std::span<const hash128>{digests}, range_size, attempt_seed);
+                    if (maybe.has_value()) {
+                        rec.finish(n, range_size);
+                        return maybe;
                     }
-                    auto maybe = (nthreads > 1 && n >= 2048)
-                        ? try_build_parallel(keys_, n, num_buckets, range_size, attempt_seed, nthreads)
-                        : try_build(keys_, n, num_buckets, range_size, attempt_seed);
-                    if (maybe.has_value()) return maybe;
                 }
 
                 // Increase alpha slightly for next round
                 alpha += 0.005;
             }
 
+            rec.finish(n, 0);
             return std::unexpected(error::optimization_failed);
         }
 
     private:
-        [[nodiscard]] result<phobic_phf> try_build(
-            const std::vector<std::string>& keys,
-            size_t n, size_t num_buckets, size_t range_size,
-            uint64_t seed) const
-        {
-            phobic_phf phf;
-            phf.seed_ = seed;
-            phf.num_keys_ = n;
-            phf.range_size_ = range_size;
-            phf.num_buckets_ = num_buckets;
-            phf.pilots_.resize(num_buckets, 0);
-
-            struct keyed_hash {
-                size_t key_idx;
-                size_t bucket_id;
-                uint64_t h2;
+        // Hash the keys into scratch, group them by bucket and order the
+        // buckets by size, descending (largest first for better packing).
+        // Clears the slot bitmap and pilots for range_size / num_buckets.
+        // Key is std::string_view or a hash128 digest.
+        template<typename Key>
+        static void prepare_attempt(std::span<const Key> keys,
+                                    size_t n, size_t num_buckets, size_t range_size,
+                                    uint64_t seed, build_scratch& scratch,
+                                    executor* pool, const detail::build_recorder& rec) {
+            auto& h2 = scratch.hashes;
+            auto& bucket_of = scratch.buckets;
+            h2.resize(n);
+            bucket_of.resize(n);
+            auto hash_range = [&](size_t lo, size_t hi) {
+                detail::for_each_digest(keys, lo, hi, [&](size_t i, const hash128& d) {
+                    auto [h1, h2_i] = hash_digest(d, seed);
+                    bucket_of[i] = static_cast<size_t>(h1 % num_buckets);
+                    h2[i] = h2_i;
+                });
             };
-
-            std::vector<keyed_hash> hashes(n);
-            std::vector<std::vector<size_t>> bucket_keys(num_buckets);
-
-            for (size_t i = 0; i < n; ++i) {
-                auto [h1, h2] = hash_key(keys[i], seed);
-                size_t bucket_id = static_cast<size_t>(h1 % num_buckets);
-                hashes[i] = {i, bucket_id, h2};
-                bucket_keys[bucket_id].push_back(i);
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                if (pool != nullptr) {
+                    constexpr size_t CHUNK = 16384;
+                    pool->for_each((n + CHUNK - 1) / CHUNK, [&](size_t c, size_t) {
+                        hash_range(c * CHUNK, std::min(n, (c + 1) * CHUNK));
+                    });
+                } else {
+                    hash_range(0, n);
+                }
+            }
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                scratch.groups.assign(num_buckets, n, [&](size_t i) { return bucket_of[i]; });
             }
 
-            // Sort buckets by size descending (largest first for better packing)
-            std::vector<size_t> bucket_order(num_buckets);
-            std::iota(bucket_order.begin(), bucket_order.end(), 0);
-            std::sort(bucket_order.begin(), bucket_order.end(),
-                [&](size_t a, size_t b) {
-                    return bucket_keys[a].size() > bucket_keys[b].size();
-                });
+            const auto& bucket_keys = scratch.groups;
+            auto& bucket_order = scratch.order;
+            {
+                auto timed = rec.time(build_report::phase::bucket_order);
+                bucket_order.resize(num_buckets);
+                std::iota(bucket_order.begin(), bucket_order.end(), 0);
+                std::sort(bucket_order.begin(), bucket_order.end(),
+                    [&](size_t a, size_t b) {
+                        return bucket_keys[a].size() > bucket_keys[b].size();
+                    });
+            }
 
-            std::vector<bool> occupied(range_size, false);
+            scratch.occupied.assign((range_size + 63) / 64, 0);
+            scratch.pilots.assign(num_buckets, 0);
+            rec.scratch(scratch.capacity_bytes());
+        }
 
-            for (size_t bucket_id : bucket_order) {
-                const auto& keys_in_bucket = bucket_keys[bucket_id];
-                if (keys_in_bucket.empty()) {
-                    phf.pilots_[bucket_id] = 0;
-                    continue;
+        // Pilot statistics of a finished search, then the pilot table.
+        static pilot_table encode(std::vector<uint16_t>& pilots,
+                                  const detail::bucket_groups& bucket_keys,
+                                  const detail::build_recorder& rec) {
+            if (rec) {
+                uint64_t sum = 0;
+                size_t used = 0;
+                for (size_t b = 0; b < pilots.size(); ++b) {
+                    if (bucket_keys[b].empty()) continue;
+                    rec->max_pilot = std::max<uint32_t>(rec->max_pilot, pilots[b]);
+                    sum += pilots[b];
+                    ++used;
                 }
+                rec->avg_pilot = used == 0 ? 0.0
+                    : static_cast<double>(sum) / static_cast<double>(used);
+            }
+            auto timed = rec.time(build_report::phase::encode);
+            return pilot_table{std::move(pilots)};
+        }
 
-                bool found = false;
-                for (uint16_t pilot = 0; pilot < 65535 && !found; ++pilot) {
-                    std::vector<size_t> candidate_slots;
-                    candidate_slots.reserve(keys_in_bucket.size());
-                    bool collision = false;
+        static constexpr uint32_t NO_PILOT = 65535;
 
-                    for (size_t ki : keys_in_bucket) {
-                        size_t slot = phf.slot_with_pilot(hashes[ki].h2, pilot);
-                        if (occupied[slot]) { collision = true; break; }
+        // No two of a bucket's slots equal; buckets are small.
+        [[maybe_unused]] static bool distinct(const std::vector<size_t>& slots) noexcept {
+            for (size_t i = 1; i < slots.size(); ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (slots[i] == slots[j]) return false;
+                }
+            }
+            return true;
+        }
 
-                        for (size_t prev : candidate_slots) {
-                            if (prev == slot) { collision = true; break; }
+        // The first pilot from `from` on that sends every key of the bucket
+        // to a distinct free slot, its slots left in `slots`; NO_PILOT if
+        // none below 65535 does.
+        static uint32_t find_pilot(const phobic_phf& phf, const std::vector<uint64_t>& hashes,
+                                   std::span<const size_t> keys_in_bucket,
+                                   const std::vector<uint64_t>& occupied, uint32_t from,
+                                   std::vector<size_t>& slots) {
+#if defined(__AVX2__)
+            // Lanes of pilots against the bitmap at once; only the pilots
+            // that clear it are checked for two keys on one slot.
+            if (detail::simd_pilot_search(phf.range_size_)) {
+                while (from < NO_PILOT) {
+                    auto run = detail::scan_free_pilots(hashes.data(), keys_in_bucket, from,
+                                                        NO_PILOT, occupied.data(), phf.range_size_);
+                    from = run.base + detail::pilot_lanes;
+                    for (uint32_t mask = run.mask; mask != 0; mask &= mask - 1) {
+                        const uint32_t pilot = run.base + static_cast<uint32_t>(std::countr_zero(mask));
+                        slots.clear();
+                        for (size_t ki : keys_in_bucket) {
+                            slots.push_back(phf.slot_with_pilot(hashes[ki], static_cast<uint16_t>(pilot)));
                         }
-                        if (collision) break;
-
-                        candidate_slots.push_back(slot);
+                        if (distinct(slots)) return pilot;
                     }
+                }
+                return NO_PILOT;
+            }
+#endif
+            for (uint32_t pilot = from; pilot < NO_PILOT; ++pilot) {
+                slots.clear();
+                bool collision = false;
 
-                    if (!collision && candidate_slots.size() == keys_in_bucket.size()) {
-                        phf.pilots_[bucket_id] = pilot;
-                        for (size_t slot : candidate_slots) {
-                            occupied[slot] = true;
-                        }
-                        found = true;
+                for (size_t ki : keys_in_bucket) {
+                    size_t slot = phf.slot_with_pilot(hashes[ki], static_cast<uint16_t>(pilot));
+                    if ((occupied[slot >> 6] >> (slot & 63)) & 1) { collision = true; break; }
+
+                    for (size_t prev : slots) {
+                        if (prev == slot) { collision = true; break; }
                     }
-                }
+                    if (collision) break;
 
-                if (!found) {
-                    return std::unexpected(error::optimization_failed);
+                    slots.push_back(slot);
                 }
+                if (!collision) return pilot;
             }
-
-            return phf;
+            return NO_PILOT;
         }
 
-        // Parallel pilot search.
-        //
-        // The sequential algorithm processes buckets in descending-size order,
-        // claiming slots against a plain bool bitset. The parallel version
-        // replaces the bitset with atomic uint64 words and splits work in
-        // two phases:
+        // Place the buckets largest first, each at the first pilot whose
+        // slots are free (find_pilot).
         //
-        // Phase 3a (fat buckets): buckets whose size >= 2*BucketSize (the
-        // straggler tail) are processed one at a time, with ALL threads
-        // cooperatively searching pilots in disjoint strides. This attacks
-        // the straggler effect that caps speedup when most threads finish
-        // thin buckets long before the last fat bucket completes.
+        // With a pool the buckets are taken in windows. The pilot of every
+        // bucket in a window is searched in parallel against the bitmap as
+        // the window found it, the pool's range stealing evening out their
+        // uneven costs, and the window is then committed in order. Earlier
+        // commits only fill slots, so a pilot that failed against the older
+        // bitmap fails against the current one: the speculative pilot is a
+        // lower bound, and when an earlier bucket of the window took one of
+        // its slots the commit resumes the search there. Every bucket gets
+        // the pilot the sequential loop would give it, so the result is the
+        // same for every thread count and schedule.
         //
-        // Phase 3b (thin buckets): the remaining buckets use work-stealing:
-        // each thread claims one bucket from a shared atomic counter and
-        // tries pilots sequentially.
-        //
-        // Correctness: each slot claim is a single atomic fetch_or. If the
-        // bit was already set, the worker releases all slots it did
-        // successfully claim and tries the next pilot. For fat buckets,
-        // multiple threads race on distinct pilot candidates for the same
-        // bucket; the winner is selected by a compare_exchange on a shared
-        // pilot_found flag, and all losers release their claims.
-        //
-        // Performance: conflicts are rare with 65535 pilot candidates per
-        // bucket and a reasonably uniform hash. Livelock is bounded by the
-        // pilot ceiling; if exhausted, the worker marks the build failed.
-        [[nodiscard]] result<phobic_phf> try_build_parallel(
-            const std::vector<std::string>& keys,
+        // A window holds about free / (4 s^2) buckets whose largest has s
+        // keys, which keeps resumed searches to a small fraction as the
+        // table fills, and at least 4 per thread.
+        template<typename Key>
+        [[nodiscard]] result<phobic_phf> try_build(
+            std::span<const Key> keys,
             size_t n, size_t num_buckets, size_t range_size,
-            uint64_t seed, size_t nthreads) const
+            uint64_t seed, build_scratch& scratch, executor* pool,
+            const detail::build_recorder& rec) const
         {
-            static_assert(std::atomic<uint64_t>::is_always_lock_free,
-                "parallel build requires lock-free 64-bit atomics");
-
             phobic_phf phf;
             phf.seed_ = seed;
             phf.num_keys_ = n;
             phf.range_size_ = range_size;
             phf.num_buckets_ = num_buckets;
-            phf.pilots_.resize(num_buckets, 0);
 
-            // Phase 1 (serial): hash keys, partition into buckets.
-            struct keyed_hash {
-                size_t key_idx;
-                size_t bucket_id;
-                uint64_t h2;
+            prepare_attempt(keys, n, num_buckets, range_size, seed, scratch, pool, rec);
+            const auto& hashes = scratch.hashes;
+            const auto& bucket_keys = scratch.groups;
+            const auto& bucket_order = scratch.order;
+            auto& occupied = scratch.occupied;
+            auto& pilots = scratch.pilots;
+            std::vector<size_t> candidate_slots;
+            auto searching = rec.time(build_report::phase::pilot_search);
+
+            auto commit = [&](size_t bucket_id, uint32_t pilot) {
+                pilots[bucket_id] = static_cast<uint16_t>(pilot);
+                for (size_t slot : candidate_slots) {
+                    occupied[slot >> 6] |= uint64_t{1} << (slot & 63);
+                }
             };
-            std::vector<keyed_hash> hashes(n);
-            std::vector<std::vector<size_t>> bucket_keys(num_buckets);
-
-            for (size_t i = 0; i < n; ++i) {
-                auto [h1, h2] = hash_key(keys[i], seed);
-                size_t bucket_id = static_cast<size_t>(h1 % num_buckets);
-                hashes[i] = {i, bucket_id, h2};
-                bucket_keys[bucket_id].push_back(i);
+
+            if (pool == nullptr) {
+                for (size_t bucket_id : bucket_order) {
+                    const auto keys_in_bucket = bucket_keys[bucket_id];
+                    if (keys_in_bucket.empty()) {
+                        pilots[bucket_id] = 0;
+                        continue;
+                    }
+                    uint32_t pilot = find_pilot(phf, hashes, keys_in_bucket, occupied, 0,
+                                                candidate_slots);
+                    if (pilot == NO_PILOT) return std::unexpected(error::optimization_failed);
+                    commit(bucket_id, pilot);
+                }
+                searching.stop();
+                phf.pilots_ = encode(pilots, bucket_keys, rec);
+                return phf;
             }
 
-            // Phase 2 (serial): sort buckets by descending size.
-            std::vector<size_t> bucket_order(num_buckets);
-            std::iota(bucket_order.begin(), bucket_order.end(), 0);
-            std::sort(bucket_order.begin(), bucket_order.end(),
-                [&](size_t a, size_t b) {
-                    return bucket_keys[a].size() > bucket_keys[b].size();
+            const size_t threads = pool->size();
+            const size_t min_window = 4 * threads;
+            const size_t max_window = size_t{1} << 14;
+            std::vector<uint32_t> spec;
+            std::vector<std::vector<size_t>> worker_slots(threads);
+
+            size_t free_slots = range_size;
+            for (size_t begin = 0; begin < num_buckets;) {
+                const size_t s = std::max<size_t>(1, bucket_keys[bucket_order[begin]].size());
+                const size_t window = std::min(num_buckets - begin,
+                    std::clamp(free_slots / (4 * s * s), min_window, max_window));
+
+                spec.assign(window, 0);
+                pool->for_each(window, [&](size_t i, size_t w) {
+                    const auto keys_in_bucket = bucket_keys[bucket_order[begin + i]];
+                    if (!keys_in_bucket.empty()) {
+                        spec[i] = find_pilot(phf, hashes, keys_in_bucket, occupied, 0,
+                                             worker_slots[w]);
+                    }
                 });
 
-            // Shared slot bitmap for phases 3a and 3b.
-            size_t num_words = (range_size + 63) / 64;
-            std::vector<std::atomic<uint64_t>> occupied(num_words);
-            for (auto& w : occupied) w.store(0, std::memory_order_relaxed);
+                for (size_t i = 0; i < window; ++i) {
+                    const size_t bucket_id = bucket_order[begin + i];
+                    const auto keys_in_bucket = bucket_keys[bucket_id];
+                    if (keys_in_bucket.empty()) {
+                        pilots[bucket_id] = 0;
+                        continue;
+                    }
+                    uint32_t pilot = spec[i];
+                    if (pilot == NO_PILOT) return std::unexpected(error::optimization_failed);
+                    pilot = find_pilot(phf, hashes, keys_in_bucket, occupied, pilot,
+                                       candidate_slots);
+                    if (pilot == NO_PILOT) return std::unexpected(error::optimization_failed);
+                    if (rec && pilot != spec[i]) ++rec->resumed_searches;
+                    commit(bucket_id, pilot);
+                    free_slots -= keys_in_bucket.size();
+                }
+                begin += window;
+            }
 
-            std::atomic<bool> failed{false};
+            searching.stop();
+            phf.pilots_ = encode(pilots, bucket_keys, rec);
+            return phf;
+        }
+    };
+};
 
-            // Classify the FIRST FEW buckets (top of the size-sorted order)
-            // as fat and process them cooperatively, one at a time with all
-            // threads collaborating on the pilot search. This targets the
-            // straggler-tail problem: the few largest buckets dominate the
-            // wall-clock time of phase 3 because pilot-search cost grows
-            // super-linearly with bucket size.
-            //
-            // Limiting fat-bucket processing to nthreads buckets ensures
-            // thread-spawn overhead stays bounded: at most nthreads * nthreads
-            // spawn/join pairs, versus (proportional to total_fat_buckets *
-            // nthreads) if we processed every large-enough bucket cooperatively.
-            // This keeps the strategy net-positive even for small key counts
-            // where many buckets would otherwise qualify as "fat" by size.
-            const size_t fat_threshold =
-                std::max<size_t>(BucketSize * 2, 8);
-            const size_t max_fat_buckets = nthreads;
-
-            size_t first_thin_idx = 0;
-            while (first_thin_idx < num_buckets &&
-                   first_thin_idx < max_fat_buckets &&
-                   bucket_keys[bucket_order[first_thin_idx]].size() >= fat_threshold) {
-                ++first_thin_idx;
-            }
+using phobic3 = phobic_phf<3>;
+using phobic4 = phobic_phf<4>;
+using phobic5 = phobic_phf<5>;
+using phobic7 = phobic_phf<7>;
+using phobic5_compact = phobic_phf<5, compact_pilots>;
 
-            // Phase 3a (fat buckets): cooperative per-pilot parallelism.
-            // One bucket at a time, all threads race on disjoint pilot
-            // strides. The first thread to successfully claim all its
-            // candidate slots wins via compare_exchange; losers release.
-            auto process_fat_bucket = [&](size_t bucket_id) {
-                const auto& keys_in_bucket = bucket_keys[bucket_id];
-                if (keys_in_bucket.empty()) {
-                    phf.pilots_[bucket_id] = 0;
-                    return;
-                }
+// ===== ZERO-COPY VIEW =====
 
-                std::atomic<bool> pilot_found{false};
+/**
+ * phobic_phf_view: phobic_phf queried in place over its serialized bytes.
+ *
+ * deserialize() checks the header and binds the pilot array where it lies
+ * in the buffer instead of copying it, so opening a mapped file costs a
+ * header parse regardless of key count and every process mapping the file
+ * shares one page-cache copy. The buffer must outlive the view.
+ *
+ * Same format and same slot_for() results as phobic_phf<BucketSize, Pilots>.
+ */
+template<size_t BucketSize = 5, typename Pilots = flat_pilots>
+class phobic_phf_view {
+    using owner = phobic_phf<BucketSize, Pilots>;
+    using dual_hash = typename owner::dual_hash;
 
-                auto search = [&](size_t thread_id) {
-                    std::vector<size_t> candidate_slots;
-                    std::vector<size_t> claimed;
+    typename Pilots::template table<phf_serial::array_view> pilots_{};
+    std::span<const std::byte> bytes_{};
+    size_t num_keys_{0};
+    size_t range_size_{0};
+    size_t num_buckets_{0};
+    uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
-                    // Each thread tries pilots [thread_id, thread_id + nthreads, ...].
-                    // Combined across threads, full coverage of [0, 65535).
-                    for (uint32_t base = static_cast<uint32_t>(thread_id);
-                         base < 65535;
-                         base += static_cast<uint32_t>(nthreads))
-                    {
-                        if (pilot_found.load(std::memory_order_acquire)) return;
-                        uint16_t pilot = static_cast<uint16_t>(base);
+    template<typename Key>
+    dual_hash hash_key(const Key& key) const noexcept {
+        return owner::hash_key(key, seed_, hash_rev_);
+    }
 
-                        candidate_slots.clear();
-                        bool internal_collision = false;
+    size_t bucket_for(uint64_t h1) const noexcept {
+        return static_cast<size_t>(h1 % num_buckets_);
+    }
 
-                        for (size_t ki : keys_in_bucket) {
-                            size_t slot = phf.slot_with_pilot(hashes[ki].h2, pilot);
-                            for (size_t prev : candidate_slots) {
-                                if (prev == slot) { internal_collision = true; break; }
-                            }
-                            if (internal_collision) break;
-                            candidate_slots.push_back(slot);
-                        }
-                        if (internal_collision) continue;
-
-                        claimed.clear();
-                        bool conflict = false;
-                        for (size_t slot : candidate_slots) {
-                            size_t word = slot >> 6;
-                            uint64_t bit = uint64_t{1} << (slot & 63);
-                            uint64_t old = occupied[word].fetch_or(
-                                bit, std::memory_order_acq_rel);
-                            if (old & bit) { conflict = true; break; }
-                            claimed.push_back(slot);
-                        }
+    slot_index slot_from(const dual_hash& h) const noexcept {
+        return slot_index{owner::pilot_slot(h.h2, pilots_[bucket_for(h.h1)], range_size_)};
+    }
 
-                        if (conflict) {
-                            for (size_t slot : claimed) {
-                                size_t word = slot >> 6;
-                                uint64_t bit = uint64_t{1} << (slot & 63);
-                                occupied[word].fetch_and(
-                                    ~bit, std::memory_order_release);
-                            }
-                            continue;
-                        }
+public:
+    phobic_phf_view() = default;
 
-                        // Slots claimed successfully. Try to commit this pilot.
-                        // If another thread already committed, release our
-                        // claims and exit.
-                        bool expected = false;
-                        if (pilot_found.compare_exchange_strong(
-                                expected, true,
-                                std::memory_order_acq_rel,
-                                std::memory_order_acquire)) {
-                            phf.pilots_[bucket_id] = pilot;
-                            return;
-                        } else {
-                            for (size_t slot : claimed) {
-                                size_t word = slot >> 6;
-                                uint64_t bit = uint64_t{1} << (slot & 63);
-                                occupied[word].fetch_and(
-                                    ~bit, std::memory_order_release);
-                            }
-                            return;
-                        }
-                    }
-                };
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_from(hash_key(key));
+    }
 
-                std::vector<std::thread> pool;
-                pool.reserve(nthreads);
-                for (size_t t = 0; t < nthreads; ++t) pool.emplace_back(search, t);
-                for (auto& th : pool) th.join();
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        return slot_from(hash_key(hk));
+    }
 
-                if (!pilot_found.load(std::memory_order_acquire)) {
-                    failed.store(true, std::memory_order_release);
-                }
-            };
+    /// Integer keys hash in registers: phf_hash128_u64 / _u128.
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_from(hash_key(hashed_key{key}));
+    }
 
-            for (size_t i = 0; i < first_thin_idx; ++i) {
-                if (failed.load(std::memory_order_acquire)) break;
-                process_fat_bucket(bucket_order[i]);
-            }
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_from(hash_key(hashed_key{digest}));
+    }
 
-            if (failed.load(std::memory_order_acquire)) {
-                return std::unexpected(error::optimization_failed);
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        uint64_t h2s[W];
+        size_t buckets[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                auto [h1, h2] = hash_key(keys[base + i]);
+                h2s[i] = h2;
+                buckets[i] = bucket_for(h1);
+                detail::prefetch_read(pilots_.address(buckets[i]));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                out[base + i] = slot_index{
+                    owner::pilot_slot(h2s[i], pilots_[buckets[i]], range_size_)};
             }
+        }
+    }
 
-            // Phase 3b (thin buckets): work-stealing.
-            std::atomic<size_t> next_bucket{first_thin_idx};
+    void prefetch(std::string_view key) const noexcept {
+        detail::prefetch_read(pilots_.address(bucket_for(hash_key(key).h1)));
+    }
 
-            auto worker = [&]() {
-                std::vector<size_t> candidate_slots;
-                std::vector<size_t> claimed;
+    void prefetch(const hashed_key& hk) const noexcept {
+        detail::prefetch_read(pilots_.address(bucket_for(hash_key(hk).h1)));
+    }
 
-                while (!failed.load(std::memory_order_acquire)) {
-                    size_t idx = next_bucket.fetch_add(1, std::memory_order_relaxed);
-                    if (idx >= num_buckets) break;
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
 
-                    size_t bucket_id = bucket_order[idx];
-                    const auto& keys_in_bucket = bucket_keys[bucket_id];
-                    if (keys_in_bucket.empty()) {
-                        phf.pilots_[bucket_id] = 0;
-                        continue;
-                    }
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(num_keys_);
+    }
 
-                    bool found = false;
-                    for (uint16_t pilot = 0; pilot < 65535 && !found; ++pilot) {
-                        candidate_slots.clear();
-                        bool internal_collision = false;
+    /// Size of the serialized structure the view reads.
+    [[nodiscard]] size_t memory_bytes() const noexcept { return bytes_.size(); }
 
-                        for (size_t ki : keys_in_bucket) {
-                            size_t slot = phf.slot_with_pilot(hashes[ki].h2, pilot);
-                            for (size_t prev : candidate_slots) {
-                                if (prev == slot) { internal_collision = true; break; }
-                            }
-                            if (internal_collision) break;
-                            candidate_slots.push_back(slot);
-                        }
-                        if (internal_collision) continue;
-
-                        // Atomically claim each candidate slot. On the first
-                        // bit that was already set, release everything we
-                        // claimed and try the next pilot.
-                        claimed.clear();
-                        bool conflict = false;
-                        for (size_t slot : candidate_slots) {
-                            size_t word = slot >> 6;
-                            uint64_t bit = uint64_t{1} << (slot & 63);
-                            uint64_t old = occupied[word].fetch_or(
-                                bit, std::memory_order_acq_rel);
-                            if (old & bit) { conflict = true; break; }
-                            claimed.push_back(slot);
-                        }
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return bytes_; }
 
-                        if (conflict) {
-                            for (size_t slot : claimed) {
-                                size_t word = slot >> 6;
-                                uint64_t bit = uint64_t{1} << (slot & 63);
-                                occupied[word].fetch_and(
-                                    ~bit, std::memory_order_release);
-                            }
-                            continue;
-                        }
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
 
-                        // Writes to different bucket_id slots in pilots_ are
-                        // independent memory locations; no race here.
-                        phf.pilots_[bucket_id] = pilot;
-                        found = true;
-                    }
+    /// Bind to bytes written by phobic_phf<BucketSize, Pilots>::serialize().
+    /// Rejects pilot arrays whose size does not match num_buckets, since the
+    /// view would otherwise read past them.
+    [[nodiscard]] static result<phobic_phf_view> deserialize(std::span<const std::byte> data) {
+        phf_serial::reader rd(data);
 
-                    if (!found) {
-                        failed.store(true, std::memory_order_release);
-                        return;
-                    }
-                }
-            };
+        auto version = phf_serial::read_header(rd, owner::ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
 
-            std::vector<std::thread> pool;
-            pool.reserve(nthreads);
-            for (size_t t = 0; t < nthreads; ++t) pool.emplace_back(worker);
-            for (auto& th : pool) th.join();
+        uint64_t seed{}, nkeys{}, rsize{}, nbuckets{}, bsize{};
+        if (!rd.read(seed) || !rd.read(nkeys) || !rd.read(rsize) ||
+            !rd.read(nbuckets) || !rd.read(bsize)) {
+            return std::unexpected(error::invalid_format);
+        }
+        if (bsize != BucketSize) return std::unexpected(error::invalid_format);
 
-            if (failed.load(std::memory_order_acquire)) {
-                return std::unexpected(error::optimization_failed);
-            }
-            return phf;
+        phobic_phf_view r;
+        r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_version(*version);
+        r.num_keys_ = static_cast<size_t>(nkeys);
+        r.range_size_ = static_cast<size_t>(rsize);
+        r.num_buckets_ = static_cast<size_t>(nbuckets);
+        if (!r.pilots_.deserialize(rd, r.num_buckets_) ||
+            (r.num_buckets_ > 0 && r.range_size_ == 0)) {
+            return std::unexpected(error::invalid_format);
         }
-    };
+        r.bytes_ = data.first(rd.offset());
+        return r;
+    }
 };
 
-using phobic3 = phobic_phf<3>;
-using phobic4 = phobic_phf<4>;
-using phobic5 = phobic_phf<5>;
-using phobic7 = phobic_phf<7>;
-
 // ===== STATIC ASSERTIONS =====
 
 static_assert(perfect_hash_function<phobic_phf<5>>);
+static_assert(batched_perfect_hash_function<phobic_phf<5>>);
+static_assert(hashed_perfect_hash_function<phobic_phf<5>>);
+static_assert(perfect_hash_function<phobic_phf_view<5>>);
+static_assert(batched_perfect_hash_function<phobic_phf_view<5>>);
+static_assert(hashed_perfect_hash_function<phobic_phf_view<5>>);
+static_assert(perfect_hash_function<phobic_phf<5, compact_pilots>>);
+static_assert(perfect_hash_function<phobic_phf_view<5, compact_pilots>>);
 
 } // namespace maph
@@ -2,118 +2,120 @@
  * @file pthash.hpp
  * @brief PTHash minimal perfect hash function.
  *
- * PTHash is a modern, extremely fast minimal perfect hash function that
- * uses an encoder-based design for compact storage. It partitions keys
- * into buckets and uses a pilot table plus encoders for collision resolution.
+ * PTHash hashes keys into buckets of a few keys each, then, largest
+ * bucket first, searches a pilot per bucket that sends all of its keys to
+ * free positions of a table of m = n / alpha slots. Query is one pilot
+ * load and one hash.
+ *
+ * Bucket assignment is skewed: 60% of the keys land in the first 30% of
+ * the buckets. The large dense buckets are placed while the table is
+ * nearly empty and the sparse tail fills the rest cheaply, which cuts
+ * both search time and the size of the largest pilots.
+ *
+ * For alpha < 1 the m - n positions past n are remapped to the free slots
+ * below n through an Elias-Fano sequence, so the function is minimal.
  *
  * References:
  * - Pibiri & Trani "PTHash: Revisiting FCH Minimal Perfect Hashing" (2021)
- * - Space: ~2.0-2.2 bits per key
- * - Query time: O(1), typically 20-30ns (fastest)
- * - Build time: O(n), very fast construction
+ * - Space: ~2.6-2.8 bits per key at the defaults (5 keys per bucket,
+ *   alpha 0.98); dictionary pilots win when a few large pilots set the
+ *   packed width
+ * - Query time: O(1), ~20-25ns: one pilot load, plus one Elias-Fano
+ *   access for the 2% of keys past n
+ * - Build time: O(n) expected
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/elias_fano.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/pilot_encoding.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
 #include "../detail/serialization.hpp"
 #include <algorithm>
 #include <cmath>
-#include <limits>
+#include <cstdint>
 #include <numeric>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
-#include <unordered_set>
 #include <vector>
 
 namespace maph {
 
 /**
  * @class pthash_hasher
- * @brief PTHash minimal perfect hash with encoder-based design
+ * @brief PTHash minimal perfect hash with skewed buckets and encoded pilots
  *
  * Algorithm:
- * 1. Keys are partitioned into buckets (first-level hash)
- * 2. Each bucket gets a pilot value (small integer)
- * 3. Pilots are stored compactly using Elias-Fano encoding
- * 4. Query: bucket_hash(key) + pilot[bucket]
+ * 1. Keys are split into dense and sparse buckets (skewed first-level hash)
+ * 2. Buckets are processed largest first; each gets the smallest pilot
+ *    whose positions are all free
+ * 3. Pilots are stored with the Pilots policy (packed or dictionary)
+ * 4. Query: position(key, pilot[bucket(key)]), remapped below n if needed
  *
- * @tparam AlphaInt Load factor for buckets (as integer, default 98 = 0.98)
+ * @tparam AlphaInt Table load factor as a percentage (default 98 = 0.98)
+ * @tparam Pilots   Pilot encoding: packed_pilots (default) or dictionary_pilots
  */
-template<size_t AlphaInt = 98>  // Alpha as integer (98 = 0.98)
+template<size_t AlphaInt = 98, typename Pilots = packed_pilots>  // Alpha as integer (98 = 0.98)
 class pthash_hasher {
-    static_assert(AlphaInt >= 80 && AlphaInt <= 99, "Alpha must be between 80 and 99");
+    static_assert(AlphaInt >= 80 && AlphaInt <= 100, "Alpha must be between 80 and 100");
     static constexpr double Alpha = AlphaInt / 100.0;
 
 public:
     class builder;
 
 private:
-    // Compact pilot storage using simple encoding
-    struct pilot_table {
-        std::vector<uint16_t> pilots;  // Pilot values per bucket
-        size_t num_buckets{0};
-
-        [[nodiscard]] uint16_t get_pilot(size_t bucket_idx) const noexcept {
-            if (bucket_idx >= pilots.size()) return 0;
-            return pilots[bucket_idx];
-        }
+    // 60% of the keys (h1 below this) go to the dense 30% of the buckets.
+    static constexpr uint64_t DENSE_THRESHOLD = 0x999999999999999AULL;  // 0.6 * 2^64
 
-        void set_pilot(size_t bucket_idx, uint16_t value) {
-            if (bucket_idx >= pilots.size()) {
-                pilots.resize(bucket_idx + 1, 0);
-            }
-            pilots[bucket_idx] = value;
-        }
+    struct dual_hash {
+        uint64_t h1, h2;
     };
 
-    pilot_table pilots_;
-    std::vector<int64_t> slot_map_;     // Raw slot -> dense slot
-    size_t key_count_{0};
-    size_t num_buckets_{0};
-    size_t table_size_{0};  // Total hash table size
-    uint64_t seed_{0};
+    static dual_hash hash_digest(const hash128& d, uint64_t seed) noexcept {
+        return {detail::wymix(d.lo ^ seed, d.hi ^ 0xbf58476d1ce4e5b9ULL),
+                detail::wymix(d.hi ^ seed, d.lo ^ 0x94d049bb133111ebULL)};
+    }
 
-    explicit pthash_hasher(size_t key_count, uint64_t seed)
-        : key_count_(key_count)
-        , num_buckets_(key_count > 0 ? key_count : 0)  // 1 key per bucket to guarantee pilot success
-        , table_size_(static_cast<size_t>(std::ceil(key_count / Alpha)))
-        , seed_(seed) {
-        pilots_.num_buckets = num_buckets_;
+    [[nodiscard]] static uint64_t fastrange(uint64_t x, uint64_t range) noexcept {
+        return static_cast<uint64_t>((static_cast<__uint128_t>(x) * range) >> 64);
     }
 
-    // Fast hash function
-    [[nodiscard]] static constexpr uint64_t fast_hash(uint64_t x) noexcept {
-        x ^= x >> 33;
-        x *= 0xff51afd7ed558ccdULL;
-        x ^= x >> 33;
-        x *= 0xc4ceb9fe1a85ec53ULL;
-        x ^= x >> 33;
-        return x;
+    // The odd multiplier spreads h1's low bits into the high bits fastrange
+    // reads, so the bucket offset is independent of the dense/sparse test.
+    [[nodiscard]] static size_t bucket_of(uint64_t h1, size_t dense, size_t sparse) noexcept {
+        const uint64_t x = h1 * 0x9e3779b97f4a7c15ULL;
+        return h1 < DENSE_THRESHOLD ? static_cast<size_t>(fastrange(x, dense))
+                                    : dense + static_cast<size_t>(fastrange(x, sparse));
     }
 
-    // Hash string to 64-bit value
-    [[nodiscard]] uint64_t hash_string(std::string_view key) const noexcept {
-        uint64_t h = seed_;
-        for (unsigned char c : key) {
-            h ^= c;
-            h *= 0x100000001b3ULL;  // FNV prime
-        }
-        return fast_hash(h);
+    [[nodiscard]] static uint64_t position(uint64_t h2, uint64_t pilot, uint64_t table_size) noexcept {
+        return fastrange(phf_remix(h2 ^ (pilot * 0xc2b2ae3d27d4eb4fULL)), table_size);
     }
 
-    // Get bucket index for key
-    [[nodiscard]] size_t get_bucket(std::string_view key) const noexcept {
-        if (num_buckets_ == 0) return 0;
-        return hash_string(key) % num_buckets_;
+    typename Pilots::table pilots_;
+    detail::elias_fano free_slots_;  // position n + i -> free slot below n
+    size_t key_count_{0};
+    size_t num_buckets_{0};
+    size_t dense_buckets_{0};
+    size_t table_size_{0};
+    uint64_t seed_{0};
+
+    [[nodiscard]] size_t bucket_for(uint64_t h1) const noexcept {
+        return bucket_of(h1, dense_buckets_, num_buckets_ - dense_buckets_);
     }
 
-    // Get position within bucket
-    [[nodiscard]] uint64_t bucket_hash(std::string_view key, uint16_t pilot) const noexcept {
-        uint64_t h = hash_string(key);
-        return fast_hash(h ^ pilot) % table_size_;
+    [[nodiscard]] slot_index slot_from(uint64_t h2, uint64_t pilot) const noexcept {
+        const uint64_t pos = position(h2, pilot, table_size_);
+        if (pos < key_count_) return slot_index{pos};
+        return slot_index{free_slots_[static_cast<size_t>(pos - key_count_)]};
     }
 
 public:
@@ -127,41 +129,77 @@ public:
      * @return Slot index in [0, num_keys())
      */
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
-        if (key_count_ == 0) return slot_index{0};
+        return slot_for(hashed_key{key});
+    }
 
-        size_t bucket_idx = get_bucket(key);
-        uint16_t pilot = pilots_.get_pilot(bucket_idx);
-        uint64_t raw_slot = bucket_hash(key, pilot);
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        if (key_count_ == 0) return slot_index{0};
+        auto [h1, h2] = hash_digest(hk.digest, seed_);
+        return slot_from(h2, pilots_[bucket_for(h1)]);
+    }
 
-        if (raw_slot < slot_map_.size() && slot_map_[raw_slot] >= 0) {
-            return slot_index{static_cast<uint64_t>(slot_map_[raw_slot])};
+    // Batched lookup: hash a window of keys and prefetch their pilots
+    // before reading any of them, so the pilot misses overlap.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (key_count_ == 0) {
+            std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(n), slot_index{0});
+            return;
         }
+        uint64_t h2s[W];
+        size_t buckets[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                auto [h1, h2] = hash_digest(phf_hash128(keys[base + i]), seed_);
+                h2s[i] = h2;
+                buckets[i] = bucket_for(h1);
+                detail::prefetch_read(pilots_.address(buckets[i]));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                out[base + i] = slot_from(h2s[i], pilots_[buckets[i]]);
+            }
+        }
+    }
 
-        // Key not in build set, return arbitrary valid index
-        return slot_index{0};
+    // Prefetch the pilot slot_for(key) will read. Lets compositions
+    // (partitioned_phf) overlap misses across inner PHFs.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (key_count_ == 0) return;
+        detail::prefetch_read(pilots_.address(bucket_for(hash_digest(hk.digest, seed_).h1)));
     }
 
+    void prefetch(std::string_view key) const noexcept { prefetch(hashed_key{key}); }
+
     [[nodiscard]] size_t num_keys() const noexcept { return key_count_; }
     [[nodiscard]] size_t range_size() const noexcept { return key_count_; }
 
     [[nodiscard]] double bits_per_key() const noexcept {
         if (key_count_ == 0) return 0.0;
-        size_t total_bytes = pilots_.pilots.size() * sizeof(uint16_t) +
-                            slot_map_.size() * sizeof(int64_t) +
-                            sizeof(*this);
-        return (total_bytes * 8.0) / key_count_;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(key_count_);
     }
 
+    /// Pilot and remap storage, plus the scalar fields.
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        return pilots_.pilots.size() * sizeof(uint16_t) +
-               slot_map_.size() * sizeof(int64_t) +
-               sizeof(*this);
+        return pilots_.memory_bytes() + free_slots_.memory_bytes()
+            + sizeof(uint64_t)     // seed_
+            + 4 * sizeof(size_t);  // key_count_, num_buckets_, dense_buckets_, table_size_
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return pilots_.heap_bytes() + free_slots_.heap_bytes();
     }
 
     [[nodiscard]] size_t num_buckets() const noexcept { return num_buckets_; }
+    [[nodiscard]] size_t table_size() const noexcept { return table_size_; }
+    [[nodiscard]] const typename Pilots::table& pilots() const noexcept { return pilots_; }
 
-    // Algorithm identifier for serialization
-    static constexpr uint32_t ALGORITHM_ID = 5;  // PTHash
+    // Algorithm identifier for serialization. The id-5 layout (one bucket
+    // per key, uint16_t pilots and an int64 slot map) is no longer read.
+    static constexpr uint32_t ALGORITHM_ID = 12;  // PTHash
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
@@ -169,38 +207,56 @@ public:
 
         phf_serial::append(out, static_cast<uint64_t>(key_count_));
         phf_serial::append(out, static_cast<uint64_t>(num_buckets_));
+        phf_serial::append(out, static_cast<uint64_t>(dense_buckets_));
         phf_serial::append(out, static_cast<uint64_t>(table_size_));
         phf_serial::append(out, seed_);
+        phf_serial::append(out, Pilots::encoding_id);
 
-        phf_serial::append_vector(out, pilots_.pilots);
-        phf_serial::append_vector(out, slot_map_);
+        pilots_.serialize(out);
+        free_slots_.serialize(out);
         return out;
     }
 
     [[nodiscard]] static result<pthash_hasher> deserialize(std::span<const std::byte> data) {
         phf_serial::reader r(data);
 
-        if (!phf_serial::verify_header(r, ALGORITHM_ID, static_cast<uint32_t>(AlphaInt))) {
+        auto version = phf_serial::read_header(r, ALGORITHM_ID, static_cast<uint32_t>(AlphaInt));
+        if (!version || phf_serial::revision_for_version(*version) != hash_revision::wide) {
             return std::unexpected(error::invalid_format);
         }
 
-        uint64_t key_count_u64{}, num_buckets_u64{}, table_size_u64{}, seed{};
-        if (!r.read(key_count_u64) || !r.read(num_buckets_u64) ||
-            !r.read(table_size_u64) || !r.read(seed)) {
+        uint64_t key_count{}, num_buckets{}, dense_buckets{}, table_size{}, seed{};
+        uint32_t encoding{};
+        if (!r.read(key_count) || !r.read(num_buckets) || !r.read(dense_buckets) ||
+            !r.read(table_size) || !r.read(seed) || !r.read(encoding)) {
             return std::unexpected(error::invalid_format);
         }
-        if (key_count_u64 > MAX_SERIALIZED_ELEMENT_COUNT) {
+        if (encoding != Pilots::encoding_id || key_count > MAX_SERIALIZED_ELEMENT_COUNT ||
+            num_buckets > MAX_SERIALIZED_ELEMENT_COUNT || table_size < key_count ||
+            table_size - key_count > MAX_SERIALIZED_ELEMENT_COUNT) {
+            return std::unexpected(error::invalid_format);
+        }
+        if (key_count > 0 && (num_buckets < 2 || dense_buckets == 0 || dense_buckets >= num_buckets)) {
             return std::unexpected(error::invalid_format);
         }
 
-        pthash_hasher hasher(static_cast<size_t>(key_count_u64), seed);
-        hasher.num_buckets_ = static_cast<size_t>(num_buckets_u64);
-        hasher.table_size_ = static_cast<size_t>(table_size_u64);
+        pthash_hasher hasher;
+        hasher.key_count_ = static_cast<size_t>(key_count);
+        hasher.num_buckets_ = static_cast<size_t>(num_buckets);
+        hasher.dense_buckets_ = static_cast<size_t>(dense_buckets);
+        hasher.table_size_ = static_cast<size_t>(table_size);
+        hasher.seed_ = seed;
 
-        if (!r.read_vector(hasher.pilots_.pilots) || !r.read_vector(hasher.slot_map_)) {
+        if (!hasher.pilots_.deserialize(r, hasher.num_buckets_) ||
+            !hasher.free_slots_.deserialize(r)) {
+            return std::unexpected(error::invalid_format);
+        }
+        // Remapped slots must stay below n.
+        const size_t spare = hasher.free_slots_.size();
+        if (spare != table_size - key_count ||
+            (spare > 0 && hasher.free_slots_[spare - 1] >= key_count)) {
             return std::unexpected(error::invalid_format);
         }
-        hasher.pilots_.num_buckets = hasher.num_buckets_;
         return hasher;
     }
 
@@ -209,25 +265,44 @@ public:
      * @brief Builder for PTHash perfect hash
      */
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        key_dedup dedup_{key_dedup::sort};
         uint64_t seed_{0x123456789abcdef0ULL};
-        size_t max_pilot_search_{16384};  // Maximum pilot value to try (uint16_t max)
+        double bucket_size_{5.0};            // Average keys per bucket
+        size_t max_pilot_search_{1u << 20};  // Pilots tried per bucket before reseeding
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(keys);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
             return *this;
         }
 
@@ -236,8 +311,27 @@ public:
             return *this;
         }
 
+        // Average keys per bucket, clamped to [1, 16]. Larger buckets mean
+        // fewer pilots (less space) and a longer search per bucket.
+        builder& with_bucket_size(double size) {
+            bucket_size_ = std::clamp(size, 1.0, 16.0);
+            return *this;
+        }
+
         builder& with_max_pilot_search(size_t max_search) {
-            max_pilot_search_ = max_search;
+            max_pilot_search_ = std::max(size_t{1}, max_search);
+            return *this;
+        }
+
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
+
+        // See build_report.hpp.
+        builder& with_report(build_report& report) {
+            report_ = &report;
             return *this;
         }
 
@@ -245,107 +339,131 @@ public:
             if (keys_.empty()) {
                 return std::unexpected(error::optimization_failed);
             }
+            const detail::build_recorder rec{report_};
 
             // Remove duplicates
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                keys_.dedup(dedup_);
+            }
+
+            const auto keys = keys_.views();
+            std::vector<hash128> digests(keys.size());
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                phf_hash128_batch(keys, digests);
+            }
 
             for (int attempt = 0; attempt < 50; ++attempt) {
                 uint64_t attempt_seed = seed_ ^ (attempt * 0x9e3779b97f4a7c15ULL);
-
-                pthash_hasher hasher(keys_.size(), attempt_seed);
-                hasher.slot_map_.assign(hasher.table_size_, -1);
-
-                // Partition keys into buckets
-                std::vector<std::vector<std::string>> buckets(hasher.num_buckets_);
-                for (const auto& key : keys_) {
-                    size_t bucket_idx = hasher.get_bucket(key);
-                    buckets[bucket_idx].push_back(key);
+                rec.attempt(attempt_seed);
+                if (auto hasher = attempt_build(digests, attempt_seed)) {
+                    rec.finish(keys.size(), hasher->range_size());
+                    return std::move(*hasher);
                 }
+                // Retry with different seed
+            }
 
-                // Sort buckets by size (largest first) for better pilot finding
-                std::vector<size_t> bucket_order(hasher.num_buckets_);
-                std::iota(bucket_order.begin(), bucket_order.end(), 0);
-                std::sort(bucket_order.begin(), bucket_order.end(),
-                    [&buckets](size_t a, size_t b) {
-                        return buckets[a].size() > buckets[b].size();
-                    });
-
-                std::vector<bool> used_slots(hasher.table_size_, false);
-                size_t next_index = 0;
-                bool all_placed = true;
-
-                // Use unordered_set for faster collision checking within bucket
-                std::unordered_set<uint64_t> current_slots;
-
-                for (size_t bucket_idx : bucket_order) {
-                    const auto& bucket_keys = buckets[bucket_idx];
-                    if (bucket_keys.empty()) continue;
-
-                    bool found_pilot = false;
-                    size_t pilot_limit = std::min(max_pilot_search_,
-                        static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1);
-
-                    current_slots.clear();
-                    current_slots.reserve(bucket_keys.size());
-
-                    for (size_t pilot = 0; pilot < pilot_limit; ++pilot) {
-                        current_slots.clear();
-                        bool has_collision = false;
-                        auto pilot_value = static_cast<uint16_t>(pilot);
-
-                        for (const auto& key : bucket_keys) {
-                            uint64_t slot = hasher.bucket_hash(key, pilot_value);
-
-                            // Check collision with already assigned slots
-                            if (used_slots[slot]) {
-                                has_collision = true;
-                                break;
-                            }
-
-                            // Check collision within this bucket
-                            if (current_slots.count(slot)) {
-                                has_collision = true;
-                                break;
-                            }
-
-                            current_slots.insert(slot);
-                        }
-
-                        if (!has_collision) {
-                            // Found a valid pilot
-                            hasher.pilots_.set_pilot(bucket_idx, pilot_value);
-
-                            // Mark slots as used
-                            for (uint64_t slot : current_slots) {
-                                used_slots[slot] = true;
-                            }
+            rec.finish(keys_.size(), 0);
+            return std::unexpected(error::optimization_failed);
+        }
 
-                            // Record dense slot mapping
-                            for (const auto& key : bucket_keys) {
-                                uint64_t slot = hasher.bucket_hash(key, pilot_value);
-                                hasher.slot_map_[slot] = static_cast<int64_t>(next_index);
-                                ++next_index;
-                            }
+    private:
+        [[nodiscard]] std::optional<pthash_hasher> attempt_build(
+            std::span<const hash128> digests, uint64_t seed) const
+        {
+            const size_t n = digests.size();
+            pthash_hasher hasher;
+            hasher.key_count_ = n;
+            hasher.seed_ = seed;
+            hasher.table_size_ = std::max(n, static_cast<size_t>(std::ceil(static_cast<double>(n) / Alpha)));
+            hasher.num_buckets_ = std::max(size_t{2},
+                static_cast<size_t>(std::ceil(static_cast<double>(n) / bucket_size_)));
+            hasher.dense_buckets_ = std::clamp<size_t>(
+                static_cast<size_t>(0.3 * static_cast<double>(hasher.num_buckets_)),
+                1, hasher.num_buckets_ - 1);
+            const size_t nb = hasher.num_buckets_;
+            const uint64_t m = hasher.table_size_;
+
+            std::vector<uint64_t> h2(n);
+            std::vector<size_t> bucket(n);
+            for (size_t i = 0; i < n; ++i) {
+                auto [a, b] = hash_digest(digests[i], seed);
+                bucket[i] = hasher.bucket_for(a);
+                h2[i] = b;
+            }
+            const detail::bucket_groups groups(nb, n, [&](size_t i) { return bucket[i]; });
+
+            // Largest buckets first (counting sort, ties by bucket id).
+            size_t max_size = 0;
+            for (size_t b = 0; b < nb; ++b) max_size = std::max(max_size, groups[b].size());
+            std::vector<size_t> start(max_size + 2, 0);
+            for (size_t b = 0; b < nb; ++b) ++start[max_size - groups[b].size() + 1];
+            std::partial_sum(start.begin(), start.end(), start.begin());
+            std::vector<size_t> order(nb);
+            for (size_t b = 0; b < nb; ++b) order[start[max_size - groups[b].size()]++] = b;
+
+            std::vector<uint64_t> taken(static_cast<size_t>((m + 63) / 64), 0);
+            std::vector<uint64_t> pilots(nb, 0);
+            std::vector<uint64_t> bucket_h2;
+            std::vector<uint64_t> placed_at;
+
+            for (size_t b : order) {
+                const auto members = groups[b];
+                if (members.empty()) break;  // the rest are empty too
+                bucket_h2.clear();
+                for (size_t i : members) bucket_h2.push_back(h2[i]);
+
+                // Keys with equal h2 collide under every pilot.
+                placed_at.assign(bucket_h2.begin(), bucket_h2.end());
+                std::sort(placed_at.begin(), placed_at.end());
+                if (std::adjacent_find(placed_at.begin(), placed_at.end()) != placed_at.end()) {
+                    return std::nullopt;
+                }
 
-                            found_pilot = true;
-                            break;
-                        }
+                // Claim positions while scanning; a taken bit (from an
+                // earlier bucket or this one) rolls back this pilot.
+                bool found = false;
+                for (uint64_t pilot = 0; pilot < max_pilot_search_ && !found; ++pilot) {
+                    size_t placed = 0;
+                    for (; placed < bucket_h2.size(); ++placed) {
+                        const uint64_t pos = position(bucket_h2[placed], pilot, m);
+                        uint64_t& word = taken[static_cast<size_t>(pos / 64)];
+                        const uint64_t bit = uint64_t{1} << (pos % 64);
+                        if (word & bit) break;
+                        word |= bit;
+                        placed_at[placed] = pos;
                     }
-
-                    if (!found_pilot) {
-                        all_placed = false;
-                        break;
+                    if (placed == bucket_h2.size()) {
+                        pilots[b] = pilot;
+                        found = true;
+                    } else {
+                        for (size_t i = 0; i < placed; ++i) {
+                            taken[static_cast<size_t>(placed_at[i] / 64)] &= ~(uint64_t{1} << (placed_at[i] % 64));
+                        }
                     }
                 }
+                if (!found) return std::nullopt;
+            }
 
-                if (all_placed && next_index == keys_.size()) {
-                    return hasher;
+            // Position n + i holding a key takes the next free slot below n.
+            // Unused positions repeat the current candidate so the sequence
+            // stays nondecreasing.
+            auto is_taken = [&](uint64_t pos) { return (taken[static_cast<size_t>(pos / 64)] >> (pos % 64)) & 1; };
+            std::vector<uint64_t> remap(static_cast<size_t>(m - n));
+            uint64_t next_free = 0;
+            for (uint64_t pos = n; pos < m; ++pos) {
+                if (is_taken(pos)) {
+                    while (is_taken(next_free)) ++next_free;
+                    remap[static_cast<size_t>(pos - n)] = next_free++;
+                } else {
+                    remap[static_cast<size_t>(pos - n)] = std::min<uint64_t>(next_free, n - 1);
                 }
-                // Retry with different seed
             }
 
-            return std::unexpected(error::optimization_failed);
+            hasher.pilots_ = typename Pilots::table{pilots};
+            hasher.free_slots_ = detail::elias_fano{remap};
+            return hasher;
         }
     };
 };
@@ -354,6 +472,7 @@ public:
 
 using pthash98 = pthash_hasher<98>;
 using pthash95 = pthash_hasher<95>;
+using pthash98_dictionary = pthash_hasher<98, dictionary_pilots>;
 
 // ===== FACTORY FUNCTIONS =====
 
@@ -370,5 +489,8 @@ make_pthash(std::span<const std::string> keys, uint64_t seed = 0) {
 // ===== STATIC ASSERTIONS =====
 
 static_assert(perfect_hash_function<pthash_hasher<98>>);
+static_assert(batched_perfect_hash_function<pthash_hasher<98>>);
+static_assert(hashed_perfect_hash_function<pthash_hasher<98>>);
+static_assert(perfect_hash_function<pthash_hasher<98, dictionary_pilots>>);
 
 } // namespace maph
@@ -2,29 +2,66 @@
  * @file recsplit.hpp
  * @brief RecSplit minimal perfect hash function.
  *
- * RecSplit is one of the fastest and most space-efficient minimal perfect
- * hash functions. It works by recursively splitting the key space.
+ * Keys are hashed into buckets of about bucket_size keys (default 100).
+ * Each bucket is split recursively, and every split is described by the
+ * first seed x for which the keys' hashes remix(fp + x) fall into the
+ * required part sizes:
+ *
+ *   m <= LeafSize      a leaf: x maps the m keys bijectively onto [0, m).
+ *   m <= lower_aggr    m / LeafSize parts of LeafSize keys (the last one
+ *                      takes the rest), then a leaf each.
+ *   m <= upper_aggr    parts of lower_aggr keys.
+ *   otherwise          two parts, the left one a multiple of upper_aggr
+ *                      close to m / 2.
+ *
+ * A key's slot is its bucket's first slot, plus the sizes of the parts
+ * to its left at every level, plus its leaf position.
+ *
+ * Each seed is stored as x minus a per-level start, Golomb-Rice coded
+ * with the parameter that minimizes the expected length for a node of
+ * that size. Parameters depend only on the node size m and live in a
+ * small table in the blob, so decoding does not depend on the libm that
+ * computed them. A bucket's tree is written as every fixed part in
+ * preorder, then every unary part in preorder. A lookup reads the codes
+ * on its root-to-leaf path. It skips a left sibling's subtree with a
+ * precomputed fixed bit count and one select over its nodes' unary
+ * terminators. An Elias-Fano directory holds each bucket's first key and
+ * first bit.
+ *
+ * Space at LeafSize = 8, bucket_size = 100 is about 1.8 bits/key. Larger
+ * leaves and buckets save space and cost build time: a leaf of m keys
+ * needs about e^m / sqrt(2 pi m) seed trials.
+ *
+ * Buckets are independent; with_threads(n) splits them over workers, and
+ * the result does not depend on n.
  *
  * References:
- * - Esposito et al. "RecSplit: Minimal Perfect Hashing via Recursive Splitting" (2019)
- * - Space: ~1.8-2.0 bits per key
- * - Query time: O(1), typically 20-40ns
+ * - Esposito, Mueller Graf, Vigna. "RecSplit: Minimal Perfect Hashing via
+ *   Recursive Splitting" (ALENEX 2020)
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/elias_fano.hpp"
+#include "../detail/golomb_rice.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 #include <algorithm>
+#include <array>
 #include <atomic>
-#include <random>
+#include <cmath>
 #include <span>
 #include <string>
 #include <string_view>
 #include <thread>
-#include <unordered_set>
 #include <vector>
 
 namespace maph {
@@ -42,45 +79,192 @@ class recsplit_hasher {
 public:
     class builder;
 
+    static constexpr size_t leaf_size = LeafSize;
+
+    /// Aggregation thresholds from the paper: ceil(0.35 L + 1/2) leaves
+    /// per lower node (at least 2), ceil(0.21 L + 9/10) lower nodes per
+    /// upper node (2 below L = 7).
+    static constexpr size_t lower_aggr =
+        LeafSize * std::max<size_t>(2, (35 * LeafSize + 50 + 99) / 100);
+    static constexpr size_t upper_aggr =
+        lower_aggr * (LeafSize < 7 ? 2 : (21 * LeafSize + 90 + 99) / 100);
+
+    static constexpr size_t DEFAULT_BUCKET_SIZE = 100;
+    static constexpr size_t MAX_BUCKET_SIZE = 2000;
+    /// Largest bucket a build accepts; the Poisson tail stays far below.
+    static constexpr size_t MAX_BUCKET_KEYS = 4096;
+
 private:
-    // Simplified RecSplit: store a seed (split value) per bucket
-    struct bucket {
-        uint16_t split{0};  // Split value for this bucket
-        size_t num_keys{0};  // Number of keys in bucket
+    static constexpr size_t MAX_FANOUT =
+        std::max(lower_aggr / LeafSize, upper_aggr / lower_aggr) + 1;
+    static constexpr unsigned MAX_RICE = 56;
+
+    // Shape of a subtree of m keys: code count and total fixed bits.
+    struct subtree {
+        uint32_t nodes{0};
+        uint32_t fixed_bits{0};
+    };
+
+    // A bucket's first slot, key count, and first bit of its tree.
+    struct bucket_ref {
+        uint64_t first{0};
+        size_t size{0};
+        uint64_t bit{0};
     };
 
-    std::vector<bucket> buckets_;
-    std::vector<uint64_t> bucket_offsets_;  // Cumulative slot offsets
     size_t key_count_{0};
+    size_t bucket_size_{DEFAULT_BUCKET_SIZE};
     size_t num_buckets_{0};
     uint64_t base_seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
+    std::vector<uint8_t> rice_{};        // Golomb-Rice parameter per subtree size
+    std::vector<subtree> memo_{};        // derived from rice_
+    detail::elias_fano bucket_keys_{};   // num_buckets + 1 first slots
+    detail::elias_fano bucket_bits_{};   // num_buckets + 1 tree offsets
+    std::vector<uint64_t> tree_bits_{};  // trees, then an all-ones guard word
+
+    [[nodiscard]] static constexpr uint64_t start_seed(size_t level) noexcept {
+        return phf_remix((level + 1) * 0x9e3779b97f4a7c15ULL);
+    }
 
-    // Construction time data (cleared after build)
-    struct build_data {
-        std::vector<std::string> keys;
-        std::mt19937_64 rng;
-    };
+    // Part of [0, m) selected by the top 16 bits of x.
+    [[nodiscard]] static constexpr size_t remap16(uint64_t x, size_t m) noexcept {
+        return static_cast<size_t>(((x >> 48) * m) >> 16);
+    }
+
+    // Size of the left part of a binary split.
+    [[nodiscard]] static constexpr size_t split_point(size_t m) noexcept {
+        return (m / 2 + upper_aggr - 1) / upper_aggr * upper_aggr;
+    }
+
+    // Per-key fingerprint used inside the bucket; independent of the
+    // high bits that pick the bucket.
+    [[nodiscard]] static constexpr uint64_t fingerprint(uint64_t h) noexcept {
+        return phf_remix(h ^ 0x2545f4914f6cdd1dULL);
+    }
+
+    template<typename Key>
+    [[nodiscard]] uint64_t key_hash(const Key& key) const noexcept {
+        return phf_hash_with_seed(key, base_seed_, hash_rev_);
+    }
+
+    [[nodiscard]] size_t bucket_of(uint64_t h) const noexcept {
+        return static_cast<size_t>((static_cast<__uint128_t>(h) * num_buckets_) >> 64);
+    }
+
+    [[nodiscard]] bucket_ref locate(size_t b) const noexcept {
+        auto [first, next] = bucket_keys_.pair(b);
+        return {first, static_cast<size_t>(next - first), bucket_bits_[b]};
+    }
+
+    void prefetch_bucket(size_t b) const noexcept {
+        detail::prefetch_read(bucket_keys_.sample_address(b));
+        detail::prefetch_read(bucket_keys_.low_address(b));
+        detail::prefetch_read(bucket_bits_.sample_address(b));
+        detail::prefetch_read(bucket_bits_.low_address(b));
+    }
+
+    // Walk bucket `ref`'s tree for fingerprint fp.
+    [[nodiscard]] uint64_t walk(const bucket_ref& ref, uint64_t fp) const noexcept {
+        size_t m = ref.size;
+        if (m == 0) return 0;
+        uint64_t slot = ref.first;
+        if (m == 1) return slot;
+        detail::rice_reader rd(tree_bits_.data(), ref.bit, ref.bit + memo_[m].fixed_bits);
+        size_t level = 0;
+        while (m > upper_aggr) {
+            const uint64_t x = rd.next(rice_[m]) + start_seed(level++);
+            const size_t left = split_point(m);
+            if (remap16(phf_remix(fp + x), m) < left) {
+                m = left;
+            } else {
+                rd.skip(memo_[left].nodes, memo_[left].fixed_bits);
+                slot += left;
+                m -= left;
+            }
+        }
+        for (size_t unit : {lower_aggr, LeafSize}) {
+            if (m <= unit) continue;
+            const uint64_t x = rd.next(rice_[m]) + start_seed(level++);
+            const size_t part = remap16(phf_remix(fp + x), m) / unit;
+            if (part != 0) {
+                rd.skip(part * memo_[unit].nodes, part * memo_[unit].fixed_bits);
+                slot += part * unit;
+                m -= part * unit;
+            }
+            m = std::min(m, unit);
+        }
+        if (m > 1) {
+            const uint64_t x = rd.next(rice_[m]) + start_seed(level);
+            slot += remap16(phf_remix(fp + x), m);
+        }
+        return slot;
+    }
 
-    explicit recsplit_hasher(size_t key_count, uint64_t seed = 0x123456789abcdef0ULL)
-        : key_count_(key_count)
-        , num_buckets_(std::max(size_t{1}, (key_count * 4) / LeafSize))  // 4x buckets for better distribution with large sets
-        , base_seed_(seed) {
-        buckets_.resize(num_buckets_);
-        bucket_offsets_.resize(num_buckets_ + 1, 0);
+    // log P(a random seed splits m keys as required at that node).
+    [[nodiscard]] static double log_split_probability(size_t m) noexcept {
+        const double dm = static_cast<double>(m);
+        double lp = std::lgamma(dm + 1);
+        auto part = [&](size_t s) {
+            const double ds = static_cast<double>(s);
+            lp += ds * std::log(ds / dm) - std::lgamma(ds + 1);
+        };
+        if (m <= LeafSize) {
+            for (size_t i = 0; i < m; ++i) part(1);
+        } else if (m > upper_aggr) {
+            part(split_point(m));
+            part(m - split_point(m));
+        } else {
+            const size_t unit = m > lower_aggr ? lower_aggr : LeafSize;
+            const size_t fanout = (m + unit - 1) / unit;
+            for (size_t j = 0; j + 1 < fanout; ++j) part(unit);
+            part(m - (fanout - 1) * unit);
+        }
+        return lp;
     }
 
-    // Determine which bucket a key belongs to
-    [[nodiscard]] size_t bucket_for_key(std::string_view key) const noexcept {
-        return phf_hash_with_seed(key, base_seed_) % num_buckets_;
+    // Golomb-Rice parameter minimizing the expected code length of a
+    // geometric count of failed trials: k + 1 / (1 - q^(2^k)).
+    [[nodiscard]] static uint8_t best_rice(double log_p) noexcept {
+        const double lq = std::log1p(-std::exp(log_p));
+        unsigned best = 0;
+        double best_len = HUGE_VAL;
+        for (unsigned k = 0; k <= MAX_RICE; ++k) {
+            const double len = k - 1.0 / std::expm1(std::ldexp(lq, static_cast<int>(k)));
+            if (len < best_len) {
+                best_len = len;
+                best = k;
+            }
+        }
+        return static_cast<uint8_t>(best);
     }
 
-    // Hash within a bucket using the bucket's split value
-    [[nodiscard]] size_t slot_in_bucket(std::string_view key, size_t bucket_idx) const noexcept {
-        if (buckets_[bucket_idx].num_keys == 0) return 0;
+    [[nodiscard]] static std::vector<uint8_t> rice_table(size_t max_m) {
+        std::vector<uint8_t> rice(max_m + 1, 0);
+        for (size_t m = 2; m <= max_m; ++m) rice[m] = best_rice(log_split_probability(m));
+        return rice;
+    }
 
-        uint64_t split = buckets_[bucket_idx].split;
-        uint64_t bucket_seed = base_seed_ ^ (bucket_idx * 0x9e3779b97f4a7c15ULL) ^ (split * 0xbf58476d1ce4e5b9ULL);
-        return phf_hash_with_seed(key, bucket_seed) % buckets_[bucket_idx].num_keys;
+    [[nodiscard]] static std::vector<subtree> memo_table(const std::vector<uint8_t>& rice) {
+        std::vector<subtree> memo(rice.size());
+        for (size_t m = 2; m < rice.size(); ++m) {
+            subtree t{1, rice[m]};
+            auto add = [&](const subtree& child, size_t times) {
+                t.nodes += static_cast<uint32_t>(child.nodes * times);
+                t.fixed_bits += static_cast<uint32_t>(child.fixed_bits * times);
+            };
+            if (m > upper_aggr) {
+                add(memo[split_point(m)], 1);
+                add(memo[m - split_point(m)], 1);
+            } else if (m > LeafSize) {
+                const size_t unit = m > lower_aggr ? lower_aggr : LeafSize;
+                const size_t fanout = (m + unit - 1) / unit;
+                add(memo[unit], fanout - 1);
+                add(memo[m - (fanout - 1) * unit], 1);
+            }
+            memo[m] = t;
+        }
+        return memo;
     }
 
 public:
@@ -94,90 +278,157 @@ public:
      * @return Slot index in [0, num_keys())
      */
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
         if (key_count_ == 0) return slot_index{0};
+        const uint64_t h = key_hash(hk);
+        return slot_index{walk(locate(bucket_of(h)), fingerprint(h))};
+    }
+
+    // Batched lookup: hash a window of keys and prefetch their directory
+    // entries, decode the directory and prefetch each tree, then walk.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (key_count_ == 0) {
+            std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(n), slot_index{0});
+            return;
+        }
+        uint64_t hashes[W];
+        bucket_ref refs[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hashes[i] = key_hash(hashed_key{keys[base + i]});
+                prefetch_bucket(bucket_of(hashes[i]));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                refs[i] = locate(bucket_of(hashes[i]));
+                detail::prefetch_read(tree_bits_.data() + refs[i].bit / 64);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                out[base + i] = slot_index{walk(refs[i], fingerprint(hashes[i]))};
+            }
+        }
+    }
 
-        size_t bucket_idx = bucket_for_key(key);
-        if (buckets_[bucket_idx].num_keys == 0) return slot_index{0};
+    // Prefetch the directory entries slot_for(key) will read.
+    void prefetch(std::string_view key) const noexcept {
+        prefetch(hashed_key{key});
+    }
 
-        size_t local_slot = slot_in_bucket(key, bucket_idx);
-        size_t global_slot = bucket_offsets_[bucket_idx] + local_slot;
-        return slot_index{global_slot};
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (key_count_ == 0) return;
+        prefetch_bucket(bucket_of(key_hash(hk)));
     }
 
     [[nodiscard]] size_t num_keys() const noexcept { return key_count_; }
     [[nodiscard]] size_t range_size() const noexcept { return key_count_; }
+    [[nodiscard]] size_t num_buckets() const noexcept { return num_buckets_; }
+    [[nodiscard]] size_t bucket_size() const noexcept { return bucket_size_; }
 
     [[nodiscard]] double bits_per_key() const noexcept {
         if (key_count_ == 0) return 0.0;
-        size_t bucket_bytes = buckets_.size() * sizeof(bucket);
-        size_t offset_bytes = bucket_offsets_.size() * sizeof(uint64_t);
-        size_t total_bytes = bucket_bytes + offset_bytes + sizeof(*this);
-        return (total_bytes * 8.0) / key_count_;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(key_count_);
     }
 
+    /// Trees, directory and parameter tables, plus the scalar fields.
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        size_t bucket_bytes = buckets_.size() * sizeof(bucket);
-        size_t offset_bytes = bucket_offsets_.size() * sizeof(uint64_t);
-        return bucket_bytes + offset_bytes + sizeof(*this);
+        return tree_bits_.size() * sizeof(uint64_t)
+            + bucket_keys_.memory_bytes() + bucket_bits_.memory_bytes()
+            + rice_.size() + memo_.size() * sizeof(subtree)
+            + sizeof(uint64_t)     // base_seed_
+            + 3 * sizeof(size_t);  // key_count_, bucket_size_, num_buckets_
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::allocated_bytes(tree_bits_) + detail::allocated_bytes(rice_)
+            + detail::allocated_bytes(memo_)
+            + bucket_keys_.heap_bytes() + bucket_bits_.heap_bytes();
     }
 
-    // Algorithm identifier for serialization
-    static constexpr uint32_t ALGORITHM_ID = 1;  // RecSplit
+    // Algorithm identifier for serialization. Id 1 was the earlier
+    // single-split layout, which is no longer read.
+    static constexpr uint32_t ALGORITHM_ID = 9;  // RecSplit
 
-    // Serialization
+    // Format: header, [u64 keys][u64 bucket_size][u64 buckets][u64 seed],
+    // rice table (u8 vector), key and bit directories, tree words.
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::write_header(out, ALGORITHM_ID, static_cast<uint32_t>(LeafSize));
+        phf_serial::write_header(out, ALGORITHM_ID, static_cast<uint32_t>(LeafSize), hash_rev_);
 
         phf_serial::append(out, static_cast<uint64_t>(key_count_));
+        phf_serial::append(out, static_cast<uint64_t>(bucket_size_));
         phf_serial::append(out, static_cast<uint64_t>(num_buckets_));
         phf_serial::append(out, base_seed_);
-
-        phf_serial::append(out, static_cast<uint64_t>(buckets_.size()));
-        for (const auto& b : buckets_) {
-            phf_serial::append(out, b.split);
-            phf_serial::append(out, static_cast<uint64_t>(b.num_keys));
-        }
-
-        phf_serial::append_vector(out, bucket_offsets_);
+        phf_serial::append_vector(out, rice_);
+        bucket_keys_.serialize(out);
+        bucket_bits_.serialize(out);
+        phf_serial::append_vector(out, tree_bits_);
         return out;
     }
 
+    /// Rejects directories that disagree with the key and bucket counts,
+    /// buckets larger than the parameter table, trees that overlap the
+    /// next bucket's, and trees that would read past the guard word.
     [[nodiscard]] static result<recsplit_hasher> deserialize(std::span<const std::byte> data) {
         phf_serial::reader r(data);
 
-        if (!phf_serial::verify_header(r, ALGORITHM_ID, static_cast<uint32_t>(LeafSize))) {
-            return std::unexpected(error::invalid_format);
-        }
+        auto version = phf_serial::read_header(r, ALGORITHM_ID, static_cast<uint32_t>(LeafSize));
+        if (!version) return std::unexpected(error::invalid_format);
 
-        uint64_t key_count_u64{}, num_buckets_u64{}, base_seed{};
-        if (!r.read(key_count_u64) || !r.read(num_buckets_u64) || !r.read(base_seed)) {
+        uint64_t key_count{}, bucket_size{}, num_buckets{}, base_seed{};
+        if (!r.read(key_count) || !r.read(bucket_size) || !r.read(num_buckets) ||
+            !r.read(base_seed)) {
             return std::unexpected(error::invalid_format);
         }
-        if (key_count_u64 > MAX_SERIALIZED_ELEMENT_COUNT) {
+        if (key_count > MAX_SERIALIZED_ELEMENT_COUNT || bucket_size == 0 ||
+            bucket_size > MAX_BUCKET_SIZE ||
+            num_buckets != (key_count + bucket_size - 1) / bucket_size) {
             return std::unexpected(error::invalid_format);
         }
 
-        recsplit_hasher hasher(static_cast<size_t>(key_count_u64), base_seed);
-        hasher.num_buckets_ = static_cast<size_t>(num_buckets_u64);
+        recsplit_hasher h;
+        h.key_count_ = static_cast<size_t>(key_count);
+        h.bucket_size_ = static_cast<size_t>(bucket_size);
+        h.num_buckets_ = static_cast<size_t>(num_buckets);
+        h.base_seed_ = base_seed;
+        h.hash_rev_ = phf_serial::revision_for_version(*version);
 
-        uint64_t bucket_count{};
-        if (!r.read(bucket_count) || bucket_count > MAX_SERIALIZED_ELEMENT_COUNT) {
+        if (!r.read_vector(h.rice_) || h.rice_.size() > MAX_BUCKET_KEYS + 1 ||
+            !h.bucket_keys_.deserialize(r) || !h.bucket_bits_.deserialize(r) ||
+            !r.read_vector(h.tree_bits_)) {
             return std::unexpected(error::invalid_format);
         }
-        hasher.buckets_.resize(static_cast<size_t>(bucket_count));
-        for (auto& b : hasher.buckets_) {
-            uint64_t num_keys{};
-            if (!r.read(b.split) || !r.read(num_keys)) {
-                return std::unexpected(error::invalid_format);
-            }
-            b.num_keys = static_cast<size_t>(num_keys);
+        for (uint8_t k : h.rice_) {
+            if (k > MAX_RICE) return std::unexpected(error::invalid_format);
         }
+        if (key_count == 0) return h;
 
-        if (!r.read_vector(hasher.bucket_offsets_)) {
+        if (h.bucket_keys_.size() != num_buckets + 1 || h.bucket_bits_.size() != num_buckets + 1 ||
+            h.tree_bits_.empty() || h.tree_bits_.back() != ~uint64_t{0} ||
+            h.bucket_bits_[h.num_buckets_] > (h.tree_bits_.size() - 1) * 64) {
             return std::unexpected(error::invalid_format);
         }
-        return hasher;
+        h.memo_ = memo_table(h.rice_);
+        if (h.bucket_keys_[0] != 0) return std::unexpected(error::invalid_format);
+        // Each bucket's tree must fit before the next one starts: at least
+        // its fixed bits plus one unary stop bit per code.
+        for (size_t b = 0; b < h.num_buckets_; ++b) {
+            auto [first, next] = h.bucket_keys_.pair(b);
+            const uint64_t m = next - first;
+            if (m <= 1) continue;
+            if (m >= h.memo_.size() ||
+                h.bucket_bits_[b] + h.memo_[m].fixed_bits + h.memo_[m].nodes > h.bucket_bits_[b + 1]) {
+                return std::unexpected(error::invalid_format);
+            }
+        }
+        if (h.bucket_keys_[h.num_buckets_] != key_count) return std::unexpected(error::invalid_format);
+        return h;
     }
 
     /**
@@ -185,25 +436,45 @@ public:
      * @brief Builder for RecSplit perfect hash
      */
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        key_dedup dedup_{key_dedup::sort};
         uint64_t seed_{0x123456789abcdef0ULL};
         size_t num_threads_{1};
+        executor* executor_{nullptr};
+        size_t bucket_size_{DEFAULT_BUCKET_SIZE};
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(keys);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
             return *this;
         }
 
@@ -217,62 +488,197 @@ public:
             return *this;
         }
 
-    private:
-        // Result of processing a single bucket
-        struct bucket_result {
-            uint16_t split{0};
-            size_t num_keys{0};
-            bool success{false};
-        };
+        // Encode on a shared pool; its size replaces with_threads.
+        builder& with_executor(executor& ex) {
+            executor_ = &ex;
+            num_threads_ = ex.size();
+            return *this;
+        }
 
-        // Process a single bucket - can be called in parallel
-        [[nodiscard]] bucket_result process_bucket(
-            const recsplit_hasher& hasher,
-            const std::vector<std::string>& keys_in_bucket,
-            size_t bucket_idx) const {
+        // Expected keys per bucket, clamped to [1, MAX_BUCKET_SIZE]. Larger
+        // buckets amortize the directory over more keys but split deeper.
+        builder& with_bucket_size(size_t n) {
+            bucket_size_ = std::clamp<size_t>(n, 1, MAX_BUCKET_SIZE);
+            return *this;
+        }
+
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
 
-            bucket_result result;
+        // See build_report.hpp.
+        builder& with_report(build_report& report) {
+            report_ = &report;
+            return *this;
+        }
 
-            if (keys_in_bucket.empty()) {
-                result.success = true;
-                return result;
+    private:
+        // Encodes one bucket at a time; one per worker so the scratch
+        // buffers are reused across buckets.
+        class bucket_encoder {
+            const recsplit_hasher& h_;
+            std::vector<uint64_t> fps_{};
+            std::vector<uint64_t> tmp_{};
+            detail::bit_writer fixed_{};
+            std::vector<uint64_t> unary_{};
+
+            void emit(uint64_t x, size_t m) {
+                const unsigned k = h_.rice_[m];
+                fixed_.append(x, k);
+                unary_.push_back(x >> k);
             }
 
-            // Find a split value that gives no collisions within this bucket
-            constexpr uint16_t max_split_search = 10000;
-
-            for (uint16_t split = 0; split < max_split_search; ++split) {
-                // Check if all keys get unique slots with this split
-                std::unordered_set<size_t> used_slots;
-                bool has_collision = false;
-
-                // Temporarily set split to compute slot positions
-                auto test_slot_in_bucket = [&](std::string_view key) -> size_t {
-                    if (keys_in_bucket.size() == 0) return 0;
-                    uint64_t bucket_seed = hasher.base_seed_ ^ (bucket_idx * 0x9e3779b97f4a7c15ULL) ^ (split * 0xbf58476d1ce4e5b9ULL);
-                    return phf_hash_with_seed(key, bucket_seed) % keys_in_bucket.size();
-                };
-
-                for (const auto& key : keys_in_bucket) {
-                    size_t slot = test_slot_in_bucket(key);
-                    if (used_slots.count(slot)) {
-                        has_collision = true;
-                        break;
+            // Preorder: this node's code, then its children left to right.
+            void split(size_t begin, size_t m, size_t level) {
+                if (m <= 1) return;
+                uint64_t* f = fps_.data() + begin;
+                uint64_t* t = tmp_.data() + begin;
+                const uint64_t x0 = start_seed(level);
+                uint64_t x = x0;
+
+                if (m <= LeafSize) {
+                    // A seed is a bijection iff the m positions cover [0, m).
+                    // No early exit: a collision branch would mispredict on
+                    // nearly every trial.
+                    const uint32_t full = (uint32_t{1} << m) - 1;
+                    for (;; ++x) {
+                        uint32_t used = 0;
+                        for (size_t i = 0; i < m; ++i) {
+                            used |= uint32_t{1} << remap16(phf_remix(f[i] + x), m);
+                        }
+                        if (used == full) break;
                     }
-                    used_slots.insert(slot);
+                    emit(x - x0, m);
+                    return;
                 }
 
-                if (!has_collision) {
-                    result.split = split;
-                    result.num_keys = keys_in_bucket.size();
-                    result.success = true;
-                    return result;
+                if (m > upper_aggr) {
+                    const size_t left = split_point(m);
+                    for (;; ++x) {
+                        size_t count = 0;
+                        for (size_t i = 0; i < m; ++i) {
+                            count += remap16(phf_remix(f[i] + x), m) < left ? 1 : 0;
+                        }
+                        if (count == left) break;
+                    }
+                    emit(x - x0, m);
+                    size_t lo = 0, hi = left;
+                    for (size_t i = 0; i < m; ++i) {
+                        t[remap16(phf_remix(f[i] + x), m) < left ? lo++ : hi++] = f[i];
+                    }
+                    std::copy(t, t + m, f);
+                    split(begin, left, level + 1);
+                    split(begin + left, m - left, level + 1);
+                    return;
+                }
+
+                const size_t unit = m > lower_aggr ? lower_aggr : LeafSize;
+                const size_t fanout = (m + unit - 1) / unit;
+                std::array<size_t, MAX_FANOUT> count{};
+                for (;; ++x) {
+                    count.fill(0);
+                    for (size_t i = 0; i < m; ++i) ++count[remap16(phf_remix(f[i] + x), m) / unit];
+                    size_t j = 0;
+                    while (j + 1 < fanout && count[j] == unit) ++j;
+                    if (j + 1 == fanout) break;
+                }
+                emit(x - x0, m);
+                std::array<size_t, MAX_FANOUT> pos{};
+                for (size_t j = 0; j < fanout; ++j) pos[j] = j * unit;
+                for (size_t i = 0; i < m; ++i) t[pos[remap16(phf_remix(f[i] + x), m) / unit]++] = f[i];
+                std::copy(t, t + m, f);
+                for (size_t j = 0; j < fanout; ++j) {
+                    split(begin + j * unit, std::min(unit, m - j * unit), level + 1);
                 }
             }
 
-            // Couldn't find split for this bucket
-            result.success = false;
-            return result;
+        public:
+            explicit bucket_encoder(const recsplit_hasher& h) : h_(h) {}
+
+            // False if two keys share a fingerprint, which no seed splits.
+            [[nodiscard]] bool encode(std::span<const uint64_t> hashes, detail::bit_writer& out) {
+                const size_t m = hashes.size();
+                fps_.resize(m);
+                tmp_.resize(m);
+                for (size_t i = 0; i < m; ++i) fps_[i] = fingerprint(hashes[i]);
+                std::sort(fps_.begin(), fps_.end());
+                if (std::adjacent_find(fps_.begin(), fps_.end()) != fps_.end()) return false;
+                fixed_.clear();
+                unary_.clear();
+                split(0, m, 0);
+                out.append(fixed_);
+                for (uint64_t u : unary_) out.append_unary(u);
+                return true;
+            }
+        };
+
+        // Fill out's directory and trees for one seed; false if a bucket
+        // is too large or holds a fingerprint collision.
+        [[nodiscard]] bool attempt_build(recsplit_hasher& out,
+                                         std::span<const hash128> digests) const {
+            const size_t n = digests.size();
+            const size_t nt = detail::effective_threads(n, num_threads_);
+            std::vector<uint64_t> hashes(n);
+            detail::parallel_chunks(n, nt, [&](size_t, size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; ++i) hashes[i] = phf_hash_with_seed(digests[i], out.base_seed_);
+            });
+            auto first = detail::radix_partition(hashes, out.num_buckets_,
+                [&](size_t i) { return out.bucket_of(hashes[i]); }, nt);
+
+            size_t max_bucket = 0;
+            for (size_t b = 0; b < out.num_buckets_; ++b) {
+                max_bucket = std::max(max_bucket, first[b + 1] - first[b]);
+            }
+            if (max_bucket > MAX_BUCKET_KEYS) return false;
+            out.rice_ = rice_table(max_bucket);
+            out.memo_ = memo_table(out.rice_);
+
+            // Workers claim blocks of buckets; each block is encoded into
+            // its own bit vector and the blocks are joined in order.
+            constexpr size_t BLOCK = 256;
+            const size_t num_blocks = (out.num_buckets_ + BLOCK - 1) / BLOCK;
+            std::vector<detail::bit_writer> block_bits(num_blocks);
+            std::vector<uint64_t> bucket_bit(out.num_buckets_ + 1, 0);
+            std::atomic<size_t> next_block{0};
+            std::atomic<bool> failed{false};
+            auto worker = [&] {
+                bucket_encoder enc{out};
+                for (;;) {
+                    const size_t blk = next_block.fetch_add(1, std::memory_order_relaxed);
+                    if (blk >= num_blocks || failed.load(std::memory_order_relaxed)) return;
+                    const size_t hi = std::min(out.num_buckets_, (blk + 1) * BLOCK);
+                    for (size_t b = blk * BLOCK; b < hi; ++b) {
+                        bucket_bit[b] = block_bits[blk].size();
+                        std::span<const uint64_t> keys{hashes.data() + first[b], first[b + 1] - first[b]};
+                        if (!enc.encode(keys, block_bits[blk])) {
+                            failed.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+                    }
+                }
+            };
+            const size_t workers = std::min(num_threads_, num_blocks);
+            detail::run_workers(workers, worker);
+            if (failed.load()) return false;
+
+            detail::bit_writer trees;
+            for (size_t blk = 0; blk < num_blocks; ++blk) {
+                const uint64_t base = trees.size();
+                const size_t hi = std::min(out.num_buckets_, (blk + 1) * BLOCK);
+                for (size_t b = blk * BLOCK; b < hi; ++b) bucket_bit[b] += base;
+                trees.append(block_bits[blk]);
+                block_bits[blk].clear();
+            }
+            bucket_bit[out.num_buckets_] = trees.size();
+            out.tree_bits_ = std::move(trees).take();
+            out.tree_bits_.push_back(~uint64_t{0});
+
+            std::vector<uint64_t> bucket_first(first.begin(), first.end());
+            out.bucket_keys_ = detail::elias_fano{bucket_first};
+            out.bucket_bits_ = detail::elias_fano{bucket_bit};
+            return true;
         }
 
     public:
@@ -280,81 +686,42 @@ public:
             if (keys_.empty()) {
                 return std::unexpected(error::optimization_failed);
             }
+            const detail::build_recorder rec{report_};
 
-            // Remove duplicates
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
-
-            for (int attempt = 0; attempt < 50; ++attempt) {
-                uint64_t attempt_seed = seed_ ^ (attempt * 0x9e3779b97f4a7c15ULL);
-
-                recsplit_hasher hasher(keys_.size(), attempt_seed);
-
-                // 1. Partition keys into buckets
-                std::vector<std::vector<std::string>> bucket_keys(hasher.num_buckets_);
-                for (const auto& key : keys_) {
-                    size_t bucket_idx = hasher.bucket_for_key(key);
-                    bucket_keys[bucket_idx].push_back(key);
-                }
-
-                // 2. Process buckets (potentially in parallel)
-                std::vector<bucket_result> results(hasher.num_buckets_);
-                bool all_success = true;
-
-                if (num_threads_ > 1 && hasher.num_buckets_ > 100) {
-                    // Parallel processing using std::thread
-                    std::atomic<bool> any_failure{false};
-                    auto process_range = [&](size_t start, size_t end) {
-                        for (size_t i = start; i < end; ++i) {
-                            results[i] = process_bucket(hasher, bucket_keys[i], i);
-                            if (!results[i].success) {
-                                any_failure.store(true, std::memory_order_relaxed);
-                            }
-                        }
-                    };
-
-                    std::vector<std::thread> threads;
-                    size_t buckets_per_thread = (hasher.num_buckets_ + num_threads_ - 1) / num_threads_;
-
-                    for (size_t t = 0; t < num_threads_; ++t) {
-                        size_t start = t * buckets_per_thread;
-                        size_t end = std::min(start + buckets_per_thread, hasher.num_buckets_);
-                        if (start < end) {
-                            threads.emplace_back(process_range, start, end);
-                        }
-                    }
-
-                    for (auto& thread : threads) {
-                        thread.join();
-                    }
+            detail::executor_scope scope{executor_};
 
-                    all_success = !any_failure.load();
-                } else {
-                    // Single-threaded processing
-                    for (size_t bucket_idx = 0; bucket_idx < hasher.num_buckets_; ++bucket_idx) {
-                        results[bucket_idx] = process_bucket(hasher, bucket_keys[bucket_idx], bucket_idx);
-                        if (!results[bucket_idx].success) {
-                            all_success = false;
-                            break;
-                        }
-                    }
-                }
+            // Remove duplicates
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                keys_.dedup(dedup_, num_threads_);
+            }
 
-                if (!all_success) continue;  // Retry with different seed
+            // Digests do not depend on the seed, so every attempt reuses them.
+            const size_t n = keys_.size();
+            std::vector<hash128> digests(n);
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                detail::parallel_chunks(n, detail::effective_threads(n, num_threads_),
+                    [&](size_t, size_t lo, size_t hi) {
+                        phf_hash128_batch(keys_.views().subspan(lo, hi - lo),
+                                          std::span<hash128>(digests).subspan(lo, hi - lo));
+                    });
+            }
 
-                // 3. Compute cumulative offsets (sequential, but O(num_buckets))
-                size_t cumulative_offset = 0;
-                for (size_t bucket_idx = 0; bucket_idx < hasher.num_buckets_; ++bucket_idx) {
-                    hasher.bucket_offsets_[bucket_idx] = cumulative_offset;
-                    hasher.buckets_[bucket_idx].split = results[bucket_idx].split;
-                    hasher.buckets_[bucket_idx].num_keys = results[bucket_idx].num_keys;
-                    cumulative_offset += results[bucket_idx].num_keys;
+            for (int attempt = 0; attempt < 50; ++attempt) {
+                recsplit_hasher out;
+                out.key_count_ = n;
+                out.bucket_size_ = bucket_size_;
+                out.num_buckets_ = (n + bucket_size_ - 1) / bucket_size_;
+                out.base_seed_ = seed_ ^ (static_cast<uint64_t>(attempt) * 0x9e3779b97f4a7c15ULL);
+                rec.attempt(out.base_seed_);
+                if (attempt_build(out, digests)) {
+                    rec.finish(n, out.range_size());
+                    return out;
                 }
-                hasher.bucket_offsets_[hasher.num_buckets_] = cumulative_offset;
-
-                return hasher;
             }
 
+            rec.finish(keys_.size(), 0);
             return std::unexpected(error::optimization_failed);
         }
     };
@@ -380,5 +747,7 @@ make_recsplit(std::span<const std::string> keys, uint64_t seed = 0) {
 // ===== STATIC ASSERTIONS =====
 
 static_assert(perfect_hash_function<recsplit_hasher<8>>);
+static_assert(batched_perfect_hash_function<recsplit_hasher<8>>);
+static_assert(hashed_perfect_hash_function<recsplit_hasher<8>>);
 
 } // namespace maph
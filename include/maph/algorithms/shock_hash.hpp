@@ -6,7 +6,9 @@
  * Walzer 2023-2024). Keys are partitioned into fixed-size buckets; each
  * bucket runs an independent 2-choice cuckoo placement with a seed
  * search. The "choice bit" (which of each key's two hash functions it
- * ended up using) is stored globally via ribbon_retrieval<1>.
+ * ended up using) is stored globally via ribbon_retrieval<1> in the
+ * interleaved layout, so the choice lookup is one popcount over one or
+ * two words and the bits take one bit per row.
  *
  * Space:
  *   - Global seed (64 bits, amortized to zero per key)
@@ -26,6 +28,16 @@
  * some buckets underfill, which means range_size slightly exceeds
  * num_keys (the "tail" of the bucket-size Poisson distribution).
  *
+ * Build: keys are hashed once; every seed trial derives its positions
+ * from the stored digests with one multiply per key. Seeds are tried
+ * in groups of eight: each group's (p1, p2) pairs are computed in one
+ * pass over the bucket, and a seed is rejected on its occupancy bitmap
+ * (fewer distinct slots than keys) or by a union-find pseudoforest test
+ * before the allocation-free cuckoo_orient_fixed runs. Seeds are still
+ * tried in order, so the smallest orientable seed wins as before, and
+ * with_threads(n) spreads buckets over workers. The result is identical
+ * for every thread count.
+ *
  * This is a single-session simplified implementation, not the full
  * paper. The paper further compresses bucket seeds via variable-width
  * coding and achieves ~1.5 bits/key.
@@ -35,13 +47,19 @@
 
 #include "../concepts/perfect_hash_function.hpp"
 #include "../core.hpp"
+#include "../detail/build_report.hpp"
 #include "../detail/cuckoo_orient.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/radix_partition.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 #include "../retrieval/ribbon_retrieval.hpp"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cstddef>
 #include <cstdint>
@@ -52,6 +70,7 @@
 #include <span>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -68,10 +87,14 @@ public:
     // ===== perfect_hash_function interface =====
 
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
-        uint32_t b = bucket_for(key);
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        uint32_t b = bucket_for(hk);
         uint32_t bseed = bucket_seeds_[b];
-        auto [p1, p2] = bucket_positions(key, bseed);
-        uint8_t choice = static_cast<uint8_t>(choices_.lookup(key)) & 1u;
+        auto [p1, p2] = bucket_positions(hk, bseed);
+        uint8_t choice = static_cast<uint8_t>(choices_.lookup(hk)) & 1u;
         uint32_t chosen = (choice == 0) ? p1 : p2;
         return slot_index{static_cast<uint64_t>(b) * bucket_size + chosen};
     }
@@ -96,11 +119,17 @@ public:
                choices_.memory_bytes();
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::allocated_bytes(bucket_seeds_) + choices_.heap_bytes();
+    }
+
     [[nodiscard]] size_t num_buckets() const noexcept { return num_buckets_; }
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::append(out, static_cast<uint32_t>(bucket_size));
+        uint32_t width = static_cast<uint32_t>(bucket_size);
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        phf_serial::append(out, width);
         phf_serial::append(out, global_seed_);
         phf_serial::append(out, static_cast<uint64_t>(num_keys_));
         phf_serial::append(out, static_cast<uint64_t>(num_buckets_));
@@ -116,7 +145,7 @@ public:
         phf_serial::reader reader{bytes};
         uint32_t bsz{};
         uint64_t gseed{}, nkeys{}, nbuckets{};
-        if (!reader.read(bsz) || bsz != bucket_size) {
+        if (!reader.read(bsz) || (bsz & ~WIDE_HASH_FLAG) != bucket_size) {
             return std::unexpected(error::invalid_format);
         }
         if (!reader.read(gseed) || !reader.read(nkeys) || !reader.read(nbuckets)) {
@@ -124,6 +153,7 @@ public:
         }
         shock_hash out;
         out.global_seed_ = gseed;
+        out.hash_rev_ = phf_serial::revision_for_width_field(bsz);
         out.num_keys_ = static_cast<size_t>(nkeys);
         out.num_buckets_ = static_cast<size_t>(nbuckets);
         out.bucket_seeds_.resize(out.num_buckets_);
@@ -136,7 +166,8 @@ public:
         if (!reader.read_span(ribbon_span, static_cast<size_t>(ribbon_len))) {
             return std::unexpected(error::invalid_format);
         }
-        auto r = ribbon_retrieval<1>::deserialize(ribbon_span);
+        // Blobs written before the interleaved layout are converted.
+        auto r = choice_retrieval::deserialize(ribbon_span);
         if (!r) return std::unexpected(r.error());
         out.choices_ = std::move(*r);
         return out;
@@ -145,21 +176,35 @@ public:
     // ===== Builder =====
 
     class builder {
-        std::vector<std::string> keys_{};
+        detail::key_store keys_{};
+        key_dedup dedup_{key_dedup::sort};
         uint64_t global_seed_{0x5a5a'5a5a'5a5a'5a5aULL};
         size_t max_seed_trials_{1 << 20};
         size_t max_global_retries_{16};
         double target_load_factor_{0.0};  // 0 => auto (scales with N)
+        size_t threads_{1};
+        executor* executor_{nullptr};
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
-        builder& add(std::string_view k) { keys_.emplace_back(k); return *this; }
+        builder& add(std::string_view k) { keys_.add(k); return *this; }
         builder& add_all(std::span<const std::string> ks) {
-            keys_.insert(keys_.end(), ks.begin(), ks.end()); return *this;
+            keys_.add_all(ks); return *this;
         }
         builder& add_all(const std::vector<std::string>& ks) {
-            keys_.insert(keys_.end(), ks.begin(), ks.end()); return *this;
+            keys_.add_all(std::span<const std::string>{ks}); return *this;
+        }
+        builder& add_all(std::span<const std::string_view> ks) {
+            keys_.add_all(ks); return *this;
+        }
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> ks) {
+            keys_.borrow_all(ks); return *this;
+        }
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets); return *this;
         }
 
         builder& with_seed(uint64_t s) { global_seed_ = s; return *this; }
@@ -171,9 +216,24 @@ public:
             target_load_factor_ = f; return *this;
         }
 
+        builder& with_dedup(key_dedup mode) { dedup_ = mode; return *this; }
+
+        // Workers for hashing, the per-bucket seed search and the choice
+        // ribbon. 0 = hardware_concurrency, 1 = serial.
+        builder& with_threads(size_t n) { threads_ = n; return *this; }
+        // Search bucket seeds on a shared pool; its size replaces with_threads.
+        builder& with_executor(executor& ex) { executor_ = &ex; return *this; }
+        // See build_report.hpp. Pilots are the bucket seeds, ribbon
+        // retries those of the choice bits.
+        builder& with_report(build_report& report) { report_ = &report; return *this; }
+
         [[nodiscard]] result<shock_hash> build() {
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+            detail::executor_scope scope{executor_};
+            const detail::build_recorder rec{report_};
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                keys_.dedup(dedup_);
+            }
 
             if (keys_.empty()) return std::unexpected(error::optimization_failed);
 
@@ -184,6 +244,22 @@ public:
             double load_factor =
                 target_load_factor_ > 0.0 ? target_load_factor_ : 0.6;
 
+            const size_t threads = executor_ != nullptr ? executor_->size()
+                : threads_ != 0 ? threads_
+                : std::max<size_t>(1u, std::thread::hardware_concurrency());
+
+            // Digests do not depend on the global seed, so every retry
+            // reuses them.
+            std::vector<hash128> digests(keys_.size());
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                detail::parallel_chunks(keys_.size(), detail::effective_threads(keys_.size(), threads),
+                    [&](size_t, size_t lo, size_t hi) {
+                        phf_hash128_batch(keys_.views().subspan(lo, hi - lo),
+                                          std::span<hash128>(digests).subspan(lo, hi - lo));
+                    });
+            }
+
             std::mt19937_64 rng{global_seed_};
             for (size_t retry = 0; retry < max_global_retries_; ++retry) {
                 shock_hash out;
@@ -194,8 +270,10 @@ public:
                 out.num_buckets_ = static_cast<size_t>(
                     std::ceil(static_cast<double>(keys_.size()) / target_load));
                 if (out.num_buckets_ == 0) out.num_buckets_ = 1;
+                rec.attempt(out.global_seed_);
 
-                if (attempt_build(out)) {
+                if (attempt_build(out, digests, threads, rec)) {
+                    rec.finish(out.num_keys_, out.range_size());
                     return out;
                 }
 
@@ -206,79 +284,189 @@ public:
                 load_factor *= 0.9;
                 if (load_factor < 0.25) load_factor = 0.25;
             }
+            rec.finish(keys_.size(), 0);
             return std::unexpected(error::optimization_failed);
         }
 
     private:
-        bool attempt_build(shock_hash& out) {
+        static constexpr uint32_t SEED_GROUP = 8;
+        static constexpr size_t BITMAP_WORDS = (bucket_size + 63) / 64;
+
+        // True when the graph with edges (a[i], b[i]) has at most one
+        // cycle per component, i.e. when cuckoo_orient_fixed can succeed.
+        static bool is_pseudoforest(const uint8_t* a, const uint8_t* b, size_t m) noexcept {
+            std::array<uint8_t, bucket_size> parent;
+            std::array<bool, bucket_size> cyclic{};
+            for (size_t v = 0; v < bucket_size; ++v) parent[v] = static_cast<uint8_t>(v);
+            auto find = [&parent](uint8_t x) {
+                while (parent[x] != x) {
+                    parent[x] = parent[parent[x]];
+                    x = parent[x];
+                }
+                return x;
+            };
+            for (size_t i = 0; i < m; ++i) {
+                const uint8_t ra = find(a[i]);
+                const uint8_t rb = find(b[i]);
+                if (ra == rb) {
+                    if (cyclic[ra]) return false;
+                    cyclic[ra] = true;
+                } else {
+                    if (cyclic[ra] && cyclic[rb]) return false;
+                    parent[ra] = rb;
+                    cyclic[rb] = cyclic[rb] || cyclic[ra];
+                }
+            }
+            return true;
+        }
+
+        // Smallest seed below max_trials whose positions orient, with the
+        // orientation written to choice_bits. Seeds are evaluated
+        // SEED_GROUP at a time: their positions are computed together
+        // (independent multiplies the CPU overlaps) and cheap rejection
+        // runs before cuckoo_orient_fixed.
+        static std::optional<uint32_t>
+        search_seed(std::span<const size_t> bk, std::span<const hash128> digests,
+                    size_t max_trials, std::span<uint8_t> choice_bits) {
+            const size_t m = bk.size();
+            std::array<std::array<uint8_t, bucket_size>, SEED_GROUP> p1, p2;
+            std::array<uint8_t, bucket_size> assignment;
+
+            for (size_t s0 = 0; s0 < max_trials; s0 += SEED_GROUP) {
+                std::array<std::array<uint64_t, BITMAP_WORDS>, SEED_GROUP> cover{};
+                for (size_t i = 0; i < m; ++i) {
+                    const hash128& d = digests[bk[i]];
+                    for (uint32_t l = 0; l < SEED_GROUP; ++l) {
+                        auto [a, b] = shock_hash::positions_from_hash(phf_hash_with_seed(
+                            d, static_cast<uint64_t>(s0 + l) * 0x9e3779b97f4a7c15ULL));
+                        p1[l][i] = static_cast<uint8_t>(a);
+                        p2[l][i] = static_cast<uint8_t>(b);
+                        cover[l][a / 64] |= uint64_t{1} << (a % 64);
+                        cover[l][b / 64] |= uint64_t{1} << (b % 64);
+                    }
+                }
+
+                for (uint32_t l = 0; l < SEED_GROUP && s0 + l < max_trials; ++l) {
+                    size_t covered = 0;
+                    for (uint64_t w : cover[l]) covered += static_cast<size_t>(std::popcount(w));
+                    if (covered < m) continue;
+                    if (!is_pseudoforest(p1[l].data(), p2[l].data(), m)) continue;
+
+                    if (!detail::cuckoo_orient_fixed<bucket_size>(
+                            std::span{p1[l]}.first(m), std::span{p2[l]}.first(m),
+                            std::span{assignment}.first(m))) {
+                        continue;
+                    }
+                    for (size_t i = 0; i < m; ++i) choice_bits[bk[i]] = assignment[i];
+                    return static_cast<uint32_t>(s0 + l);
+                }
+            }
+            return std::nullopt;
+        }
+
+        bool attempt_build(shock_hash& out, std::span<const hash128> digests, size_t threads,
+                           const detail::build_recorder& rec) {
             // 1. Bucket keys.
-            std::vector<std::vector<uint32_t>> bucket_keys(out.num_buckets_);
-            for (uint32_t i = 0; i < keys_.size(); ++i) {
-                uint32_t b = static_cast<uint32_t>(
-                    phf_hash_with_seed(keys_[i], out.global_seed_) % out.num_buckets_);
-                bucket_keys[b].push_back(i);
+            const size_t n = keys_.size();
+            std::vector<uint32_t> bucket_of(n);
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                detail::parallel_chunks(n, detail::effective_threads(n, threads),
+                    [&](size_t, size_t lo, size_t hi) {
+                        for (size_t i = lo; i < hi; ++i) {
+                            bucket_of[i] = static_cast<uint32_t>(
+                                phf_hash_with_seed(digests[i], out.global_seed_) % out.num_buckets_);
+                        }
+                    });
             }
+            auto sorting = rec.time(build_report::phase::sort);
+            detail::bucket_groups buckets(out.num_buckets_, n,
+                [&](size_t i) { return bucket_of[i]; });
+            sorting.stop();
+            rec.scratch(digests.size() * sizeof(hash128) + n * sizeof(uint32_t) + n
+                        + buckets.capacity_bytes());
 
             // Reject if any bucket overflows.
-            for (const auto& bk : bucket_keys) {
-                if (bk.size() > bucket_size) return false;
+            for (size_t b = 0; b < out.num_buckets_; ++b) {
+                if (buckets[b].size() > bucket_size) return false;
             }
 
-            // 2. Per-bucket seed search and cuckoo placement.
+            // 2. Per-bucket seed search and cuckoo placement. Buckets are
+            //    independent; workers claim blocks of them.
             out.bucket_seeds_.assign(out.num_buckets_, 0);
-            std::vector<uint8_t> choice_bits(keys_.size(), 0);
-
-            for (uint32_t b = 0; b < out.num_buckets_; ++b) {
-                const auto& bk = bucket_keys[b];
-                if (bk.empty()) continue;
-
-                bool placed = false;
-                for (uint32_t seed_try = 0;
-                     seed_try < static_cast<uint32_t>(max_seed_trials_);
-                     ++seed_try) {
-                    std::vector<std::pair<uint32_t, uint32_t>> edges;
-                    edges.reserve(bk.size());
-                    for (uint32_t key_idx : bk) {
-                        auto [p1, p2] = shock_hash::positions_for_seed(
-                            keys_[key_idx], seed_try);
-                        edges.emplace_back(p1, p2);
-                    }
-
-                    auto orient = detail::cuckoo_orient(edges, bucket_size);
-                    if (orient.has_value()) {
-                        out.bucket_seeds_[b] = seed_try;
-                        for (size_t i = 0; i < bk.size(); ++i) {
-                            choice_bits[bk[i]] = orient->assignment[i];
+            std::vector<uint8_t> choice_bits(n, 0);
+            constexpr size_t BLOCK = 64;
+            std::atomic<size_t> next_block{0};
+            std::atomic<bool> failed{false};
+            auto worker = [&] {
+                for (;;) {
+                    const size_t lo = next_block.fetch_add(BLOCK, std::memory_order_relaxed);
+                    if (lo >= out.num_buckets_ || failed.load(std::memory_order_relaxed)) return;
+                    const size_t hi = std::min(lo + BLOCK, out.num_buckets_);
+                    for (size_t b = lo; b < hi; ++b) {
+                        const auto bk = buckets[b];
+                        if (bk.empty()) continue;
+                        auto seed = search_seed(bk, digests, max_seed_trials_, choice_bits);
+                        if (!seed) {
+                            failed.store(true, std::memory_order_relaxed);
+                            return;
                         }
-                        placed = true;
-                        break;
+                        out.bucket_seeds_[b] = *seed;
                     }
                 }
-                if (!placed) return false;
+            };
+            const size_t workers = std::min(threads, (out.num_buckets_ + BLOCK - 1) / BLOCK);
+            {
+                auto timed = rec.time(build_report::phase::pilot_search);
+                detail::run_workers(workers, worker);
             }
+            if (failed.load()) return false;
 
             // 3. Build ribbon_retrieval<1> of choice bits keyed by the
             //    original key strings.
-            std::vector<uint8_t> vals(keys_.size());
-            for (size_t i = 0; i < keys_.size(); ++i) {
-                vals[i] = choice_bits[i];
+            auto encoding = rec.time(build_report::phase::encode);
+            typename choice_retrieval::builder rb{};
+            rb.borrow_all(keys_.views(), std::span<const uint8_t>{choice_bits})
+              .with_threads(threads);
+            build_report ribbon;
+            if (rec) rb.with_report(ribbon);
+            auto r = rb.build();
+            if (rec) {
+                rec->ribbon_retries += ribbon.ribbon_retries;
+                rec.scratch(digests.size() * sizeof(hash128) + n + ribbon.peak_scratch_bytes);
             }
-            auto r = typename ribbon_retrieval<1>::builder{}
-                .add_all(std::span<const std::string>{keys_},
-                         std::span<const uint8_t>{vals})
-                .build();
             if (!r) return false;
             out.choices_ = std::move(*r);
+            encoding.stop();
+            if (rec) {
+                uint64_t sum = 0;
+                size_t used = 0;
+                for (size_t b = 0; b < out.num_buckets_; ++b) {
+                    if (buckets[b].empty()) continue;
+                    rec->max_pilot = std::max(rec->max_pilot, out.bucket_seeds_[b]);
+                    sum += out.bucket_seeds_[b];
+                    ++used;
+                }
+                rec->avg_pilot = used == 0 ? 0.0
+                    : static_cast<double>(sum) / static_cast<double>(used);
+            }
             return true;
         }
 
     };
 
     // Shared by builder and the query path.
+    template<typename Key>
     static std::pair<uint32_t, uint32_t>
-    positions_for_seed(std::string_view key, uint32_t seed) noexcept {
-        uint64_t h = phf_hash_with_seed(key,
-            static_cast<uint64_t>(seed) * 0x9e3779b97f4a7c15ULL);
+    positions_for_seed(const Key& key, uint32_t seed,
+                       hash_revision rev = hash_revision::wide) noexcept {
+        return positions_from_hash(phf_hash_with_seed(key,
+            static_cast<uint64_t>(seed) * 0x9e3779b97f4a7c15ULL, rev));
+    }
+
+private:
+    // The two in-bucket positions named by a seeded key hash.
+    static std::pair<uint32_t, uint32_t> positions_from_hash(uint64_t h) noexcept {
         uint64_t h_mixed = h;
         h_mixed ^= h_mixed >> 33;
         h_mixed *= 0xff51afd7ed558ccdULL;
@@ -289,25 +477,28 @@ public:
         return {p1, p2};
     }
 
-private:
     // Bucket assignment: the same formula used by the builder.
-    uint32_t bucket_for(std::string_view key) const noexcept {
+    uint32_t bucket_for(const hashed_key& key) const noexcept {
         return static_cast<uint32_t>(
-            phf_hash_with_seed(key, global_seed_) % num_buckets_);
+            phf_hash_with_seed(key, global_seed_, hash_rev_) % num_buckets_);
     }
 
     std::pair<uint32_t, uint32_t>
-    bucket_positions(std::string_view key, uint32_t bseed) const noexcept {
-        return positions_for_seed(key, bseed);
+    bucket_positions(const hashed_key& key, uint32_t bseed) const noexcept {
+        return positions_for_seed(key, bseed, hash_rev_);
     }
 
+    using choice_retrieval = ribbon_retrieval<1, interleaved_solution>;
+
     uint64_t global_seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
     size_t num_keys_{0};
     size_t num_buckets_{0};
     std::vector<uint32_t> bucket_seeds_{};
-    ribbon_retrieval<1> choices_{};
+    choice_retrieval choices_{};
 };
 
 static_assert(perfect_hash_function<shock_hash<64>>);
+static_assert(hashed_perfect_hash_function<shock_hash<64>>);
 
 } // namespace maph
@@ -0,0 +1,302 @@
+/**
+ * @file static_phf.hpp
+ * @brief Minimal perfect hash functions built at compile time for small
+ *        fixed key sets.
+ *
+ * Protocol keywords, header names, country codes: tables whose keys are
+ * known when the program is compiled. Building a phobic_phf for them at
+ * startup costs time and heap; static_phf<N> is built by the compiler
+ * instead and lives in .rodata:
+ *
+ *   static constexpr auto methods = maph::make_static_phf({
+ *       "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS"});
+ *   methods.slot_for("PUT");   // a constant in [0, 6)
+ *
+ *   static constexpr auto status = maph::make_static_map<int>({
+ *       {"ok", 200}, {"not_found", 404}, {"teapot", 418}});
+ *   if (const int* code = status.find(word)) ...
+ *
+ * The scheme is PHOBIC's with the sizes fixed by N: keys hash (the same
+ * phf_hash128 digest as every other structure; it is constexpr) to one
+ * of ceil(N / 3) buckets, and each bucket's 16-bit pilot sends its keys
+ * to distinct slots of [0, N). Buckets are placed largest first; a
+ * bucket that finds no pilot restarts the search under another seed, up
+ * to 32 seeds. Everything is std::array, so the build runs in constant
+ * evaluation, and with N and the seed constant the query's reductions
+ * compile to multiplies.
+ *
+ * make_static_phf / make_static_map are consteval: duplicate keys, or a
+ * set no seed solves, stop the compilation at a call to
+ * static_table_build_failed(). static_phf<N>::build does the same work
+ * at run time (or in any constexpr context) and returns a result.
+ *
+ * static_map stores its keys, so find() is exact: a non-member gets
+ * nullptr, not another key's value. Keys are views; in a constexpr
+ * table they are string literals and outlive it.
+ *
+ * Space: 16 bits per bucket, about 5.3 bits per key, plus the seed.
+ * Meant for up to a few thousand keys; the compiler's constexpr budget
+ * (-fconstexpr-ops-limit) bounds larger sets.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/pilot_search.hpp"
+#include "../detail/serialization.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+namespace detail {
+
+/// Not constexpr: a consteval table build that reaches it fails to
+/// compile, naming this function. The keys repeat, or no seed solved them.
+inline void static_table_build_failed(error) {}
+
+} // namespace detail
+
+template<size_t N>
+    requires (N >= 1)
+class static_phf {
+public:
+    static constexpr size_t bucket_size_v = 3;
+    static constexpr size_t num_buckets_v = (N + bucket_size_v - 1) / bucket_size_v;
+    static constexpr size_t max_seeds = 32;
+
+    constexpr static_phf() = default;
+
+    // ===== Queries =====
+
+    [[nodiscard]] constexpr slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(phf_hash128(key));
+    }
+
+    [[nodiscard]] constexpr slot_index slot_for(const hashed_key& hk) const noexcept {
+        return slot_for(hk.digest);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] constexpr slot_index slot_for(K key) const noexcept {
+        return slot_for(phf_hash128_int(key));
+    }
+
+    [[nodiscard]] constexpr slot_index slot_for(const hash128& digest) const noexcept {
+        const auto [h1, h2] = hash_digest(digest, seed_);
+        return slot_index{detail::phobic_pilot_mix(h2, pilots_[h1 % num_buckets_v]) % N};
+    }
+
+    // ===== Statistics =====
+
+    [[nodiscard]] constexpr size_t num_keys() const noexcept { return N; }
+    [[nodiscard]] constexpr size_t range_size() const noexcept { return N; }
+    [[nodiscard]] constexpr size_t memory_bytes() const noexcept { return sizeof(*this); }
+    [[nodiscard]] constexpr double bits_per_key() const noexcept {
+        return static_cast<double>(sizeof(*this) * 8) / static_cast<double>(N);
+    }
+    [[nodiscard]] constexpr uint64_t seed() const noexcept { return seed_; }
+
+    // ===== Serialization =====
+
+    /// [u64 N][u64 seed][u16 pilot per bucket]
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        out.reserve(16 + 2 * num_buckets_v);
+        phf_serial::append(out, static_cast<uint64_t>(N));
+        phf_serial::append(out, seed_);
+        for (uint16_t p : pilots_) phf_serial::append(out, p);
+        return out;
+    }
+
+    [[nodiscard]] static result<static_phf> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint64_t n{};
+        static_phf out{};
+        if (!r.read(n) || n != N || !r.read(out.seed_)) return std::unexpected(error::invalid_format);
+        for (auto& p : out.pilots_) {
+            if (!r.read(p)) return std::unexpected(error::invalid_format);
+        }
+        return out;
+    }
+
+    // ===== Build =====
+
+    /// Build over the digests of N distinct keys: duplicate_key if two
+    /// are equal, optimization_failed if no seed places every bucket.
+    [[nodiscard]] static constexpr result<static_phf> build(std::span<const hash128, N> digests) {
+        std::array<hash128, N> sorted{};
+        std::copy(digests.begin(), digests.end(), sorted.begin());
+        std::sort(sorted.begin(), sorted.end(), [](const hash128& a, const hash128& b) {
+            return a.hi != b.hi ? a.hi < b.hi : a.lo < b.lo;
+        });
+        for (size_t i = 1; i < N; ++i) {
+            if (sorted[i] == sorted[i - 1]) return std::unexpected(error::duplicate_key);
+        }
+
+        for (size_t attempt = 0; attempt < max_seeds; ++attempt) {
+            static_phf out{};
+            out.seed_ = phf_remix(0x5bd1e9955bd1e995ULL + attempt);
+            if (out.place(digests)) return out;
+        }
+        return std::unexpected(error::optimization_failed);
+    }
+
+    [[nodiscard]] static constexpr result<static_phf> build(std::span<const std::string_view, N> keys) {
+        std::array<hash128, N> digests{};
+        for (size_t i = 0; i < N; ++i) digests[i] = phf_hash128(keys[i]);
+        return build(std::span<const hash128, N>{digests});
+    }
+
+private:
+    struct dual_hash {
+        uint64_t h1, h2;
+    };
+
+    // phobic_phf's two seeded mixes of the digest.
+    static constexpr dual_hash hash_digest(const hash128& d, uint64_t seed) noexcept {
+        return {detail::wymix(d.lo ^ seed, d.hi ^ 0xbf58476d1ce4e5b9ULL),
+                detail::wymix(d.hi ^ seed, d.lo ^ 0x94d049bb133111ebULL)};
+    }
+
+    // One pilot per bucket under seed_, largest buckets first.
+    constexpr bool place(std::span<const hash128, N> digests) {
+        std::array<uint64_t, N> h2{};
+        std::array<uint32_t, N> bucket{};
+        std::array<uint32_t, num_buckets_v + 1> start{};
+        for (size_t i = 0; i < N; ++i) {
+            const auto h = hash_digest(digests[i], seed_);
+            h2[i] = h.h2;
+            bucket[i] = static_cast<uint32_t>(h.h1 % num_buckets_v);
+            ++start[bucket[i] + 1];
+        }
+        for (size_t b = 0; b < num_buckets_v; ++b) start[b + 1] += start[b];
+        std::array<uint32_t, N> members{};
+        std::array<uint32_t, num_buckets_v> fill{};
+        for (size_t i = 0; i < N; ++i) {
+            members[start[bucket[i]] + fill[bucket[i]]++] = static_cast<uint32_t>(i);
+        }
+
+        std::array<uint32_t, num_buckets_v> order{};
+        for (size_t b = 0; b < num_buckets_v; ++b) order[b] = static_cast<uint32_t>(b);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const uint32_t sa = start[a + 1] - start[a], sb = start[b + 1] - start[b];
+            return sa != sb ? sa > sb : a < b;
+        });
+
+        std::array<bool, N> taken{};
+        std::array<size_t, N> slots{};
+        for (uint32_t b : order) {
+            const size_t lo = start[b], size = start[b + 1] - lo;
+            if (size == 0) break;
+            bool placed = false;
+            for (uint32_t p = 0; p <= 0xffff && !placed; ++p) {
+                placed = true;
+                for (size_t k = 0; k < size && placed; ++k) {
+                    const size_t s = detail::phobic_pilot_mix(h2[members[lo + k]], static_cast<uint16_t>(p)) % N;
+                    if (taken[s]) placed = false;
+                    for (size_t j = 0; j < k && placed; ++j) placed = slots[j] != s;
+                    slots[k] = s;
+                }
+                if (placed) {
+                    pilots_[b] = static_cast<uint16_t>(p);
+                    for (size_t k = 0; k < size; ++k) taken[slots[k]] = true;
+                }
+            }
+            if (!placed) return false;
+        }
+        return true;
+    }
+
+    std::array<uint16_t, num_buckets_v> pilots_{};
+    uint64_t seed_{0};
+};
+
+/**
+ * A static_phf and, per slot, the key that owns it and its value. find()
+ * compares the key, so it answers exactly for any query.
+ */
+template<typename V, size_t N>
+    requires (N >= 1)
+class static_map {
+public:
+    using value_type = V;
+    using entry = std::pair<std::string_view, V>;
+
+    constexpr static_map() = default;
+
+    /// The value of `key`, or nullptr if it is not in the table.
+    [[nodiscard]] constexpr const V* find(std::string_view key) const noexcept {
+        const size_t s = phf_.slot_for(key);
+        return keys_[s] == key ? &values_[s] : nullptr;
+    }
+
+    [[nodiscard]] constexpr bool contains(std::string_view key) const noexcept {
+        return find(key) != nullptr;
+    }
+
+    /// The value of `key`, or `fallback`.
+    [[nodiscard]] constexpr V value_or(std::string_view key, V fallback) const {
+        const V* v = find(key);
+        return v != nullptr ? *v : fallback;
+    }
+
+    [[nodiscard]] constexpr size_t size() const noexcept { return N; }
+    [[nodiscard]] constexpr const static_phf<N>& phf() const noexcept { return phf_; }
+    /// Keys and values in slot order.
+    [[nodiscard]] constexpr const std::array<std::string_view, N>& keys() const noexcept { return keys_; }
+    [[nodiscard]] constexpr const std::array<V, N>& values() const noexcept { return values_; }
+
+    [[nodiscard]] static constexpr result<static_map> build(std::span<const entry, N> entries) {
+        std::array<std::string_view, N> keys{};
+        for (size_t i = 0; i < N; ++i) keys[i] = entries[i].first;
+        auto phf = static_phf<N>::build(std::span<const std::string_view, N>{keys});
+        if (!phf) return std::unexpected(phf.error());
+        static_map out{};
+        out.phf_ = *phf;
+        for (size_t i = 0; i < N; ++i) {
+            const size_t s = out.phf_.slot_for(entries[i].first);
+            out.keys_[s] = entries[i].first;
+            out.values_[s] = entries[i].second;
+        }
+        return out;
+    }
+
+private:
+    static_phf<N> phf_{};
+    std::array<std::string_view, N> keys_{};
+    std::array<V, N> values_{};
+};
+
+/// static_phf over `keys`, built by the compiler.
+template<size_t N>
+[[nodiscard]] consteval static_phf<N> make_static_phf(const std::string_view (&keys)[N]) {
+    auto built = static_phf<N>::build(std::span<const std::string_view, N>{keys});
+    if (!built) detail::static_table_build_failed(built.error());
+    return *built;
+}
+
+template<size_t N>
+[[nodiscard]] consteval static_phf<N> make_static_phf(const std::array<std::string_view, N>& keys) {
+    auto built = static_phf<N>::build(std::span<const std::string_view, N>{keys});
+    if (!built) detail::static_table_build_failed(built.error());
+    return *built;
+}
+
+/// static_map over `entries`, built by the compiler.
+template<typename V, size_t N>
+[[nodiscard]] consteval static_map<V, N> make_static_map(const std::pair<std::string_view, V> (&entries)[N]) {
+    auto built = static_map<V, N>::build(std::span<const std::pair<std::string_view, V>, N>{entries});
+    if (!built) detail::static_table_build_failed(built.error());
+    return *built;
+}
+
+} // namespace maph
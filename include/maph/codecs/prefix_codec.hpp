@@ -27,7 +27,15 @@
  *
  * Lengths must be in [1, M]. Codewords are stored canonically
  * (left-aligned in the M-bit pattern, low-order bits zero) but
- * decoding works for any pattern: it scans for the matching prefix.
+ * decoding works for any pattern.
+ *
+ * Decoding is table-driven. For M <= 12 one table of 2^M entries maps
+ * every pattern to its value. Larger M index a root table by the top 12
+ * bits; a root entry covered by one codeword of length <= 12 answers
+ * directly, the others point to a subtable over the next (at most 12)
+ * bits. Patterns under a codeword longer than 24 bits, whose share of
+ * the codespace is at most 2^-24 each, fall back to a scan of the
+ * entries. decode_batch() decodes a span of patterns.
  */
 
 #pragma once
@@ -39,6 +47,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <random>
+#include <span>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
@@ -99,17 +108,15 @@ public:
     }
 
     [[nodiscard]] V decode(uint64_t pattern) const {
-        uint32_t p = static_cast<uint32_t>(pattern & (alphabet_size - 1));
-        // Linear scan over entries. For small alphabets this is fine
-        // and avoids the complexity of a code tree. Entries are sorted
-        // by descending length so longer codewords match first.
-        for (const auto& e : entries_sorted_by_length_) {
-            uint32_t mask = mask_for_length(e.length);
-            if ((p & mask) == (e.prefix_left_aligned & mask)) {
-                return e.value;
-            }
-        }
-        return default_;
+        if (root_.empty()) return default_;
+        const auto p = static_cast<uint32_t>(pattern & (alphabet_size - 1));
+        return decoded_[decode_index(p)];
+    }
+
+    // out[i] = decode(patterns[i]) over the shorter of the two spans.
+    void decode_batch(std::span<const uint64_t> patterns, std::span<V> out) const {
+        const size_t n = std::min(patterns.size(), out.size());
+        for (size_t i = 0; i < n; ++i) out[i] = decode(patterns[i]);
     }
 
     // Return the canonical pattern (encode result) and the size of v's
@@ -153,8 +160,22 @@ public:
     }
 
 private:
+    // Decode tables. An entry of root_ or sub_ below table_flag is an
+    // index into decoded_ (entries_ in order, then default_). A root
+    // entry with table_flag set holds the offset of its subtable in sub_
+    // and, at subtable_shift, the number of bits that subtable indexes.
+    // scan_entry in a subtable sends the pattern to the linear scan.
+    static constexpr unsigned root_bits = M < 12 ? M : 12;
+    static constexpr unsigned max_sub_bits = 12;
+    static constexpr uint32_t table_flag = 0x80000000u;
+    static constexpr unsigned subtable_shift = 26;
+    static constexpr uint32_t offset_mask = (uint32_t{1} << subtable_shift) - 1;
+    static constexpr uint32_t scan_entry = 0xffffffffu;
+
     std::vector<entry> entries_{};
-    std::vector<entry> entries_sorted_by_length_{};
+    std::vector<V> decoded_{};
+    std::vector<uint32_t> root_{};
+    std::vector<uint32_t> sub_{};
     std::unordered_map<V, size_t> to_entry_{};
     V default_{};
     uint64_t surplus_start_{0};
@@ -166,6 +187,73 @@ private:
                                      << (M - length));
     }
 
+    [[nodiscard]] uint32_t decode_index(uint32_t p) const {
+        const uint32_t r = root_[p >> (M - root_bits)];
+        if ((r & table_flag) == 0) return r;
+        const unsigned bits = (r & ~table_flag) >> subtable_shift;
+        const uint32_t below = p & static_cast<uint32_t>((uint64_t{1} << (M - root_bits)) - 1);
+        const uint32_t s = sub_[(r & offset_mask) + (below >> (M - root_bits - bits))];
+        return s != scan_entry ? s : scan_index(p);
+    }
+
+    // The entry whose codeword prefixes p, by trying every entry from the
+    // longest codeword down.
+    [[nodiscard]] uint32_t scan_index(uint32_t p) const {
+        for (size_t k = entries_.size(); k-- > 0;) {
+            const entry& e = entries_[k];
+            const uint32_t mask = mask_for_length(e.length);
+            if ((p & mask) == (e.prefix_left_aligned & mask)) return static_cast<uint32_t>(k);
+        }
+        return static_cast<uint32_t>(entries_.size());
+    }
+
+    // Codewords are canonical, so entries_ is in codeword order and the
+    // entries under one root prefix are consecutive.
+    void build_tables() {
+        decoded_.clear();
+        decoded_.reserve(entries_.size() + 1);
+        for (const auto& e : entries_) decoded_.push_back(e.value);
+        decoded_.push_back(default_);
+        const auto none = static_cast<uint32_t>(entries_.size());
+
+        constexpr unsigned low_bits = M - root_bits;
+        root_.assign(size_t{1} << root_bits, none);
+        sub_.clear();
+        for (size_t i = 0; i < entries_.size();) {
+            const entry& e = entries_[i];
+            const uint32_t r = e.prefix_left_aligned >> low_bits;
+            if (e.length <= root_bits) {
+                std::fill_n(root_.begin() + r, size_t{1} << (root_bits - e.length),
+                            static_cast<uint32_t>(i));
+                ++i;
+                continue;
+            }
+            // Entries [i, j) share root prefix r; the last is the longest.
+            size_t j = i;
+            while (j < entries_.size() && entries_[j].length > root_bits &&
+                   (entries_[j].prefix_left_aligned >> low_bits) == r) {
+                ++j;
+            }
+            const unsigned bits = std::min(entries_[j - 1].length - root_bits, max_sub_bits);
+            const size_t offset = sub_.size();
+            sub_.resize(offset + (size_t{1} << bits), none);
+            for (size_t k = i; k < j; ++k) {
+                const entry& c = entries_[k];
+                const uint32_t below = c.prefix_left_aligned &
+                    static_cast<uint32_t>((uint64_t{1} << low_bits) - 1);
+                const size_t q = offset + (below >> (low_bits - bits));
+                if (c.length <= root_bits + bits) {
+                    std::fill_n(sub_.begin() + q, size_t{1} << (root_bits + bits - c.length),
+                                static_cast<uint32_t>(k));
+                } else {
+                    sub_[q] = scan_entry;
+                }
+            }
+            root_[r] = table_flag | (bits << subtable_shift) | static_cast<uint32_t>(offset);
+            i = j;
+        }
+    }
+
     [[nodiscard]] double surplus_share() const {
         return static_cast<double>(surplus_count_) / static_cast<double>(alphabet_size);
     }
@@ -220,11 +308,7 @@ private:
             ? alphabet_size - next_code
             : 0;
 
-        // For decode: longest codewords first.
-        entries_sorted_by_length_ = entries_;
-        std::sort(entries_sorted_by_length_.begin(),
-                  entries_sorted_by_length_.end(),
-            [](const entry& a, const entry& b) { return a.length > b.length; });
+        build_tables();
     }
 
     static std::vector<std::pair<V, unsigned>>
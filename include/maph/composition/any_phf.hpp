@@ -0,0 +1,373 @@
+/**
+ * @file any_phf.hpp
+ * @brief Type-erased PHF and retrieval handles chosen at load time.
+ *
+ * Every structure here is a template, so code that loads "whatever PHF
+ * is in this file" has to name the type before it can call deserialize.
+ * any_phf holds any perfect_hash_function behind one virtual interface
+ * and any_phf::deserialize(bytes) picks the concrete type from the bytes:
+ * the algorithm id in the phf_serial header (or in the container header,
+ * for to_container() output) selects the candidates with that
+ * ALGORITHM_ID, and the first whose deserialize accepts the bytes wins.
+ * Formats without a standard header (shock_hash) have id 0 and are tried
+ * when the bytes carry no header. Template parameters a format stores
+ * after its header (bucket size, leaf size, levels) are checked by the
+ * candidate's own deserialize, so phobic4 bytes never load as phobic5.
+ *
+ * The candidates are a phf_types<...> list: default_phf_types names the
+ * usual instantiations, and deserialize<phf_types<...>>(bytes) loads from
+ * a list of the caller's own (a custom Inner for partitioned_phf, say).
+ *
+ * A virtual call per key would cost as much as a phobic query, so the
+ * batch entry points cross the interface once per batch and run the
+ * concrete type's pipelined slot_for_batch (lookup_batch for retrieval)
+ * on the whole span.
+ *
+ * any_retrieval does the same for retrieval structures, widening values
+ * to uint64_t. Retrieval formats are headerless (a leading width field,
+ * not an algorithm id), so every candidate in the list is tried in order.
+ *
+ * Both handles are immutable and share their structure on copy.
+ */
+
+#pragma once
+
+#include "../algorithms/bbhash.hpp"
+#include "../algorithms/chd.hpp"
+#include "../algorithms/fch.hpp"
+#include "../algorithms/phobic.hpp"
+#include "../algorithms/pthash.hpp"
+#include "../algorithms/recsplit.hpp"
+#include "../algorithms/shock_hash.hpp"
+#include "../concepts/perfect_hash_function.hpp"
+#include "../concepts/retrieval.hpp"
+#include "../core.hpp"
+#include "../detail/container.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/serialization.hpp"
+#include "../retrieval/phf_value_array.hpp"
+#include "../retrieval/ribbon_retrieval.hpp"
+#include "partitioned.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+/// Candidate types for any_phf::deserialize / any_retrieval::deserialize.
+template<typename... Ts>
+struct phf_types {};
+
+using default_phf_types = phf_types<
+    phobic5, phobic4, phobic3, phobic7, phobic5_compact,
+    partitioned_phf<phobic5>, partitioned_phf<phobic4>,
+    recsplit8, recsplit16, bbhash3, bbhash5,
+    pthash98, pthash95, pthash98_dictionary,
+    chd_hasher, fch_hasher, shock_hash<64>>;
+
+using default_retrieval_types = phf_types<
+    ribbon_retrieval<1>, ribbon_retrieval<2>, ribbon_retrieval<4>, ribbon_retrieval<8>,
+    ribbon_retrieval<16>, ribbon_retrieval<32>, ribbon_retrieval<64>>;
+
+namespace detail {
+
+/// Algorithm id of serialized bytes: the container's when they are a
+/// container, the phf_serial header's otherwise, 0 when neither. Sets
+/// `container` to whether they were a container.
+[[nodiscard]] inline uint32_t peek_algorithm(std::span<const std::byte> bytes, bool& container) noexcept {
+    container = false;
+    uint64_t cmagic{};
+    if (bytes.size() >= sizeof(container_header)) {
+        std::memcpy(&cmagic, bytes.data(), sizeof(cmagic));
+        if (cmagic == CONTAINER_MAGIC) {
+            container = true;
+            uint32_t algo{};
+            std::memcpy(&algo, bytes.data() + offsetof(container_header, algorithm), sizeof(algo));
+            return algo;
+        }
+    }
+    phf_serial::reader r{bytes};
+    uint32_t magic{}, version{}, algo{};
+    if (!r.read(magic) || magic != PERFECT_HASH_MAGIC) return 0;
+    if (!r.read(version) || version < PERFECT_HASH_MIN_VERSION
+        || version > PERFECT_HASH_VERSION) return 0;
+    if (!r.read(algo)) return 0;
+    return algo;
+}
+
+/// T from `bytes`, raw or as a container.
+template<typename T>
+[[nodiscard]] result<T> load_any(std::span<const std::byte> bytes, bool container) {
+    if (container) return from_container<T>(bytes);
+    return deserialize_as<T>(bytes);
+}
+
+} // namespace detail
+
+class any_phf {
+    struct base {
+        virtual ~base() = default;
+        virtual slot_index slot_for(std::string_view key) const noexcept = 0;
+        virtual slot_index slot_for(const hashed_key& hk) const noexcept = 0;
+        virtual void slot_for_batch(std::span<const std::string_view> keys,
+                                    std::span<slot_index> out) const noexcept = 0;
+        virtual size_t num_keys() const noexcept = 0;
+        virtual size_t range_size() const noexcept = 0;
+        virtual double bits_per_key() const noexcept = 0;
+        virtual size_t memory_bytes() const noexcept = 0;
+        virtual std::vector<std::byte> serialize() const = 0;
+        virtual uint32_t algorithm_id() const noexcept = 0;
+        virtual const std::type_info& type() const noexcept = 0;
+    };
+
+    template<perfect_hash_function P>
+    struct model final : base {
+        P p;
+        explicit model(P&& x) : p(std::move(x)) {}
+
+        slot_index slot_for(std::string_view key) const noexcept override {
+            return slot_index{p.slot_for(key)};
+        }
+        slot_index slot_for(const hashed_key& hk) const noexcept override {
+            return slot_for_hashed(p, hk);
+        }
+        void slot_for_batch(std::span<const std::string_view> keys,
+                            std::span<slot_index> out) const noexcept override {
+            maph::slot_for_batch(p, keys, out);
+        }
+        size_t num_keys() const noexcept override { return p.num_keys(); }
+        size_t range_size() const noexcept override { return p.range_size(); }
+        double bits_per_key() const noexcept override { return p.bits_per_key(); }
+        size_t memory_bytes() const noexcept override { return sizeof(*this) + p.memory_bytes(); }
+        std::vector<std::byte> serialize() const override { return p.serialize(); }
+        uint32_t algorithm_id() const noexcept override { return detail::container_algorithm<P>(); }
+        const std::type_info& type() const noexcept override { return typeid(P); }
+    };
+
+    std::shared_ptr<const base> self_;
+
+    template<typename T, typename... Ts>
+    [[nodiscard]] static result<any_phf> first_of(std::span<const std::byte> bytes,
+                                                  uint32_t algo, bool container) {
+        if (detail::container_algorithm<T>() == algo) {
+            if (auto r = detail::load_any<T>(bytes, container)) return any_phf{std::move(*r)};
+        }
+        if constexpr (sizeof...(Ts) > 0) {
+            return first_of<Ts...>(bytes, algo, container);
+        } else {
+            return std::unexpected(error::invalid_format);
+        }
+    }
+
+    template<typename... Ts>
+    [[nodiscard]] static result<any_phf> load(std::span<const std::byte> bytes, phf_types<Ts...>) {
+        bool container = false;
+        const uint32_t algo = detail::peek_algorithm(bytes, container);
+        return first_of<Ts...>(bytes, algo, container);
+    }
+
+public:
+    /// Empty: has_value() is false and no query may be made.
+    any_phf() = default;
+
+    template<perfect_hash_function P>
+        requires (!std::same_as<std::remove_cvref_t<P>, any_phf>)
+    explicit any_phf(P phf) : self_(std::make_shared<const model<P>>(std::move(phf))) {}
+
+    /// Load serialize() or to_container() bytes of any type in Types.
+    /// invalid_format when none accepts them.
+    template<typename Types = default_phf_types>
+    [[nodiscard]] static result<any_phf> deserialize(std::span<const std::byte> bytes) {
+        return load(bytes, Types{});
+    }
+
+    [[nodiscard]] bool has_value() const noexcept { return self_ != nullptr; }
+
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return self_->slot_for(key);
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        return self_->slot_for(hk);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return self_->slot_for(hashed_key{key});
+    }
+
+    /// One indirect call for the whole batch.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        self_->slot_for_batch(keys, out);
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return self_ ? self_->num_keys() : 0; }
+    [[nodiscard]] size_t range_size() const noexcept { return self_ ? self_->range_size() : 0; }
+    [[nodiscard]] double bits_per_key() const noexcept { return self_ ? self_->bits_per_key() : 0.0; }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return sizeof(*this) + (self_ ? self_->memory_bytes() : 0);
+    }
+
+    /// The held structure's own serialize() bytes.
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return self_ ? self_->serialize() : std::vector<std::byte>{};
+    }
+
+    /// ALGORITHM_ID of the held type, 0 for one without.
+    [[nodiscard]] uint32_t algorithm_id() const noexcept { return self_ ? self_->algorithm_id() : 0; }
+
+    [[nodiscard]] const std::type_info& type() const noexcept {
+        return self_ ? self_->type() : typeid(void);
+    }
+
+    /// The held structure if it is a P, nullptr otherwise.
+    template<typename P>
+    [[nodiscard]] const P* target() const noexcept {
+        if (!self_ || self_->type() != typeid(P)) return nullptr;
+        return &static_cast<const model<P>*>(self_.get())->p;
+    }
+};
+
+static_assert(batched_perfect_hash_function<any_phf>);
+static_assert(hashed_perfect_hash_function<any_phf>);
+
+class any_retrieval {
+public:
+    using value_type = uint64_t;
+
+private:
+    struct base {
+        virtual ~base() = default;
+        virtual value_type lookup(std::string_view key) const noexcept = 0;
+        virtual value_type lookup(const hashed_key& hk) const noexcept = 0;
+        virtual void lookup_batch(std::span<const std::string_view> keys,
+                                  std::span<value_type> out) const noexcept = 0;
+        virtual size_t num_keys() const noexcept = 0;
+        virtual size_t value_bits() const noexcept = 0;
+        virtual double bits_per_key() const noexcept = 0;
+        virtual size_t memory_bytes() const noexcept = 0;
+        virtual std::vector<std::byte> serialize() const = 0;
+        virtual const std::type_info& type() const noexcept = 0;
+    };
+
+    template<retrieval R>
+    struct model final : base {
+        using inner_value = typename R::value_type;
+        R r;
+        explicit model(R&& x) : r(std::move(x)) {}
+
+        value_type lookup(std::string_view key) const noexcept override {
+            return static_cast<value_type>(r.lookup(key));
+        }
+        value_type lookup(const hashed_key& hk) const noexcept override {
+            return static_cast<value_type>(lookup_hashed(r, hk));
+        }
+        void lookup_batch(std::span<const std::string_view> keys,
+                          std::span<value_type> out) const noexcept override {
+            const size_t n = std::min(keys.size(), out.size());
+            if constexpr (requires(std::span<inner_value> o) { r.lookup_batch(keys, o); }) {
+                // The structure's own batch into a window of its value
+                // type, widened afterwards.
+                constexpr size_t BW = 64;
+                inner_value buf[BW];
+                for (size_t base_i = 0; base_i < n; base_i += BW) {
+                    const size_t m = std::min(BW, n - base_i);
+                    r.lookup_batch(keys.subspan(base_i, m), std::span<inner_value>{buf, m});
+                    for (size_t i = 0; i < m; ++i) out[base_i + i] = static_cast<value_type>(buf[i]);
+                }
+            } else {
+                for (size_t i = 0; i < n; ++i) out[i] = static_cast<value_type>(r.lookup(keys[i]));
+            }
+        }
+        size_t num_keys() const noexcept override { return r.num_keys(); }
+        size_t value_bits() const noexcept override { return r.value_bits(); }
+        double bits_per_key() const noexcept override { return r.bits_per_key(); }
+        size_t memory_bytes() const noexcept override { return sizeof(*this) + r.memory_bytes(); }
+        std::vector<std::byte> serialize() const override { return r.serialize(); }
+        const std::type_info& type() const noexcept override { return typeid(R); }
+    };
+
+    std::shared_ptr<const base> self_;
+
+    template<typename T, typename... Ts>
+    [[nodiscard]] static result<any_retrieval> first_of(std::span<const std::byte> bytes, bool container) {
+        if (auto r = detail::load_any<T>(bytes, container)) return any_retrieval{std::move(*r)};
+        if constexpr (sizeof...(Ts) > 0) {
+            return first_of<Ts...>(bytes, container);
+        } else {
+            return std::unexpected(error::invalid_format);
+        }
+    }
+
+    template<typename... Ts>
+    [[nodiscard]] static result<any_retrieval> load(std::span<const std::byte> bytes, phf_types<Ts...>) {
+        bool container = false;
+        (void)detail::peek_algorithm(bytes, container);
+        return first_of<Ts...>(bytes, container);
+    }
+
+public:
+    any_retrieval() = default;
+
+    template<retrieval R>
+        requires (!std::same_as<std::remove_cvref_t<R>, any_retrieval>
+                  && std::convertible_to<typename R::value_type, uint64_t>)
+    explicit any_retrieval(R r) : self_(std::make_shared<const model<R>>(std::move(r))) {}
+
+    /// Load serialize() or to_container() bytes of the first type in Types
+    /// that accepts them.
+    template<typename Types = default_retrieval_types>
+    [[nodiscard]] static result<any_retrieval> deserialize(std::span<const std::byte> bytes) {
+        return load(bytes, Types{});
+    }
+
+    [[nodiscard]] bool has_value() const noexcept { return self_ != nullptr; }
+
+    [[nodiscard]] value_type lookup(std::string_view key) const noexcept { return self_->lookup(key); }
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept { return self_->lookup(hk); }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept { return self_->lookup(hashed_key{key}); }
+
+    /// One indirect call for the whole batch.
+    void lookup_batch(std::span<const std::string_view> keys, std::span<value_type> out) const noexcept {
+        self_->lookup_batch(keys, out);
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return self_ ? self_->num_keys() : 0; }
+    [[nodiscard]] size_t value_bits() const noexcept { return self_ ? self_->value_bits() : 0; }
+    [[nodiscard]] double bits_per_key() const noexcept { return self_ ? self_->bits_per_key() : 0.0; }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return sizeof(*this) + (self_ ? self_->memory_bytes() : 0);
+    }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return self_ ? self_->serialize() : std::vector<std::byte>{};
+    }
+
+    [[nodiscard]] const std::type_info& type() const noexcept {
+        return self_ ? self_->type() : typeid(void);
+    }
+
+    template<typename R>
+    [[nodiscard]] const R* target() const noexcept {
+        if (!self_ || self_->type() != typeid(R)) return nullptr;
+        return &static_cast<const model<R>*>(self_.get())->r;
+    }
+};
+
+static_assert(hashed_retrieval<any_retrieval>);
+
+} // namespace maph
@@ -0,0 +1,466 @@
+/**
+ * @file auto_builder.hpp
+ * @brief Pick the PHF or retrieval structure, and its parameters, for a
+ *        space / query / build-time budget by calibrating on a sample.
+ *
+ * bench_phf_sweep and bench_partitioned_algos show that the best of
+ * PHOBIC's bucket size, RecSplit's leaf size, BBHash's levels, PTHash's
+ * load factor or a partitioned build's shard size depends on n, the key
+ * lengths and what is being optimized. auto_builder runs that sweep on
+ * the caller's own keys:
+ *
+ *   tuning_report report;
+ *   auto phf = maph::auto_builder{}
+ *       .add_all(keys)
+ *       .with_max_bits_per_key(3.0)
+ *       .with_max_build_seconds(20.0)
+ *       .with_goal(tuning_goal::query)
+ *       .with_report(report)
+ *       .build();                     // result<any_phf>
+ *
+ * build() takes an evenly spaced sample of the keys (with_sample_size,
+ * default 2^16), builds every candidate on it, and measures three things:
+ *
+ *   bits_per_key   of the sample structure;
+ *   query_ns       mean slot_for() over the sample keys in shuffled
+ *                  order, best of three passes;
+ *   build_seconds  the sample build's wall time scaled by n / sample.
+ *
+ * Non-minimal candidates (shock_hash, whose range exceeds n) are left
+ * out unless with_minimal(false) admits them; a value array over them
+ * needs a slot per range element, which their bits_per_key omits.
+ *
+ * The candidates within every limit are ranked by the goal (fastest
+ * query, fewest bits, or fastest build) and the best one is built over
+ * all keys; if that build fails the next one is tried. No candidate
+ * within the limits is error::optimization_failed, and the report says
+ * how far each one missed.
+ *
+ * The sample structure is smaller than the full one, so query_ns ranks
+ * candidates by their work per key and understates the cache misses a
+ * structure far larger than the cache adds; with_sample_size(n)
+ * calibrates on every key at the cost of building each candidate in
+ * full. Every default candidate is one of default_phf_types, so the
+ * result's serialize() bytes load back with any_phf::deserialize.
+ *
+ * Calibration builds every candidate once, several seconds in all for
+ * the default 2^16 sample keys. Left out of the defaults for that reason
+ * are recsplit<16> (minutes per 2^16 keys) and phobic<7> (half a minute,
+ * then a failed pilot search on 2^16 random keys). with_options() takes
+ * a caller's own list, built from detail::build_phf_option<P> and its
+ * siblings.
+ *
+ * auto_retrieval_builder<M> does the same for key -> M-bit value maps
+ * (ribbon_retrieval in both layouts, phf_value_array over several PHFs)
+ * and returns an any_retrieval.
+ */
+
+#pragma once
+
+#include "../algorithms/bbhash.hpp"
+#include "../algorithms/chd.hpp"
+#include "../algorithms/fch.hpp"
+#include "../algorithms/phobic.hpp"
+#include "../algorithms/pthash.hpp"
+#include "../algorithms/recsplit.hpp"
+#include "../algorithms/shock_hash.hpp"
+#include "../core.hpp"
+#include "../detail/key_store.hpp"
+#include "../retrieval/phf_value_array.hpp"
+#include "../retrieval/ribbon_retrieval.hpp"
+#include "any_phf.hpp"
+#include "partitioned.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace maph {
+
+/// What auto_builder ranks the candidates within the limits by.
+enum class tuning_goal : uint8_t {
+    query,  ///< lowest query_ns (default)
+    space,  ///< fewest bits_per_key
+    build,  ///< shortest projected build
+};
+
+/// One calibrated candidate.
+struct tuning_candidate {
+    std::string_view name{};
+    double bits_per_key{0};
+    double query_ns{0};
+    double build_seconds{0};  // projected to the full key set
+    bool built{false};        // the sample build succeeded
+    bool minimal{true};       // range_size() == num_keys()
+    bool fits{false};         // built, and within every limit
+};
+
+struct tuning_report {
+    std::vector<tuning_candidate> candidates{};
+    size_t sample_keys{0};
+    size_t keys{0};
+    /// Index into candidates of the structure returned, or SIZE_MAX.
+    size_t chosen{SIZE_MAX};
+    double calibration_seconds{0};
+};
+
+namespace detail {
+
+struct tuning_limits {
+    double max_bits_per_key{std::numeric_limits<double>::infinity()};
+    double max_query_ns{std::numeric_limits<double>::infinity()};
+    double max_build_seconds{std::numeric_limits<double>::infinity()};
+    tuning_goal goal{tuning_goal::query};
+    bool minimal{true};
+    size_t sample_size{size_t{1} << 16};
+    size_t threads{1};
+    uint64_t seed{42};
+};
+
+// A candidate's build over (keys, values); values is empty for a PHF.
+template<typename Handle>
+struct tuning_option {
+    std::string_view name;
+    result<Handle> (*build)(std::span<const std::string_view> keys,
+                            std::span<const uint64_t> values, const tuning_limits& limits);
+};
+
+template<typename B>
+void apply_tuning(B& b, const tuning_limits& limits) {
+    if constexpr (requires { b.with_seed(limits.seed); }) b.with_seed(limits.seed);
+    if constexpr (requires { b.with_threads(limits.threads); }) b.with_threads(limits.threads);
+}
+
+template<typename P>
+result<any_phf> build_phf_option(std::span<const std::string_view> keys,
+                                 std::span<const uint64_t>, const tuning_limits& limits) {
+    typename P::builder b;
+    b.borrow_all(keys);
+    apply_tuning(b, limits);
+    auto built = b.build();
+    if (!built) return std::unexpected(built.error());
+    return any_phf{std::move(*built)};
+}
+
+// partitioned_phf with shards of about KeysPerShard keys, so the shard
+// count chosen on the sample scales with the key set.
+template<typename Inner, size_t KeysPerShard>
+result<any_phf> build_partitioned_option(std::span<const std::string_view> keys,
+                                         std::span<const uint64_t>, const tuning_limits& limits) {
+    typename partitioned_phf<Inner>::builder b;
+    b.borrow_all(keys).with_shards(std::max<size_t>(1, keys.size() / KeysPerShard));
+    apply_tuning(b, limits);
+    auto built = b.build();
+    if (!built) return std::unexpected(built.error());
+    return any_phf{std::move(*built)};
+}
+
+template<typename R>
+result<any_retrieval> build_retrieval_option(std::span<const std::string_view> keys,
+                                             std::span<const uint64_t> values,
+                                             const tuning_limits& limits) {
+    using value_type = typename R::value_type;
+    std::vector<value_type> narrow(values.size());
+    std::transform(values.begin(), values.end(), narrow.begin(),
+                   [](uint64_t v) { return static_cast<value_type>(v); });
+    typename R::builder b;
+    b.borrow_all(keys, narrow);
+    apply_tuning(b, limits);
+    auto built = b.build();
+    if (!built) return std::unexpected(built.error());
+    return any_retrieval{std::move(*built)};
+}
+
+inline double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Mean ns of query(key) over `probes`, best of three passes of at least
+// 2^17 queries each.
+template<typename Query>
+double time_queries(std::span<const std::string_view> probes, Query&& query) {
+    if (probes.empty()) return 0.0;
+    const size_t rounds = std::max<size_t>(1, (size_t{1} << 17) / probes.size());
+    uint64_t sink = 0;
+    double best = std::numeric_limits<double>::infinity();
+    for (int pass = 0; pass < 3; ++pass) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; ++r) {
+            for (auto k : probes) sink += query(k);
+        }
+        best = std::min(best, seconds_since(t0) * 1e9 / static_cast<double>(rounds * probes.size()));
+    }
+    volatile uint64_t keep = sink;
+    (void)keep;
+    return best;
+}
+
+// Calibrate every option on a sample, then build the best one that fits
+// over all keys.
+template<typename Handle, typename Query>
+result<Handle> tune(std::span<const tuning_option<Handle>> options,
+                    std::span<const std::string_view> keys, std::span<const uint64_t> values,
+                    const tuning_limits& limits, tuning_report* report, Query&& query) {
+    const size_t n = keys.size();
+    if (n == 0) return std::unexpected(error::optimization_failed);
+    const auto t0 = std::chrono::steady_clock::now();
+
+    // Evenly spaced, so sorted or clustered input is sampled across its range.
+    const size_t m = std::clamp<size_t>(limits.sample_size, 1, n);
+    std::vector<std::string_view> sample(m);
+    std::vector<uint64_t> sample_values(values.empty() ? 0 : m);
+    for (size_t i = 0; i < m; ++i) {
+        const size_t j = static_cast<size_t>(static_cast<__uint128_t>(i) * n / m);
+        sample[i] = keys[j];
+        if (!values.empty()) sample_values[i] = values[j];
+    }
+    std::vector<std::string_view> probes = sample;
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64{limits.seed});
+
+    std::vector<tuning_candidate> rows(options.size());
+    for (size_t c = 0; c < options.size(); ++c) {
+        tuning_candidate& row = rows[c];
+        row.name = options[c].name;
+        const auto start = std::chrono::steady_clock::now();
+        auto built = options[c].build(sample, sample_values, limits);
+        const double elapsed = seconds_since(start);
+        if (!built) continue;
+        row.built = true;
+        row.build_seconds = elapsed * static_cast<double>(n) / static_cast<double>(m);
+        row.bits_per_key = built->bits_per_key();
+        row.query_ns = time_queries(probes, [&](std::string_view k) { return query(*built, k); });
+        if constexpr (requires { built->range_size(); }) {
+            row.minimal = built->range_size() == built->num_keys();
+        }
+        row.fits = (row.minimal || !limits.minimal) &&
+                   row.bits_per_key <= limits.max_bits_per_key &&
+                   row.query_ns <= limits.max_query_ns &&
+                   row.build_seconds <= limits.max_build_seconds;
+    }
+
+    auto score = [&](const tuning_candidate& row) {
+        switch (limits.goal) {
+            case tuning_goal::space: return row.bits_per_key;
+            case tuning_goal::build: return row.build_seconds;
+            case tuning_goal::query: break;
+        }
+        return row.query_ns;
+    };
+    std::vector<size_t> order;
+    for (size_t c = 0; c < rows.size(); ++c) {
+        if (rows[c].fits) order.push_back(c);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return score(rows[a]) < score(rows[b]); });
+
+    result<Handle> out = std::unexpected(error::optimization_failed);
+    size_t chosen = SIZE_MAX;
+    for (size_t c : order) {
+        out = options[c].build(keys, values, limits);
+        if (out) {
+            chosen = c;
+            break;
+        }
+    }
+    if (report != nullptr) {
+        report->candidates = std::move(rows);
+        report->sample_keys = m;
+        report->keys = n;
+        report->chosen = chosen;
+        report->calibration_seconds = seconds_since(t0);
+    }
+    return out;
+}
+
+// Builder knobs shared by auto_builder and auto_retrieval_builder.
+template<typename Self>
+class tuning_knobs {
+protected:
+    tuning_limits limits_{};
+    tuning_report* report_{nullptr};
+
+    Self& self() { return static_cast<Self&>(*this); }
+
+public:
+    Self& with_max_bits_per_key(double b) { limits_.max_bits_per_key = b; return self(); }
+    Self& with_max_query_ns(double ns) { limits_.max_query_ns = ns; return self(); }
+    /// Projected wall time of the final build, calibration not included.
+    Self& with_max_build_seconds(double s) { limits_.max_build_seconds = s; return self(); }
+    Self& with_goal(tuning_goal g) { limits_.goal = g; return self(); }
+    /// Admit non-minimal PHFs (shock_hash), whose range exceeds the keys.
+    Self& with_minimal(bool m) { limits_.minimal = m; return self(); }
+    /// Keys each candidate is calibrated on; at least 1.
+    Self& with_sample_size(size_t m) { limits_.sample_size = std::max<size_t>(1, m); return self(); }
+    /// Threads for every build, calibration and final.
+    Self& with_threads(size_t n) { limits_.threads = n; return self(); }
+    Self& with_seed(uint64_t s) { limits_.seed = s; return self(); }
+    Self& with_report(tuning_report& r) { report_ = &r; return self(); }
+};
+
+} // namespace detail
+
+/**
+ * Builds the any_phf that best meets the limits; see the file comment.
+ */
+class auto_builder : public detail::tuning_knobs<auto_builder> {
+public:
+    using option = detail::tuning_option<any_phf>;
+
+private:
+    detail::key_store keys_{};
+    std::span<const option> options_{options()};
+
+public:
+    /// The default candidates, in the order they are calibrated.
+    [[nodiscard]] static std::span<const option> options() noexcept {
+        static constexpr option table[] = {
+            {"phobic<3>", &detail::build_phf_option<phobic3>},
+            {"phobic<4>", &detail::build_phf_option<phobic4>},
+            {"phobic<5>", &detail::build_phf_option<phobic5>},
+            {"phobic<5, compact>", &detail::build_phf_option<phobic5_compact>},
+            {"partitioned<phobic<5>>/8k", &detail::build_partitioned_option<phobic5, 8192>},
+            {"partitioned<phobic<5>>/32k", &detail::build_partitioned_option<phobic5, 32768>},
+            {"partitioned<phobic<4>>/32k", &detail::build_partitioned_option<phobic4, 32768>},
+            {"pthash<0.98>", &detail::build_phf_option<pthash98>},
+            {"pthash<0.95>", &detail::build_phf_option<pthash95>},
+            {"pthash<0.98, dictionary>", &detail::build_phf_option<pthash98_dictionary>},
+            {"recsplit<8>", &detail::build_phf_option<recsplit8>},
+            {"bbhash<3>", &detail::build_phf_option<bbhash3>},
+            {"bbhash<5>", &detail::build_phf_option<bbhash5>},
+            {"chd", &detail::build_phf_option<chd_hasher>},
+            {"fch", &detail::build_phf_option<fch_hasher>},
+            {"shock_hash<64>", &detail::build_phf_option<shock_hash<64>>},
+        };
+        return table;
+    }
+
+    /// Calibrate these instead; the span must outlive build().
+    auto_builder& with_options(std::span<const option> o) {
+        options_ = o;
+        return *this;
+    }
+
+    auto_builder& add(std::string_view key) {
+        keys_.add(key);
+        return *this;
+    }
+
+    auto_builder& add_all(std::span<const std::string> keys) {
+        keys_.add_all(keys);
+        return *this;
+    }
+
+    auto_builder& add_all(const std::vector<std::string>& keys) {
+        keys_.add_all(std::span<const std::string>{keys});
+        return *this;
+    }
+
+    auto_builder& add_all(std::span<const std::string_view> keys) {
+        keys_.add_all(keys);
+        return *this;
+    }
+
+    // See key_store::borrow_all.
+    auto_builder& borrow_all(std::span<const std::string_view> keys) {
+        keys_.borrow_all(keys);
+        return *this;
+    }
+
+    [[nodiscard]] result<any_phf> build() {
+        keys_.dedup(key_dedup::sort, limits_.threads);
+        return detail::tune<any_phf>(options_, keys_.views(), {}, limits_, report_,
+            [](const any_phf& p, std::string_view k) { return p.slot_for(k).value; });
+    }
+};
+
+/**
+ * Builds the any_retrieval of M-bit values that best meets the limits.
+ * Values are masked to M bits; the last value added for a key wins.
+ */
+template<unsigned M>
+    requires (M >= 1 && M <= 64)
+class auto_retrieval_builder : public detail::tuning_knobs<auto_retrieval_builder<M>> {
+public:
+    using option = detail::tuning_option<any_retrieval>;
+
+private:
+    detail::key_store keys_{};
+    std::vector<uint64_t> values_{};
+    std::span<const option> options_{options()};
+
+    static constexpr uint64_t mask_ = M == 64 ? ~uint64_t{0} : (uint64_t{1} << M) - 1;
+
+public:
+    /// The default candidates, in the order they are calibrated.
+    [[nodiscard]] static std::span<const option> options() noexcept {
+        static constexpr option table[] = {
+            {"ribbon", &detail::build_retrieval_option<ribbon_retrieval<M>>},
+            {"ribbon, interleaved",
+             &detail::build_retrieval_option<ribbon_retrieval<M, interleaved_solution>>},
+            {"phf_value_array<phobic<3>>", &detail::build_retrieval_option<phf_value_array<phobic3, M>>},
+            {"phf_value_array<phobic<5>>", &detail::build_retrieval_option<phf_value_array<phobic5, M>>},
+            {"phf_value_array<pthash<0.98>>", &detail::build_retrieval_option<phf_value_array<pthash98, M>>},
+            {"phf_value_array<partitioned<phobic<5>>>",
+             &detail::build_retrieval_option<phf_value_array<partitioned_phf<phobic5>, M>>},
+        };
+        return table;
+    }
+
+    /// Calibrate these instead; the span must outlive build().
+    auto_retrieval_builder& with_options(std::span<const option> o) {
+        options_ = o;
+        return *this;
+    }
+
+    auto_retrieval_builder& add(std::string_view key, uint64_t value) {
+        keys_.add(key);
+        values_.push_back(value & mask_);
+        return *this;
+    }
+
+    auto_retrieval_builder& add_all(std::span<const std::string> keys, std::span<const uint64_t> values) {
+        const size_t n = std::min(keys.size(), values.size());
+        keys_.add_all(keys.first(n));
+        for (uint64_t v : values.first(n)) values_.push_back(v & mask_);
+        return *this;
+    }
+
+    // See key_store::borrow_all.
+    auto_retrieval_builder& borrow_all(std::span<const std::string_view> keys,
+                                       std::span<const uint64_t> values) {
+        const size_t n = std::min(keys.size(), values.size());
+        keys_.borrow_all(keys.first(n));
+        for (uint64_t v : values.first(n)) values_.push_back(v & mask_);
+        return *this;
+    }
+
+    [[nodiscard]] result<any_retrieval> build() {
+        // The last value of a repeated key, in key order.
+        const auto all = keys_.views();
+        std::vector<size_t> order(all.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return all[a] < all[b]; });
+        std::vector<std::string_view> keys;
+        std::vector<uint64_t> values;
+        keys.reserve(order.size());
+        values.reserve(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && all[order[i]] == all[order[i + 1]]) continue;
+            keys.push_back(all[order[i]]);
+            values.push_back(values_[order[i]]);
+        }
+        return detail::tune<any_retrieval>(options_, keys, values, this->limits_, this->report_,
+            [](const any_retrieval& r, std::string_view k) { return r.lookup(k); });
+    }
+};
+
+} // namespace maph
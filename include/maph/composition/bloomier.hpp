@@ -25,6 +25,11 @@
  * Query: oracle.verify cost + (on hit) retrieval.lookup cost
  * FPR:   oracle's FPR. On FP, caller gets some value (not the "right" one).
  *
+ * lookup_interleaved() keeps G lookups in flight (detail/amac.hpp). Each
+ * prefetches its key, then starts the oracle and the retrieval together,
+ * stepping both through their prefetches, and finishes as soon as the
+ * oracle rejects.
+ *
  * This is explicitly the *approximate-map* path, distinct from the pure
  * retrieval path used by cipher maps. Cipher maps want GIGO (no None)
  * because an oracle leaks membership; approximate maps want None
@@ -33,10 +38,18 @@
 
 #pragma once
 
+#include "../concepts/membership_oracle.hpp"
 #include "../concepts/retrieval.hpp"
 #include "../core.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/container.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 
+#include <algorithm>
 #include <array>
 #include <bit>
 #include <cstddef>
@@ -46,6 +59,7 @@
 #include <span>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -66,10 +80,75 @@ public:
 
     // The approximate-map query. Returns nullopt when the oracle
     // rejects; otherwise returns the retrieval's value (exact for
-    // members, arbitrary for false-positive non-members).
+    // members, arbitrary for false-positive non-members). The key is
+    // hashed once and the digest shared by oracle and retrieval.
     [[nodiscard]] std::optional<value_type> lookup(std::string_view key) const {
-        if (!o_.verify(key)) return std::nullopt;
-        return r_.lookup(key);
+        return lookup(hashed_key{key});
+    }
+
+    [[nodiscard]] std::optional<value_type> lookup(const hashed_key& hk) const {
+        if (!verify_hashed(o_, hk)) return std::nullopt;
+        return lookup_hashed(r_, hk);
+    }
+
+    // Interleaved lookup(): G lookups in flight, out[i] = lookup(keys[i]).
+    template <size_t G = detail::interleave_group>
+    void lookup_interleaved(std::span<const std::string_view> keys,
+                            std::span<std::optional<value_type>> out) const {
+        lookup_interleaved<G>(keys.first(std::min(keys.size(), out.size())),
+                              [out](size_t i, std::optional<value_type> v) { out[i] = v; });
+    }
+
+    /// fn(i, lookup(keys[i])) for every i, in completion order.
+    template <size_t G = detail::interleave_group, typename Fn>
+        requires std::invocable<Fn&, size_t, std::optional<value_type>>
+    void lookup_interleaved(std::span<const std::string_view> keys, Fn&& fn) const {
+        struct in_flight {
+            detail::lookup_cursor oracle{};
+            detail::lookup_cursor retrieval{};
+            std::optional<value_type> value{};
+            bool oracle_done{false};
+        };
+        detail::interleave<G, in_flight>(
+            keys.size(),
+            [&](size_t i, in_flight& f) {
+                f = in_flight{};
+                f.oracle.hk.key = keys[i];
+                detail::prefetch_read(keys[i].data());
+            },
+            [&](size_t i, in_flight& f) {
+                if (!f.oracle.hashed) {
+                    f.oracle.hashed = true;
+                    f.oracle.hk = hashed_key{f.oracle.hk.key};
+                    f.retrieval.hk = f.oracle.hk;
+                    detail::stage_start(o_, f.oracle);
+                    detail::stage_start(r_, f.retrieval);
+                    return false;
+                }
+                if (!f.oracle_done) {
+                    f.oracle_done = detail::value_step(
+                        o_, f.oracle, [&] { return verify_hashed(o_, f.oracle.hk); });
+                }
+                if (f.oracle_done && f.oracle.value == 0) {
+                    fn(i, std::optional<value_type>{});
+                    return true;
+                }
+                if (!f.value) {
+                    // Staged retrievals hold integer values in the cursor;
+                    // the rest (encoded_retrieval's logical values) resolve
+                    // directly after their prefetch.
+                    if constexpr (detail::staged_lookup<Retrieval>) {
+                        if (r_.lookup_step(f.retrieval)) {
+                            f.value = static_cast<value_type>(f.retrieval.value);
+                        }
+                    } else {
+                        f.value = lookup_hashed(r_, f.retrieval.hk);
+                    }
+                }
+                if (!f.oracle_done || !f.value) return false;
+                fn(i, std::move(f.value));
+                return true;
+            });
     }
 
     // Convenience: just the membership check, no value.
@@ -77,6 +156,10 @@ public:
         return o_.verify(key);
     }
 
+    [[nodiscard]] bool contains(const hashed_key& hk) const {
+        return verify_hashed(o_, hk);
+    }
+
     [[nodiscard]] size_t num_keys() const noexcept { return r_.num_keys(); }
     [[nodiscard]] size_t value_bits() const noexcept { return r_.value_bits(); }
 
@@ -100,6 +183,10 @@ public:
         return r_.memory_bytes() + o_.memory_bytes();
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::member_heap_bytes(r_) + detail::member_heap_bytes(o_);
+    }
+
     [[nodiscard]] const Retrieval& get_retrieval() const noexcept { return r_; }
     [[nodiscard]] const Oracle& get_oracle() const noexcept { return o_; }
 
@@ -113,40 +200,78 @@ public:
         return out;
     }
 
+    /// Container sections: the retrieval and the oracle, each as a nested
+    /// container. There is no deserialize(); read_sections() (through
+    /// from_container) is how a stored bloomier is loaded.
+    void write_sections(container_writer& w) const {
+        w.add(section_tag::retrieval, to_container(r_));
+        w.add(section_tag::oracle, to_container(o_));
+    }
+
+    [[nodiscard]] static result<bloomier> read_sections(const container_view& v) {
+        auto r_bytes = v.checked(section_tag::retrieval);
+        if (!r_bytes) return std::unexpected(r_bytes.error());
+        auto r = from_container<Retrieval>(*r_bytes);
+        if (!r) return std::unexpected(r.error());
+        auto o_bytes = v.checked(section_tag::oracle);
+        if (!o_bytes) return std::unexpected(o_bytes.error());
+        auto o = from_container<Oracle>(*o_bytes);
+        if (!o) return std::unexpected(o.error());
+        return bloomier{std::move(*r), std::move(*o)};
+    }
+
     // ===== Builder =====
 
     class builder {
+        // Keys and values are held here once; the retrieval builder
+        // borrows them at build() time and the oracle reads the same views.
         typename Retrieval::builder rb_{};
-        std::vector<std::string> keys_{};
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+        size_t threads_{1};
+        executor* executor_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key, const value_type& v) {
-            rb_.add(key, v);
-            keys_.emplace_back(key);
+            keys_.add(key);
+            values_.push_back(v);
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys,
                          std::span<const value_type> values) {
             size_t n = keys.size() < values.size() ? keys.size() : values.size();
-            keys_.reserve(keys_.size() + n);
-            for (size_t i = 0; i < n; ++i) {
-                rb_.add(keys[i], values[i]);
-                keys_.emplace_back(keys[i]);
-            }
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.borrow_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
             return *this;
         }
 
         template <typename ValueFn>
             requires std::invocable<ValueFn, std::string_view>
         builder& add_all_with(std::span<const std::string> keys, ValueFn fn) {
-            keys_.reserve(keys_.size() + keys.size());
+            keys_.add_all(keys);
+            values_.reserve(values_.size() + keys.size());
             for (const auto& k : keys) {
-                value_type v = static_cast<value_type>(fn(std::string_view{k}));
-                rb_.add(k, v);
-                keys_.emplace_back(k);
+                values_.push_back(static_cast<value_type>(fn(std::string_view{k})));
             }
             return *this;
         }
@@ -157,21 +282,54 @@ public:
             rb_.with_seed(s); return *this;
         }
 
-        builder& with_threads(size_t n)
-            requires requires(typename Retrieval::builder& b) { b.with_threads(n); } {
-            rb_.with_threads(n); return *this;
+        // Threads for both builds, where each supports them.
+        builder& with_threads(size_t n) {
+            if constexpr (requires(typename Retrieval::builder& b) { b.with_threads(n); }) {
+                rb_.with_threads(n);
+            }
+            threads_ = n;
+            return *this;
+        }
+
+        // A shared pool for both builds; its size replaces with_threads.
+        builder& with_executor(executor& ex) {
+            if constexpr (requires(typename Retrieval::builder& b) { b.with_executor(ex); }) {
+                rb_.with_executor(ex);
+            }
+            executor_ = &ex;
+            threads_ = ex.size();
+            return *this;
         }
 
         [[nodiscard]] result<bloomier> build() {
+            detail::executor_scope scope{executor_};
+
             // Build retrieval first (takes keys + values).
-            auto r = rb_.build();
+            auto rb = rb_;
+            if constexpr (requires { rb.borrow_all(keys_.views(), std::span<const value_type>{values_}); }) {
+                rb.borrow_all(keys_.views(), std::span<const value_type>{values_});
+            } else {
+                for (size_t i = 0; i < keys_.size(); ++i) rb.add(keys_[i], values_[i]);
+            }
+            auto r = rb.build();
             if (!r) return std::unexpected(r.error());
 
             // Build oracle on keys alone. Oracles expose a free-form
             // build(keys) method (xor_filter, ribbon_filter,
-            // binary_fuse_filter all do this).
+            // binary_fuse_filter all do this); the built-in ones also
+            // take a span of views, which avoids copying the keys again.
             Oracle o;
-            if (!o.build(keys_)) return std::unexpected(error::optimization_failed);
+            bool built = false;
+            if constexpr (requires { o.build(keys_.views(), threads_); }) {
+                const size_t nthreads = threads_ != 0 ? threads_
+                    : std::max<size_t>(1u, std::thread::hardware_concurrency());
+                built = o.build(keys_.views(), nthreads);
+            } else if constexpr (requires { o.build(keys_.views()); }) {
+                built = o.build(keys_.views());
+            } else {
+                built = o.build(std::vector<std::string>(keys_.begin(), keys_.end()));
+            }
+            if (!built) return std::unexpected(error::optimization_failed);
 
             return bloomier{std::move(*r), std::move(o)};
         }
@@ -0,0 +1,115 @@
+/**
+ * @file bulk_query.hpp
+ * @brief bulk_slot_for / bulk_lookup: one call for a large key batch,
+ *        split over worker threads, each running the structure's most
+ *        pipelined query path.
+ *
+ * Offline joins probe a static map with millions of keys at a time, and
+ * a single thread stalls on one random read per key long before memory
+ * bandwidth runs out. These functions cut the batch into `threads`
+ * contiguous chunks (detail::parallel_chunks, so a scoped executor from
+ * task_pool.hpp is used when one is installed) and resolve each chunk
+ * with the first of:
+ *
+ *   lookup_interleaved()   G lookups in flight (detail/amac.hpp);
+ *   slot_for_batch() /     a window hashed and prefetched before any
+ *   lookup_batch()         read is resolved;
+ *   prefetch(hk)           generic interleaving: hash and prefetch, then
+ *                          a hashed lookup when the ring comes round
+ *                          (ribbon_retrieval and its view);
+ *   slot_for / lookup      one key at a time.
+ *
+ * out[i] is exactly slot_for(keys[i]) / lookup(keys[i]) whatever the
+ * thread count or path. The *_view types answer like their owning
+ * structures from the same serialized bytes, so a mapped image queried
+ * here gives the results of the structure that wrote it.
+ *
+ * threads = 0 uses hardware_concurrency(). Batches under 4096 keys run
+ * on the calling thread. device/cuda_bulk.hpp runs the same queries on a
+ * CUDA device (MAPH_ENABLE_CUDA builds).
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../concepts/retrieval.hpp"
+#include "../core.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/radix_partition.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <thread>
+
+namespace maph {
+
+namespace detail {
+
+inline size_t bulk_threads(size_t n, size_t threads) noexcept {
+    if (threads == 0) threads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+    return effective_threads(n, threads);
+}
+
+template<perfect_hash_function P>
+void bulk_slot_for_chunk(const P& phf, std::span<const std::string_view> keys,
+                         std::span<slot_index> out) noexcept {
+    if constexpr (batched_perfect_hash_function<P>) {
+        phf.slot_for_batch(keys, out);
+    } else if constexpr (staged_lookup<P> || requires(const hashed_key& hk) { phf.prefetch(hk); }) {
+        interleave_keys<interleave_group>(
+            phf, keys, [&](lookup_cursor& c) { return phf_step(phf, c); },
+            [&](size_t i, const lookup_cursor& c) { out[i] = slot_index{c.slot}; });
+    } else {
+        for (size_t i = 0; i < keys.size(); ++i) out[i] = slot_index{phf.slot_for(keys[i])};
+    }
+}
+
+template<retrieval R>
+void bulk_lookup_chunk(const R& r, std::span<const std::string_view> keys,
+                       std::span<typename R::value_type> out) {
+    using value_type = typename R::value_type;
+    if constexpr (requires { r.lookup_interleaved(keys, out); }) {
+        r.lookup_interleaved(keys, out);
+    } else if constexpr (requires { r.lookup_batch(keys, out); }) {
+        r.lookup_batch(keys, out);
+    } else if constexpr (hashed_retrieval<R> && requires(const hashed_key& hk) { r.prefetch(hk); }) {
+        interleave_keys<interleave_group>(
+            r, keys,
+            [&](lookup_cursor& c) {
+                c.value = static_cast<uint64_t>(r.lookup(c.hk));
+                return true;
+            },
+            [&](size_t i, const lookup_cursor& c) { out[i] = static_cast<value_type>(c.value); });
+    } else {
+        for (size_t i = 0; i < keys.size(); ++i) out[i] = r.lookup(keys[i]);
+    }
+}
+
+} // namespace detail
+
+/// out[i] = phf.slot_for(keys[i]) for i < min(keys.size(), out.size()),
+/// on `threads` workers (0 = hardware_concurrency).
+template<perfect_hash_function P>
+void bulk_slot_for(const P& phf, std::span<const std::string_view> keys,
+                   std::span<slot_index> out, size_t threads = 1) {
+    const size_t n = std::min(keys.size(), out.size());
+    detail::parallel_chunks(n, detail::bulk_threads(n, threads), [&](size_t, size_t lo, size_t hi) {
+        detail::bulk_slot_for_chunk(phf, keys.subspan(lo, hi - lo), out.subspan(lo, hi - lo));
+    });
+}
+
+/// out[i] = r.lookup(keys[i]) for i < min(keys.size(), out.size()), on
+/// `threads` workers (0 = hardware_concurrency).
+template<retrieval R>
+void bulk_lookup(const R& r, std::span<const std::string_view> keys,
+                 std::span<typename R::value_type> out, size_t threads = 1) {
+    const size_t n = std::min(keys.size(), out.size());
+    detail::parallel_chunks(n, detail::bulk_threads(n, threads), [&](size_t, size_t lo, size_t hi) {
+        detail::bulk_lookup_chunk(r, keys.subspan(lo, hi - lo), out.subspan(lo, hi - lo));
+    });
+}
+
+} // namespace maph
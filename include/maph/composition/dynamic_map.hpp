@@ -0,0 +1,755 @@
+/**
+ * @file dynamic_map.hpp
+ * @brief Inserts and deletes over a static structure, rebuilt in the background.
+ *
+ * Every structure in maph is built once from a fixed key set. dynamic_map
+ * wraps one and takes writes against it:
+ *
+ *   dynamic_map<phf_value_array<phobic5, 32>>   key -> value
+ *   dynamic_map<perfect_filter<phobic5, 16>>    key -> slot
+ *   dynamic_map<partitioned_phf<phobic5>>       key -> slot
+ *
+ * A generation is the static structure plus two write layers over it: an
+ * open-addressing overlay of records for inserted, updated and erased keys,
+ * and a tombstone bit per slot of the static range. lookup() probes the
+ * overlay first; a miss falls through to the static structure unless the
+ * slot's tombstone is set. Once a generation's overlay records and
+ * tombstones reach max(min_rebuild, rebuild_fraction * keys), a rebuild
+ * thread gathers the live keys, builds a new static structure, replays the
+ * writes that arrived meanwhile and publishes the new generation.
+ *
+ * Readers never wait for writers or a rebuild: they load the current
+ * generation through std::atomic<std::shared_ptr>, and a reader still
+ * holding the old one finishes on it. That load is not lock-free in
+ * libstdc++, which guards the pointer with a short internal spinlock, so
+ * concurrent loads and a publish briefly contend on it (snapshot.hpp
+ * avoids that with per-reader epochs, at the cost of a reader object per
+ * thread). Overlay entries publish immutable records with release stores;
+ * tombstones are atomic words. Writers serialize on one mutex and wait only
+ * when the overlay fills (twice the rebuild threshold) before the running
+ * rebuild publishes.
+ *
+ * Lookups are exact, whatever the static structure answers for keys outside
+ * its set: each generation keeps the static keys by slot, and a key the
+ * overlay does not hold must equal the key stored at its slot. That costs
+ * the key bytes plus a second cache line per lookup, and takes GIGO
+ * retrievals like phf_value_array to a map whose erased keys stay erased.
+ *
+ * The slot modes hand out slots: static keys keep theirs, inserted keys get
+ * fresh ones from range_size() up, and a rebuild renumbers everything into
+ * the new structure's range (generation() counts the rebuilds).
+ *
+ * dynamic_traits<Static> adapts a structure: its value type, its slot range,
+ * the slot a key reaches, the value stored there, and how to build one from
+ * distinct keys. It is specialized for retrievals over a PHF, approximate
+ * maps, and plain PHFs.
+ */
+
+#pragma once
+
+#include "../concepts/approximate_map.hpp"
+#include "../concepts/perfect_hash_function.hpp"
+#include "../concepts/retrieval.hpp"
+#include "../core.hpp"
+#include "../detail/key_store.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+template<typename Static>
+struct dynamic_traits;
+
+namespace detail {
+
+// dynamic_map hands builders distinct keys; skip their dedup pass.
+template<typename Builder>
+void skip_dedup(Builder& b) {
+    if constexpr (requires { b.with_dedup(key_dedup::none); }) b.with_dedup(key_dedup::none);
+}
+
+} // namespace detail
+
+/// A retrieval over a PHF (phf_value_array): the stored values.
+template<typename S>
+    requires retrieval<S> && (!approximate_map<S>)
+          && requires(const S& s) { s.phf(); typename S::builder; }
+struct dynamic_traits<S> {
+    using value_type = typename S::value_type;
+    static constexpr bool assigns_slots = false;
+
+    static size_t range(const S& s) noexcept { return s.phf().range_size(); }
+
+    static std::optional<size_t> slot(const S& s, const hashed_key& hk) noexcept {
+        return static_cast<size_t>(slot_for_hashed(s.phf(), hk).value);
+    }
+
+    static value_type value(const S& s, const hashed_key& hk, size_t slot) {
+        if constexpr (requires { s.values().get(slot); }) {
+            return static_cast<value_type>(s.values().get(slot));
+        } else {
+            return lookup_hashed(s, hk);
+        }
+    }
+
+    static result<S> build(std::span<const std::string_view> keys,
+                           std::span<const value_type> values) {
+        typename S::builder b{};
+        b.borrow_all(keys, values);
+        detail::skip_dedup(b);
+        return b.build();
+    }
+};
+
+/// An approximate map over a PHF (perfect_filter): the verified slot.
+template<typename S>
+    requires approximate_map<S> && requires(const S& s) { s.phf(); }
+struct dynamic_traits<S> {
+    using value_type = slot_index;
+    using phf_type = std::remove_cvref_t<decltype(std::declval<const S&>().phf())>;
+    static constexpr bool assigns_slots = true;
+
+    static size_t range(const S& s) noexcept { return s.range_size(); }
+
+    static std::optional<size_t> slot(const S& s, const hashed_key& hk) noexcept {
+        std::optional<slot_index> r;
+        if constexpr (requires { s.slot_for(hk); }) {
+            r = s.slot_for(hk);
+        } else {
+            r = s.slot_for(hk.key);
+        }
+        if (!r) return std::nullopt;
+        return static_cast<size_t>(r->value);
+    }
+
+    static value_type value(const S&, const hashed_key&, size_t slot) noexcept {
+        return slot_index{slot};
+    }
+
+    static result<S> build(std::span<const std::string_view> keys,
+                           std::span<const value_type>) {
+        typename phf_type::builder b{};
+        detail::borrow_keys_into(b, keys);
+        detail::skip_dedup(b);
+        auto phf = b.build();
+        if (!phf) return std::unexpected(phf.error());
+        return S::build(std::move(*phf), keys);
+    }
+};
+
+/// A plain PHF (partitioned_phf, phobic_phf, ...): the slot itself.
+template<typename S>
+    requires perfect_hash_function<S> && (!approximate_map<S>) && (!retrieval<S>)
+struct dynamic_traits<S> {
+    using value_type = slot_index;
+    static constexpr bool assigns_slots = true;
+
+    static size_t range(const S& s) noexcept { return s.range_size(); }
+
+    static std::optional<size_t> slot(const S& s, const hashed_key& hk) noexcept {
+        return static_cast<size_t>(slot_for_hashed(s, hk).value);
+    }
+
+    static value_type value(const S&, const hashed_key&, size_t slot) noexcept {
+        return slot_index{slot};
+    }
+
+    static result<S> build(std::span<const std::string_view> keys,
+                           std::span<const value_type>) {
+        typename S::builder b{};
+        detail::borrow_keys_into(b, keys);
+        detail::skip_dedup(b);
+        return b.build();
+    }
+};
+
+template<typename Static>
+    requires requires { typename dynamic_traits<Static>::value_type; }
+class dynamic_map {
+    using traits = dynamic_traits<Static>;
+
+public:
+    using static_type = Static;
+    using value_type = typename traits::value_type;
+
+    /// True when values are slots handed out by the map (insert(key)),
+    /// false when the caller supplies them (insert(key, value)).
+    static constexpr bool assigns_slots = traits::assigns_slots;
+
+    static constexpr double default_rebuild_fraction = 0.01;
+    static constexpr size_t default_min_rebuild = 1024;
+
+    class builder;
+
+    dynamic_map(dynamic_map&&) noexcept = default;
+    dynamic_map& operator=(dynamic_map&&) noexcept = default;
+
+    // ===== Reads: never wait for writers =====
+
+    [[nodiscard]] std::optional<value_type> lookup(std::string_view key) const {
+        return lookup(hashed_key{key});
+    }
+
+    [[nodiscard]] std::optional<value_type> lookup(const hashed_key& hk) const {
+        auto gen = state_->current.load(std::memory_order_acquire);
+        return find(*gen, hk);
+    }
+
+    [[nodiscard]] bool contains(std::string_view key) const { return lookup(key).has_value(); }
+
+    // ===== Writes: serialized on the writer mutex =====
+
+    /// Insert or overwrite key. Fails only when the overlay is full and the
+    /// rebuild that would empty it failed (last_rebuild_error()).
+    result<void> insert(std::string_view key, value_type value)
+        requires (!assigns_slots) {
+        std::unique_lock lock(state_->write_mutex);
+        if (auto room = reserve_record(lock); !room) return std::unexpected(room.error());
+        auto gen = state_->current.load(std::memory_order_relaxed);
+        apply_insert(*state_, *gen, hashed_key{key}, value);
+        log_write(key, value, false);
+        maybe_rebuild(lock);
+        return {};
+    }
+
+    /// Insert key if absent; returns its slot either way.
+    result<slot_index> insert(std::string_view key) requires assigns_slots {
+        std::unique_lock lock(state_->write_mutex);
+        if (auto room = reserve_record(lock); !room) return std::unexpected(room.error());
+        const hashed_key hk{key};
+        auto gen = state_->current.load(std::memory_order_relaxed);
+        const slot_index slot = apply_insert(*state_, *gen, hk, value_type{});
+        log_write(key, value_type{}, false);
+        maybe_rebuild(lock);
+        // A synchronous rebuild renumbered the slots.
+        if (auto now = state_->current.load(std::memory_order_relaxed); now != gen) return *find(*now, hk);
+        return slot;
+    }
+
+    /// Remove key; false if it was not present.
+    bool erase(std::string_view key) {
+        std::unique_lock lock(state_->write_mutex);
+        auto gen = state_->current.load(std::memory_order_relaxed);
+        const bool erased = apply_erase(*state_, *gen, hashed_key{key});
+        if (erased) {
+            log_write(key, value_type{}, true);
+            maybe_rebuild(lock);
+        }
+        return erased;
+    }
+
+    // ===== Rebuilds =====
+
+    /// Rebuild now on the calling thread (after any running rebuild).
+    result<void> rebuild() {
+        std::unique_lock lock(state_->write_mutex);
+        state_->rebuilt.wait(lock, [&] { return !state_->rebuilding; });
+        run_rebuild_inline(lock);
+        if (state_->last_error != error::success) return std::unexpected(state_->last_error);
+        return {};
+    }
+
+    /// Block until no rebuild is running.
+    void wait_for_rebuild() const {
+        std::unique_lock lock(state_->write_mutex);
+        state_->rebuilt.wait(lock, [&] { return !state_->rebuilding; });
+    }
+
+    [[nodiscard]] bool rebuilding() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->rebuilding;
+    }
+
+    /// error::success unless the most recent rebuild failed.
+    [[nodiscard]] error last_rebuild_error() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->last_error;
+    }
+
+    // ===== Introspection =====
+
+    /// Live keys.
+    [[nodiscard]] size_t size() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->live;
+    }
+
+    /// Rebuilds published since construction.
+    [[nodiscard]] uint64_t generation() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->generations;
+    }
+
+    /// Records written to the current overlay (updates count each time).
+    [[nodiscard]] size_t overlay_size() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->current.load(std::memory_order_relaxed)->records.size();
+    }
+
+    /// Static keys erased in the current generation.
+    [[nodiscard]] size_t tombstones() const {
+        std::lock_guard lock(state_->write_mutex);
+        return state_->current.load(std::memory_order_relaxed)->tombstones;
+    }
+
+    /// The current static structure, kept alive by the returned pointer.
+    /// Null while the live set was empty at the last rebuild.
+    [[nodiscard]] std::shared_ptr<const Static> snapshot() const {
+        auto gen = state_->current.load(std::memory_order_acquire);
+        if (!gen->base) return nullptr;
+        const Static* base = &*gen->base;
+        return std::shared_ptr<const Static>(std::move(gen), base);
+    }
+
+private:
+    // Immutable once published: a write replaces an entry's record.
+    struct record {
+        std::string key;
+        value_type value{};
+        bool erased{false};
+    };
+
+    struct entry {
+        std::atomic<uint64_t> tag{0};  // 0: empty
+        std::atomic<const record*> rec{nullptr};
+    };
+
+    struct generation_state {
+        std::optional<Static> base;
+        size_t range{0};
+
+        // Static keys by slot, for exact writer-side compares and gathers.
+        std::string key_bytes;
+        std::vector<uint64_t> key_offsets;  // range + 1
+        std::vector<uint64_t> used;         // slot holds a static key
+
+        std::unique_ptr<std::atomic<uint64_t>[]> dead;  // tombstones
+        std::unique_ptr<entry[]> overlay;
+        size_t mask{0};
+
+        // Writer-side, under write_mutex.
+        std::vector<std::unique_ptr<record>> records;
+        size_t entries{0};
+        size_t tombstones{0};
+        size_t threshold{0};
+        size_t next_slot{0};
+
+        [[nodiscard]] std::string_view slot_key(size_t s) const noexcept {
+            return std::string_view{key_bytes}.substr(
+                key_offsets[s], key_offsets[s + 1] - key_offsets[s]);
+        }
+        [[nodiscard]] bool is_used(size_t s) const noexcept { return (used[s >> 6] >> (s & 63)) & 1; }
+        [[nodiscard]] bool is_dead(size_t s) const noexcept {
+            return (dead[s >> 6].load(std::memory_order_acquire) >> (s & 63)) & 1;
+        }
+        [[nodiscard]] size_t pending() const noexcept { return records.size() + tombstones; }
+        [[nodiscard]] size_t entry_limit() const noexcept { return (mask + 1) / 2; }
+    };
+
+    struct write_op {
+        std::string key;
+        value_type value{};
+        bool erase{false};
+    };
+
+    struct shared_state {
+        std::atomic<std::shared_ptr<generation_state>> current;
+        mutable std::mutex write_mutex;
+        mutable std::condition_variable rebuilt;
+        std::thread worker;
+
+        std::vector<write_op> log;  // writes since the running rebuild began
+        bool rebuilding{false};
+        bool background{true};
+        double fraction{default_rebuild_fraction};
+        size_t min_rebuild{default_min_rebuild};
+        size_t live{0};
+        size_t retry_at{0};  // pending() a failed rebuild waits for
+        uint64_t generations{0};
+        error last_error{error::success};
+
+        ~shared_state() {
+            {
+                std::unique_lock lock(write_mutex);
+                rebuilt.wait(lock, [&] { return !rebuilding; });
+            }
+            if (worker.joinable()) worker.join();
+        }
+    };
+
+    explicit dynamic_map(std::unique_ptr<shared_state> st) : state_(std::move(st)) {}
+
+    static uint64_t tag_of(const hashed_key& hk) noexcept { return hk.digest.hi | 1; }
+
+    static const record* find_record(const generation_state& g, const hashed_key& hk) noexcept {
+        const uint64_t tag = tag_of(hk);
+        for (size_t i = hk.digest.lo & g.mask;; i = (i + 1) & g.mask) {
+            const uint64_t t = g.overlay[i].tag.load(std::memory_order_acquire);
+            if (t == 0) return nullptr;
+            if (t == tag) {
+                const record* r = g.overlay[i].rec.load(std::memory_order_acquire);
+                if (r->key == hk.key) return r;
+            }
+        }
+    }
+
+    static std::optional<value_type> find(const generation_state& g, const hashed_key& hk) {
+        if (const record* r = find_record(g, hk)) {
+            if (r->erased) return std::nullopt;
+            return r->value;
+        }
+        if (!g.base) return std::nullopt;
+        auto s = traits::slot(*g.base, hk);
+        if (!s || *s >= g.range || g.is_dead(*s) || g.slot_key(*s) != hk.key) return std::nullopt;
+        return traits::value(*g.base, hk, *s);
+    }
+
+    // The slot of key among the static keys, live or erased.
+    static std::optional<size_t> static_slot(const generation_state& g, const hashed_key& hk) {
+        if (!g.base) return std::nullopt;
+        auto s = traits::slot(*g.base, hk);
+        if (!s || *s >= g.range || !g.is_used(*s) || g.slot_key(*s) != hk.key) return std::nullopt;
+        return s;
+    }
+
+    static void set_dead(generation_state& g, size_t s, bool dead) noexcept {
+        const uint64_t bit = uint64_t{1} << (s & 63);
+        if (dead) {
+            g.dead[s >> 6].fetch_or(bit, std::memory_order_release);
+        } else {
+            g.dead[s >> 6].fetch_and(~bit, std::memory_order_release);
+        }
+    }
+
+    // Publish a record for key: replace its entry's, or claim an empty one.
+    static void put_record(generation_state& g, const hashed_key& hk, value_type value, bool erased) {
+        g.records.push_back(std::make_unique<record>(record{std::string{hk.key}, value, erased}));
+        const record* r = g.records.back().get();
+        const uint64_t tag = tag_of(hk);
+        for (size_t i = hk.digest.lo & g.mask;; i = (i + 1) & g.mask) {
+            entry& e = g.overlay[i];
+            const uint64_t t = e.tag.load(std::memory_order_relaxed);
+            if (t == 0) {
+                e.rec.store(r, std::memory_order_relaxed);
+                e.tag.store(tag, std::memory_order_release);
+                ++g.entries;
+                return;
+            }
+            if (t == tag && e.rec.load(std::memory_order_relaxed)->key == hk.key) {
+                e.rec.store(r, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    static value_type apply_insert(shared_state& st, generation_state& g, const hashed_key& hk,
+                                   value_type value) {
+        const record* r = find_record(g, hk);
+        if constexpr (assigns_slots) {
+            if (r && !r->erased) return r->value;
+            if (!r) {
+                if (auto s = static_slot(g, hk)) {
+                    if (g.is_dead(*s)) {
+                        set_dead(g, *s, false);
+                        --g.tombstones;
+                        ++st.live;
+                    }
+                    return slot_index{*s};
+                }
+            }
+            // A re-inserted overlay key keeps the slot it had.
+            value = r ? r->value : slot_index{g.next_slot++};
+            put_record(g, hk, value, false);
+            ++st.live;
+            return value;
+        } else {
+            bool was_live = false;
+            if (r) {
+                was_live = !r->erased;
+            } else if (auto s = static_slot(g, hk)) {
+                was_live = !g.is_dead(*s);
+            }
+            put_record(g, hk, value, false);
+            if (!was_live) ++st.live;
+            return value;
+        }
+    }
+
+    static bool apply_erase(shared_state& st, generation_state& g, const hashed_key& hk) {
+        if (const record* r = find_record(g, hk)) {
+            // The record shadows any static copy of the key.
+            if (r->erased) return false;
+            put_record(g, hk, r->value, true);
+            --st.live;
+            return true;
+        }
+        auto s = static_slot(g, hk);
+        if (!s || g.is_dead(*s)) return false;
+        set_dead(g, *s, true);
+        ++g.tombstones;
+        --st.live;
+        return true;
+    }
+
+    void log_write(std::string_view key, value_type value, bool erase) {
+        if (state_->rebuilding) state_->log.push_back(write_op{std::string{key}, value, erase});
+    }
+
+    // Make room for one more overlay entry, rebuilding if the overlay is full.
+    result<void> reserve_record(std::unique_lock<std::mutex>& lock) {
+        auto full = [&] {
+            const auto& g = *state_->current.load(std::memory_order_relaxed);
+            return g.entries >= g.entry_limit();
+        };
+        if (!full()) return {};
+        state_->rebuilt.wait(lock, [&] { return !state_->rebuilding; });
+        if (full()) run_rebuild_inline(lock);
+        if (full()) return std::unexpected(state_->last_error);
+        return {};
+    }
+
+    void maybe_rebuild(std::unique_lock<std::mutex>& lock) {
+        const auto& g = *state_->current.load(std::memory_order_relaxed);
+        if (state_->rebuilding || g.pending() < g.threshold || g.pending() < state_->retry_at) return;
+        if (!state_->background) {
+            run_rebuild_inline(lock);
+            return;
+        }
+        if (state_->worker.joinable()) state_->worker.join();  // finished: it cleared rebuilding
+        state_->rebuilding = true;
+        state_->log.clear();
+        shared_state* st = state_.get();
+        state_->worker = std::thread([st] { rebuild_into(*st); });
+    }
+
+    void run_rebuild_inline(std::unique_lock<std::mutex>& lock) {
+        state_->rebuilding = true;
+        state_->log.clear();
+        lock.unlock();
+        rebuild_into(*state_);
+        lock.lock();
+    }
+
+    // Live keys and values of a generation. Runs without the writer mutex;
+    // writes that race with it are in the log and replayed on publish. The
+    // overlay is read first and its keys skipped among the static ones, so
+    // a static key written mid-scan is gathered once, not from both.
+    static void gather(const generation_state& g, std::vector<std::string>& keys,
+                       std::vector<value_type>& values) {
+        std::unordered_set<std::string_view> shadowed;
+        for (size_t i = 0; i <= g.mask; ++i) {
+            if (g.overlay[i].tag.load(std::memory_order_acquire) == 0) continue;
+            const record* r = g.overlay[i].rec.load(std::memory_order_acquire);
+            shadowed.insert(r->key);  // g.records keeps r alive
+            if (r->erased) continue;
+            keys.push_back(r->key);
+            values.push_back(r->value);
+        }
+        for (size_t s = 0; s < g.range; ++s) {
+            if (!g.is_used(s) || g.is_dead(s)) continue;
+            const std::string_view key = g.slot_key(s);
+            if (shadowed.contains(key)) continue;  // the overlay decides
+            keys.emplace_back(key);
+            values.push_back(traits::value(*g.base, hashed_key{key}, s));
+        }
+    }
+
+    static size_t threshold_for(const shared_state& st, size_t keys) noexcept {
+        const auto scaled = static_cast<size_t>(st.fraction * static_cast<double>(keys));
+        return std::max<size_t>({st.min_rebuild, scaled, 1});
+    }
+
+    // A generation over distinct keys; the caller sizes its overlay.
+    static result<std::shared_ptr<generation_state>> make_generation(
+        std::span<const std::string_view> keys, std::span<const value_type> values) {
+        auto g = std::make_shared<generation_state>();
+        if (!keys.empty()) {
+            auto built = traits::build(keys, values);
+            if (!built) return std::unexpected(built.error());
+            g->base.emplace(std::move(*built));
+            g->range = traits::range(*g->base);
+        }
+        const size_t words = (g->range + 63) / 64;
+        g->used.assign(words, 0);
+        g->key_offsets.assign(g->range + 1, 0);
+        std::vector<uint64_t> slots(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto s = traits::slot(*g->base, hashed_key{keys[i]});
+            if (!s || *s >= g->range) return std::unexpected(error::optimization_failed);
+            slots[i] = *s;
+            g->key_offsets[*s + 1] = keys[i].size();
+            g->used[*s >> 6] |= uint64_t{1} << (*s & 63);
+        }
+        std::partial_sum(g->key_offsets.begin(), g->key_offsets.end(), g->key_offsets.begin());
+        g->key_bytes.resize(g->key_offsets.back());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            std::memcpy(g->key_bytes.data() + g->key_offsets[slots[i]], keys[i].data(), keys[i].size());
+        }
+        // Unused slots start dead, so approximate hits on them miss.
+        g->dead = std::make_unique<std::atomic<uint64_t>[]>(std::max<size_t>(words, 1));
+        for (size_t w = 0; w < words; ++w) g->dead[w].store(~g->used[w], std::memory_order_relaxed);
+        g->next_slot = g->range;
+        return g;
+    }
+
+    static void allocate_overlay(generation_state& g, size_t min_entries) {
+        const size_t capacity = std::bit_ceil(std::max<size_t>({64, 4 * g.threshold, 2 * min_entries}));
+        g.overlay = std::make_unique<entry[]>(capacity);
+        g.mask = capacity - 1;
+    }
+
+    // Entered with rebuilding set and the log cleared, without the mutex.
+    static void rebuild_into(shared_state& st) {
+        auto old = st.current.load(std::memory_order_acquire);
+        std::vector<std::string> keys;
+        std::vector<value_type> values;
+        gather(*old, keys, values);
+        std::vector<std::string_view> views(keys.begin(), keys.end());
+        auto next = make_generation(views, values);
+
+        std::lock_guard lock(st.write_mutex);
+        if (next) {
+            auto& g = **next;
+            g.threshold = threshold_for(st, keys.size());
+            allocate_overlay(g, st.log.size());
+            st.live = keys.size();
+            for (const auto& op : st.log) {
+                const hashed_key hk{op.key};
+                if (op.erase) {
+                    apply_erase(st, g, hk);
+                } else {
+                    apply_insert(st, g, hk, op.value);
+                }
+            }
+            st.current.store(std::move(*next), std::memory_order_release);
+            ++st.generations;
+            st.last_error = error::success;
+            st.retry_at = 0;
+        } else {
+            st.last_error = next.error();
+            st.retry_at = old->pending() + old->threshold;
+        }
+        st.log.clear();
+        st.rebuilding = false;
+        st.rebuilt.notify_all();
+    }
+
+    std::unique_ptr<shared_state> state_;
+};
+
+template<typename Static>
+    requires requires { typename dynamic_traits<Static>::value_type; }
+class dynamic_map<Static>::builder {
+public:
+    builder() = default;
+
+    builder& add(std::string_view key) requires assigns_slots {
+        keys_.emplace_back(key);
+        return *this;
+    }
+
+    builder& add(std::string_view key, value_type value) requires (!assigns_slots) {
+        keys_.emplace_back(key);
+        values_.push_back(value);
+        return *this;
+    }
+
+    builder& add_all(std::span<const std::string> keys) requires assigns_slots {
+        keys_.insert(keys_.end(), keys.begin(), keys.end());
+        return *this;
+    }
+
+    builder& add_all(std::span<const std::string_view> keys) requires assigns_slots {
+        keys_.insert(keys_.end(), keys.begin(), keys.end());
+        return *this;
+    }
+
+    builder& add_all(std::span<const std::string> keys, std::span<const value_type> values)
+        requires (!assigns_slots) {
+        const size_t n = std::min(keys.size(), values.size());
+        keys_.insert(keys_.end(), keys.begin(), keys.begin() + n);
+        values_.insert(values_.end(), values.begin(), values.begin() + n);
+        return *this;
+    }
+
+    builder& add_all(std::span<const std::string_view> keys, std::span<const value_type> values)
+        requires (!assigns_slots) {
+        const size_t n = std::min(keys.size(), values.size());
+        keys_.insert(keys_.end(), keys.begin(), keys.begin() + n);
+        values_.insert(values_.end(), values.begin(), values.begin() + n);
+        return *this;
+    }
+
+    /// Rebuild once overlay records + tombstones reach this fraction of the
+    /// keys (default 1%), but not before min_rebuild writes.
+    builder& with_rebuild_fraction(double f) {
+        fraction_ = f;
+        return *this;
+    }
+
+    builder& with_min_rebuild(size_t n) {
+        min_rebuild_ = n;
+        return *this;
+    }
+
+    /// false: rebuild synchronously in the write that crosses the threshold.
+    builder& with_background_rebuild(bool on) {
+        background_ = on;
+        return *this;
+    }
+
+    [[nodiscard]] result<dynamic_map> build() {
+        // Distinct keys, the last value added for a key winning.
+        std::vector<size_t> order(keys_.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return keys_[a] < keys_[b]; });
+        std::vector<std::string_view> keys;
+        std::vector<value_type> values;
+        keys.reserve(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && keys_[order[i]] == keys_[order[i + 1]]) continue;
+            keys.push_back(keys_[order[i]]);
+            if constexpr (!assigns_slots) values.push_back(values_[order[i]]);
+        }
+
+        auto st = std::make_unique<shared_state>();
+        st->fraction = fraction_;
+        st->min_rebuild = min_rebuild_;
+        st->background = background_;
+        auto gen = make_generation(keys, values);
+        if (!gen) return std::unexpected(gen.error());
+        (*gen)->threshold = threshold_for(*st, keys.size());
+        allocate_overlay(**gen, 0);
+        st->live = keys.size();
+        st->current.store(std::move(*gen), std::memory_order_release);
+        return dynamic_map{std::move(st)};
+    }
+
+private:
+    std::vector<std::string> keys_;
+    std::vector<value_type> values_;
+    double fraction_{default_rebuild_fraction};
+    size_t min_rebuild_{default_min_rebuild};
+    bool background_{true};
+};
+
+} // namespace maph
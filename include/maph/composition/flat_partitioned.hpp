@@ -0,0 +1,260 @@
+/**
+ * @file flat_partitioned.hpp
+ * @brief partitioned_phf<phobic_phf> laid out flat for queries.
+ *
+ * partitioned_phf::slot_for reads shards_[s], a whole phobic_phf with its
+ * own heap vector, and offsets_[s], then the pilot that vector points to:
+ * at scale each is a separate miss, and the pilot's address is not known
+ * until the shard object arrives. It also divides three times (shard,
+ * bucket, slot).
+ *
+ * flat_partitioned_phf keeps every shard's pilots in one array and
+ * everything a query needs about a shard in one 64-byte header:
+ *
+ *   offset, seed, first pilot index, bucket count, range,
+ *   and the fastmod_u64 multipliers for the bucket count and range
+ *
+ * A query is the routing hash, one header line, one pilot. Every modulo
+ * is detail::fastmod_u64, exact, so slots and the serialized format are
+ * those of the partitioned_phf it was made from; deserialize() takes
+ * partitioned_phf<phobic_phf<B>> bytes and serialize() writes them.
+ *
+ * Query-only: build a partitioned_phf<phobic_phf<B>> (flat pilots, any
+ * storage, wide hash) and convert it with from().
+ */
+
+#pragma once
+
+#include "../algorithms/phobic.hpp"
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/page_allocator.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/serialization.hpp"
+#include "partitioned.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace maph {
+
+template<size_t BucketSize = 5, typename Storage = heap_storage>
+class flat_partitioned_phf {
+    static_assert(storage_policy<Storage>, "Storage must be a storage policy");
+
+    using inner = phobic_phf<BucketSize>;
+
+    struct alignas(64) shard_header {
+        __uint128_t bucket_m{0};   // fastmod_u64 multiplier for num_buckets
+        __uint128_t range_m{0};    // and for range
+        uint64_t offset{0};        // first slot of the shard's range
+        uint64_t seed{0};          // the shard's phobic seed
+        uint64_t pilots{0};        // index of its first pilot
+        uint32_t num_buckets{1};
+        uint32_t range{1};
+    };
+    static_assert(sizeof(shard_header) == 64);
+
+    // Exact shard sizes for serialize(); headers clamp empty ones to 1.
+    struct shard_meta {
+        uint64_t keys, buckets, range;
+    };
+
+    std::vector<shard_header> headers_;
+    typename Storage::template array<uint16_t> pilots_{};
+    std::vector<shard_meta> meta_;
+    uint64_t seed_{0};
+    size_t num_keys_{0};
+    size_t range_size_{0};
+    detail::fastmod_u64 shard_mod_{};
+
+    const shard_header& header_for(const hashed_key& hk) const noexcept {
+        return headers_[shard_mod_(detail::partition_shard_hash(hk, seed_))];
+    }
+
+    static size_t pilot_index(const shard_header& h, uint64_t h1) noexcept {
+        return h.pilots + detail::fastmod_u64::reduce(h1, h.bucket_m, h.num_buckets);
+    }
+
+    static uint64_t slot_with(const shard_header& h, uint64_t h2, uint16_t pilot) noexcept {
+        return h.offset + detail::fastmod_u64::reduce(inner::pilot_mix(h2, pilot), h.range_m, h.range);
+    }
+
+public:
+    flat_partitioned_phf() = default;
+    flat_partitioned_phf(flat_partitioned_phf&&) = default;
+    flat_partitioned_phf& operator=(flat_partitioned_phf&&) = default;
+
+    /// Flatten a built partitioned_phf. invalid_format when it was written
+    /// with the older hash revision or a shard exceeds 2^32 slots.
+    template<typename S>
+    [[nodiscard]] static result<flat_partitioned_phf> from(
+        const partitioned_phf<phobic_phf<BucketSize, flat_pilots, S>>& p) {
+        if (p.hash_rev_ != hash_revision::wide) return std::unexpected(error::invalid_format);
+
+        flat_partitioned_phf r;
+        const size_t P = p.num_shards_;
+        r.headers_.resize(P);
+        r.meta_.resize(P);
+        std::vector<uint16_t> pilots;
+        for (size_t i = 0; i < P; ++i) {
+            const auto& sh = p.shards_[i];
+            if (sh.hash_rev_ != hash_revision::wide || sh.num_buckets_ > UINT32_MAX
+                || sh.range_size_ > UINT32_MAX) {
+                return std::unexpected(error::invalid_format);
+            }
+            auto& h = r.headers_[i];
+            h.offset = p.offsets_[i];
+            h.seed = sh.seed_;
+            h.pilots = pilots.size();
+            h.num_buckets = static_cast<uint32_t>(std::max<size_t>(sh.num_buckets_, 1));
+            h.range = static_cast<uint32_t>(std::max<size_t>(sh.range_size_, 1));
+            h.bucket_m = detail::fastmod_u64{h.num_buckets}.m;
+            h.range_m = detail::fastmod_u64{h.range}.m;
+            for (size_t b = 0; b < sh.num_buckets_; ++b) pilots.push_back(sh.pilots_[b]);
+            r.meta_[i] = {sh.num_keys_, sh.num_buckets_, sh.range_size_};
+        }
+        pilots.push_back(0);  // an empty shard's one bucket
+        r.pilots_ = detail::adopt_array<typename Storage::template array<uint16_t>>(std::move(pilots));
+        r.seed_ = p.seed_;
+        r.num_keys_ = p.num_keys_;
+        r.range_size_ = p.range_size_;
+        r.shard_mod_ = detail::fastmod_u64{P};
+        return r;
+    }
+
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_for(hashed_key{digest});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        const shard_header& h = header_for(hk);
+        const auto d = inner::hash_digest(hk.digest, h.seed);
+        return slot_index{slot_with(h, d.h2, pilots_[pilot_index(h, d.h1)])};
+    }
+
+    // Three passes over a window: route and prefetch each header, then
+    // prefetch each pilot, then resolve.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        hashed_key hks[W];
+        const shard_header* hs[W];
+        size_t idx[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                hs[i] = &header_for(hks[i]);
+                detail::prefetch_read(hs[i]);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                idx[i] = pilot_index(*hs[i], inner::hash_digest(hks[i].digest, hs[i]->seed).h1);
+                detail::prefetch_read(detail::element_address(pilots_, idx[i]));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                const auto d = inner::hash_digest(hks[i].digest, hs[i]->seed);
+                out[base + i] = slot_index{slot_with(*hs[i], d.h2, pilots_[idx[i]])};
+            }
+        }
+    }
+
+    // Interleaved stages (detail/amac.hpp): the header, then the pilot.
+    // c.slot holds the pilot index between the two.
+    void lookup_start(detail::lookup_cursor& c) const noexcept {
+        c.shard = shard_mod_(detail::partition_shard_hash(c.hk, seed_));
+        detail::prefetch_read(&headers_[c.shard]);
+    }
+
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        const shard_header& h = headers_[c.shard];
+        const auto d = inner::hash_digest(c.hk.digest, h.seed);
+        if (c.stage == 0) {
+            c.stage = 1;
+            c.slot = pilot_index(h, d.h1);
+            detail::prefetch_read(detail::element_address(pilots_, c.slot));
+            return false;
+        }
+        c.slot = slot_with(h, d.h2, pilots_[c.slot]);
+        return true;
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return headers_.size(); }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(num_keys_);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return sizeof(*this) + headers_.size() * sizeof(shard_header)
+             + pilots_.size() * sizeof(uint16_t) + meta_.size() * sizeof(shard_meta);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::allocated_bytes(headers_) + detail::allocated_bytes(pilots_)
+             + detail::allocated_bytes(meta_);
+    }
+
+    /// partitioned_phf<phobic_phf<BucketSize>> bytes.
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        const size_t P = headers_.size();
+        std::vector<std::byte> out;
+        phf_serial::write_header(out, partitioned_phf<inner>::ALGORITHM_ID);
+        phf_serial::append(out, seed_);
+        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
+        phf_serial::append(out, static_cast<uint64_t>(range_size_));
+        phf_serial::append(out, static_cast<uint64_t>(P));
+        phf_serial::append(out, static_cast<uint64_t>(P + 1));
+        for (const auto& h : headers_) phf_serial::append(out, h.offset);
+        phf_serial::append(out, static_cast<uint64_t>(range_size_));
+
+        std::vector<std::byte> shard;
+        for (size_t i = 0; i < P; ++i) {
+            // The phobic_phf<BucketSize> layout, pilots as a counted array.
+            const auto& h = headers_[i];
+            const auto& m = meta_[i];
+            shard.clear();
+            phf_serial::write_header(shard, inner::ALGORITHM_ID);
+            phf_serial::append(shard, h.seed);
+            phf_serial::append(shard, m.keys);
+            phf_serial::append(shard, m.range);
+            phf_serial::append(shard, m.buckets);
+            phf_serial::append(shard, static_cast<uint64_t>(BucketSize));
+            phf_serial::append(shard, m.buckets);
+            for (size_t b = 0; b < m.buckets; ++b) phf_serial::append(shard, pilots_[h.pilots + b]);
+            phf_serial::append(out, static_cast<uint64_t>(shard.size()));
+            out.insert(out.end(), shard.begin(), shard.end());
+        }
+        return out;
+    }
+
+    [[nodiscard]] static result<flat_partitioned_phf> deserialize(std::span<const std::byte> data) {
+        auto p = partitioned_phf<inner>::deserialize(data);
+        if (!p) return std::unexpected(p.error());
+        return from(*p);
+    }
+};
+
+} // namespace maph
@@ -0,0 +1,256 @@
+/**
+ * @file lazy_partitioned.hpp
+ * @brief partitioned_phf loaded one shard at a time, on first use.
+ *
+ * partitioned_phf::deserialize decodes every shard before the first query
+ * can run. lazy_partitioned_phf<Inner> opens the container written by
+ * to_container(partitioned_phf<...>) (detail/container.hpp), reads only
+ * its meta and offsets sections, and decodes a shard the first time a
+ * query routes to it: the shard's section is checksummed (unless opened
+ * with verify = false) and handed to Inner::deserialize. With a view for
+ * Inner (phobic_phf_view<5>, ...) decoding only binds the section in
+ * place, so an untouched shard costs nothing and a touched one only the
+ * pages its queries fault in.
+ *
+ * prefault(shards) and prefault_keys(keys) load known-hot shards before
+ * traffic arrives, spread over threads, and report a shard that fails to
+ * load. A shard that fails to load answers range_size() (one past the
+ * last slot) for every key routed to it.
+ *
+ * Each shard loads at most once (std::call_once). Once loaded, a query
+ * costs one acquire load more than partitioned_phf::slot_for.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/container.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/mapped_file.hpp"
+#include "partitioned.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace maph {
+
+template<typename Inner>
+class lazy_partitioned_phf {
+    static_assert(perfect_hash_function<Inner>,
+        "lazy_partitioned_phf Inner must satisfy perfect_hash_function");
+
+    enum : uint8_t { unloaded = 0, ready = 1, failed = 2 };
+
+    // Behind a pointer so the once flags and atomics stay put on move.
+    struct shared {
+        mapped_file file{};  // empty when bound to the caller's bytes
+        container_view container{};
+        std::vector<uint64_t> offsets;
+        std::vector<std::optional<Inner>> shards;
+        std::unique_ptr<std::once_flag[]> once;
+        std::unique_ptr<std::atomic<uint8_t>[]> status;
+        std::atomic<size_t> loaded{0};
+        bool verify{true};
+    };
+
+    std::unique_ptr<shared> st_;
+    uint64_t seed_{0};
+    size_t num_keys_{0};
+    size_t range_size_{0};
+    size_t num_shards_{0};
+    detail::fastmod_u64 shard_mod_{};
+    hash_revision hash_rev_{hash_revision::wide};
+
+    [[nodiscard]] bool load(size_t s) const {
+        shared& st = *st_;
+        std::call_once(st.once[s], [&] {
+            const auto i = st.container.find(section_tag::shard, static_cast<uint32_t>(s));
+            uint8_t outcome = failed;
+            if (i && (!st.verify || st.container.verify(*i))) {
+                auto shard = detail::deserialize_as<Inner>(st.container.section(*i));
+                if (shard) {
+                    st.shards[s].emplace(std::move(*shard));
+                    st.loaded.fetch_add(1, std::memory_order_relaxed);
+                    outcome = ready;
+                }
+            }
+            st.status[s].store(outcome, std::memory_order_release);
+        });
+        return st.status[s].load(std::memory_order_acquire) == ready;
+    }
+
+    [[nodiscard]] const Inner* shard_ptr(size_t s) const {
+        if (st_->status[s].load(std::memory_order_acquire) == ready || load(s)) {
+            return &*st_->shards[s];
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] static result<lazy_partitioned_phf> from_view(std::unique_ptr<shared> st) {
+        constexpr uint32_t algorithm = partitioned_phf<Inner>::ALGORITHM_ID;
+        if (st->container.algorithm() != algorithm) return std::unexpected(error::invalid_format);
+        auto p = detail::read_partitioned_sections(st->container, algorithm);
+        if (!p) return std::unexpected(p.error());
+
+        lazy_partitioned_phf r;
+        r.seed_ = p->seed;
+        r.hash_rev_ = p->rev;
+        r.num_keys_ = static_cast<size_t>(p->num_keys);
+        r.range_size_ = static_cast<size_t>(p->range_size);
+        r.num_shards_ = static_cast<size_t>(p->num_shards);
+        r.shard_mod_ = detail::fastmod_u64{p->num_shards};
+        st->offsets.assign(p->offsets.begin(), p->offsets.end());
+        st->shards.resize(r.num_shards_);
+        st->once = std::make_unique<std::once_flag[]>(r.num_shards_);
+        st->status = std::make_unique<std::atomic<uint8_t>[]>(r.num_shards_);
+        r.st_ = std::move(st);
+        return r;
+    }
+
+public:
+    lazy_partitioned_phf() = default;
+    lazy_partitioned_phf(lazy_partitioned_phf&&) noexcept = default;
+    lazy_partitioned_phf& operator=(lazy_partitioned_phf&&) noexcept = default;
+
+    /// Map the container at `path` and read its meta and offsets. No shard
+    /// is decoded.
+    [[nodiscard]] static result<lazy_partitioned_phf> open(const std::string& path, bool verify = true) {
+        auto st = std::make_unique<shared>();
+        auto mf = mapped_file::open(path);
+        if (!mf) return std::unexpected(mf.error());
+        st->file = std::move(*mf);
+        auto v = container_view::open(st->file.bytes());
+        if (!v) return std::unexpected(v.error());
+        st->container = *v;
+        st->verify = verify;
+        return from_view(std::move(st));
+    }
+
+    /// Over bytes the caller keeps alive for the lifetime of the result.
+    [[nodiscard]] static result<lazy_partitioned_phf> bind(std::span<const std::byte> data,
+                                                           bool verify = true) {
+        auto v = container_view::open(data);
+        if (!v) return std::unexpected(v.error());
+        auto st = std::make_unique<shared>();
+        st->container = *v;
+        st->verify = verify;
+        return from_view(std::move(st));
+    }
+
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_for(hashed_key{digest});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        const size_t s = shard_of(hk);
+        const Inner* sh = shard_ptr(s);
+        if (sh == nullptr) return slot_index{range_size_};
+        return slot_index{st_->offsets[s] + slot_for_hashed(*sh, hk).value};
+    }
+
+    [[nodiscard]] size_t shard_of(const hashed_key& hk) const noexcept {
+        return static_cast<size_t>(shard_mod_(detail::partition_shard_hash(hk, seed_, hash_rev_)));
+    }
+
+    [[nodiscard]] size_t shard_of(std::string_view key) const noexcept {
+        return shard_of(hashed_key{key});
+    }
+
+    /// Load these shards now, over `threads` threads. invalid_format if
+    /// any of them fails its checksum or does not decode; out-of-range
+    /// shard numbers are skipped.
+    [[nodiscard]] result<void> prefault(std::span<const size_t> shards, size_t threads = 1) const {
+        std::atomic<size_t> next{0};
+        std::atomic<bool> ok{true};
+        auto work = [&] {
+            for (size_t i = next++; i < shards.size(); i = next++) {
+                if (shards[i] < num_shards_ && !load(shards[i])) ok = false;
+            }
+        };
+        threads = std::clamp<size_t>(threads, 1, std::max<size_t>(shards.size(), 1));
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) pool.emplace_back(work);
+        work();
+        for (auto& t : pool) t.join();
+        if (!ok) return std::unexpected(error::invalid_format);
+        return {};
+    }
+
+    /// Load the shards these keys route to.
+    [[nodiscard]] result<void> prefault_keys(std::span<const std::string_view> keys,
+                                             size_t threads = 1) const {
+        std::vector<size_t> shards;
+        shards.reserve(keys.size());
+        for (auto k : keys) shards.push_back(shard_of(k));
+        std::sort(shards.begin(), shards.end());
+        shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+        return prefault(shards, threads);
+    }
+
+    [[nodiscard]] result<void> prefault_all(size_t threads = 1) const {
+        std::vector<size_t> shards(num_shards_);
+        for (size_t i = 0; i < num_shards_; ++i) shards[i] = i;
+        return prefault(shards, threads);
+    }
+
+    [[nodiscard]] bool is_loaded(size_t shard) const noexcept {
+        return shard < num_shards_ && st_->status[shard].load(std::memory_order_acquire) == ready;
+    }
+
+    [[nodiscard]] size_t loaded_shards() const noexcept {
+        return st_ ? st_->loaded.load(std::memory_order_relaxed) : 0;
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return num_shards_; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(num_keys_);
+    }
+
+    /// Bytes held now: the loaded shards and the per-shard bookkeeping.
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        size_t total = sizeof(*this);
+        if (!st_) return total;
+        total += sizeof(shared) + st_->offsets.size() * sizeof(uint64_t)
+               + num_shards_ * (sizeof(std::optional<Inner>) + sizeof(std::once_flag)
+                                + sizeof(std::atomic<uint8_t>));
+        for (size_t i = 0; i < num_shards_; ++i) {
+            if (is_loaded(i)) total += st_->shards[i]->memory_bytes();
+        }
+        return total;
+    }
+
+    /// The container it was opened from.
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        if (!st_) return {};
+        const auto bytes = st_->container.bytes();
+        return {bytes.begin(), bytes.end()};
+    }
+};
+
+} // namespace maph
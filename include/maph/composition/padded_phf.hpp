@@ -36,8 +36,12 @@
 
 #include "../concepts/perfect_hash_function.hpp"
 #include "../core.hpp"
+#include "../detail/build_report.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 
 #include <array>
 #include <bit>
@@ -59,14 +63,21 @@ class padded_phf {
 public:
     padded_phf() = default;
 
-    padded_phf(Inner inner, uint64_t padding_factor, uint64_t pad_seed)
+    padded_phf(Inner inner, uint64_t padding_factor, uint64_t pad_seed,
+               hash_revision rev = hash_revision::wide, bool digest_offset = true)
         : inner_(std::move(inner)),
           padding_factor_(padding_factor),
-          pad_seed_(pad_seed) {}
+          pad_seed_(pad_seed),
+          hash_rev_(rev),
+          digest_offset_(digest_offset && rev == hash_revision::wide) {}
 
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
-        uint64_t m = static_cast<uint64_t>(inner_.slot_for(key).value);
-        uint64_t off = offset_for(key);
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        uint64_t m = static_cast<uint64_t>(slot_for_hashed(inner_, hk).value);
+        uint64_t off = offset_for(hk);
         return slot_index{m * padding_factor_ + off};
     }
 
@@ -88,12 +99,17 @@ public:
         return inner_.memory_bytes() + sizeof(padding_factor_) + sizeof(pad_seed_);
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return detail::member_heap_bytes(inner_); }
+
     [[nodiscard]] uint64_t padding_factor() const noexcept { return padding_factor_; }
     [[nodiscard]] const Inner& inner() const noexcept { return inner_; }
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::append(out, padding_factor_);
+        uint64_t factor = padding_factor_;
+        if (hash_rev_ == hash_revision::wide) factor |= wide_factor_flag;
+        if (digest_offset_) factor |= digest_offset_flag;
+        phf_serial::append(out, factor);
         phf_serial::append(out, pad_seed_);
         auto inner_bytes = inner_.serialize();
         phf_serial::append(out, static_cast<uint64_t>(inner_bytes.size()));
@@ -114,7 +130,12 @@ public:
         }
         auto inner_r = Inner::deserialize(inner_span);
         if (!inner_r) return std::unexpected(inner_r.error());
-        return padded_phf{std::move(*inner_r), factor, seed};
+        auto rev = (factor & wide_factor_flag) ? hash_revision::wide
+                                               : hash_revision::fnv1a;
+        const bool digest_offset = (factor & digest_offset_flag) != 0;
+        factor &= ~(wide_factor_flag | digest_offset_flag);
+        if (factor == 0) return std::unexpected(error::invalid_format);
+        return padded_phf{std::move(*inner_r), factor, seed, rev, digest_offset};
     }
 
     // ===== Builder =====
@@ -142,6 +163,17 @@ public:
             return *this;
         }
 
+        builder& add_all(std::span<const std::string_view> keys) {
+            for (auto k : keys) inner_builder_.add(k);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            detail::borrow_keys_into(inner_builder_, keys);
+            return *this;
+        }
+
         // Stride: padded range = inner.range * padding_factor.
         // padding_factor = 1 is a no-op wrapper.
         builder& with_padding(uint64_t factor) {
@@ -165,6 +197,25 @@ public:
             return *this;
         }
 
+        builder& with_executor(executor& ex)
+            requires requires(typename Inner::builder& b) { b.with_executor(ex); } {
+            inner_builder_.with_executor(ex);
+            return *this;
+        }
+
+        // The report is the inner PHF build's.
+        builder& with_report(build_report& report)
+            requires requires(typename Inner::builder& b) { b.with_report(report); } {
+            inner_builder_.with_report(report);
+            return *this;
+        }
+
+        builder& with_dedup(key_dedup mode)
+            requires requires(typename Inner::builder& b) { b.with_dedup(mode); } {
+            inner_builder_.with_dedup(mode);
+            return *this;
+        }
+
         [[nodiscard]] result<padded_phf> build() {
             auto r = inner_builder_.build();
             if (!r) return std::unexpected(r.error());
@@ -176,12 +227,26 @@ private:
     Inner inner_{};
     uint64_t padding_factor_{1};
     uint64_t pad_seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
+    bool digest_offset_{true};
+
+    // The factor field has no header to version it, so its top bit marks
+    // data written with the wide key hash (format version 3 and later),
+    // and the next one data whose offsets come from offset_for's
+    // multiply-high path.
+    static constexpr uint64_t wide_factor_flag = uint64_t{1} << 63;
+    static constexpr uint64_t digest_offset_flag = uint64_t{1} << 62;
 
     // Offset within the row for a given key. Uses an independent hash
     // of the key keyed by pad_seed_ so the choice is decorrelated from
     // the inner PHF's slot assignment.
-    uint64_t offset_for(std::string_view key) const noexcept {
-        uint64_t h = phf_hash_with_seed(key, pad_seed_);
+    uint64_t offset_for(const hashed_key& key) const noexcept {
+        if (digest_offset_) {
+            // wymix's high bits are well mixed; no finalizer or division.
+            const uint64_t h = phf_hash_with_seed(key.digest, pad_seed_);
+            return static_cast<uint64_t>((static_cast<__uint128_t>(h) * padding_factor_) >> 64);
+        }
+        uint64_t h = phf_hash_with_seed(key, pad_seed_, hash_rev_);
         h ^= h >> 33;
         h *= 0xff51afd7ed558ccdULL;
         h ^= h >> 33;
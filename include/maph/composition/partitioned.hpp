@@ -6,27 +6,60 @@
  * builds one Inner PHF per shard in parallel, and presents a unified
  * slot_for() that returns shard_offset + inner.slot_for. Each shard is
  * independent so build time scales near-linearly with threads; the ceiling
- * is set by the largest shard's build time.
+ * is set by the largest shard's build time. Each worker thread lends one
+ * build_scratch to all its inner builds that take it (phobic_phf does),
+ * so the thousands of small shard builds recycle their working memory.
  *
  * When every inner PHF is minimal (range_size == num_keys), the partitioned
  * PHF is also minimal. If inner builds bump alpha to succeed, the outer
  * total range may exceed num_keys.
  *
  * Serialization embeds each shard's bytes with a length prefix.
+ * partitioned_phf_view<InnerView> queries that layout in place, e.g. over
+ * a mapped_file, without copying any shard. to_container() instead writes
+ * one aligned, checksummed section per shard (detail/container.hpp).
+ *
+ * partitioned_phf::stream_builder builds the same structure in bounded
+ * memory: keys are spilled to per-shard temporary files as they arrive
+ * and each shard is loaded only while it is being built.
+ *
+ * A changed key only moves its own shard, so builder::with_previous(old,
+ * added, removed) rebuilds just the shards those keys route to and copies
+ * the rest from old. with_stable_ranges(slack) reserves slack slots after
+ * each shard's range; a rebuilt shard that still fits keeps its offset,
+ * so a value array indexed by slot only needs that shard's slots updated.
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
+#include "../detail/memory_report.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/container.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/build_scratch.hpp"
 #include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/shard_spill.hpp"
+#include "../detail/task_pool.hpp"
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <cmath>
+#include <concepts>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <istream>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
@@ -36,6 +69,102 @@
 
 namespace maph {
 
+template<size_t BucketSize, typename Storage>
+class flat_partitioned_phf;
+
+namespace detail {
+
+// First-level routing hash, shared by partitioned_phf and its view.
+template<typename Key>
+inline uint64_t partition_shard_hash(const Key& key, uint64_t seed,
+                                     hash_revision rev = hash_revision::wide) noexcept {
+    uint64_t h = phf_hash_with_seed(key, seed ^ 0x3a2e0c73b8b6c7d1ULL, rev);
+    return phf_remix(h);
+}
+
+// The meta and offsets sections of a partitioned container, checked
+// against each other and the shard section count.
+struct partitioned_sections {
+    uint64_t seed{0};
+    uint64_t num_keys{0};
+    uint64_t range_size{0};
+    uint64_t num_shards{0};
+    hash_revision rev{hash_revision::wide};
+    std::span<const uint64_t> offsets{};
+};
+
+[[nodiscard]] inline result<partitioned_sections>
+read_partitioned_sections(const container_view& v, uint32_t algorithm) {
+    auto meta = v.checked(section_tag::meta);
+    if (!meta) return std::unexpected(meta.error());
+    phf_serial::reader rd(*meta);
+    auto version = phf_serial::read_header(rd, algorithm);
+    partitioned_sections p;
+    if (!version || !rd.read(p.seed) || !rd.read(p.num_keys) ||
+        !rd.read(p.range_size) || !rd.read(p.num_shards)) {
+        return std::unexpected(error::invalid_format);
+    }
+    p.rev = phf_serial::revision_for_version(*version);
+    auto offsets = v.array<uint64_t>(section_tag::offsets);
+    if (!offsets) return std::unexpected(offsets.error());
+    p.offsets = *offsets;
+    if (p.num_shards == 0 || p.offsets.size() != p.num_shards + 1
+        || v.count(section_tag::shard) != p.num_shards) {
+        return std::unexpected(error::invalid_format);
+    }
+    return p;
+}
+
+} // namespace detail
+
+/**
+ * The first level of partitioned_phf on its own: which shard a key routes
+ * to, from the seed and shard count alone. A client that spreads one key
+ * set over several nodes routes with this (or a shard_manifest around it)
+ * without holding any shard. Stable: the same seed, count and hash
+ * revision route every key to the same shard as the structure they came
+ * from, member or not.
+ */
+class partition_router {
+    uint64_t seed_{0};
+    size_t num_shards_{0};
+    detail::fastmod_u64 shard_mod_{};
+    hash_revision hash_rev_{hash_revision::wide};
+
+public:
+    partition_router() = default;
+
+    /// num_shards must be at least one.
+    partition_router(uint64_t seed, size_t num_shards,
+                     hash_revision rev = hash_revision::wide) noexcept
+        : seed_(seed), num_shards_(num_shards), shard_mod_(num_shards), hash_rev_(rev) {}
+
+    [[nodiscard]] size_t shard_of(const hashed_key& hk) const noexcept {
+        return static_cast<size_t>(shard_mod_(detail::partition_shard_hash(hk, seed_, hash_rev_)));
+    }
+
+    [[nodiscard]] size_t shard_of(std::string_view key) const noexcept {
+        return shard_of(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] size_t shard_of(K key) const noexcept {
+        return shard_of(hashed_key{key});
+    }
+
+    [[nodiscard]] size_t shard_of(const hash128& digest) const noexcept {
+        return shard_of(hashed_key{digest});
+    }
+
+    [[nodiscard]] uint64_t seed() const noexcept { return seed_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return num_shards_; }
+    [[nodiscard]] hash_revision revision() const noexcept { return hash_rev_; }
+
+    friend bool operator==(const partition_router& a, const partition_router& b) noexcept {
+        return a.seed_ == b.seed_ && a.num_shards_ == b.num_shards_ && a.hash_rev_ == b.hash_rev_;
+    }
+};
+
 /**
  * partitioned_phf: shards keys into P groups, builds one Inner PHF per shard,
  * presents a unified slot_for that returns shard_offset + inner.slot_for.
@@ -56,6 +185,7 @@ class partitioned_phf {
 
 public:
     class builder;
+    class stream_builder;
 
 private:
     std::vector<Inner> shards_;
@@ -64,14 +194,19 @@ private:
     size_t num_keys_{0};
     size_t range_size_{0};
     size_t num_shards_{0};
+    detail::fastmod_u64 shard_mod_{};  // % num_shards_ without a division
+    hash_revision hash_rev_{hash_revision::wide};
 
-    static uint64_t shard_hash(std::string_view key, uint64_t seed) noexcept {
-        uint64_t h = phf_hash_with_seed(key, seed ^ 0x3a2e0c73b8b6c7d1ULL);
-        return phf_remix(h);
+    template<size_t, typename> friend class flat_partitioned_phf;
+
+    template<typename Key>
+    static uint64_t shard_hash(const Key& key, uint64_t seed,
+                               hash_revision rev = hash_revision::wide) noexcept {
+        return detail::partition_shard_hash(key, seed, rev);
     }
 
-    size_t shard_for(std::string_view key) const noexcept {
-        return static_cast<size_t>(shard_hash(key, seed_) % num_shards_);
+    size_t shard_for(const hashed_key& key) const noexcept {
+        return static_cast<size_t>(shard_mod_(shard_hash(key, seed_, hash_rev_)));
     }
 
 public:
@@ -80,13 +215,99 @@ public:
     partitioned_phf& operator=(partitioned_phf&&) = default;
 
     [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
-        size_t s = shard_for(key);
-        uint64_t local = shards_[s].slot_for(key).value;
+        return slot_for(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_for(hashed_key{digest});
+    }
+
+    // Routing and the inner lookup share one digest of the key.
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        size_t s = shard_for(hk);
+        uint64_t local = slot_for_hashed(shards_[s], hk).value;
         return slot_index{offsets_[s] + local};
     }
 
+    // Batched lookup in three passes over a window of keys: route each key
+    // and prefetch its shard descriptor; ask the inner PHF to prefetch the
+    // word the key will read (when Inner exposes prefetch()); resolve.
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        hashed_key hks[W];
+        size_t shard_ids[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                shard_ids[i] = shard_for(hks[i]);
+                detail::prefetch_read(&shards_[shard_ids[i]]);
+                detail::prefetch_read(&offsets_[shard_ids[i]]);
+            }
+            if constexpr (requires(const Inner& in, const hashed_key& k) { in.prefetch(k); }) {
+                for (size_t i = 0; i < m; ++i) shards_[shard_ids[i]].prefetch(hks[i]);
+            } else if constexpr (requires(const Inner& in, std::string_view k) { in.prefetch(k); }) {
+                for (size_t i = 0; i < m; ++i) shards_[shard_ids[i]].prefetch(keys[base + i]);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                size_t s = shard_ids[i];
+                out[base + i] = slot_index{
+                    offsets_[s] + slot_for_hashed(shards_[s], hks[i]).value};
+            }
+        }
+    }
+
+    // Interleaved stages (detail/amac.hpp): route and prefetch the shard
+    // descriptor, then run the inner PHF's stages and add the offset.
+    void lookup_start(detail::lookup_cursor& c) const noexcept {
+        c.shard = shard_for(c.hk);
+        c.routed = false;
+        detail::prefetch_read(&shards_[c.shard]);
+        detail::prefetch_read(detail::element_address(offsets_, c.shard));
+    }
+
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        const Inner& inner = shards_[c.shard];
+        if (!c.routed) {
+            c.routed = true;
+            detail::stage_start(inner, c);
+            return false;
+        }
+        if (!detail::phf_step(inner, c)) return false;
+        c.slot += offsets_[c.shard];
+        return true;
+    }
+
     [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
     [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return num_shards_; }
+
+    [[nodiscard]] const Inner& shard(size_t i) const noexcept { return shards_[i]; }
+
+    /// The shard key routes to, member or not.
+    [[nodiscard]] size_t shard_of(std::string_view key) const noexcept {
+        return shard_for(hashed_key{key});
+    }
+
+    /// First slot of shard i's reserved range; shard_offset(num_shards())
+    /// is range_size(). With stable ranges the reservation exceeds
+    /// shard(i).range_size() by its slack.
+    [[nodiscard]] uint64_t shard_offset(size_t i) const noexcept { return offsets_[i]; }
+
+    /// The routing function alone: shard_of() without the shards.
+    [[nodiscard]] partition_router router() const noexcept {
+        return partition_router{seed_, num_shards_, hash_rev_};
+    }
 
     [[nodiscard]] double bits_per_key() const noexcept {
         if (num_keys_ == 0) return 0.0;
@@ -101,18 +322,17 @@ public:
         return total;
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        size_t total = detail::allocated_bytes(offsets_) + detail::allocated_bytes(shards_);
+        for (const auto& sh : shards_) total += detail::member_heap_bytes(sh);
+        return total;
+    }
+
     static constexpr uint32_t ALGORITHM_ID = 7;
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::write_header(out, ALGORITHM_ID);
-        phf_serial::append(out, seed_);
-        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
-        phf_serial::append(out, static_cast<uint64_t>(range_size_));
-        phf_serial::append(out, static_cast<uint64_t>(num_shards_));
-
-        // Offsets
-        phf_serial::append_vector(out, offsets_);
+        write_prefix(out);
 
         // Each shard: length-prefixed serialized bytes
         for (const auto& sh : shards_) {
@@ -123,11 +343,95 @@ public:
         return out;
     }
 
+    /// serialize() on `threads` workers: the shards serialize in parallel,
+    /// then each is copied, in parallel, to its place in an output
+    /// allocated once at its final size. Same bytes as serialize().
+    [[nodiscard]] std::vector<std::byte> serialize(size_t threads) const {
+        std::vector<std::byte> prefix;
+        write_prefix(prefix);
+        std::vector<std::vector<std::byte>> parts(num_shards_);
+        for_each_shard(num_shards_, threads, [&](size_t i) {
+            parts[i] = shards_[i].serialize();
+            return true;
+        });
+
+        std::vector<size_t> at(num_shards_ + 1);
+        at[0] = prefix.size();
+        for (size_t i = 0; i < num_shards_; ++i) at[i + 1] = at[i] + sizeof(uint64_t) + parts[i].size();
+        std::vector<std::byte> out(at[num_shards_]);
+        std::memcpy(out.data(), prefix.data(), prefix.size());
+        for_each_shard(num_shards_, threads, [&](size_t i) {
+            const uint64_t len = parts[i].size();
+            std::memcpy(out.data() + at[i], &len, sizeof(len));
+            if (len != 0) std::memcpy(out.data() + at[i] + sizeof(len), parts[i].data(), len);
+            std::vector<std::byte>().swap(parts[i]);
+            return true;
+        });
+        return out;
+    }
+
+    /// Size of serialize()'s output, by serializing every shard (on
+    /// `threads` workers) and keeping only the lengths.
+    [[nodiscard]] uint64_t serialized_size(size_t threads = 1) const {
+        std::vector<std::byte> prefix;
+        write_prefix(prefix);
+        std::vector<uint64_t> sizes(num_shards_);
+        for_each_shard(num_shards_, threads, [&](size_t i) {
+            sizes[i] = detail::serialized_size_of(shards_[i], 1);
+            return true;
+        });
+        uint64_t total = prefix.size();
+        for (auto n : sizes) total += sizeof(uint64_t) + n;
+        return total;
+    }
+
+    /// Stream serialize()'s bytes to `sink` without holding them all: shards
+    /// are serialized, `threads` at a time, in windows of a few per thread,
+    /// and written out in order. io_error once the sink fails.
+    template<typename Sink>
+        requires phf_serial::byte_sink<Sink>
+    [[nodiscard]] result<void> serialize_to(Sink& sink, size_t threads = 1) const {
+        std::vector<std::byte> prefix;
+        write_prefix(prefix);
+        if (!sink(std::span<const std::byte>(prefix))) return std::unexpected(error::io_error);
+
+        const size_t window = std::max<size_t>(threads, 1) * 4;
+        std::vector<std::vector<std::byte>> parts(std::min(window, num_shards_));
+        for (size_t base = 0; base < num_shards_; base += window) {
+            const size_t m = std::min(window, num_shards_ - base);
+            for_each_shard(m, threads, [&](size_t i) {
+                parts[i] = shards_[base + i].serialize();
+                return true;
+            });
+            for (size_t i = 0; i < m; ++i) {
+                const uint64_t len = parts[i].size();
+                const auto len_bytes = std::bit_cast<std::array<std::byte, sizeof(len)>>(len);
+                if (!sink(std::span<const std::byte>(len_bytes)) ||
+                    !sink(std::span<const std::byte>(parts[i]))) {
+                    return std::unexpected(error::io_error);
+                }
+            }
+        }
+        return {};
+    }
+
+    [[nodiscard]] result<void> serialize_to(std::ostream& os, size_t threads = 1) const {
+        phf_serial::ostream_sink sink{os};
+        return serialize_to(sink, threads);
+    }
+
     [[nodiscard]] static result<partitioned_phf> deserialize(std::span<const std::byte> data) {
+        return deserialize(data, 1);
+    }
+
+    /// deserialize() with the shards decoded on `threads` workers. The
+    /// length prefixes are walked first, so each worker knows its shard's
+    /// bytes without waiting for the shards before it.
+    [[nodiscard]] static result<partitioned_phf> deserialize(std::span<const std::byte> data,
+                                                             size_t threads) {
         phf_serial::reader rd(data);
-        if (!phf_serial::verify_header(rd, ALGORITHM_ID)) {
-            return std::unexpected(error::invalid_format);
-        }
+        auto version = phf_serial::read_header(rd, ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
 
         uint64_t seed{}, nkeys{}, rsize{}, nshards{};
         if (!rd.read(seed) || !rd.read(nkeys) ||
@@ -137,49 +441,398 @@ public:
 
         partitioned_phf r;
         r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_version(*version);
         r.num_keys_ = static_cast<size_t>(nkeys);
         r.range_size_ = static_cast<size_t>(rsize);
         r.num_shards_ = static_cast<size_t>(nshards);
 
         if (!rd.read_vector(r.offsets_)) return std::unexpected(error::invalid_format);
-        if (r.offsets_.size() != r.num_shards_ + 1) return std::unexpected(error::invalid_format);
+        if (r.num_shards_ == 0 || r.offsets_.size() != r.num_shards_ + 1) {
+            return std::unexpected(error::invalid_format);
+        }
+        r.shard_mod_ = detail::fastmod_u64{nshards};
 
-        r.shards_.reserve(r.num_shards_);
-        for (size_t i = 0; i < r.num_shards_; ++i) {
+        std::vector<std::span<const std::byte>> spans(r.num_shards_);
+        for (auto& shard_span : spans) {
             uint64_t len{};
-            if (!rd.read(len)) return std::unexpected(error::invalid_format);
-            std::span<const std::byte> shard_span;
-            if (!rd.read_span(shard_span, static_cast<size_t>(len))) {
+            if (!rd.read(len) || !rd.read_span(shard_span, static_cast<size_t>(len))) {
                 return std::unexpected(error::invalid_format);
             }
-            auto shard = Inner::deserialize(shard_span);
-            if (!shard.has_value()) return std::unexpected(shard.error());
-            r.shards_.push_back(std::move(*shard));
+        }
+        if (auto e = r.decode_shards(threads, [&](size_t i) { return spans[i]; }); e != error::success) {
+            return std::unexpected(e);
+        }
+        return r;
+    }
+
+    static constexpr uint32_t SHARD_GROUP_ID = 14;
+
+    /// A subset of the shards on their own, for a node that serves only
+    /// those: the routing fields and the global slot offsets of every
+    /// shard, then per listed shard its id and its length-prefixed
+    /// serialize() bytes. Loaded by
+    /// partitioned_shard_group (composition/shard_manifest.hpp), whose
+    /// slot_for() gives the same global slots as this structure for keys
+    /// routed to the group. Shards are written in ascending order, once
+    /// each; out-of-range shard numbers are skipped.
+    [[nodiscard]] std::vector<std::byte> serialize_shards(std::span<const size_t> shards) const {
+        std::vector<size_t> ids;
+        for (size_t i : shards) {
+            if (i < num_shards_) ids.push_back(i);
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        std::vector<std::byte> out;
+        phf_serial::write_header(out, SHARD_GROUP_ID, std::nullopt, hash_rev_);
+        phf_serial::append(out, seed_);
+        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
+        phf_serial::append(out, static_cast<uint64_t>(range_size_));
+        phf_serial::append(out, static_cast<uint64_t>(num_shards_));
+        phf_serial::append_vector(out, offsets_);
+        phf_serial::append(out, static_cast<uint64_t>(ids.size()));
+        for (size_t i : ids) {
+            auto bytes = shards_[i].serialize();
+            phf_serial::append(out, static_cast<uint64_t>(i));
+            phf_serial::append(out, static_cast<uint64_t>(bytes.size()));
+            out.insert(out.end(), bytes.begin(), bytes.end());
+        }
+        return out;
+    }
+
+    /// Container sections (detail/container.hpp): meta (the serialize()
+    /// prefix up to the shard count), offsets as a uint64_t array, and one
+    /// shard section per shard holding its serialize() bytes.
+    void write_sections(container_writer& w) const {
+        std::vector<std::byte> meta;
+        write_prefix_fields(meta);
+        w.add(section_tag::meta, std::move(meta));
+        w.add_array(section_tag::offsets, 0, std::span<const uint64_t>(offsets_));
+        for (size_t i = 0; i < num_shards_; ++i) {
+            w.add(section_tag::shard, static_cast<uint32_t>(i), shards_[i].serialize());
+        }
+    }
+
+    /// Load write_sections() output, checksumming and decoding the shards
+    /// on `threads` workers.
+    [[nodiscard]] static result<partitioned_phf> read_sections(const container_view& v,
+                                                               size_t threads = 1) {
+        auto p = detail::read_partitioned_sections(v, ALGORITHM_ID);
+        if (!p) return std::unexpected(p.error());
+
+        partitioned_phf r;
+        r.seed_ = p->seed;
+        r.hash_rev_ = p->rev;
+        r.num_keys_ = static_cast<size_t>(p->num_keys);
+        r.range_size_ = static_cast<size_t>(p->range_size);
+        r.num_shards_ = static_cast<size_t>(p->num_shards);
+        r.offsets_.assign(p->offsets.begin(), p->offsets.end());
+        r.shard_mod_ = detail::fastmod_u64{p->num_shards};
+        auto e = r.decode_shards(threads, [&](size_t i) -> std::optional<std::span<const std::byte>> {
+            auto bytes = v.checked(section_tag::shard, static_cast<uint32_t>(i));
+            if (!bytes) return std::nullopt;
+            return *bytes;
+        });
+        if (e != error::success) return std::unexpected(e);
+        return r;
+    }
+
+private:
+    // Header and scalar fields through the shard count: the start of
+    // serialize() and the meta section.
+    void write_prefix_fields(std::vector<std::byte>& out) const {
+        phf_serial::write_header(out, ALGORITHM_ID, std::nullopt, hash_rev_);
+        phf_serial::append(out, seed_);
+        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
+        phf_serial::append(out, static_cast<uint64_t>(range_size_));
+        phf_serial::append(out, static_cast<uint64_t>(num_shards_));
+    }
+
+    // Everything serialize() writes before the first shard.
+    void write_prefix(std::vector<std::byte>& out) const {
+        write_prefix_fields(out);
+        phf_serial::append_vector(out, offsets_);
+    }
+
+    // fn(i) for i in [0, n) on up to `threads` workers taking indices from
+    // a shared counter; inline when one thread suffices. Stops handing out
+    // indices once fn returns false.
+    template<typename Fn>
+    static void for_each_shard(size_t n, size_t threads, Fn&& fn) {
+        threads = std::clamp<size_t>(threads, 1, std::max<size_t>(n, 1));
+        std::atomic<size_t> next{0};
+        std::atomic<bool> stop{false};
+        auto worker = [&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n) break;
+                if (!fn(i)) stop = true;
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+    }
+
+    // Decode shards_[i] from bytes_of(i) (a span, or nullopt when it is
+    // missing or damaged) on `threads` workers; the first error wins.
+    template<typename BytesOf>
+    error decode_shards(size_t threads, BytesOf&& bytes_of) {
+        shards_.resize(num_shards_);
+        std::atomic<error> failure{error::success};
+        for_each_shard(num_shards_, threads, [&](size_t i) {
+            std::optional<std::span<const std::byte>> bytes = bytes_of(i);
+            error e = error::invalid_format;
+            if (bytes) {
+                auto shard = Inner::deserialize(*bytes);
+                if (shard.has_value()) {
+                    shards_[i] = std::move(*shard);
+                    return true;
+                }
+                e = shard.error();
+            }
+            error expected = error::success;
+            failure.compare_exchange_strong(expected, e, std::memory_order_acq_rel);
+            return false;
+        });
+        return failure.load(std::memory_order_acquire);
+    }
+
+    // Inner builders that take a build_scratch build in the worker's.
+    template<typename Builder>
+    static void lend_scratch(Builder& b, build_scratch& scratch) {
+        if constexpr (requires { b.with_scratch(scratch); }) b.with_scratch(scratch);
+    }
+
+    // Inner builders that take a build_report fill the shard's, if asked.
+    template<typename Builder>
+    static void lend_report(Builder& b, build_report* report) {
+        if constexpr (requires { b.with_report(*report); }) {
+            if (report != nullptr) b.with_report(*report);
+        }
+    }
+
+    // Inner builders that take an executor run on ex, when there is one.
+    template<typename Builder>
+    static void lend_executor(Builder& b, executor* ex) {
+        if constexpr (requires { b.with_executor(*ex); }) {
+            if (ex != nullptr) b.with_executor(*ex);
+        }
+    }
+
+    // Derive per-shard seed so each shard's builds are independent.
+    static uint64_t shard_seed(uint64_t seed, size_t shard) noexcept {
+        return seed + shard * 0x9e3779b97f4a7c15ULL;
+    }
+
+    // A shard reused by an incremental rebuild.
+    static result<Inner> copy_shard(const Inner& shard) {
+        if constexpr (std::copy_constructible<Inner>) {
+            return shard;
+        } else {
+            return Inner::deserialize(shard.serialize());
+        }
+    }
+
+    // True if shard still maps every one of keys (string views or
+    // digests) to a distinct slot in its range, so it can be reused for
+    // them as is.
+    template<typename Key>
+    static bool still_perfect(const Inner& shard, std::span<const Key> keys) {
+        const size_t range = shard.range_size();
+        if (keys.size() != shard.num_keys() || keys.size() > range) return false;
+        std::vector<uint64_t> seen((range + 63) / 64, 0);
+        for (const auto& k : keys) {
+            const auto slot = static_cast<size_t>(slot_for_hashed(shard, hashed_key{k}).value);
+            if (slot >= range) return false;
+            uint64_t& word = seen[slot >> 6];
+            const uint64_t bit = uint64_t{1} << (slot & 63);
+            if (word & bit) return false;
+            word |= bit;
+        }
+        return true;
+    }
+
+    // Shard ranges back to back, each followed by ceil(slack * range)
+    // spare slots. keep_offsets, when every shard still fits in its
+    // reservation there, is kept as is.
+    static std::vector<uint64_t> lay_out(const std::vector<Inner>& shards, double slack,
+                                         const std::vector<uint64_t>* keep_offsets) {
+        const size_t P = shards.size();
+        if (keep_offsets != nullptr && keep_offsets->size() == P + 1) {
+            bool fits = true;
+            for (size_t i = 0; i < P && fits; ++i) {
+                fits = shards[i].range_size() <= (*keep_offsets)[i + 1] - (*keep_offsets)[i];
+            }
+            if (fits) return *keep_offsets;
+        }
+        std::vector<uint64_t> offsets(P + 1, 0);
+        for (size_t i = 0; i < P; ++i) {
+            const auto range = static_cast<uint64_t>(shards[i].range_size());
+            const auto spare = static_cast<uint64_t>(std::ceil(slack * static_cast<double>(range)));
+            offsets[i + 1] = offsets[i] + range + spare;
+        }
+        return offsets;
+    }
+
+    // Below this many keys a shard's own build stays on one thread (the
+    // PHOBIC parallel cutoff), so lending it the executor would serialize
+    // the shards for nothing.
+    static constexpr size_t LEND_MIN_SHARD_KEYS = 2048;
+
+    // Run build_shard(i, scratch, lend, shard_report) -> result<Inner> for
+    // every shard on nthreads workers (work-stealing over a shared counter),
+    // then lay the shard ranges out (lay_out). Stops at the first failure.
+    // Each worker keeps one build_scratch for all the shards it builds.
+    // With a report, shard i is lent report->shards[i] (null otherwise),
+    // and the shards' reports are summed into it.
+    //
+    // With an executor ex the workers are its threads. When there are
+    // fewer shards than threads, the inner builder takes an executor, and
+    // the average shard (num_keys / P) is big enough for its own parallel
+    // path, the shards build one after another instead, each lent ex
+    // (lend) to spread its own work over all of them.
+    template<typename BuildShard>
+    static result<partitioned_phf> build_shards(size_t P, size_t num_keys, size_t nthreads,
+                                                executor* ex, uint64_t seed,
+                                                BuildShard&& build_shard, build_report* report,
+                                                double slack = 0.0,
+                                                const std::vector<uint64_t>* keep_offsets = nullptr) {
+        std::vector<Inner> shards(P);
+        if (report != nullptr) report->shards.assign(P, build_report{});
+        std::atomic<size_t> next_shard{0};
+        std::atomic<error> failure{error::success};
+        constexpr bool inner_takes_executor =
+            requires(typename Inner::builder& b, executor& e) { b.with_executor(e); };
+        executor* const lend = inner_takes_executor && ex != nullptr && ex->parallel()
+            && P < ex->size() && num_keys / P >= LEND_MIN_SHARD_KEYS ? ex : nullptr;
+
+        auto worker = [&]() {
+            build_scratch scratch;
+            while (failure.load(std::memory_order_acquire) == error::success) {
+                size_t i = next_shard.fetch_add(1, std::memory_order_relaxed);
+                if (i >= P) break;
+                auto built = build_shard(i, scratch, lend,
+                                         report != nullptr ? &report->shards[i] : nullptr);
+                if (!built.has_value()) {
+                    error expected = error::success;
+                    failure.compare_exchange_strong(expected, built.error(),
+                                                    std::memory_order_acq_rel);
+                    return;
+                }
+                shards[i] = std::move(*built);
+            }
+        };
+
+        if (lend != nullptr) {
+            worker();
+        } else {
+            detail::run_workers(nthreads, worker);
+        }
+
+        if (error e = failure.load(std::memory_order_acquire); e != error::success) {
+            return std::unexpected(e);
+        }
+
+        auto offsets = lay_out(shards, slack, keep_offsets);
+        size_t n = 0;
+        for (const auto& sh : shards) n += sh.num_keys();
+
+        partitioned_phf r;
+        r.shards_ = std::move(shards);
+        r.offsets_ = std::move(offsets);
+        r.seed_ = seed;
+        r.num_keys_ = n;
+        r.range_size_ = static_cast<size_t>(r.offsets_.back());
+        r.num_shards_ = P;
+        r.shard_mod_ = detail::fastmod_u64{P};
+        if (report != nullptr) {
+            report->keys = n;
+            report->range_size = r.range_size_;
+            report->aggregate_shards();
         }
         return r;
     }
 
+public:
     class builder {
-        std::vector<std::string> keys_;
+        detail::key_store keys_;
+        std::vector<hash128> hashes_{};  // add_hashes()
+        key_dedup dedup_{key_dedup::sort};
         uint64_t seed_{0xac32e5f5b3a8a3d7ULL};
         size_t num_shards_{0};  // 0 = auto (target ~15000 keys/shard)
         size_t threads_{0};     // 0 = auto (hardware_concurrency)
+        executor* executor_{nullptr};
+        double slack_{0.0};
+        bool stable_ranges_{false};
+        const partitioned_phf* previous_{nullptr};
+        std::vector<bool> touched_{};  // per shard of previous_
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key) {
-            keys_.emplace_back(key);
+            keys_.add(key);
+            return *this;
+        }
+
+        template<integer_key K>
+        builder& add(const K& key) {
+            keys_.add(key);
             return *this;
         }
 
         builder& add_all(const std::vector<std::string>& keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(std::span<const std::string>{keys});
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys) {
-            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        builder& add_all(std::span<const uint64_t> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        builder& add_all(std::span<const __uint128_t> keys) {
+            keys_.add_all(keys);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_all(std::span<const uint64_t> keys) {
+            keys_.borrow_all(keys);
+            return *this;
+        }
+
+        builder& borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+            keys_.borrow_blob(blob, offsets);
+            return *this;
+        }
+
+        // Keys known only by their digest, phf_hash128(key). Routed by
+        // digest and handed to each shard's add_hashes(); build() returns
+        // error::duplicate_key if two digests are equal.
+        builder& add_hashes(std::span<const hash128> digests)
+            requires requires(typename Inner::builder b, std::span<const hash128> h) { b.add_hashes(h); }
+        {
+            hashes_.insert(hashes_.end(), digests.begin(), digests.end());
             return *this;
         }
 
@@ -198,14 +851,89 @@ public:
             return *this;
         }
 
+        /// Build on a shared pool, which replaces with_threads: shards,
+        /// dedup and partitioning run on its threads, and so do the inner
+        /// builds' own loops when there are fewer shards than threads and
+        /// the shards are large enough to use them (build_shards).
+        builder& with_executor(executor& ex) {
+            executor_ = &ex;
+            return *this;
+        }
+
+        // See key_dedup.
+        builder& with_dedup(key_dedup mode) {
+            dedup_ = mode;
+            return *this;
+        }
+
+        /// Reserve ceil(slack * range) spare slots after each shard's range
+        /// (e.g. 0.05), and in a with_previous() rebuild keep every offset
+        /// of the previous layout when each rebuilt shard still fits its
+        /// reservation. The range is no longer minimal.
+        builder& with_stable_ranges(double slack) {
+            slack_ = slack;
+            stable_ranges_ = true;
+            return *this;
+        }
+
+        /// Rebuild against old: the keys added are the full new key set,
+        /// and only shards some added or removed key routes to are built;
+        /// the others are copied from old. The seed and shard count come
+        /// from old. An untouched shard is reused only if it still maps
+        /// its keys one-to-one into its range, checked with one query per
+        /// key; otherwise it is rebuilt, so a change missing from added or
+        /// removed costs a rebuild rather than a broken shard. old must
+        /// outlive build().
+        builder& with_previous(const partitioned_phf& old,
+                               std::span<const std::string_view> added,
+                               std::span<const std::string_view> removed) {
+            previous_ = &old;
+            touched_.assign(old.num_shards_, false);
+            for (auto k : added) touched_[old.shard_of(k)] = true;
+            for (auto k : removed) touched_[old.shard_of(k)] = true;
+            return *this;
+        }
+
+        /// See build_report.hpp. Each shard's inner build is reported in
+        /// report.shards and summed into the rest, with the dedup and
+        /// routing of the keys under sort.
+        builder& with_report(build_report& report) {
+            report_ = &report;
+            return *this;
+        }
+
         [[nodiscard]] result<partitioned_phf> build() {
-            if (keys_.empty()) return std::unexpected(error::optimization_failed);
+            if (keys_.empty() && hashes_.empty()) return std::unexpected(error::optimization_failed);
+            const detail::build_recorder rec{report_};
 
-            std::sort(keys_.begin(), keys_.end());
-            keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
-            size_t n = keys_.size();
+            size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+            if (nthreads == 0) {
+                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            }
+            detail::executor_scope scope{executor_};
+
+            // Digests are merged into a copy, so a failed build leaves the
+            // builder as it was.
+            auto sorting = rec.time(build_report::phase::sort);
+            std::vector<hash128> digests;
+            if (hashes_.empty()) {
+                keys_.dedup(dedup_, nthreads);
+            } else {
+                digests = hashes_;
+                if (!detail::merge_digests(digests, keys_.views())) {
+                    return std::unexpected(error::duplicate_key);
+                }
+            }
+            size_t n = digests.empty() ? keys_.size() : digests.size();
+
+            // Shards of a previous build keep its routing; builds of the
+            // older hash revision route differently and start over.
+            const partitioned_phf* prev =
+                previous_ != nullptr && previous_->hash_rev_ == hash_revision::wide
+                    && previous_->num_shards_ <= n ? previous_ : nullptr;
+            if (prev != nullptr) seed_ = prev->seed_;
 
-            size_t P = num_shards_;
+            size_t P = prev != nullptr ? prev->num_shards_ : num_shards_;
             if (P == 0) {
                 // Target ~15000 keys per shard; clamp to reasonable range.
                 P = std::max<size_t>(1, (n + 14999) / 15000);
@@ -213,66 +941,372 @@ public:
             if (P > n) P = n;  // can't have empty shards in the scheme we use
             if (P == 0) P = 1;
 
-            size_t nthreads = threads_;
-            if (nthreads == 0) {
-                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            // Partition keys into shards with a stable counting sort; each
+            // shard borrows its contiguous range of keys_, already unique.
+            // Digests are grouped the same way, routed as their keys are.
+            std::vector<size_t> shard_begin;
+            if (digests.empty()) {
+                shard_begin = keys_.partition_by_digest(P, [&](const hash128& d) {
+                    return static_cast<size_t>(shard_hash(hashed_key{d}, seed_) % P);
+                }, nthreads);
+            } else {
+                shard_begin = detail::radix_partition(digests, P, [&](size_t i) {
+                    return static_cast<size_t>(shard_hash(hashed_key{digests[i]}, seed_) % P);
+                }, nthreads);
             }
+            sorting.stop();
+            auto shard_size = [&](size_t i) { return shard_begin[i + 1] - shard_begin[i]; };
+            auto shard_keys = [&](size_t i) {
+                return keys_.views().subspan(shard_begin[i], shard_size(i));
+            };
 
-            // Partition keys into shards.
-            std::vector<std::vector<std::string>> shard_keys(P);
-            for (auto& k : keys_) {
-                size_t s = static_cast<size_t>(shard_hash(k, seed_) % P);
-                shard_keys[s].push_back(std::move(k));
+            auto built = build_shards(P, n, nthreads, executor_, seed_,
+                                      [&](size_t i, build_scratch& scratch, executor* lend,
+                                          build_report* shard_report) -> result<Inner> {
+                if (prev != nullptr && !touched_[i]) {
+                    const bool reusable = digests.empty()
+                        ? still_perfect(prev->shards_[i], shard_keys(i))
+                        : still_perfect(prev->shards_[i],
+                              std::span<const hash128>{digests}.subspan(shard_begin[i], shard_size(i)));
+                    if (reusable) return copy_shard(prev->shards_[i]);
+                }
+                typename Inner::builder b{};
+                if (digests.empty()) {
+                    detail::borrow_keys_into(b, shard_keys(i));
+                } else if constexpr (requires { b.add_hashes(std::span<const hash128>{}); }) {
+                    b.add_hashes(std::span<const hash128>{digests}.subspan(shard_begin[i], shard_size(i)));
+                }
+                if constexpr (requires { b.with_dedup(key_dedup::none); }) {
+                    b.with_dedup(key_dedup::none);
+                }
+                lend_scratch(b, scratch);
+                lend_executor(b, lend);
+                lend_report(b, shard_report);
+                return b.with_seed(shard_seed(seed_, i)).build();
+            }, rec.get(), slack_, prev != nullptr && stable_ranges_ ? &prev->offsets_ : nullptr);
+            if (built) rec.finish(built->num_keys(), built->range_size());
+            else rec.finish(n, 0);
+            return built;
+        }
+    };
+
+    /// Rebuild only the shards of old that the added or removed keys route
+    /// to; keys is the full new key set. Shorthand for builder{}.add_all(keys)
+    /// .with_previous(old, added, removed).build().
+    [[nodiscard]] static result<partitioned_phf> rebuild_shards(
+        const partitioned_phf& old, std::span<const std::string_view> keys,
+        std::span<const std::string_view> added, std::span<const std::string_view> removed) {
+        return builder{}.add_all(keys).with_previous(old, added, removed).build();
+    }
+
+    /**
+     * stream_builder: external-memory build for key sets that do not fit
+     * in RAM. Each key is sharded as it arrives and appended to its
+     * shard's temporary file once the buffered bytes exceed the memory
+     * budget; build() then loads, builds and frees one shard per worker.
+     * Peak memory is the budget plus about one shard per thread, instead
+     * of every key.
+     *
+     * The shard count is fixed by the first add(): with_shards(P), or
+     * with_expected_keys(n) to size shards like builder's auto mode
+     * (~15000 keys each). With neither, keys spill to one file and
+     * build() picks P from the number streamed, clamped to [1, n], then
+     * re-shards that file in one streaming pass. For the same seed and
+     * shard count the result is identical to builder's. Configure before
+     * adding keys; single use.
+     */
+    class stream_builder {
+        detail::shard_spill spill_;
+        detail::shard_spill resharded_;  // auto mode: spill_ split P ways
+        std::filesystem::path temp_dir_{};
+        uint64_t seed_{0xac32e5f5b3a8a3d7ULL};
+        size_t num_shards_{0};
+        size_t expected_keys_{0};
+        size_t threads_{0};     // 0 = auto (hardware_concurrency)
+        executor* executor_{nullptr};
+        size_t memory_budget_{size_t{256} << 20};
+        build_report* report_{nullptr};
+        size_t streamed_{0};
+        bool auto_shards_{false};
+        bool opened_{false};
+        error error_{error::success};
+
+        bool ensure_open() {
+            if (opened_) return error_ == error::success;
+            opened_ = true;
+            if (num_shards_ == 0 && expected_keys_ > 0) {
+                num_shards_ = std::max<size_t>(1, (expected_keys_ + 14999) / 15000);
             }
+            auto_shards_ = num_shards_ == 0;
+            auto st = spill_.open(temp_dir_, auto_shards_ ? 1 : num_shards_, memory_budget_);
+            if (!st) error_ = st.error();
+            return error_ == error::success;
+        }
 
-            // Build shards in parallel.
-            std::vector<Inner> shards(P);
-            std::atomic<size_t> next_shard{0};
-            std::atomic<bool> failed{false};
-
-            auto worker = [&]() {
-                while (!failed.load(std::memory_order_acquire)) {
-                    size_t i = next_shard.fetch_add(1, std::memory_order_relaxed);
-                    if (i >= P) break;
-                    // Derive per-shard seed so each shard's builds are independent.
-                    uint64_t shard_seed = seed_ + i * 0x9e3779b97f4a7c15ULL;
-                    auto built = typename Inner::builder{}
-                        .add_all(shard_keys[i])
-                        .with_seed(shard_seed)
-                        .build();
-                    if (!built.has_value()) {
-                        failed.store(true, std::memory_order_release);
-                        return;
-                    }
-                    shards[i] = std::move(*built);
-                }
-            };
+        // Auto mode: size shards like builder's auto mode from the count
+        // streamed, and split the single spill file into them.
+        [[nodiscard]] result<void> reshard() {
+            num_shards_ = std::clamp<size_t>((streamed_ + 14999) / 15000, 1,
+                                             std::max<size_t>(1, streamed_));
+            if (num_shards_ == 1) return {};
+            if (auto st = resharded_.open(temp_dir_, num_shards_, memory_budget_); !st) return st;
+            auto st = spill_.scan(0, [&](std::string_view key) {
+                return resharded_.append(static_cast<size_t>(shard_hash(key, seed_) % num_shards_), key);
+            });
+            if (!st) return st;
+            return resharded_.flush_all();
+        }
 
-            std::vector<std::thread> pool;
-            pool.reserve(nthreads);
-            for (size_t t = 0; t < nthreads; ++t) pool.emplace_back(worker);
-            for (auto& th : pool) th.join();
+    public:
+        stream_builder() = default;
 
-            if (failed.load(std::memory_order_acquire)) {
-                return std::unexpected(error::optimization_failed);
+        stream_builder& with_seed(uint64_t seed) { seed_ = seed; return *this; }
+        stream_builder& with_shards(size_t P) { num_shards_ = P; return *this; }
+        stream_builder& with_expected_keys(size_t n) { expected_keys_ = n; return *this; }
+        stream_builder& with_threads(size_t n) { threads_ = n; return *this; }
+        stream_builder& with_executor(executor& ex) { executor_ = &ex; return *this; }
+        /// As builder::with_report; spilling and loading are not timed.
+        stream_builder& with_report(build_report& report) { report_ = &report; return *this; }
+        // Bytes of keys buffered before spilling to disk.
+        stream_builder& with_memory_budget(size_t bytes) { memory_budget_ = bytes; return *this; }
+        // Parent of the spill directory; the system temp directory if unset.
+        stream_builder& with_temp_dir(std::filesystem::path dir) {
+            temp_dir_ = std::move(dir);
+            return *this;
+        }
+
+        stream_builder& add(std::string_view key) {
+            if (!ensure_open()) return *this;
+            size_t s = auto_shards_ ? 0 : static_cast<size_t>(shard_hash(key, seed_) % num_shards_);
+            if (auto st = spill_.append(s, key); !st) error_ = st.error();
+            ++streamed_;
+            return *this;
+        }
+
+        template<std::ranges::input_range R>
+            requires std::convertible_to<std::ranges::range_reference_t<R>, std::string_view>
+        stream_builder& add_all(R&& keys) {
+            for (auto&& k : keys) {
+                if (error_ != error::success) break;
+                add(std::string_view{k});
             }
+            return *this;
+        }
 
-            // Compute prefix-sum offsets.
-            std::vector<uint64_t> offsets(P + 1, 0);
-            for (size_t i = 0; i < P; ++i) {
-                offsets[i + 1] = offsets[i] + static_cast<uint64_t>(shards[i].range_size());
+        // One key per line; a trailing '\r' is kept as part of the key.
+        stream_builder& add_lines(std::istream& in) {
+            std::string line;
+            while (error_ == error::success && std::getline(in, line)) add(line);
+            if (in.bad()) error_ = error::io_error;
+            return *this;
+        }
+
+        [[nodiscard]] result<partitioned_phf> build() {
+            if (!ensure_open()) return std::unexpected(error_);
+            if (auto st = spill_.flush_all(); !st) return std::unexpected(st.error());
+            if (auto_shards_) {
+                if (auto st = reshard(); !st) return std::unexpected(st.error());
             }
+            detail::shard_spill& spill = num_shards_ > spill_.num_shards() ? resharded_ : spill_;
 
-            partitioned_phf r;
-            r.shards_ = std::move(shards);
-            r.offsets_ = std::move(offsets);
-            r.seed_ = seed_;
-            r.num_keys_ = n;
-            r.range_size_ = static_cast<size_t>(r.offsets_.back());
-            r.num_shards_ = P;
-            return r;
+            size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+            if (nthreads == 0) {
+                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            }
+            detail::executor_scope scope{executor_};
+            const detail::build_recorder rec{report_};
+            auto built = build_shards(num_shards_, streamed_, nthreads, executor_, seed_,
+                                      [&](size_t i, build_scratch& scratch, executor* lend,
+                                          build_report* shard_report) -> result<Inner> {
+                auto loaded = spill.load(i);
+                if (!loaded) return std::unexpected(loaded.error());
+                typename Inner::builder b{};
+                detail::borrow_keys_into(b, loaded->keys);
+                lend_scratch(b, scratch);
+                lend_executor(b, lend);
+                lend_report(b, shard_report);
+                return b.with_seed(shard_seed(seed_, i)).build();
+            }, rec.get());
+            if (built) rec.finish(built->num_keys(), built->range_size());
+            else rec.finish(streamed_, 0);
+            return built;
         }
     };
 };
 
+/**
+ * partitioned_phf_view: partitioned_phf queried in place over its
+ * serialized bytes.
+ *
+ * InnerView is the zero-copy counterpart of the shard type (e.g.
+ * phobic_phf_view<5> for partitioned_phf<phobic_phf<5>>). deserialize()
+ * walks the shard length prefixes once and binds one InnerView per shard;
+ * offsets and shard payloads stay in the buffer, which must outlive the
+ * view. Same format and same slot_for() results as partitioned_phf.
+ */
+template<typename InnerView>
+class partitioned_phf_view {
+    static_assert(perfect_hash_function<InnerView>,
+        "partitioned_phf_view InnerView must satisfy perfect_hash_function");
+
+    std::vector<InnerView> shards_;
+    phf_serial::array_view<uint64_t> offsets_{};
+    std::span<const std::byte> bytes_{};
+    uint64_t seed_{0};
+    size_t num_keys_{0};
+    size_t range_size_{0};
+    size_t num_shards_{0};
+    detail::fastmod_u64 shard_mod_{};
+    hash_revision hash_rev_{hash_revision::wide};
+
+    size_t shard_for(const hashed_key& key) const noexcept {
+        return static_cast<size_t>(shard_mod_(detail::partition_shard_hash(key, seed_, hash_rev_)));
+    }
+
+public:
+    partitioned_phf_view() = default;
+
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_for(hashed_key{digest});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        size_t s = shard_for(hk);
+        return slot_index{offsets_[s] + slot_for_hashed(shards_[s], hk).value};
+    }
+
+    void slot_for_batch(std::span<const std::string_view> keys,
+                        std::span<slot_index> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        hashed_key hks[W];
+        size_t shard_ids[W];
+
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                shard_ids[i] = shard_for(hks[i]);
+                detail::prefetch_read(&shards_[shard_ids[i]]);
+                detail::prefetch_read(offsets_.address(shard_ids[i]));
+            }
+            if constexpr (requires(const InnerView& in, const hashed_key& k) { in.prefetch(k); }) {
+                for (size_t i = 0; i < m; ++i) shards_[shard_ids[i]].prefetch(hks[i]);
+            } else if constexpr (requires(const InnerView& in, std::string_view k) { in.prefetch(k); }) {
+                for (size_t i = 0; i < m; ++i) shards_[shard_ids[i]].prefetch(keys[base + i]);
+            }
+            for (size_t i = 0; i < m; ++i) {
+                size_t s = shard_ids[i];
+                out[base + i] = slot_index{
+                    offsets_[s] + slot_for_hashed(shards_[s], hks[i]).value};
+            }
+        }
+    }
+
+    // The same interleaved stages as partitioned_phf.
+    void lookup_start(detail::lookup_cursor& c) const noexcept {
+        c.shard = shard_for(c.hk);
+        c.routed = false;
+        detail::prefetch_read(&shards_[c.shard]);
+        detail::prefetch_read(detail::element_address(offsets_, c.shard));
+    }
+
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        const InnerView& inner = shards_[c.shard];
+        if (!c.routed) {
+            c.routed = true;
+            detail::stage_start(inner, c);
+            return false;
+        }
+        if (!detail::phf_step(inner, c)) return false;
+        c.slot += offsets_[c.shard];
+        return true;
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return num_shards_; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes() * 8) / static_cast<double>(num_keys_);
+    }
+
+    /// Serialized size plus the per-shard view descriptors built on open.
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return bytes_.size() + shards_.size() * sizeof(InnerView);
+    }
+
+    [[nodiscard]] const InnerView& shard(size_t i) const noexcept { return shards_[i]; }
+
+    [[nodiscard]] size_t shard_of(std::string_view key) const noexcept {
+        return shard_for(hashed_key{key});
+    }
+
+    [[nodiscard]] uint64_t shard_offset(size_t i) const noexcept { return offsets_[i]; }
+
+    [[nodiscard]] partition_router router() const noexcept {
+        return partition_router{seed_, num_shards_, hash_rev_};
+    }
+
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return bytes_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
+
+    /// Bind to bytes written by partitioned_phf<Inner>::serialize(). Also
+    /// rejects a zero shard count, which slot_for() would divide by.
+    [[nodiscard]] static result<partitioned_phf_view> deserialize(std::span<const std::byte> data) {
+        phf_serial::reader rd(data);
+        auto version = phf_serial::read_header(rd, partitioned_phf<InnerView>::ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
+
+        uint64_t seed{}, nkeys{}, rsize{}, nshards{};
+        if (!rd.read(seed) || !rd.read(nkeys) ||
+            !rd.read(rsize) || !rd.read(nshards)) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        partitioned_phf_view r;
+        r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_version(*version);
+        r.num_keys_ = static_cast<size_t>(nkeys);
+        r.range_size_ = static_cast<size_t>(rsize);
+        r.num_shards_ = static_cast<size_t>(nshards);
+
+        if (!rd.read_array(r.offsets_)) return std::unexpected(error::invalid_format);
+        if (r.num_shards_ == 0 || r.offsets_.size() != r.num_shards_ + 1) {
+            return std::unexpected(error::invalid_format);
+        }
+        r.shard_mod_ = detail::fastmod_u64{nshards};
+
+        r.shards_.reserve(r.num_shards_);
+        for (size_t i = 0; i < r.num_shards_; ++i) {
+            uint64_t len{};
+            if (!rd.read(len)) return std::unexpected(error::invalid_format);
+            std::span<const std::byte> shard_span;
+            if (!rd.read_span(shard_span, static_cast<size_t>(len))) {
+                return std::unexpected(error::invalid_format);
+            }
+            auto shard = InnerView::deserialize(shard_span);
+            if (!shard.has_value()) return std::unexpected(shard.error());
+            r.shards_.push_back(std::move(*shard));
+        }
+        r.bytes_ = data.first(rd.offset());
+        return r;
+    }
+};
+
 } // namespace maph
@@ -6,6 +6,19 @@
  * array (approximate membership). The result is an approximate filter
  * that can also return unique slot indices for accepted keys.
  *
+ * contains_batch() resolves a window of slots, then verifies them in one
+ * pass; contains_interleaved() keeps G queries in flight, each stepping
+ * through the PHF and then a prefetch of its fingerprint.
+ *
+ * erase() retires a key until the next rebuild by zeroing its slot's
+ * fingerprint with an atomic word write; readers on other threads
+ * meanwhile use contains_atomic(), which loads the word atomically, while
+ * contains() stays a plain load. Both need FPBits to divide 64. An erased
+ * key answers contains() = true only with the false positive probability
+ * 2^-FPBits, and num_keys() still counts it. Erasing a key that was never added clears another
+ * key's slot only if it was a false positive, i.e. with that same
+ * probability.
+ *
  * @tparam PHF A type satisfying perfect_hash_function
  * @tparam FPBits Fingerprint width in bits (8, 16, or 32)
  */
@@ -15,6 +28,11 @@
 #include "../core.hpp"
 #include "../concepts/perfect_hash_function.hpp"
 #include "../filters/packed_fingerprint.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/container.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include <algorithm>
 #include <array>
 #include <bit>
 #include <cstring>
@@ -23,6 +41,7 @@
 #include <string>
 #include <string_view>
 #include <optional>
+#include <ostream>
 
 namespace maph {
 
@@ -32,6 +51,8 @@ class perfect_filter {
     packed_fingerprint_array<FPBits> fps_;
 
 public:
+    static constexpr unsigned fingerprint_bits_v = FPBits;
+
     perfect_filter() = default;
     perfect_filter(perfect_filter&&) = default;
     perfect_filter& operator=(perfect_filter&&) = default;
@@ -48,24 +69,155 @@ public:
         return pf;
     }
 
+    /// Keys borrowed as views; nothing is copied.
+    static perfect_filter build(PHF phf, std::span<const std::string_view> keys) {
+        perfect_filter pf;
+        pf.phf_ = std::move(phf);
+        pf.fps_.build(keys, [&pf](const hashed_key& hk) { return slot_for_hashed(pf.phf_, hk).value; },
+                      pf.phf_.range_size());
+        return pf;
+    }
+
+    static perfect_filter build(PHF phf, std::span<const uint64_t> keys) {
+        perfect_filter pf;
+        pf.phf_ = std::move(phf);
+        pf.fps_.build(keys, [&pf](const hashed_key& hk) { return slot_for_hashed(pf.phf_, hk).value; },
+                      pf.phf_.range_size());
+        return pf;
+    }
+
+    // The key is hashed once; the PHF slot and the fingerprint are both
+    // derived from the same digest.
     [[nodiscard]] bool contains(std::string_view key) const noexcept {
-        auto slot = phf_.slot_for(key);
-        return fps_.verify(key, slot.value);
+        return contains(hashed_key{key});
+    }
+
+    [[nodiscard]] bool contains(const hashed_key& hk) const noexcept {
+        auto slot = slot_for_hashed(phf_, hk);
+        return fps_.verify(hk, slot.value);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] bool contains(K key) const noexcept {
+        return contains(hashed_key{key});
+    }
+
+    /// contains() for readers running alongside erase().
+    [[nodiscard]] bool contains_atomic(std::string_view key) const noexcept
+        requires (64 % FPBits == 0) {
+        return contains_atomic(hashed_key{key});
+    }
+
+    [[nodiscard]] bool contains_atomic(const hashed_key& hk) const noexcept
+        requires (64 % FPBits == 0) {
+        return fps_.verify_atomic(hk, static_cast<size_t>(slot_for_hashed(phf_, hk).value));
+    }
+
+    template<integer_key K>
+        requires (64 % FPBits == 0)
+    [[nodiscard]] bool contains_atomic(K key) const noexcept {
+        return contains_atomic(hashed_key{key});
+    }
+
+    /// Retire `key`: true if it was present (or a false positive) and its
+    /// fingerprint is now zero.
+    bool erase(std::string_view key) noexcept requires (64 % FPBits == 0) {
+        return erase(hashed_key{key});
+    }
+
+    bool erase(const hashed_key& hk) noexcept requires (64 % FPBits == 0) {
+        return fps_.erase(hk, static_cast<size_t>(slot_for_hashed(phf_, hk).value));
+    }
+
+    template<integer_key K>
+        requires (64 % FPBits == 0)
+    bool erase(K key) noexcept {
+        return erase(hashed_key{key});
+    }
+
+    // Batched contains(): a window of keys is hashed and resolved to
+    // slots, then all their fingerprints are read in one verify_batch().
+    void contains_batch(std::span<const std::string_view> keys, std::span<bool> out) const noexcept {
+        constexpr size_t BW = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        hashed_key hks[BW];
+        size_t slots[BW];
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                slots[i] = static_cast<size_t>(slot_for_hashed(phf_, hks[i]).value);
+            }
+            fps_.verify_batch(std::span<const hashed_key>{hks, m},
+                              std::span<const size_t>{slots, m}, out.subspan(base, m));
+        }
+    }
+
+    // Interleaved contains(): G queries in flight, out[i] = contains(keys[i]).
+    template<size_t G = detail::interleave_group>
+    void contains_interleaved(std::span<const std::string_view> keys,
+                              std::span<bool> out) const noexcept {
+        contains_interleaved<G>(keys.first(std::min(keys.size(), out.size())),
+                                [out](size_t i, bool hit) { out[i] = hit; });
+    }
+
+    /// fn(i, contains(keys[i])) for every i, in completion order.
+    template<size_t G = detail::interleave_group, typename Fn>
+        requires std::invocable<Fn&, size_t, bool>
+    void contains_interleaved(std::span<const std::string_view> keys, Fn&& fn) const {
+        detail::interleave_keys<G>(
+            *this, keys, [this](detail::lookup_cursor& c) { return lookup_step(c); },
+            [&fn](size_t i, const detail::lookup_cursor& c) { fn(i, c.value != 0); });
+    }
+
+    void lookup_start(detail::lookup_cursor& c) const noexcept { detail::stage_start(phf_, c); }
+
+    // The PHF's stages, a prefetch of the fingerprint, then the compare.
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        if (!c.resolved) {
+            if (!detail::phf_step(phf_, c)) return false;
+            c.resolved = true;
+            detail::prefetch_read(fps_.address(static_cast<size_t>(c.slot)));
+            return false;
+        }
+        c.value = fps_.verify(c.hk, static_cast<size_t>(c.slot)) ? 1 : 0;
+        return true;
     }
 
     [[nodiscard]] std::optional<slot_index> slot_for(std::string_view key) const noexcept {
-        auto slot = phf_.slot_for(key);
-        if (fps_.verify(key, slot.value)) return slot;
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] std::optional<slot_index> slot_for(const hashed_key& hk) const noexcept {
+        auto slot = slot_for_hashed(phf_, hk);
+        if (fps_.verify(hk, slot.value)) return slot;
         return std::nullopt;
     }
 
+    template<integer_key K>
+    [[nodiscard]] std::optional<slot_index> slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
     [[nodiscard]] const PHF& phf() const noexcept { return phf_; }
 
     [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
     [[nodiscard]] size_t range_size() const noexcept { return phf_.range_size(); }
 
-    [[nodiscard]] std::vector<std::byte> serialize() const {
-        auto phf_bytes = phf_.serialize();
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return phf_.memory_bytes() + fps_.memory_bytes();
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::member_heap_bytes(phf_) + fps_.heap_bytes();
+    }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const { return serialize(1); }
+
+    /// serialize() with the PHF serialized on `threads` workers when it
+    /// can be (partitioned_phf). Same bytes.
+    [[nodiscard]] std::vector<std::byte> serialize(size_t threads) const {
+        auto phf_bytes = detail::serialize_with_threads(phf_, threads);
         auto fps_bytes = fps_.serialize();
 
         std::vector<std::byte> out;
@@ -77,7 +229,33 @@ public:
         return out;
     }
 
+    /// Stream serialize()'s bytes to `sink`; a PHF with serialize_to()
+    /// streams too, so no full copy is built. io_error once the sink fails.
+    template<typename Sink>
+        requires phf_serial::byte_sink<Sink>
+    [[nodiscard]] result<void> serialize_to(Sink& sink, size_t threads = 1) const {
+        const uint64_t phf_size = detail::serialized_size_of(phf_, threads);
+        const auto size_bytes = std::bit_cast<std::array<std::byte, 8>>(phf_size);
+        const auto fps_bytes = fps_.serialize();
+        if (!sink(std::span<const std::byte>(size_bytes)) || !detail::serialize_into(phf_, sink, threads)
+            || !sink(std::span<const std::byte>(fps_bytes))) {
+            return std::unexpected(error::io_error);
+        }
+        return {};
+    }
+
+    [[nodiscard]] result<void> serialize_to(std::ostream& os, size_t threads = 1) const {
+        phf_serial::ostream_sink sink{os};
+        return serialize_to(sink, threads);
+    }
+
     [[nodiscard]] static result<perfect_filter> deserialize(std::span<const std::byte> data) {
+        return deserialize(data, 1);
+    }
+
+    /// deserialize() with the PHF decoded on `threads` workers when it can be.
+    [[nodiscard]] static result<perfect_filter> deserialize(std::span<const std::byte> data,
+                                                            size_t threads) {
         if (data.size() < 8) return std::unexpected(error::invalid_format);
 
         uint64_t phf_size{};
@@ -88,7 +266,7 @@ public:
         auto phf_span = data.subspan(8, phf_size);
         auto fps_span = data.subspan(8 + phf_size);
 
-        auto phf = PHF::deserialize(phf_span);
+        auto phf = detail::deserialize_with_threads<PHF>(phf_span, threads);
         if (!phf) return std::unexpected(phf.error());
 
         auto fps = packed_fingerprint_array<FPBits>::deserialize(fps_span);
@@ -99,6 +277,30 @@ public:
         pf.fps_ = std::move(*fps);
         return pf;
     }
+
+    /// Container sections: the PHF as a nested container, and the
+    /// fingerprint array's serialize() bytes.
+    void write_sections(container_writer& w) const {
+        w.add(section_tag::phf, to_container(phf_));
+        w.add(section_tag::fingerprints, fps_.serialize());
+    }
+
+    [[nodiscard]] static result<perfect_filter> read_sections(const container_view& v,
+                                                              size_t threads = 1) {
+        auto phf_bytes = v.checked(section_tag::phf);
+        if (!phf_bytes) return std::unexpected(phf_bytes.error());
+        auto phf = from_container<PHF>(*phf_bytes, threads);
+        if (!phf) return std::unexpected(phf.error());
+        auto fps_bytes = v.checked(section_tag::fingerprints);
+        if (!fps_bytes) return std::unexpected(fps_bytes.error());
+        auto fps = packed_fingerprint_array<FPBits>::deserialize(*fps_bytes);
+        if (!fps) return std::unexpected(error::invalid_format);
+
+        perfect_filter pf;
+        pf.phf_ = std::move(*phf);
+        pf.fps_ = std::move(*fps);
+        return pf;
+    }
 };
 
 } // namespace maph
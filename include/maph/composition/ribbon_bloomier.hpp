@@ -0,0 +1,257 @@
+/**
+ * @file ribbon_bloomier.hpp
+ * @brief Approximate function in one ribbon solve: value and check bits
+ *        share a row.
+ *
+ * bloomier<ribbon_retrieval<M>, ribbon_filter<F>> solves two banded
+ * systems over the same keys and reads two band windows per query, one in
+ * each solution. ribbon_bloomier<M, F> solves a single ribbon_retrieval
+ * of M + F bits per row whose stored value for key k is
+ *
+ *     (value(k) << F) | check(k)
+ *
+ * where check(k) is F bits of a hash of k independent of its band. A
+ * query XORs one window, compares the low F bits against check(k), and
+ * returns the high M bits on a match. For non-members the window is an
+ * arbitrary (M + F)-bit word, so the check passes with probability 2^-F.
+ *
+ * Space:  ~1.08 * (M + F) bits per key, one solution array instead of two
+ *         (flat rows round up to the width of M + F bits, so pick sums
+ *         of 8, 16, 32 or 64 there, or use interleaved_solution).
+ * Query:  one band window, one hash.
+ * FPR:    2^-F.
+ *
+ * Keys are hashed once at build() and solved by their digests, so two
+ * keys with equal digests fail with error::duplicate_key. The blob is the
+ * retrieval's behind a word recording M and F.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+#include "../detail/fingerprint_hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/packed_value_array.hpp"
+#include "../detail/radix_partition.hpp"
+#include "../detail/ribbon_solution.hpp"
+#include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
+#include "../retrieval/ribbon_retrieval.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+template <unsigned M, unsigned F, ribbon_solution_layout Layout = flat_solution>
+    requires (M >= 1 && F >= 1 && M + F <= 64)
+class ribbon_bloomier {
+public:
+    using retrieval_type = ribbon_retrieval<M + F, Layout>;
+    using value_type = typename detail::packed_value_array<M>::value_type;
+
+    static constexpr unsigned value_bits_v = M;
+    static constexpr unsigned fingerprint_bits_v = F;
+
+private:
+    using row_type = typename retrieval_type::value_type;
+
+    static constexpr uint64_t check_mask_ = (uint64_t{1} << F) - 1;
+
+    retrieval_type r_{};
+
+    // The check bits of a key. Remixed with a constant of its own so they
+    // are independent of the start and coefficients band() draws from the
+    // same fingerprint.
+    static uint64_t check_of(const hash128& digest) noexcept {
+        return phf_remix(membership_fingerprint(digest) ^ 0x510e527fade682d1ULL) & check_mask_;
+    }
+
+    static uint32_t shape_word() noexcept { return M | (F << 8); }
+
+    explicit ribbon_bloomier(retrieval_type r) : r_(std::move(r)) {}
+
+public:
+    ribbon_bloomier() = default;
+
+    [[nodiscard]] std::optional<value_type> lookup(std::string_view key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] std::optional<value_type> lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes).
+    [[nodiscard]] std::optional<value_type> lookup(const hash128& digest) const noexcept {
+        return lookup(hashed_key{digest});
+    }
+
+    [[nodiscard]] std::optional<value_type> lookup(const hashed_key& hk) const noexcept {
+        if (r_.num_keys() == 0) return std::nullopt;
+        const auto row = static_cast<uint64_t>(r_.lookup(hk));
+        if ((row & check_mask_) != check_of(hk.digest)) return std::nullopt;
+        return static_cast<value_type>(row >> F);
+    }
+
+    [[nodiscard]] bool contains(std::string_view key) const noexcept {
+        return lookup(key).has_value();
+    }
+
+    [[nodiscard]] bool contains(const hashed_key& hk) const noexcept {
+        return lookup(hk).has_value();
+    }
+
+    /// Prefetch the band window lookup(hk) reads.
+    void prefetch(const hashed_key& hk) const noexcept { r_.prefetch(hk); }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return r_.num_keys(); }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+    [[nodiscard]] size_t fingerprint_bits() const noexcept { return F; }
+    [[nodiscard]] double bits_per_key() const noexcept { return r_.bits_per_key(); }
+    [[nodiscard]] size_t memory_bytes() const noexcept { return r_.memory_bytes(); }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept { return r_.heap_bytes(); }
+
+    [[nodiscard]] const retrieval_type& get_retrieval() const noexcept { return r_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        phf_serial::append(out, shape_word());
+        auto r_bytes = r_.serialize();
+        out.insert(out.end(), r_bytes.begin(), r_bytes.end());
+        return out;
+    }
+
+    // The shape word tells ribbon_bloomier<8, 8> from <12, 4>, whose
+    // retrieval blobs alone are indistinguishable.
+    [[nodiscard]] static result<ribbon_bloomier> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint32_t shape{};
+        if (!r.read(shape) || shape != shape_word()) return std::unexpected(error::invalid_format);
+        auto inner = retrieval_type::deserialize(bytes.subspan(sizeof(shape)));
+        if (!inner) return std::unexpected(inner.error());
+        return ribbon_bloomier{std::move(*inner)};
+    }
+
+    // ===== Builder =====
+
+    class builder {
+        typename retrieval_type::builder rb_{};
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+        std::vector<hash128> hashes_{};
+        std::vector<value_type> hash_values_{};
+        size_t threads_{1};
+        executor* executor_{nullptr};
+
+        static constexpr uint64_t value_mask_ =
+            (M == 64) ? ~uint64_t{0} : ((uint64_t{1} << M) - 1);
+
+        static row_type row_for(const hash128& digest, value_type v) noexcept {
+            const uint64_t value = static_cast<uint64_t>(v) & value_mask_;
+            return static_cast<row_type>((value << F) | check_of(digest));
+        }
+
+    public:
+        builder() = default;
+
+        builder& add(std::string_view key, value_type v) {
+            keys_.add(key);
+            values_.push_back(v);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.borrow_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // Keys known only by their digest, phf_hash128(key).
+        builder& add_hashes(std::span<const hash128> digests,
+                            std::span<const value_type> values) {
+            size_t n = digests.size() < values.size() ? digests.size() : values.size();
+            hashes_.insert(hashes_.end(), digests.begin(), digests.begin() + n);
+            hash_values_.insert(hash_values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // Forward the retrieval builder's knobs.
+        builder& with_seed(uint64_t s) { rb_.with_seed(s); return *this; }
+        builder& with_epsilon(double e) { rb_.with_epsilon(e); return *this; }
+        builder& with_max_attempts(size_t a) { rb_.with_max_attempts(a); return *this; }
+        builder& with_shard_keys(size_t k) { rb_.with_shard_keys(k); return *this; }
+
+        // Threads for hashing the keys and for the solve.
+        builder& with_threads(size_t n) {
+            rb_.with_threads(n);
+            threads_ = n;
+            return *this;
+        }
+
+        builder& with_executor(executor& ex) {
+            rb_.with_executor(ex);
+            executor_ = &ex;
+            threads_ = ex.size();
+            return *this;
+        }
+
+        [[nodiscard]] result<ribbon_bloomier> build() {
+            if (keys_.empty() && hashes_.empty()) return std::unexpected(error::optimization_failed);
+            detail::executor_scope scope{executor_};
+
+            const size_t nkeys = keys_.size();
+            const size_t total = nkeys + hashes_.size();
+            std::vector<hash128> digests(total);
+            std::vector<row_type> rows(total);
+            const size_t nthreads = threads_ != 0 ? threads_
+                : std::max<size_t>(1u, std::thread::hardware_concurrency());
+            detail::parallel_chunks(nkeys, nthreads, [&](size_t, size_t lo, size_t hi) {
+                phf_hash128_batch(keys_.views().subspan(lo, hi - lo),
+                                  std::span<hash128>(digests).subspan(lo, hi - lo));
+                for (size_t i = lo; i < hi; ++i) rows[i] = row_for(digests[i], values_[i]);
+            });
+            for (size_t i = 0; i < hashes_.size(); ++i) {
+                digests[nkeys + i] = hashes_[i];
+                rows[nkeys + i] = row_for(hashes_[i], hash_values_[i]);
+            }
+
+            auto rb = rb_;
+            rb.add_hashes(digests, rows);
+            auto r = rb.build();
+            if (!r) return std::unexpected(r.error());
+            return ribbon_bloomier{std::move(*r)};
+        }
+    };
+};
+
+} // namespace maph
@@ -0,0 +1,318 @@
+/**
+ * @file shard_manifest.hpp
+ * @brief One partitioned_phf served from several nodes: a manifest that
+ *        routes keys to nodes, and the shard groups the nodes load.
+ *
+ * A partitioned_phf's shards are independent, so one logical key set can
+ * be spread over several serving nodes, each holding some of the shards:
+ *
+ *   auto manifest = shard_manifest::assign(phf, 4);       // 4 nodes
+ *   for (uint32_t n = 0; n < 4; ++n)
+ *       write(node_file(n), phf.serialize_shards(manifest.shards_of(n)));
+ *   write("manifest", manifest.serialize());
+ *
+ * A client loads only the manifest (the routing seed and shard count, the
+ * global offsets, one node id per shard: a few bytes per shard) and sends
+ * each key to manifest.node_of(key). A node maps its own file and loads
+ * it as a partitioned_shard_group<Shard>, whose slot_for() returns the
+ * same global slot the whole structure would. With a view for Shard
+ * (phobic_phf_view<5>, ...) the node binds its shards in place.
+ *
+ * Routing needs no shard at all: partition_router (partitioned.hpp) is
+ * the seed, the count and the hash revision, and partitioned_phf::router()
+ * hands it out.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+#include "../detail/container.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/serialization.hpp"
+#include "partitioned.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace maph {
+
+/**
+ * Which node serves each shard of a partitioned_phf, with the routing
+ * function and the global slot offsets needed to route a key and place
+ * its slot without any shard.
+ */
+class shard_manifest {
+    partition_router router_{};
+    uint64_t num_keys_{0};
+    uint64_t range_size_{0};
+    uint32_t num_nodes_{0};
+    std::vector<uint64_t> offsets_;  // num_shards + 1, as in partitioned_phf
+    std::vector<uint32_t> nodes_;    // node of each shard
+
+    // offsets_ and nodes_ agree with the router and each other.
+    [[nodiscard]] bool consistent() const noexcept {
+        const size_t n = router_.num_shards();
+        if (n == 0 || num_nodes_ == 0 || offsets_.size() != n + 1 || nodes_.size() != n) return false;
+        if (offsets_.front() != 0 || offsets_.back() != range_size_) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (offsets_[i] > offsets_[i + 1] || nodes_[i] >= num_nodes_) return false;
+        }
+        return true;
+    }
+
+    template<typename P>
+    static shard_manifest from(const P& phf) {
+        shard_manifest m;
+        m.router_ = phf.router();
+        m.num_keys_ = phf.num_keys();
+        m.range_size_ = phf.range_size();
+        m.offsets_.resize(phf.num_shards() + 1);
+        for (size_t i = 0; i <= phf.num_shards(); ++i) m.offsets_[i] = phf.shard_offset(i);
+        return m;
+    }
+
+public:
+    static constexpr uint32_t ALGORITHM_ID = 13;
+
+    shard_manifest() = default;
+
+    /// Shard i on node node_of_shard[i]. invalid_format unless there is
+    /// one entry per shard, each below num_nodes.
+    template<typename P>
+    [[nodiscard]] static result<shard_manifest> assign(const P& phf,
+                                                       std::span<const uint32_t> node_of_shard,
+                                                       uint32_t num_nodes) {
+        shard_manifest m = from(phf);
+        m.num_nodes_ = num_nodes;
+        m.nodes_.assign(node_of_shard.begin(), node_of_shard.end());
+        if (!m.consistent()) return std::unexpected(error::invalid_format);
+        return m;
+    }
+
+    /// Contiguous runs of shards on num_nodes nodes, balanced by slots: a
+    /// shard goes to the node whose share of [0, range_size) holds its
+    /// midpoint. invalid_format for zero nodes.
+    template<typename P>
+    [[nodiscard]] static result<shard_manifest> assign(const P& phf, uint32_t num_nodes) {
+        shard_manifest m = from(phf);
+        m.num_nodes_ = num_nodes;
+        m.nodes_.resize(phf.num_shards());
+        const uint64_t range = std::max<uint64_t>(m.range_size_, 1);
+        for (size_t i = 0; i < m.nodes_.size(); ++i) {
+            const uint64_t mid = m.offsets_[i] + (m.offsets_[i + 1] - m.offsets_[i]) / 2;
+            const auto node = static_cast<uint64_t>(
+                static_cast<__uint128_t>(mid) * num_nodes / range);
+            m.nodes_[i] = static_cast<uint32_t>(std::min<uint64_t>(node, num_nodes - 1));
+        }
+        if (!m.consistent()) return std::unexpected(error::invalid_format);
+        return m;
+    }
+
+    // ===== Routing =====
+
+    template<typename Key>
+    [[nodiscard]] size_t shard_of(const Key& key) const noexcept { return router_.shard_of(key); }
+
+    template<typename Key>
+    [[nodiscard]] uint32_t node_of(const Key& key) const noexcept { return nodes_[router_.shard_of(key)]; }
+
+    [[nodiscard]] uint32_t node_of_shard(size_t shard) const noexcept { return nodes_[shard]; }
+
+    /// The shards node serves, ascending: the argument to
+    /// partitioned_phf::serialize_shards for that node's file.
+    [[nodiscard]] std::vector<size_t> shards_of(uint32_t node) const {
+        std::vector<size_t> out;
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (nodes_[i] == node) out.push_back(i);
+        }
+        return out;
+    }
+
+    /// First global slot of shard i; shard_offset(num_shards()) is
+    /// range_size().
+    [[nodiscard]] uint64_t shard_offset(size_t i) const noexcept { return offsets_[i]; }
+
+    [[nodiscard]] const partition_router& router() const noexcept { return router_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return router_.num_shards(); }
+    [[nodiscard]] uint32_t num_nodes() const noexcept { return num_nodes_; }
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+
+    // ===== Serialization =====
+
+    /// [header][u64 seed][u64 keys][u64 range][u64 shards][u32 nodes]
+    /// [offsets][node per shard]
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        phf_serial::write_header(out, ALGORITHM_ID, std::nullopt, router_.revision());
+        phf_serial::append(out, router_.seed());
+        phf_serial::append(out, num_keys_);
+        phf_serial::append(out, range_size_);
+        phf_serial::append(out, static_cast<uint64_t>(router_.num_shards()));
+        phf_serial::append(out, num_nodes_);
+        phf_serial::append_vector(out, offsets_);
+        phf_serial::append_vector(out, nodes_);
+        return out;
+    }
+
+    [[nodiscard]] static result<shard_manifest> deserialize(std::span<const std::byte> data) {
+        phf_serial::reader rd(data);
+        auto version = phf_serial::read_header(rd, ALGORITHM_ID);
+        if (!version) return std::unexpected(error::invalid_format);
+        uint64_t seed{}, nshards{};
+        shard_manifest m;
+        if (!rd.read(seed) || !rd.read(m.num_keys_) || !rd.read(m.range_size_) ||
+            !rd.read(nshards) || nshards == 0 || !rd.read(m.num_nodes_) ||
+            !rd.read_vector(m.offsets_) || !rd.read_vector(m.nodes_)) {
+            return std::unexpected(error::invalid_format);
+        }
+        m.router_ = partition_router{seed, static_cast<size_t>(nshards),
+                                     phf_serial::revision_for_version(*version)};
+        if (!m.consistent()) return std::unexpected(error::invalid_format);
+        return m;
+    }
+};
+
+/**
+ * The shards one node serves, loaded from
+ * partitioned_phf<Inner>::serialize_shards(). Shard is Inner, or its view
+ * (which binds the bytes in place; they must then outlive the group).
+ *
+ * slot_for() gives the global slot the whole partitioned_phf gives for a
+ * key routed to one of these shards, and range_size() (one past the last
+ * slot, as lazy_partitioned_phf answers for a shard it cannot load) for
+ * a key routed elsewhere; owns() tells the two apart. Routing costs what
+ * it does in partitioned_phf plus one load from a table of one uint32_t
+ * per global shard.
+ */
+template<typename Shard>
+class partitioned_shard_group {
+    static_assert(perfect_hash_function<Shard>,
+        "partitioned_shard_group Shard must satisfy perfect_hash_function");
+
+    static constexpr uint32_t absent = ~uint32_t{0};
+
+    partition_router router_{};
+    size_t num_keys_{0};
+    size_t range_size_{0};
+    std::vector<Shard> shards_;
+    std::vector<uint64_t> offsets_;  // global first slot of each local shard
+    std::vector<size_t> ids_;        // global id of each local shard
+    std::vector<uint32_t> local_;    // global id -> local index, or absent
+
+public:
+    partitioned_shard_group() = default;
+
+    [[nodiscard]] slot_index slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    template<integer_key K>
+    [[nodiscard]] slot_index slot_for(K key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hash128& digest) const noexcept {
+        return slot_for(hashed_key{digest});
+    }
+
+    [[nodiscard]] slot_index slot_for(const hashed_key& hk) const noexcept {
+        const uint32_t l = local_[router_.shard_of(hk)];
+        if (l == absent) return slot_index{range_size_};
+        return slot_index{offsets_[l] + slot_for_hashed(shards_[l], hk).value};
+    }
+
+    /// True if key routes to a shard of this group, member or not.
+    template<typename Key>
+    [[nodiscard]] bool owns(const Key& key) const noexcept {
+        return local_[router_.shard_of(key)] != absent;
+    }
+
+    [[nodiscard]] bool owns_shard(size_t shard) const noexcept {
+        return shard < local_.size() && local_[shard] != absent;
+    }
+
+    template<typename Key>
+    [[nodiscard]] size_t shard_of(const Key& key) const noexcept { return router_.shard_of(key); }
+
+    /// Global ids of the shards held, ascending.
+    [[nodiscard]] std::span<const size_t> shard_ids() const noexcept { return ids_; }
+
+    /// The shard with global id `shard`; owns_shard(shard) must hold.
+    [[nodiscard]] const Shard& shard(size_t shard) const noexcept { return shards_[local_[shard]]; }
+
+    [[nodiscard]] const partition_router& router() const noexcept { return router_; }
+
+    /// Of the whole structure, as in partitioned_phf.
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t range_size() const noexcept { return range_size_; }
+    [[nodiscard]] size_t num_shards() const noexcept { return router_.num_shards(); }
+
+    /// Keys held by this group's shards.
+    [[nodiscard]] size_t local_keys() const noexcept {
+        size_t n = 0;
+        for (const auto& sh : shards_) n += sh.num_keys();
+        return n;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        size_t total = sizeof(*this) + offsets_.size() * sizeof(uint64_t)
+                     + ids_.size() * sizeof(size_t) + local_.size() * sizeof(uint32_t)
+                     + shards_.size() * sizeof(Shard);
+        for (const auto& sh : shards_) total += sh.memory_bytes();
+        return total;
+    }
+
+    /// Bind to serialize_shards() bytes. invalid_format if they are cut
+    /// short, the offsets table is not one ascending entry per shard from
+    /// 0 to range_size (so no two shards' slot ranges overlap), the shard
+    /// ids are out of range or not ascending, or a slot range does not
+    /// fit the shard in it.
+    [[nodiscard]] static result<partitioned_shard_group> deserialize(std::span<const std::byte> data) {
+        using writer = partitioned_phf<Shard>;
+        phf_serial::reader rd(data);
+        auto version = phf_serial::read_header(rd, writer::SHARD_GROUP_ID);
+        if (!version) return std::unexpected(error::invalid_format);
+
+        uint64_t seed{}, nkeys{}, rsize{}, nshards{}, count{};
+        std::vector<uint64_t> global;  // first slot of every shard, then range_size
+        if (!rd.read(seed) || !rd.read(nkeys) || !rd.read(rsize) || !rd.read(nshards) ||
+            !rd.read_vector(global) || !rd.read(count) ||
+            nshards == 0 || global.size() != nshards + 1 || count > nshards ||
+            global.front() != 0 || global.back() != rsize ||
+            !std::is_sorted(global.begin(), global.end())) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        partitioned_shard_group g;
+        g.router_ = partition_router{seed, static_cast<size_t>(nshards),
+                                     phf_serial::revision_for_version(*version)};
+        g.num_keys_ = static_cast<size_t>(nkeys);
+        g.range_size_ = static_cast<size_t>(rsize);
+        g.local_.assign(static_cast<size_t>(nshards), absent);
+        g.shards_.reserve(static_cast<size_t>(count));
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t id{}, len{};
+            std::span<const std::byte> bytes;
+            if (!rd.read(id) || !rd.read(len) || !rd.read_span(bytes, static_cast<size_t>(len)) ||
+                id >= nshards || (!g.ids_.empty() && id <= g.ids_.back())) {
+                return std::unexpected(error::invalid_format);
+            }
+            const auto s = static_cast<size_t>(id);
+            auto shard = detail::deserialize_as<Shard>(bytes);
+            if (!shard) return std::unexpected(shard.error());
+            if (shard->range_size() > global[s + 1] - global[s]) return std::unexpected(error::invalid_format);
+            g.local_[s] = static_cast<uint32_t>(g.shards_.size());
+            g.shards_.push_back(std::move(*shard));
+            g.offsets_.push_back(global[s]);
+            g.ids_.push_back(static_cast<size_t>(id));
+        }
+        return g;
+    }
+};
+
+} // namespace maph
@@ -0,0 +1,273 @@
+/**
+ * @file snapshot.hpp
+ * @brief Hot swap of a rebuilt structure under running queries.
+ *
+ * Every structure in maph is immutable once built; serving a changing key
+ * set means building a new one and switching readers over to it.
+ * snapshot<T> holds the current instance and lets a writer publish a
+ * replacement while readers keep querying:
+ *
+ *   snapshot<partitioned_phf<phobic5>> live{std::move(first)};
+ *
+ *   // each query thread, once
+ *   auto reader = live.make_reader();
+ *   // per query (or per batch of queries)
+ *   auto g = reader.read();
+ *   g->slot_for(key);
+ *
+ *   // the rebuild thread
+ *   live.publish(std::move(rebuilt));
+ *
+ * Reclamation is epoch based. A reader owns a slot on its own cache
+ * line; read() stores the global epoch there and loads the current
+ * instance, and the guard's destructor marks the slot idle. No reader
+ * writes a line another thread writes, so guards scale with cores where
+ * an std::atomic<std::shared_ptr> load bumps one shared reference count
+ * per query. publish() swaps the instance in, advances the epoch and
+ * retires the old one tagged with the new epoch; it is destroyed once
+ * every reader slot is idle or has entered at that epoch or later, which
+ * publish() and reclaim() check and synchronize() waits for.
+ *
+ * publish(value, keep) also takes an owner destroyed together with the
+ * value, after it: a *_view and the mapped_file it reads, for instance.
+ *
+ * Readers are cheap to create but not free (one mutex acquisition), so
+ * make one per thread and reuse it; a reader is used by one thread at a
+ * time and must be destroyed before its snapshot. Guards nest: an inner
+ * read() keeps the outer one's epoch.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+template<typename T>
+class snapshot {
+    static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+    struct node_base {
+        const T* value{nullptr};
+        virtual ~node_base() = default;
+    };
+
+    // keep is declared first so that it outlives value.
+    template<typename Keep>
+    struct node final : node_base {
+        Keep keep;
+        T held;
+        node(T v, Keep k) : keep(std::move(k)), held(std::move(v)) { this->value = &held; }
+    };
+
+    struct empty_keep {};
+
+    struct alignas(64) reader_slot {
+        std::atomic<uint64_t> epoch{idle};
+        bool in_use{false};  // under registry_mutex_
+    };
+
+    struct retired_node {
+        std::unique_ptr<node_base> node;
+        uint64_t epoch;
+    };
+
+    std::atomic<node_base*> current_{nullptr};
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint64_t> version_{0};
+
+    mutable std::mutex registry_mutex_;
+    std::deque<reader_slot> slots_{};  // never shrinks, so slots do not move
+
+    mutable std::mutex writer_mutex_;
+    std::vector<retired_node> retired_{};
+
+    // Oldest epoch a reader is inside, or idle if none is.
+    uint64_t oldest_reader() const {
+        std::lock_guard lock(registry_mutex_);
+        uint64_t oldest = idle;
+        for (const auto& s : slots_) oldest = std::min(oldest, s.epoch.load(std::memory_order_seq_cst));
+        return oldest;
+    }
+
+    // Under writer_mutex_.
+    size_t reclaim_locked() {
+        if (retired_.empty()) return 0;
+        const uint64_t oldest = oldest_reader();
+        std::erase_if(retired_, [oldest](const retired_node& r) { return oldest >= r.epoch; });
+        return retired_.size();
+    }
+
+    void swap_in(std::unique_ptr<node_base> next) {
+        std::lock_guard lock(writer_mutex_);
+        node_base* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+        const uint64_t e = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        version_.fetch_add(1, std::memory_order_relaxed);
+        if (old != nullptr) retired_.push_back({std::unique_ptr<node_base>(old), e});
+        reclaim_locked();
+    }
+
+public:
+    class reader;
+
+    /// Read access to the instance current at read(); keeps it alive.
+    class guard {
+        reader* owner_{nullptr};
+        const T* value_{nullptr};
+
+        friend class reader;
+        guard(reader* owner, const T* value) noexcept : owner_(owner), value_(value) {}
+
+    public:
+        guard() = default;
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+        guard(guard&& other) noexcept
+            : owner_(std::exchange(other.owner_, nullptr)), value_(std::exchange(other.value_, nullptr)) {}
+        guard& operator=(guard&& other) noexcept {
+            if (this != &other) {
+                release();
+                owner_ = std::exchange(other.owner_, nullptr);
+                value_ = std::exchange(other.value_, nullptr);
+            }
+            return *this;
+        }
+        ~guard() { release(); }
+
+        void release() noexcept {
+            if (owner_ != nullptr) std::exchange(owner_, nullptr)->leave();
+            value_ = nullptr;
+        }
+
+        /// nullptr while nothing has been published.
+        [[nodiscard]] const T* get() const noexcept { return value_; }
+        [[nodiscard]] const T& operator*() const noexcept { return *value_; }
+        [[nodiscard]] const T* operator->() const noexcept { return value_; }
+        explicit operator bool() const noexcept { return value_ != nullptr; }
+    };
+
+    /// One thread's registration; hand out guards with read().
+    class reader {
+        snapshot* owner_{nullptr};
+        reader_slot* slot_{nullptr};
+        size_t depth_{0};
+
+        friend class snapshot;
+        friend class guard;
+        reader(snapshot* owner, reader_slot* slot) noexcept : owner_(owner), slot_(slot) {}
+
+        void leave() noexcept {
+            if (--depth_ == 0) slot_->epoch.store(idle, std::memory_order_release);
+        }
+
+    public:
+        reader() = default;
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+        reader(reader&& other) noexcept
+            : owner_(std::exchange(other.owner_, nullptr)), slot_(std::exchange(other.slot_, nullptr)),
+              depth_(std::exchange(other.depth_, 0)) {}
+        reader& operator=(reader&& other) noexcept {
+            if (this != &other) {
+                unregister();
+                owner_ = std::exchange(other.owner_, nullptr);
+                slot_ = std::exchange(other.slot_, nullptr);
+                depth_ = std::exchange(other.depth_, 0);
+            }
+            return *this;
+        }
+        ~reader() { unregister(); }
+
+        /// Enter the current epoch and take the current instance. The
+        /// guard must not outlive this reader.
+        [[nodiscard]] guard read() noexcept {
+            if (depth_++ == 0) {
+                // seq_cst: the epoch store must be visible before the
+                // instance load, or a writer could miss this reader.
+                slot_->epoch.store(owner_->epoch_.load(std::memory_order_seq_cst),
+                                   std::memory_order_seq_cst);
+            }
+            node_base* n = owner_->current_.load(std::memory_order_seq_cst);
+            return guard{this, n != nullptr ? n->value : nullptr};
+        }
+
+    private:
+        void unregister() noexcept {
+            if (owner_ == nullptr) return;
+            slot_->epoch.store(idle, std::memory_order_release);
+            std::lock_guard lock(owner_->registry_mutex_);
+            slot_->in_use = false;
+            owner_ = nullptr;
+            slot_ = nullptr;
+        }
+    };
+
+    snapshot() = default;
+    explicit snapshot(T initial) { publish(std::move(initial)); }
+
+    snapshot(const snapshot&) = delete;
+    snapshot& operator=(const snapshot&) = delete;
+
+    /// Every reader must be gone.
+    ~snapshot() { delete current_.load(std::memory_order_acquire); }
+
+    [[nodiscard]] reader make_reader() {
+        std::lock_guard lock(registry_mutex_);
+        for (auto& s : slots_) {
+            if (!s.in_use) {
+                s.in_use = true;
+                return reader{this, &s};
+            }
+        }
+        auto& s = slots_.emplace_back();
+        s.in_use = true;
+        return reader{this, &s};
+    }
+
+    /// Make `next` current. The previous instance is destroyed once no
+    /// reader can still hold it.
+    void publish(T next) {
+        swap_in(std::make_unique<node<empty_keep>>(std::move(next), empty_keep{}));
+    }
+
+    /// publish(), with `keep` destroyed after the value: a view and the
+    /// buffer or mapped_file it reads.
+    template<typename Keep>
+    void publish(T next, Keep keep) {
+        swap_in(std::make_unique<node<Keep>>(std::move(next), std::move(keep)));
+    }
+
+    /// Destroy the retired instances no reader can hold; returns how many
+    /// are still pending.
+    size_t reclaim() {
+        std::lock_guard lock(writer_mutex_);
+        return reclaim_locked();
+    }
+
+    /// Wait until every retired instance is destroyed. Readers must leave
+    /// their guards eventually.
+    void synchronize() {
+        while (reclaim() != 0) std::this_thread::yield();
+    }
+
+    /// Retired instances not yet destroyed.
+    [[nodiscard]] size_t pending() const {
+        std::lock_guard lock(writer_mutex_);
+        return retired_.size();
+    }
+
+    /// Instances published so far.
+    [[nodiscard]] uint64_t version() const noexcept { return version_.load(std::memory_order_relaxed); }
+};
+
+} // namespace maph
@@ -0,0 +1,480 @@
+/**
+ * @file tiered.hpp
+ * @brief Frequency-aware layout: the most accessed keys in a small hot
+ *        structure that stays in cache, the rest in a cold one.
+ *
+ * A minimal PHF sends keys to slots at random, so under skewed traffic
+ * the values of the few keys that take most of the queries are spread
+ * over the whole array and each of them costs a cache miss. Given a
+ * weight per key (an access count from a query log, say), the tiered
+ * builders put the heaviest keys in a structure of their own, sized to
+ * fit in L2 (with_hot_budget(), default 256 KiB; with_hot_fraction(),
+ * default 1% of the keys), and the others in a cold structure:
+ *
+ *   tiered_value_array<PHF, M, HotPHF>   hot:  verified_value_array<HotPHF, 32, M>
+ *                                        cold: phf_value_array<PHF, M>
+ *   tiered_filter<PHF, FPBits, HotPHF>   hot:  perfect_filter<HotPHF, FPBits>
+ *                                        cold: perfect_filter<PHF, FPBits>
+ *
+ * HotPHF defaults to PHF; a plain phobic5 over the few hot keys is
+ * cheaper to evaluate than a partitioned_phf and fits the budget anyway.
+ *
+ * A lookup hashes the key once and asks the hot tier first. For
+ * tiered_value_array that answer must be exact for every build key, so
+ * each hot record carries a 32-bit fingerprint and the builder checks
+ * every cold key against the hot tier: a cold key the hot tier would
+ * accept is promoted into it and the hot tier is rebuilt with another
+ * seed until none is (about n / 2^32 promotions per attempt). A cold key
+ * then pays one cache-resident PHF evaluation and compare before its
+ * cold lookup, with no membership structure in between. Non-members get
+ * an arbitrary value, as with phf_value_array.
+ *
+ * That check is not free: it lengthens each cold query's dependency
+ * chain, so fewer cold misses overlap. The layout pays off when the hot
+ * keys take most of the queries and would otherwise miss the cache
+ * (Zipf s > 1, or many keys); under uniform traffic it only costs.
+ *
+ * tiered_filter answers hot.contains(k) || cold.contains(k). A non-member
+ * lands on a slot of each tier and matches either fingerprint with
+ * probability 2^-FPBits, so the false positive rate is about
+ * 2 * 2^-FPBits, twice that of one perfect_filter<PHF, FPBits>.
+ *
+ * Keys must be distinct. Keys with no positive weight are never hot.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/serialization.hpp"
+#include "../retrieval/phf_value_array.hpp"
+#include "perfect_filter.hpp"
+#include "verified_value_array.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+namespace detail {
+
+/// How many keys go to the hot tier: the smaller of `fraction` of them
+/// and what fits in `budget_bytes` at `bits` per hot key.
+struct hot_limits {
+    double fraction{0.01};
+    size_t budget_bytes{256 * 1024};
+
+    [[nodiscard]] size_t count(size_t n, unsigned bits) const noexcept {
+        const auto by_share = static_cast<size_t>(fraction * static_cast<double>(n));
+        return std::min({n, by_share, budget_bytes * 8 / bits});
+    }
+};
+
+/// mask[i] = 1 for the `count` heaviest keys with a positive weight.
+inline std::vector<uint8_t> heaviest(std::span<const double> weights, size_t count) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        if (weights[i] > 0) order.push_back(i);
+    }
+    if (order.size() > count) {
+        std::nth_element(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(count), order.end(),
+                         [&](size_t a, size_t b) { return weights[a] > weights[b]; });
+        order.resize(count);
+    }
+    std::vector<uint8_t> mask(weights.size(), 0);
+    for (size_t i : order) mask[i] = 1;
+    return mask;
+}
+
+// [u64 size][bytes], an empty tier as size 0.
+inline void append_tier(std::vector<std::byte>& out, const std::vector<std::byte>& bytes) {
+    phf_serial::append(out, static_cast<uint64_t>(bytes.size()));
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+inline bool read_tier(phf_serial::reader& r, std::span<const std::byte>& bytes) {
+    uint64_t size{};
+    return r.read(size) && r.read_span(bytes, static_cast<size_t>(size));
+}
+
+} // namespace detail
+
+/**
+ * phf_value_array with the heaviest keys' values in a hot
+ * verified_value_array checked first. lookup() is exact for every build
+ * key.
+ */
+template <perfect_hash_function PHF, unsigned M, perfect_hash_function HotPHF = PHF>
+    requires (M >= 1 && M <= 32)
+class tiered_value_array {
+public:
+    static constexpr unsigned hot_fingerprint_bits = 32;
+
+    using hot_type = verified_value_array<HotPHF, hot_fingerprint_bits, M>;
+    using cold_type = phf_value_array<PHF, M>;
+    using value_type = typename cold_type::value_type;
+
+    static constexpr unsigned value_bits_v = M;
+
+    tiered_value_array() = default;
+
+    // ===== Queries =====
+
+    [[nodiscard]] value_type lookup(std::string_view key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept {
+        if (hot_.num_keys() != 0) {
+            if (auto v = hot_.lookup(hk)) return static_cast<value_type>(*v);
+        }
+        return cold_.num_keys() != 0 ? cold_.lookup(hk) : value_type{0};
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    // ===== Statistics =====
+
+    [[nodiscard]] size_t num_keys() const noexcept { return hot_.num_keys() + cold_.num_keys(); }
+    [[nodiscard]] size_t hot_keys() const noexcept { return hot_.num_keys(); }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys() == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0 / static_cast<double>(num_keys());
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return hot_.memory_bytes() + cold_.memory_bytes();
+    }
+
+    /// The hot tier's bytes: what must stay cached.
+    [[nodiscard]] size_t hot_bytes() const noexcept { return hot_.memory_bytes(); }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept { return hot_.heap_bytes() + cold_.heap_bytes(); }
+
+    [[nodiscard]] const hot_type& hot() const noexcept { return hot_; }
+    [[nodiscard]] const cold_type& cold() const noexcept { return cold_; }
+
+    // ===== Serialization =====
+
+    /// [u64 size][hot bytes][u64 size][cold bytes]; an empty tier has size 0.
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        detail::append_tier(out, hot_.num_keys() != 0 ? hot_.serialize() : std::vector<std::byte>{});
+        detail::append_tier(out, cold_.num_keys() != 0 ? cold_.serialize() : std::vector<std::byte>{});
+        return out;
+    }
+
+    [[nodiscard]] static result<tiered_value_array> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        std::span<const std::byte> hot_bytes, cold_bytes;
+        if (!detail::read_tier(r, hot_bytes) || !detail::read_tier(r, cold_bytes)) {
+            return std::unexpected(error::invalid_format);
+        }
+        tiered_value_array out{};
+        if (!hot_bytes.empty()) {
+            auto h = hot_type::deserialize(hot_bytes);
+            if (!h) return std::unexpected(h.error());
+            out.hot_ = std::move(*h);
+        }
+        if (!cold_bytes.empty()) {
+            auto c = cold_type::deserialize(cold_bytes);
+            if (!c) return std::unexpected(c.error());
+            out.cold_ = std::move(*c);
+        }
+        return out;
+    }
+
+    // ===== Builder =====
+
+    class builder {
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+        std::vector<double> weights_{};
+        detail::hot_limits limits_{};
+        uint64_t seed_{0x7f4a7c159e3779b9ULL};
+        size_t threads_{1};
+        size_t max_attempts_{8};
+
+        template<typename B>
+        void configure(B& b, uint64_t seed) const {
+            if constexpr (requires { b.with_seed(seed); }) b.with_seed(seed);
+            if constexpr (requires { b.with_threads(threads_); }) b.with_threads(threads_);
+        }
+
+    public:
+        builder() = default;
+
+        /// `weight` is the key's share of the traffic in any unit.
+        builder& add(std::string_view key, value_type value, double weight = 0.0) {
+            keys_.add(key);
+            values_.push_back(value);
+            weights_.push_back(weight);
+            return *this;
+        }
+
+        // Parallel spans; the shortest decides the count.
+        builder& add_all(std::span<const std::string> keys, std::span<const value_type> values,
+                         std::span<const double> weights) {
+            const size_t n = std::min({keys.size(), values.size(), weights.size()});
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + static_cast<std::ptrdiff_t>(n));
+            weights_.insert(weights_.end(), weights.begin(), weights.begin() + static_cast<std::ptrdiff_t>(n));
+            return *this;
+        }
+
+        /// At most this share of the keys is hot (default 0.01).
+        builder& with_hot_fraction(double fraction) {
+            limits_.fraction = fraction;
+            return *this;
+        }
+
+        /// At most this many bytes of hot records (default 256 KiB).
+        builder& with_hot_budget(size_t bytes) {
+            limits_.budget_bytes = bytes;
+            return *this;
+        }
+
+        builder& with_seed(uint64_t seed) {
+            seed_ = seed;
+            return *this;
+        }
+
+        builder& with_threads(size_t n) {
+            threads_ = n;
+            return *this;
+        }
+
+        [[nodiscard]] result<tiered_value_array> build() {
+            const size_t n = keys_.size();
+            if (n == 0) return std::unexpected(error::optimization_failed);
+            const auto views = keys_.views();
+            auto hot = detail::heaviest(weights_, limits_.count(n, hot_fingerprint_bits + M));
+
+            tiered_value_array out{};
+            std::vector<std::string_view> tier_keys;
+            std::vector<value_type> tier_values;
+            auto gather = [&](uint8_t want) {
+                tier_keys.clear();
+                tier_values.clear();
+                for (size_t i = 0; i < n; ++i) {
+                    if (hot[i] == want) {
+                        tier_keys.push_back(views[i]);
+                        tier_values.push_back(values_[i]);
+                    }
+                }
+            };
+
+            bool exact = false;
+            for (size_t attempt = 0; attempt < max_attempts_ && !exact; ++attempt) {
+                gather(1);
+                if (tier_keys.empty()) {
+                    exact = true;
+                    break;
+                }
+                typename hot_type::builder hb;
+                hb.borrow_all(tier_keys, tier_values);
+                configure(hb, seed_ + attempt * 0x9e3779b97f4a7c15ULL);
+                auto built = hb.build();
+                if (!built) return std::unexpected(built.error());
+
+                // A cold key the hot tier accepts would read a hot value.
+                exact = true;
+                for (size_t i = 0; i < n; ++i) {
+                    if (hot[i] == 0 && built->lookup(hashed_key{views[i]}).has_value()) {
+                        hot[i] = 1;
+                        exact = false;
+                    }
+                }
+                if (exact) out.hot_ = std::move(*built);
+            }
+            if (!exact) return std::unexpected(error::optimization_failed);
+
+            gather(0);
+            if (!tier_keys.empty()) {
+                typename cold_type::builder cb;
+                cb.borrow_all(tier_keys, tier_values);
+                configure(cb, seed_);
+                auto built = cb.build();
+                if (!built) return std::unexpected(built.error());
+                out.cold_ = std::move(*built);
+            }
+            return out;
+        }
+    };
+
+private:
+    hot_type hot_{};
+    cold_type cold_{};
+};
+
+/**
+ * perfect_filter with the heaviest keys' fingerprints in a hot
+ * perfect_filter checked first.
+ */
+template <perfect_hash_function PHF, unsigned FPBits = 16, perfect_hash_function HotPHF = PHF>
+class tiered_filter {
+public:
+    using hot_type = perfect_filter<HotPHF, FPBits>;
+    using cold_type = perfect_filter<PHF, FPBits>;
+
+    static constexpr unsigned fingerprint_bits_v = FPBits;
+
+    tiered_filter() = default;
+
+    [[nodiscard]] bool contains(std::string_view key) const noexcept {
+        return contains(hashed_key{key});
+    }
+
+    [[nodiscard]] bool contains(const hashed_key& hk) const noexcept {
+        return (hot_.num_keys() != 0 && hot_.contains(hk)) || (cold_.num_keys() != 0 && cold_.contains(hk));
+    }
+
+    template<integer_key K>
+    [[nodiscard]] bool contains(K key) const noexcept {
+        return contains(hashed_key{key});
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return hot_.num_keys() + cold_.num_keys(); }
+    [[nodiscard]] size_t hot_keys() const noexcept { return hot_.num_keys(); }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys() == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0 / static_cast<double>(num_keys());
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return hot_.memory_bytes() + cold_.memory_bytes();
+    }
+
+    [[nodiscard]] size_t hot_bytes() const noexcept { return hot_.memory_bytes(); }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept { return hot_.heap_bytes() + cold_.heap_bytes(); }
+
+    [[nodiscard]] const hot_type& hot() const noexcept { return hot_; }
+    [[nodiscard]] const cold_type& cold() const noexcept { return cold_; }
+
+    /// [u64 size][hot bytes][u64 size][cold bytes]; an empty tier has size 0.
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        detail::append_tier(out, hot_.num_keys() != 0 ? hot_.serialize() : std::vector<std::byte>{});
+        detail::append_tier(out, cold_.num_keys() != 0 ? cold_.serialize() : std::vector<std::byte>{});
+        return out;
+    }
+
+    [[nodiscard]] static result<tiered_filter> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        std::span<const std::byte> hot_bytes, cold_bytes;
+        if (!detail::read_tier(r, hot_bytes) || !detail::read_tier(r, cold_bytes)) {
+            return std::unexpected(error::invalid_format);
+        }
+        tiered_filter out{};
+        if (!hot_bytes.empty()) {
+            auto h = hot_type::deserialize(hot_bytes);
+            if (!h) return std::unexpected(h.error());
+            out.hot_ = std::move(*h);
+        }
+        if (!cold_bytes.empty()) {
+            auto c = cold_type::deserialize(cold_bytes);
+            if (!c) return std::unexpected(c.error());
+            out.cold_ = std::move(*c);
+        }
+        return out;
+    }
+
+    class builder {
+        detail::key_store keys_{};
+        std::vector<double> weights_{};
+        detail::hot_limits limits_{};
+        uint64_t seed_{0x7f4a7c159e3779b9ULL};
+        size_t threads_{1};
+
+        template<typename Tier, typename TierPHF>
+        result<Tier> build_tier(std::span<const std::string_view> keys) const {
+            typename TierPHF::builder b;
+            if constexpr (requires { b.with_seed(seed_); }) b.with_seed(seed_);
+            if constexpr (requires { b.with_threads(threads_); }) b.with_threads(threads_);
+            auto phf = detail::borrow_keys_into(b, keys).build();
+            if (!phf) return std::unexpected(phf.error());
+            return Tier::build(std::move(*phf), keys);
+        }
+
+    public:
+        builder() = default;
+
+        builder& add(std::string_view key, double weight = 0.0) {
+            keys_.add(key);
+            weights_.push_back(weight);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string> keys, std::span<const double> weights) {
+            const size_t n = std::min(keys.size(), weights.size());
+            keys_.add_all(keys.first(n));
+            weights_.insert(weights_.end(), weights.begin(), weights.begin() + static_cast<std::ptrdiff_t>(n));
+            return *this;
+        }
+
+        builder& with_hot_fraction(double fraction) {
+            limits_.fraction = fraction;
+            return *this;
+        }
+
+        builder& with_hot_budget(size_t bytes) {
+            limits_.budget_bytes = bytes;
+            return *this;
+        }
+
+        builder& with_seed(uint64_t seed) {
+            seed_ = seed;
+            return *this;
+        }
+
+        builder& with_threads(size_t n) {
+            threads_ = n;
+            return *this;
+        }
+
+        [[nodiscard]] result<tiered_filter> build() {
+            const size_t n = keys_.size();
+            if (n == 0) return std::unexpected(error::optimization_failed);
+            const auto views = keys_.views();
+            const auto hot = detail::heaviest(weights_, limits_.count(n, FPBits));
+
+            // Both tiers borrow the stored keys.
+            std::vector<std::string_view> hot_keys, cold_keys;
+            for (size_t i = 0; i < n; ++i) (hot[i] ? hot_keys : cold_keys).push_back(views[i]);
+
+            tiered_filter out{};
+            if (!hot_keys.empty()) {
+                auto t = build_tier<hot_type, HotPHF>(hot_keys);
+                if (!t) return std::unexpected(t.error());
+                out.hot_ = std::move(*t);
+            }
+            if (!cold_keys.empty()) {
+                auto t = build_tier<cold_type, PHF>(cold_keys);
+                if (!t) return std::unexpected(t.error());
+                out.cold_ = std::move(*t);
+            }
+            return out;
+        }
+    };
+
+private:
+    hot_type hot_{};
+    cold_type cold_{};
+};
+
+} // namespace maph
@@ -0,0 +1,325 @@
+/**
+ * @file verified_value_array.hpp
+ * @brief Approximate map with each slot's fingerprint and value stored in
+ *        one packed record.
+ *
+ * verified_value_array<PHF, FPBits, M> is perfect_filter<PHF, FPBits> and
+ * phf_value_array<PHF, M> over the same PHF, fused: slot s holds one
+ * (FPBits + M)-bit record, fingerprint in the low bits and value above it.
+ * lookup(k) is
+ *
+ *   s = phf.slot_for(k);  r = records[s];
+ *   fingerprint(r) == fp(k) ? value(r) : nullopt
+ *
+ * so after the PHF there is one memory access instead of two (a
+ * fingerprint array read and a value array read at unrelated addresses).
+ * A record spans at most two adjacent words.
+ *
+ * Space: bits_per_key(PHF) + (FPBits + M) * range_size / num_keys, the
+ *        same as the two separate arrays.
+ * FPR:   2^-FPBits, as perfect_filter. Unused slots of a non-minimal PHF
+ *        hold a zero record.
+ *
+ * Unlike bloomier, the oracle is tied to the PHF's slots, so the PHF's
+ * bits are paid once for both membership and value.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/fingerprint_hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/packed_value_array.hpp"
+#include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+template <perfect_hash_function PHF, unsigned FPBits, unsigned M>
+    requires (FPBits >= 1 && M >= 1 && FPBits + M <= 64)
+class verified_value_array {
+public:
+    using record_array = detail::packed_value_array<FPBits + M>;
+    using value_type =
+        std::conditional_t<(M <= 8),  uint8_t,
+        std::conditional_t<(M <= 16), uint16_t,
+        std::conditional_t<(M <= 32), uint32_t, uint64_t>>>;
+
+    static constexpr unsigned fingerprint_bits_v = FPBits;
+    static constexpr unsigned value_bits_v = M;
+
+    verified_value_array() = default;
+
+    // ===== Queries =====
+
+    [[nodiscard]] std::optional<value_type> lookup(std::string_view key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    [[nodiscard]] std::optional<value_type> lookup(const hashed_key& hk) const noexcept {
+        auto slot = static_cast<size_t>(slot_for_hashed(phf_, hk));
+        if (slot >= records_.num_slots()) return std::nullopt;
+        const uint64_t r = records_.get(slot);
+        if ((r & fp_mask_) != fingerprint(hk)) return std::nullopt;
+        return static_cast<value_type>(r >> FPBits);
+    }
+
+    [[nodiscard]] bool contains(std::string_view key) const noexcept {
+        return contains(hashed_key{key});
+    }
+
+    [[nodiscard]] bool contains(const hashed_key& hk) const noexcept {
+        return slot_for(hk).has_value();
+    }
+
+    [[nodiscard]] std::optional<slot_index> slot_for(std::string_view key) const noexcept {
+        return slot_for(hashed_key{key});
+    }
+
+    [[nodiscard]] std::optional<slot_index> slot_for(const hashed_key& hk) const noexcept {
+        auto slot = slot_for_hashed(phf_, hk);
+        if (slot.value >= records_.num_slots()) return std::nullopt;
+        if ((records_.get(static_cast<size_t>(slot.value)) & fp_mask_) != fingerprint(hk)) {
+            return std::nullopt;
+        }
+        return slot;
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
+    [[nodiscard]] size_t range_size() const noexcept { return phf_.range_size(); }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+    [[nodiscard]] size_t fingerprint_bits() const noexcept { return FPBits; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (phf_.num_keys() == 0) return 0.0;
+        return phf_.bits_per_key()
+             + static_cast<double>(records_.memory_bytes()) * 8.0
+             / static_cast<double>(phf_.num_keys());
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return phf_.memory_bytes() + records_.memory_bytes();
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::member_heap_bytes(phf_) + records_.heap_bytes();
+    }
+
+    [[nodiscard]] const PHF& phf() const noexcept { return phf_; }
+    [[nodiscard]] const record_array& records() const noexcept { return records_; }
+
+    // Format: [u32 FPBits][u32 M][u64 phf size][phf bytes][record array].
+    [[nodiscard]] std::vector<std::byte> serialize() const { return serialize(1); }
+
+    /// serialize() with the PHF serialized on `threads` workers when it
+    /// can be (partitioned_phf). Same bytes.
+    [[nodiscard]] std::vector<std::byte> serialize(size_t threads) const {
+        auto phf_bytes = detail::serialize_with_threads(phf_, threads);
+        auto rec_bytes = records_.serialize();
+        std::vector<std::byte> out;
+        out.reserve(16 + phf_bytes.size() + rec_bytes.size());
+        phf_serial::append(out, static_cast<uint32_t>(FPBits));
+        phf_serial::append(out, static_cast<uint32_t>(M));
+        phf_serial::append(out, static_cast<uint64_t>(phf_bytes.size()));
+        out.insert(out.end(), phf_bytes.begin(), phf_bytes.end());
+        out.insert(out.end(), rec_bytes.begin(), rec_bytes.end());
+        return out;
+    }
+
+    /// Stream serialize()'s bytes to `sink`; a PHF with serialize_to()
+    /// streams too, so no full copy is built. io_error once the sink fails.
+    template<typename Sink>
+        requires phf_serial::byte_sink<Sink>
+    [[nodiscard]] result<void> serialize_to(Sink& sink, size_t threads = 1) const {
+        std::vector<std::byte> head;
+        phf_serial::append(head, static_cast<uint32_t>(FPBits));
+        phf_serial::append(head, static_cast<uint32_t>(M));
+        phf_serial::append(head, detail::serialized_size_of(phf_, threads));
+        const auto rec_bytes = records_.serialize();
+        if (!sink(std::span<const std::byte>(head)) || !detail::serialize_into(phf_, sink, threads)
+            || !sink(std::span<const std::byte>(rec_bytes))) {
+            return std::unexpected(error::io_error);
+        }
+        return {};
+    }
+
+    [[nodiscard]] result<void> serialize_to(std::ostream& os, size_t threads = 1) const {
+        phf_serial::ostream_sink sink{os};
+        return serialize_to(sink, threads);
+    }
+
+    [[nodiscard]] static result<verified_value_array>
+    deserialize(std::span<const std::byte> bytes) {
+        return deserialize(bytes, 1);
+    }
+
+    /// Rejects a width mismatch and a record array too small for the
+    /// PHF's range. The PHF decodes on `threads` workers when it can.
+    [[nodiscard]] static result<verified_value_array>
+    deserialize(std::span<const std::byte> bytes, size_t threads) {
+        phf_serial::reader r{bytes};
+        uint32_t fp_bits{}, value_bits{};
+        uint64_t phf_sz{};
+        if (!r.read(fp_bits) || fp_bits != FPBits) return std::unexpected(error::invalid_format);
+        if (!r.read(value_bits) || value_bits != M) return std::unexpected(error::invalid_format);
+        if (!r.read(phf_sz)) return std::unexpected(error::invalid_format);
+        std::span<const std::byte> phf_span;
+        if (!r.read_span(phf_span, static_cast<size_t>(phf_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        auto phf_r = detail::deserialize_with_threads<PHF>(phf_span, threads);
+        if (!phf_r) return std::unexpected(phf_r.error());
+
+        auto rec = record_array::deserialize(bytes.subspan(r.offset()));
+        if (!rec || rec->num_slots() < phf_r->range_size()
+            || rec->memory_bytes() * 8 < rec->num_slots() * (FPBits + M)) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        verified_value_array out{};
+        out.phf_ = std::move(*phf_r);
+        out.records_ = std::move(*rec);
+        return out;
+    }
+
+    // ===== Builder =====
+
+    class builder {
+        // Keys are stored once here and lent to the PHF builder at
+        // build() time, so each key is copied at most once.
+        typename PHF::builder phf_builder_{};
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+
+    public:
+        builder() = default;
+
+        builder& add(std::string_view key, value_type value) {
+            keys_.add(key);
+            values_.push_back(value);
+            return *this;
+        }
+
+        // Parallel spans; the shorter length wins.
+        builder& add_all(std::span<const std::string> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.borrow_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        template <typename ValueFn>
+            requires std::invocable<ValueFn, std::string_view>
+        builder& add_all_with(std::span<const std::string> keys, ValueFn fn) {
+            keys_.add_all(keys);
+            values_.reserve(values_.size() + keys.size());
+            for (const auto& k : keys) {
+                values_.push_back(static_cast<value_type>(fn(std::string_view{k})));
+            }
+            return *this;
+        }
+
+        // Forward inner-PHF builder knobs when present.
+
+        builder& with_seed(uint64_t seed)
+            requires requires(typename PHF::builder& b) { b.with_seed(seed); } {
+            phf_builder_.with_seed(seed);
+            return *this;
+        }
+
+        builder& with_threads(size_t n)
+            requires requires(typename PHF::builder& b) { b.with_threads(n); } {
+            phf_builder_.with_threads(n);
+            return *this;
+        }
+
+        builder& with_executor(executor& ex)
+            requires requires(typename PHF::builder& b) { b.with_executor(ex); } {
+            phf_builder_.with_executor(ex);
+            return *this;
+        }
+
+        // The report is the PHF build's.
+        builder& with_report(build_report& report)
+            requires requires(typename PHF::builder& b) { b.with_report(report); } {
+            phf_builder_.with_report(report);
+            return *this;
+        }
+
+        builder& with_dedup(key_dedup mode)
+            requires requires(typename PHF::builder& b) { b.with_dedup(mode); } {
+            phf_builder_.with_dedup(mode);
+            return *this;
+        }
+
+        builder& with_padding(uint64_t factor)
+            requires requires(typename PHF::builder& b) { b.with_padding(factor); } {
+            phf_builder_.with_padding(factor);
+            return *this;
+        }
+
+        [[nodiscard]] result<verified_value_array> build() {
+            auto phf_builder = phf_builder_;
+            detail::borrow_keys_into(phf_builder, keys_.views());
+            auto built = phf_builder.build();
+            if (!built.has_value()) return std::unexpected(built.error());
+
+            verified_value_array out{};
+            out.phf_ = std::move(*built);
+            out.records_.resize(out.phf_.range_size());
+
+            // In insertion order, so the last of duplicate keys wins.
+            for (size_t i = 0; i < keys_.size(); ++i) {
+                hashed_key hk{keys_[i]};
+                auto slot = static_cast<size_t>(slot_for_hashed(out.phf_, hk));
+                out.records_.set(slot, static_cast<typename record_array::value_type>(
+                    fingerprint(hk) | (static_cast<uint64_t>(values_[i]) << FPBits)));
+            }
+            return out;
+        }
+    };
+
+private:
+    static constexpr uint64_t fp_mask_ = (uint64_t{1} << FPBits) - 1;
+
+    static uint64_t fingerprint(const hashed_key& hk) noexcept {
+        return membership_fingerprint(hk.digest) & fp_mask_;
+    }
+
+    PHF phf_{};
+    record_array records_{};
+};
+
+} // namespace maph
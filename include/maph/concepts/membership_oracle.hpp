@@ -10,6 +10,9 @@
 #pragma once
 
 #include "../core.hpp"
+#include "../detail/hash.hpp"
+#include <algorithm>
+#include <span>
 #include <string_view>
 
 namespace maph {
@@ -29,4 +32,43 @@ concept membership_oracle = requires(const O o, std::string_view key) {
     { o.memory_bytes() }     -> std::convertible_to<size_t>;
 };
 
+/**
+ * @concept hashed_membership_oracle
+ * @brief An oracle that can verify a pre-hashed key: verify(hashed_key{k}) == verify(k).
+ */
+template<typename O>
+concept hashed_membership_oracle = membership_oracle<O> &&
+    requires(const O o, const hashed_key& hk) {
+        { o.verify(hk) } -> std::convertible_to<bool>;
+    };
+
+/// verify() of a pre-hashed key; falls back to re-hashing the key bytes.
+template<typename O>
+    requires requires(const O o, std::string_view key) { { o.verify(key) } -> std::convertible_to<bool>; }
+[[nodiscard]] bool verify_hashed(const O& oracle, const hashed_key& hk) {
+    if constexpr (requires { { oracle.verify(hk) } -> std::convertible_to<bool>; }) {
+        return oracle.verify(hk);
+    } else {
+        return oracle.verify(hk.key);
+    }
+}
+
+/**
+ * @brief Verify a batch of keys: out[i] = oracle.verify(keys[i])
+ *
+ * Dispatches to the oracle's own verify_batch() (window prefetch, and
+ * vector gathers in the xor and binary fuse filters) when it has one.
+ * Processes min(keys.size(), out.size()) keys.
+ */
+template<typename O>
+    requires requires(const O o, std::string_view key) { { o.verify(key) } -> std::convertible_to<bool>; }
+void verify_batch(const O& oracle, std::span<const std::string_view> keys, std::span<bool> out) {
+    if constexpr (requires { oracle.verify_batch(keys, out); }) {
+        oracle.verify_batch(keys, out);
+    } else {
+        size_t n = std::min(keys.size(), out.size());
+        for (size_t i = 0; i < n; ++i) out[i] = oracle.verify(keys[i]);
+    }
+}
+
 } // namespace maph
@@ -10,6 +10,8 @@
 #pragma once
 
 #include "../core.hpp"
+#include "../detail/hash.hpp"
+#include <algorithm>
 #include <string_view>
 #include <vector>
 #include <span>
@@ -38,6 +40,69 @@ concept perfect_hash_function = requires(const P p, std::string_view key) {
     { p.serialize() }      -> std::convertible_to<std::vector<std::byte>>;
 };
 
+/**
+ * @concept batched_perfect_hash_function
+ * @brief A perfect hash function with a native batched lookup
+ *
+ * slot_for_batch(keys, out) writes slot_for(keys[i]) into out[i] for every
+ * i < min(keys.size(), out.size()). Implementations pipeline the batch:
+ * hash a window of keys, prefetch the words each key will touch, then
+ * resolve, so independent cache misses overlap instead of serializing.
+ *
+ * Optional: callers should go through maph::slot_for_batch(), which falls
+ * back to a slot_for() loop for PHFs that do not provide one.
+ */
+template<typename P>
+concept batched_perfect_hash_function = perfect_hash_function<P> &&
+    requires(const P p, std::span<const std::string_view> keys, std::span<slot_index> out) {
+        p.slot_for_batch(keys, out);
+    };
+
+/**
+ * @brief Resolve a batch of keys: out[i] = phf.slot_for(keys[i])
+ *
+ * Dispatches to the PHF's own pipelined slot_for_batch() when it has one.
+ * Processes min(keys.size(), out.size()) keys.
+ */
+template<perfect_hash_function P>
+void slot_for_batch(const P& phf, std::span<const std::string_view> keys,
+                    std::span<slot_index> out) noexcept {
+    if constexpr (batched_perfect_hash_function<P>) {
+        phf.slot_for_batch(keys, out);
+    } else {
+        size_t n = std::min(keys.size(), out.size());
+        for (size_t i = 0; i < n; ++i) out[i] = slot_index{phf.slot_for(keys[i])};
+    }
+}
+
+/**
+ * @concept hashed_perfect_hash_function
+ * @brief A perfect hash function that can resolve a pre-hashed key
+ *
+ * slot_for(hashed_key{k}) == slot_for(k) for every k. Compositions that
+ * consult several components per key hash it once and use this overload.
+ */
+template<typename P>
+concept hashed_perfect_hash_function = perfect_hash_function<P> &&
+    requires(const P p, const hashed_key& hk) {
+        { p.slot_for(hk) } -> std::convertible_to<slot_index>;
+    };
+
+/**
+ * @brief slot_for() of a pre-hashed key
+ *
+ * Uses the PHF's hashed_key overload when it has one, otherwise re-hashes
+ * the key bytes through slot_for(string_view).
+ */
+template<perfect_hash_function P>
+[[nodiscard]] slot_index slot_for_hashed(const P& phf, const hashed_key& hk) noexcept {
+    if constexpr (hashed_perfect_hash_function<P>) {
+        return slot_index{phf.slot_for(hk)};
+    } else {
+        return slot_index{phf.slot_for(hk.key)};
+    }
+}
+
 /**
  * @concept phf_builder
  * @brief A builder that constructs a perfect hash function from a key set
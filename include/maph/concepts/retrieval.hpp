@@ -40,6 +40,8 @@
 
 #pragma once
 
+#include "../detail/hash.hpp"
+
 #include <concepts>
 #include <cstddef>
 #include <string_view>
@@ -71,4 +73,24 @@ concept retrieval = requires(const T t, std::string_view key) {
     { t.serialize() }     -> std::convertible_to<std::vector<std::byte>>;
 };
 
+/**
+ * @concept hashed_retrieval
+ * @brief A retrieval that can look up a pre-hashed key: lookup(hashed_key{k}) == lookup(k).
+ */
+template <typename T>
+concept hashed_retrieval = retrieval<T> &&
+    requires(const T t, const hashed_key& hk) {
+        { t.lookup(hk) } -> std::convertible_to<typename T::value_type>;
+    };
+
+/// lookup() of a pre-hashed key; falls back to re-hashing the key bytes.
+template <retrieval T>
+[[nodiscard]] typename T::value_type lookup_hashed(const T& r, const hashed_key& hk) {
+    if constexpr (hashed_retrieval<T>) {
+        return r.lookup(hk);
+    } else {
+        return r.lookup(hk.key);
+    }
+}
+
 } // namespace maph
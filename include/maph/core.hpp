@@ -45,7 +45,8 @@ enum class error {
     key_not_found,
     value_too_large,
     permission_denied,
-    optimization_failed
+    optimization_failed,
+    duplicate_key   ///< two keys (or pre-hashed digests) are equal
 };
 
 template<typename T>
@@ -0,0 +1,161 @@
+/**
+ * @file amac.hpp
+ * @brief Asynchronous memory access chaining: G lookups in flight at once.
+ *
+ * A batched lookup (slot_for_batch, lookup_batch) walks a window of keys
+ * in lock-step passes: hash all, prefetch all, resolve all. Every key in
+ * the window waits for the slowest one, and a structure that needs two
+ * dependent reads (a PHF slot, then the value stored at it) pays two
+ * stalls per window. Interleaving instead keeps G independent lookups in
+ * a ring, each a small state machine that issues a prefetch and yields;
+ * the executor steps them round-robin and refills a finished entry with
+ * the next key, so every stage of every lookup overlaps with the others.
+ *
+ * A structure takes part through two members over a lookup_cursor:
+ *
+ *   void lookup_start(lookup_cursor& c) const;  // c.hk is set; prefetch
+ *   bool lookup_step(lookup_cursor& c) const;   // true once c holds the result
+ *
+ * PHFs leave their slot in c.slot; retrievals and filters their value or
+ * verdict in c.value. Structures without the members still interleave:
+ * stage_start() calls their prefetch(hk) when they have one, and the
+ * first step resolves with a plain hashed call.
+ *
+ * State machines rather than C++20 coroutines: a coroutine frame is a
+ * heap allocation per lookup unless the compiler elides it, and the state
+ * here is a few words.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "hash.hpp"
+#include "prefetch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <span>
+
+namespace maph::detail {
+
+/// In-flight lookups of the interleaved queries when the caller picks none.
+inline constexpr size_t interleave_group = 16;
+
+/// State of one in-flight lookup. Each layer of a composed structure
+/// owns its fields: the PHF its stage, partitioned_phf its shard and
+/// routed flag, the value array or filter on top its resolved flag.
+struct lookup_cursor {
+    hashed_key hk{};
+    uint64_t slot{0};      // PHF result
+    uint64_t value{0};     // retrieval value, or filter verdict
+    uint64_t shard{0};
+    uint32_t stage{0};
+    bool hashed{false};    // interleave_keys: digest computed
+    bool routed{false};
+    bool resolved{false};
+};
+
+template<typename T>
+concept staged_lookup = requires(const T& t, lookup_cursor& c) {
+    t.lookup_start(c);
+    { t.lookup_step(c) } -> std::convertible_to<bool>;
+};
+
+/// Begin a lookup of c.hk in t: its own first stage, or its prefetch.
+template<typename T>
+void stage_start(const T& t, lookup_cursor& c) noexcept {
+    c.stage = 0;
+    if constexpr (staged_lookup<T>) {
+        t.lookup_start(c);
+    } else if constexpr (requires { t.prefetch(c.hk); }) {
+        t.prefetch(c.hk);
+    }
+}
+
+/// Advance a PHF lookup; true once c.slot is its slot.
+template<typename PHF>
+bool phf_step(const PHF& phf, lookup_cursor& c) noexcept {
+    if constexpr (staged_lookup<PHF>) {
+        return phf.lookup_step(c);
+    } else {
+        c.slot = slot_for_hashed(phf, c.hk).value;
+        return true;
+    }
+}
+
+/// Advance a lookup in t; true once c.value holds its result. `resolve`
+/// computes that result directly for structures without stages.
+template<typename T, typename Resolve>
+bool value_step(const T& t, lookup_cursor& c, Resolve&& resolve) {
+    if constexpr (staged_lookup<T>) {
+        return t.lookup_step(c);
+    } else {
+        c.value = static_cast<uint64_t>(resolve());
+        return true;
+    }
+}
+
+/**
+ * Run n lookups with up to G in flight. start(i, state) begins lookup i;
+ * step(i, state) advances it and returns true when it has delivered its
+ * result. A finished entry is refilled with the next lookup and left to
+ * its prefetch until the ring comes around again.
+ */
+template<size_t G, typename State, typename Start, typename Step>
+    requires (G >= 1)
+void interleave(size_t n, Start&& start, Step&& step) {
+    State ring[G];
+    size_t index[G];
+    size_t live = 0;
+    size_t next = 0;
+    for (; live < G && next < n; ++live, ++next) {
+        index[live] = next;
+        start(next, ring[live]);
+    }
+    while (live != 0) {
+        for (size_t j = 0; j < live;) {
+            if (!step(index[j], ring[j])) {
+                ++j;
+            } else if (next < n) {
+                index[j] = next;
+                start(next++, ring[j]);
+                ++j;
+            } else {
+                --live;
+                index[j] = index[live];
+                ring[j] = ring[live];
+            }
+        }
+    }
+}
+
+/// Interleaved lookups of keys in t, handing (i, c) to `done` for each
+/// finished lookup. The common core of the lookup_interleaved() members.
+/// The first stage prefetches the key's bytes: keys past the small-string
+/// buffer live on the heap, and hashing them is a miss of its own.
+template<size_t G, typename T, typename Step, typename Done>
+void interleave_keys(const T& t, std::span<const std::string_view> keys,
+                     Step&& step, Done&& done) {
+    interleave<G, lookup_cursor>(
+        keys.size(),
+        [&](size_t i, lookup_cursor& c) {
+            c = lookup_cursor{};
+            c.hk.key = keys[i];
+            prefetch_read(keys[i].data());
+        },
+        [&](size_t i, lookup_cursor& c) {
+            if (!c.hashed) {
+                c.hashed = true;
+                c.hk = hashed_key{c.hk.key};
+                stage_start(t, c);
+                return false;
+            }
+            if (!step(c)) return false;
+            done(i, c);
+            return true;
+        });
+}
+
+} // namespace maph::detail
@@ -0,0 +1,190 @@
+/**
+ * @file build_report.hpp
+ * @brief What a build did: attempts, seeds, time per phase, pilot and
+ *        retry statistics, scratch memory.
+ *
+ * A slow build, or one that bumped alpha, says nothing about why. Builders
+ * that take with_report(report) fill a build_report as they go:
+ *
+ *   build_report report;
+ *   auto phf = phobic5::builder{}.add_all(keys).with_report(report).build();
+ *   std::cerr << report.attempts << " attempts, "
+ *             << report.ms(build_report::phase::pilot_search) << " ms search\n";
+ *
+ * Every builder's with_report(report) works the same way: build() resets
+ * the report, fills it, and leaves it complete on every return. The
+ * report must outlive build(). A failed build still has its attempts,
+ * seeds, phase times and total_ms; range_size stays 0. The notes on a
+ * builder's with_report() only say what its fields mean there.
+ *
+ * Phase times add up over every attempt. A phase a builder does not have
+ * stays at zero, as do the statistics it has nothing to say about. With
+ * no report the builders do no timing at all.
+ *
+ * partitioned_phf gives every shard's inner build a report of its own,
+ * kept in `shards`, and sums them into its own (aggregate_shards): phase
+ * times are then summed over shards, i.e. CPU time rather than wall time,
+ * and slowest_shard() picks out stragglers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace maph {
+
+struct build_report {
+    enum class phase : uint8_t {
+        hash,          // key digests and seeded hashes
+        sort,          // dedup, grouping keys by bucket, partitioning
+        bucket_order,  // ordering buckets for the search
+        pilot_search,  // pilot or bucket-seed search; the band solve of a ribbon
+        encode,        // packing the result: pilot tables, choice bits, rank structures
+    };
+    static constexpr size_t num_phases = 5;
+
+    size_t keys{0};
+    size_t range_size{0};
+    size_t attempts{0};                  // construction attempts, the successful one included
+    std::vector<uint64_t> seeds{};       // the seed of each attempt, in order
+    std::array<double, num_phases> phase_ms{};
+    double total_ms{0};                  // wall time of build()
+
+    uint32_t max_pilot{0};               // largest pilot (bucket seed for shock_hash)
+    double avg_pilot{0};                 // mean over non-empty buckets
+    size_t resumed_searches{0};          // parallel phobic: speculative pilots re-searched at commit
+    size_t ribbon_retries{0};            // failed ribbon solves, over every shard of the band
+    size_t peak_scratch_bytes{0};        // working memory held at the build's peak
+
+    std::vector<build_report> shards{};  // partitioned_phf: one per shard
+
+    [[nodiscard]] double& ms(phase p) noexcept { return phase_ms[static_cast<size_t>(p)]; }
+    [[nodiscard]] double ms(phase p) const noexcept { return phase_ms[static_cast<size_t>(p)]; }
+
+    [[nodiscard]] static constexpr const char* phase_name(phase p) noexcept {
+        constexpr const char* names[num_phases] = {
+            "hash", "sort", "bucket_order", "pilot_search", "encode"};
+        return names[static_cast<size_t>(p)];
+    }
+
+    /// range_size / keys, the load the build ended at.
+    [[nodiscard]] double alpha() const noexcept {
+        return keys == 0 ? 0.0 : static_cast<double>(range_size) / static_cast<double>(keys);
+    }
+
+    /// Index of the shard with the longest build, or shards.size() if none.
+    [[nodiscard]] size_t slowest_shard() const noexcept {
+        size_t best = shards.size();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (best == shards.size() || shards[i].total_ms > shards[best].total_ms) best = i;
+        }
+        return best;
+    }
+
+    /// Fold the shards' reports into this one. Counts and phase times are
+    /// summed, pilots maximized and averaged by key count, and scratch is
+    /// the largest single shard's (a worker's scratch is reused across its
+    /// shards, so at most that times the number of workers).
+    void aggregate_shards() noexcept {
+        double pilot_sum = 0;
+        for (const auto& s : shards) {
+            attempts += s.attempts;
+            for (size_t p = 0; p < num_phases; ++p) phase_ms[p] += s.phase_ms[p];
+            max_pilot = std::max(max_pilot, s.max_pilot);
+            pilot_sum += s.avg_pilot * static_cast<double>(s.keys);
+            resumed_searches += s.resumed_searches;
+            ribbon_retries += s.ribbon_retries;
+            peak_scratch_bytes = std::max(peak_scratch_bytes, s.peak_scratch_bytes);
+        }
+        if (keys != 0) avg_pilot = pilot_sum / static_cast<double>(keys);
+    }
+};
+
+namespace detail {
+
+/**
+ * A builder's handle on its optional report. Every call is a no-op on a
+ * null report, so build code reads the same either way and takes the
+ * clock only when someone asked. A build that returns without finish()
+ * (any error path) still gets its total time when the recorder goes out
+ * of scope.
+ */
+class build_recorder {
+    using clock = std::chrono::steady_clock;
+
+    build_report* r_;
+    clock::time_point start_{};
+    mutable bool finished_{false};
+
+    [[nodiscard]] double elapsed_ms() const noexcept {
+        return std::chrono::duration<double, std::milli>(clock::now() - start_).count();
+    }
+
+public:
+    explicit build_recorder(build_report* r) noexcept : r_(r) {
+        if (r_ == nullptr) return;
+        *r_ = build_report{};
+        start_ = clock::now();
+    }
+    ~build_recorder() {
+        if (r_ != nullptr && !finished_) r_->total_ms = elapsed_ms();
+    }
+    build_recorder(const build_recorder&) = delete;
+    build_recorder& operator=(const build_recorder&) = delete;
+
+    [[nodiscard]] explicit operator bool() const noexcept { return r_ != nullptr; }
+    [[nodiscard]] build_report* get() const noexcept { return r_; }
+    build_report* operator->() const noexcept { return r_; }
+
+    void attempt(uint64_t seed) const {
+        if (r_ == nullptr) return;
+        ++r_->attempts;
+        r_->seeds.push_back(seed);
+    }
+
+    void scratch(size_t bytes) const noexcept {
+        if (r_ != nullptr) r_->peak_scratch_bytes = std::max(r_->peak_scratch_bytes, bytes);
+    }
+
+    /// Adds the scope's wall time to phase p.
+    class phase_timer {
+        build_report* r_;
+        build_report::phase p_;
+        clock::time_point t0_{};
+
+    public:
+        phase_timer(build_report* r, build_report::phase p) noexcept : r_(r), p_(p) {
+            if (r_ != nullptr) t0_ = clock::now();
+        }
+        ~phase_timer() { stop(); }
+
+        /// End the phase before the scope does.
+        void stop() noexcept {
+            if (r_ == nullptr) return;
+            r_->ms(p_) += std::chrono::duration<double, std::milli>(clock::now() - t0_).count();
+            r_ = nullptr;
+        }
+        phase_timer(const phase_timer&) = delete;
+        phase_timer& operator=(const phase_timer&) = delete;
+    };
+
+    [[nodiscard]] phase_timer time(build_report::phase p) const noexcept { return {r_, p}; }
+
+    /// Record the result's shape and the elapsed wall time.
+    void finish(size_t keys, size_t range_size) const noexcept {
+        if (r_ == nullptr) return;
+        finished_ = true;
+        r_->keys = keys;
+        r_->range_size = range_size;
+        r_->total_ms = elapsed_ms();
+    }
+};
+
+} // namespace detail
+
+} // namespace maph
@@ -0,0 +1,54 @@
+/**
+ * @file build_scratch.hpp
+ * @brief Reusable working memory for PHF builds.
+ *
+ * A phobic_phf build attempt hashes every key into per-key arrays, groups
+ * the keys by bucket, orders the buckets and marks slots in a bitmap, and
+ * each of those arrays used to be allocated afresh per attempt. A seed
+ * retry repeats all of it, and partitioned_phf runs thousands of small
+ * inner builds, so at its default 15K keys per shard the allocator churn
+ * is a visible part of the build.
+ *
+ * build_scratch holds those arrays between builds. Capacities only grow,
+ * so after the first build on a thread later ones of the same size
+ * allocate nothing but their result:
+ *
+ *   build_scratch scratch;
+ *   for (auto& shard : shards) {
+ *       auto phf = phobic5::builder{}.borrow_all(shard)
+ *                      .with_scratch(scratch).build();
+ *   }
+ *
+ * A builder without with_scratch() keeps its own for the retries of one
+ * build(). partitioned_phf gives each worker thread one scratch and lends
+ * it to every inner build that takes it. A scratch serves one build at a
+ * time; parallel builds use one per thread.
+ */
+
+#pragma once
+
+#include "radix_partition.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace maph {
+
+struct build_scratch {
+    std::vector<uint64_t> hashes{};         // per key: the slot hash
+    std::vector<size_t> buckets{};          // per key: its bucket
+    detail::bucket_groups groups{};         // key indices by bucket
+    std::vector<size_t> order{};            // buckets in processing order
+    std::vector<uint64_t> occupied{};       // slot bitmap, 64 slots per word
+    std::vector<uint16_t> pilots{};         // per bucket, moved into the result
+
+    /// Bytes held, for sizing a pool of scratches.
+    [[nodiscard]] size_t capacity_bytes() const noexcept {
+        return hashes.capacity() * sizeof(uint64_t) + buckets.capacity() * sizeof(size_t)
+             + groups.capacity_bytes() + order.capacity() * sizeof(size_t)
+             + occupied.capacity() * sizeof(uint64_t) + pilots.capacity() * sizeof(uint16_t);
+    }
+};
+
+} // namespace maph
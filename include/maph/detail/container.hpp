@@ -0,0 +1,396 @@
+/**
+ * @file container.hpp
+ * @brief Sectioned container: a table of contents over aligned,
+ *        checksummed sections.
+ *
+ * The per-structure formats (phf_serial) pack fields back to back and
+ * nest sub-structures behind length prefixes, so a reader has to walk a
+ * blob from the front to reach its tail, and nothing in it is aligned.
+ * The container records where every section starts:
+ *
+ *   header    64 bytes: magic, version, algorithm id, section count,
+ *             container size, TOC checksum, header checksum
+ *   TOC       32 bytes per section: tag, index, offset, size, checksum,
+ *             sorted by (tag, index)
+ *   sections  each at a 64-byte aligned offset, zero padded between
+ *
+ * container_view::open() checks the header and the TOC only, O(sections);
+ * a section's checksum is checked when it is read through checked() or
+ * array(), or for every section at once, in parallel, with verify_all().
+ * Offsets are aligned relative to the start of the container, so over a
+ * mapped_file (page aligned) every section starts on a cache line and
+ * array<T>() hands out typed spans without copying.
+ *
+ * A structure opts in with write_sections(container_writer&) and a static
+ * read_sections(const container_view&); to_container() / from_container()
+ * store any other structure as one payload section of its serialize()
+ * bytes. Compositions nest their components as containers of their own,
+ * so a partitioned_phf inside a perfect_filter keeps its shard sections.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+#include "hash.hpp"
+#include "serialization.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+constexpr uint64_t CONTAINER_MAGIC = 0x524E54434850414DULL;  // "MAPHCTNR"
+constexpr uint32_t CONTAINER_VERSION = 1;
+constexpr size_t CONTAINER_ALIGNMENT = 64;
+
+/// What a section holds. A structure may use several sections of one tag,
+/// told apart by their index (e.g. one shard section per shard).
+enum class section_tag : uint32_t {
+    payload = 1,       ///< serialize() bytes of a structure without sections
+    meta = 2,          ///< scalar fields
+    offsets = 3,       ///< uint64_t array
+    shard = 4,         ///< one per shard, index = shard number
+    phf = 5,           ///< a nested container holding the PHF
+    values = 6,
+    fingerprints = 7,
+    retrieval = 8,     ///< a nested container holding the retrieval
+    oracle = 9,        ///< a nested container holding the membership oracle
+};
+
+/// One TOC entry, as stored.
+struct section_entry {
+    uint32_t tag{0};
+    uint32_t index{0};
+    uint64_t offset{0};  // from the start of the container
+    uint64_t size{0};
+    uint64_t checksum{0};
+};
+static_assert(sizeof(section_entry) == 32);
+
+namespace detail {
+
+struct container_header {
+    uint64_t magic{CONTAINER_MAGIC};
+    uint32_t version{CONTAINER_VERSION};
+    uint32_t algorithm{0};
+    uint64_t section_count{0};
+    uint64_t size{0};
+    uint64_t toc_checksum{0};
+    uint64_t reserved[2]{};
+    uint64_t header_checksum{0};  // of the 56 bytes before it
+};
+static_assert(sizeof(container_header) == 64);
+
+[[nodiscard]] inline uint64_t section_checksum(std::span<const std::byte> bytes) noexcept {
+    const auto d = phf_hash128({reinterpret_cast<const char*>(bytes.data()), bytes.size()});
+    return d.lo ^ (d.hi * 0x9e3779b97f4a7c15ULL);
+}
+
+[[nodiscard]] inline constexpr uint64_t align_section(uint64_t off) noexcept {
+    return (off + CONTAINER_ALIGNMENT - 1) & ~uint64_t{CONTAINER_ALIGNMENT - 1};
+}
+
+[[nodiscard]] inline constexpr bool entry_before(const section_entry& a, const section_entry& b) noexcept {
+    return a.tag != b.tag ? a.tag < b.tag : a.index < b.index;
+}
+
+} // namespace detail
+
+/**
+ * Collects sections and lays them out. Adding a (tag, index) that is
+ * already present replaces it.
+ */
+class container_writer {
+    struct pending {
+        section_entry entry;
+        std::vector<std::byte> bytes;
+    };
+    std::vector<pending> sections_;
+    uint32_t algorithm_{0};
+
+public:
+    container_writer() = default;
+    explicit container_writer(uint32_t algorithm) noexcept : algorithm_(algorithm) {}
+
+    container_writer& add(section_tag tag, uint32_t index, std::vector<std::byte> bytes) {
+        pending p{section_entry{static_cast<uint32_t>(tag), index, 0, bytes.size(), 0}, std::move(bytes)};
+        sections_.push_back(std::move(p));
+        return *this;
+    }
+
+    container_writer& add(section_tag tag, std::vector<std::byte> bytes) {
+        return add(tag, 0, std::move(bytes));
+    }
+
+    /// The elements' bytes, with no count prefix: the section size says it.
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    container_writer& add_array(section_tag tag, uint32_t index, std::span<const T> values) {
+        std::vector<std::byte> bytes(values.size_bytes());
+        if (!values.empty()) std::memcpy(bytes.data(), values.data(), bytes.size());
+        return add(tag, index, std::move(bytes));
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return sections_.size(); }
+
+    [[nodiscard]] std::vector<std::byte> finish() const {
+        // Sort by (tag, index), keeping the last of each duplicate.
+        std::vector<size_t> order(sections_.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return detail::entry_before(sections_[a].entry, sections_[b].entry);
+        });
+        std::vector<size_t> kept;
+        kept.reserve(order.size());
+        for (size_t i : order) {
+            if (!kept.empty() && !detail::entry_before(sections_[kept.back()].entry, sections_[i].entry)) {
+                kept.back() = i;
+            } else {
+                kept.push_back(i);
+            }
+        }
+
+        std::vector<section_entry> toc(kept.size());
+        uint64_t off = detail::align_section(sizeof(detail::container_header)
+                                             + toc.size() * sizeof(section_entry));
+        for (size_t i = 0; i < kept.size(); ++i) {
+            const auto& s = sections_[kept[i]];
+            toc[i] = s.entry;
+            toc[i].offset = off;
+            toc[i].checksum = detail::section_checksum(s.bytes);
+            off = detail::align_section(off + s.bytes.size());
+        }
+        const uint64_t total = toc.empty() ? off : toc.back().offset + toc.back().size;
+
+        std::vector<std::byte> out(static_cast<size_t>(total));
+        if (!toc.empty()) {
+            std::memcpy(out.data() + sizeof(detail::container_header), toc.data(),
+                        toc.size() * sizeof(section_entry));
+        }
+        for (size_t i = 0; i < kept.size(); ++i) {
+            const auto& bytes = sections_[kept[i]].bytes;
+            if (!bytes.empty()) std::memcpy(out.data() + toc[i].offset, bytes.data(), bytes.size());
+        }
+
+        detail::container_header h;
+        h.algorithm = algorithm_;
+        h.section_count = toc.size();
+        h.size = total;
+        h.toc_checksum = detail::section_checksum(
+            std::span<const std::byte>(out).subspan(sizeof(h), toc.size() * sizeof(section_entry)));
+        std::memcpy(out.data(), &h, sizeof(h));
+        h.header_checksum = detail::section_checksum(std::span<const std::byte>(out).first(56));
+        std::memcpy(out.data(), &h, sizeof(h));
+        return out;
+    }
+};
+
+/**
+ * Read-only view of a container. Holds no copy: the bytes must outlive it.
+ */
+class container_view {
+    std::span<const std::byte> data_{};
+    size_t count_{0};
+    uint32_t algorithm_{0};
+
+public:
+    container_view() = default;
+
+    /// Check the header and the TOC. Sections are checked when read.
+    /// Bytes past the recorded container size are ignored.
+    [[nodiscard]] static result<container_view> open(std::span<const std::byte> data) {
+        detail::container_header h;
+        if (data.size() < sizeof(h)) return std::unexpected(error::invalid_format);
+        std::memcpy(&h, data.data(), sizeof(h));
+        if (h.magic != CONTAINER_MAGIC || h.version != CONTAINER_VERSION
+            || h.header_checksum != detail::section_checksum(data.first(56))
+            || h.size < sizeof(h) || h.size > data.size()
+            || h.section_count > (h.size - sizeof(h)) / sizeof(section_entry)) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        container_view v;
+        v.data_ = data.first(static_cast<size_t>(h.size));
+        v.count_ = static_cast<size_t>(h.section_count);
+        v.algorithm_ = h.algorithm;
+        const size_t toc_end = sizeof(h) + v.count_ * sizeof(section_entry);
+        if (h.toc_checksum != detail::section_checksum(v.data_.subspan(sizeof(h), toc_end - sizeof(h)))) {
+            return std::unexpected(error::invalid_format);
+        }
+        for (size_t i = 0; i < v.count_; ++i) {
+            const auto e = v.entry(i);
+            if (e.offset % CONTAINER_ALIGNMENT != 0 || e.offset < toc_end || e.offset > h.size
+                || e.size > h.size - e.offset
+                || (i > 0 && !detail::entry_before(v.entry(i - 1), e))) {
+                return std::unexpected(error::invalid_format);
+            }
+        }
+        return v;
+    }
+
+    [[nodiscard]] uint32_t algorithm() const noexcept { return algorithm_; }
+    [[nodiscard]] size_t section_count() const noexcept { return count_; }
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return data_; }
+
+    [[nodiscard]] section_entry entry(size_t i) const noexcept {
+        section_entry e;
+        std::memcpy(&e, data_.data() + sizeof(detail::container_header) + i * sizeof(e), sizeof(e));
+        return e;
+    }
+
+    /// Position of (tag, index) in the TOC: a binary search.
+    [[nodiscard]] std::optional<size_t> find(section_tag tag, uint32_t index = 0) const noexcept {
+        const section_entry key{static_cast<uint32_t>(tag), index, 0, 0, 0};
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (detail::entry_before(entry(mid), key)) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < count_) {
+            const auto e = entry(lo);
+            if (e.tag == key.tag && e.index == index) return lo;
+        }
+        return std::nullopt;
+    }
+
+    /// Number of sections with this tag.
+    [[nodiscard]] size_t count(section_tag tag) const noexcept {
+        size_t n = 0;
+        for (size_t i = 0; i < count_; ++i) n += entry(i).tag == static_cast<uint32_t>(tag);
+        return n;
+    }
+
+    /// Section i's bytes, unchecked.
+    [[nodiscard]] std::span<const std::byte> section(size_t i) const noexcept {
+        const auto e = entry(i);
+        return data_.subspan(static_cast<size_t>(e.offset), static_cast<size_t>(e.size));
+    }
+
+    [[nodiscard]] bool verify(size_t i) const noexcept {
+        return detail::section_checksum(section(i)) == entry(i).checksum;
+    }
+
+    /// Check every section's checksum, spread over `threads` threads.
+    [[nodiscard]] result<void> verify_all(size_t threads = 1) const {
+        std::atomic<size_t> next{0};
+        std::atomic<bool> ok{true};
+        auto work = [&] {
+            for (size_t i = next++; i < count_ && ok.load(std::memory_order_relaxed); i = next++) {
+                if (!verify(i)) ok = false;
+            }
+        };
+        threads = std::clamp<size_t>(threads, 1, std::max<size_t>(count_, 1));
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) pool.emplace_back(work);
+        work();
+        for (auto& t : pool) t.join();
+        if (!ok) return std::unexpected(error::invalid_format);
+        return {};
+    }
+
+    /// The bytes of (tag, index) once its checksum matches.
+    [[nodiscard]] result<std::span<const std::byte>> checked(section_tag tag, uint32_t index = 0) const {
+        auto i = find(tag, index);
+        if (!i || !verify(*i)) return std::unexpected(error::invalid_format);
+        return section(*i);
+    }
+
+    /// A checked section as a typed span. invalid_format if its size is
+    /// not a multiple of sizeof(T) or it is not aligned for T (only
+    /// possible when the container itself starts misaligned).
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] result<std::span<const T>> array(section_tag tag, uint32_t index = 0) const {
+        auto s = checked(tag, index);
+        if (!s) return std::unexpected(s.error());
+        if (s->size() % sizeof(T) != 0
+            || reinterpret_cast<uintptr_t>(s->data()) % alignof(T) != 0) {
+            return std::unexpected(error::invalid_format);
+        }
+        return std::span<const T>(reinterpret_cast<const T*>(s->data()), s->size() / sizeof(T));
+    }
+};
+
+namespace detail {
+
+template<typename T>
+concept writes_sections = requires(const T& t, container_writer& w) { t.write_sections(w); };
+
+template<typename T>
+concept reads_sections = requires(const container_view& v) {
+    { T::read_sections(v) } -> std::same_as<result<T>>;
+};
+
+template<typename T>
+[[nodiscard]] constexpr uint32_t container_algorithm() noexcept {
+    if constexpr (requires { { T::ALGORITHM_ID } -> std::convertible_to<uint32_t>; }) {
+        return T::ALGORITHM_ID;
+    } else {
+        return 0;
+    }
+}
+
+/// T::deserialize as a result, whether it returns result<T> or optional<T>,
+/// with `threads` passed on when T takes them.
+template<typename T>
+[[nodiscard]] result<T> deserialize_as(std::span<const std::byte> bytes, size_t threads = 1) {
+    auto r = deserialize_with_threads<T>(bytes, threads);
+    if (!r) {
+        if constexpr (requires { r.error(); }) return std::unexpected(r.error());
+        else return std::unexpected(error::invalid_format);
+    }
+    return std::move(*r);
+}
+
+} // namespace detail
+
+/// obj as a container: its own sections, or one payload section.
+template<typename T>
+[[nodiscard]] std::vector<std::byte> to_container(const T& obj) {
+    container_writer w{detail::container_algorithm<T>()};
+    if constexpr (detail::writes_sections<T>) {
+        obj.write_sections(w);
+    } else {
+        w.add(section_tag::payload, obj.serialize());
+    }
+    return w.finish();
+}
+
+/// Load what to_container<T>() wrote. Each section is checksummed as it
+/// is read; call container_view::verify_all() first to check them all up
+/// front instead. `threads` reaches structures that decode in parallel.
+template<typename T>
+[[nodiscard]] result<T> from_container(const container_view& v, size_t threads = 1) {
+    if (v.algorithm() != detail::container_algorithm<T>()) return std::unexpected(error::invalid_format);
+    if constexpr (requires { { T::read_sections(v, threads) } -> std::same_as<result<T>>; }) {
+        return T::read_sections(v, threads);
+    } else if constexpr (detail::reads_sections<T>) {
+        return T::read_sections(v);
+    } else {
+        auto payload = v.checked(section_tag::payload);
+        if (!payload) return std::unexpected(payload.error());
+        return detail::deserialize_as<T>(*payload, threads);
+    }
+}
+
+template<typename T>
+[[nodiscard]] result<T> from_container(std::span<const std::byte> data, size_t threads = 1) {
+    auto v = container_view::open(data);
+    if (!v) return std::unexpected(v.error());
+    return from_container<T>(*v, threads);
+}
+
+} // namespace maph
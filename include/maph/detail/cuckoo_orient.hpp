@@ -22,6 +22,12 @@
  * The caller (shock_hash seed search) retries with a new seed.
  *
  * Complexity: O(V + E). Typical V = E = BucketSize ~ 64.
+ *
+ * cuckoo_orient takes any graph and allocates its adjacency lists.
+ * cuckoo_orient_fixed<BucketSize> is the same algorithm for shock_hash's
+ * inner loop, which calls it once per seed trial. Adjacency is a CSR in
+ * stack arrays sized by BucketSize and the peeling queue is an in-place
+ * stack, so a trial never allocates. Both return the same orientation.
  */
 
 #pragma once
@@ -30,6 +36,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace maph::detail {
@@ -146,4 +154,115 @@ cuckoo_orient(const std::vector<std::pair<uint32_t, uint32_t>>& edges,
     return cuckoo_orient_result{std::move(assignment)};
 }
 
+// Edge i is (first[i], second[i]); on success assignment[i] is set as in
+// cuckoo_orient. At most BucketSize edges over vertices < BucketSize.
+// Returns false if the graph is not orientable or the input is out of
+// range, leaving assignment unspecified.
+template <size_t BucketSize>
+    requires (BucketSize >= 1 && BucketSize <= 256)
+[[nodiscard]] inline bool
+cuckoo_orient_fixed(std::span<const uint8_t> first, std::span<const uint8_t> second,
+                    std::span<uint8_t> assignment) noexcept {
+    constexpr uint8_t UNASSIGNED = 0xFF;
+    const size_t n = first.size();
+    if (second.size() != n || assignment.size() != n || n > BucketSize) return false;
+    if (n == 0) return true;
+
+    // CSR adjacency: vertex v's entries are adj_edge/adj_other[start[v],
+    // start[v] + size[v]), filled in edge order like cuckoo_orient's
+    // push_back. Removal swaps with the last entry, as there.
+    std::array<uint16_t, BucketSize + 1> start{};
+    std::array<uint16_t, BucketSize> size{};
+    std::array<uint8_t, 2 * BucketSize> adj_edge;
+    std::array<uint8_t, 2 * BucketSize> adj_other;
+
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t a = first[i], b = second[i];
+        if (a >= BucketSize || b >= BucketSize) return false;
+        ++start[a + 1];
+        if (a != b) ++start[b + 1];
+    }
+    for (size_t v = 0; v < BucketSize; ++v) start[v + 1] = static_cast<uint16_t>(start[v + 1] + start[v]);
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t a = first[i], b = second[i];
+        const auto e = static_cast<uint8_t>(i);
+        adj_edge[start[a] + size[a]] = e;
+        adj_other[start[a] + size[a]++] = b;
+        if (a != b) {
+            adj_edge[start[b] + size[b]] = e;
+            adj_other[start[b] + size[b]++] = a;
+        }
+        assignment[i] = a == b ? 0 : UNASSIGNED;
+    }
+
+    auto remove_edge_from = [&](uint8_t v, uint8_t e) {
+        const size_t lo = start[v];
+        for (size_t j = lo; j < lo + size[v]; ++j) {
+            if (adj_edge[j] == e) {
+                const size_t last = lo + --size[v];
+                adj_edge[j] = adj_edge[last];
+                adj_other[j] = adj_other[last];
+                return;
+            }
+        }
+    };
+
+    // Peeling. Each vertex is pushed once up front and once per peeled
+    // edge at most, so 2 * BucketSize entries suffice.
+    std::array<uint8_t, 2 * BucketSize> queue;
+    size_t top = 0;
+    for (size_t v = 0; v < BucketSize; ++v) {
+        if (size[v] == 1) queue[top++] = static_cast<uint8_t>(v);
+    }
+    while (top != 0) {
+        const uint8_t v = queue[--top];
+        if (size[v] != 1) continue;
+        const uint8_t e = adj_edge[start[v]];
+        const uint8_t other = adj_other[start[v]];
+        size[v] = 0;
+        if (assignment[e] != UNASSIGNED) continue;
+        assignment[e] = first[e] == v ? 0 : 1;
+        remove_edge_from(other, e);
+        if (size[other] == 1) queue[top++] = other;
+    }
+
+    for (size_t v = 0; v < BucketSize; ++v) {
+        if (size[v] != 0 && size[v] != 2) return false;
+    }
+
+    // Cycle walk; popping the front of a two-entry list keeps the order
+    // cuckoo_orient's erase(begin()) leaves.
+    auto pop_front = [&](size_t v) {
+        const size_t lo = start[v];
+        for (size_t j = lo; j + 1 < lo + size[v]; ++j) {
+            adj_edge[j] = adj_edge[j + 1];
+            adj_other[j] = adj_other[j + 1];
+        }
+        --size[v];
+    };
+    for (size_t v = 0; v < BucketSize; ++v) {
+        while (size[v] != 0) {
+            const uint8_t e = adj_edge[start[v]];
+            const uint8_t other = adj_other[start[v]];
+            if (assignment[e] != UNASSIGNED) {
+                pop_front(v);
+                continue;
+            }
+            assignment[e] = first[e] == other ? 0 : 1;
+            pop_front(v);
+            remove_edge_from(other, e);
+        }
+    }
+
+    std::array<uint64_t, (BucketSize + 63) / 64> owned{};
+    for (size_t i = 0; i < n; ++i) {
+        if (assignment[i] == UNASSIGNED) return false;
+        const uint8_t slot = assignment[i] == 0 ? first[i] : second[i];
+        const uint64_t bit = uint64_t{1} << (slot % 64);
+        if (owned[slot / 64] & bit) return false;
+        owned[slot / 64] |= bit;
+    }
+    return true;
+}
+
 } // namespace maph::detail
@@ -0,0 +1,315 @@
+/**
+ * @file elias_fano.hpp
+ * @brief Elias-Fano coded nondecreasing integer sequence with O(1) access.
+ *
+ * Each value v_i is split into L = floor(log2(u / n)) low bits, stored
+ * packed, and a high part v_i >> L, stored in unary as bit (v_i >> L) + i
+ * of a bit vector. That costs 2 + log2(u / n) bits per element. Access i
+ * finds the i-th set bit of the high vector (a sampled select: the
+ * position of every SELECT_SAMPLE-th one is kept, and the rest is a short
+ * popcount scan) and rejoins it with the low bits.
+ *
+ * Used for recsplit's bucket directory: cumulative key counts and bit
+ * offsets per bucket, two monotone sequences with small gaps, and for
+ * phf_blob_store's value offsets.
+ *
+ * Wire format: [u64 count][u32 low_bits][low words][high words]. The
+ * select samples are rebuilt on load. serialize_indexed() appends them
+ * as [sample words], so elias_fano_view can query a mapped buffer in
+ * place without a pass over the high words.
+ */
+
+#pragma once
+
+#include "memory_report.hpp"
+#include "serialization.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace maph::detail {
+
+/// Position of the r-th (0-based) set bit of w; w must have more than r.
+/// Without BMI2: byte-wise prefix popcounts locate the byte (a SWAR
+/// compare against r), then at most seven bits are cleared inside it.
+[[nodiscard]] inline unsigned select_in_word(uint64_t w, unsigned r) noexcept {
+#if defined(__BMI2__)
+    return static_cast<unsigned>(std::countr_zero(_pdep_u64(uint64_t{1} << r, w)));
+#else
+    constexpr uint64_t L8 = 0x0101010101010101ULL;
+    constexpr uint64_t H8 = 0x8080808080808080ULL;
+    uint64_t s = w - ((w >> 1) & 0x5555555555555555ULL);
+    s = (s & 0x3333333333333333ULL) + ((s >> 2) & 0x3333333333333333ULL);
+    s = ((s + (s >> 4)) & 0x0f0f0f0f0f0f0f0fULL) * L8;  // byte i: ones in bytes 0..i
+    const auto byte = static_cast<unsigned>(
+        std::popcount((((r * L8) | H8) - s) & H8));     // bytes with prefix <= r
+    const unsigned before = byte == 0 ? 0 : static_cast<unsigned>((s >> (8 * byte - 8)) & 0xff);
+    uint64_t b = (w >> (8 * byte)) & 0xff;
+    for (r -= before; r != 0; --r) b &= b - 1;
+    return 8 * byte + static_cast<unsigned>(std::countr_zero(b));
+#endif
+}
+
+/// `width` (<= 64) bits of an LSB-first bit vector starting at bit
+/// `pos`. Reads words[pos / 64 + 1] only when the field straddles it.
+[[nodiscard]] inline uint64_t read_bits(const uint64_t* words, uint64_t pos,
+                                        unsigned width) noexcept {
+    if (width == 0) return 0;
+    const size_t w = static_cast<size_t>(pos / 64);
+    const unsigned off = static_cast<unsigned>(pos % 64);
+    uint64_t v = words[w] >> off;
+    if (off + width > 64) v |= words[w + 1] << (64 - off);
+    return width == 64 ? v : v & ((uint64_t{1} << width) - 1);
+}
+
+inline constexpr size_t EF_SELECT_SAMPLE = 256;
+
+/// Bit position in `high` of the i-th one, starting from the sampled
+/// position of every EF_SELECT_SAMPLE-th one. Words is any indexable
+/// sequence of uint64_t (a vector, or an array_view in place). The scan
+/// stops at the end of `high`: with too few ones (a corrupt image) the
+/// result is high.size() * 64 rather than a read past the words.
+template<typename Words, typename Samples>
+[[nodiscard]] uint64_t ef_select_high(const Words& high, const Samples& samples,
+                                      size_t i) noexcept {
+    const uint64_t start = samples[i / EF_SELECT_SAMPLE];
+    auto r = static_cast<unsigned>(i % EF_SELECT_SAMPLE);
+    size_t w = static_cast<size_t>(start / 64);
+    if (w >= high.size()) return static_cast<uint64_t>(high.size()) * 64;
+    uint64_t word = high[w] & (~uint64_t{0} << (start % 64));
+    for (;;) {
+        const auto ones = static_cast<unsigned>(std::popcount(word));
+        if (r < ones) return w * 64 + select_in_word(word, r);
+        r -= ones;
+        if (++w == high.size()) return static_cast<uint64_t>(w) * 64;
+        word = high[w];
+    }
+}
+
+/// Bit position in `high` of the first one after bit `pos`, or
+/// high.size() * 64 when there is none.
+template<typename Words>
+[[nodiscard]] uint64_t ef_next_high(const Words& high, uint64_t pos) noexcept {
+    size_t w = static_cast<size_t>(pos / 64);
+    if (w >= high.size()) return static_cast<uint64_t>(high.size()) * 64;
+    const unsigned off = static_cast<unsigned>(pos % 64);
+    uint64_t word = off == 63 ? 0 : high[w] & (~uint64_t{0} << (off + 1));
+    while (word == 0) {
+        if (++w == high.size()) return static_cast<uint64_t>(w) * 64;
+        word = high[w];
+    }
+    return w * 64 + static_cast<uint64_t>(std::countr_zero(word));
+}
+
+class elias_fano {
+    static constexpr size_t SELECT_SAMPLE = EF_SELECT_SAMPLE;
+
+    std::vector<uint64_t> low_{};
+    std::vector<uint64_t> high_{};
+    std::vector<uint64_t> samples_{};  // high_ bit of every SELECT_SAMPLE-th one
+    uint64_t count_{0};
+    uint32_t low_bits_{0};
+
+    void build_samples() {
+        samples_.clear();
+        samples_.reserve(static_cast<size_t>(count_ / SELECT_SAMPLE) + 1);
+        uint64_t seen = 0;
+        for (size_t w = 0; w < high_.size(); ++w) {
+            const uint64_t word = high_[w];
+            const auto ones = static_cast<uint64_t>(std::popcount(word));
+            // Next sample index falls inside this word.
+            while (samples_.size() * SELECT_SAMPLE < seen + ones) {
+                const auto r = static_cast<unsigned>(samples_.size() * SELECT_SAMPLE - seen);
+                samples_.push_back(w * 64 + select_in_word(word, r));
+            }
+            seen += ones;
+        }
+    }
+
+    // Bit position in high_ of the i-th one.
+    [[nodiscard]] uint64_t select_high(size_t i) const noexcept {
+        return ef_select_high(high_, samples_, i);
+    }
+
+    // Bit position of the first one after bit `pos`.
+    [[nodiscard]] uint64_t next_high(uint64_t pos) const noexcept {
+        return ef_next_high(high_, pos);
+    }
+
+    [[nodiscard]] uint64_t low(size_t i) const noexcept {
+        return read_bits(low_.data(), static_cast<uint64_t>(i) * low_bits_, low_bits_);
+    }
+
+public:
+    elias_fano() = default;
+
+    /// `values` must be nondecreasing.
+    explicit elias_fano(std::span<const uint64_t> values) : count_(values.size()) {
+        const uint64_t universe = values.empty() ? 0 : values.back();
+        if (count_ != 0 && universe / count_ != 0) {
+            low_bits_ = static_cast<uint32_t>(std::bit_width(universe / count_) - 1);
+        }
+        // One spare low word lets read_bits load two words unchecked.
+        low_.assign(static_cast<size_t>((count_ * low_bits_ + 63) / 64 + 1), 0);
+        high_.assign(static_cast<size_t>((count_ + (universe >> low_bits_) + 64) / 64), 0);
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (low_bits_ != 0) {
+                const uint64_t pos = static_cast<uint64_t>(i) * low_bits_;
+                const uint64_t v = values[i] & ((uint64_t{1} << low_bits_) - 1);
+                low_[static_cast<size_t>(pos / 64)] |= v << (pos % 64);
+                if (pos % 64 + low_bits_ > 64) {
+                    low_[static_cast<size_t>(pos / 64) + 1] |= v >> (64 - pos % 64);
+                }
+            }
+            const uint64_t h = (values[i] >> low_bits_) + i;
+            high_[static_cast<size_t>(h / 64)] |= uint64_t{1} << (h % 64);
+        }
+        build_samples();
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(count_); }
+
+    [[nodiscard]] uint64_t operator[](size_t i) const noexcept {
+        return ((select_high(i) - i) << low_bits_) | low(i);
+    }
+
+    /// Elements i and i + 1 for one select.
+    [[nodiscard]] std::pair<uint64_t, uint64_t> pair(size_t i) const noexcept {
+        const uint64_t h = select_high(i);
+        const uint64_t h_next = next_high(h);
+        return {((h - i) << low_bits_) | low(i),
+                ((h_next - i - 1) << low_bits_) | low(i + 1)};
+    }
+
+    /// Addresses element i's access starts from, for prefetching.
+    [[nodiscard]] const void* sample_address(size_t i) const noexcept {
+        return samples_.data() + i / SELECT_SAMPLE;
+    }
+
+    [[nodiscard]] const void* low_address(size_t i) const noexcept {
+        return low_.data() + static_cast<size_t>(static_cast<uint64_t>(i) * low_bits_ / 64);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return (low_.size() + high_.size() + samples_.size()) * sizeof(uint64_t);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return allocated_bytes(low_) + allocated_bytes(high_) + allocated_bytes(samples_);
+    }
+
+    void serialize(std::vector<std::byte>& out) const {
+        phf_serial::append(out, count_);
+        phf_serial::append(out, low_bits_);
+        phf_serial::append_vector(out, low_);
+        phf_serial::append_vector(out, high_);
+    }
+
+    /// Rejects arrays too short for count and low_bits, and a high vector
+    /// without exactly count ones.
+    [[nodiscard]] bool deserialize(phf_serial::reader& r) {
+        if (!r.read(count_) || !r.read(low_bits_) || low_bits_ >= 64) return false;
+        if (count_ > MAX_SERIALIZED_ELEMENT_COUNT) return false;
+        if (!r.read_vector(low_) || !r.read_vector(high_)) return false;
+        if (count_ != 0 && low_.size() < (count_ * low_bits_ + 63) / 64 + 1) return false;
+        uint64_t ones = 0;
+        for (uint64_t w : high_) ones += static_cast<uint64_t>(std::popcount(w));
+        if (ones != count_) return false;
+        build_samples();
+        return true;
+    }
+
+    /// serialize(), then the select samples.
+    void serialize_indexed(std::vector<std::byte>& out) const {
+        serialize(out);
+        phf_serial::append_vector(out, samples_);
+    }
+
+    /// Read serialize_indexed() output. The samples are rebuilt and must
+    /// match the stored ones.
+    [[nodiscard]] bool deserialize_indexed(phf_serial::reader& r) {
+        std::vector<uint64_t> stored;
+        return deserialize(r) && r.read_vector(stored) && stored == samples_;
+    }
+};
+
+/**
+ * elias_fano queried in place over serialize_indexed() bytes: the low,
+ * high and sample words are read where they lie (typically a mapped
+ * file), so binding costs no pass over the sequence. The buffer must
+ * outlive the view.
+ */
+class elias_fano_view {
+    phf_serial::array_view<uint64_t> low_{};
+    phf_serial::array_view<uint64_t> high_{};
+    phf_serial::array_view<uint64_t> samples_{};
+    uint64_t count_{0};
+    uint32_t low_bits_{0};
+
+    [[nodiscard]] uint64_t low(size_t i) const noexcept {
+        if (low_bits_ == 0) return 0;
+        const uint64_t pos = static_cast<uint64_t>(i) * low_bits_;
+        const size_t w = static_cast<size_t>(pos / 64);
+        const unsigned off = static_cast<unsigned>(pos % 64);
+        uint64_t v = low_[w] >> off;
+        if (off + low_bits_ > 64) v |= low_[w + 1] << (64 - off);
+        return v & ((uint64_t{1} << low_bits_) - 1);
+    }
+
+public:
+    elias_fano_view() = default;
+
+    [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(count_); }
+
+    [[nodiscard]] uint64_t operator[](size_t i) const noexcept {
+        return ((ef_select_high(high_, samples_, i) - i) << low_bits_) | low(i);
+    }
+
+    /// Elements i and i + 1 for one select.
+    [[nodiscard]] std::pair<uint64_t, uint64_t> pair(size_t i) const noexcept {
+        const uint64_t h = ef_select_high(high_, samples_, i);
+        const uint64_t h_next = ef_next_high(high_, h);
+        return {((h - i) << low_bits_) | low(i),
+                ((h_next - i - 1) << low_bits_) | low(i + 1)};
+    }
+
+    [[nodiscard]] const void* sample_address(size_t i) const noexcept {
+        return samples_.address(i / EF_SELECT_SAMPLE);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return low_.size_bytes() + high_.size_bytes() + samples_.size_bytes();
+    }
+
+    /// Bind to serialize_indexed() output. Checks the array sizes, that
+    /// the high words hold exactly count ones (about 1/4 byte read per
+    /// element), and that the samples are increasing positions inside
+    /// them. The low words are not read.
+    [[nodiscard]] bool bind(phf_serial::reader& r) noexcept {
+        if (!r.read(count_) || !r.read(low_bits_) || low_bits_ >= 64) return false;
+        if (count_ > MAX_SERIALIZED_ELEMENT_COUNT) return false;
+        if (!r.read_array(low_) || !r.read_array(high_) || !r.read_array(samples_)) return false;
+        if (count_ != 0 && low_.size() < (count_ * low_bits_ + 63) / 64 + 1) return false;
+        if (high_.size() * 64 < count_) return false;
+        if (samples_.size() != (count_ + EF_SELECT_SAMPLE - 1) / EF_SELECT_SAMPLE) return false;
+        uint64_t ones = 0;
+        for (size_t i = 0; i < high_.size(); ++i) ones += static_cast<uint64_t>(std::popcount(high_[i]));
+        if (ones != count_) return false;
+        for (size_t i = 0; i < samples_.size(); ++i) {
+            if (samples_[i] >= high_.size() * 64 || (i > 0 && samples_[i] <= samples_[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace maph::detail
@@ -2,21 +2,32 @@
  * @file fingerprint_hash.hpp
  * @brief Independent hash used for approximate membership fingerprints.
  *
- * SplitMix64 finalization applied to FNV-1a. Must be independent of
- * the internal mixing used by any perfect hash function so that a
+ * Derived from the same phf_hash128 digest as the PHF hashes but through
+ * a different mix (two splitmix64 rounds folding both digest words), so a
  * spurious PHF collision does not imply a spurious fingerprint match.
  */
 
 #pragma once
 
+#include "hash.hpp"
 #include <cstdint>
 #include <string_view>
 
 namespace maph {
 
+/// Fingerprint hash of an already-computed digest.
+[[nodiscard]] inline uint64_t membership_fingerprint(const hash128& digest) noexcept {
+    return phf_remix(digest.hi ^ phf_remix(digest.lo ^ 0xcbf29ce484222325ULL));
+}
+
 /// Independent hash for fingerprinting. Must differ from perfect hash internals.
-/// SplitMix64 finalization applied to FNV-1a.
 [[nodiscard]] inline uint64_t membership_fingerprint(std::string_view key) noexcept {
+    return membership_fingerprint(phf_hash128(key));
+}
+
+/// SplitMix64 finalization applied to FNV-1a. The format-version-2
+/// fingerprint hash; only used by structures loaded from v2 data.
+[[nodiscard]] inline uint64_t membership_fingerprint_fnv(std::string_view key) noexcept {
     uint64_t h = 0xcbf29ce484222325ULL;
     for (unsigned char c : key) {
         h ^= c;
@@ -30,4 +41,25 @@ namespace maph {
     return h;
 }
 
+/// Fingerprint hash under the given revision.
+[[nodiscard]] inline uint64_t membership_fingerprint(std::string_view key,
+                                                     hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? membership_fingerprint(key)
+                                      : membership_fingerprint_fnv(key);
+}
+
+/// Fingerprint hash of a hashed key under the given revision.
+[[nodiscard]] inline uint64_t membership_fingerprint(const hashed_key& hk,
+                                                     hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? membership_fingerprint(hk.digest)
+                                      : membership_fingerprint_fnv(hk.key);
+}
+
+/// Fingerprint hash of an integer key (its little-endian bytes).
+template<integer_key K>
+[[nodiscard]] inline uint64_t membership_fingerprint(const K& key, hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? membership_fingerprint(phf_hash128_int(key))
+                                      : membership_fingerprint_fnv(integer_key_bytes(key));
+}
+
 } // namespace maph
@@ -0,0 +1,124 @@
+/**
+ * @file golomb_rice.hpp
+ * @brief Bit vector writer and Golomb-Rice decoding cursor.
+ *
+ * A Golomb-Rice code with parameter k writes x as its low k bits (the
+ * fixed part) and x >> k in unary (that many zeros, then a one). recsplit
+ * stores each bucket's split tree as all fixed parts in preorder followed
+ * by all unary parts in preorder, so a subtree is skipped by advancing
+ * the fixed cursor by its fixed bit count and the unary cursor past as
+ * many ones as it has nodes, without decoding it.
+ *
+ * Bit vectors are LSB-first: bit i is bit i % 64 of word i / 64.
+ */
+
+#pragma once
+
+#include "elias_fano.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace maph::detail {
+
+class bit_writer {
+    std::vector<uint64_t> words_{};
+    uint64_t size_{0};
+
+    void reserve_bits(uint64_t bits) {
+        const auto need = static_cast<size_t>((size_ + bits + 63) / 64);
+        if (words_.size() < need) words_.resize(need, 0);
+    }
+
+public:
+    /// Low `width` (<= 64) bits of value.
+    void append(uint64_t value, unsigned width) {
+        if (width == 0) return;
+        if (width < 64) value &= (uint64_t{1} << width) - 1;
+        reserve_bits(width);
+        const auto w = static_cast<size_t>(size_ / 64);
+        const auto off = static_cast<unsigned>(size_ % 64);
+        words_[w] |= value << off;
+        if (off + width > 64) words_[w + 1] |= value >> (64 - off);
+        size_ += width;
+    }
+
+    /// `zeros` zero bits, then a one.
+    void append_unary(uint64_t zeros) {
+        reserve_bits(zeros + 1);
+        size_ += zeros;
+        words_[static_cast<size_t>(size_ / 64)] |= uint64_t{1} << (size_ % 64);
+        ++size_;
+    }
+
+    void append(const bit_writer& other) {
+        const uint64_t full = other.size_ / 64;
+        for (size_t w = 0; w < full; ++w) append(other.words_[w], 64);
+        if (other.size_ % 64 != 0) {
+            append(other.words_[static_cast<size_t>(full)], static_cast<unsigned>(other.size_ % 64));
+        }
+    }
+
+    void clear() noexcept {
+        words_.clear();
+        size_ = 0;
+    }
+
+    [[nodiscard]] uint64_t size() const noexcept { return size_; }
+
+    /// The words; bits past size() are zero.
+    [[nodiscard]] std::vector<uint64_t> take() && {
+        words_.resize(static_cast<size_t>((size_ + 63) / 64));
+        size_ = 0;
+        return std::move(words_);
+    }
+};
+
+/// Reads Golomb-Rice codes whose fixed and unary parts live in separate
+/// regions of one bit vector.
+class rice_reader {
+    const uint64_t* words_;
+    uint64_t fixed_;
+    uint64_t unary_;
+
+public:
+    rice_reader(const uint64_t* words, uint64_t fixed_pos, uint64_t unary_pos) noexcept
+        : words_(words), fixed_(fixed_pos), unary_(unary_pos) {}
+
+    [[nodiscard]] uint64_t next(unsigned k) noexcept {
+        const uint64_t lo = read_bits(words_, fixed_, k);
+        fixed_ += k;
+        size_t w = static_cast<size_t>(unary_ / 64);
+        uint64_t word = words_[w] >> (unary_ % 64);
+        uint64_t zeros = 0;
+        if (word == 0) {
+            zeros = 64 - unary_ % 64;
+            while ((word = words_[++w]) == 0) zeros += 64;
+        }
+        zeros += static_cast<uint64_t>(std::countr_zero(word));
+        unary_ += zeros + 1;
+        return (zeros << k) | lo;
+    }
+
+    /// Skip `nodes` codes whose fixed parts total `fixed_bits`.
+    void skip(size_t nodes, uint64_t fixed_bits) noexcept {
+        fixed_ += fixed_bits;
+        if (nodes == 0) return;
+        size_t w = static_cast<size_t>(unary_ / 64);
+        uint64_t word = words_[w] & (~uint64_t{0} << (unary_ % 64));
+        for (;;) {
+            const auto ones = static_cast<size_t>(std::popcount(word));
+            if (nodes <= ones) {
+                unary_ = w * 64 + select_in_word(word, static_cast<unsigned>(nodes - 1)) + 1;
+                return;
+            }
+            nodes -= ones;
+            word = words_[++w];
+        }
+    }
+};
+
+} // namespace maph::detail
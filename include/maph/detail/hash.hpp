@@ -2,15 +2,44 @@
  * @file hash.hpp
  * @brief Shared hash primitives used by PHF algorithms.
  *
- * The splitmix64 finalizer and FNV-1a-with-seed are used identically by
- * several algorithms. Factored out to avoid duplication.
+ * Keys are hashed once into a 128-bit digest (phf_hash128) that reads the
+ * key 8/16/32 bytes at a time; every per-algorithm hash (bucket, level,
+ * pilot, shard, fingerprint) is a seeded mix of that digest. Long keys
+ * (> 256 bytes) go through a striped accumulator with AVX2 and NEON
+ * paths whose output is bit-identical to the portable scalar loop, so a
+ * structure built on one machine queries identically on any other.
+ *
+ * hashed_key carries one digest through a composed lookup so each key is
+ * read once per query, however many components consult it.
+ *
+ * phf_hash128 and the seeded mixes are constexpr: in constant evaluation
+ * the key is read a byte at a time and the vector paths are skipped, for
+ * the same digest, so a table built at compile time (static_phf) agrees
+ * with every runtime structure.
+ *
+ * The previous byte-at-a-time FNV-1a hashes are kept as *_fnv variants:
+ * structures deserialized from format version 2 keep using them (see
+ * hash_revision).
  */
 
 #pragma once
 
+#include "prefetch.hpp"
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <span>
 #include <string_view>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace maph {
 
 /// SplitMix64 final mixer — strong avalanche in a few cycles.
@@ -20,8 +49,387 @@ namespace maph {
     return z ^ (z >> 31);
 }
 
-/// FNV-1a over the key bytes starting from `seed`, finalized with splitmix64.
+/// 128-bit key digest produced by phf_hash128().
+struct hash128 {
+    uint64_t lo{0};
+    uint64_t hi{0};
+
+    friend constexpr bool operator==(const hash128&, const hash128&) noexcept = default;
+};
+
+/**
+ * Which key hash a structure was built with. Structures built by this
+ * version use `wide`; those deserialized from format version 2 (or from a
+ * headerless blob without WIDE_HASH_FLAG) use `fnv1a`.
+ */
+enum class hash_revision : uint8_t {
+    fnv1a,  ///< byte-at-a-time FNV-1a + splitmix (format version 2)
+    wide    ///< phf_hash128 digest + seeded mix (format version 3+)
+};
+
+/// Set in the leading width field of headerless formats (filters,
+/// retrievals, shock_hash) written with hash_revision::wide. Blobs from
+/// before the wide hash have it clear.
+inline constexpr uint32_t WIDE_HASH_FLAG = 1u << 16;
+
+namespace detail {
+
+/// wyhash-style mix: 64x64 -> 128 multiply, xor-folded.
+[[nodiscard]] inline constexpr uint64_t wymix(uint64_t a, uint64_t b) noexcept {
+    __uint128_t full = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(full) ^ static_cast<uint64_t>(full >> 64);
+}
+
+/// a % d without a division (Lemire, Kaser and Kurz, "Faster remainder by
+/// direct computation", 2019). Exact for every 64-bit a and d >= 1, so it
+/// can replace % where the result is part of a format. m = 2^128 / d + 1.
+struct fastmod_u64 {
+    __uint128_t m{0};
+    uint64_t d{1};
+
+    fastmod_u64() = default;
+    explicit fastmod_u64(uint64_t divisor) noexcept
+        : m(~__uint128_t{0} / divisor + 1), d(divisor) {}
+
+    [[nodiscard]] static uint64_t reduce(uint64_t a, __uint128_t m, uint64_t d) noexcept {
+        const __uint128_t low = m * a;
+        const __uint128_t bottom = (static_cast<__uint128_t>(static_cast<uint64_t>(low)) * d) >> 64;
+        const __uint128_t top = (low >> 64) * d;
+        return static_cast<uint64_t>((bottom + top) >> 64);
+    }
+
+    [[nodiscard]] uint64_t operator()(uint64_t a) const noexcept { return reduce(a, m, d); }
+};
+
+// Little-endian loads; byte by byte in constant evaluation.
+template<typename Byte>
+    requires (sizeof(Byte) == 1)
+[[nodiscard]] inline constexpr uint64_t read_le(const Byte* p, size_t n) noexcept {
+    uint64_t v = 0;
+    for (size_t i = n; i-- > 0;) v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+template<typename Byte>
+    requires (sizeof(Byte) == 1)
+[[nodiscard]] inline constexpr uint64_t read64(const Byte* p) noexcept {
+    if consteval {
+        return read_le(p, 8);
+    } else {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        if constexpr (std::endian::native == std::endian::big) v = std::byteswap(v);
+        return v;
+    }
+}
+
+template<typename Byte>
+    requires (sizeof(Byte) == 1)
+[[nodiscard]] inline constexpr uint64_t read32(const Byte* p) noexcept {
+    if consteval {
+        return read_le(p, 4);
+    } else {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        if constexpr (std::endian::native == std::endian::big) v = std::byteswap(v);
+        return v;
+    }
+}
+
+inline constexpr uint64_t hash_secret[8] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+    0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+    0x1d8e4e27c47d124fULL, 0x9e3779b97f4a7c15ULL,
+    0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL,
+};
+
+// ----- Long keys: 64-byte stripes into eight 64-bit lanes -----
+//
+// Per lane j: acc[j] += lo32(x) * hi32(x) with x = data[j] ^ secret[j], and
+// acc[j ^ 1] += data[j]. Only 32x32 -> 64 multiplies, so AVX2/NEON can run
+// four/two lanes per instruction and match the scalar loop bit for bit.
+// Every 16 stripes the lanes are scrambled so high bits feed back down.
+
+inline constexpr size_t hash_stripe_bytes = 64;
+inline constexpr size_t hash_stripes_per_block = 16;
+inline constexpr size_t hash_long_threshold = 256;
+inline constexpr uint64_t hash_scramble_mul = 0x9E3779B1ULL;
+
+inline constexpr uint64_t hash_stripe_secret[8] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+    0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+    0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+inline constexpr uint64_t hash_scramble_secret[8] = {
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL,
+    0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL,
+    0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL,
+};
+
+template<typename Byte>
+inline constexpr void accumulate_stripes_scalar(uint64_t* acc, const Byte* p,
+                                                size_t stripes) noexcept {
+    for (size_t s = 0; s < stripes; ++s, p += hash_stripe_bytes) {
+        for (size_t j = 0; j < 8; ++j) {
+            uint64_t d = read64(p + 8 * j);
+            uint64_t x = d ^ hash_stripe_secret[j];
+            acc[j ^ 1] += d;
+            acc[j] += (x & 0xffffffffULL) * (x >> 32);
+        }
+    }
+}
+
+inline constexpr void scramble_scalar(uint64_t* acc) noexcept {
+    for (size_t j = 0; j < 8; ++j) {
+        uint64_t a = acc[j];
+        a ^= a >> 47;
+        a ^= hash_scramble_secret[j];
+        acc[j] = a * hash_scramble_mul;
+    }
+}
+
+#if defined(__AVX2__)
+
+inline void accumulate_stripes_simd(uint64_t* acc, const unsigned char* p,
+                                    size_t stripes) noexcept {
+    __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+    __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+    const __m256i k0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hash_stripe_secret));
+    const __m256i k1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hash_stripe_secret + 4));
+    auto lane = [](__m256i a, __m256i d, __m256i k) {
+        __m256i x = _mm256_xor_si256(d, k);
+        __m256i prod = _mm256_mul_epu32(x, _mm256_srli_epi64(x, 32));
+        __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        return _mm256_add_epi64(a, _mm256_add_epi64(prod, swapped));
+    };
+    for (size_t s = 0; s < stripes; ++s, p += hash_stripe_bytes) {
+        a0 = lane(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), k0);
+        a1 = lane(a1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), k1);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), a1);
+}
+
+inline constexpr bool hash_has_simd = true;
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+inline void accumulate_stripes_simd(uint64_t* acc, const unsigned char* p,
+                                    size_t stripes) noexcept {
+    uint64x2_t a[4];
+    uint64x2_t k[4];
+    for (size_t i = 0; i < 4; ++i) {
+        a[i] = vld1q_u64(acc + 2 * i);
+        k[i] = vld1q_u64(hash_stripe_secret + 2 * i);
+    }
+    for (size_t s = 0; s < stripes; ++s, p += hash_stripe_bytes) {
+        for (size_t i = 0; i < 4; ++i) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + 16 * i));
+            uint64x2_t x = veorq_u64(d, k[i]);
+            uint64x2_t prod = vmull_u32(vmovn_u64(x), vshrn_n_u64(x, 32));
+            uint64x2_t swapped = vextq_u64(d, d, 1);
+            a[i] = vaddq_u64(a[i], vaddq_u64(prod, swapped));
+        }
+    }
+    for (size_t i = 0; i < 4; ++i) vst1q_u64(acc + 2 * i, a[i]);
+}
+
+inline constexpr bool hash_has_simd = true;
+
+#else
+
+inline void accumulate_stripes_simd(uint64_t* acc, const unsigned char* p,
+                                    size_t stripes) noexcept {
+    accumulate_stripes_scalar(acc, p, stripes);
+}
+
+inline constexpr bool hash_has_simd = false;
+
+#endif
+
+/**
+ * phf_hash128 implementation. UseSimd selects the vector stripe loop for
+ * long keys; both settings produce identical digests (tested), the flag
+ * only exists so tests and benchmarks can compare the two paths.
+ */
+template<bool UseSimd>
+[[nodiscard]] inline constexpr hash128 phf_hash128_impl(std::string_view key) noexcept {
+    const char* p = key.data();
+    const size_t len = key.size();
+    uint64_t s0 = hash_secret[0];
+    uint64_t s1 = hash_secret[1];
+    uint64_t a = 0, b = 0;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // Overlapping 4-byte reads cover every byte of a 4..16 byte key.
+            const size_t off = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + off);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - off);
+        } else if (len > 0) {
+            a = (uint64_t{static_cast<unsigned char>(p[0])} << 16)
+              | (uint64_t{static_cast<unsigned char>(p[len >> 1])} << 8)
+              | static_cast<unsigned char>(p[len - 1]);
+        }
+    } else {
+        size_t i = len;
+        if (i > hash_long_threshold) {
+            uint64_t acc[8] = {
+                hash_secret[0], hash_secret[1], hash_secret[2], hash_secret[3],
+                hash_secret[4], hash_secret[5], hash_secret[6], hash_secret[7],
+            };
+            // Leave 1..64 bytes for the tail below.
+            size_t stripes = (i - 1) / hash_stripe_bytes;
+            while (stripes > 0) {
+                size_t run = stripes < hash_stripes_per_block ? stripes : hash_stripes_per_block;
+                if consteval {
+                    accumulate_stripes_scalar(acc, p, run);
+                } else {
+                    if constexpr (UseSimd) {
+                        accumulate_stripes_simd(acc, reinterpret_cast<const unsigned char*>(p), run);
+                    } else {
+                        accumulate_stripes_scalar(acc, p, run);
+                    }
+                }
+                if (run == hash_stripes_per_block) scramble_scalar(acc);
+                p += run * hash_stripe_bytes;
+                i -= run * hash_stripe_bytes;
+                stripes -= run;
+            }
+            // Two different pairings so a change in lane j reaches both
+            // output words through different products.
+            s0 ^= wymix(acc[0] ^ hash_secret[0], acc[1] ^ hash_secret[1])
+                ^ wymix(acc[2] ^ hash_secret[2], acc[3] ^ hash_secret[3])
+                ^ wymix(acc[4] ^ hash_secret[4], acc[5] ^ hash_secret[5])
+                ^ wymix(acc[6] ^ hash_secret[6], acc[7] ^ hash_secret[7]);
+            s1 ^= wymix(acc[0] ^ hash_secret[3], acc[7] ^ hash_secret[2])
+                ^ wymix(acc[1] ^ hash_secret[5], acc[6] ^ hash_secret[4])
+                ^ wymix(acc[2] ^ hash_secret[7], acc[5] ^ hash_secret[6])
+                ^ wymix(acc[3] ^ hash_secret[1], acc[4] ^ hash_secret[0]);
+        }
+        if (i > 32) {
+            // 32 bytes per round in four independent multiply chains;
+            // every 16-byte block feeds both halves of the digest.
+            uint64_t s2 = hash_secret[2];
+            uint64_t s3 = hash_secret[3];
+            do {
+                uint64_t a0 = read64(p), b0 = read64(p + 8);
+                uint64_t a1 = read64(p + 16), b1 = read64(p + 24);
+                s0 = wymix(a0 ^ hash_secret[4], b0 ^ s0);
+                s1 = wymix(a0 ^ hash_secret[5], b0 ^ s1);
+                s2 = wymix(a1 ^ hash_secret[4], b1 ^ s2);
+                s3 = wymix(a1 ^ hash_secret[5], b1 ^ s3);
+                p += 32;
+                i -= 32;
+            } while (i > 32);
+            s0 ^= s2;
+            s1 ^= s3;
+        }
+        if (i > 16) {
+            uint64_t a0 = read64(p), b0 = read64(p + 8);
+            s0 = wymix(a0 ^ hash_secret[4], b0 ^ s0);
+            s1 = wymix(a0 ^ hash_secret[5], b0 ^ s1);
+            p += 16;
+            i -= 16;
+        }
+        // Last 16 bytes, overlapping already-consumed input when i < 16.
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    uint64_t lo = wymix(wymix(a ^ hash_secret[6], b ^ s0) ^ len, hash_secret[1]);
+    uint64_t hi = wymix(wymix(a ^ hash_secret[7], b ^ s1) ^ len, hash_secret[3]);
+    return {lo, hi};
+}
+
+} // namespace detail
+
+/// 128-bit digest of the key bytes. Unseeded: seeds are applied per use
+/// via phf_hash_with_seed(digest, seed).
+[[nodiscard]] inline constexpr hash128 phf_hash128(std::string_view key) noexcept {
+    return detail::phf_hash128_impl<detail::hash_has_simd>(key);
+}
+
+/// phf_hash128 of the 8 little-endian bytes of `key`, without reading
+/// memory or branching on the length: the two words phf_hash128 loads for
+/// an 8-byte key are the key and its 32-bit rotation.
+[[nodiscard]] inline constexpr hash128 phf_hash128_u64(uint64_t key) noexcept {
+    using detail::hash_secret;
+    using detail::wymix;
+    const uint64_t a = std::rotl(key, 32);
+    const uint64_t lo = wymix(wymix(a ^ hash_secret[6], key ^ hash_secret[0]) ^ 8, hash_secret[1]);
+    const uint64_t hi = wymix(wymix(a ^ hash_secret[7], key ^ hash_secret[1]) ^ 8, hash_secret[3]);
+    return {lo, hi};
+}
+
+/// phf_hash128 of the 16 little-endian bytes of `key`.
+[[nodiscard]] inline constexpr hash128 phf_hash128_u128(__uint128_t key) noexcept {
+    using detail::hash_secret;
+    using detail::wymix;
+    constexpr uint64_t low32 = 0xffffffffULL;
+    const uint64_t l = static_cast<uint64_t>(key);
+    const uint64_t h = static_cast<uint64_t>(key >> 64);
+    const uint64_t a = (l << 32) | (h & low32);
+    const uint64_t b = (h & ~low32) | (l >> 32);
+    const uint64_t lo = wymix(wymix(a ^ hash_secret[6], b ^ hash_secret[0]) ^ 16, hash_secret[1]);
+    const uint64_t hi = wymix(wymix(a ^ hash_secret[7], b ^ hash_secret[1]) ^ 16, hash_secret[3]);
+    return {lo, hi};
+}
+
+/// Fixed-width integer keys taken natively by builders and queries.
+/// An integer key is the same key as the string of its little-endian
+/// bytes (integer_key_bytes): a structure built from integers answers
+/// string queries of those bytes identically, and the other way round.
+template<typename K>
+concept integer_key = std::same_as<K, uint64_t> || std::same_as<K, __uint128_t>;
+
+/// A string-like or integer key.
+template<typename K>
+concept key_like = std::convertible_to<const K&, std::string_view> || integer_key<K>;
+
+/// The bytes an integer key stands for: a view of `key` itself, valid
+/// while it is.
+template<integer_key K>
+[[nodiscard]] inline std::string_view integer_key_bytes(const K& key) noexcept {
+    static_assert(std::endian::native == std::endian::little,
+                  "integer keys are their little-endian bytes");
+    return {reinterpret_cast<const char*>(&key), sizeof(K)};
+}
+
+template<integer_key K>
+[[nodiscard]] inline constexpr hash128 phf_hash128_int(K key) noexcept {
+    if constexpr (std::same_as<K, uint64_t>) return phf_hash128_u64(key);
+    else return phf_hash128_u128(key);
+}
+
+namespace detail {
+
+/// Key bytes of a string-like or integer key; for an integer, a view of
+/// the argument itself.
+template<key_like K>
+[[nodiscard]] inline std::string_view key_view(const K& key) noexcept {
+    if constexpr (integer_key<K>) return integer_key_bytes(key);
+    else return std::string_view{key};
+}
+
+} // namespace detail
+
+/// Seeded 64-bit hash derived from a digest. One multiply.
+[[nodiscard]] inline constexpr uint64_t phf_hash_with_seed(const hash128& digest, uint64_t seed) noexcept {
+    return detail::wymix(digest.lo ^ seed, digest.hi ^ detail::hash_secret[2]);
+}
+
+/// Seeded 64-bit hash of the key bytes.
 [[nodiscard]] inline uint64_t phf_hash_with_seed(std::string_view key, uint64_t seed) noexcept {
+    return phf_hash_with_seed(phf_hash128(key), seed);
+}
+
+/// FNV-1a over the key bytes starting from `seed`, finalized with splitmix64.
+/// The format-version-2 hash; only used by structures loaded from v2 data.
+[[nodiscard]] inline uint64_t phf_hash_with_seed_fnv(std::string_view key, uint64_t seed) noexcept {
     uint64_t h = seed;
     for (unsigned char c : key) {
         h ^= c;
@@ -30,4 +438,223 @@ namespace maph {
     return phf_remix(h);
 }
 
+/// Seeded hash under the given revision.
+[[nodiscard]] inline uint64_t phf_hash_with_seed(std::string_view key, uint64_t seed,
+                                                 hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? phf_hash_with_seed(key, seed)
+                                      : phf_hash_with_seed_fnv(key, seed);
+}
+
+// ===== HASHED KEY =====
+
+/**
+ * A key hashed once. Compositions (perfect_filter, bloomier,
+ * partitioned_phf, ...) build one hashed_key per query and pass it to
+ * every component's slot_for / verify / lookup overload, each of which
+ * derives its own seeded hashes from the digest instead of re-reading
+ * the key bytes.
+ *
+ * Holds a view of the key: structures loaded from format-version-2 data
+ * hash with FNV-1a and need the bytes. The view must outlive the
+ * hashed_key's use, as with any string_view.
+ */
+struct hashed_key {
+    hash128 digest{};
+    std::string_view key{};
+
+    hashed_key() = default;
+    explicit constexpr hashed_key(std::string_view k) noexcept : digest(phf_hash128(k)), key(k) {}
+
+    /// An integer key, hashed without reading its bytes. The view is of
+    /// `k` itself, so a temporary is refused.
+    template<integer_key K>
+    explicit hashed_key(const K& k) noexcept : digest(phf_hash128_int(k)), key(integer_key_bytes(k)) {}
+    template<integer_key K>
+    hashed_key(const K&&) = delete;
+
+    /// A key known only by its digest (builder::add_hashes). Only
+    /// hash_revision::wide structures derive everything from the digest;
+    /// one loaded from a format version 2 blob (hash_revision::fnv1a)
+    /// hashes the key bytes, which this key does not have, so its slot
+    /// or value for a digest-only key is meaningless.
+    explicit hashed_key(const hash128& d) noexcept : digest(d) {}
+
+    [[nodiscard]] size_t length() const noexcept { return key.size(); }
+};
+
+namespace detail {
+
+/// Bytes of a plain or pre-hashed key, for the byte-loop v2 hashes.
+[[nodiscard]] inline std::string_view key_bytes(std::string_view key) noexcept { return key; }
+[[nodiscard]] inline std::string_view key_bytes(const hashed_key& hk) noexcept { return hk.key; }
+
+} // namespace detail
+
+/// Seeded hash of a hashed key under the given revision.
+[[nodiscard]] inline uint64_t phf_hash_with_seed(const hashed_key& hk, uint64_t seed,
+                                                 hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? phf_hash_with_seed(hk.digest, seed)
+                                      : phf_hash_with_seed_fnv(hk.key, seed);
+}
+
+// ===== MANY KEYS AT ONCE =====
+
+namespace detail {
+
+/// Keys phf_hash128_batch sorts into length classes at a time.
+inline constexpr size_t hash_batch_window = 64;
+/// Keys of one length class hashed in lockstep.
+inline constexpr size_t hash_batch_lanes = 4;
+
+// phf_hash128 of a 4..16 byte key: no branch on the length.
+[[nodiscard]] inline hash128 hash_short_key(std::string_view key) noexcept {
+    const char* p = key.data();
+    const size_t len = key.size();
+    const size_t off = (len >> 3) << 2;
+    const uint64_t a = (read32(p) << 32) | read32(p + off);
+    const uint64_t b = (read32(p + len - 4) << 32) | read32(p + len - 4 - off);
+    return {wymix(wymix(a ^ hash_secret[6], b ^ hash_secret[0]) ^ len, hash_secret[1]),
+            wymix(wymix(a ^ hash_secret[7], b ^ hash_secret[1]) ^ len, hash_secret[3])};
+}
+
+// phf_hash128 of L keys of 17..256 bytes that take the same number of
+// 32-byte rounds, run a round at a time across all L: 4L independent
+// multiply chains per round, and no branch on any key's length until
+// its last 16 bytes.
+template<size_t L>
+inline void hash_medium_lanes(const std::string_view* keys, const uint8_t* idx,
+                              size_t rounds, hash128* out) noexcept {
+    const char* p[L];
+    size_t n[L];
+    uint64_t s0[L], s1[L];
+    for (size_t l = 0; l < L; ++l) {
+        p[l] = keys[idx[l]].data();
+        n[l] = keys[idx[l]].size();
+        s0[l] = hash_secret[0];
+        s1[l] = hash_secret[1];
+    }
+    if (rounds > 0) {
+        uint64_t s2[L], s3[L];
+        for (size_t l = 0; l < L; ++l) {
+            s2[l] = hash_secret[2];
+            s3[l] = hash_secret[3];
+        }
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t l = 0; l < L; ++l) {
+                const uint64_t a0 = read64(p[l]), b0 = read64(p[l] + 8);
+                const uint64_t a1 = read64(p[l] + 16), b1 = read64(p[l] + 24);
+                s0[l] = wymix(a0 ^ hash_secret[4], b0 ^ s0[l]);
+                s1[l] = wymix(a0 ^ hash_secret[5], b0 ^ s1[l]);
+                s2[l] = wymix(a1 ^ hash_secret[4], b1 ^ s2[l]);
+                s3[l] = wymix(a1 ^ hash_secret[5], b1 ^ s3[l]);
+                p[l] += 32;
+            }
+        }
+        for (size_t l = 0; l < L; ++l) {
+            s0[l] ^= s2[l];
+            s1[l] ^= s3[l];
+            n[l] -= 32 * rounds;
+        }
+    }
+    for (size_t l = 0; l < L; ++l) {
+        if (n[l] > 16) {
+            const uint64_t a0 = read64(p[l]), b0 = read64(p[l] + 8);
+            s0[l] = wymix(a0 ^ hash_secret[4], b0 ^ s0[l]);
+            s1[l] = wymix(a0 ^ hash_secret[5], b0 ^ s1[l]);
+            p[l] += 16;
+            n[l] -= 16;
+        }
+        const uint64_t a = read64(p[l] + n[l] - 16), b = read64(p[l] + n[l] - 8);
+        const size_t len = keys[idx[l]].size();
+        out[idx[l]] = {wymix(wymix(a ^ hash_secret[6], b ^ s0[l]) ^ len, hash_secret[1]),
+                       wymix(wymix(a ^ hash_secret[7], b ^ s1[l]) ^ len, hash_secret[3])};
+    }
+}
+
+} // namespace detail
+
+/**
+ * out[i] = phf_hash128(keys[i]) for every key, many at a time: a build's
+ * initial hash pass. Keys of 4..64 bytes, where a key's own hash is too
+ * short to keep the multipliers busy and a length branch costs as much as
+ * the hash, are set aside by length class (4..16, 17..32, 33..64 bytes)
+ * and each class is then hashed hash_batch_lanes keys in lockstep: no
+ * branch on the length and the lanes' multiplies overlap. Other keys are
+ * hashed in place, in order; longer ones already run four multiply chains
+ * of their own.
+ *
+ * The lanes are scalar: the digest's 64x64 -> 128-bit multiplies have no
+ * vector form on AVX2 or NEON, and the digests must stay those of
+ * phf_hash128.
+ */
+inline void phf_hash128_batch(std::span<const std::string_view> keys, std::span<hash128> out) noexcept {
+    using detail::hash_batch_lanes;
+    constexpr size_t W = detail::hash_batch_window;
+    const size_t n = keys.size() < out.size() ? keys.size() : out.size();
+    for (size_t base = 0; base < n; base += W) {
+        const size_t m = n - base < W ? n - base : W;
+        const std::string_view* k = keys.data() + base;
+        hash128* o = out.data() + base;
+
+        // Class 0: 4..16 bytes; 1 + r: 17..64 bytes in r 32-byte rounds.
+        uint8_t members[3][W];
+        uint8_t count[3] = {};
+        for (size_t i = 0; i < m; ++i) {
+            const size_t len = k[i].size();
+            if (len < 4 || len > 64) {
+                o[i] = phf_hash128(k[i]);
+                continue;
+            }
+            const size_t cls = len <= 16 ? 0 : 1 + ((len - 1) >> 5);
+            members[cls][count[cls]++] = static_cast<uint8_t>(i);
+            // Read later and out of order: start its lines now.
+            detail::prefetch_read(k[i].data());
+            detail::prefetch_read(k[i].data() + len - 1);
+        }
+
+        for (size_t j = 0; j < count[0]; ++j) {
+            const size_t i = members[0][j];
+            o[i] = detail::hash_short_key(k[i]);
+        }
+        for (size_t r = 0; r < 2; ++r) {
+            const uint8_t* ids = members[1 + r];
+            size_t j = 0;
+            for (; j + hash_batch_lanes <= count[1 + r]; j += hash_batch_lanes) {
+                detail::hash_medium_lanes<hash_batch_lanes>(k, ids + j, r, o);
+            }
+            for (; j < count[1 + r]; ++j) detail::hash_medium_lanes<1>(k, ids + j, r, o);
+        }
+    }
+}
+
+
+namespace detail {
+
+/**
+ * fn(i, digest) for each i in [lo, hi), the digest being phf_hash128 of
+ * keys[i]: a builder's hash pass over its keys. String keys go through
+ * phf_hash128_batch a window at a time; integer keys through
+ * phf_hash128_int; a hash128 is its own digest.
+ */
+template<typename Key, typename Fn>
+inline void for_each_digest(std::span<const Key> keys, size_t lo, size_t hi, Fn&& fn) {
+    if constexpr (std::same_as<Key, hash128>) {
+        for (size_t i = lo; i < hi; ++i) fn(i, keys[i]);
+    } else if constexpr (integer_key<Key>) {
+        for (size_t i = lo; i < hi; ++i) fn(i, phf_hash128_int(keys[i]));
+    } else {
+        constexpr size_t W = hash_batch_window;
+        std::string_view views[W];
+        hash128 digests[W];
+        for (size_t base = lo; base < hi; base += W) {
+            const size_t m = hi - base < W ? hi - base : W;
+            for (size_t j = 0; j < m; ++j) views[j] = std::string_view{keys[base + j]};
+            phf_hash128_batch({views, m}, {digests, m});
+            for (size_t j = 0; j < m; ++j) fn(base + j, digests[j]);
+        }
+    }
+}
+
+} // namespace detail
+
 } // namespace maph
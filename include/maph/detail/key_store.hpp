@@ -0,0 +1,242 @@
+/**
+ * @file key_store.hpp
+ * @brief Builder key storage: one arena for copied keys, or borrowed views.
+ *
+ * Every builder collects keys before build(). Storing them as
+ * std::vector<std::string> costs one heap allocation per key longer than
+ * the SSO buffer, plus a second copy in builders that forward keys to an
+ * inner builder. key_store keeps a single std::vector<std::string_view>
+ * instead:
+ *
+ *   add / add_all   copy the bytes into a chunked arena. Chunks are never
+ *                   reallocated, so earlier views stay valid; one
+ *                   allocation per ARENA_CHUNK bytes, not per key.
+ *   borrow_all      store the caller's views as-is. No bytes are copied,
+ *   borrow_blob     so the caller keeps the keys alive until build()
+ *                   returns.
+ *
+ * Integer keys (uint64_t, __uint128_t) are stored as their little-endian
+ * bytes and may be borrowed in place from the caller's array.
+ *
+ * Both kinds may be mixed in one store. dedup() removes duplicate views
+ * by string sort (the default), by 128-bit hash (key_dedup::hash, see
+ * radix_partition.hpp), or not at all for callers that know their keys
+ * are unique.
+ */
+
+#pragma once
+
+#include "hash.hpp"
+#include "radix_partition.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+/// How a builder removes duplicate keys before construction. Every
+/// builder with a with_dedup() setter takes one of these.
+///
+/// key_dedup::hash radix-sorts the 128-bit digests (radix_partition.hpp)
+/// instead of sorting the strings, which is the faster choice for long or
+/// numerous keys; it leaves the keys in digest order rather than string
+/// order. key_dedup::none skips the pass for keys known to be unique.
+///
+/// A builder that also holds digests (PHOBIC's add_hashes()) reduces
+/// every key to its digest and sorts and compares all digests whatever
+/// the mode, so there none saves nothing and a repeated key or digest
+/// fails with error::duplicate_key.
+enum class key_dedup {
+    sort,  ///< sort the keys as strings (default)
+    hash,  ///< radix sort by 128-bit digest; strings compared only on collision
+    none,  ///< keys are known to be unique; duplicates make build() fail
+};
+
+namespace detail {
+
+class key_store {
+    static constexpr size_t ARENA_CHUNK = size_t{1} << 20;
+
+    std::vector<std::string_view> views_{};
+    std::vector<std::unique_ptr<char[]>> chunks_{};
+    char* cursor_{nullptr};
+    size_t remaining_{0};
+
+    std::string_view copy(std::string_view key) {
+        if (key.empty()) return {};
+        if (key.size() > remaining_) {
+            // Oversized keys get a chunk of their own so the current one
+            // keeps filling.
+            if (key.size() > ARENA_CHUNK / 4) {
+                chunks_.push_back(std::make_unique_for_overwrite<char[]>(key.size()));
+                std::memcpy(chunks_.back().get(), key.data(), key.size());
+                return {chunks_.back().get(), key.size()};
+            }
+            chunks_.push_back(std::make_unique_for_overwrite<char[]>(ARENA_CHUNK));
+            cursor_ = chunks_.back().get();
+            remaining_ = ARENA_CHUNK;
+        }
+        std::memcpy(cursor_, key.data(), key.size());
+        std::string_view out{cursor_, key.size()};
+        cursor_ += key.size();
+        remaining_ -= key.size();
+        return out;
+    }
+
+public:
+    key_store() = default;
+
+    // A copy owns its bytes: views into the source's chunks would dangle
+    // once the source is gone, so every key (borrowed ones too) is copied.
+    key_store(const key_store& other) { add_all(other.views()); }
+    key_store& operator=(const key_store& other) {
+        if (this != &other) {
+            key_store tmp{other};
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+    // Chunks move with their owner; the source forgets its cursor so it
+    // cannot write into them afterwards.
+    key_store(key_store&& other) noexcept
+        : views_(std::move(other.views_)), chunks_(std::move(other.chunks_)),
+          cursor_(std::exchange(other.cursor_, nullptr)),
+          remaining_(std::exchange(other.remaining_, 0)) {}
+    key_store& operator=(key_store&& other) noexcept {
+        if (this != &other) {
+            views_ = std::move(other.views_);
+            chunks_ = std::move(other.chunks_);
+            cursor_ = std::exchange(other.cursor_, nullptr);
+            remaining_ = std::exchange(other.remaining_, 0);
+        }
+        return *this;
+    }
+
+    void add(std::string_view key) { views_.push_back(copy(key)); }
+
+    /// An integer key is stored as its little-endian bytes.
+    template<integer_key K>
+    void add(const K& key) { views_.push_back(copy(integer_key_bytes(key))); }
+
+    template<typename Key>
+    void add_all(std::span<const Key> keys) {
+        views_.reserve(views_.size() + keys.size());
+        for (const auto& k : keys) views_.push_back(copy(key_view(k)));
+    }
+
+    /// Store views without copying; the bytes must outlive build().
+    /// Every builder's borrow_all() forwards here, so the same lifetime
+    /// rule applies to all of them.
+    void borrow_all(std::span<const std::string_view> keys) {
+        views_.insert(views_.end(), keys.begin(), keys.end());
+    }
+
+    /// Views of the integers in place; the array must outlive build().
+    template<integer_key K>
+    void borrow_all(std::span<const K> keys) {
+        views_.reserve(views_.size() + keys.size());
+        for (const auto& k : keys) views_.push_back(integer_key_bytes(k));
+    }
+
+    /// Key i is blob[offsets[i], offsets[i+1]); offsets has n+1 entries.
+    /// Out-of-range offsets end the key list early.
+    void borrow_blob(std::string_view blob, std::span<const uint64_t> offsets) {
+        if (offsets.size() < 2) return;
+        views_.reserve(views_.size() + offsets.size() - 1);
+        for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+            uint64_t lo = offsets[i], hi = offsets[i + 1];
+            if (lo > hi || hi > blob.size()) return;
+            views_.push_back(blob.substr(static_cast<size_t>(lo),
+                                         static_cast<size_t>(hi - lo)));
+        }
+    }
+
+    /// Drop duplicate keys. key_dedup::sort leaves the keys sorted;
+    /// key_dedup::hash leaves them in digest order.
+    void dedup(key_dedup mode = key_dedup::sort, size_t threads = 1) {
+        switch (mode) {
+        case key_dedup::sort:
+            std::sort(views_.begin(), views_.end());
+            views_.erase(std::unique(views_.begin(), views_.end()), views_.end());
+            break;
+        case key_dedup::hash:
+            hash_dedup(views_, threads);
+            break;
+        case key_dedup::none:
+            break;
+        }
+    }
+
+    /// Stable-group the keys into `parts` by part_of(key); returns the
+    /// parts + 1 group offsets into views().
+    template<typename PartOf>
+    std::vector<size_t> partition(size_t parts, PartOf&& part_of, size_t threads = 1) {
+        return radix_partition(views_, parts,
+            [&](size_t i) { return part_of(views_[i]); }, threads);
+    }
+
+    /// partition() with part_of(digest) given phf_hash128 of each key,
+    /// hashed a window at a time (phf_hash128_batch).
+    template<typename PartOf>
+    std::vector<size_t> partition_by_digest(size_t parts, PartOf&& part_of, size_t threads = 1) {
+        return radix_partition_runs(views_, parts, [&](size_t lo, size_t hi, uint32_t* part) {
+            for_each_digest(std::span<const std::string_view>(views_), lo, hi,
+                            [&](size_t i, const hash128& d) { part[i] = static_cast<uint32_t>(part_of(d)); });
+        }, threads);
+    }
+
+    void reserve(size_t n) { views_.reserve(n); }
+
+    void clear() noexcept {
+        views_.clear();
+        chunks_.clear();
+        cursor_ = nullptr;
+        remaining_ = 0;
+    }
+
+    [[nodiscard]] std::span<const std::string_view> views() const noexcept { return views_; }
+    [[nodiscard]] std::string_view operator[](size_t i) const noexcept { return views_[i]; }
+    [[nodiscard]] size_t size() const noexcept { return views_.size(); }
+    [[nodiscard]] bool empty() const noexcept { return views_.empty(); }
+    [[nodiscard]] auto begin() const noexcept { return views_.begin(); }
+    [[nodiscard]] auto end() const noexcept { return views_.end(); }
+};
+
+/// Sort the digests a builder was given by add_hashes(), after appending
+/// the digest of each of `keys`. False if two are equal: a digest stands
+/// in for its key, so a repeat is a duplicate key or a 128-bit collision,
+/// and either way there is nothing to build.
+[[nodiscard]] inline bool merge_digests(std::vector<hash128>& digests,
+                                        std::span<const std::string_view> keys) {
+    const size_t given = digests.size();
+    digests.resize(given + keys.size());
+    phf_hash128_batch(keys, std::span<hash128>(digests).subspan(given));
+    auto less = [](const hash128& a, const hash128& b) {
+        return a.hi != b.hi ? a.hi < b.hi : a.lo < b.lo;
+    };
+    std::sort(digests.begin(), digests.end(), less);
+    return std::adjacent_find(digests.begin(), digests.end()) == digests.end();
+}
+
+/// Hand `keys` to builder `b` without copying when it supports borrowing.
+template<typename Builder>
+Builder& borrow_keys_into(Builder& b, std::span<const std::string_view> keys) {
+    if constexpr (requires { b.borrow_all(keys); }) {
+        b.borrow_all(keys);
+    } else {
+        for (auto k : keys) b.add(k);
+    }
+    return b;
+}
+
+} // namespace detail
+
+} // namespace maph
@@ -0,0 +1,132 @@
+/**
+ * @file lz_block.hpp
+ * @brief Small LZ77 byte compressor for independently decoded blocks.
+ *
+ * phf_blob_store compresses its values a block of slots at a time so one
+ * lookup decodes one block. Blocks are a few KiB, so the format is the
+ * simplest that still finds repeats (LZ4's block format, minus its
+ * end-of-block rules):
+ *
+ *   sequence = token, [literal length bytes], literals,
+ *              [u16 offset, [match length bytes]]
+ *
+ * The token's high nibble is the literal count and its low nibble the
+ * match length minus 4; a nibble of 15 continues in bytes of 255 ending
+ * with one below 255. The last sequence has literals only. The encoder is
+ * greedy with a 4096-entry hash table of 4-byte prefixes; the decoder
+ * bounds-checks every field and fails rather than read or write outside
+ * its buffers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace maph::detail {
+
+inline constexpr size_t LZ_MIN_MATCH = 4;
+inline constexpr size_t LZ_MAX_OFFSET = 65535;
+
+namespace lz {
+
+inline uint32_t load32(const std::byte* p) noexcept {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void put_length(std::vector<std::byte>& out, size_t len) {
+    for (; len >= 255; len -= 255) out.push_back(std::byte{255});
+    out.push_back(static_cast<std::byte>(len));
+}
+
+inline bool get_length(std::span<const std::byte> in, size_t& ip, size_t& len) noexcept {
+    for (;;) {
+        if (ip >= in.size()) return false;
+        const auto b = static_cast<size_t>(in[ip++]);
+        len += b;
+        if (b != 255) return true;
+    }
+}
+
+inline void put_sequence(std::vector<std::byte>& out, std::span<const std::byte> literals,
+                         size_t offset, size_t match_len) {
+    const size_t lit = literals.size();
+    const size_t m = match_len == 0 ? 0 : match_len - LZ_MIN_MATCH;
+    out.push_back(static_cast<std::byte>((std::min<size_t>(lit, 15) << 4) | std::min<size_t>(m, 15)));
+    if (lit >= 15) put_length(out, lit - 15);
+    out.insert(out.end(), literals.begin(), literals.end());
+    if (match_len == 0) return;
+    out.push_back(static_cast<std::byte>(offset & 0xff));
+    out.push_back(static_cast<std::byte>(offset >> 8));
+    if (m >= 15) put_length(out, m - 15);
+}
+
+} // namespace lz
+
+/// Append the compressed form of `in` to `out`.
+inline void lz_compress(std::span<const std::byte> in, std::vector<std::byte>& out) {
+    const size_t n = in.size();
+    if (n == 0) return;
+    std::array<uint32_t, 4096> table{};  // position + 1 of the last 4-byte prefix per hash
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        const uint32_t seq = lz::load32(in.data() + i);
+        const uint32_t h = (seq * 2654435761u) >> 20;
+        const size_t cand = table[h];
+        table[h] = static_cast<uint32_t>(i + 1);
+        if (cand != 0 && i - (cand - 1) <= LZ_MAX_OFFSET
+            && lz::load32(in.data() + cand - 1) == seq) {
+            const size_t from = cand - 1;
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < n && in[from + len] == in[i + len]) ++len;
+            lz::put_sequence(out, in.subspan(anchor, i - anchor), i - from, len);
+            i += len;
+            anchor = i;
+        } else {
+            ++i;
+        }
+    }
+    lz::put_sequence(out, in.subspan(anchor), 0, 0);
+}
+
+/// Upper bound on the bytes `n` compressed bytes decode to: a length
+/// byte adds at most 255, and every other byte at most one.
+[[nodiscard]] constexpr size_t lz_max_decompressed(size_t n) noexcept {
+    return n > SIZE_MAX / 255 ? SIZE_MAX : n * 255;
+}
+
+/// Decode `in` into exactly out.size() bytes. False on malformed input.
+[[nodiscard]] inline bool lz_decompress(std::span<const std::byte> in, std::span<std::byte> out) noexcept {
+    size_t ip = 0, op = 0;
+    while (ip < in.size()) {
+        const auto token = static_cast<size_t>(in[ip++]);
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz::get_length(in, ip, lit)) return false;
+        if (lit > in.size() - ip || lit > out.size() - op) return false;
+        if (lit != 0) std::memcpy(out.data() + op, in.data() + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == in.size()) break;
+
+        if (in.size() - ip < 2) return false;
+        const size_t offset = static_cast<size_t>(in[ip]) | (static_cast<size_t>(in[ip + 1]) << 8);
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && !lz::get_length(in, ip, len)) return false;
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || len > out.size() - op) return false;
+        // Byte by byte: a match may overlap the bytes it produces.
+        for (size_t k = 0; k < len; ++k, ++op) out[op] = out[op - offset];
+    }
+    return op == out.size();
+}
+
+} // namespace maph::detail
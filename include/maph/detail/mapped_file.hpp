@@ -0,0 +1,132 @@
+/**
+ * @file mapped_file.hpp
+ * @brief Read-only file mapping for the zero-copy *_view types.
+ *
+ * mapped_file::open(path) maps a file written from serialize() and exposes
+ * it as a std::span<const std::byte>, ready for e.g.
+ * partitioned_phf_view<phobic_phf_view<5>>::deserialize(). Pages are
+ * loaded on first touch and shared through the page cache by every
+ * process mapping the same file.
+ *
+ * On platforms without <sys/mman.h> the file is read into memory instead;
+ * the views work the same, only the zero-copy property is lost.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPH_HAS_MMAP 1
+#else
+#define MAPH_HAS_MMAP 0
+#endif
+
+namespace maph {
+
+class mapped_file {
+    const std::byte* data_{nullptr};
+    size_t size_{0};
+#if !MAPH_HAS_MMAP
+    std::vector<std::byte> buffer_{};
+#endif
+
+    void release() noexcept {
+#if MAPH_HAS_MMAP
+        if (data_ != nullptr && size_ > 0) {
+            ::munmap(const_cast<std::byte*>(data_), size_);
+        }
+#else
+        buffer_.clear();
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    mapped_file() = default;
+    ~mapped_file() { release(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0))
+#if !MAPH_HAS_MMAP
+        , buffer_(std::move(other.buffer_))
+#endif
+    {}
+
+    mapped_file& operator=(mapped_file&& other) noexcept {
+        if (this != &other) {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+#if !MAPH_HAS_MMAP
+            buffer_ = std::move(other.buffer_);
+#endif
+        }
+        return *this;
+    }
+
+    /// Map `path` read-only. An empty file maps to an empty span.
+    [[nodiscard]] static result<mapped_file> open(const std::string& path) {
+        mapped_file out;
+#if MAPH_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return std::unexpected(errno == EACCES ? error::permission_denied
+                                                   : error::io_error);
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return std::unexpected(error::io_error);
+        }
+        out.size_ = static_cast<size_t>(st.st_size);
+        if (out.size_ > 0) {
+            void* p = ::mmap(nullptr, out.size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                out.size_ = 0;
+                return std::unexpected(error::io_error);
+            }
+            out.data_ = static_cast<const std::byte*>(p);
+        }
+        ::close(fd);  // the mapping keeps its own reference to the file
+#else
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (f == nullptr) return std::unexpected(error::io_error);
+        std::byte chunk[1 << 16];
+        size_t got = 0;
+        while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            out.buffer_.insert(out.buffer_.end(), chunk, chunk + got);
+        }
+        bool failed = std::ferror(f) != 0;
+        std::fclose(f);
+        if (failed) return std::unexpected(error::io_error);
+        out.data_ = out.buffer_.data();
+        out.size_ = out.buffer_.size();
+#endif
+        return out;
+    }
+
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+};
+
+} // namespace maph
@@ -0,0 +1,170 @@
+/**
+ * @file memory_report.hpp
+ * @brief One accounting of a structure's memory: resident, encoded,
+ *        serialized, and the information-theoretic lower bound.
+ *
+ * memory_bytes() is each structure's own count of its payload: the
+ * arrays' sizes, sometimes a few scalar fields, sometimes sizeof(*this).
+ * It is not what the process holds. measure_memory() reports four
+ * numbers that mean the same thing for every structure:
+ *
+ *   resident_bytes    sizeof(T) plus every heap block it owns, at its
+ *                     capacity and rounded to what the allocator hands
+ *                     out (malloc chunks, or whole pages and huge pages
+ *                     for mapped_storage). The figure to size machines by.
+ *   encoded_bytes     memory_bytes(), for comparison.
+ *   serialized_bytes  serialize().size(): the file, and what a view maps.
+ *   entropy_bytes     the least any structure answering the same queries
+ *                     over `keys` keys could take (see lower_bound_bits).
+ *
+ *   auto m = measure_memory(phf, keys.size());
+ *   std::cout << m.resident_bits_per_key() << " vs " << m.entropy_bits_per_key();
+ *
+ * Owning structures report their heap through heap_bytes(), built from
+ * allocated_bytes() of each array they hold; a type without one (a view,
+ * a user type) is counted as sizeof(T) + memory_bytes(). The malloc
+ * figures model glibc (16-byte chunks with an 8-byte header, mmap above
+ * 128 KiB) and are estimates; peak memory during a build is measured by
+ * bench_build_memory, not here.
+ */
+
+#pragma once
+
+#include "page_allocator.hpp"
+#include "serialization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+namespace maph {
+
+struct memory_report {
+    size_t keys{0};
+    size_t resident_bytes{0};
+    size_t encoded_bytes{0};
+    size_t serialized_bytes{0};
+    double entropy_bytes{0};
+
+    [[nodiscard]] double resident_bits_per_key() const noexcept { return per_key(resident_bytes); }
+    [[nodiscard]] double encoded_bits_per_key() const noexcept { return per_key(encoded_bytes); }
+    [[nodiscard]] double serialized_bits_per_key() const noexcept { return per_key(serialized_bytes); }
+    [[nodiscard]] double entropy_bits_per_key() const noexcept { return per_key(entropy_bytes); }
+
+    /// resident / lower bound; 0 when the bound is 0.
+    [[nodiscard]] double overhead() const noexcept {
+        return entropy_bytes > 0 ? static_cast<double>(resident_bytes) / entropy_bytes : 0.0;
+    }
+
+private:
+    [[nodiscard]] double per_key(double bytes) const noexcept {
+        return keys == 0 ? 0.0 : bytes * 8.0 / static_cast<double>(keys);
+    }
+};
+
+namespace detail {
+
+inline constexpr size_t malloc_mmap_threshold = size_t{128} << 10;
+
+/// Bytes malloc takes from the system for a request of `bytes`.
+[[nodiscard]] constexpr size_t heap_block_bytes(size_t bytes) noexcept {
+    if (bytes == 0) return 0;
+    if (bytes >= malloc_mmap_threshold) return (bytes + 16 + base_page_bytes - 1) / base_page_bytes * base_page_bytes;
+    return std::max<size_t>(32, (bytes + 8 + 15) / 16 * 16);
+}
+
+template<typename T>
+[[nodiscard]] size_t allocated_bytes(const std::vector<T>& v) noexcept {
+    return heap_block_bytes(v.capacity() * sizeof(T));
+}
+
+template<typename T, page_size Pages, numa_placement Placement>
+[[nodiscard]] size_t allocated_bytes(const std::vector<T, page_allocator<T, Pages, Placement>>& v) noexcept {
+    const size_t bytes = v.capacity() * sizeof(T);
+#if MAPH_HAS_PAGE_CONTROL
+    if (bytes >= min_mapped_bytes) {
+        const size_t granule = mapping_granule(Pages, bytes);
+        return (bytes + granule - 1) / granule * granule;
+    }
+#endif
+    return heap_block_bytes(bytes);
+}
+
+/// A view owns nothing; the bytes it reads belong to whoever mapped them.
+template<typename T>
+[[nodiscard]] constexpr size_t allocated_bytes(const phf_serial::array_view<T>&) noexcept { return 0; }
+
+template<typename T>
+concept has_heap_bytes = requires(const T& x) {
+    { x.heap_bytes() } -> std::convertible_to<size_t>;
+};
+
+/// The heap a member holds: its heap_bytes(), or its memory_bytes() for
+/// a type that does not count its allocations.
+template<typename T>
+[[nodiscard]] size_t member_heap_bytes(const T& x) noexcept {
+    if constexpr (has_heap_bytes<T>) return x.heap_bytes();
+    else return x.memory_bytes();
+}
+
+} // namespace detail
+
+/// Minimum bits for a perfect hash function of `keys` keys into `range`
+/// slots: n log2(e) + (m - n) log2(1 - n/m), n log2(e) when minimal.
+[[nodiscard]] inline double phf_lower_bound_bits(size_t keys, size_t range) noexcept {
+    if (keys == 0 || range < keys) return 0.0;
+    const double n = static_cast<double>(keys);
+    const double m = static_cast<double>(range);
+    double bits = n * std::numbers::log2e;
+    if (range > keys) bits += (m - n) * std::log2(1.0 - n / m);
+    return std::max(bits, 0.0);
+}
+
+/**
+ * The information-theoretic floor for what T answers over `keys` keys:
+ *
+ *   retrieval of M-bit values           n M
+ *   ... that also rejects non-members   n (M + F), F = fingerprint_bits_v
+ *   perfect hash function into m slots  phf_lower_bound_bits(n, m)
+ *   ... that also rejects non-members   + n F
+ *   membership with F-bit fingerprints  n F (false positive rate 2^-F)
+ *
+ * 0 for a type that declares none of these.
+ */
+template<typename T>
+[[nodiscard]] double lower_bound_bits(const T& x, size_t keys) noexcept {
+    const double n = static_cast<double>(keys);
+    double bits = 0.0;
+    if constexpr (requires { T::fingerprint_bits_v; }) bits += n * T::fingerprint_bits_v;
+    if constexpr (requires { T::value_bits_v; }) {
+        bits += n * T::value_bits_v;
+    } else if constexpr (requires { { x.range_size() } -> std::convertible_to<size_t>; }) {
+        bits += phf_lower_bound_bits(keys, x.range_size());
+    }
+    return bits;
+}
+
+template<typename T>
+[[nodiscard]] memory_report measure_memory(const T& x, size_t keys) {
+    memory_report m;
+    m.keys = keys;
+    m.encoded_bytes = x.memory_bytes();
+    if constexpr (detail::has_heap_bytes<T>) m.resident_bytes = sizeof(T) + x.heap_bytes();
+    else m.resident_bytes = sizeof(T) + x.memory_bytes();
+    if constexpr (requires { x.serialize().size(); }) m.serialized_bytes = x.serialize().size();
+    m.entropy_bytes = lower_bound_bits(x, keys) / 8.0;
+    return m;
+}
+
+/// measure_memory over the structure's own key count.
+template<typename T>
+    requires requires(const T& x) { { x.num_keys() } -> std::convertible_to<size_t>; }
+[[nodiscard]] memory_report measure_memory(const T& x) {
+    return measure_memory(x, x.num_keys());
+}
+
+} // namespace maph
@@ -6,36 +6,121 @@
  * structures. Not tied to keys, hashes, or membership semantics; just
  * indexed M-bit reads and writes.
  *
- * M is a compile-time parameter in [1, 64]. At M=1 this is a bit
- * vector; at M=8/16/32/64 the per-value reads reduce to aligned or
- * nearly-aligned word loads. Intermediate widths pay a conditional
- * second-word load for values that cross a 64-bit boundary.
+ * M is a compile-time parameter in [1, 64]. At M=8/16/32/64 get() and
+ * set() are plain aligned loads and stores of value_type (on
+ * little-endian targets, where byte order matches bit order); other
+ * divisors of 64 never straddle a word and skip the second-word check.
+ * The remaining widths up to 56 bits read one unaligned 64-bit word at
+ * the value's first byte, with no branch on whether the value crosses a
+ * word; wider ones (and the last bytes of the array) pay a conditional
+ * second-word load.
+ *
+ * Bulk operations:
+ *   get_batch(slots, out)   independent reads. With AVX2, widths that
+ *                           straddle words (M <= 56, 64 % M != 0) read
+ *                           four values with one 64-bit gather at their
+ *                           byte offsets, then a shift and mask: ~35%
+ *                           faster than get() at M = 13 out of cache.
+ *   set_range(first, vals)  consecutive slots, packed a word at a time.
+ *   fill(first, n, v)       n copies of v: the words repeat with a period
+ *                           of M / gcd(M, 64), so one period is packed
+ *                           and copied; only the two edges go through
+ *                           set() and write_run().
+ *   assign(n, v)            resize(n) and fill(0, n, v) in one pass,
+ *                           without zeroing the words first.
+ *
+ * set_atomic(slot, v) writes one value with a compare-and-swap on its
+ * word, so it may run while other threads call get_atomic(), which reads
+ * the word with a relaxed atomic load (a plain load on x86-64 and
+ * AArch64) and sees the old or the new value. get() and get_batch() stay
+ * plain loads for structures nobody writes. Concurrent set_atomic() calls
+ * on neighbouring slots of one word do not lose each other's writes.
+ * Only widths with 64 % M == 0 have them: a value straddling two words
+ * could not change at once.
+ *
+ * The words live in Storage's array (heap_storage, or a mapped_storage
+ * from page_allocator.hpp); the serialized bytes are the same for either.
+ * packed_value_array_view<M> reads them in place.
  */
 
 #pragma once
 
+#include "memory_report.hpp"
+#include "page_allocator.hpp"
 #include "serialization.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cstdint>
 #include <cstring>
+#include <numeric>
 #include <optional>
 #include <span>
 #include <type_traits>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace maph::detail {
 
-template <unsigned M>
+template <unsigned M, storage_policy Storage = heap_storage>
     requires (M >= 1 && M <= 64)
 class packed_value_array {
     static constexpr uint64_t value_mask_ =
         (M == 64) ? ~uint64_t{0} : ((uint64_t{1} << M) - 1);
 
-    std::vector<uint64_t> data_{};
+    typename Storage::template array<uint64_t> data_{};
     size_t num_slots_{0};
 
+    // Writes value_at(i) to slot first + i for i < count. Slots up to the
+    // first word boundary go through set(); from there values are
+    // accumulated into whole words, and the last partial word is merged.
+    template <typename ValueAt>
+    void write_run(size_t first, size_t count, ValueAt&& value_at) noexcept {
+        size_t i = 0;
+        for (; i < count && (first + i) * M % 64 != 0; ++i) set(first + i, value_at(i));
+        if (i == count) return;
+
+        size_t w = (first + i) * M / 64;
+        uint64_t acc = 0;
+        unsigned used = 0;
+        for (; i < count; ++i) {
+            const uint64_t v = static_cast<uint64_t>(value_at(i)) & value_mask_;
+            acc |= v << used;
+            used += M;
+            if (used >= 64) {
+                data_[w++] = acc;
+                used -= 64;
+                acc = used != 0 ? v >> (M - used) : 0;
+            }
+        }
+        if (used != 0) {
+            const uint64_t low = (uint64_t{1} << used) - 1;
+            data_[w] = (data_[w] & ~low) | acc;
+        }
+    }
+
+    // Words per repeat of a run of equal values, and its slots.
+    static constexpr size_t fill_period_ = M / std::gcd(M, 64u);
+    static constexpr size_t fill_period_slots_ = fill_period_ * 64 / M;
+
+    // One period of words holding `v` in every slot, starting on a slot
+    // that begins a word.
+    static std::array<uint64_t, fill_period_> fill_words(uint64_t v) noexcept {
+        std::array<uint64_t, fill_period_> words{};
+        v &= value_mask_;
+        for (size_t bit = 0; bit < fill_period_ * 64; bit += M) {
+            const size_t w = bit / 64, off = bit % 64;
+            words[w] |= v << off;
+            if (off + M > 64) words[w + 1] |= v >> (64 - off);
+        }
+        return words;
+    }
+
 public:
     static constexpr unsigned bits_per_value = M;
 
@@ -53,21 +138,152 @@ public:
         data_.assign((total_bits + 63) / 64, 0);
     }
 
+    /// resize(num_slots) then fill(0, num_slots, value), writing each
+    /// word once. Bits past the last slot are zero, as after resize().
+    void assign(size_t num_slots, value_type value) {
+        num_slots_ = num_slots;
+        const size_t words = (num_slots * M + 63) / 64;
+        const auto pattern = fill_words(static_cast<uint64_t>(value));
+        if constexpr (fill_period_ == 1) {
+            data_.assign(words, pattern[0]);
+        } else {
+            data_.clear();
+            data_.reserve(words);
+            while (data_.size() + fill_period_ <= words) {
+                data_.insert(data_.end(), pattern.begin(), pattern.end());
+            }
+            data_.insert(data_.end(), pattern.begin(),
+                         pattern.begin() + static_cast<std::ptrdiff_t>(words - data_.size()));
+        }
+        if (const size_t tail = num_slots * M % 64; tail != 0) {
+            data_.back() &= (uint64_t{1} << tail) - 1;
+        }
+    }
+
     [[nodiscard]] size_t num_slots() const noexcept { return num_slots_; }
 
-    [[nodiscard]] value_type get(size_t slot) const noexcept {
-        size_t bit_pos = slot * M;
-        size_t word_idx = bit_pos / 64;
-        size_t bit_offset = bit_pos % 64;
-        uint64_t val = data_[word_idx] >> bit_offset;
-        if (bit_offset + M > 64 && word_idx + 1 < data_.size()) {
-            val |= data_[word_idx + 1] << (64 - bit_offset);
+    // Widths whose values are whole, aligned value_type objects.
+    static constexpr bool byte_aligned_ =
+        (M == 8 || M == 16 || M == 32 || M == 64) && std::endian::native == std::endian::little;
+
+    // Widths whose values never straddle two words.
+    static constexpr bool word_aligned_ = (64 % M) == 0;
+
+    // Shared by packed_value_array_view, which reads the words in place.
+    template <typename Words>
+    [[nodiscard]] static value_type extract(const Words& words, size_t slot) noexcept {
+        if constexpr (byte_aligned_) {
+            value_type v;
+            std::memcpy(&v, static_cast<const std::byte*>(element_address(words, 0))
+                            + slot * sizeof(value_type), sizeof(v));
+            return v;
+        } else if constexpr (word_aligned_) {
+            const size_t bit_pos = slot * M;
+            return static_cast<value_type>((words[bit_pos / 64] >> (bit_pos % 64)) & value_mask_);
+        } else {
+            size_t bit_pos = slot * M;
+            if constexpr (M <= 56 && std::endian::native == std::endian::little) {
+                // One unaligned load covers the value unless it would read
+                // past the last word; skips the data-dependent straddle branch.
+                const size_t byte = bit_pos / 8;
+                if (byte + 8 <= words.size() * sizeof(uint64_t)) {
+                    uint64_t val;
+                    std::memcpy(&val, static_cast<const std::byte*>(element_address(words, 0)) + byte,
+                                sizeof(val));
+                    return static_cast<value_type>((val >> (bit_pos % 8)) & value_mask_);
+                }
+            }
+            size_t word_idx = bit_pos / 64;
+            size_t bit_offset = bit_pos % 64;
+            uint64_t val = words[word_idx] >> bit_offset;
+            if (bit_offset + M > 64 && word_idx + 1 < words.size()) {
+                val |= words[word_idx + 1] << (64 - bit_offset);
+            }
+            return static_cast<value_type>(val & value_mask_);
+        }
+    }
+
+    /// out[i] = extract(words, slots[i]). Every slot must be in range.
+    template <typename Words>
+    static void extract_batch(const Words& words, std::span<const size_t> slots,
+                              value_type* out) noexcept {
+        size_t k = 0;
+#if defined(__AVX2__)
+        if constexpr (!word_aligned_ && M <= 56 && std::endian::native == std::endian::little) {
+            // An unaligned 64-bit read at the value's first byte holds all
+            // M bits after a shift of at most 7, so values that straddle
+            // words need no second load or branch. (Word-aligned widths
+            // are single loads already, and measure faster scalar.) Lanes
+            // whose read would pass the last word, and arrays too large
+            // for the 32-bit multiply, take the scalar loop.
+            const size_t bytes = words.size() * sizeof(uint64_t);
+            if (bytes >= sizeof(uint64_t) && words.size() * 64 / M <= UINT32_MAX) {
+                const auto* base = static_cast<const long long*>(element_address(words, 0));
+                const __m256i width = _mm256_set1_epi64x(M);
+                const __m256i last = _mm256_set1_epi64x(static_cast<long long>(bytes - 8));
+                const __m256i low3 = _mm256_set1_epi64x(7);
+                const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(value_mask_));
+                const __m256i all = _mm256_set1_epi64x(-1);
+                for (; k + 4 <= slots.size(); k += 4) {
+                    const __m256i bit = _mm256_mul_epu32(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(slots.data() + k)),
+                        width);
+                    const __m256i byte = _mm256_srli_epi64(bit, 3);
+                    if (!_mm256_testz_si256(_mm256_cmpgt_epi64(byte, last), all)) break;
+                    // Masked form with a zero source, as in xor_gather.hpp.
+                    __m256i v = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), base, byte,
+                                                            all, 1);
+                    v = _mm256_and_si256(_mm256_srlv_epi64(v, _mm256_and_si256(bit, low3)), mask);
+                    alignas(32) uint64_t lanes[4];
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+                    for (size_t j = 0; j < 4; ++j) out[k + j] = static_cast<value_type>(lanes[j]);
+                }
+            }
         }
-        return static_cast<value_type>(val & value_mask_);
+#endif
+        for (; k < slots.size(); ++k) out[k] = extract(words, slots[k]);
+    }
+
+    /// extract() from words that store_atomic() may be writing: the word
+    /// is read with a relaxed atomic load. Words must hold real uint64_t
+    /// objects (a vector, not an array_view). atomic_ref<const T> is
+    /// C++26, so the word is referenced non-const; the load writes nothing.
+    template <typename Words>
+    [[nodiscard]] static value_type load_atomic(const Words& words, size_t slot) noexcept
+        requires word_aligned_ {
+        const size_t bit_pos = slot * M;
+        auto& word = const_cast<uint64_t&>(words[bit_pos / 64]);
+        const uint64_t w = std::atomic_ref<uint64_t>{word}.load(std::memory_order_relaxed);
+        return static_cast<value_type>((w >> (bit_pos % 64)) & value_mask_);
+    }
+
+    [[nodiscard]] value_type get(size_t slot) const noexcept {
+        return extract(data_, slot);
+    }
+
+    /// get() for readers running alongside set_atomic(); see the file comment.
+    [[nodiscard]] value_type get_atomic(size_t slot) const noexcept requires word_aligned_ {
+        return load_atomic(data_, slot);
+    }
+
+    /// out[i] = get(slots[i]) for every i < slots.size().
+    void get_batch(std::span<const size_t> slots, value_type* out) const noexcept {
+        extract_batch(data_, slots, out);
+    }
+
+    /// Address of the word holding `slot`, for prefetching.
+    [[nodiscard]] const std::byte* address(size_t slot) const noexcept {
+        return static_cast<const std::byte*>(element_address(data_, slot * M / 64));
     }
 
     void set(size_t slot, value_type value) noexcept {
         uint64_t v = static_cast<uint64_t>(value) & value_mask_;
+        if constexpr (byte_aligned_) {
+            const auto narrow = static_cast<value_type>(v);
+            std::memcpy(reinterpret_cast<std::byte*>(data_.data()) + slot * sizeof(value_type),
+                        &narrow, sizeof(narrow));
+            return;
+        }
         size_t bit_pos = slot * M;
         size_t word_idx = bit_pos / 64;
         size_t bit_offset = bit_pos % 64;
@@ -75,19 +291,85 @@ public:
         data_[word_idx] &= ~(value_mask_ << bit_offset);
         data_[word_idx] |= v << bit_offset;
 
-        if (bit_offset + M > 64 && word_idx + 1 < data_.size()) {
-            size_t bits_in_first = 64 - bit_offset;
-            size_t bits_in_second = M - bits_in_first;
-            uint64_t mask2 = (uint64_t{1} << bits_in_second) - 1;
-            data_[word_idx + 1] &= ~mask2;
-            data_[word_idx + 1] |= (v >> bits_in_first) & mask2;
+        if constexpr (!word_aligned_) {
+            if (bit_offset + M > 64 && word_idx + 1 < data_.size()) {
+                size_t bits_in_first = 64 - bit_offset;
+                size_t bits_in_second = M - bits_in_first;
+                uint64_t mask2 = (uint64_t{1} << bits_in_second) - 1;
+                data_[word_idx + 1] &= ~mask2;
+                data_[word_idx + 1] |= (v >> bits_in_first) & mask2;
+            }
         }
     }
 
+    /// Replace the bits `mask` of words[w] with `bits`, atomically.
+    template <typename Words>
+    static void merge_word_atomic(Words& words, size_t w, uint64_t mask, uint64_t bits) noexcept {
+        std::atomic_ref<uint64_t> word{words[w]};
+        uint64_t old = word.load(std::memory_order_relaxed);
+        while (!word.compare_exchange_weak(old, (old & ~mask) | bits,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+        }
+    }
+
+    /// set() for writers running alongside load_atomic() readers; see the
+    /// file comment. Shared by packed_fingerprint_array.
+    template <typename Words>
+    static void store_atomic(Words& words, size_t slot, uint64_t value) noexcept
+        requires word_aligned_ {
+        const size_t bit_pos = slot * M;
+        const size_t offset = bit_pos % 64;
+        merge_word_atomic(words, bit_pos / 64, value_mask_ << offset, (value & value_mask_) << offset);
+    }
+
+    void set_atomic(size_t slot, value_type value) noexcept requires word_aligned_ {
+        store_atomic(data_, slot, static_cast<uint64_t>(value));
+    }
+
+    /// set(first + i, values[i]) for every i, packing whole words.
+    void set_range(size_t first, std::span<const value_type> values) noexcept {
+        if constexpr (byte_aligned_) {
+            if (!values.empty()) {
+                std::memcpy(reinterpret_cast<std::byte*>(data_.data()) + first * sizeof(value_type),
+                            values.data(), values.size_bytes());
+            }
+        } else {
+            write_run(first, values.size(), [&](size_t i) { return values[i]; });
+        }
+    }
+
+    /// set(first + i, value) for every i < count, copying whole periods
+    /// of words between the edges.
+    void fill(size_t first, size_t count, value_type value) noexcept {
+        size_t i = 0;
+        for (; i < count && (first + i) * M % 64 != 0; ++i) set(first + i, value);
+        if (const size_t periods = (count - i) / fill_period_slots_; periods != 0) {
+            const auto pattern = fill_words(static_cast<uint64_t>(value));
+            uint64_t* w = data_.data() + (first + i) * M / 64;
+            if constexpr (fill_period_ == 1) {
+                std::fill_n(w, periods, pattern[0]);
+            } else {
+                for (size_t p = 0; p < periods; ++p, w += fill_period_) {
+                    std::memcpy(w, pattern.data(), sizeof(pattern));
+                }
+            }
+            i += periods * fill_period_slots_;
+        }
+        write_run(first + i, count - i, [value](size_t) { return value; });
+    }
+
     [[nodiscard]] size_t memory_bytes() const noexcept {
         return data_.size() * sizeof(uint64_t);
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(data_); }
+
+    /// The packed words: slot i holds bits [i * M, (i + 1) * M).
+    [[nodiscard]] std::span<const uint64_t> words() const noexcept {
+        return {data_.data(), data_.size()};
+    }
+
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
         phf_serial::append(out, static_cast<uint32_t>(M));
@@ -110,4 +392,67 @@ public:
     }
 };
 
+/**
+ * Zero-copy packed_value_array over a serialized buffer. The words are
+ * read in place, so the buffer (typically a mapped file) must outlive the
+ * view. Same format and same get() results as packed_value_array<M>.
+ */
+template <unsigned M>
+    requires (M >= 1 && M <= 64)
+class packed_value_array_view {
+    using owner = packed_value_array<M>;
+
+    phf_serial::array_view<uint64_t> data_{};
+    size_t num_slots_{0};
+    std::span<const std::byte> bytes_{};
+
+public:
+    static constexpr unsigned bits_per_value = M;
+    using value_type = typename owner::value_type;
+
+    packed_value_array_view() = default;
+
+    [[nodiscard]] size_t num_slots() const noexcept { return num_slots_; }
+
+    [[nodiscard]] value_type get(size_t slot) const noexcept {
+        return owner::extract(data_, slot);
+    }
+
+    void get_batch(std::span<const size_t> slots, value_type* out) const noexcept {
+        owner::extract_batch(data_, slots, out);
+    }
+
+    /// Address of the word holding `slot`, for prefetching.
+    [[nodiscard]] const std::byte* address(size_t slot) const noexcept {
+        return data_.address(slot * M / 64);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept { return data_.size_bytes(); }
+
+    /// The bytes this view was bound to, i.e. what owner::serialize() wrote.
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return bytes_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
+
+    /// Bind to bytes written by packed_value_array<M>::serialize(). Also
+    /// rejects buffers whose word count is too small for num_slots, since
+    /// the view reads them without copying.
+    [[nodiscard]] static std::optional<packed_value_array_view>
+    deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint32_t width{}; uint64_t slots{};
+        if (!r.read(width) || width != M) return std::nullopt;
+        if (!r.read(slots) || slots > MAX_SERIALIZED_ELEMENT_COUNT) return std::nullopt;
+
+        packed_value_array_view out;
+        out.num_slots_ = static_cast<size_t>(slots);
+        if (!r.read_array(out.data_)) return std::nullopt;
+        if (out.data_.size() < (out.num_slots_ * M + 63) / 64) return std::nullopt;
+        out.bytes_ = bytes.first(r.offset());
+        return out;
+    }
+};
+
 } // namespace maph::detail
@@ -0,0 +1,248 @@
+/**
+ * @file page_allocator.hpp
+ * @brief Storage policies for the large arrays: heap, huge pages, NUMA.
+ *
+ * At tens of gigabytes a table of 4 KiB pages needs millions of TLB
+ * entries, and a query's page walk can cost as much as its data miss.
+ * The structures that hold the big arrays take a Storage policy naming
+ * the array type they keep them in:
+ *
+ *   phobic_phf<B, Pilots, Storage>         pilots
+ *   detail::packed_value_array<M, Storage> values (phf_value_array<PHF, M, Storage>)
+ *   ribbon_retrieval<M, Layout, Storage>   solution rows
+ *   xor_filter<Bits, Storage>              fingerprint table
+ *
+ * heap_storage, the default, is std::vector. mapped_storage<Pages,
+ * Placement> is std::vector over page_allocator, which serves
+ * allocations of min_mapped_bytes and more with an anonymous mapping:
+ *
+ *   page_size::base         4 KiB pages (a mapping, but no huge pages)
+ *   page_size::transparent  2 MiB-aligned, madvise(MADV_HUGEPAGE)
+ *   page_size::huge_2m      MAP_HUGETLB 2 MiB pages, else transparent
+ *   page_size::huge_1g      MAP_HUGETLB 1 GiB pages for arrays of 1 GiB
+ *                           and more, else as huge_2m
+ *
+ *   numa_placement::first_touch  the kernel default
+ *   numa_placement::local        preferred on the allocating thread's node,
+ *                                whichever threads fill it
+ *   numa_placement::interleave   round-robin over the online nodes
+ *
+ * MAP_HUGETLB needs pages reserved in /proc/sys/vm/nr_hugepages (or
+ * hugepagesz=1G at boot); without them the mapping falls back as listed.
+ * Placement is a hint: mbind failures are ignored. Serialized bytes do not
+ * depend on the storage; a blob written with one policy loads with any.
+ * Off Linux every policy is plain heap allocation.
+ *
+ * Builders assemble into std::vector and the finished rows are copied
+ * once into a mapped array, so a mapped build briefly holds both.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined(__linux__)
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define MAPH_HAS_PAGE_CONTROL 1
+#else
+#define MAPH_HAS_PAGE_CONTROL 0
+#endif
+
+namespace maph {
+
+enum class page_size : uint8_t { base, transparent, huge_2m, huge_1g };
+
+enum class numa_placement : uint8_t { first_touch, local, interleave };
+
+namespace detail {
+
+inline constexpr size_t base_page_bytes = size_t{1} << 12;
+inline constexpr size_t huge_2m_bytes = size_t{1} << 21;
+inline constexpr size_t huge_1g_bytes = size_t{1} << 30;
+
+/// Smaller allocations stay on the heap: a mapping per small vector would
+/// cost a system call and round up to at least a page.
+inline constexpr size_t min_mapped_bytes = size_t{1} << 20;
+
+/// Granularity a mapping of `bytes` is rounded to (and aligned to, for
+/// huge pages). A function of the request alone, so deallocate() unmaps
+/// exactly what allocate() mapped whichever fallback served it.
+[[nodiscard]] constexpr size_t mapping_granule(page_size pages, size_t bytes) noexcept {
+    switch (pages) {
+        case page_size::base: return base_page_bytes;
+        case page_size::huge_1g: return bytes >= huge_1g_bytes ? huge_1g_bytes : huge_2m_bytes;
+        default: return huge_2m_bytes;
+    }
+}
+
+#if MAPH_HAS_PAGE_CONTROL
+
+// Kernel ABI constants (<linux/mempolicy.h>, <linux/mman.h>) without
+// requiring libnuma or the kernel headers.
+inline constexpr int mpol_preferred = 1;
+inline constexpr int mpol_interleave = 3;
+inline constexpr int huge_page_shift = 26;  // MAP_HUGE_SHIFT
+
+/// Online NUMA nodes as a bit mask (nodes 0..63), read from sysfs.
+[[nodiscard]] inline uint64_t online_numa_nodes() noexcept {
+    uint64_t mask = 0;
+    std::FILE* f = std::fopen("/sys/devices/system/node/online", "r");
+    if (f == nullptr) return 1;
+    unsigned lo = 0, hi = 0;
+    for (;;) {
+        if (std::fscanf(f, "%u", &lo) != 1) break;
+        hi = lo;
+        int c = std::fgetc(f);
+        if (c == '-') {
+            if (std::fscanf(f, "%u", &hi) != 1) break;
+            c = std::fgetc(f);
+        }
+        for (unsigned node = lo; node <= hi && node < 64; ++node) mask |= uint64_t{1} << node;
+        if (c != ',') break;
+    }
+    std::fclose(f);
+    return mask == 0 ? 1 : mask;
+}
+
+inline void place_pages(void* p, size_t len, numa_placement placement) noexcept {
+    if (placement == numa_placement::first_touch) return;
+    uint64_t mask = 0;
+    int mode = mpol_interleave;
+    if (placement == numa_placement::interleave) {
+        mask = online_numa_nodes();
+    } else {
+        unsigned cpu = 0, node = 0;
+        if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= 64) return;
+        mask = uint64_t{1} << node;
+        mode = mpol_preferred;
+    }
+    unsigned long words[1] = {static_cast<unsigned long>(mask)};
+    (void)::syscall(SYS_mbind, p, len, mode, words, 65UL, 0U);
+}
+
+/// Anonymous mapping of `len` bytes, a multiple of `granule`, aligned to
+/// it. nullptr when even the 4 KiB fallback fails.
+[[nodiscard]] inline void* map_pages(size_t len, size_t granule, page_size pages,
+                                     numa_placement placement) noexcept {
+    constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_HUGETLB)
+    if (pages == page_size::huge_2m || pages == page_size::huge_1g) {
+        const int size_bits = granule == huge_1g_bytes ? 30 : 21;
+        void* p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                         flags | MAP_HUGETLB | (size_bits << huge_page_shift), -1, 0);
+        if (p != MAP_FAILED) {
+            place_pages(p, len, placement);
+            return p;
+        }
+    }
+#endif
+    // Over-map by one granule and trim both ends, leaving an aligned
+    // mapping of exactly len bytes that THP can back with huge pages.
+    const size_t slack = granule > base_page_bytes ? granule : 0;
+    void* raw = ::mmap(nullptr, len + slack, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+    auto* base = static_cast<std::byte*>(raw);
+    const auto addr = reinterpret_cast<uintptr_t>(base);
+    const size_t head = slack == 0 ? 0 : (granule - addr % granule) % granule;
+    if (head != 0) ::munmap(base, head);
+    if (slack - head != 0) ::munmap(base + head + len, slack - head);
+    void* p = base + head;
+#if defined(MADV_HUGEPAGE)
+    if (pages != page_size::base) ::madvise(p, len, MADV_HUGEPAGE);
+#endif
+    place_pages(p, len, placement);
+    return p;
+}
+
+#endif // MAPH_HAS_PAGE_CONTROL
+
+/**
+ * Stateless allocator over anonymous mappings with the given page size
+ * and NUMA placement; see the file comment. Allocations under
+ * min_mapped_bytes go to std::allocator.
+ */
+template<typename T, page_size Pages, numa_placement Placement>
+class page_allocator {
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = page_allocator<U, Pages, Placement>; };
+
+    page_allocator() = default;
+
+    template<typename U>
+    constexpr page_allocator(const page_allocator<U, Pages, Placement>&) noexcept {}
+
+    [[nodiscard]] T* allocate(size_t n) {
+#if MAPH_HAS_PAGE_CONTROL
+        if (n > SIZE_MAX / sizeof(T)) throw std::bad_alloc{};
+        const size_t bytes = n * sizeof(T);
+        if (bytes >= min_mapped_bytes) {
+            const size_t granule = mapping_granule(Pages, bytes);
+            void* p = map_pages(round_up(bytes, granule), granule, Pages, Placement);
+            if (p == nullptr) throw std::bad_alloc{};
+            return static_cast<T*>(p);
+        }
+#endif
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+#if MAPH_HAS_PAGE_CONTROL
+        const size_t bytes = n * sizeof(T);
+        if (bytes >= min_mapped_bytes) {
+            ::munmap(p, round_up(bytes, mapping_granule(Pages, bytes)));
+            return;
+        }
+#endif
+        std::allocator<T>{}.deallocate(p, n);
+    }
+
+    template<typename U>
+    friend constexpr bool operator==(const page_allocator&,
+                                     const page_allocator<U, Pages, Placement>&) noexcept {
+        return true;
+    }
+
+private:
+    static constexpr size_t round_up(size_t bytes, size_t granule) noexcept {
+        return (bytes + granule - 1) / granule * granule;
+    }
+};
+
+} // namespace detail
+
+/// std::vector with the default allocator; every structure's default.
+struct heap_storage {
+    template<typename T>
+    using array = std::vector<T>;
+};
+
+/// Arrays in anonymous mappings with the given pages and placement.
+template<page_size Pages = page_size::transparent,
+         numa_placement Placement = numa_placement::first_touch>
+struct mapped_storage {
+    static constexpr page_size pages = Pages;
+    static constexpr numa_placement placement = Placement;
+
+    template<typename T>
+    using array = std::vector<T, detail::page_allocator<T, Pages, Placement>>;
+};
+
+using huge_page_storage = mapped_storage<page_size::huge_2m>;
+using gigantic_page_storage = mapped_storage<page_size::huge_1g>;
+using numa_local_storage = mapped_storage<page_size::transparent, numa_placement::local>;
+using numa_interleaved_storage = mapped_storage<page_size::transparent, numa_placement::interleave>;
+
+template<typename S>
+concept storage_policy = requires { typename S::template array<uint64_t>; };
+
+} // namespace maph
@@ -0,0 +1,167 @@
+/**
+ * @file peeling.hpp
+ * @brief Cache-local 3- and 4-wise hypergraph peeling for xor and binary
+ *        fuse filter construction.
+ *
+ * Both filters place each key on three (or, for 4-wise binary fuse, four)
+ * table slots derived from one seeded 64-bit hash h and solve
+ * table[p0] ^ table[p1] ^ table[p2] == fingerprint(h) by peeling.
+ * Following Graf and Lemire:
+ *
+ *   - keys are hashed once (in parallel); each attempt only XORs in the
+ *     new seed, so retries never rehash strings;
+ *   - hashes are grouped by a block of the table they touch (a stable
+ *     radix partition, see radix_partition.hpp) so the degree updates
+ *     sweep the table in order instead of jumping at random;
+ *   - each slot keeps a count and the XOR of its incident hashes rather
+ *     than key indices, so a peeled key's other slots are recomputed from
+ *     the hash alone with no random read into a per-key array. The low
+ *     two bits of the count hold the XOR of the incident keys' position
+ *     indices, which names the key's slot once the count drops to one;
+ *   - equal hashes (duplicate keys) land in one block and are dropped
+ *     there, where a 64-bit collision would otherwise fail every attempt.
+ *
+ * Positions(h) returns std::array<size_t, Arity> of pairwise distinct
+ * slots. Arity is at most four, so a position index fits the two bits.
+ */
+
+#pragma once
+
+#include "radix_partition.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace maph::detail {
+
+/// Peeled keys in peeling order: hash and index of the slot they own.
+struct peel_order {
+    std::vector<uint64_t> hash;
+    std::vector<uint8_t> which;
+};
+
+/**
+ * XOR `seed` into every base hash and group the results by
+ * block_of(h) in [0, blocks). Duplicates are removed within each block.
+ */
+template<typename BlockOf>
+std::vector<uint64_t> seeded_hashes_by_block(std::span<const uint64_t> base, uint64_t seed,
+                                             size_t blocks, BlockOf&& block_of,
+                                             size_t threads = 1) {
+    std::vector<uint64_t> hs(base.size());
+    parallel_chunks(hs.size(), effective_threads(hs.size(), threads),
+        [&](size_t, size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; ++i) hs[i] = base[i] ^ seed;
+        });
+    auto offsets = radix_partition(hs, blocks,
+        [&](size_t i) { return block_of(hs[i]); }, threads);
+
+    // Sort and dedup each block in place, then close the gaps.
+    std::vector<size_t> kept(blocks, 0);
+    parallel_chunks(blocks, effective_threads(hs.size(), threads),
+        [&](size_t, size_t lo, size_t hi) {
+            for (size_t b = lo; b < hi; ++b) {
+                auto first = hs.begin() + static_cast<std::ptrdiff_t>(offsets[b]);
+                auto last = hs.begin() + static_cast<std::ptrdiff_t>(offsets[b + 1]);
+                std::sort(first, last);
+                kept[b] = static_cast<size_t>(std::unique(first, last) - first);
+            }
+        });
+    size_t out = 0;
+    for (size_t b = 0; b < blocks; ++b) {
+        std::copy_n(hs.begin() + static_cast<std::ptrdiff_t>(offsets[b]), kept[b],
+                    hs.begin() + static_cast<std::ptrdiff_t>(out));
+        out += kept[b];
+    }
+    hs.resize(out);
+    return hs;
+}
+
+/**
+ * Peel the Arity-uniform hypergraph whose edges are positions(h) for each
+ * h in `hashes` over a table of `table_size` slots. Returns false if a core
+ * remains (or a slot's degree exceeds 62, which only happens on
+ * pathological input); the caller retries with another seed.
+ */
+template<size_t Arity, typename Positions>
+    requires (Arity == 3 || Arity == 4)
+bool peel(std::span<const uint64_t> hashes, size_t table_size,
+          Positions&& positions, peel_order& order) {
+    std::vector<uint8_t> count(table_size, 0);   // degree << 2 | XOR of indices
+    std::vector<uint64_t> xors(table_size, 0);
+    for (uint64_t h : hashes) {
+        const std::array<size_t, Arity> p = positions(h);
+        for (uint8_t j = 0; j < Arity; ++j) {
+            if (count[p[j]] >= 252) return false;
+            count[p[j]] = static_cast<uint8_t>((count[p[j]] + 4) ^ j);
+            xors[p[j]] ^= h;
+        }
+    }
+
+    // Scan order seeds the stack, so peeling starts from the table's
+    // beginning and mostly stays in the blocks just visited.
+    std::vector<size_t> stack;
+    stack.reserve(table_size / 4);
+    for (size_t i = 0; i < table_size; ++i) {
+        if ((count[i] >> 2) == 1) stack.push_back(i);
+    }
+
+    order.hash.clear();
+    order.which.clear();
+    order.hash.reserve(hashes.size());
+    order.which.reserve(hashes.size());
+    while (!stack.empty()) {
+        const size_t pos = stack.back();
+        stack.pop_back();
+        if ((count[pos] >> 2) != 1) continue;
+
+        const uint64_t h = xors[pos];
+        const uint8_t which = count[pos] & 3;
+        order.hash.push_back(h);
+        order.which.push_back(which);
+
+        const std::array<size_t, Arity> p = positions(h);
+        for (uint8_t j = 0; j < Arity; ++j) {
+            if (j == which) continue;
+            count[p[j]] = static_cast<uint8_t>((count[p[j]] - 4) ^ j);
+            xors[p[j]] ^= h;
+            if ((count[p[j]] >> 2) == 1) stack.push_back(p[j]);
+        }
+        count[pos] = 0;
+        xors[pos] = 0;
+    }
+    return order.hash.size() == hashes.size();
+}
+
+/// Fill `table` in reverse peeling order so each key's slots XOR to
+/// fingerprint(h).
+template<size_t Arity, typename T, typename Alloc, typename Positions, typename Fingerprint>
+void assign(const peel_order& order, std::vector<T, Alloc>& table,
+            Positions&& positions, Fingerprint&& fingerprint) {
+    for (size_t k = order.hash.size(); k-- > 0;) {
+        const uint64_t h = order.hash[k];
+        const size_t which = order.which[k];
+        const std::array<size_t, Arity> p = positions(h);
+        auto v = static_cast<T>(fingerprint(h));
+        for (size_t j = 1; j < Arity; ++j) v = static_cast<T>(v ^ table[p[(which + j) % Arity]]);
+        table[p[which]] = v;
+    }
+}
+
+template<typename Positions>
+bool peel3(std::span<const uint64_t> hashes, size_t table_size,
+           Positions&& positions, peel_order& order) {
+    return peel<3>(hashes, table_size, positions, order);
+}
+
+template<typename T, typename Alloc, typename Positions, typename Fingerprint>
+void assign3(const peel_order& order, std::vector<T, Alloc>& table,
+             Positions&& positions, Fingerprint&& fingerprint) {
+    assign<3>(order, table, positions, fingerprint);
+}
+
+} // namespace maph::detail
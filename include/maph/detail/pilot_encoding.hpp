@@ -0,0 +1,386 @@
+/**
+ * @file pilot_encoding.hpp
+ * @brief Runtime pilot storage for phobic_phf and pthash_hasher.
+ *
+ * phobic_phf takes its pilot storage as a policy:
+ *
+ *   flat_pilots     one uint16_t per bucket. One load per query. 16 bits
+ *                   per bucket, ~3.2 bits/key at BucketSize=5.
+ *   compact_pilots  k-bit low part per bucket plus an escape table holding
+ *                   the high 16-k bits of the (few) pilots >= 2^k. k is
+ *                   picked at build time to minimize space; ~2.6 bits/key
+ *                   at BucketSize=5. A few ns slower per query.
+ *
+ * Buckets placed early (large, empty table) get small pilots; the tail of
+ * small buckets placed into a nearly full table needs large ones. The
+ * pilot distribution is therefore roughly log-uniform up to 2^16, which a
+ * fixed k-bit array with an escape for the high bits covers well.
+ *
+ * Compact layout, per block of 64 buckets:
+ *
+ *   blocks_  [escape bitmap][k words of 64 packed k-bit low parts] ...
+ *   ranks_   escapes before each block (uint32_t)
+ *   high_    pilot >> k for each escaped bucket, in bucket order
+ *
+ * A non-escaped pilot is read from one block (1-2 cache lines); an escaped
+ * one adds a rank lookup and one byte from high_. Both tables are
+ * templated on their array type so the same code serves the owning
+ * phobic_phf (a std::vector from its storage policy) and the zero-copy
+ * phobic_phf_view
+ * (phf_serial::array_view).
+ *
+ * pthash_hasher searches unbounded pilots and takes one of PTHash's two
+ * encoders as its policy:
+ *
+ *   packed_pilots      every pilot in b = bit_width(max pilot) bits. One
+ *                      load per query.
+ *   dictionary_pilots  the distinct pilot values in a table, and a packed
+ *                      index of bit_width(distinct - 1) bits per bucket.
+ *                      Smaller when a few large pilots set the width;
+ *                      a second (cached) load per query.
+ */
+
+#pragma once
+
+#include "elias_fano.hpp"
+#include "memory_report.hpp"
+#include "serialization.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+namespace detail {
+
+// ===== FLAT =====
+
+template<template<typename> class Array>
+class flat_pilot_table {
+    Array<uint16_t> pilots_{};
+
+public:
+    flat_pilot_table() = default;
+
+    explicit flat_pilot_table(std::vector<uint16_t> pilots)
+        requires is_owned_array<Array<uint16_t>>
+        : pilots_(adopt_array<Array<uint16_t>>(std::move(pilots))) {}
+
+    [[nodiscard]] uint16_t operator[](size_t bucket) const noexcept { return pilots_[bucket]; }
+
+    [[nodiscard]] const void* address(size_t bucket) const noexcept {
+        return element_address(pilots_, bucket);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return pilots_.size() * sizeof(uint16_t);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(pilots_); }
+
+    void serialize(std::vector<std::byte>& out) const
+        requires is_owned_array<Array<uint16_t>> {
+        phf_serial::append_vector(out, pilots_);
+    }
+
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_buckets) noexcept {
+        return read_array_into(r, pilots_) && pilots_.size() == num_buckets;
+    }
+};
+
+// ===== COMPACT =====
+
+template<template<typename> class Array>
+class compact_pilot_table {
+    static constexpr size_t BLOCK = 64;
+    static constexpr unsigned MIN_WIDTH = 8;   // high_ stores 16-k <= 8 bits
+    static constexpr unsigned MAX_WIDTH = 16;  // no escapes
+
+    Array<uint64_t> blocks_{};
+    Array<uint32_t> ranks_{};
+    Array<uint8_t> high_{};
+    unsigned width_{MAX_WIDTH};
+
+    size_t block_words() const noexcept { return size_t{width_} + 1; }
+
+public:
+    compact_pilot_table() = default;
+
+    explicit compact_pilot_table(const std::vector<uint16_t>& pilots)
+        requires is_owned_array<Array<uint64_t>> {
+        // Space in bits for each width: (k + 1) per bucket for the block,
+        // 32 per block for the rank, 8 per escape.
+        std::array<size_t, MAX_WIDTH + 1> escapes{};
+        for (uint16_t p : pilots) {
+            for (unsigned k = MIN_WIDTH; k < MAX_WIDTH; ++k) {
+                if ((p >> k) != 0) ++escapes[k];
+            }
+        }
+        const size_t nblocks = (pilots.size() + BLOCK - 1) / BLOCK;
+        size_t best_bits = std::numeric_limits<size_t>::max();
+        for (unsigned k = MIN_WIDTH; k <= MAX_WIDTH; ++k) {
+            if (escapes[k] > std::numeric_limits<uint32_t>::max()) continue;
+            size_t bits = nblocks * BLOCK * (k + 1) + nblocks * 32 + escapes[k] * 8;
+            if (bits < best_bits) { best_bits = bits; width_ = k; }
+        }
+
+        blocks_.assign(nblocks * block_words(), 0);
+        ranks_.assign(nblocks, 0);
+        high_.reserve(escapes[width_]);
+        const uint64_t low_mask = (uint64_t{1} << width_) - 1;
+        for (size_t b = 0; b < pilots.size(); ++b) {
+            const size_t blk = b / BLOCK, i = b % BLOCK;
+            const size_t base = blk * block_words();
+            if (i == 0) ranks_[blk] = static_cast<uint32_t>(high_.size());
+
+            uint64_t lo = pilots[b] & low_mask;
+            size_t bit_pos = i * width_;
+            size_t w = base + 1 + bit_pos / 64;
+            size_t off = bit_pos % 64;
+            blocks_[w] |= lo << off;
+            if (off + width_ > 64) blocks_[w + 1] |= lo >> (64 - off);
+
+            if ((pilots[b] >> width_) != 0) {
+                blocks_[base] |= uint64_t{1} << i;
+                high_.push_back(static_cast<uint8_t>(pilots[b] >> width_));
+            }
+        }
+    }
+
+    [[nodiscard]] uint16_t operator[](size_t bucket) const noexcept {
+        const size_t blk = bucket / BLOCK, i = bucket % BLOCK;
+        const size_t base = blk * block_words();
+        size_t bit_pos = i * width_;
+        size_t w = base + 1 + bit_pos / 64;
+        size_t off = bit_pos % 64;
+        uint64_t v = blocks_[w] >> off;
+        if (off + width_ > 64) v |= blocks_[w + 1] << (64 - off);
+        uint64_t lo = v & ((uint64_t{1} << width_) - 1);
+
+        uint64_t escape = blocks_[base];
+        if (((escape >> i) & 1) == 0) return static_cast<uint16_t>(lo);
+        size_t r = ranks_[blk] + static_cast<size_t>(
+            std::popcount(escape & ((uint64_t{1} << i) - 1)));
+        // Only reachable through a corrupt buffer; keeps views in bounds.
+        if (r >= high_.size()) return static_cast<uint16_t>(lo);
+        return static_cast<uint16_t>(lo | (uint64_t{high_[r]} << width_));
+    }
+
+    /// Address of the code word for `bucket`, for prefetching.
+    [[nodiscard]] const void* address(size_t bucket) const noexcept {
+        const size_t base = (bucket / BLOCK) * block_words();
+        return element_address(blocks_, base + 1 + (bucket % BLOCK) * width_ / 64);
+    }
+
+    [[nodiscard]] unsigned width() const noexcept { return width_; }
+    [[nodiscard]] size_t num_escapes() const noexcept { return high_.size(); }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return blocks_.size() * sizeof(uint64_t)
+             + ranks_.size() * sizeof(uint32_t)
+             + high_.size() * sizeof(uint8_t);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return allocated_bytes(blocks_) + allocated_bytes(ranks_) + allocated_bytes(high_);
+    }
+
+    void serialize(std::vector<std::byte>& out) const
+        requires is_owned_array<Array<uint64_t>> {
+        phf_serial::append(out, static_cast<uint32_t>(width_));
+        phf_serial::append_vector(out, blocks_);
+        phf_serial::append_vector(out, ranks_);
+        phf_serial::append_vector(out, high_);
+    }
+
+    /// Checks the array sizes against num_buckets and that the last rank
+    /// agrees with the escape count; O(1), so a view stays lazy.
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_buckets) noexcept {
+        uint32_t width{};
+        if (!r.read(width) || width < MIN_WIDTH || width > MAX_WIDTH) return false;
+        width_ = width;
+        if (!read_array_into(r, blocks_) || !read_array_into(r, ranks_) ||
+            !read_array_into(r, high_)) {
+            return false;
+        }
+        const size_t nblocks = (num_buckets + BLOCK - 1) / BLOCK;
+        if (ranks_.size() != nblocks || blocks_.size() != nblocks * block_words()) return false;
+        if (nblocks == 0) return high_.size() == 0;
+        uint64_t last = blocks_[(nblocks - 1) * block_words()];
+        return ranks_[nblocks - 1] + static_cast<size_t>(std::popcount(last)) == high_.size();
+    }
+};
+
+// ===== PTHASH: PACKED AND DICTIONARY =====
+
+/// Fixed-width array of width_ bits per element, plus one spare word so a
+/// read may load two words unchecked.
+class packed_int_array {
+    std::vector<uint64_t> words_{};
+    uint64_t size_{0};
+    uint32_t width_{0};
+
+public:
+    packed_int_array() = default;
+
+    explicit packed_int_array(const std::vector<uint64_t>& values) : size_(values.size()) {
+        uint64_t max = 0;
+        for (uint64_t v : values) max = std::max(max, v);
+        width_ = static_cast<uint32_t>(std::bit_width(max));
+        words_.assign(static_cast<size_t>((size_ * width_ + 63) / 64 + 1), 0);
+        if (width_ == 0) return;
+        for (size_t i = 0; i < values.size(); ++i) {
+            const uint64_t pos = static_cast<uint64_t>(i) * width_;
+            const auto w = static_cast<size_t>(pos / 64);
+            const auto off = static_cast<unsigned>(pos % 64);
+            words_[w] |= values[i] << off;
+            if (off + width_ > 64) words_[w + 1] |= values[i] >> (64 - off);
+        }
+    }
+
+    [[nodiscard]] uint64_t operator[](size_t i) const noexcept {
+        return read_bits(words_.data(), static_cast<uint64_t>(i) * width_, width_);
+    }
+
+    [[nodiscard]] const void* address(size_t i) const noexcept {
+        return words_.data() + static_cast<size_t>(static_cast<uint64_t>(i) * width_ / 64);
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(size_); }
+    [[nodiscard]] unsigned width() const noexcept { return width_; }
+    [[nodiscard]] size_t memory_bytes() const noexcept { return words_.size() * sizeof(uint64_t); }
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(words_); }
+
+    void serialize(std::vector<std::byte>& out) const {
+        phf_serial::append(out, size_);
+        phf_serial::append(out, width_);
+        phf_serial::append_vector(out, words_);
+    }
+
+    [[nodiscard]] bool deserialize(phf_serial::reader& r) {
+        if (!r.read(size_) || !r.read(width_) || width_ > 64) return false;
+        if (size_ > MAX_SERIALIZED_ELEMENT_COUNT || !r.read_vector(words_)) return false;
+        return words_.size() == (size_ * width_ + 63) / 64 + 1;
+    }
+};
+
+class packed_pilot_table {
+    packed_int_array pilots_{};
+
+public:
+    packed_pilot_table() = default;
+    explicit packed_pilot_table(const std::vector<uint64_t>& pilots) : pilots_(pilots) {}
+
+    [[nodiscard]] uint64_t operator[](size_t bucket) const noexcept { return pilots_[bucket]; }
+    [[nodiscard]] const void* address(size_t bucket) const noexcept { return pilots_.address(bucket); }
+    [[nodiscard]] size_t memory_bytes() const noexcept { return pilots_.memory_bytes(); }
+    [[nodiscard]] size_t heap_bytes() const noexcept { return pilots_.heap_bytes(); }
+
+    void serialize(std::vector<std::byte>& out) const { pilots_.serialize(out); }
+
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_buckets) {
+        return pilots_.deserialize(r) && pilots_.size() == num_buckets;
+    }
+};
+
+class dictionary_pilot_table {
+    packed_int_array values_{};  // distinct pilots, most frequent first
+    packed_int_array index_{};
+
+public:
+    dictionary_pilot_table() = default;
+
+    explicit dictionary_pilot_table(const std::vector<uint64_t>& pilots) {
+        std::vector<std::pair<uint64_t, uint64_t>> counts;  // (pilot, count)
+        {
+            std::vector<uint64_t> sorted = pilots;
+            std::sort(sorted.begin(), sorted.end());
+            for (uint64_t p : sorted) {
+                if (counts.empty() || counts.back().first != p) counts.emplace_back(p, 0);
+                ++counts.back().second;
+            }
+        }
+        std::stable_sort(counts.begin(), counts.end(),
+            [](const auto& a, const auto& b) { return a.second > b.second; });
+        std::vector<uint64_t> values;
+        values.reserve(counts.size());
+        for (const auto& [p, c] : counts) values.push_back(p);
+        values_ = packed_int_array{values};
+
+        // Rank of each pilot in values, through a sorted (pilot, rank) table.
+        std::vector<std::pair<uint64_t, uint64_t>> rank_of(counts.size());
+        for (size_t i = 0; i < values.size(); ++i) rank_of[i] = {values[i], i};
+        std::sort(rank_of.begin(), rank_of.end());
+        std::vector<uint64_t> index(pilots.size());
+        for (size_t b = 0; b < pilots.size(); ++b) {
+            auto it = std::lower_bound(rank_of.begin(), rank_of.end(),
+                                       std::pair<uint64_t, uint64_t>{pilots[b], 0});
+            index[b] = it->second;
+        }
+        index_ = packed_int_array{index};
+    }
+
+    [[nodiscard]] uint64_t operator[](size_t bucket) const noexcept { return values_[index_[bucket]]; }
+    [[nodiscard]] const void* address(size_t bucket) const noexcept { return index_.address(bucket); }
+    [[nodiscard]] size_t num_values() const noexcept { return values_.size(); }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return values_.memory_bytes() + index_.memory_bytes();
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return values_.heap_bytes() + index_.heap_bytes();
+    }
+
+    void serialize(std::vector<std::byte>& out) const {
+        values_.serialize(out);
+        index_.serialize(out);
+    }
+
+    /// Also rejects index entries past the end of the dictionary.
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_buckets) {
+        if (!values_.deserialize(r) || !index_.deserialize(r)) return false;
+        if (index_.size() != num_buckets) return false;
+        for (size_t b = 0; b < num_buckets; ++b) {
+            if (index_[b] >= values_.size()) return false;
+        }
+        return true;
+    }
+};
+
+} // namespace detail
+
+/// phobic_phf pilot policy: one uint16_t per bucket.
+struct flat_pilots {
+    static constexpr uint32_t algorithm_id = 6;
+    template<template<typename> class Array>
+    using table = detail::flat_pilot_table<Array>;
+};
+
+/// phobic_phf pilot policy: k-bit low parts plus an escape table.
+struct compact_pilots {
+    static constexpr uint32_t algorithm_id = 8;
+    template<template<typename> class Array>
+    using table = detail::compact_pilot_table<Array>;
+};
+
+/// pthash_hasher pilot policy: fixed-width packed pilots.
+struct packed_pilots {
+    static constexpr uint32_t encoding_id = 0;
+    using table = detail::packed_pilot_table;
+};
+
+/// pthash_hasher pilot policy: distinct-value dictionary plus packed index.
+struct dictionary_pilots {
+    static constexpr uint32_t encoding_id = 1;
+    using table = detail::dictionary_pilot_table;
+};
+
+} // namespace maph
@@ -0,0 +1,243 @@
+/**
+ * @file pilot_search.hpp
+ * @brief Several PHOBIC pilot candidates tested at once against the taken
+ *        bitmap.
+ *
+ * A pilot p places a key with second hash h2 at mix(h2 + p * phi) % range
+ * (phobic_pilot_mix). scan_free_pilots() takes runs of consecutive
+ * pilots, one per vector lane, and for each key of a bucket computes the
+ * slot under every lane's pilot, gathers the bitmap words those slots
+ * fall in and clears the lanes that hit a taken slot, stopping as soon as
+ * no lane is left. The caller still checks the surviving pilots for two
+ * keys of the bucket landing on the same slot.
+ *
+ * Lanes are 64-bit: 8 per AVX-512 vector, 4 per AVX2 vector, two vectors
+ * per run. The modulo is exact without a divide: the quotient is
+ * estimated in double precision and the remainder corrected by at most
+ * two steps of range. That needs 2^13 <= range < 2^32
+ * (simd_pilot_search); other ranges and builds without AVX2 keep the
+ * scalar loop, with identical results.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace maph::detail {
+
+/// Full splitmix64 finalizer on h2 + pilot: PHOBIC's pilot hash.
+[[nodiscard]] constexpr uint64_t phobic_pilot_mix(uint64_t h2, uint16_t pilot) noexcept {
+    uint64_t mixed = h2 + static_cast<uint64_t>(pilot) * 0x9e3779b97f4a7c15ULL;
+    mixed ^= mixed >> 30;
+    mixed *= 0xbf58476d1ce4e5b9ULL;
+    mixed ^= mixed >> 27;
+    mixed *= 0x94d049bb133111ebULL;
+    mixed ^= mixed >> 31;
+    return mixed;
+}
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+inline constexpr uint32_t pilot_lanes = 16;
+#else
+inline constexpr uint32_t pilot_lanes = 8;
+#endif
+
+/// True if scan_free_pilots has a vector path for this range.
+[[nodiscard]] constexpr bool simd_pilot_search(uint64_t range) noexcept {
+#if defined(__AVX2__)
+    return range >= (uint64_t{1} << 13) && range < (uint64_t{1} << 32);
+#else
+    (void)range;
+    return false;
+#endif
+}
+
+#if defined(__AVX2__)
+
+namespace pilot_simd {
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+
+// Shifts in their masked forms: the unmasked ones trip
+// -Wmaybe-uninitialized in GCC 12.
+inline constexpr __mmask8 all = 0xFF;
+
+// mix(h2 + pc) % range for 8 lanes of pc = pilot * phi.
+[[nodiscard]] inline __m512i slots(__m512i h2, __m512i pc, __m512i range, __m512d inv) noexcept {
+    __m512i x = _mm512_add_epi64(h2, pc);
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(all, x, 30));
+    x = _mm512_mullo_epi64(x, _mm512_set1_epi64(static_cast<long long>(0xbf58476d1ce4e5b9ULL)));
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(all, x, 27));
+    x = _mm512_mullo_epi64(x, _mm512_set1_epi64(static_cast<long long>(0x94d049bb133111ebULL)));
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi64(all, x, 31));
+    // q is within 2 of x / range (see the file comment), so r is in
+    // (-2 range, 2 range).
+    const __m512i q = _mm512_cvtpd_epu64(_mm512_mul_pd(_mm512_cvtepu64_pd(x), inv));
+    __m512i r = _mm512_sub_epi64(x, _mm512_mullo_epi64(q, range));
+    const __m512i zero = _mm512_setzero_si512();
+    r = _mm512_mask_add_epi64(r, _mm512_cmplt_epi64_mask(r, zero), r, range);
+    r = _mm512_mask_add_epi64(r, _mm512_cmplt_epi64_mask(r, zero), r, range);
+    r = _mm512_mask_sub_epi64(r, _mm512_cmpge_epi64_mask(r, range), r, range);
+    return r;
+}
+
+// Lanes whose slot is free.
+[[nodiscard]] inline __mmask8 free_lanes(__m512i slot, const uint64_t* occupied) noexcept {
+    const __m512i words = _mm512_mask_i64gather_epi64(
+        _mm512_setzero_si512(), all, _mm512_maskz_srli_epi64(all, slot, 6), occupied, 8);
+    const __m512i bit = _mm512_maskz_srlv_epi64(all, words, _mm512_and_si512(slot, _mm512_set1_epi64(63)));
+    return _mm512_testn_epi64_mask(bit, _mm512_set1_epi64(1));
+}
+
+#else
+
+// Low 64 bits of x * c, from 32-bit halves.
+[[nodiscard]] inline __m256i mullo64(__m256i x, uint64_t c) noexcept {
+    const __m256i lo = _mm256_set1_epi64x(static_cast<long long>(c & 0xffffffffu));
+    const __m256i hi = _mm256_set1_epi64x(static_cast<long long>(c >> 32));
+    const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), lo),
+                                           _mm256_mul_epu32(x, hi));
+    return _mm256_add_epi64(_mm256_mul_epu32(x, lo), _mm256_slli_epi64(cross, 32));
+}
+
+// Exact uint64 -> double up to the final rounding: hi * 2^32 + lo.
+[[nodiscard]] inline __m256d to_double(__m256i x) noexcept {
+    const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);  // 2^52
+    const __m256d two52 = _mm256_castsi256_pd(magic);
+    const __m256d hi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(x, 32), magic)), two52);
+    const __m256d lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+        _mm256_and_si256(x, _mm256_set1_epi64x(0xffffffffLL)), magic)), two52);
+    return _mm256_add_pd(_mm256_mul_pd(hi, _mm256_set1_pd(4294967296.0)), lo);
+}
+
+// mix(h2 + pc) % range for 4 lanes; range < 2^32.
+[[nodiscard]] inline __m256i slots(__m256i h2, __m256i pc, __m256i range, __m256d inv) noexcept {
+    __m256i x = _mm256_add_epi64(h2, pc);
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 30));
+    x = mullo64(x, 0xbf58476d1ce4e5b9ULL);
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 27));
+    x = mullo64(x, 0x94d049bb133111ebULL);
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+    // Rounded quotient, below 2^51 since range >= 2^13: adding 2^52
+    // leaves it in the mantissa.
+    const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);
+    const __m256d qd = _mm256_add_pd(_mm256_mul_pd(to_double(x), inv), _mm256_castsi256_pd(magic));
+    const __m256i q = _mm256_sub_epi64(_mm256_castpd_si256(qd), magic);
+    const __m256i qr = _mm256_add_epi64(_mm256_mul_epu32(q, range),
+                                        _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(q, 32), range), 32));
+    __m256i r = _mm256_sub_epi64(x, qr);
+    const __m256i zero = _mm256_setzero_si256();
+    r = _mm256_add_epi64(r, _mm256_and_si256(_mm256_cmpgt_epi64(zero, r), range));
+    r = _mm256_add_epi64(r, _mm256_and_si256(_mm256_cmpgt_epi64(zero, r), range));
+    const __m256i below = _mm256_cmpgt_epi64(range, r);
+    r = _mm256_sub_epi64(r, _mm256_andnot_si256(below, range));
+    return r;
+}
+
+// Lanes whose slot is free, one bit per lane.
+[[nodiscard]] inline uint32_t free_lanes(__m256i slot, const uint64_t* occupied) noexcept {
+    const __m256i words = _mm256_mask_i64gather_epi64(
+        _mm256_setzero_si256(), reinterpret_cast<const long long*>(occupied),
+        _mm256_srli_epi64(slot, 6), _mm256_set1_epi64x(-1), 8);
+    const __m256i bit = _mm256_and_si256(
+        _mm256_srlv_epi64(words, _mm256_and_si256(slot, _mm256_set1_epi64x(63))),
+        _mm256_set1_epi64x(1));
+    const __m256i taken = _mm256_cmpeq_epi64(bit, _mm256_set1_epi64x(1));
+    return ~static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(taken))) & 0xFu;
+}
+
+#endif
+
+} // namespace pilot_simd
+
+/// A run of pilot_lanes pilots from base; bit j of mask is set iff pilot
+/// base + j clears the bitmap.
+struct pilot_run {
+    uint32_t base;
+    uint32_t mask;
+};
+
+/**
+ * Scan the pilots [from, end) a run of pilot_lanes at a time and return
+ * the first run holding a pilot under which every key of the bucket
+ * (hashes[k] for k in keys) lands on a slot not set in occupied; mask is
+ * 0 if no pilot before end does. Requires simd_pilot_search(range).
+ */
+[[nodiscard]] inline pilot_run scan_free_pilots(const uint64_t* hashes, std::span<const size_t> keys,
+                                                uint32_t from, uint32_t end,
+                                                const uint64_t* occupied, uint64_t range) noexcept {
+    constexpr uint64_t phi = 0x9e3779b97f4a7c15ULL;
+    const double inv = 1.0 / static_cast<double>(range);
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    constexpr uint32_t V = 8;
+    const __m512i r = _mm512_set1_epi64(static_cast<long long>(range));
+    const __m512d iv = _mm512_set1_pd(inv);
+    auto bcast = [](uint64_t x) { return _mm512_set1_epi64(static_cast<long long>(x)); };
+    const __m512i step = _mm512_mullo_epi64(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0), bcast(phi));
+    __m512i pc0 = _mm512_add_epi64(bcast(from * phi), step);
+    __m512i pc1 = _mm512_add_epi64(pc0, bcast(V * phi));
+    const __m512i advance = bcast(pilot_lanes * phi);
+    auto add = [](__m512i a, __m512i b) { return _mm512_add_epi64(a, b); };
+#else
+    constexpr uint32_t V = 4;
+    const __m256i r = _mm256_set1_epi64x(static_cast<long long>(range));
+    const __m256d iv = _mm256_set1_pd(inv);
+    auto bcast = [](uint64_t x) { return _mm256_set1_epi64x(static_cast<long long>(x)); };
+    const __m256i step = _mm256_set_epi64x(static_cast<long long>(3 * phi), static_cast<long long>(2 * phi),
+                                           static_cast<long long>(phi), 0);
+    __m256i pc0 = _mm256_add_epi64(bcast(from * phi), step);
+    __m256i pc1 = _mm256_add_epi64(pc0, bcast(V * phi));
+    const __m256i advance = bcast(pilot_lanes * phi);
+    auto add = [](__m256i a, __m256i b) { return _mm256_add_epi64(a, b); };
+#endif
+    for (uint32_t base = from; base < end; base += pilot_lanes) {
+        const uint32_t count = end - base;
+        uint32_t alive = count >= pilot_lanes ? (uint32_t{1} << pilot_lanes) - 1
+                                              : (uint32_t{1} << count) - 1;
+        for (size_t k : keys) {
+            const auto h2 = bcast(hashes[k]);
+            const uint32_t lo = pilot_simd::free_lanes(pilot_simd::slots(h2, pc0, r, iv), occupied);
+            const uint32_t hi = pilot_simd::free_lanes(pilot_simd::slots(h2, pc1, r, iv), occupied);
+            alive &= lo | (hi << V);
+            if (alive == 0) break;
+        }
+        if (alive != 0) return {base, alive};
+        pc0 = add(pc0, advance);
+        pc1 = add(pc1, advance);
+    }
+    return {end, 0};
+}
+
+/// The slot of a key with second hash h2 under each pilot from + j,
+/// j < pilot_lanes, as scan_free_pilots computes it.
+inline void pilot_slots(uint64_t h2, uint32_t from, uint64_t range, uint64_t* out) noexcept {
+    alignas(64) uint64_t pc[pilot_lanes];
+    for (uint32_t j = 0; j < pilot_lanes; ++j) {
+        pc[j] = static_cast<uint64_t>(static_cast<uint16_t>(from + j)) * 0x9e3779b97f4a7c15ULL;
+    }
+    const double inv = 1.0 / static_cast<double>(range);
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    for (uint32_t j = 0; j < pilot_lanes; j += 8) {
+        _mm512_storeu_si512(out + j, pilot_simd::slots(
+            _mm512_set1_epi64(static_cast<long long>(h2)), _mm512_load_si512(pc + j),
+            _mm512_set1_epi64(static_cast<long long>(range)), _mm512_set1_pd(inv)));
+    }
+#else
+    for (uint32_t j = 0; j < pilot_lanes; j += 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), pilot_simd::slots(
+            _mm256_set1_epi64x(static_cast<long long>(h2)),
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(pc + j)),
+            _mm256_set1_epi64x(static_cast<long long>(range)), _mm256_set1_pd(inv)));
+    }
+#endif
+}
+
+#endif // __AVX2__
+
+} // namespace maph::detail
@@ -0,0 +1,30 @@
+/**
+ * @file prefetch.hpp
+ * @brief Software prefetch hint and the window size used by batched lookups.
+ *
+ * Batched queries (slot_for_batch) hash a window of keys, issue one
+ * prefetch per key for the word its lookup will read, then resolve the
+ * window. The window needs to be wide enough to cover memory latency
+ * (~100ns DRAM vs ~5-10ns of hashing per key) but small enough that the
+ * per-key scratch stays in registers/L1.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace maph::detail {
+
+/// Keys hashed ahead of their dependent loads in a batched lookup.
+inline constexpr size_t lookup_batch_window = 16;
+
+/// Read prefetch into all cache levels. No-op on compilers without the builtin.
+inline void prefetch_read(const void* p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+} // namespace maph::detail
@@ -0,0 +1,238 @@
+/**
+ * @file radix_partition.hpp
+ * @brief Counting-sort building blocks for construction: hash dedup,
+ *        stable key partitioning, and per-bucket grouping.
+ *
+ * Builders used to sort keys as strings to drop duplicates, push them one
+ * by one into a vector per shard, and keep a vector of key indices per
+ * bucket. At 100M keys the string sort alone outlasts the pilot search.
+ * Everything here works on fixed-size integers instead:
+ *
+ *   hash_dedup        128-bit digest per key, LSD radix sort on the high
+ *                     64 bits, duplicates found as equal digests; strings
+ *                     are only compared within a run of equal high words.
+ *   radix_partition   stable counting-sort scatter of keys into P parts;
+ *                     radix_partition_runs finds the parts a run at a
+ *                     time (keys routed by batch-hashed digests).
+ *   bucket_groups     CSR layout of key indices per bucket: two arrays in
+ *                     place of one heap vector per bucket.
+ *
+ * hash_dedup and radix_partition split their passes over `threads`
+ * workers (per-thread histograms, then one scatter per worker), so the
+ * result does not depend on the thread count.
+ */
+
+#pragma once
+
+#include "hash.hpp"
+#include "task_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace maph::detail {
+
+/// Run fn(t, begin, end) over `threads` contiguous chunks of [0, n), on
+/// the scoped executor (task_pool.hpp) when one is installed.
+template<typename Fn>
+void parallel_chunks(size_t n, size_t threads, Fn&& fn) {
+    if (threads <= 1 || n < 4096) {
+        fn(size_t{0}, size_t{0}, n);
+        return;
+    }
+    if (task_pool* ex = scoped_executor()) {
+        ex->for_each(threads, [&](size_t t, size_t) {
+            fn(t, n * t / threads, n * (t + 1) / threads);
+        });
+        return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        size_t lo = n * t / threads, hi = n * (t + 1) / threads;
+        pool.emplace_back([&fn, t, lo, hi] { fn(t, lo, hi); });
+    }
+    for (auto& th : pool) th.join();
+}
+
+inline size_t effective_threads(size_t n, size_t threads) noexcept {
+    return (threads <= 1 || n < 4096) ? 1 : threads;
+}
+
+/**
+ * Stable scatter of items into `parts` groups, the groups found a run at
+ * a time: parts_of(lo, hi, part) stores the group of items[i] in part[i]
+ * for each i in [lo, hi). On return items is grouped by part, keeping the
+ * input order inside each group, and the returned offsets (parts + 1
+ * entries) bound each group.
+ */
+template<typename T, typename PartsOf>
+std::vector<size_t> radix_partition_runs(std::vector<T>& items, size_t parts,
+                                         PartsOf&& parts_of, size_t threads = 1) {
+    const size_t n = items.size();
+    const size_t nt = effective_threads(n, threads);
+    std::vector<uint32_t> part(n);
+    std::vector<size_t> counts(nt * parts, 0);
+    parallel_chunks(n, nt, [&](size_t t, size_t lo, size_t hi) {
+        parts_of(lo, hi, part.data());
+        size_t* c = counts.data() + t * parts;
+        for (size_t i = lo; i < hi; ++i) ++c[part[i]];
+    });
+
+    // Part-major prefix sums: thread t writes part p after threads < t.
+    std::vector<size_t> offsets(parts + 1, 0);
+    size_t sum = 0;
+    for (size_t p = 0; p < parts; ++p) {
+        offsets[p] = sum;
+        for (size_t t = 0; t < nt; ++t) {
+            size_t c = counts[t * parts + p];
+            counts[t * parts + p] = sum;
+            sum += c;
+        }
+    }
+    offsets[parts] = sum;
+
+    std::vector<T> out(n);
+    parallel_chunks(n, nt, [&](size_t t, size_t lo, size_t hi) {
+        size_t* pos = counts.data() + t * parts;
+        for (size_t i = lo; i < hi; ++i) out[pos[part[i]]++] = items[i];
+    });
+    items = std::move(out);
+    return offsets;
+}
+
+/// radix_partition_runs with part_of(i) naming the group of items[i].
+template<typename T, typename PartOf>
+std::vector<size_t> radix_partition(std::vector<T>& items, size_t parts,
+                                    PartOf&& part_of, size_t threads = 1) {
+    return radix_partition_runs(items, parts, [&](size_t lo, size_t hi, uint32_t* part) {
+        for (size_t i = lo; i < hi; ++i) part[i] = static_cast<uint32_t>(part_of(i));
+    }, threads);
+}
+
+/**
+ * Remove duplicate keys by digest. Keys come back ordered by
+ * phf_hash128(key).hi, which is as good as sorted order for every builder
+ * (none needs lexicographic order, only uniqueness and determinism).
+ */
+inline void hash_dedup(std::vector<std::string_view>& keys, size_t threads = 1) {
+    struct entry {
+        uint64_t hi;
+        std::string_view key;
+    };
+    static constexpr size_t DIGITS = size_t{1} << 16;
+    const size_t n = keys.size();
+    if (n < 2) return;
+    const size_t nt = effective_threads(n, threads);
+
+    std::vector<entry> a(n);
+    parallel_chunks(n, nt, [&](size_t, size_t lo, size_t hi) {
+        for_each_digest(std::span<const std::string_view>(keys), lo, hi, [&](size_t i, const hash128& d) {
+            a[i] = {d.hi, keys[i]};
+        });
+    });
+
+    if (n < 4096) {
+        // Too few keys to pay for the counters: a comparison sort, stable
+        // so the order matches the radix sort's.
+        std::stable_sort(a.begin(), a.end(),
+                         [](const entry& x, const entry& y) { return x.hi < y.hi; });
+    } else {
+        // LSD radix sort on the 64-bit high word, 16 bits per pass. Each
+        // worker clears and prefix-sums DIGITS counters a pass, so stop
+        // adding workers once that outweighs their share of the keys.
+        const size_t rt = std::min(nt, std::max<size_t>(1, n / DIGITS));
+        std::vector<entry> b(n);
+        std::vector<size_t> counts(rt * DIGITS);
+        for (unsigned shift = 0; shift < 64; shift += 16) {
+            std::fill(counts.begin(), counts.end(), 0);
+            parallel_chunks(n, rt, [&](size_t t, size_t lo, size_t hi) {
+                size_t* c = counts.data() + t * DIGITS;
+                for (size_t i = lo; i < hi; ++i) ++c[(a[i].hi >> shift) & (DIGITS - 1)];
+            });
+            size_t sum = 0;
+            for (size_t d = 0; d < DIGITS; ++d) {
+                for (size_t t = 0; t < rt; ++t) {
+                    size_t c = counts[t * DIGITS + d];
+                    counts[t * DIGITS + d] = sum;
+                    sum += c;
+                }
+            }
+            parallel_chunks(n, rt, [&](size_t t, size_t lo, size_t hi) {
+                size_t* pos = counts.data() + t * DIGITS;
+                for (size_t i = lo; i < hi; ++i) b[pos[(a[i].hi >> shift) & (DIGITS - 1)]++] = a[i];
+            });
+            a.swap(b);
+        }
+    }
+
+    // Equal keys have equal high words and so sit in one run. Runs longer
+    // than one are either duplicates or (rarely) 64-bit collisions; only
+    // those pay for string compares.
+    size_t out = 0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && a[j].hi == a[i].hi) ++j;
+        size_t run_begin = out;
+        for (size_t k = i; k < j; ++k) {
+            bool dup = false;
+            for (size_t m = run_begin; m < out && !dup; ++m) dup = keys[m] == a[k].key;
+            if (!dup) keys[out++] = a[k].key;
+        }
+        i = j;
+    }
+    keys.resize(out);
+}
+
+/**
+ * Key indices grouped by bucket in one array (CSR). Built with a stable
+ * counting sort, so each bucket lists its keys in ascending index order,
+ * exactly as push_back into a vector per bucket would.
+ */
+class bucket_groups {
+    std::vector<size_t> start_{};  // num_buckets + 1
+    std::vector<size_t> items_{};
+
+public:
+    bucket_groups() = default;
+
+    /// bucket_of(i) in [0, num_buckets) for each key index i in [0, n).
+    template<typename BucketOf>
+    bucket_groups(size_t num_buckets, size_t n, BucketOf&& bucket_of) {
+        assign(num_buckets, n, bucket_of);
+    }
+
+    /// Regroup in place, reusing both arrays' capacity (build_scratch
+    /// keeps one bucket_groups across attempts and shards).
+    template<typename BucketOf>
+    void assign(size_t num_buckets, size_t n, BucketOf&& bucket_of) {
+        start_.assign(num_buckets + 1, 0);
+        items_.resize(n);
+        // Count into start_[b + 1], prefix-sum, scatter with start_[b] as
+        // the cursor (leaving it at bucket b's end), then shift back.
+        for (size_t i = 0; i < n; ++i) ++start_[bucket_of(i) + 1];
+        for (size_t b = 0; b < num_buckets; ++b) start_[b + 1] += start_[b];
+        for (size_t i = 0; i < n; ++i) items_[start_[bucket_of(i)]++] = i;
+        for (size_t b = num_buckets; b > 0; --b) start_[b] = start_[b - 1];
+        start_[0] = 0;
+    }
+
+    [[nodiscard]] std::span<const size_t> operator[](size_t bucket) const noexcept {
+        return {items_.data() + start_[bucket], start_[bucket + 1] - start_[bucket]};
+    }
+
+    [[nodiscard]] size_t num_buckets() const noexcept {
+        return start_.empty() ? 0 : start_.size() - 1;
+    }
+
+    [[nodiscard]] size_t capacity_bytes() const noexcept {
+        return (start_.capacity() + items_.capacity()) * sizeof(size_t);
+    }
+};
+
+} // namespace maph::detail
@@ -0,0 +1,120 @@
+/**
+ * @file rank_bitvector.hpp
+ * @brief Bit vector with constant-time rank in one cache line.
+ *
+ * Bits live in 64-byte blocks, each a 64-bit count of the ones in earlier
+ * blocks followed by 448 bits of the vector (bbhash's layout, for a single
+ * bit vector). rank(pos) reads one block and sums at most seven popcounts,
+ * at 512 / 448 = 1.14 bits per bit of the vector.
+ *
+ * chd_hasher and fch_hasher use it to map sparse table positions to dense
+ * slots: the slot of an occupied position is the number of occupied
+ * positions before it.
+ *
+ * Wire format: [u64 size_bits][u64 words], the plain bits without the
+ * counts, which are rebuilt on load.
+ */
+
+#pragma once
+
+#include "memory_report.hpp"
+#include "serialization.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace maph::detail {
+
+class rank_bitvector {
+    static constexpr size_t BLOCK_DATA_WORDS = 7;
+    static constexpr size_t BLOCK_BITS = BLOCK_DATA_WORDS * 64;
+
+    struct alignas(64) rank_block {
+        uint64_t rank{0};
+        std::array<uint64_t, BLOCK_DATA_WORDS> bits{};
+    };
+    static_assert(sizeof(rank_block) == 64);
+
+    std::vector<rank_block> blocks_{};
+    uint64_t size_{0};
+    uint64_t count_{0};
+
+    [[nodiscard]] uint64_t word(size_t w) const noexcept {
+        return blocks_[w / BLOCK_DATA_WORDS].bits[w % BLOCK_DATA_WORDS];
+    }
+
+    void assemble(std::span<const uint64_t> words) {
+        blocks_.assign(static_cast<size_t>((size_ + BLOCK_BITS - 1) / BLOCK_BITS), rank_block{});
+        for (size_t w = 0; w < words.size(); ++w) {
+            blocks_[w / BLOCK_DATA_WORDS].bits[w % BLOCK_DATA_WORDS] = words[w];
+        }
+        count_ = 0;
+        for (auto& block : blocks_) {
+            block.rank = count_;
+            for (uint64_t w : block.bits) count_ += static_cast<uint64_t>(std::popcount(w));
+        }
+    }
+
+public:
+    rank_bitvector() = default;
+
+    /// `words` holds size_bits bits LSB-first; bits past size_bits must be zero.
+    rank_bitvector(std::span<const uint64_t> words, uint64_t size_bits) : size_(size_bits) {
+        assemble(words.first(static_cast<size_t>((size_bits + 63) / 64)));
+    }
+
+    [[nodiscard]] uint64_t size() const noexcept { return size_; }
+    [[nodiscard]] uint64_t count() const noexcept { return count_; }
+
+    [[nodiscard]] bool test(uint64_t pos) const noexcept {
+        return (word(static_cast<size_t>(pos / 64)) >> (pos % 64)) & 1;
+    }
+
+    /// Number of ones before `pos`, if bit `pos` is set. pos < size().
+    [[nodiscard]] std::optional<uint64_t> rank_if_set(uint64_t pos) const noexcept {
+        const rank_block& block = blocks_[static_cast<size_t>(pos / BLOCK_BITS)];
+        const auto bit = static_cast<size_t>(pos % BLOCK_BITS);
+        const size_t w = bit / 64;
+        const uint64_t through = block.bits[w] & ((uint64_t{2} << (bit % 64)) - 1);
+        if ((through >> (bit % 64)) == 0) return std::nullopt;
+        uint64_t r = block.rank + static_cast<uint64_t>(std::popcount(through)) - 1;
+        for (size_t i = 0; i < w; ++i) r += static_cast<uint64_t>(std::popcount(block.bits[i]));
+        return r;
+    }
+
+    /// Cache line rank_if_set(pos) reads, for prefetching.
+    [[nodiscard]] const void* block_address(uint64_t pos) const noexcept {
+        return blocks_.data() + pos / BLOCK_BITS;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return blocks_.size() * sizeof(rank_block) + sizeof(size_) + sizeof(count_);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(blocks_); }
+
+    void serialize(std::vector<std::byte>& out) const {
+        std::vector<uint64_t> words(static_cast<size_t>((size_ + 63) / 64));
+        for (size_t w = 0; w < words.size(); ++w) words[w] = word(w);
+        phf_serial::append(out, size_);
+        phf_serial::append_vector(out, words);
+    }
+
+    /// Rejects a word count that disagrees with size_bits and set bits
+    /// past the end.
+    [[nodiscard]] bool deserialize(phf_serial::reader& r) {
+        std::vector<uint64_t> words;
+        if (!r.read(size_) || !r.read_vector(words)) return false;
+        if (words.size() != (size_ + 63) / 64) return false;
+        if (size_ % 64 != 0 && (words.back() >> (size_ % 64)) != 0) return false;
+        assemble(words);
+        return true;
+    }
+};
+
+} // namespace maph::detail
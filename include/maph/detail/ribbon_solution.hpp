@@ -0,0 +1,209 @@
+/**
+ * @file ribbon_solution.hpp
+ * @brief Solution storage for ribbon_retrieval and ribbon_filter: flat
+ *        rows or interleaved (column-major) words.
+ *
+ * A ribbon query XORs the solution rows start + i for every set bit i of
+ * a 64-bit coefficient word. The layout is a policy:
+ *
+ *   flat_solution         one value_type per row. The query walks the set
+ *                         bits: ~32 dependent loads and XORs with a
+ *                         data-dependent branch each.
+ *   interleaved_solution  rows grouped in blocks of 64; block b stores
+ *                         Bits words, and bit i of word j is bit j of row
+ *                         64b + i (the "interleaved ribbon" of RocksDB).
+ *                         Result bit j is the parity of the coefficients
+ *                         ANDed with column j, so a query is Bits
+ *                         popcounts over at most two adjacent blocks and
+ *                         has no branches on the key. Storage is exactly
+ *                         Bits bits per row instead of sizeof(value_type).
+ *
+ * Interleaved pays off for narrow values: at 1M keys a 1-bit lookup drops
+ * from ~110 to ~70 ns and its solution from one byte to one bit per row.
+ * Query cost grows with Bits, so from about 16 bits the flat walk is as
+ * fast, and at 64 bits it is faster.
+ *
+ * Both layouts give the same query results and share the wire format
+ * except for the solution array; INTERLEAVED_SOLUTION_FLAG in the width
+ * field says which one follows. Owning structures load either layout and
+ * convert; views bind only to their own. Tables are templated on their
+ * array type so one class serves an owning structure (a std::vector from
+ * its storage policy) and its zero-copy view (phf_serial::array_view).
+ */
+
+#pragma once
+
+#include "memory_report.hpp"
+#include "serialization.hpp"
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+/// Set in the width field of ribbon blobs whose solution is interleaved.
+inline constexpr uint32_t INTERLEAVED_SOLUTION_FLAG = 1u << 17;
+
+namespace detail {
+
+// ===== FLAT =====
+
+template<typename T, unsigned Bits, template<typename> class Array>
+class flat_ribbon_table {
+    Array<T> solution_{};
+
+public:
+    flat_ribbon_table() = default;
+
+    explicit flat_ribbon_table(std::vector<T> rows)
+        requires is_owned_array<Array<T>>
+        : solution_(adopt_array<Array<T>>(std::move(rows))) {}
+
+    /// XOR of rows start + i over the set bits i of coeffs.
+    [[nodiscard]] T query(size_t start, uint64_t coeffs) const noexcept {
+        T result = 0;
+        while (coeffs != 0) {
+            result ^= solution_[start + static_cast<size_t>(std::countr_zero(coeffs))];
+            coeffs &= coeffs - 1;
+        }
+        return result;
+    }
+
+    /// Address of row `row`, for prefetching.
+    [[nodiscard]] const void* address(size_t row) const noexcept {
+        return element_address(solution_, row);
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return solution_.empty(); }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept { return solution_.size() * sizeof(T); }
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(solution_); }
+
+    [[nodiscard]] std::vector<T> rows(size_t num_rows) const {
+        std::vector<T> out(num_rows, 0);
+        for (size_t r = 0; r < num_rows && r < solution_.size(); ++r) out[r] = solution_[r];
+        return out;
+    }
+
+    void serialize(std::vector<std::byte>& out) const
+        requires is_owned_array<Array<T>> {
+        phf_serial::append_vector(out, solution_);
+    }
+
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_rows) noexcept {
+        return read_array_into(r, solution_)
+            && (solution_.empty() || solution_.size() == num_rows);
+    }
+};
+
+// ===== INTERLEAVED =====
+
+template<typename T, unsigned Bits, template<typename> class Array>
+class interleaved_ribbon_table {
+    static constexpr size_t BLOCK_ROWS = 64;
+
+    Array<uint64_t> words_{};
+
+    static size_t words_for(size_t num_rows) noexcept {
+        return (num_rows + BLOCK_ROWS - 1) / BLOCK_ROWS * Bits;
+    }
+
+public:
+    interleaved_ribbon_table() = default;
+
+    explicit interleaved_ribbon_table(const std::vector<T>& rows)
+        requires is_owned_array<Array<uint64_t>>
+        : words_(words_for(rows.size()), 0) {
+        for (size_t r = 0; r < rows.size(); ++r) {
+            uint64_t* block = words_.data() + r / BLOCK_ROWS * Bits;
+            const uint64_t bit = uint64_t{1} << (r % BLOCK_ROWS);
+            for (uint64_t v = rows[r]; v != 0; v &= v - 1) {
+                block[std::countr_zero(v)] |= bit;
+            }
+        }
+    }
+
+    /// The rows start + i over the set bits i of coeffs span block b at
+    /// offset o and, unless o == 0, the low o rows of block b + 1.
+    [[nodiscard]] T query(size_t start, uint64_t coeffs) const noexcept {
+        const size_t w = start / BLOCK_ROWS * Bits;
+        const unsigned o = static_cast<unsigned>(start % BLOCK_ROWS);
+        const uint64_t lo = coeffs << o;
+        T result = 0;
+        if (o == 0) {
+            for (unsigned j = 0; j < Bits; ++j) {
+                result |= static_cast<T>(static_cast<T>(std::popcount(words_[w + j] & lo) & 1) << j);
+            }
+        } else {
+            const uint64_t hi = coeffs >> (BLOCK_ROWS - o);
+            for (unsigned j = 0; j < Bits; ++j) {
+                const uint64_t m = (words_[w + j] & lo) ^ (words_[w + Bits + j] & hi);
+                result |= static_cast<T>(static_cast<T>(std::popcount(m) & 1) << j);
+            }
+        }
+        return result;
+    }
+
+    /// Address of the block holding row `row`, for prefetching.
+    [[nodiscard]] const void* address(size_t row) const noexcept {
+        return element_address(words_, row / BLOCK_ROWS * Bits);
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return words_.empty(); }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept { return words_.size() * sizeof(uint64_t); }
+    [[nodiscard]] size_t heap_bytes() const noexcept { return allocated_bytes(words_); }
+
+    [[nodiscard]] std::vector<T> rows(size_t num_rows) const {
+        std::vector<T> out(num_rows, 0);
+        if (words_.size() < words_for(num_rows)) return out;
+        for (size_t r = 0; r < num_rows; ++r) {
+            const size_t w = r / BLOCK_ROWS * Bits;
+            const unsigned i = static_cast<unsigned>(r % BLOCK_ROWS);
+            T v = 0;
+            for (unsigned j = 0; j < Bits; ++j) {
+                v |= static_cast<T>(static_cast<T>((words_[w + j] >> i) & 1) << j);
+            }
+            out[r] = v;
+        }
+        return out;
+    }
+
+    void serialize(std::vector<std::byte>& out) const
+        requires is_owned_array<Array<uint64_t>> {
+        phf_serial::append_vector(out, words_);
+    }
+
+    [[nodiscard]] bool deserialize(phf_serial::reader& r, size_t num_rows) noexcept {
+        return read_array_into(r, words_)
+            && (words_.empty() || words_.size() == words_for(num_rows));
+    }
+};
+
+} // namespace detail
+
+/// One value_type per row; the original layout.
+struct flat_solution {
+    static constexpr uint32_t layout_flag = 0;
+
+    template<typename T, unsigned Bits, template<typename> class Array>
+    using table = detail::flat_ribbon_table<T, Bits, Array>;
+};
+
+/// Column-major 64-row blocks queried with popcount parities.
+struct interleaved_solution {
+    static constexpr uint32_t layout_flag = INTERLEAVED_SOLUTION_FLAG;
+
+    template<typename T, unsigned Bits, template<typename> class Array>
+    using table = detail::interleaved_ribbon_table<T, Bits, Array>;
+};
+
+template<typename L>
+concept ribbon_solution_layout =
+    std::same_as<L, flat_solution> || std::same_as<L, interleaved_solution>;
+
+} // namespace maph
@@ -12,19 +12,28 @@
 #pragma once
 
 #include "../core.hpp"
+#include "hash.hpp"
 #include <array>
 #include <bit>
+#include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <optional>
+#include <ostream>
 #include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace maph {
 
 // Magic numbers for serialization format
 constexpr uint32_t PERFECT_HASH_MAGIC = 0x4D415048;  // "MAPH"
-constexpr uint32_t PERFECT_HASH_VERSION = 2;
+constexpr uint32_t PERFECT_HASH_VERSION = 3;
+
+// Oldest version deserialize() still accepts. Version 2 has the same
+// layout as 3 but was built with the byte-at-a-time FNV-1a key hash.
+constexpr uint32_t PERFECT_HASH_MIN_VERSION = 2;
 
 // Serialization requires little-endian. All modern x86/ARM targets are LE.
 // If you need big-endian support, add byte-swap wrappers around read/write.
@@ -40,8 +49,12 @@ namespace phf_serial {
 /// Append a trivially-copyable value to the byte buffer.
 template<typename T>
 inline void append(std::vector<std::byte>& buf, const T& value) {
-    auto bytes = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
-    buf.insert(buf.end(), bytes.begin(), bytes.end());
+    static_assert(std::is_trivially_copyable_v<T>);
+    // resize + memcpy rather than a range insert, which GCC 12 flags with
+    // a spurious -Wstringop-overflow when the buffer starts empty.
+    const size_t at = buf.size();
+    buf.resize(at + sizeof(T));
+    std::memcpy(buf.data() + at, &value, sizeof(T));
 }
 
 /// Append a vector with length prefix. Values of type U (or convertible)
@@ -59,6 +72,36 @@ inline void append_vector_size(std::vector<std::byte>& buf,
     for (auto e : v) append(buf, static_cast<uint64_t>(e));
 }
 
+/// Read-only array of T stored in place inside a serialized buffer.
+/// Elements are loaded with memcpy, so the array needs no alignment for T
+/// (the formats pack fields back to back); on x86-64 and AArch64 each
+/// load compiles to a single unaligned mov/ldr. Used by the *_view types
+/// to query a buffer without copying it.
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class array_view {
+    const std::byte* data_{nullptr};
+    size_t size_{0};
+public:
+    array_view() = default;
+    array_view(const std::byte* data, size_t size) noexcept : data_(data), size_(size) {}
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    [[nodiscard]] size_t size_bytes() const noexcept { return size_ * sizeof(T); }
+
+    [[nodiscard]] T operator[](size_t i) const noexcept {
+        T v;
+        std::memcpy(&v, data_ + i * sizeof(T), sizeof(T));
+        return v;
+    }
+
+    /// Address of element i, for prefetching.
+    [[nodiscard]] const std::byte* address(size_t i) const noexcept {
+        return data_ + i * sizeof(T);
+    }
+};
+
 /// Bounded stream reader over a byte span. Tracks offset, returns false
 /// on any short read; never throws.
 class reader {
@@ -68,6 +111,7 @@ public:
     explicit reader(std::span<const std::byte> d) noexcept : data_(d) {}
 
     size_t remaining() const noexcept { return data_.size() - off_; }
+    size_t offset() const noexcept { return off_; }
 
     template<typename T>
     [[nodiscard]] bool read(T& out) noexcept {
@@ -78,8 +122,8 @@ public:
     }
 
     /// Read a length-prefixed vector of fixed-size T elements.
-    template<typename T>
-    [[nodiscard]] bool read_vector(std::vector<T>& out) noexcept {
+    template<typename T, typename Alloc>
+    [[nodiscard]] bool read_vector(std::vector<T, Alloc>& out) noexcept {
         uint64_t count{};
         if (!read(count) || count > MAX_SERIALIZED_ELEMENT_COUNT) return false;
         auto n = static_cast<size_t>(count);
@@ -89,6 +133,19 @@ public:
         return true;
     }
 
+    /// Bind a length-prefixed vector of fixed-size T elements in place,
+    /// without copying. Same bounds checks as read_vector().
+    template<typename T>
+    [[nodiscard]] bool read_array(array_view<T>& out) noexcept {
+        uint64_t count{};
+        if (!read(count) || count > MAX_SERIALIZED_ELEMENT_COUNT) return false;
+        auto n = static_cast<size_t>(count);
+        if (n > remaining() / sizeof(T)) return false;
+        out = array_view<T>(data_.data() + off_, n);
+        off_ += n * sizeof(T);
+        return true;
+    }
+
     /// Read a length-prefixed vector of uint64_t and narrow each to size_t.
     [[nodiscard]] bool read_vector_size(std::vector<size_t>& out) noexcept {
         uint64_t count{};
@@ -115,31 +172,176 @@ public:
     }
 };
 
-/// Verify the standard header (magic + version + algorithm id). Optionally
-/// reads an additional trailing uint32_t (e.g. LeafSize, NumLevels, AlphaInt)
-/// that parameterizes the algorithm. Returns true on match.
-inline bool verify_header(reader& r, uint32_t expected_algo,
-                          std::optional<uint32_t> expected_param = std::nullopt) {
+/// Destination for serialize_to(): called with consecutive chunks of the
+/// serialized bytes; returns false to report a write failure.
+template<typename S>
+concept byte_sink = requires(S& s, std::span<const std::byte> chunk) {
+    { s(chunk) } -> std::convertible_to<bool>;
+};
+
+/// byte_sink writing to a std::ostream.
+class ostream_sink {
+    std::ostream* os_;
+public:
+    explicit ostream_sink(std::ostream& os) noexcept : os_(&os) {}
+    bool operator()(std::span<const std::byte> chunk) {
+        os_->write(reinterpret_cast<const char*>(chunk.data()),
+                   static_cast<std::streamsize>(chunk.size()));
+        return static_cast<bool>(*os_);
+    }
+};
+
+/// byte_sink appending to a buffer.
+class vector_sink {
+    std::vector<std::byte>* out_;
+public:
+    explicit vector_sink(std::vector<std::byte>& out) noexcept : out_(&out) {}
+    bool operator()(std::span<const std::byte> chunk) {
+        out_->insert(out_->end(), chunk.begin(), chunk.end());
+        return true;
+    }
+};
+
+/// Read and check the standard header (magic + version + algorithm id).
+/// Optionally reads an additional trailing uint32_t (e.g. LeafSize,
+/// NumLevels, AlphaInt) that parameterizes the algorithm. Returns the
+/// format version on match, nullopt otherwise.
+inline std::optional<uint32_t> read_header(reader& r, uint32_t expected_algo,
+                                           std::optional<uint32_t> expected_param = std::nullopt) {
     uint32_t magic{}, version{}, algo{};
-    if (!r.read(magic) || magic != PERFECT_HASH_MAGIC) return false;
-    if (!r.read(version) || version != PERFECT_HASH_VERSION) return false;
-    if (!r.read(algo) || algo != expected_algo) return false;
+    if (!r.read(magic) || magic != PERFECT_HASH_MAGIC) return std::nullopt;
+    if (!r.read(version) || version < PERFECT_HASH_MIN_VERSION ||
+        version > PERFECT_HASH_VERSION) return std::nullopt;
+    if (!r.read(algo) || algo != expected_algo) return std::nullopt;
     if (expected_param) {
         uint32_t param{};
-        if (!r.read(param) || param != *expected_param) return false;
+        if (!r.read(param) || param != *expected_param) return std::nullopt;
     }
-    return true;
+    return version;
+}
+
+/// read_header() for callers that only need a match / no-match answer.
+inline bool verify_header(reader& r, uint32_t expected_algo,
+                          std::optional<uint32_t> expected_param = std::nullopt) {
+    return read_header(r, expected_algo, expected_param).has_value();
+}
+
+/// Key hash a structure of the given format version was built with.
+[[nodiscard]] inline constexpr hash_revision revision_for_version(uint32_t version) noexcept {
+    return version >= 3 ? hash_revision::wide : hash_revision::fnv1a;
+}
+
+/// Key hash implied by the leading width field of a headerless format.
+[[nodiscard]] inline constexpr hash_revision revision_for_width_field(uint32_t field) noexcept {
+    return (field & WIDE_HASH_FLAG) ? hash_revision::wide : hash_revision::fnv1a;
+}
+
+/// Format version to write for a structure using the given key hash, so a
+/// v2 structure that is loaded and saved again stays readable as v2.
+[[nodiscard]] inline constexpr uint32_t version_for_revision(hash_revision rev) noexcept {
+    return rev == hash_revision::wide ? PERFECT_HASH_VERSION : PERFECT_HASH_MIN_VERSION;
 }
 
 /// Write the standard header. The param (if provided) is written as uint32_t.
 inline void write_header(std::vector<std::byte>& buf, uint32_t algo,
-                         std::optional<uint32_t> param = std::nullopt) {
+                         std::optional<uint32_t> param = std::nullopt,
+                         hash_revision rev = hash_revision::wide) {
     append(buf, PERFECT_HASH_MAGIC);
-    append(buf, PERFECT_HASH_VERSION);
+    append(buf, version_for_revision(rev));
     append(buf, algo);
     if (param) append(buf, *param);
 }
 
 }  // namespace phf_serial
 
+namespace detail {
+
+// Helpers for tables templated on their array type, so one class serves an
+// owning structure (std::vector, with any allocator) and its zero-copy
+// view (array_view).
+
+template<typename T>
+using owned_array = std::vector<T>;
+
+/// True for the owning arrays, false for array_view.
+template<typename A>
+inline constexpr bool is_owned_array = true;
+
+template<typename T>
+inline constexpr bool is_owned_array<phf_serial::array_view<T>> = false;
+
+/// The rows a builder produced, as the owning array type A: moved when A
+/// is a plain std::vector, copied into A's allocator otherwise.
+template<typename A, typename T>
+[[nodiscard]] A adopt_array(std::vector<T>&& rows) {
+    if constexpr (std::is_same_v<A, std::vector<T>>) {
+        return std::move(rows);
+    } else {
+        return A(rows.begin(), rows.end());
+    }
+}
+
+template<typename T, typename Alloc>
+inline const void* element_address(const std::vector<T, Alloc>& a, size_t i) noexcept {
+    return a.data() + i;
+}
+
+template<typename T>
+inline const void* element_address(const phf_serial::array_view<T>& a, size_t i) noexcept {
+    return a.address(i);
+}
+
+// Component (de)serialization for compositions: the component's threaded
+// or streaming overload when it has one, the plain call otherwise.
+
+template<typename T>
+[[nodiscard]] std::vector<std::byte> serialize_with_threads(const T& t, size_t threads) {
+    if constexpr (requires { { t.serialize(threads) } -> std::same_as<std::vector<std::byte>>; }) {
+        return t.serialize(threads);
+    } else {
+        return t.serialize();
+    }
+}
+
+template<typename T>
+[[nodiscard]] auto deserialize_with_threads(std::span<const std::byte> data, size_t threads) {
+    if constexpr (requires { T::deserialize(data, threads); }) {
+        return T::deserialize(data, threads);
+    } else {
+        return T::deserialize(data);
+    }
+}
+
+template<typename T>
+[[nodiscard]] uint64_t serialized_size_of(const T& t, size_t threads) {
+    if constexpr (requires { { t.serialized_size(threads) } -> std::convertible_to<uint64_t>; }) {
+        return t.serialized_size(threads);
+    } else {
+        return t.serialize().size();
+    }
+}
+
+template<typename T, typename Sink>
+[[nodiscard]] bool serialize_into(const T& t, Sink& sink, size_t threads) {
+    if constexpr (requires { { t.serialize_to(sink, threads) } -> std::same_as<result<void>>; }) {
+        return t.serialize_to(sink, threads).has_value();
+    } else {
+        const auto bytes = t.serialize();
+        return sink(std::span<const std::byte>(bytes));
+    }
+}
+
+template<typename T, typename Alloc>
+[[nodiscard]] inline bool read_array_into(phf_serial::reader& r, std::vector<T, Alloc>& out) noexcept {
+    return r.read_vector(out);
+}
+
+template<typename T>
+[[nodiscard]] inline bool read_array_into(phf_serial::reader& r,
+                                          phf_serial::array_view<T>& out) noexcept {
+    return r.read_array(out);
+}
+
+} // namespace detail
+
 } // namespace maph
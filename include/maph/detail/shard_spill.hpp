@@ -0,0 +1,203 @@
+/**
+ * @file shard_spill.hpp
+ * @brief Per-shard temporary files for external-memory partitioned builds.
+ *
+ * shard_spill buffers keys per shard in memory and appends them to one
+ * temporary file per shard whenever the buffered total exceeds the memory
+ * budget. Files are opened only while being appended to or read, so the
+ * shard count is not limited by the open-file limit.
+ *
+ * Record format: uint32_t length, then the key bytes. load(i) reads shard
+ * i back into one buffer and returns views into it, ready for
+ * Inner::builder::borrow_all. scan(i, fn) streams shard i a chunk at a
+ * time instead, for a shard too large to hold (re-sharding).
+ *
+ * open() creates a fresh spill directory; the destructor removes it with
+ * every file in it.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace maph::detail {
+
+class shard_spill {
+    std::filesystem::path dir_{};
+    std::vector<std::string> buffers_{};
+    std::vector<uint64_t> spilled_bytes_{};
+    size_t buffered_{0};
+    size_t budget_{0};
+
+    std::filesystem::path file(size_t shard) const {
+        return dir_ / ("shard_" + std::to_string(shard) + ".keys");
+    }
+
+    [[nodiscard]] bool flush(size_t shard) {
+        auto& buf = buffers_[shard];
+        if (buf.empty()) return true;
+        std::FILE* f = std::fopen(file(shard).string().c_str(), "ab");
+        if (f == nullptr) return false;
+        bool ok = std::fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+        ok = (std::fclose(f) == 0) && ok;
+        spilled_bytes_[shard] += buf.size();
+        buffered_ -= buf.size();
+        std::string{}.swap(buf);
+        return ok;
+    }
+
+public:
+    /// Loaded shard: key bytes plus views into them.
+    struct shard_keys {
+        std::vector<char> bytes;  // not std::string: SSO would move the bytes
+        std::vector<std::string_view> keys;
+    };
+
+    shard_spill() = default;
+    shard_spill(const shard_spill&) = delete;
+    shard_spill& operator=(const shard_spill&) = delete;
+
+    ~shard_spill() {
+        if (!dir_.empty()) {
+            std::error_code ec;
+            std::filesystem::remove_all(dir_, ec);
+        }
+    }
+
+    /// Create a fresh spill directory under `parent` (the system temp
+    /// directory if empty) for `shards` shards.
+    [[nodiscard]] result<void> open(const std::filesystem::path& parent,
+                                    size_t shards, size_t memory_budget) {
+        std::error_code ec;
+        auto base = parent.empty() ? std::filesystem::temp_directory_path(ec) : parent;
+        if (ec) return std::unexpected(error::io_error);
+        std::random_device rd;
+        std::mt19937_64 rng{(uint64_t{rd()} << 32) ^ rd()};
+        for (int attempt = 0; attempt < 16; ++attempt) {
+            auto candidate = base / ("maph_spill_" + std::to_string(rng()));
+            if (std::filesystem::create_directory(candidate, ec)) {
+                dir_ = std::move(candidate);
+                buffers_.assign(shards, {});
+                spilled_bytes_.assign(shards, 0);
+                budget_ = memory_budget;
+                return {};
+            }
+            if (ec && ec != std::errc::file_exists) break;
+        }
+        return std::unexpected(ec == std::errc::permission_denied
+                               ? error::permission_denied : error::io_error);
+    }
+
+    [[nodiscard]] size_t num_shards() const noexcept { return buffers_.size(); }
+
+    /// Bytes written or buffered for `shard`, including length prefixes.
+    [[nodiscard]] uint64_t shard_bytes(size_t shard) const noexcept {
+        return spilled_bytes_[shard] + buffers_[shard].size();
+    }
+
+    [[nodiscard]] result<void> append(size_t shard, std::string_view key) {
+        if (key.size() > std::numeric_limits<uint32_t>::max()) {
+            return std::unexpected(error::value_too_large);
+        }
+        auto len = static_cast<uint32_t>(key.size());
+        auto& buf = buffers_[shard];
+        buf.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        buf.append(key);
+        buffered_ += sizeof(len) + key.size();
+        if (buffered_ > budget_) return flush_all();
+        return {};
+    }
+
+    [[nodiscard]] result<void> flush_all() {
+        for (size_t s = 0; s < buffers_.size(); ++s) {
+            if (!flush(s)) return std::unexpected(error::io_error);
+        }
+        return {};
+    }
+
+    /// Pass each key of shard `shard` to fn (call after flush_all),
+    /// reading a chunk at a time, then delete its file. fn returns
+    /// result<void>; the first error stops the scan.
+    template<typename Fn>
+    [[nodiscard]] result<void> scan(size_t shard, Fn&& fn) {
+        static constexpr size_t CHUNK = size_t{1} << 20;
+        if (spilled_bytes_[shard] == 0) return {};
+        auto path = file(shard);
+        std::FILE* f = std::fopen(path.string().c_str(), "rb");
+        if (f == nullptr) return std::unexpected(error::io_error);
+
+        std::vector<char> buf;
+        size_t have = 0;
+        result<void> st{};
+        for (;;) {
+            // A record longer than CHUNK grows the buffer a chunk a read.
+            buf.resize(have + CHUNK);
+            const size_t got = std::fread(buf.data() + have, 1, CHUNK, f);
+            have += got;
+            size_t pos = 0;
+            while (st && have - pos >= sizeof(uint32_t)) {
+                uint32_t len{};
+                std::memcpy(&len, buf.data() + pos, sizeof(len));
+                if (have - pos - sizeof(len) < len) break;
+                st = fn(std::string_view{buf.data() + pos + sizeof(len), len});
+                pos += sizeof(len) + len;
+            }
+            std::memmove(buf.data(), buf.data() + pos, have - pos);
+            have -= pos;
+            if (!st || got < CHUNK) break;
+        }
+        const bool read_ok = std::ferror(f) == 0;
+        std::fclose(f);
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        spilled_bytes_[shard] = 0;
+        if (!st) return st;
+        if (!read_ok) return std::unexpected(error::io_error);
+        if (have != 0) return std::unexpected(error::invalid_format);
+        return {};
+    }
+
+    /// Read shard `shard` back (call after flush_all) and delete its file.
+    [[nodiscard]] result<shard_keys> load(size_t shard) {
+        shard_keys out;
+        const uint64_t size = spilled_bytes_[shard];
+        if (size > 0) {
+            auto path = file(shard);
+            std::FILE* f = std::fopen(path.string().c_str(), "rb");
+            if (f == nullptr) return std::unexpected(error::io_error);
+            out.bytes.resize(static_cast<size_t>(size));
+            bool ok = std::fread(out.bytes.data(), 1, out.bytes.size(), f) == out.bytes.size();
+            std::fclose(f);
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            if (!ok) return std::unexpected(error::io_error);
+        }
+
+        const char* p = out.bytes.data();
+        const char* end = p + out.bytes.size();
+        while (end - p >= static_cast<std::ptrdiff_t>(sizeof(uint32_t))) {
+            uint32_t len{};
+            std::memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (static_cast<size_t>(end - p) < len) return std::unexpected(error::invalid_format);
+            out.keys.emplace_back(p, len);
+            p += len;
+        }
+        if (p != end) return std::unexpected(error::invalid_format);
+        return out;
+    }
+};
+
+} // namespace maph::detail
@@ -0,0 +1,284 @@
+/**
+ * @file task_pool.hpp
+ * @brief Persistent worker threads with range work-stealing, for builds
+ *        that run many short parallel loops.
+ *
+ * parallel_chunks (radix_partition.hpp) starts and joins its threads on
+ * every call: fine for one pass over millions of keys, ruinous for the
+ * hundreds of short loops of a pilot search. task_pool starts its threads
+ * once and keeps them parked between calls.
+ *
+ *   run(fn)          fn(worker) once on every worker.
+ *   for_each(n, fn)  fn(i, worker) for i in [0, n). Each worker starts with
+ *                    one contiguous range of tasks and takes from its
+ *                    front; a worker whose range is empty steals the back
+ *                    half of the largest remaining one, so a few long
+ *                    tasks do not leave the other threads idle.
+ *
+ * The calling thread is worker 0, so a pool of size 1 starts no threads
+ * and runs everything inline. Calls from different threads take turns; a
+ * call made from inside one of the pool's own tasks runs inline on the
+ * calling worker, so nested parallel loops never spawn or wait on more
+ * threads than the pool has. fn must not throw.
+ *
+ * As maph::executor it is the pool builders share (with_executor): build()
+ * installs it with executor_scope, and parallel_chunks and run_workers
+ * then run on it in place of threads of their own.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace maph::detail {
+
+class task_pool;
+
+/// The executor installed on this thread, or null. Worker threads of a
+/// pool always see their own pool.
+[[nodiscard]] inline task_pool*& scoped_executor() noexcept {
+    thread_local task_pool* ex = nullptr;
+    return ex;
+}
+
+/// Installs `ex` as this thread's executor for the scope; null leaves the
+/// current one in place.
+class executor_scope {
+    task_pool* prev_;
+
+public:
+    explicit executor_scope(task_pool* ex) noexcept : prev_(scoped_executor()) {
+        if (ex != nullptr) scoped_executor() = ex;
+    }
+    ~executor_scope() { scoped_executor() = prev_; }
+    executor_scope(const executor_scope&) = delete;
+    executor_scope& operator=(const executor_scope&) = delete;
+};
+
+class task_pool {
+    // A worker's remaining tasks [lo, hi), one word so that its owner and
+    // thieves move it with a single compare-exchange. A range never takes
+    // the same value twice in one for_each, so the exchange cannot ABA.
+    struct alignas(64) range_slot {
+        std::atomic<uint64_t> packed{0};
+    };
+
+    static constexpr uint64_t pack(uint64_t lo, uint64_t hi) noexcept { return (hi << 32) | lo; }
+    static constexpr uint64_t lo_of(uint64_t r) noexcept { return r & 0xffffffffu; }
+    static constexpr uint64_t hi_of(uint64_t r) noexcept { return r >> 32; }
+
+    static constexpr size_t MAX_BATCH = 0xffffffffu;
+
+    // The pool and worker index whose task this thread is running.
+    struct worker_tag {
+        const task_pool* pool;
+        size_t worker;
+    };
+
+    static worker_tag& current() noexcept {
+        thread_local worker_tag tag{nullptr, 0};
+        return tag;
+    }
+
+    size_t size_{1};
+    std::vector<std::thread> threads_{};
+    std::unique_ptr<range_slot[]> slots_{};
+
+    std::mutex call_mu_{};  // one outside caller at a time
+    std::mutex mu_{};
+    std::condition_variable wake_{};
+    std::condition_variable done_{};
+    uint64_t generation_{0};
+    size_t running_{0};
+    bool stop_{false};
+    void (*job_)(void*, size_t){nullptr};
+    void* ctx_{nullptr};
+
+    void worker_loop(size_t w) {
+        current() = {this, w};
+        scoped_executor() = this;
+        uint64_t seen = 0;
+        std::unique_lock lk(mu_);
+        for (;;) {
+            wake_.wait(lk, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+            auto* job = job_;
+            void* ctx = ctx_;
+            lk.unlock();
+            job(ctx, w);
+            lk.lock();
+            if (--running_ == 0) done_.notify_one();
+        }
+    }
+
+    // fn(w) on every worker, the caller as worker 0. call_mu_ is held.
+    template<typename Fn>
+    void dispatch(Fn& fn) {
+        const worker_tag outer = current();
+        task_pool* const outer_scope = scoped_executor();
+        current() = {this, 0};
+        scoped_executor() = this;
+        {
+            std::lock_guard lk(mu_);
+            job_ = [](void* ctx, size_t w) { (*static_cast<Fn*>(ctx))(w); };
+            ctx_ = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+            running_ = size_ - 1;
+            ++generation_;
+        }
+        wake_.notify_all();
+        fn(size_t{0});
+        {
+            std::unique_lock lk(mu_);
+            done_.wait(lk, [&] { return running_ == 0; });
+        }
+        current() = outer;
+        scoped_executor() = outer_scope;
+    }
+
+    // Take the back half of the largest range another worker holds and
+    // make it w's own. False once every range is empty.
+    bool steal(size_t w) noexcept {
+        for (;;) {
+            size_t victim = size_;
+            uint64_t seen = 0, most = 0;
+            for (size_t k = 1; k < size_; ++k) {
+                const size_t v = (w + k) % size_;
+                const uint64_t r = slots_[v].packed.load(std::memory_order_acquire);
+                if (hi_of(r) - lo_of(r) > most) {
+                    most = hi_of(r) - lo_of(r);
+                    victim = v;
+                    seen = r;
+                }
+            }
+            if (victim == size_) return false;
+            const uint64_t lo = lo_of(seen), hi = hi_of(seen);
+            const uint64_t mid = lo + (hi - lo) / 2;
+            if (slots_[victim].packed.compare_exchange_weak(seen, pack(lo, mid),
+                    std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                slots_[w].packed.store(pack(mid, hi), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    template<typename Fn>
+    void drain(size_t w, size_t base, Fn& fn) {
+        auto& mine = slots_[w].packed;
+        do {
+            uint64_t r = mine.load(std::memory_order_acquire);
+            while (lo_of(r) < hi_of(r)) {
+                if (mine.compare_exchange_weak(r, pack(lo_of(r) + 1, hi_of(r)),
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    fn(base + static_cast<size_t>(lo_of(r)), w);
+                    r = mine.load(std::memory_order_acquire);
+                }
+            }
+        } while (steal(w));
+    }
+
+public:
+    /// A pool of `threads` workers, counting the caller; 0 means one.
+    explicit task_pool(size_t threads)
+        : size_(threads == 0 ? 1 : threads),
+          slots_(std::make_unique<range_slot[]>(size_)) {
+        threads_.reserve(size_ - 1);
+        for (size_t w = 1; w < size_; ++w) {
+            threads_.emplace_back([this, w] { worker_loop(w); });
+        }
+    }
+
+    task_pool(const task_pool&) = delete;
+    task_pool& operator=(const task_pool&) = delete;
+
+    ~task_pool() {
+        {
+            std::lock_guard lk(mu_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+
+    /// True if a call now would run on several threads: the pool has more
+    /// than one and this thread is not already running one of its tasks.
+    [[nodiscard]] bool parallel() const noexcept {
+        return size_ > 1 && current().pool != this;
+    }
+
+    /// fn(worker) on each worker, the caller as worker 0; returns when all
+    /// have finished. Nested in a task of this pool, fn(w) runs for every
+    /// w in turn on the calling thread.
+    template<typename Fn>
+    void run(Fn&& fn) {
+        if (!parallel()) {
+            for (size_t w = 0; w < size_; ++w) fn(w);
+            return;
+        }
+        std::lock_guard call(call_mu_);
+        dispatch(fn);
+    }
+
+    /// fn(i, worker) for every i in [0, n), balanced by range stealing.
+    /// Nested in a task of this pool, it is a plain loop on that worker.
+    template<typename Fn>
+    void for_each(size_t n, Fn&& fn) {
+        if (!parallel() || n <= 1) {
+            const size_t w = current().pool == this ? current().worker : 0;
+            for (size_t i = 0; i < n; ++i) fn(i, w);
+            return;
+        }
+        std::lock_guard call(call_mu_);
+        for (size_t base = 0; base < n; base += MAX_BATCH) {
+            const uint64_t count = std::min<size_t>(n - base, MAX_BATCH);
+            for (size_t w = 0; w < size_; ++w) {
+                slots_[w].packed.store(pack(count * w / size_, count * (w + 1) / size_),
+                                       std::memory_order_relaxed);
+            }
+            auto body = [&](size_t w) { drain(w, base, fn); };
+            dispatch(body);
+        }
+    }
+};
+
+/**
+ * Run worker() on up to `workers` threads that claim work from shared
+ * state until none is left. On the scoped executor when there is one
+ * (every pool worker calls it; the extra ones find nothing to claim),
+ * otherwise on fresh threads.
+ */
+template<typename Worker>
+void run_workers(size_t workers, Worker&& worker) {
+    if (workers <= 1) {
+        worker();
+        return;
+    }
+    if (task_pool* ex = scoped_executor()) {
+        ex->run([&](size_t) { worker(); });
+        return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (size_t t = 0; t < workers; ++t) pool.emplace_back(worker);
+    for (auto& th : pool) th.join();
+}
+
+} // namespace maph::detail
+
+namespace maph {
+
+/// A thread pool several builders can share: pass it to with_executor().
+using executor = detail::task_pool;
+
+} // namespace maph
@@ -0,0 +1,118 @@
+/**
+ * @file xor_gather.hpp
+ * @brief Batched k-way XOR fingerprint check for xor and binary fuse
+ *        filters.
+ *
+ * Both filters answer a query with table[i0] ^ table[i1] ^ table[i2]
+ * (^ table[i3] for 4-wise binary fuse) == fingerprint. verify_batch()
+ * computes the indices and fingerprints for a window of keys, prefetches
+ * the slots of each, and then calls xor_match() to resolve the window.
+ * For 16- and 32-bit fingerprints the loads are vector gathers: 16 lanes
+ * with AVX-512, 8 with AVX2. 8-bit tables and builds without either ISA
+ * use the scalar loop; all paths give identical results.
+ *
+ * A 16-bit gather reads 32 bits at a 2-byte scale, i.e. one slot past the
+ * requested one, so lanes whose index is the last slot fall back to the
+ * scalar loop rather than read past the table.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace maph::detail {
+
+/// out[k] = (XOR of table[idx[j][k]] over j) == fps[k] for k < m.
+template<size_t Arity, typename T>
+    requires (Arity == 3 || Arity == 4)
+void xor_match(const T* table, size_t table_size,
+               const std::array<const uint32_t*, Arity>& idx,
+               const T* fps, size_t m, bool* out) noexcept {
+    (void)table_size;
+    size_t k = 0;
+#if defined(__AVX2__)
+    if constexpr (sizeof(T) == 2 || sizeof(T) == 4) {
+        // Signed 32-bit gather offsets, plus one slot of slack for 16-bit.
+        if (table_size <= static_cast<size_t>(std::numeric_limits<int32_t>::max()) / sizeof(T)) {
+            const auto* base = reinterpret_cast<const int*>(table);
+            constexpr int scale = static_cast<int>(sizeof(T));
+            const uint32_t last = static_cast<uint32_t>(table_size - 1);
+            auto fits = [&](size_t at, size_t lanes) {
+                if constexpr (sizeof(T) == 4) return true;
+                for (size_t j = at; j < at + lanes; ++j) {
+                    for (size_t a = 0; a < Arity; ++a) {
+                        if (idx[a][j] >= last) return false;
+                    }
+                }
+                return true;
+            };
+#if defined(__AVX512F__)
+            for (; k + 16 <= m && fits(k, 16); k += 16) {
+                // Masked forms with a zero source: the unmasked intrinsics
+                // trip -Wmaybe-uninitialized in GCC 12.
+                auto gather = [base](const uint32_t* p) {
+                    return _mm512_mask_i32gather_epi32(
+                        _mm512_setzero_si512(), __mmask16{0xFFFF},
+                        _mm512_loadu_si512(reinterpret_cast<const void*>(p)), base, scale);
+                };
+                __m512i v = gather(idx[0] + k);
+                for (size_t a = 1; a < Arity; ++a) v = _mm512_xor_si512(v, gather(idx[a] + k));
+                __m512i want;
+                if constexpr (sizeof(T) == 4) {
+                    want = _mm512_loadu_si512(reinterpret_cast<const void*>(fps + k));
+                } else {
+                    v = _mm512_and_si512(v, _mm512_set1_epi32(0xFFFF));
+                    want = _mm512_maskz_cvtepu16_epi32(
+                        __mmask16{0xFFFF},
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fps + k)));
+                }
+                __mmask16 eq = _mm512_cmpeq_epi32_mask(v, want);
+                for (size_t j = 0; j < 16; ++j) out[k + j] = ((eq >> j) & 1) != 0;
+            }
+#endif
+            for (; k + 8 <= m && fits(k, 8); k += 8) {
+                auto gather = [base](const uint32_t* p) {
+                    return _mm256_i32gather_epi32(
+                        base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), scale);
+                };
+                __m256i v = gather(idx[0] + k);
+                for (size_t a = 1; a < Arity; ++a) v = _mm256_xor_si256(v, gather(idx[a] + k));
+                __m256i want;
+                if constexpr (sizeof(T) == 4) {
+                    want = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fps + k));
+                } else {
+                    v = _mm256_and_si256(v, _mm256_set1_epi32(0xFFFF));
+                    want = _mm256_cvtepu16_epi32(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(fps + k)));
+                }
+                auto eq = static_cast<unsigned>(
+                    _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, want))));
+                for (size_t j = 0; j < 8; ++j) out[k + j] = ((eq >> j) & 1) != 0;
+            }
+        }
+    }
+#endif
+    for (; k < m; ++k) {
+        T v = table[idx[0][k]];
+        for (size_t a = 1; a < Arity; ++a) v = static_cast<T>(v ^ table[idx[a][k]]);
+        out[k] = v == fps[k];
+    }
+}
+
+/// out[k] = (table[i0[k]] ^ table[i1[k]] ^ table[i2[k]]) == fps[k] for k < m.
+template<typename T>
+void xor3_match(const T* table, size_t table_size,
+                const uint32_t* i0, const uint32_t* i1, const uint32_t* i2,
+                const T* fps, size_t m, bool* out) noexcept {
+    xor_match<3>(table, table_size, std::array<const uint32_t*, 3>{i0, i1, i2}, fps, m, out);
+}
+
+} // namespace maph::detail
@@ -0,0 +1,129 @@
+/**
+ * @file cuda_bulk.hpp
+ * @brief bulk_slot_for / bulk_lookup on a CUDA device: a key batch in
+ *        device memory against device-resident copies of a phobic_phf,
+ *        a phf_value_array over one, or a ribbon_retrieval.
+ *
+ * Built only with -DMAPH_ENABLE_CUDA=ON, as the maph_cuda library
+ * (cuda/bulk_kernels.cu); the rest of maph stays header-only and never
+ * includes this file. It is C++17 and does not include the CUDA headers,
+ * so host code of any standard can call it.
+ *
+ *   auto table = maph::device::make_table(phf);          // device_image.hpp
+ *   maph::device::device_phobic d;
+ *   d.upload(table->image());                            // host -> device
+ *   maph::device::device_keys keys;
+ *   keys.upload(batch);                                  // key_batch on host
+ *   maph::device::device_buffer out;
+ *   out.allocate(batch.count * sizeof(uint64_t));
+ *   maph::device::bulk_slot_for(d, keys.batch(), static_cast<uint64_t*>(out.data()));
+ *
+ * Each thread runs the query of device_query.hpp for one key, so out[i]
+ * equals the CPU structure's slot_for / lookup of key i bit for bit (the
+ * host reference is slot_for_all / lookup_all). Calls are synchronous.
+ *
+ * Pilot search (building) stays on the host: phobic_phf::builder already
+ * searches buckets in parallel, and the device only needs the result.
+ */
+
+#pragma once
+
+#include "device_query.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace maph::device {
+
+enum class cuda_status {
+    ok,
+    no_device,      ///< no CUDA device or driver
+    out_of_memory,  ///< device allocation failed
+    failed          ///< any other CUDA error
+};
+
+/// True when a CUDA device can be used.
+[[nodiscard]] bool cuda_available() noexcept;
+
+/// One device allocation, freed on destruction.
+class device_buffer {
+    void* ptr_{nullptr};
+    size_t bytes_{0};
+
+public:
+    device_buffer() = default;
+    ~device_buffer();
+    device_buffer(device_buffer&& other) noexcept;
+    device_buffer& operator=(device_buffer&& other) noexcept;
+    device_buffer(const device_buffer&) = delete;
+    device_buffer& operator=(const device_buffer&) = delete;
+
+    /// Replace the allocation with `bytes` uninitialized bytes.
+    [[nodiscard]] cuda_status allocate(size_t bytes);
+    /// allocate(bytes), then copy `bytes` from host memory.
+    [[nodiscard]] cuda_status upload(const void* host, size_t bytes);
+    /// Copy the first `bytes` (at most size()) to host memory.
+    [[nodiscard]] cuda_status download(void* host, size_t bytes) const;
+
+    [[nodiscard]] void* data() const noexcept { return ptr_; }
+    [[nodiscard]] size_t size() const noexcept { return bytes_; }
+};
+
+/// Device copy of a phobic_image; image() points at device memory.
+class device_phobic {
+    device_buffer pilots_;
+    phobic_image image_{};
+
+public:
+    [[nodiscard]] cuda_status upload(const phobic_image& host);
+    [[nodiscard]] const phobic_image& image() const noexcept { return image_; }
+};
+
+/// Device copy of a value_array_image.
+class device_value_array {
+    device_phobic phf_;
+    device_buffer words_;
+    value_array_image image_{};
+
+public:
+    [[nodiscard]] cuda_status upload(const value_array_image& host);
+    [[nodiscard]] const value_array_image& image() const noexcept { return image_; }
+};
+
+/// Device copy of a ribbon_image.
+class device_ribbon {
+    device_buffer rows_;
+    device_buffer shard_rows_;
+    device_buffer shard_seeds_;
+    ribbon_image image_{};
+
+public:
+    [[nodiscard]] cuda_status upload(const ribbon_image& host);
+    [[nodiscard]] const ribbon_image& image() const noexcept { return image_; }
+};
+
+/// Device copy of a key_batch.
+class device_keys {
+    device_buffer bytes_;
+    device_buffer offsets_;
+    key_batch batch_{};
+
+public:
+    [[nodiscard]] cuda_status upload(const key_batch& host);
+    [[nodiscard]] const key_batch& batch() const noexcept { return batch_; }
+};
+
+/// out[i] = slot_for(f.image(), key i) for i < keys.count. keys and out
+/// are in device memory.
+[[nodiscard]] cuda_status bulk_slot_for(const device_phobic& f, const key_batch& keys,
+                                        uint64_t* out);
+
+/// out[i] = lookup(a.image(), key i) for i < keys.count.
+[[nodiscard]] cuda_status bulk_lookup(const device_value_array& a, const key_batch& keys,
+                                      uint64_t* out);
+
+/// out[i] = lookup(r.image(), key i) for i < keys.count.
+[[nodiscard]] cuda_status bulk_lookup(const device_ribbon& r, const key_batch& keys,
+                                      uint64_t* out);
+
+} // namespace maph::device
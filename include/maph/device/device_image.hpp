@@ -0,0 +1,115 @@
+/**
+ * @file device_image.hpp
+ * @brief Flat host tables of a phobic_phf, a phf_value_array over one,
+ *        or a ribbon_retrieval, whose image() is the struct the portable
+ *        queries in device_query.hpp (and the CUDA kernels) read.
+ *
+ * make_table() copies the query state out of the owning structure:
+ * pilots widened to uint16_t whatever the Pilots policy, the packed value
+ * words as stored, and the ribbon solution as one value per row whatever
+ * the layout (interleaved columns are transposed back). To query a
+ * serialized image on a device, deserialize() it into the owning type,
+ * make_table(), then upload the table's image() with cuda_bulk.hpp.
+ *
+ * Only hash_revision::wide structures have a device query; tables of
+ * format-v2 (FNV-1a) images are refused with error::invalid_format.
+ */
+
+#pragma once
+
+#include "../algorithms/phobic.hpp"
+#include "../core.hpp"
+#include "../retrieval/phf_value_array.hpp"
+#include "../retrieval/ribbon_retrieval.hpp"
+#include "device_query.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace maph::device {
+
+/// Host arrays of a phobic_image.
+struct phobic_table {
+    std::vector<uint16_t> pilots;
+    uint64_t range_size{0};
+    uint64_t seed{0};
+
+    [[nodiscard]] phobic_image image() const noexcept {
+        return {pilots.data(), pilots.size(), range_size, seed};
+    }
+};
+
+/// Host arrays of a value_array_image.
+struct value_array_table {
+    phobic_table phf;
+    std::vector<uint64_t> words;
+    unsigned bits{0};
+
+    [[nodiscard]] value_array_image image() const noexcept {
+        return {phf.image(), {words.data(), words.size(), bits}};
+    }
+};
+
+/// Host arrays of a ribbon_image.
+struct ribbon_table {
+    std::vector<unsigned char> rows;
+    unsigned row_bytes{0};
+    uint64_t num_rows{0};
+    uint64_t seed{0};
+    std::vector<uint64_t> shard_rows;
+    std::vector<uint64_t> shard_seeds;
+
+    [[nodiscard]] ribbon_image image() const noexcept {
+        return {rows.data(), row_bytes, num_rows, seed,
+                shard_rows.empty() ? nullptr : shard_rows.data(),
+                shard_seeds.empty() ? nullptr : shard_seeds.data(), shard_seeds.size()};
+    }
+};
+
+template<size_t BucketSize, typename Pilots, storage_policy Storage>
+[[nodiscard]] result<phobic_table> make_table(const phobic_phf<BucketSize, Pilots, Storage>& phf) {
+    if (phf.revision() != hash_revision::wide) return std::unexpected(error::invalid_format);
+    phobic_table t;
+    t.pilots.resize(phf.num_buckets());
+    for (size_t b = 0; b < t.pilots.size(); ++b) {
+        t.pilots[b] = static_cast<uint16_t>(phf.pilots()[b]);
+    }
+    t.range_size = phf.range_size();
+    t.seed = phf.seed();
+    return t;
+}
+
+template<size_t BucketSize, typename Pilots, storage_policy PhfStorage, unsigned M,
+         storage_policy Storage>
+[[nodiscard]] result<value_array_table>
+make_table(const phf_value_array<phobic_phf<BucketSize, Pilots, PhfStorage>, M, Storage>& a) {
+    auto phf = make_table(a.phf());
+    if (!phf) return std::unexpected(phf.error());
+    const auto words = a.values().words();
+    return value_array_table{std::move(*phf), {words.begin(), words.end()}, M};
+}
+
+template<unsigned M, ribbon_solution_layout Layout, storage_policy Storage>
+[[nodiscard]] result<ribbon_table> make_table(const ribbon_retrieval<M, Layout, Storage>& r) {
+    using value_type = typename ribbon_retrieval<M, Layout, Storage>::value_type;
+    if (r.revision() != hash_revision::wide) return std::unexpected(error::invalid_format);
+    const auto rows = r.solution_rows();
+    ribbon_table t;
+    t.row_bytes = sizeof(value_type);
+    t.num_rows = rows.size();
+    t.seed = r.seed();
+    // Little-endian whatever the host, as device_query.hpp reads it.
+    t.rows.resize(rows.size() * sizeof(value_type));
+    for (size_t i = 0; i < rows.size(); ++i) {
+        for (size_t k = 0; k < sizeof(value_type); ++k) {
+            t.rows[i * sizeof(value_type) + k] =
+                static_cast<unsigned char>(static_cast<uint64_t>(rows[i]) >> (8 * k));
+        }
+    }
+    t.shard_rows.assign(r.shard_rows().begin(), r.shard_rows().end());
+    t.shard_seeds.assign(r.shard_seeds().begin(), r.shard_seeds().end());
+    return t;
+}
+
+} // namespace maph::device
@@ -0,0 +1,315 @@
+/**
+ * @file device_query.hpp
+ * @brief Portable per-key queries over flat images of phobic_phf,
+ *        phf_value_array<phobic_phf> and ribbon_retrieval, shared by the
+ *        host and by the CUDA kernels.
+ *
+ * The library proper is C++23 (std::expected, if consteval, concepts),
+ * which nvcc does not accept, so the device query lives here in plain
+ * C++17 with no library includes. Every function is __host__ __device__
+ * under nvcc and an ordinary inline function otherwise. Each one is a
+ * line-for-line port of the structure's wide-revision query:
+ *
+ *   hash128()          phf_hash128() (scalar stripe loop; the SIMD loop
+ *                      is bit-identical to it);
+ *   slot_for()         phobic_phf::slot_for(hash128);
+ *   lookup()           phf_value_array::lookup(hash128) over a phobic
+ *                      PHF, and ribbon_retrieval::lookup(hash128).
+ *
+ * The images are plain pointer + scalar structs. device_image.hpp fills
+ * them from the owning structures (so from any serialized image, after
+ * deserialize()), pointing at host arrays; cuda_bulk.hpp copies those
+ * arrays to the device and hands back the same structs over device
+ * pointers. Either way the answers are identical to the CPU structure's.
+ * tests/v3/test_device_image.cpp checks that on the host build.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__CUDACC__)
+#define MAPH_HD __host__ __device__
+#else
+#define MAPH_HD
+#endif
+
+namespace maph::device {
+
+/// phf_hash128() digest.
+struct digest {
+    uint64_t lo;
+    uint64_t hi;
+};
+
+/// phobic_phf: pilots[num_buckets] as uint16_t, whatever the Pilots policy.
+struct phobic_image {
+    const uint16_t* pilots;
+    uint64_t num_buckets;
+    uint64_t range_size;
+    uint64_t seed;
+};
+
+/// detail::packed_value_array<bits>: slot i holds bits [i * bits, (i + 1) * bits).
+struct packed_image {
+    const uint64_t* words;
+    uint64_t num_words;
+    unsigned bits;
+};
+
+/// phf_value_array<phobic_phf<...>, bits>.
+struct value_array_image {
+    phobic_image phf;
+    packed_image values;
+};
+
+/// ribbon_retrieval<bits>: one row_bytes-wide little-endian value per row
+/// (the flat layout, whatever layout was built). num_rows is 0 for a
+/// structure built from no keys. shard_rows has num_shards + 1 entries;
+/// both shard arrays are null and num_shards 0 for an unsharded build.
+struct ribbon_image {
+    const void* rows;
+    unsigned row_bytes;
+    uint64_t num_rows;
+    uint64_t seed;
+    const uint64_t* shard_rows;
+    const uint64_t* shard_seeds;
+    uint64_t num_shards;
+};
+
+namespace detail {
+
+MAPH_HD inline uint64_t mulhi(uint64_t a, uint64_t b) {
+#if defined(__CUDA_ARCH__)
+    return __umul64hi(a, b);
+#else
+    return static_cast<uint64_t>((static_cast<__uint128_t>(a) * b) >> 64);
+#endif
+}
+
+MAPH_HD inline uint64_t wymix(uint64_t a, uint64_t b) { return (a * b) ^ mulhi(a, b); }
+
+MAPH_HD inline uint64_t remix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Byte by byte: device keys need not be aligned.
+MAPH_HD inline uint64_t read_le(const unsigned char* p, unsigned n) {
+    uint64_t v = 0;
+    for (unsigned i = n; i-- > 0;) v = (v << 8) | p[i];
+    return v;
+}
+
+// Secrets are local arrays: namespace-scope constexpr arrays are not
+// visible to device code.
+MAPH_HD inline uint64_t hash_secret(unsigned i) {
+    const uint64_t s[8] = {
+        0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+        0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+        0x1d8e4e27c47d124fULL, 0x9e3779b97f4a7c15ULL,
+        0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL,
+    };
+    return s[i];
+}
+
+MAPH_HD inline void accumulate_stripes(uint64_t* acc, const unsigned char* p, uint64_t stripes) {
+    const uint64_t k[8] = {
+        0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+        0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+        0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+        0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+    };
+    for (uint64_t s = 0; s < stripes; ++s, p += 64) {
+        for (unsigned j = 0; j < 8; ++j) {
+            const uint64_t d = read_le(p + 8 * j, 8);
+            const uint64_t x = d ^ k[j];
+            acc[j ^ 1] += d;
+            acc[j] += (x & 0xffffffffULL) * (x >> 32);
+        }
+    }
+}
+
+MAPH_HD inline void scramble(uint64_t* acc) {
+    const uint64_t k[8] = {
+        0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL,
+        0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+        0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL,
+        0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL,
+    };
+    for (unsigned j = 0; j < 8; ++j) {
+        uint64_t a = acc[j];
+        a ^= a >> 47;
+        a ^= k[j];
+        acc[j] = a * 0x9E3779B1ULL;
+    }
+}
+
+MAPH_HD inline uint64_t pilot_mix(uint64_t h2, uint16_t pilot) {
+    uint64_t mixed = h2 + static_cast<uint64_t>(pilot) * 0x9e3779b97f4a7c15ULL;
+    mixed ^= mixed >> 30;
+    mixed *= 0xbf58476d1ce4e5b9ULL;
+    mixed ^= mixed >> 27;
+    mixed *= 0x94d049bb133111ebULL;
+    mixed ^= mixed >> 31;
+    return mixed;
+}
+
+MAPH_HD inline uint64_t ribbon_row(const ribbon_image& r, uint64_t i) {
+    const auto* p = static_cast<const unsigned char*>(r.rows) + i * r.row_bytes;
+    return read_le(p, r.row_bytes);
+}
+
+} // namespace detail
+
+/// phf_hash128() of the len bytes at p.
+MAPH_HD inline digest hash128(const unsigned char* p, uint64_t len) {
+    using detail::hash_secret;
+    using detail::read_le;
+    using detail::wymix;
+    uint64_t s0 = hash_secret(0);
+    uint64_t s1 = hash_secret(1);
+    uint64_t a = 0, b = 0;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            const uint64_t off = (len >> 3) << 2;
+            a = (read_le(p, 4) << 32) | read_le(p + off, 4);
+            b = (read_le(p + len - 4, 4) << 32) | read_le(p + len - 4 - off, 4);
+        } else if (len > 0) {
+            a = (uint64_t{p[0]} << 16) | (uint64_t{p[len >> 1]} << 8) | p[len - 1];
+        }
+    } else {
+        uint64_t i = len;
+        if (i > 256) {
+            uint64_t acc[8];
+            for (unsigned j = 0; j < 8; ++j) acc[j] = hash_secret(j);
+            uint64_t stripes = (i - 1) / 64;
+            while (stripes > 0) {
+                const uint64_t run = stripes < 16 ? stripes : 16;
+                detail::accumulate_stripes(acc, p, run);
+                if (run == 16) detail::scramble(acc);
+                p += run * 64;
+                i -= run * 64;
+                stripes -= run;
+            }
+            s0 ^= wymix(acc[0] ^ hash_secret(0), acc[1] ^ hash_secret(1))
+                ^ wymix(acc[2] ^ hash_secret(2), acc[3] ^ hash_secret(3))
+                ^ wymix(acc[4] ^ hash_secret(4), acc[5] ^ hash_secret(5))
+                ^ wymix(acc[6] ^ hash_secret(6), acc[7] ^ hash_secret(7));
+            s1 ^= wymix(acc[0] ^ hash_secret(3), acc[7] ^ hash_secret(2))
+                ^ wymix(acc[1] ^ hash_secret(5), acc[6] ^ hash_secret(4))
+                ^ wymix(acc[2] ^ hash_secret(7), acc[5] ^ hash_secret(6))
+                ^ wymix(acc[3] ^ hash_secret(1), acc[4] ^ hash_secret(0));
+        }
+        if (i > 32) {
+            uint64_t s2 = hash_secret(2);
+            uint64_t s3 = hash_secret(3);
+            do {
+                const uint64_t a0 = read_le(p, 8), b0 = read_le(p + 8, 8);
+                const uint64_t a1 = read_le(p + 16, 8), b1 = read_le(p + 24, 8);
+                s0 = wymix(a0 ^ hash_secret(4), b0 ^ s0);
+                s1 = wymix(a0 ^ hash_secret(5), b0 ^ s1);
+                s2 = wymix(a1 ^ hash_secret(4), b1 ^ s2);
+                s3 = wymix(a1 ^ hash_secret(5), b1 ^ s3);
+                p += 32;
+                i -= 32;
+            } while (i > 32);
+            s0 ^= s2;
+            s1 ^= s3;
+        }
+        if (i > 16) {
+            const uint64_t a0 = read_le(p, 8), b0 = read_le(p + 8, 8);
+            s0 = wymix(a0 ^ hash_secret(4), b0 ^ s0);
+            s1 = wymix(a0 ^ hash_secret(5), b0 ^ s1);
+            p += 16;
+            i -= 16;
+        }
+        a = read_le(p + i - 16, 8);
+        b = read_le(p + i - 8, 8);
+    }
+
+    return {wymix(wymix(a ^ hash_secret(6), b ^ s0) ^ len, hash_secret(1)),
+            wymix(wymix(a ^ hash_secret(7), b ^ s1) ^ len, hash_secret(3))};
+}
+
+/// count keys packed end to end: key i is bytes[offsets[i], offsets[i + 1]).
+struct key_batch {
+    const unsigned char* bytes;
+    const uint64_t* offsets;
+    uint64_t count;
+
+    MAPH_HD digest hash(uint64_t i) const {
+        return hash128(bytes + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+/// phobic_phf::slot_for(d). An image with no buckets answers 0.
+MAPH_HD inline uint64_t slot_for(const phobic_image& f, digest d) {
+    if (f.num_buckets == 0 || f.range_size == 0) return 0;
+    const uint64_t h1 = detail::wymix(d.lo ^ f.seed, d.hi ^ 0xbf58476d1ce4e5b9ULL);
+    const uint64_t h2 = detail::wymix(d.hi ^ f.seed, d.lo ^ 0x94d049bb133111ebULL);
+    return detail::pilot_mix(h2, f.pilots[h1 % f.num_buckets]) % f.range_size;
+}
+
+/// packed_value_array::get(slot).
+MAPH_HD inline uint64_t get(const packed_image& v, uint64_t slot) {
+    const uint64_t mask = v.bits == 64 ? ~uint64_t{0} : (uint64_t{1} << v.bits) - 1;
+    const uint64_t bit = slot * v.bits;
+    const uint64_t w = bit / 64;
+    const unsigned off = static_cast<unsigned>(bit % 64);
+    uint64_t x = v.words[w] >> off;
+    if (off + v.bits > 64 && w + 1 < v.num_words) x |= v.words[w + 1] << (64 - off);
+    return x & mask;
+}
+
+/// phf_value_array::lookup(d).
+MAPH_HD inline uint64_t lookup(const value_array_image& a, digest d) {
+    return get(a.values, slot_for(a.phf, d));
+}
+
+/// ribbon_retrieval::lookup(d): the XOR of the rows of d's 64-row band
+/// picked by its coefficient word.
+MAPH_HD inline uint64_t lookup(const ribbon_image& r, digest d) {
+    if (r.num_rows == 0) return 0;
+    const uint64_t fp = detail::remix(d.hi ^ detail::remix(d.lo ^ 0xcbf29ce484222325ULL));
+    uint64_t h = fp ^ r.seed;
+    uint64_t first = 0;
+    uint64_t rows = r.num_rows;
+    if (r.num_shards != 0) {
+        const uint64_t s = detail::mulhi(detail::remix(fp ^ 0x6a09e667f3bcc909ULL), r.num_shards);
+        first = r.shard_rows[s];
+        rows = r.shard_rows[s + 1] - first;
+        h = fp ^ r.shard_seeds[s];
+    }
+    const uint64_t start = first + (rows > 64 ? (h >> 32) % (rows - 64 + 1) : 0);
+    uint64_t c = h * 0xbf58476d1ce4e5b9ULL;
+    c ^= c >> 31;
+    c |= 1ULL;
+    uint64_t result = 0;
+    for (unsigned i = 0; c != 0; ++i, c >>= 1) {
+        if (c & 1) result ^= detail::ribbon_row(r, start + i);
+    }
+    return result;
+}
+
+/// out[i] = slot_for(f, hash128(key i)) for i < keys.count. The
+/// host reference for bulk_slot_for() in cuda_bulk.hpp, whose threads run
+/// the same body.
+inline void slot_for_all(const phobic_image& f, const key_batch& keys, uint64_t* out) {
+    for (uint64_t i = 0; i < keys.count; ++i) out[i] = slot_for(f, keys.hash(i));
+}
+
+/// out[i] = lookup(a, hash128(key i)) for i < keys.count.
+inline void lookup_all(const value_array_image& a, const key_batch& keys, uint64_t* out) {
+    for (uint64_t i = 0; i < keys.count; ++i) out[i] = lookup(a, keys.hash(i));
+}
+
+/// out[i] = lookup(r, hash128(key i)) for i < keys.count.
+inline void lookup_all(const ribbon_image& r, const key_batch& keys, uint64_t* out) {
+    for (uint64_t i = 0; i < keys.count; ++i) out[i] = lookup(r, keys.hash(i));
+}
+
+} // namespace maph::device
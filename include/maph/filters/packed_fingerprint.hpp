@@ -4,15 +4,22 @@
  *
  * Stores a k-bit fingerprint per slot in a tightly packed bit array.
  * Combined with a perfect hash function in composition/perfect_filter.hpp
- * to form an approximate map.
+ * to form an approximate map. erase() retires a key by zeroing its
+ * fingerprint, after which it verifies only if its fingerprint was 0
+ * (probability 2^-k). It exists at widths dividing 64, whose
+ * fingerprints never straddle two words.
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../detail/fingerprint_hash.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/packed_value_array.hpp"
+#include <algorithm>
 #include <array>
 #include <bit>
+#include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <functional>
@@ -41,21 +48,20 @@ class packed_fingerprint_array {
 
     std::vector<uint64_t> data_;
     size_t num_slots_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
-    static uint64_t truncate_fp(std::string_view key) noexcept {
-        return membership_fingerprint(key) & fp_mask;
+    template<typename Key>
+    uint64_t truncate_fp(const Key& key) const noexcept {
+        return membership_fingerprint(key, hash_rev_) & fp_mask;
     }
 
-    uint64_t extract(size_t slot) const noexcept {
-        size_t bit_pos = slot * FingerprintBits;
-        size_t word_idx = bit_pos / 64;
-        size_t bit_offset = bit_pos % 64;
+    using packed = detail::packed_value_array<FingerprintBits>;
 
-        uint64_t val = data_[word_idx] >> bit_offset;
-        if (bit_offset + FingerprintBits > 64 && word_idx + 1 < data_.size()) {
-            val |= data_[word_idx + 1] << (64 - bit_offset);
-        }
-        return val & fp_mask;
+    // Widths erase() may rewrite while verify_atomic() runs.
+    static constexpr bool concurrent_erase = 64 % FingerprintBits == 0;
+
+    uint64_t extract(size_t slot) const noexcept {
+        return packed::extract(data_, slot);
     }
 
     void store(size_t slot, uint64_t value) noexcept {
@@ -82,6 +88,7 @@ public:
                std::function<std::optional<size_t>(std::string_view)> slot_for,
                size_t total_slots) {
         num_slots_ = total_slots;
+        hash_rev_ = hash_revision::wide;
         size_t total_bits = num_slots_ * FingerprintBits;
         data_.assign((total_bits + 63) / 64, 0);
 
@@ -92,11 +99,92 @@ public:
         }
     }
 
+    /// Integer or borrowed string keys, each hashed once for its slot and
+    /// its fingerprint. slot_for(hk) returns the key's slot.
+    template<typename K, typename SlotFn>
+        requires (integer_key<K> || std::same_as<K, std::string_view>) &&
+                 std::invocable<SlotFn&, const hashed_key&>
+    void build(std::span<const K> keys, SlotFn slot_for, size_t total_slots) {
+        num_slots_ = total_slots;
+        hash_rev_ = hash_revision::wide;
+        data_.assign((num_slots_ * FingerprintBits + 63) / 64, 0);
+        for (const auto& key : keys) {
+            const hashed_key hk{key};
+            const size_t slot = static_cast<size_t>(slot_for(hk));
+            if (slot < num_slots_) store(slot, truncate_fp(hk));
+        }
+    }
+
     [[nodiscard]] bool verify(std::string_view key, size_t slot) const noexcept {
         if (slot >= num_slots_) return false;
         return extract(slot) == truncate_fp(key);
     }
 
+    [[nodiscard]] bool verify(const hashed_key& hk, size_t slot) const noexcept {
+        if (slot >= num_slots_) return false;
+        return extract(slot) == truncate_fp(hk);
+    }
+
+    /// verify() for readers running alongside erase(): the fingerprint's
+    /// word is read with packed_value_array::load_atomic().
+    [[nodiscard]] bool verify_atomic(std::string_view key, size_t slot) const noexcept
+        requires concurrent_erase {
+        if (slot >= num_slots_) return false;
+        return packed::load_atomic(data_, slot) == truncate_fp(key);
+    }
+
+    [[nodiscard]] bool verify_atomic(const hashed_key& hk, size_t slot) const noexcept
+        requires concurrent_erase {
+        if (slot >= num_slots_) return false;
+        return packed::load_atomic(data_, slot) == truncate_fp(hk);
+    }
+
+    /// Zero `slot`'s fingerprint if it is the key's, and say whether it was.
+    /// The write is packed_value_array::store_atomic(), so verify_atomic()
+    /// may run on other threads meanwhile; a reader racing the erase sees
+    /// the key present or absent.
+    bool erase(std::string_view key, size_t slot) noexcept requires concurrent_erase {
+        if (!verify_atomic(key, slot)) return false;
+        packed::store_atomic(data_, slot, 0);
+        return true;
+    }
+
+    bool erase(const hashed_key& hk, size_t slot) noexcept requires concurrent_erase {
+        if (!verify_atomic(hk, slot)) return false;
+        packed::store_atomic(data_, slot, 0);
+        return true;
+    }
+
+    /// Address of the word holding `slot`'s fingerprint, for prefetching.
+    [[nodiscard]] const void* address(size_t slot) const noexcept {
+        return data_.data() + (slot < num_slots_ ? slot * FingerprintBits / 64 : 0);
+    }
+
+    /// out[i] = verify(hks[i], slots[i]); the stored fingerprints are read
+    /// with packed_value_array::extract_batch().
+    void verify_batch(std::span<const hashed_key> hks, std::span<const size_t> slots,
+                      std::span<bool> out) const noexcept {
+        constexpr size_t BW = 64;
+        const size_t n = std::min({hks.size(), slots.size(), out.size()});
+        if (num_slots_ == 0) {
+            std::fill_n(out.begin(), n, false);
+            return;
+        }
+        size_t in_range[BW];
+        typename packed::value_type stored[BW];
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                in_range[i] = slots[base + i] < num_slots_ ? slots[base + i] : 0;
+            }
+            packed::extract_batch(data_, std::span<const size_t>{in_range, m}, stored);
+            for (size_t i = 0; i < m; ++i) {
+                out[base + i] = slots[base + i] < num_slots_
+                             && stored[i] == truncate_fp(hks[base + i]);
+            }
+        }
+    }
+
     [[nodiscard]] double bits_per_key(size_t key_count) const noexcept {
         return key_count > 0 ? static_cast<double>(FingerprintBits) : 0.0;
     }
@@ -105,13 +193,17 @@ public:
         return data_.size() * sizeof(uint64_t);
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return detail::allocated_bytes(data_); }
+
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
         auto append = [&](const auto& val) {
             auto bytes = std::bit_cast<std::array<std::byte, sizeof(val)>>(val);
             out.insert(out.end(), bytes.begin(), bytes.end());
         };
-        append(static_cast<uint32_t>(FingerprintBits));
+        uint32_t width = FingerprintBits;
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        append(width);
         append(static_cast<uint64_t>(num_slots_));
         append(static_cast<uint64_t>(data_.size()));
         for (auto w : data_) append(w);
@@ -127,12 +219,13 @@ public:
             return true;
         };
         uint32_t fp_bits{}; uint64_t slots{}; uint64_t words{};
-        if (!read(fp_bits) || fp_bits != FingerprintBits) return std::nullopt;
+        if (!read(fp_bits) || (fp_bits & ~WIDE_HASH_FLAG) != FingerprintBits) return std::nullopt;
         if (!read(slots) || !read(words)) return std::nullopt;
         if (words > (bytes.size() - off) / sizeof(uint64_t)) return std::nullopt;
 
         packed_fingerprint_array r;
         r.num_slots_ = static_cast<size_t>(slots);
+        r.hash_rev_ = (fp_bits & WIDE_HASH_FLAG) ? hash_revision::wide : hash_revision::fnv1a;
         r.data_.resize(static_cast<size_t>(words));
         for (auto& w : r.data_) { if (!read(w)) return std::nullopt; }
         return r;
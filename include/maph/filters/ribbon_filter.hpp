@@ -10,15 +10,24 @@
  *
  * Uses a banded matrix with bandwidth w=64. Construction: sort rows by
  * start position, forward Gaussian elimination, back-substitution.
+ *
+ * Layout picks the solution storage (ribbon_solution.hpp): flat_solution
+ * keeps one fingerprint per row and XORs the rows under the set
+ * coefficient bits; interleaved_solution keeps FingerprintBits column
+ * words per 64 rows and answers with that many popcount parities.
  */
 
 #pragma once
 
 #include "../core.hpp"
 #include "../detail/fingerprint_hash.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/ribbon_solution.hpp"
+#include "../detail/serialization.hpp"
 #include <algorithm>
 #include <array>
 #include <bit>
+#include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <optional>
@@ -36,19 +45,23 @@ namespace maph {
  * @brief Homogeneous ribbon retrieval for membership testing
  *
  * @tparam FingerprintBits Width of stored fingerprint (8, 16, or 32)
+ * @tparam Layout flat_solution or interleaved_solution
  */
-template<unsigned FingerprintBits>
+template<unsigned FingerprintBits, ribbon_solution_layout Layout = flat_solution>
     requires (FingerprintBits == 8 || FingerprintBits == 16 || FingerprintBits == 32)
 class ribbon_filter {
     using fp_type = std::conditional_t<FingerprintBits <= 8, uint8_t,
                     std::conditional_t<FingerprintBits <= 16, uint16_t, uint32_t>>;
+    template<typename L>
+    using table_for = typename L::template table<fp_type, FingerprintBits, detail::owned_array>;
 
     static constexpr uint64_t fp_mask = (1ULL << FingerprintBits) - 1;
     static constexpr size_t W = 64;  // Band width = machine word
 
-    std::vector<fp_type> solution_;  // One fp_type per row
+    table_for<Layout> solution_;
     size_t num_rows_{0};
     uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
     // Each key produces a row: starting position, 64-bit coefficients, desired result
     struct row {
@@ -57,8 +70,14 @@ class ribbon_filter {
         fp_type result;
     };
 
-    row make_row(std::string_view key) const noexcept {
-        uint64_t h = membership_fingerprint(key) ^ seed_;
+    template<typename Key>
+    row make_row(const Key& key) const noexcept {
+        return make_row_from(membership_fingerprint(key, hash_rev_));
+    }
+
+    // The row of a key whose seedless fingerprint hash is `base`.
+    row make_row_from(uint64_t base) const noexcept {
+        uint64_t h = base ^ seed_;
 
         size_t start = 0;
         if (num_rows_ > W) {
@@ -80,25 +99,34 @@ class ribbon_filter {
 
     // Query: compute XOR of solution[start+i] for each set bit i in coeffs
     fp_type query_row(const row& r) const noexcept {
-        fp_type result = 0;
-        uint64_t c = r.coeffs;
-        size_t base = r.start;
-        while (c != 0) {
-            size_t bit = static_cast<size_t>(std::countr_zero(c));  // Lowest set bit
-            result ^= solution_[base + bit];
-            c &= c - 1;  // Clear lowest set bit
-        }
-        return result;
+        return solution_.query(r.start, r.coeffs);
     }
 
 public:
+    static constexpr unsigned fingerprint_bits_v = FingerprintBits;
+
     ribbon_filter() = default;
 
     bool build(const std::vector<std::string>& keys) {
+        return build(std::span<const std::string>{keys});
+    }
+
+    // Keys are only read during the call; string_view and integer
+    // key spans work too.
+    template<typename Key>
+        requires key_like<Key>
+    bool build(std::span<const Key> keys) {
         if (keys.empty()) return false;
         size_t n = keys.size();
+        hash_rev_ = hash_revision::wide;
         std::mt19937_64 rng{42};
 
+        // Seedless key hashes, computed once for every attempt.
+        std::vector<uint64_t> hashes(n);
+        detail::for_each_digest(keys, 0, n, [&](size_t i, const hash128& d) {
+            hashes[i] = membership_fingerprint(d);
+        });
+
         for (int attempt = 0; attempt < 50; ++attempt) {
             seed_ = rng();
             num_rows_ = n + std::max(size_t{W}, static_cast<size_t>(n * 0.08));
@@ -106,7 +134,7 @@ public:
             // Build rows, sorted by start position
             std::vector<row> rows(n);
             for (size_t i = 0; i < n; ++i) {
-                rows[i] = make_row(keys[i]);
+                rows[i] = make_row_from(hashes[i]);
             }
             std::sort(rows.begin(), rows.end(),
                       [](const row& a, const row& b) { return a.start < b.start; });
@@ -146,7 +174,7 @@ public:
             if (!ok) continue;
 
             // Back-substitution
-            solution_.assign(num_rows_, 0);
+            std::vector<fp_type> solution(num_rows_, 0);
             for (size_t col = num_rows_; col-- > 0;) {
                 if (pivot_coeffs[col] == 0) continue;  // Free variable
 
@@ -162,22 +190,24 @@ public:
                     size_t bit = static_cast<size_t>(std::countr_zero(rest));
                     size_t ref = col + offset + bit;
                     if (ref < num_rows_) {
-                        val ^= solution_[ref];
+                        val ^= solution[ref];
                     }
                     rest >>= (bit + 1);
                     offset += bit + 1;
                 }
-                solution_[col] = val;
+                solution[col] = val;
             }
+            solution_ = table_for<Layout>{std::move(solution)};
 
             // Verify all keys
             bool verified = true;
             for (size_t i = 0; i < n; ++i) {
-                auto r = make_row(keys[i]);
+                auto r = make_row_from(hashes[i]);
                 if (query_row(r) != r.result) { verified = false; break; }
             }
             if (verified) return true;
         }
+        solution_ = {};
         return false;
     }
 
@@ -187,46 +217,94 @@ public:
         return query_row(r) == r.result;
     }
 
+    [[nodiscard]] bool verify(const hashed_key& hk) const noexcept {
+        if (solution_.empty()) return false;
+        auto r = make_row(hk);
+        return query_row(r) == r.result;
+    }
+
+    template<integer_key K>
+    [[nodiscard]] bool verify(K key) const noexcept {
+        return verify(hashed_key{key});
+    }
+
+    /// Prefetch the first and last solution entries of hk's row.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (solution_.empty()) return;
+        auto r = make_row(hk);
+        detail::prefetch_read(solution_.address(r.start));
+        detail::prefetch_read(solution_.address(std::min(r.start + W - 1, num_rows_ - 1)));
+    }
+
+    // Batched verify(): hash a window of keys and prefetch the first and
+    // last solution entries of each row before XORing any of them.
+    void verify_batch(std::span<const std::string_view> keys, std::span<bool> out) const noexcept {
+        constexpr size_t BW = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (solution_.empty()) {
+            std::fill_n(out.begin(), n, false);
+            return;
+        }
+        row rows[BW];
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                rows[i] = make_row(keys[base + i]);
+                const size_t last = std::min(rows[i].start + W - 1, num_rows_ - 1);
+                detail::prefetch_read(solution_.address(rows[i].start));
+                detail::prefetch_read(solution_.address(last));
+            }
+            for (size_t i = 0; i < m; ++i) out[base + i] = query_row(rows[i]) == rows[i].result;
+        }
+    }
+
     [[nodiscard]] double bits_per_key(size_t key_count) const noexcept {
-        return key_count > 0 ? static_cast<double>(solution_.size() * FingerprintBits) / key_count : 0.0;
+        if (key_count == 0 || solution_.empty()) return 0.0;
+        return static_cast<double>(num_rows_ * FingerprintBits) / static_cast<double>(key_count);
     }
 
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        return solution_.size() * sizeof(fp_type);
+        return solution_.memory_bytes();
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return solution_.heap_bytes(); }
+
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        auto append = [&](const auto& val) {
-            auto bytes = std::bit_cast<std::array<std::byte, sizeof(val)>>(val);
-            out.insert(out.end(), bytes.begin(), bytes.end());
-        };
-        append(static_cast<uint32_t>(FingerprintBits));
-        append(seed_);
-        append(static_cast<uint64_t>(num_rows_));
-        append(static_cast<uint64_t>(solution_.size()));
-        for (auto v : solution_) append(v);
+        uint32_t width = FingerprintBits | Layout::layout_flag;
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        phf_serial::append(out, width);
+        phf_serial::append(out, seed_);
+        phf_serial::append(out, static_cast<uint64_t>(num_rows_));
+        solution_.serialize(out);
         return out;
     }
 
+    /// Loads blobs of either solution layout; the other one is converted.
     [[nodiscard]] static std::optional<ribbon_filter> deserialize(std::span<const std::byte> bytes) {
-        size_t off = 0;
-        auto read = [&](auto& val) -> bool {
-            if (off + sizeof(val) > bytes.size()) return false;
-            std::memcpy(&val, bytes.data() + off, sizeof(val));
-            off += sizeof(val);
-            return true;
-        };
-        uint32_t fp_bits{}; uint64_t seed{}, nrows{}, sol_size{};
-        if (!read(fp_bits) || fp_bits != FingerprintBits) return std::nullopt;
-        if (!read(seed) || !read(nrows) || !read(sol_size)) return std::nullopt;
-        if (sol_size > (bytes.size() - off) / sizeof(fp_type)) return std::nullopt;
+        phf_serial::reader rd{bytes};
+        uint32_t fp_bits{}; uint64_t seed{}, nrows{};
+        if (!rd.read(fp_bits) ||
+            (fp_bits & ~(WIDE_HASH_FLAG | INTERLEAVED_SOLUTION_FLAG)) != FingerprintBits) {
+            return std::nullopt;
+        }
+        if (!rd.read(seed) || !rd.read(nrows)) return std::nullopt;
 
         ribbon_filter r;
         r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_width_field(fp_bits);
         r.num_rows_ = static_cast<size_t>(nrows);
-        r.solution_.resize(static_cast<size_t>(sol_size));
-        for (auto& v : r.solution_) { if (!read(v)) return std::nullopt; }
+        if ((fp_bits & INTERLEAVED_SOLUTION_FLAG) == Layout::layout_flag) {
+            if (!r.solution_.deserialize(rd, r.num_rows_)) return std::nullopt;
+        } else {
+            using other = std::conditional_t<std::same_as<Layout, flat_solution>,
+                                             interleaved_solution, flat_solution>;
+            table_for<other> stored;
+            if (!stored.deserialize(rd, r.num_rows_)) return std::nullopt;
+            if (!stored.empty()) r.solution_ = table_for<Layout>{stored.rows(r.num_rows_)};
+        }
+        // A query window reads rows [start, start + W).
+        if (!r.solution_.empty() && r.num_rows_ < W) return std::nullopt;
         return r;
     }
 };
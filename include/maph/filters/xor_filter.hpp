@@ -5,23 +5,36 @@
  * Restored from git history (removed in commit d805e47).
  *
  * Space: ~1.23 * FingerprintBits bits per key.
- * Query: 3 memory accesses + XOR + compare.
+ * Query: 3 memory accesses + XOR + compare; verify_batch() prefetches a
+ *        window of keys and gathers the three reads.
  * FP rate: 2^-FingerprintBits.
  *
- * Construction uses the "peeling" algorithm on a 3-partite hypergraph.
- * Retries with a new seed if peeling fails (~3% per attempt).
+ * Construction uses the "peeling" algorithm on a 3-partite hypergraph
+ * (detail/peeling.hpp), optionally multi-threaded. Retries with a new seed
+ * if peeling fails (~3% per attempt).
+ *
+ * The fingerprint table lives in Storage's array: heap_storage, or a
+ * mapped_storage for huge pages and NUMA placement (page_allocator.hpp).
  */
 
 #pragma once
 
 #include "../core.hpp"
+#include "../detail/container.hpp"
 #include "../detail/fingerprint_hash.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/page_allocator.hpp"
+#include "../detail/peeling.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/xor_gather.hpp"
 #include <algorithm>
 #include <array>
 #include <bit>
 #include <cmath>
+#include <concepts>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <optional>
 #include <random>
 #include <span>
@@ -32,13 +45,18 @@
 
 namespace maph {
 
+template<unsigned FingerprintBits>
+    requires (FingerprintBits == 8 || FingerprintBits == 16 || FingerprintBits == 32)
+class xor_plus_filter;
+
 /**
  * @class xor_filter
  * @brief 3-wise xor filter for membership testing
  *
  * @tparam FingerprintBits Width of each fingerprint (8, 16, or 32)
+ * @tparam Storage         Array storage for the table (default heap_storage)
  */
-template<unsigned FingerprintBits>
+template<unsigned FingerprintBits, storage_policy Storage = heap_storage>
     requires (FingerprintBits == 8 || FingerprintBits == 16 || FingerprintBits == 32)
 class xor_filter {
     using fp_type = std::conditional_t<FingerprintBits <= 8, uint8_t,
@@ -46,18 +64,22 @@ class xor_filter {
 
     static constexpr uint64_t fp_mask = (1ULL << FingerprintBits) - 1;
 
-    std::vector<fp_type> table_;
+    typename Storage::template array<fp_type> table_;
     size_t segment_size_{0};
     uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
 
     struct key_hashes {
         size_t h0, h1, h2;
         fp_type fingerprint;
     };
 
-    key_hashes hash_key(std::string_view key) const noexcept {
-        uint64_t h = membership_fingerprint(key) ^ seed_;
+    template<typename Key>
+    key_hashes hash_key(const Key& key) const noexcept {
+        return hash_seeded(membership_fingerprint(key, hash_rev_) ^ seed_);
+    }
 
+    static uint64_t second_hash(uint64_t h) noexcept {
         // Second independent hash via additional mixing
         uint64_t h2 = h;
         h2 ^= h2 >> 33;
@@ -65,87 +87,92 @@ class xor_filter {
         h2 ^= h2 >> 33;
         h2 *= 0xc4ceb9fe1a85ec53ULL;
         h2 ^= h2 >> 33;
+        return h2;
+    }
 
-        auto fp = static_cast<fp_type>(h2 & fp_mask);
+    static fp_type fingerprint_of(uint64_t h) noexcept {
+        auto fp = static_cast<fp_type>(second_hash(h) & fp_mask);
         if (fp == 0) fp = 1;  // Non-zero fingerprint for correctness
+        return fp;
+    }
 
+    key_hashes hash_seeded(uint64_t h) const noexcept {
+        return hash_seeded(h, segment_size_);
+    }
+
+    static key_hashes hash_seeded(uint64_t h, size_t segment_size) noexcept {
+        uint64_t h2 = second_hash(h);
         return {
-            static_cast<size_t>(h % segment_size_),
-            static_cast<size_t>((h >> 21) % segment_size_) + segment_size_,
-            static_cast<size_t>((h2 >> 11) % segment_size_) + 2 * segment_size_,
-            fp
+            static_cast<size_t>(h % segment_size),
+            static_cast<size_t>((h >> 21) % segment_size) + segment_size,
+            static_cast<size_t>((h2 >> 11) % segment_size) + 2 * segment_size,
+            fingerprint_of(h)
         };
     }
 
+    // Builds through xor_filter and keeps its hashing.
+    template<unsigned B>
+        requires (B == 8 || B == 16 || B == 32)
+    friend class xor_plus_filter;
+
 public:
+    static constexpr unsigned fingerprint_bits_v = FingerprintBits;
+
     xor_filter() = default;
 
-    bool build(const std::vector<std::string>& keys) {
+    bool build(const std::vector<std::string>& keys, size_t threads = 1) {
+        return build(std::span<const std::string>{keys}, threads);
+    }
+
+    // Keys are only read during the call; string_view and integer
+    // key spans work too.
+    // `threads` hashes and groups the keys in parallel (see peeling.hpp);
+    // the filter is the same for every thread count. Duplicate keys are
+    // allowed.
+    template<typename Key>
+        requires key_like<Key>
+    bool build(std::span<const Key> keys, size_t threads = 1) {
         if (keys.empty()) return false;
 
         size_t n = keys.size();
         segment_size_ = std::max(size_t{4}, static_cast<size_t>(std::ceil(n * 1.23 / 3.0)));
         size_t table_size = 3 * segment_size_;
 
-        std::mt19937_64 rng{42};
+        hash_rev_ = hash_revision::wide;
+
+        // Seedless key hashes, computed once for every attempt.
+        std::vector<uint64_t> base(n);
+        detail::parallel_chunks(n, detail::effective_threads(n, threads),
+            [&](size_t, size_t lo, size_t hi) {
+                detail::for_each_digest(keys, lo, hi, [&](size_t i, const hash128& d) {
+                    base[i] = membership_fingerprint(d);
+                });
+            });
+
+        // The three slots are independent, so blocks follow the first one;
+        // that segment is then updated left to right.
+        const size_t blocks = std::clamp<size_t>(n / 256, 1, size_t{1} << 16);
+        auto block_of = [this, blocks](uint64_t h) {
+            return static_cast<size_t>((h % segment_size_) * blocks / segment_size_);
+        };
+        auto slots = [this](uint64_t h) {
+            key_hashes kh = hash_seeded(h);
+            return std::array<size_t, 3>{kh.h0, kh.h1, kh.h2};
+        };
 
+        std::mt19937_64 rng{42};
+        detail::peel_order order;
         for (int attempt = 0; attempt < 100; ++attempt) {
             seed_ = rng();
-            table_.assign(table_size, 0);
-
-            // Compute hashes and build degree/xor tracking
-            std::vector<int32_t> degree(table_size, 0);
-            std::vector<uint64_t> deg_xor(table_size, 0);
-            std::vector<key_hashes> hashes(n);
-
-            for (size_t i = 0; i < n; ++i) {
-                hashes[i] = hash_key(keys[i]);
-                degree[hashes[i].h0]++;
-                degree[hashes[i].h1]++;
-                degree[hashes[i].h2]++;
-                deg_xor[hashes[i].h0] ^= i;
-                deg_xor[hashes[i].h1] ^= i;
-                deg_xor[hashes[i].h2] ^= i;
-            }
-
-            // Peeling: repeatedly remove degree-1 slots
-            struct peel_entry { size_t key_idx; size_t slot; };
-            std::vector<peel_entry> stack;
-            stack.reserve(n);
-
-            std::vector<size_t> queue;
-            for (size_t i = 0; i < table_size; ++i) {
-                if (degree[i] == 1) queue.push_back(i);
-            }
-
-            while (!queue.empty()) {
-                size_t pos = queue.back();
-                queue.pop_back();
-                if (degree[pos] != 1) continue;
-
-                size_t ki = static_cast<size_t>(deg_xor[pos]);
-                if (ki >= n) continue;
-
-                stack.push_back({ki, pos});
-
-                const auto& kh = hashes[ki];
-                for (size_t slot : {kh.h0, kh.h1, kh.h2}) {
-                    degree[slot]--;
-                    deg_xor[slot] ^= ki;
-                    if (degree[slot] == 1) queue.push_back(slot);
-                }
-            }
-
-            if (stack.size() != n) continue;  // Peeling failed, retry
+            auto hs = detail::seeded_hashes_by_block(base, seed_, blocks, block_of, threads);
+            if (!detail::peel3(hs, table_size, slots, order)) continue;
 
             // Assign values in reverse peel order
-            for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
-                const auto& kh = hashes[it->key_idx];
-                fp_type val = kh.fingerprint ^ table_[kh.h0] ^ table_[kh.h1] ^ table_[kh.h2];
-                table_[it->slot] = val;
-            }
+            table_.assign(table_size, 0);
+            detail::assign3(order, table_, slots, &fingerprint_of);
             return true;
         }
+        table_.clear();
         return false;
     }
 
@@ -155,6 +182,60 @@ public:
         return (table_[kh.h0] ^ table_[kh.h1] ^ table_[kh.h2]) == kh.fingerprint;
     }
 
+    [[nodiscard]] bool verify(const hashed_key& hk) const noexcept {
+        if (table_.empty()) return false;
+        auto kh = hash_key(hk);
+        return (table_[kh.h0] ^ table_[kh.h1] ^ table_[kh.h2]) == kh.fingerprint;
+    }
+
+    template<integer_key K>
+    [[nodiscard]] bool verify(K key) const noexcept {
+        return verify(hashed_key{key});
+    }
+
+    /// Prefetch the three slots verify(hk) reads.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (table_.empty()) return;
+        auto kh = hash_key(hk);
+        detail::prefetch_read(&table_[kh.h0]);
+        detail::prefetch_read(&table_[kh.h1]);
+        detail::prefetch_read(&table_[kh.h2]);
+    }
+
+    // Batched verify(): hash a window of keys, prefetch their three slots,
+    // then check the window with vector gathers (see xor_gather.hpp).
+    // Processes min(keys.size(), out.size()) keys.
+    void verify_batch(std::span<const std::string_view> keys, std::span<bool> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (table_.empty()) {
+            std::fill_n(out.begin(), n, false);
+            return;
+        }
+        // Gather indices are 32-bit; larger tables take the scalar path.
+        if (table_.size() > std::numeric_limits<uint32_t>::max()) {
+            for (size_t i = 0; i < n; ++i) out[i] = verify(keys[i]);
+            return;
+        }
+        uint32_t i0[W], i1[W], i2[W];
+        fp_type fps[W];
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                key_hashes kh = hash_key(keys[base + i]);
+                i0[i] = static_cast<uint32_t>(kh.h0);
+                i1[i] = static_cast<uint32_t>(kh.h1);
+                i2[i] = static_cast<uint32_t>(kh.h2);
+                fps[i] = kh.fingerprint;
+                detail::prefetch_read(&table_[kh.h0]);
+                detail::prefetch_read(&table_[kh.h1]);
+                detail::prefetch_read(&table_[kh.h2]);
+            }
+            detail::xor3_match(table_.data(), table_.size(), i0, i1, i2, fps, m,
+                               out.data() + base);
+        }
+    }
+
     [[nodiscard]] double bits_per_key(size_t key_count) const noexcept {
         return key_count > 0 ? static_cast<double>(table_.size() * FingerprintBits) / key_count : 0.0;
     }
@@ -163,13 +244,19 @@ public:
         return table_.size() * sizeof(fp_type);
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return detail::allocated_bytes(table_); }
+
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
+        out.reserve(sizeof(uint32_t) + 3 * sizeof(uint64_t) + table_.size() * sizeof(fp_type));
         auto append = [&](const auto& val) {
-            auto bytes = std::bit_cast<std::array<std::byte, sizeof(val)>>(val);
-            out.insert(out.end(), bytes.begin(), bytes.end());
+            const size_t at = out.size();
+            out.resize(at + sizeof(val));
+            std::memcpy(out.data() + at, &val, sizeof(val));
         };
-        append(static_cast<uint32_t>(FingerprintBits));
+        uint32_t width = FingerprintBits;
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        append(width);
         append(seed_);
         append(static_cast<uint64_t>(segment_size_));
         append(static_cast<uint64_t>(table_.size()));
@@ -186,17 +273,53 @@ public:
             return true;
         };
         uint32_t fp_bits{}; uint64_t seed{}, seg{}, tsize{};
-        if (!read(fp_bits) || fp_bits != FingerprintBits) return std::nullopt;
+        if (!read(fp_bits) || (fp_bits & ~WIDE_HASH_FLAG) != FingerprintBits) return std::nullopt;
         if (!read(seed) || !read(seg) || !read(tsize)) return std::nullopt;
         if (tsize > (bytes.size() - off) / sizeof(fp_type)) return std::nullopt;
 
         xor_filter r;
         r.seed_ = seed;
+        r.hash_rev_ = (fp_bits & WIDE_HASH_FLAG) ? hash_revision::wide : hash_revision::fnv1a;
         r.segment_size_ = static_cast<size_t>(seg);
         r.table_.resize(static_cast<size_t>(tsize));
         for (auto& v : r.table_) { if (!read(v)) return std::nullopt; }
         return r;
     }
+
+    /// Container sections: meta (width field, seed, segment size) and the
+    /// table as a fingerprints array.
+    void write_sections(container_writer& w) const {
+        std::vector<std::byte> meta;
+        uint32_t width = FingerprintBits;
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        phf_serial::append(meta, width);
+        phf_serial::append(meta, seed_);
+        phf_serial::append(meta, static_cast<uint64_t>(segment_size_));
+        w.add(section_tag::meta, std::move(meta));
+        w.add_array(section_tag::fingerprints, 0,
+                    std::span<const fp_type>(table_.data(), table_.size()));
+    }
+
+    [[nodiscard]] static result<xor_filter> read_sections(const container_view& v) {
+        auto meta = v.checked(section_tag::meta);
+        if (!meta) return std::unexpected(meta.error());
+        phf_serial::reader rd(*meta);
+        uint32_t fp_bits{}; uint64_t seed{}, seg{};
+        if (!rd.read(fp_bits) || (fp_bits & ~WIDE_HASH_FLAG) != FingerprintBits
+            || !rd.read(seed) || !rd.read(seg)) {
+            return std::unexpected(error::invalid_format);
+        }
+        auto table = v.array<fp_type>(section_tag::fingerprints);
+        if (!table) return std::unexpected(table.error());
+
+        xor_filter r;
+        r.seed_ = seed;
+        r.hash_rev_ = phf_serial::revision_for_width_field(fp_bits);
+        r.segment_size_ = static_cast<size_t>(seg);
+        r.table_.resize(table->size());
+        std::copy(table->begin(), table->end(), r.table_.begin());
+        return r;
+    }
 };
 
 } // namespace maph
@@ -0,0 +1,278 @@
+/**
+ * @file xor_plus_filter.hpp
+ * @brief xor+ filter: an xor_filter with its empty slots dropped.
+ *
+ * Graf and Lemire's xor+ variant ("Xor Filters: Faster and Smaller Than
+ * Bloom and Cuckoo Filters", JEA 2020).
+ * A peeled xor filter owns one slot per key, so of its ~1.23 n slots
+ * about 0.23 n are never assigned and stay zero; together with the
+ * owned slots that happen to solve to zero, ~19% of the table is empty.
+ * xor_plus_filter builds an xor_filter<M>, then keeps only the nonzero
+ * slots, densely, behind a rank_bitvector that marks which slots they
+ * were. A query reads each of its three slots as values[rank(pos)] if
+ * the bit is set and 0 otherwise, so answers match the xor_filter's
+ * exactly.
+ *
+ * Space:   ~M + 1.41 bits per key (M bits per kept slot plus the 1.14
+ *          bits per slot of the rank bit vector): ~17.4 at M = 16
+ *          against ~19.7 for xor_filter<16>, ~9.4 against ~9.8 at M = 8.
+ * Query:   three rank lookups (one cache line each) then three value
+ *          reads, twice the memory reads of xor_filter; verify_batch()
+ *          prefetches both rounds over a window of keys.
+ * FPR:     2^-M, as xor_filter.
+ * Build:   xor_filter's (peeling, optionally multi-threaded) plus one
+ *          pass over the table.
+ */
+
+#pragma once
+
+#include "../core.hpp"
+#include "../detail/container.hpp"
+#include "../detail/fingerprint_hash.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/rank_bitvector.hpp"
+#include "../detail/serialization.hpp"
+#include "xor_filter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace maph {
+
+/// Set in xor_plus_filter's width field, so an xor_filter never loads an
+/// xor+ blob or the reverse.
+inline constexpr uint32_t XOR_PLUS_FLAG = 1u << 20;
+
+/**
+ * @class xor_plus_filter
+ * @brief Rank-compressed 3-wise xor filter for membership testing
+ *
+ * @tparam FingerprintBits Width of each fingerprint (8, 16, or 32)
+ */
+template<unsigned FingerprintBits>
+    requires (FingerprintBits == 8 || FingerprintBits == 16 || FingerprintBits == 32)
+class xor_plus_filter {
+    using base_filter = xor_filter<FingerprintBits>;
+    using fp_type = typename base_filter::fp_type;
+
+    static constexpr uint32_t width_field = FingerprintBits | WIDE_HASH_FLAG | XOR_PLUS_FLAG;
+
+    detail::rank_bitvector occupied_{};
+    std::vector<fp_type> values_{};
+    size_t segment_size_{0};
+    uint64_t seed_{0};
+
+    template<typename Key>
+    auto hash_key(const Key& key) const noexcept {
+        return base_filter::hash_seeded(
+            membership_fingerprint(key, hash_revision::wide) ^ seed_, segment_size_);
+    }
+
+    fp_type slot(size_t pos) const noexcept {
+        auto r = occupied_.rank_if_set(pos);
+        return r ? values_[static_cast<size_t>(*r)] : fp_type{0};
+    }
+
+    template<typename Key>
+    bool check(const Key& key) const noexcept {
+        auto kh = hash_key(key);
+        return static_cast<fp_type>(slot(kh.h0) ^ slot(kh.h1) ^ slot(kh.h2)) == kh.fingerprint;
+    }
+
+    /// Take the nonzero slots of `table` and mark them in occupied_.
+    template<typename Table>
+    void compress(const Table& table) {
+        std::vector<uint64_t> words((table.size() + 63) / 64, 0);
+        size_t kept = 0;
+        for (size_t i = 0; i < table.size(); ++i) {
+            if (table[i] != 0) {
+                words[i / 64] |= uint64_t{1} << (i % 64);
+                ++kept;
+            }
+        }
+        values_.clear();
+        values_.reserve(kept);
+        for (size_t i = 0; i < table.size(); ++i) {
+            if (table[i] != 0) values_.push_back(table[i]);
+        }
+        occupied_ = detail::rank_bitvector(words, table.size());
+    }
+
+    /// The table has three segments; the rank bits and values must agree.
+    [[nodiscard]] bool consistent() const noexcept {
+        return occupied_.size() == 3 * static_cast<uint64_t>(segment_size_)
+            && occupied_.count() == values_.size();
+    }
+
+public:
+    static constexpr unsigned fingerprint_bits_v = FingerprintBits;
+
+    xor_plus_filter() = default;
+
+    bool build(const std::vector<std::string>& keys, size_t threads = 1) {
+        return build(std::span<const std::string>{keys}, threads);
+    }
+
+    // Keys are only read during the call; string_view and integer key
+    // spans work too. Same filter for every thread count; duplicate keys
+    // are allowed.
+    template<typename Key>
+        requires key_like<Key>
+    bool build(std::span<const Key> keys, size_t threads = 1) {
+        base_filter full;
+        if (!full.build(keys, threads)) {
+            *this = xor_plus_filter{};
+            return false;
+        }
+        seed_ = full.seed_;
+        segment_size_ = full.segment_size_;
+        compress(full.table_);
+        return true;
+    }
+
+    [[nodiscard]] bool verify(std::string_view key) const noexcept {
+        if (segment_size_ == 0) return false;
+        return check(key);
+    }
+
+    [[nodiscard]] bool verify(const hashed_key& hk) const noexcept {
+        if (segment_size_ == 0) return false;
+        return check(hk);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] bool verify(K key) const noexcept {
+        return verify(hashed_key{key});
+    }
+
+    /// Prefetch the three rank blocks verify(hk) reads first.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (segment_size_ == 0) return;
+        auto kh = hash_key(hk);
+        detail::prefetch_read(occupied_.block_address(kh.h0));
+        detail::prefetch_read(occupied_.block_address(kh.h1));
+        detail::prefetch_read(occupied_.block_address(kh.h2));
+    }
+
+    // Batched verify(): hash a window of keys and prefetch their rank
+    // blocks, then rank each slot and prefetch its value, then compare.
+    // Processes min(keys.size(), out.size()) keys.
+    void verify_batch(std::span<const std::string_view> keys, std::span<bool> out) const noexcept {
+        constexpr size_t W = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        if (segment_size_ == 0) {
+            std::fill_n(out.begin(), n, false);
+            return;
+        }
+        // Per key and slot: the value index, or SIZE_MAX for an empty slot.
+        std::array<size_t, 3> at[W];
+        std::array<size_t, 3> pos[W];
+        fp_type fps[W];
+        for (size_t base = 0; base < n; base += W) {
+            const size_t m = std::min(W, n - base);
+            for (size_t i = 0; i < m; ++i) {
+                auto kh = hash_key(keys[base + i]);
+                pos[i] = {kh.h0, kh.h1, kh.h2};
+                fps[i] = kh.fingerprint;
+                for (size_t p : pos[i]) detail::prefetch_read(occupied_.block_address(p));
+            }
+            for (size_t i = 0; i < m; ++i) {
+                for (size_t j = 0; j < 3; ++j) {
+                    auto r = occupied_.rank_if_set(pos[i][j]);
+                    at[i][j] = r ? static_cast<size_t>(*r) : SIZE_MAX;
+                    if (r) detail::prefetch_read(&values_[at[i][j]]);
+                }
+            }
+            for (size_t i = 0; i < m; ++i) {
+                fp_type v = 0;
+                for (size_t a : at[i]) {
+                    if (a != SIZE_MAX) v = static_cast<fp_type>(v ^ values_[a]);
+                }
+                out[base + i] = v == fps[i];
+            }
+        }
+    }
+
+    [[nodiscard]] double bits_per_key(size_t key_count) const noexcept {
+        return key_count > 0 ? static_cast<double>(memory_bytes() * 8) / key_count : 0.0;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return occupied_.memory_bytes() + values_.size() * sizeof(fp_type);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return occupied_.heap_bytes() + detail::allocated_bytes(values_);
+    }
+
+    /// Slots of the uncompressed table, and how many of them are kept.
+    [[nodiscard]] size_t table_slots() const noexcept { return 3 * segment_size_; }
+    [[nodiscard]] size_t kept_slots() const noexcept { return values_.size(); }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        phf_serial::append(out, width_field);
+        phf_serial::append(out, seed_);
+        phf_serial::append(out, static_cast<uint64_t>(segment_size_));
+        occupied_.serialize(out);
+        phf_serial::append_vector(out, values_);
+        return out;
+    }
+
+    [[nodiscard]] static std::optional<xor_plus_filter> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint32_t width{};
+        uint64_t seed{}, seg{};
+        if (!r.read(width) || width != width_field) return std::nullopt;
+        if (!r.read(seed) || !r.read(seg)) return std::nullopt;
+
+        xor_plus_filter out;
+        out.seed_ = seed;
+        out.segment_size_ = static_cast<size_t>(seg);
+        if (!out.occupied_.deserialize(r) || !r.read_vector(out.values_)) return std::nullopt;
+        if (!out.consistent()) return std::nullopt;
+        return out;
+    }
+
+    /// Container sections: meta (width field, seed, segment size, rank
+    /// bits) and the kept slots as a fingerprints array.
+    void write_sections(container_writer& w) const {
+        std::vector<std::byte> meta;
+        phf_serial::append(meta, width_field);
+        phf_serial::append(meta, seed_);
+        phf_serial::append(meta, static_cast<uint64_t>(segment_size_));
+        occupied_.serialize(meta);
+        w.add(section_tag::meta, std::move(meta));
+        w.add_array(section_tag::fingerprints, 0, std::span<const fp_type>(values_));
+    }
+
+    [[nodiscard]] static result<xor_plus_filter> read_sections(const container_view& v) {
+        auto meta = v.checked(section_tag::meta);
+        if (!meta) return std::unexpected(meta.error());
+        phf_serial::reader rd(*meta);
+        uint32_t width{};
+        uint64_t seed{}, seg{};
+        xor_plus_filter out;
+        if (!rd.read(width) || width != width_field || !rd.read(seed) || !rd.read(seg)
+            || !out.occupied_.deserialize(rd)) {
+            return std::unexpected(error::invalid_format);
+        }
+        auto values = v.array<fp_type>(section_tag::fingerprints);
+        if (!values) return std::unexpected(values.error());
+
+        out.seed_ = seed;
+        out.segment_size_ = static_cast<size_t>(seg);
+        out.values_.assign(values->begin(), values->end());
+        if (!out.consistent()) return std::unexpected(error::invalid_format);
+        return out;
+    }
+};
+
+} // namespace maph
@@ -0,0 +1,407 @@
+/**
+ * @file compressed_retrieval.hpp
+ * @brief Compressed static function: prefix codewords in layered 1-bit ribbons.
+ *
+ * encoded_retrieval<ribbon_retrieval<M>, prefix_codec<V, M>> stores every
+ * value as a full M-bit pattern, so a column where one label covers 90%
+ * of the keys still costs ~1.04 * M bits per key. compressed_retrieval
+ * stores only each value's codeword, bit by bit: layer d is a
+ * ribbon_retrieval<1, interleaved_solution> over the keys whose codeword
+ * is longer than d, holding bit d of it. A query reads layer 0, 1, ...
+ * and stops as soon as the bits read form a codeword, which the
+ * prefix-free property makes unambiguous.
+ *
+ * Space:  ~1.04 * (mean codeword length) bits per key, i.e. within
+ *         ~1.04 * (H(values) + 1) for Huffman lengths, against
+ *         ~1.04 * M for a fixed-width ribbon. Every layer has at least
+ *         64 rows, so very small layers cost a little more.
+ * Query:  one key hash, then one 1-bit ribbon query per codeword bit;
+ *         keys with the dominant value stop after the first layer.
+ *         lookup_batch() prefetches each layer's window for the keys
+ *         still undecided before reading it.
+ * Build:  one digest per key, then one ribbon solve per layer over a
+ *         shrinking key set (total work ~ sum of codeword lengths).
+ *
+ * The codec is a prefix_codec<V, M>; builder() without one derives
+ * Huffman lengths from the value frequencies at build(), with the most
+ * frequent value as the default. Codewords are canonical, so the
+ * codewords of each length are a contiguous range and a prefix is
+ * resolved with one compare per layer.
+ *
+ * GIGO semantics: a key outside the build set reads layer bits until
+ * they spell a codeword, and gets the codec's default value if no
+ * codeword is complete after the last layer. As with encoded_retrieval,
+ * serialize() writes the layers only; deserialize() takes the codec back.
+ */
+
+#pragma once
+
+#include "../codecs/prefix_codec.hpp"
+#include "../concepts/retrieval.hpp"
+#include "../core.hpp"
+#include "../detail/hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
+#include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
+#include "ribbon_retrieval.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+template <typename V, unsigned M>
+    requires (M >= 1 && M <= 32)
+class compressed_retrieval {
+public:
+    using value_type = V;
+    using codec_type = prefix_codec<V, M>;
+    using layer_type = ribbon_retrieval<1, interleaved_solution>;
+
+    static constexpr unsigned value_bits_v = M;
+
+private:
+    // Canonical codewords of length d + 1 are [first, first + count),
+    // entries index .. index + count - 1 of the codec.
+    struct level {
+        uint32_t first{0};
+        uint32_t count{0};
+        uint32_t index{0};
+    };
+
+    std::vector<layer_type> layers_{};
+    std::array<level, M> levels_{};
+    codec_type codec_{};
+    size_t num_keys_{0};
+
+    void set_levels() {
+        levels_ = {};
+        const auto& entries = codec_.entries();
+        for (size_t i = 0; i < entries.size(); ++i) {
+            level& lv = levels_[entries[i].length - 1];
+            if (lv.count++ == 0) {
+                lv.first = entries[i].prefix_left_aligned >> (M - entries[i].length);
+                lv.index = static_cast<uint32_t>(i);
+            }
+        }
+    }
+
+    // The entry whose codeword is the (d + 1)-bit prefix `code`, or
+    // UINT32_MAX if that prefix is not a codeword.
+    [[nodiscard]] uint32_t resolve(size_t d, uint32_t code) const noexcept {
+        const level& lv = levels_[d];
+        return code - lv.first < lv.count ? lv.index + (code - lv.first) : UINT32_MAX;
+    }
+
+    // Codeword length of an encoded M-bit pattern: the first prefix that
+    // is a codeword, or M for a pattern in the codec's surplus.
+    [[nodiscard]] unsigned length_of(uint64_t pattern) const noexcept {
+        for (unsigned d = 0; d < M; ++d) {
+            if (resolve(d, static_cast<uint32_t>(pattern >> (M - 1 - d))) != UINT32_MAX) return d + 1;
+        }
+        return M;
+    }
+
+    [[nodiscard]] value_type decoded(uint32_t entry) const {
+        return entry == UINT32_MAX ? codec_.default_value() : codec_.entries()[entry].value;
+    }
+
+    [[nodiscard]] value_type walk(const hashed_key& hk) const {
+        uint32_t code = 0;
+        for (size_t d = 0; d < layers_.size(); ++d) {
+            code = (code << 1) | static_cast<uint32_t>(layers_[d].lookup(hk));
+            const uint32_t e = resolve(d, code);
+            if (e != UINT32_MAX) return decoded(e);
+        }
+        return codec_.default_value();
+    }
+
+    compressed_retrieval(std::vector<layer_type> layers, codec_type c, size_t num_keys)
+        : layers_(std::move(layers)), codec_(std::move(c)), num_keys_(num_keys) {
+        set_levels();
+    }
+
+public:
+    compressed_retrieval() = default;
+
+    [[nodiscard]] value_type lookup(std::string_view key) const {
+        return walk(hashed_key{key});
+    }
+
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const {
+        return walk(hk);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const {
+        return walk(hashed_key{key});
+    }
+
+    // Batched lookup(): hash a window of keys, then per layer prefetch
+    // the band of every key still undecided before reading any of them.
+    void lookup_batch(std::span<const std::string_view> keys, std::span<value_type> out) const {
+        constexpr size_t BW = detail::lookup_batch_window;
+        const size_t n = std::min(keys.size(), out.size());
+        hashed_key hks[BW];
+        uint32_t codes[BW];
+        uint32_t open[BW];
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            size_t live = m;
+            for (size_t i = 0; i < m; ++i) {
+                hks[i] = hashed_key{keys[base + i]};
+                codes[i] = 0;
+                open[i] = static_cast<uint32_t>(i);
+            }
+            for (size_t d = 0; d < layers_.size() && live > 0; ++d) {
+                for (size_t j = 0; j < live; ++j) layers_[d].prefetch(hks[open[j]]);
+                size_t still = 0;
+                for (size_t j = 0; j < live; ++j) {
+                    const uint32_t i = open[j];
+                    codes[i] = (codes[i] << 1) | static_cast<uint32_t>(layers_[d].lookup(hks[i]));
+                    const uint32_t e = resolve(d, codes[i]);
+                    if (e != UINT32_MAX) {
+                        out[base + i] = decoded(e);
+                    } else {
+                        open[still++] = i;
+                    }
+                }
+                live = still;
+            }
+            for (size_t j = 0; j < live; ++j) out[base + open[j]] = codec_.default_value();
+        }
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+    [[nodiscard]] size_t num_layers() const noexcept { return layers_.size(); }
+    [[nodiscard]] const layer_type& layer(size_t d) const noexcept { return layers_[d]; }
+
+    /// Mean codeword length over the build set: the bits per key the
+    /// layers store before ribbon overhead.
+    [[nodiscard]] double mean_code_length() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        size_t total = 0;
+        for (const auto& l : layers_) total += l.num_keys();
+        return static_cast<double>(total) / static_cast<double>(num_keys_);
+    }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0 / static_cast<double>(num_keys_);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        size_t bytes = 0;
+        for (const auto& l : layers_) bytes += l.memory_bytes();
+        return bytes;
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        size_t bytes = detail::allocated_bytes(layers_);
+        for (const auto& l : layers_) bytes += l.heap_bytes();
+        return bytes;
+    }
+
+    [[nodiscard]] const codec_type& encoder() const noexcept { return codec_; }
+
+    // Layers only: [u32 M][u64 num_keys][u32 layers], then each layer as
+    // [u64 size][ribbon_retrieval bytes]. The codec is the caller's to
+    // keep and pass back to deserialize().
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        std::vector<std::byte> out;
+        phf_serial::append(out, static_cast<uint32_t>(M));
+        phf_serial::append(out, static_cast<uint64_t>(num_keys_));
+        phf_serial::append(out, static_cast<uint32_t>(layers_.size()));
+        for (const auto& l : layers_) {
+            auto bytes = l.serialize();
+            phf_serial::append(out, static_cast<uint64_t>(bytes.size()));
+            out.insert(out.end(), bytes.begin(), bytes.end());
+        }
+        return out;
+    }
+
+    [[nodiscard]] static result<compressed_retrieval>
+    deserialize(std::span<const std::byte> bytes, codec_type c) {
+        phf_serial::reader r{bytes};
+        uint32_t width{}, count{};
+        uint64_t nkeys{};
+        if (!r.read(width) || width != M || !r.read(nkeys) || !r.read(count) || count > M) {
+            return std::unexpected(error::invalid_format);
+        }
+        std::vector<layer_type> layers;
+        layers.reserve(count);
+        for (uint32_t d = 0; d < count; ++d) {
+            uint64_t size{};
+            std::span<const std::byte> span;
+            if (!r.read(size) || !r.read_span(span, static_cast<size_t>(size))) {
+                return std::unexpected(error::invalid_format);
+            }
+            auto layer = layer_type::deserialize(span);
+            if (!layer) return std::unexpected(layer.error());
+            // Layer d holds the keys with codewords longer than d.
+            if (layer->num_keys() > (d == 0 ? nkeys : layers.back().num_keys())) {
+                return std::unexpected(error::invalid_format);
+            }
+            layers.push_back(std::move(*layer));
+        }
+        return compressed_retrieval{std::move(layers), std::move(c), static_cast<size_t>(nkeys)};
+    }
+
+    // ===== Builder =====
+    //
+    // Collects (key, value) pairs; the last of duplicate keys wins. With
+    // no codec given, build() runs Huffman over the value frequencies.
+
+    class builder {
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+        std::optional<codec_type> codec_{};
+        uint64_t seed_{42};
+        size_t threads_{1};
+        executor* executor_{nullptr};
+
+    public:
+        builder() = default;
+        explicit builder(codec_type c) : codec_(std::move(c)) {}
+
+        builder& add(std::string_view key, const value_type& v) {
+            keys_.add(key);
+            values_.push_back(v);
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        template<integer_key K>
+        builder& add(const K& key, const value_type& v) {
+            keys_.add(key);
+            values_.push_back(v);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string> keys, std::span<const value_type> values) {
+            const size_t n = std::min(keys.size(), values.size());
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            const size_t n = std::min(keys.size(), values.size());
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            const size_t n = std::min(keys.size(), values.size());
+            keys_.borrow_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& with_seed(uint64_t s) { seed_ = s; return *this; }
+        builder& with_threads(size_t n) { threads_ = n; return *this; }
+        // Hash keys and solve each layer's shards on a shared pool.
+        builder& with_executor(executor& ex) { executor_ = &ex; return *this; }
+
+        /// error::value_too_large if Huffman needs codewords longer than M.
+        [[nodiscard]] result<compressed_retrieval> build() {
+            const size_t n = keys_.size();
+            if (n == 0) return std::unexpected(error::optimization_failed);
+            detail::executor_scope scope{executor_};
+            const size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+
+            std::vector<hash128> digests(n);
+            detail::parallel_chunks(n, detail::effective_threads(n, nthreads),
+                [&](size_t, size_t lo, size_t hi) {
+                    phf_hash128_batch(keys_.views().subspan(lo, hi - lo),
+                                      std::span<hash128>(digests).subspan(lo, hi - lo));
+                });
+
+            // Keep the last occurrence of each digest, in insertion order.
+            std::vector<size_t> order(n);
+            std::iota(order.begin(), order.end(), size_t{0});
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                return digests[a].hi != digests[b].hi ? digests[a].hi < digests[b].hi
+                                                      : digests[a].lo < digests[b].lo;
+            });
+            std::vector<size_t> kept;
+            kept.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                if (i + 1 == n || !(digests[order[i]] == digests[order[i + 1]])) {
+                    kept.push_back(order[i]);
+                }
+            }
+            std::sort(kept.begin(), kept.end());
+
+            if (!codec_) {
+                std::unordered_map<value_type, size_t> counts;
+                for (size_t i : kept) ++counts[values_[i]];
+                std::vector<std::pair<value_type, double>> freqs;
+                freqs.reserve(counts.size());
+                for (const auto& [v, c] : counts) freqs.emplace_back(v, static_cast<double>(c));
+                std::sort(freqs.begin(), freqs.end(),
+                          [](const auto& a, const auto& b) { return a.first < b.first; });
+                const auto top = std::max_element(freqs.begin(), freqs.end(),
+                    [](const auto& a, const auto& b) { return a.second < b.second; });
+                try {
+                    codec_ = codec_type::from_frequencies(freqs, top->first);
+                } catch (const std::invalid_argument&) {
+                    return std::unexpected(error::value_too_large);
+                }
+            }
+
+            compressed_retrieval out{{}, *codec_, kept.size()};
+            std::vector<uint32_t> patterns(kept.size());
+            std::vector<uint8_t> lengths(kept.size());
+            unsigned depth = 0;
+            for (size_t j = 0; j < kept.size(); ++j) {
+                patterns[j] = static_cast<uint32_t>(out.codec_.encode(values_[kept[j]]));
+                lengths[j] = static_cast<uint8_t>(out.length_of(patterns[j]));
+                depth = std::max<unsigned>(depth, lengths[j]);
+            }
+
+            std::vector<hash128> layer_keys;
+            std::vector<typename layer_type::value_type> layer_bits;
+            for (unsigned d = 0; d < depth; ++d) {
+                layer_keys.clear();
+                layer_bits.clear();
+                for (size_t j = 0; j < kept.size(); ++j) {
+                    if (lengths[j] <= d) continue;
+                    layer_keys.push_back(digests[kept[j]]);
+                    layer_bits.push_back(
+                        static_cast<typename layer_type::value_type>((patterns[j] >> (M - 1 - d)) & 1));
+                }
+                typename layer_type::builder b;
+                b.add_hashes(layer_keys, layer_bits)
+                 .with_seed(seed_ + d * 0x9e3779b97f4a7c15ULL)
+                 .with_threads(threads_);
+                if (executor_ != nullptr) b.with_executor(*executor_);
+                auto layer = b.build();
+                if (!layer) return std::unexpected(layer.error());
+                out.layers_.push_back(std::move(*layer));
+            }
+            return out;
+        }
+    };
+};
+
+} // namespace maph
@@ -44,6 +44,9 @@
 #include "../concepts/codec.hpp"
 #include "../concepts/retrieval.hpp"
 #include "../core.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/task_pool.hpp"
 
 #include <array>
 #include <bit>
@@ -81,11 +84,56 @@ public:
         return codec_.decode(static_cast<uint64_t>(base_.lookup(key)));
     }
 
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const {
+        return codec_.decode(static_cast<uint64_t>(lookup_hashed(base_, hk)));
+    }
+
+    // Batched lookup(): a window of patterns from the base's own
+    // lookup_batch() (or hashed and prefetched a window ahead when it has
+    // none), then decoded together with the codec's decode_batch().
+    void lookup_batch(std::span<const std::string_view> keys,
+                      std::span<value_type> out) const {
+        constexpr size_t BW = detail::lookup_batch_window;
+        const size_t n = keys.size() < out.size() ? keys.size() : out.size();
+        uint64_t patterns[BW];
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = n - base < BW ? n - base : BW;
+            if constexpr (requires(std::span<pattern_type> p) { base_.lookup_batch(keys, p); }) {
+                pattern_type raw[BW];
+                base_.lookup_batch(keys.subspan(base, m), std::span<pattern_type>{raw, m});
+                for (size_t i = 0; i < m; ++i) patterns[i] = static_cast<uint64_t>(raw[i]);
+            } else {
+                hashed_key hks[BW];
+                for (size_t i = 0; i < m; ++i) {
+                    hks[i] = hashed_key{keys[base + i]};
+                    if constexpr (requires { base_.prefetch(hks[i]); }) base_.prefetch(hks[i]);
+                }
+                for (size_t i = 0; i < m; ++i) {
+                    patterns[i] = static_cast<uint64_t>(lookup_hashed(base_, hks[i]));
+                }
+            }
+            decode_batch(std::span<const uint64_t>{patterns, m}, out.subspan(base, m));
+        }
+    }
+
+    // out[i] = decode(patterns[i]), through the codec's decode_batch()
+    // when it has one.
+    void decode_batch(std::span<const uint64_t> patterns, std::span<value_type> out) const {
+        if constexpr (requires { codec_.decode_batch(patterns, out); }) {
+            codec_.decode_batch(patterns, out);
+        } else {
+            const size_t n = patterns.size() < out.size() ? patterns.size() : out.size();
+            for (size_t i = 0; i < n; ++i) out[i] = codec_.decode(patterns[i]);
+        }
+    }
+
     [[nodiscard]] size_t num_keys() const noexcept { return base_.num_keys(); }
     [[nodiscard]] size_t value_bits() const noexcept { return base_.value_bits(); }
     [[nodiscard]] double bits_per_key() const noexcept { return base_.bits_per_key(); }
     [[nodiscard]] size_t memory_bytes() const noexcept { return base_.memory_bytes(); }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept { return detail::member_heap_bytes(base_); }
+
     [[nodiscard]] const Retrieval& base() const noexcept { return base_; }
     [[nodiscard]] const Codec& encoder() const noexcept { return codec_; }
 
@@ -131,6 +179,31 @@ public:
             return *this;
         }
 
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            for (size_t i = 0; i < n; ++i) {
+                rbuilder_.add(keys[i],
+                    static_cast<pattern_type>(codec_.encode(values[i])));
+            }
+            return *this;
+        }
+
+        // See key_store::borrow_all. Only the encoded patterns are
+        // materialized.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values)
+            requires requires(typename Retrieval::builder& b,
+                              std::span<const pattern_type> p) { b.borrow_all(keys, p); } {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            std::vector<pattern_type> patterns(n);
+            for (size_t i = 0; i < n; ++i) {
+                patterns[i] = static_cast<pattern_type>(codec_.encode(values[i]));
+            }
+            rbuilder_.borrow_all(keys.first(n), std::span<const pattern_type>{patterns});
+            return *this;
+        }
+
         template <typename ValueFn>
             requires std::invocable<ValueFn, std::string_view>
         builder& add_all_with(std::span<const std::string> keys, ValueFn fn) {
@@ -154,6 +227,12 @@ public:
             return *this;
         }
 
+        builder& with_executor(executor& ex)
+            requires requires(typename Retrieval::builder& b) { b.with_executor(ex); } {
+            rbuilder_.with_executor(ex);
+            return *this;
+        }
+
         // Forward padded_phf's padding knob through the chain.
         builder& with_padding(uint64_t factor)
             requires requires(typename Retrieval::builder& b) { b.with_padding(factor); } {
@@ -0,0 +1,614 @@
+/**
+ * @file phf_blob_store.hpp
+ * @brief Variable-length values (strings, blobs) keyed by a PHF.
+ *
+ * phf_value_array stores fixed M-bit values; phf_blob_store stores byte
+ * strings of any length. The values are concatenated in slot order into
+ * one contiguous blob, and an Elias-Fano sequence of the range_size + 1
+ * slot offsets (detail/elias_fano.hpp) says where each one starts and
+ * ends. lookup(key) is the PHF query, one directory access (a sampled
+ * select and the low bits of two neighbouring offsets) and one read of
+ * the value's bytes, returned as a std::string_view into the blob.
+ *
+ * Space:  PHF bits/key, plus 2 + log2(mean value bytes) bits per slot of
+ *         directory, plus the values themselves.
+ *
+ * BlockCodec compresses the blob a block of slots at a time
+ * (with_block_slots(), 64 by default): no_block_codec (the default)
+ * stores values as they are; lz_block_codec runs detail/lz_block.hpp
+ * over each block's concatenated values, and a second Elias-Fano
+ * sequence holds the compressed block offsets. Compressed stores have no
+ * buffer to point into, so lookup() takes a std::string that the block
+ * is decoded into and returns a view of the value within it. A codec is
+ * any type with an `id` and static compress() / decompress() /
+ * max_decompressed() of that shape. The largest decoded block is stored,
+ * and a block claiming more is rejected before its buffer is sized.
+ *
+ * GIGO semantics, as phf_value_array: a key outside the build set gets
+ * the value at whatever slot the PHF sends it to, and unused slots of a
+ * non-minimal PHF hold empty values.
+ *
+ * phf_blob_store_view<PHFView, BlockCodec> queries the serialize() bytes
+ * in place: the directory's select samples are part of the format, so
+ * binding a mapped file reads neither the directory nor the blob.
+ */
+
+#pragma once
+
+#include "../concepts/perfect_hash_function.hpp"
+#include "../core.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/container.hpp"
+#include "../detail/elias_fano.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/lz_block.hpp"
+#include "../detail/memory_report.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/task_pool.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace maph {
+
+/// phf_blob_store values stored as they are.
+struct no_block_codec {
+    static constexpr uint32_t id = 0;
+};
+
+/// phf_blob_store blocks compressed with detail::lz_compress.
+struct lz_block_codec {
+    static constexpr uint32_t id = 1;
+
+    static void compress(std::span<const std::byte> in, std::vector<std::byte>& out) {
+        detail::lz_compress(in, out);
+    }
+
+    [[nodiscard]] static bool decompress(std::span<const std::byte> in,
+                                         std::span<std::byte> out) noexcept {
+        return detail::lz_decompress(in, out);
+    }
+
+    [[nodiscard]] static constexpr size_t max_decompressed(size_t n) noexcept {
+        return detail::lz_max_decompressed(n);
+    }
+};
+
+template<typename C>
+concept block_codec = requires { { C::id } -> std::convertible_to<uint32_t>; }
+    && (std::same_as<C, no_block_codec>
+        || requires(std::span<const std::byte> in, std::vector<std::byte>& out,
+                    std::span<std::byte> dst) {
+               C::compress(in, out);
+               { C::decompress(in, dst) } -> std::convertible_to<bool>;
+               { C::max_decompressed(size_t{}) } -> std::convertible_to<size_t>;
+           });
+
+namespace detail {
+
+/// Slot-ordered values over a directory and a blob, owned or in place.
+/// Offsets and Blocks are elias_fano or elias_fano_view.
+template<typename BlockCodec, typename Offsets>
+struct blob_reader {
+    static constexpr bool compressed = !std::same_as<BlockCodec, no_block_codec>;
+
+    const Offsets* offsets;
+    const Offsets* blocks;
+    std::span<const std::byte> blob;
+    size_t block_slots;
+    uint64_t max_block_bytes;  // largest decoded block; 0 if raw
+
+    [[nodiscard]] std::string_view chars(size_t lo, size_t hi, std::span<const std::byte> from) const noexcept {
+        if (hi < lo || hi > from.size()) return {};
+        return {reinterpret_cast<const char*>(from.data()) + lo, hi - lo};
+    }
+
+    [[nodiscard]] std::string_view raw(size_t slot) const noexcept {
+        const auto [lo, hi] = offsets->pair(slot);
+        return chars(static_cast<size_t>(lo), static_cast<size_t>(hi), blob);
+    }
+
+    /// Decode slot's block into `buffer` and view the value in it. An
+    /// empty view if the block does not decode.
+    [[nodiscard]] std::string_view decoded(size_t slot, std::string& buffer) const {
+        const size_t b = slot / block_slots;
+        const size_t first = b * block_slots;
+        const size_t last = std::min(first + block_slots, offsets->size() - 1);
+        const auto [clo, chi] = blocks->pair(b);
+        const uint64_t ustart = (*offsets)[first];
+        const uint64_t uend = (*offsets)[last];
+        if (chi < clo || chi > blob.size() || uend < ustart) return {};
+        if (uend - ustart > max_block_bytes
+            || uend - ustart > BlockCodec::max_decompressed(static_cast<size_t>(chi - clo))) {
+            return {};
+        }
+        buffer.resize(static_cast<size_t>(uend - ustart));
+        auto out = std::as_writable_bytes(std::span<char>(buffer.data(), buffer.size()));
+        if (!BlockCodec::decompress(blob.subspan(static_cast<size_t>(clo),
+                                                 static_cast<size_t>(chi - clo)), out)) {
+            buffer.clear();
+            return {};
+        }
+        const auto [lo, hi] = offsets->pair(slot);
+        if (lo < ustart) return {};
+        return chars(static_cast<size_t>(lo - ustart), static_cast<size_t>(hi - ustart),
+                     std::as_bytes(std::span<const char>(buffer.data(), buffer.size())));
+    }
+
+    [[nodiscard]] std::string_view at(size_t slot, std::string& buffer) const {
+        if constexpr (compressed) return decoded(slot, buffer);
+        else return raw(slot);
+    }
+
+    /// The directory sample and blob bytes of a window of slots, then the
+    /// values (uncompressed stores only).
+    void batch(std::span<const slot_index> slots, std::string_view* out) const noexcept {
+        for (auto s : slots) prefetch_read(offsets->sample_address(static_cast<size_t>(s)));
+        for (size_t i = 0; i < slots.size(); ++i) {
+            out[i] = raw(static_cast<size_t>(slots[i]));
+            if (!out[i].empty()) prefetch_read(out[i].data());
+        }
+    }
+
+    /// Offsets sizes agree with the range, blocks with block_slots, both
+    /// end at the blob's end, and the largest block is one the blob could
+    /// decode to.
+    [[nodiscard]] bool consistent(uint64_t range_size) const noexcept {
+        if (offsets->size() != range_size + 1) return false;
+        if constexpr (compressed) {
+            if (block_slots == 0) return false;
+            if (max_block_bytes > BlockCodec::max_decompressed(blob.size())) return false;
+            const uint64_t nblocks = (range_size + block_slots - 1) / block_slots;
+            return blocks->size() == nblocks + 1 && (*blocks)[static_cast<size_t>(nblocks)] == blob.size();
+        } else {
+            return (*offsets)[static_cast<size_t>(range_size)] == blob.size();
+        }
+    }
+};
+
+} // namespace detail
+
+template <perfect_hash_function PHF, block_codec BlockCodec = no_block_codec>
+class phf_blob_store {
+public:
+    static constexpr bool compressed = !std::same_as<BlockCodec, no_block_codec>;
+
+    phf_blob_store() = default;
+
+    // ===== Queries =====
+
+    [[nodiscard]] std::string_view lookup(std::string_view key) const noexcept
+        requires (!compressed) {
+        return reader().raw(static_cast<size_t>(phf_.slot_for(key)));
+    }
+
+    [[nodiscard]] std::string_view lookup(const hashed_key& hk) const noexcept
+        requires (!compressed) {
+        return reader().raw(static_cast<size_t>(slot_for_hashed(phf_, hk)));
+    }
+
+    template<integer_key K>
+    [[nodiscard]] std::string_view lookup(K key) const noexcept
+        requires (!compressed) {
+        return lookup(hashed_key{key});
+    }
+
+    /// Either layout: a compressed store decodes the key's block into
+    /// `buffer` and returns a view into it (valid until buffer changes);
+    /// an uncompressed one leaves buffer alone and views the blob.
+    [[nodiscard]] std::string_view lookup(std::string_view key, std::string& buffer) const {
+        return reader().at(static_cast<size_t>(phf_.slot_for(key)), buffer);
+    }
+
+    [[nodiscard]] std::string_view lookup(const hashed_key& hk, std::string& buffer) const {
+        return reader().at(static_cast<size_t>(slot_for_hashed(phf_, hk)), buffer);
+    }
+
+    /// The value at a slot of the PHF's range.
+    [[nodiscard]] std::string_view value_at(size_t slot) const noexcept requires (!compressed) {
+        return reader().raw(slot);
+    }
+
+    [[nodiscard]] std::string_view value_at(size_t slot, std::string& buffer) const {
+        return reader().at(slot, buffer);
+    }
+
+    // Batched lookup(): resolve a window of slots through the PHF's own
+    // slot_for_batch(), prefetch their directory samples, then read the
+    // offsets and prefetch each value's first line.
+    void lookup_batch(std::span<const std::string_view> keys,
+                      std::span<std::string_view> out) const noexcept requires (!compressed) {
+        constexpr size_t BW = 64;
+        const size_t n = std::min(keys.size(), out.size());
+        slot_index slots[BW];
+        const auto r = reader();
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            maph::slot_for_batch(phf_, keys.subspan(base, m), std::span<slot_index>{slots, m});
+            r.batch(std::span<const slot_index>{slots, m}, out.data() + base);
+        }
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
+    [[nodiscard]] size_t block_slots() const noexcept { return block_slots_; }
+
+    /// Bytes of the value blob as stored (compressed, for a compressed store).
+    [[nodiscard]] size_t blob_bytes() const noexcept { return blob_.size(); }
+
+    /// Bytes of the values before compression.
+    [[nodiscard]] size_t value_bytes() const noexcept {
+        return offsets_.size() == 0 ? 0 : static_cast<size_t>(offsets_[offsets_.size() - 1]);
+    }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (phf_.num_keys() == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0 / static_cast<double>(phf_.num_keys());
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return phf_.memory_bytes() + offsets_.memory_bytes() + blocks_.memory_bytes() + blob_.size();
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::member_heap_bytes(phf_) + offsets_.heap_bytes() + blocks_.heap_bytes()
+             + detail::allocated_bytes(blob_);
+    }
+
+    [[nodiscard]] const PHF& phf() const noexcept { return phf_; }
+
+    // ===== Serialization =====
+    //
+    // [u64 phf size][phf][u32 codec id][u32 block slots][u64 max block bytes]
+    // [offsets, elias_fano::serialize_indexed][blocks, likewise]
+    // [u64 blob size][blob]
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        auto phf_bytes = phf_.serialize();
+        std::vector<std::byte> out;
+        out.reserve(8 + phf_bytes.size() + blob_.size() + offsets_.memory_bytes() + 64);
+        phf_serial::append(out, static_cast<uint64_t>(phf_bytes.size()));
+        out.insert(out.end(), phf_bytes.begin(), phf_bytes.end());
+        append_directory(out);
+        phf_serial::append(out, static_cast<uint64_t>(blob_.size()));
+        out.insert(out.end(), blob_.begin(), blob_.end());
+        return out;
+    }
+
+    [[nodiscard]] static result<phf_blob_store> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint64_t phf_sz{};
+        std::span<const std::byte> phf_span;
+        if (!r.read(phf_sz) || !r.read_span(phf_span, static_cast<size_t>(phf_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+        auto phf_r = PHF::deserialize(phf_span);
+        if (!phf_r) return std::unexpected(error::invalid_format);
+
+        phf_blob_store out{};
+        out.phf_ = std::move(*phf_r);
+        uint64_t blob_sz{};
+        std::span<const std::byte> blob;
+        if (!out.read_directory(r) || !r.read(blob_sz)
+            || !r.read_span(blob, static_cast<size_t>(blob_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+        out.blob_.assign(blob.begin(), blob.end());
+        if (!out.reader().consistent(out.phf_.range_size())) return std::unexpected(error::invalid_format);
+        return out;
+    }
+
+    /// Container sections: the PHF as a nested container, the directory
+    /// as meta, and the blob as values.
+    void write_sections(container_writer& w) const {
+        w.add(section_tag::phf, to_container(phf_));
+        std::vector<std::byte> meta;
+        append_directory(meta);
+        w.add(section_tag::meta, std::move(meta));
+        w.add(section_tag::values, blob_);
+    }
+
+    [[nodiscard]] static result<phf_blob_store> read_sections(const container_view& v,
+                                                              size_t threads = 1) {
+        auto phf_bytes = v.checked(section_tag::phf);
+        if (!phf_bytes) return std::unexpected(phf_bytes.error());
+        auto phf_r = from_container<PHF>(*phf_bytes, threads);
+        if (!phf_r) return std::unexpected(phf_r.error());
+        auto meta = v.checked(section_tag::meta);
+        if (!meta) return std::unexpected(meta.error());
+        auto blob = v.checked(section_tag::values);
+        if (!blob) return std::unexpected(blob.error());
+
+        phf_blob_store out{};
+        out.phf_ = std::move(*phf_r);
+        phf_serial::reader r{*meta};
+        if (!out.read_directory(r)) return std::unexpected(error::invalid_format);
+        out.blob_.assign(blob->begin(), blob->end());
+        if (!out.reader().consistent(out.phf_.range_size())) return std::unexpected(error::invalid_format);
+        return out;
+    }
+
+    // ===== Builder =====
+
+    class builder {
+        // Keys and values are stored once here; keys are lent to the PHF
+        // builder at build() time.
+        typename PHF::builder phf_builder_{};
+        detail::key_store keys_{};
+        detail::key_store values_{};
+        size_t block_slots_{64};
+
+    public:
+        builder() = default;
+
+        builder& add(std::string_view key, std::string_view value) {
+            keys_.add(key);
+            values_.add(value);
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        template<integer_key K>
+        builder& add(const K& key, std::string_view value) {
+            keys_.add(key);
+            values_.add(value);
+            return *this;
+        }
+
+        // Parallel spans. Must have equal length.
+        builder& add_all(std::span<const std::string> keys, std::span<const std::string> values) {
+            size_t n = std::min(keys.size(), values.size());
+            keys_.add_all(keys.first(n));
+            values_.add_all(values.first(n));
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const std::string_view> values) {
+            size_t n = std::min(keys.size(), values.size());
+            keys_.add_all(keys.first(n));
+            values_.add_all(values.first(n));
+            return *this;
+        }
+
+        // Borrowed keys and values are not copied; they must outlive build().
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const std::string_view> values) {
+            size_t n = std::min(keys.size(), values.size());
+            keys_.borrow_all(keys.first(n));
+            values_.borrow_all(values.first(n));
+            return *this;
+        }
+
+        builder& with_seed(uint64_t seed)
+            requires requires(typename PHF::builder& b) { b.with_seed(seed); } {
+            phf_builder_.with_seed(seed);
+            return *this;
+        }
+
+        builder& with_threads(size_t n)
+            requires requires(typename PHF::builder& b) { b.with_threads(n); } {
+            phf_builder_.with_threads(n);
+            return *this;
+        }
+
+        builder& with_executor(executor& ex)
+            requires requires(typename PHF::builder& b) { b.with_executor(ex); } {
+            phf_builder_.with_executor(ex);
+            return *this;
+        }
+
+        // The report is the PHF build's.
+        builder& with_report(build_report& report)
+            requires requires(typename PHF::builder& b) { b.with_report(report); } {
+            phf_builder_.with_report(report);
+            return *this;
+        }
+
+        builder& with_dedup(key_dedup mode)
+            requires requires(typename PHF::builder& b) { b.with_dedup(mode); } {
+            phf_builder_.with_dedup(mode);
+            return *this;
+        }
+
+        /// Slots per compressed block: larger blocks compress better and
+        /// decode slower. At least 1.
+        builder& with_block_slots(size_t n) requires compressed {
+            block_slots_ = std::max<size_t>(n, 1);
+            return *this;
+        }
+
+        [[nodiscard]] result<phf_blob_store> build() {
+            auto phf_builder = phf_builder_;
+            detail::borrow_keys_into(phf_builder, keys_.views());
+            auto built = phf_builder.build();
+            if (!built.has_value()) return std::unexpected(built.error());
+
+            phf_blob_store out{};
+            out.phf_ = std::move(*built);
+            const size_t range = out.phf_.range_size();
+
+            // Value index per slot, in insertion order so the last of
+            // duplicate keys wins.
+            constexpr size_t none = std::numeric_limits<size_t>::max();
+            std::vector<size_t> value_of(range, none);
+            for (size_t i = 0; i < keys_.size(); ++i) {
+                value_of[static_cast<size_t>(out.phf_.slot_for(keys_[i]))] = i;
+            }
+            auto value = [&](size_t slot) {
+                return value_of[slot] == none ? std::string_view{} : values_[value_of[slot]];
+            };
+
+            std::vector<uint64_t> offsets(range + 1, 0);
+            for (size_t s = 0; s < range; ++s) offsets[s + 1] = offsets[s] + value(s).size();
+            out.offsets_ = detail::elias_fano{offsets};
+
+            if constexpr (compressed) {
+                out.block_slots_ = block_slots_;
+                const size_t nblocks = (range + block_slots_ - 1) / block_slots_;
+                std::vector<uint64_t> block_offsets(nblocks + 1, 0);
+                std::vector<std::byte> raw;
+                for (size_t b = 0; b < nblocks; ++b) {
+                    raw.clear();
+                    for (size_t s = b * block_slots_; s < std::min(range, (b + 1) * block_slots_); ++s) {
+                        auto bytes = std::as_bytes(std::span<const char>(value(s)));
+                        raw.insert(raw.end(), bytes.begin(), bytes.end());
+                    }
+                    BlockCodec::compress(raw, out.blob_);
+                    block_offsets[b + 1] = out.blob_.size();
+                    out.max_block_bytes_ = std::max<uint64_t>(out.max_block_bytes_, raw.size());
+                }
+                out.blocks_ = detail::elias_fano{block_offsets};
+            } else {
+                out.blob_.reserve(static_cast<size_t>(offsets[range]));
+                for (size_t s = 0; s < range; ++s) {
+                    auto bytes = std::as_bytes(std::span<const char>(value(s)));
+                    out.blob_.insert(out.blob_.end(), bytes.begin(), bytes.end());
+                }
+            }
+            return out;
+        }
+    };
+
+private:
+    PHF phf_{};
+    detail::elias_fano offsets_{};   // range_size + 1 value offsets, slot order
+    detail::elias_fano blocks_{};    // blocks + 1 compressed block offsets; empty if raw
+    std::vector<std::byte> blob_{};
+    size_t block_slots_{0};
+    uint64_t max_block_bytes_{0};
+
+    [[nodiscard]] detail::blob_reader<BlockCodec, detail::elias_fano> reader() const noexcept {
+        return {&offsets_, &blocks_, blob_, block_slots_, max_block_bytes_};
+    }
+
+    void append_directory(std::vector<std::byte>& out) const {
+        phf_serial::append(out, static_cast<uint32_t>(BlockCodec::id));
+        phf_serial::append(out, static_cast<uint32_t>(block_slots_));
+        phf_serial::append(out, max_block_bytes_);
+        offsets_.serialize_indexed(out);
+        blocks_.serialize_indexed(out);
+    }
+
+    [[nodiscard]] bool read_directory(phf_serial::reader& r) {
+        uint32_t id{}, slots{};
+        if (!r.read(id) || id != BlockCodec::id || !r.read(slots) || !r.read(max_block_bytes_)) {
+            return false;
+        }
+        block_slots_ = slots;
+        return offsets_.deserialize_indexed(r) && blocks_.deserialize_indexed(r);
+    }
+};
+
+/**
+ * phf_blob_store_view: phf_blob_store queried in place over its
+ * serialize() bytes. PHFView is the zero-copy counterpart of the PHF the
+ * store was built with (e.g. phobic_phf_view<5> for phobic_phf<5>). The
+ * buffer must outlive the view, and uncompressed lookups return views
+ * into it.
+ */
+template <perfect_hash_function PHFView, block_codec BlockCodec = no_block_codec>
+class phf_blob_store_view {
+public:
+    static constexpr bool compressed = !std::same_as<BlockCodec, no_block_codec>;
+
+    phf_blob_store_view() = default;
+
+    [[nodiscard]] std::string_view lookup(std::string_view key) const noexcept
+        requires (!compressed) {
+        return reader().raw(static_cast<size_t>(phf_.slot_for(key)));
+    }
+
+    [[nodiscard]] std::string_view lookup(const hashed_key& hk) const noexcept
+        requires (!compressed) {
+        return reader().raw(static_cast<size_t>(slot_for_hashed(phf_, hk)));
+    }
+
+    template<integer_key K>
+    [[nodiscard]] std::string_view lookup(K key) const noexcept
+        requires (!compressed) {
+        return lookup(hashed_key{key});
+    }
+
+    [[nodiscard]] std::string_view lookup(std::string_view key, std::string& buffer) const {
+        return reader().at(static_cast<size_t>(phf_.slot_for(key)), buffer);
+    }
+
+    [[nodiscard]] std::string_view lookup(const hashed_key& hk, std::string& buffer) const {
+        return reader().at(static_cast<size_t>(slot_for_hashed(phf_, hk)), buffer);
+    }
+
+    void lookup_batch(std::span<const std::string_view> keys,
+                      std::span<std::string_view> out) const noexcept requires (!compressed) {
+        constexpr size_t BW = 64;
+        const size_t n = std::min(keys.size(), out.size());
+        slot_index slots[BW];
+        const auto r = reader();
+        for (size_t base = 0; base < n; base += BW) {
+            const size_t m = std::min(BW, n - base);
+            maph::slot_for_batch(phf_, keys.subspan(base, m), std::span<slot_index>{slots, m});
+            r.batch(std::span<const slot_index>{slots, m}, out.data() + base);
+        }
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
+    [[nodiscard]] size_t blob_bytes() const noexcept { return blob_.size(); }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return phf_.memory_bytes() + offsets_.memory_bytes() + blocks_.memory_bytes() + blob_.size();
+    }
+
+    [[nodiscard]] const PHFView& phf() const noexcept { return phf_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
+
+    /// Bind to bytes written by phf_blob_store<PHF, BlockCodec>::serialize().
+    [[nodiscard]] static result<phf_blob_store_view> deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint64_t phf_sz{};
+        std::span<const std::byte> phf_span;
+        if (!r.read(phf_sz) || !r.read_span(phf_span, static_cast<size_t>(phf_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+        auto phf_r = PHFView::deserialize(phf_span);
+        if (!phf_r) return std::unexpected(error::invalid_format);
+
+        phf_blob_store_view out{};
+        out.phf_ = std::move(*phf_r);
+        uint32_t id{}, slots{};
+        uint64_t blob_sz{};
+        if (!r.read(id) || id != BlockCodec::id || !r.read(slots) || !r.read(out.max_block_bytes_)
+            || !out.offsets_.bind(r) || !out.blocks_.bind(r)
+            || !r.read(blob_sz) || !r.read_span(out.blob_, static_cast<size_t>(blob_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+        out.block_slots_ = slots;
+        if (!out.reader().consistent(out.phf_.range_size())) return std::unexpected(error::invalid_format);
+        out.bytes_ = bytes.first(r.offset());
+        return out;
+    }
+
+private:
+    PHFView phf_{};
+    detail::elias_fano_view offsets_{};
+    detail::elias_fano_view blocks_{};
+    std::span<const std::byte> blob_{};
+    size_t block_slots_{0};
+    uint64_t max_block_bytes_{0};
+    std::span<const std::byte> bytes_{};
+
+    [[nodiscard]] detail::blob_reader<BlockCodec, detail::elias_fano_view> reader() const noexcept {
+        return {&offsets_, &blocks_, blob_, block_slots_, max_block_bytes_};
+    }
+};
+
+} // namespace maph
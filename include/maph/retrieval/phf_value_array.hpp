@@ -9,7 +9,11 @@
  * Space:  bits_per_key(PHF) + M bits per key.
  * Query:  one PHF query + one packed-array read.
  * Build:  inherits the PHF's build; then one pass over pairs to fill
- *         the array.
+ *         the array. The unused slots of a non-minimal PHF get the fill
+ *         pattern a period of words at a time (packed_value_array::
+ *         assign). With with_threads(n) the slots are computed on n
+ *         workers and the values scattered by n workers, each owning
+ *         whole 64-slot runs of the range, so none shares a word.
  *
  * This is the *naive* retrieval baseline. It pays the PHF's full
  * bits/key (around 2.7 for PHOBIC) on top of the M-bit value payload.
@@ -21,6 +25,26 @@
  * happens to be at phf.slot_for(k). No branch, no sentinel, no
  * distinguishable failure mode. When values are pseudorandom, the
  * output for non-members is indistinguishable from a real hit.
+ *
+ * lookup_batch() pipelines the PHF lookups (slot_for_batch) and reads
+ * the values with packed_value_array::get_batch(). lookup_interleaved()
+ * keeps G lookups in flight instead (see detail/amac.hpp): each runs the
+ * PHF's stages, prefetches its value's word, and reads it, with no pass
+ * waiting on the slowest key of a window.
+ *
+ * Storage places the value words (heap_storage, or a mapped_storage for
+ * huge pages and NUMA placement; see detail/page_allocator.hpp). The PHF
+ * takes its own policy, e.g. phobic_phf<5, flat_pilots, Storage>.
+ *
+ * update(key, value) rewrites one key's value in place through its PHF
+ * slot, for changes that leave the key set alone. It writes with
+ * packed_value_array::set_atomic(), so lookup_atomic() may run on other
+ * threads meanwhile and see the old or the new value; lookup() stays a
+ * plain load. Like set_atomic(), both exist only when M divides 64. The
+ * key must be in the build set: any other key overwrites the value of
+ * whichever key shares its slot.
+ *
+ * phf_value_array_view<PHFView, M> queries the serialized form in place.
  */
 
 #pragma once
@@ -28,14 +52,24 @@
 #include "../concepts/perfect_hash_function.hpp"
 #include "../concepts/retrieval.hpp"
 #include "../core.hpp"
+#include "../detail/amac.hpp"
+#include "../detail/build_report.hpp"
+#include "../detail/container.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
 #include "../detail/packed_value_array.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
+#include "../detail/task_pool.hpp"
 
+#include <algorithm>
 #include <array>
 #include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <optional>
+#include <ostream>
 #include <span>
 #include <string>
 #include <string_view>
@@ -44,11 +78,46 @@
 
 namespace maph {
 
-template <perfect_hash_function PHF, unsigned M>
+namespace detail {
+
+// lookup_batch() of phf_value_array and its view.
+template <typename PHF, typename Values>
+void lookup_values_batch(const PHF& phf, const Values& values,
+                         std::span<const std::string_view> keys,
+                         std::span<typename Values::value_type> out) noexcept {
+    constexpr size_t BW = 64;
+    const size_t n = std::min(keys.size(), out.size());
+    slot_index slots[BW];
+    size_t indices[BW];
+    for (size_t base = 0; base < n; base += BW) {
+        const size_t m = std::min(BW, n - base);
+        maph::slot_for_batch(phf, keys.subspan(base, m), std::span<slot_index>{slots, m});
+        for (size_t i = 0; i < m; ++i) indices[i] = static_cast<size_t>(slots[i]);
+        values.get_batch(std::span<const size_t>{indices, m}, out.data() + base);
+    }
+}
+
+// lookup_step() of phf_value_array and its view: the PHF's stages, a
+// prefetch of the word holding the value, then the read.
+template <typename PHF, typename Values>
+bool step_values(const PHF& phf, const Values& values, lookup_cursor& c) noexcept {
+    if (!c.resolved) {
+        if (!phf_step(phf, c)) return false;
+        c.resolved = true;
+        prefetch_read(values.address(static_cast<size_t>(c.slot)));
+        return false;
+    }
+    c.value = static_cast<uint64_t>(values.get(static_cast<size_t>(c.slot)));
+    return true;
+}
+
+} // namespace detail
+
+template <perfect_hash_function PHF, unsigned M, storage_policy Storage = heap_storage>
     requires (M >= 1 && M <= 64)
 class phf_value_array {
 public:
-    using packed_type = detail::packed_value_array<M>;
+    using packed_type = detail::packed_value_array<M, Storage>;
     using value_type = typename packed_type::value_type;
 
     static constexpr unsigned value_bits_v = M;
@@ -61,6 +130,80 @@ public:
         return values_.get(static_cast<size_t>(phf_.slot_for(key)));
     }
 
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept {
+        return values_.get(static_cast<size_t>(slot_for_hashed(phf_, hk)));
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    // Batched lookup(): resolve a window of slots through the PHF's own
+    // slot_for_batch(), then read the values with one get_batch().
+    void lookup_batch(std::span<const std::string_view> keys,
+                      std::span<value_type> out) const noexcept {
+        detail::lookup_values_batch(phf_, values_, keys, out);
+    }
+
+    // Interleaved lookup(): G lookups in flight, out[i] = lookup(keys[i]).
+    template <size_t G = detail::interleave_group>
+    void lookup_interleaved(std::span<const std::string_view> keys,
+                            std::span<value_type> out) const noexcept {
+        lookup_interleaved<G>(keys.first(std::min(keys.size(), out.size())),
+                              [out](size_t i, value_type v) { out[i] = v; });
+    }
+
+    /// fn(i, lookup(keys[i])) for every i, in completion order.
+    template <size_t G = detail::interleave_group, typename Fn>
+        requires std::invocable<Fn&, size_t, value_type>
+    void lookup_interleaved(std::span<const std::string_view> keys, Fn&& fn) const {
+        detail::interleave_keys<G>(
+            *this, keys, [this](detail::lookup_cursor& c) { return lookup_step(c); },
+            [&fn](size_t i, const detail::lookup_cursor& c) {
+                fn(i, static_cast<value_type>(c.value));
+            });
+    }
+
+    void lookup_start(detail::lookup_cursor& c) const noexcept { detail::stage_start(phf_, c); }
+
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        return detail::step_values(phf_, values_, c);
+    }
+
+    // ===== In-place update =====
+
+    /// lookup() for readers running alongside update().
+    [[nodiscard]] value_type lookup_atomic(std::string_view key) const noexcept
+        requires (64 % M == 0) {
+        return values_.get_atomic(static_cast<size_t>(phf_.slot_for(key)));
+    }
+
+    [[nodiscard]] value_type lookup_atomic(const hashed_key& hk) const noexcept
+        requires (64 % M == 0) {
+        return values_.get_atomic(static_cast<size_t>(slot_for_hashed(phf_, hk)));
+    }
+
+    template<integer_key K>
+        requires (64 % M == 0)
+    [[nodiscard]] value_type lookup_atomic(K key) const noexcept {
+        return lookup_atomic(hashed_key{key});
+    }
+
+    void update(std::string_view key, value_type value) noexcept requires (64 % M == 0) {
+        values_.set_atomic(static_cast<size_t>(phf_.slot_for(key)), value);
+    }
+
+    void update(const hashed_key& hk, value_type value) noexcept requires (64 % M == 0) {
+        values_.set_atomic(static_cast<size_t>(slot_for_hashed(phf_, hk)), value);
+    }
+
+    template<integer_key K>
+        requires (64 % M == 0)
+    void update(K key, value_type value) noexcept {
+        update(hashed_key{key}, value);
+    }
+
     [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
     [[nodiscard]] size_t value_bits() const noexcept { return M; }
 
@@ -76,11 +219,19 @@ public:
         return phf_.memory_bytes() + values_.memory_bytes();
     }
 
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return detail::member_heap_bytes(phf_) + values_.heap_bytes();
+    }
+
     [[nodiscard]] const PHF& phf() const noexcept { return phf_; }
     [[nodiscard]] const packed_type& values() const noexcept { return values_; }
 
-    [[nodiscard]] std::vector<std::byte> serialize() const {
-        auto phf_bytes = phf_.serialize();
+    [[nodiscard]] std::vector<std::byte> serialize() const { return serialize(1); }
+
+    /// serialize() with the PHF serialized on `threads` workers when it
+    /// can be (partitioned_phf). Same bytes.
+    [[nodiscard]] std::vector<std::byte> serialize(size_t threads) const {
+        auto phf_bytes = detail::serialize_with_threads(phf_, threads);
         auto val_bytes = values_.serialize();
         std::vector<std::byte> out;
         out.reserve(8 + phf_bytes.size() + val_bytes.size());
@@ -93,16 +244,20 @@ public:
     // ===== Builder =====
 
     class builder {
+        // Keys are stored once here and lent to the PHF builder at
+        // build() time, so each key is copied at most once.
         typename PHF::builder phf_builder_{};
-        std::vector<std::pair<std::string, value_type>> pairs_{};
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
         value_type fill_pattern_{0};  // Pattern written to unused slots
+        size_t threads_{1};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key, value_type value) {
-            phf_builder_.add(key);
-            pairs_.emplace_back(std::string{key}, value);
+            keys_.add(key);
+            values_.push_back(value);
             return *this;
         }
 
@@ -110,11 +265,41 @@ public:
         builder& add_all(std::span<const std::string> keys,
                          std::span<const value_type> values) {
             size_t n = keys.size() < values.size() ? keys.size() : values.size();
-            pairs_.reserve(pairs_.size() + n);
-            for (size_t i = 0; i < n; ++i) {
-                phf_builder_.add(keys[i]);
-                pairs_.emplace_back(keys[i], values[i]);
-            }
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        template<integer_key K>
+        builder& add(const K& key, value_type value) {
+            keys_.add(key);
+            values_.push_back(value);
+            return *this;
+        }
+
+        builder& add_all(std::span<const uint64_t> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.borrow_all(keys.first(n));
+            values_.insert(values_.end(), values.begin(), values.begin() + n);
             return *this;
         }
 
@@ -123,11 +308,10 @@ public:
         template <typename ValueFn>
             requires std::invocable<ValueFn, std::string_view>
         builder& add_all_with(std::span<const std::string> keys, ValueFn fn) {
-            pairs_.reserve(pairs_.size() + keys.size());
+            keys_.add_all(keys);
+            values_.reserve(values_.size() + keys.size());
             for (const auto& k : keys) {
-                value_type v = static_cast<value_type>(fn(std::string_view{k}));
-                phf_builder_.add(k);
-                pairs_.emplace_back(k, v);
+                values_.push_back(static_cast<value_type>(fn(std::string_view{k})));
             }
             return *this;
         }
@@ -145,6 +329,26 @@ public:
         builder& with_threads(size_t n)
             requires requires(typename PHF::builder& b) { b.with_threads(n); } {
             phf_builder_.with_threads(n);
+            threads_ = n;
+            return *this;
+        }
+
+        builder& with_executor(executor& ex)
+            requires requires(typename PHF::builder& b) { b.with_executor(ex); } {
+            phf_builder_.with_executor(ex);
+            return *this;
+        }
+
+        // The report is the PHF build's.
+        builder& with_report(build_report& report)
+            requires requires(typename PHF::builder& b) { b.with_report(report); } {
+            phf_builder_.with_report(report);
+            return *this;
+        }
+
+        builder& with_dedup(key_dedup mode)
+            requires requires(typename PHF::builder& b) { b.with_dedup(mode); } {
+            phf_builder_.with_dedup(mode);
             return *this;
         }
 
@@ -163,30 +367,85 @@ public:
         }
 
         [[nodiscard]] result<phf_value_array> build() {
-            auto built = phf_builder_.build();
+            auto phf_builder = phf_builder_;
+            detail::borrow_keys_into(phf_builder, keys_.views());
+            auto built = phf_builder.build();
             if (!built.has_value()) return std::unexpected(built.error());
 
             phf_value_array out{};
             out.phf_ = std::move(*built);
-            out.values_.resize(out.phf_.range_size());
-            if (fill_pattern_ != 0) {
-                for (size_t i = 0; i < out.phf_.range_size(); ++i) {
-                    out.values_.set(i, fill_pattern_);
-                }
-            }
+            out.values_.assign(out.phf_.range_size(), fill_pattern_);
+            scatter(out);
+            return out;
+        }
 
-            for (const auto& [k, v] : pairs_) {
-                auto slot = static_cast<size_t>(out.phf_.slot_for(k));
-                out.values_.set(slot, v);
+    private:
+        struct placed {
+            size_t slot;
+            value_type value;
+        };
+
+        // Every value to its slot. In insertion order within each worker's
+        // part of the range, so the last of duplicate keys wins.
+        void scatter(phf_value_array& out) const {
+            const size_t n = keys_.size();
+            const size_t nt = detail::effective_threads(n, threads_);
+            if (nt == 1) {
+                for (size_t i = 0; i < n; ++i) {
+                    out.values_.set(static_cast<size_t>(out.phf_.slot_for(keys_[i])), values_[i]);
+                }
+                return;
             }
-            return out;
+            std::vector<placed> items(n);
+            detail::parallel_chunks(n, nt, [&](size_t, size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; ++i) {
+                    items[i] = {static_cast<size_t>(out.phf_.slot_for(keys_[i])), values_[i]};
+                }
+            });
+            // 64 slots are M whole words, so parts never share a word.
+            const size_t range = out.phf_.range_size();
+            const size_t part_slots = ((range + nt - 1) / nt + 63) / 64 * 64;
+            const auto offsets = detail::radix_partition(items, nt,
+                [&](size_t i) { return items[i].slot / part_slots; }, nt);
+            // One part per worker: chunk t of parallel_chunks is part t.
+            detail::parallel_chunks(n, nt, [&](size_t t, size_t, size_t) {
+                for (size_t i = offsets[t]; i < offsets[t + 1]; ++i) {
+                    out.values_.set(items[i].slot, items[i].value);
+                }
+            });
         }
     };
 
+    /// Stream serialize()'s bytes to `sink`; a PHF with serialize_to()
+    /// streams too, so no full copy is built. io_error once the sink fails.
+    template<typename Sink>
+        requires phf_serial::byte_sink<Sink>
+    [[nodiscard]] result<void> serialize_to(Sink& sink, size_t threads = 1) const {
+        const uint64_t phf_sz = detail::serialized_size_of(phf_, threads);
+        const auto size_bytes = std::bit_cast<std::array<std::byte, 8>>(phf_sz);
+        const auto val_bytes = values_.serialize();
+        if (!sink(std::span<const std::byte>(size_bytes)) || !detail::serialize_into(phf_, sink, threads)
+            || !sink(std::span<const std::byte>(val_bytes))) {
+            return std::unexpected(error::io_error);
+        }
+        return {};
+    }
+
+    [[nodiscard]] result<void> serialize_to(std::ostream& os, size_t threads = 1) const {
+        phf_serial::ostream_sink sink{os};
+        return serialize_to(sink, threads);
+    }
+
     // ===== Deserialize =====
 
     [[nodiscard]] static result<phf_value_array>
     deserialize(std::span<const std::byte> bytes) {
+        return deserialize(bytes, 1);
+    }
+
+    /// deserialize() with the PHF decoded on `threads` workers when it can be.
+    [[nodiscard]] static result<phf_value_array>
+    deserialize(std::span<const std::byte> bytes, size_t threads) {
         phf_serial::reader r{bytes};
         uint64_t phf_sz{};
         if (!r.read(phf_sz)) return std::unexpected(error::invalid_format);
@@ -195,7 +454,7 @@ public:
             return std::unexpected(error::invalid_format);
         }
 
-        auto phf_r = PHF::deserialize(phf_span);
+        auto phf_r = detail::deserialize_with_threads<PHF>(phf_span, threads);
         if (!phf_r) return std::unexpected(phf_r.error());
 
         auto val_opt = packed_type::deserialize(bytes.subspan(8 + phf_sz));
@@ -207,9 +466,149 @@ public:
         return out;
     }
 
+    /// Container sections: the PHF as a nested container, and the value
+    /// array's serialize() bytes.
+    void write_sections(container_writer& w) const {
+        w.add(section_tag::phf, to_container(phf_));
+        w.add(section_tag::values, values_.serialize());
+    }
+
+    [[nodiscard]] static result<phf_value_array> read_sections(const container_view& v,
+                                                               size_t threads = 1) {
+        auto phf_bytes = v.checked(section_tag::phf);
+        if (!phf_bytes) return std::unexpected(phf_bytes.error());
+        auto phf_r = from_container<PHF>(*phf_bytes, threads);
+        if (!phf_r) return std::unexpected(phf_r.error());
+        auto val_bytes = v.checked(section_tag::values);
+        if (!val_bytes) return std::unexpected(val_bytes.error());
+        auto val_opt = packed_type::deserialize(*val_bytes);
+        if (!val_opt) return std::unexpected(error::invalid_format);
+
+        phf_value_array out{};
+        out.phf_ = std::move(*phf_r);
+        out.values_ = std::move(*val_opt);
+        return out;
+    }
+
 private:
     PHF phf_{};
     packed_type values_{};
 };
 
+/**
+ * phf_value_array_view: phf_value_array queried in place over its
+ * serialized bytes. PHFView is the zero-copy counterpart of the PHF the
+ * array was built with (e.g. phobic_phf_view<5> for phobic_phf<5>); the
+ * value array is read through packed_value_array_view. The buffer must
+ * outlive the view.
+ */
+template <perfect_hash_function PHFView, unsigned M>
+    requires (M >= 1 && M <= 64)
+class phf_value_array_view {
+public:
+    using packed_type = detail::packed_value_array_view<M>;
+    using value_type = typename packed_type::value_type;
+
+    static constexpr unsigned value_bits_v = M;
+
+    phf_value_array_view() = default;
+
+    [[nodiscard]] value_type lookup(std::string_view key) const noexcept {
+        return values_.get(static_cast<size_t>(phf_.slot_for(key)));
+    }
+
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept {
+        return values_.get(static_cast<size_t>(slot_for_hashed(phf_, hk)));
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    // Batched lookup(): resolve a window of slots through the PHF's own
+    // slot_for_batch(), then read the values with one get_batch().
+    void lookup_batch(std::span<const std::string_view> keys,
+                      std::span<value_type> out) const noexcept {
+        detail::lookup_values_batch(phf_, values_, keys, out);
+    }
+
+    // Interleaved lookup(): G lookups in flight, out[i] = lookup(keys[i]).
+    template <size_t G = detail::interleave_group>
+    void lookup_interleaved(std::span<const std::string_view> keys,
+                            std::span<value_type> out) const noexcept {
+        lookup_interleaved<G>(keys.first(std::min(keys.size(), out.size())),
+                              [out](size_t i, value_type v) { out[i] = v; });
+    }
+
+    /// fn(i, lookup(keys[i])) for every i, in completion order.
+    template <size_t G = detail::interleave_group, typename Fn>
+        requires std::invocable<Fn&, size_t, value_type>
+    void lookup_interleaved(std::span<const std::string_view> keys, Fn&& fn) const {
+        detail::interleave_keys<G>(
+            *this, keys, [this](detail::lookup_cursor& c) { return lookup_step(c); },
+            [&fn](size_t i, const detail::lookup_cursor& c) {
+                fn(i, static_cast<value_type>(c.value));
+            });
+    }
+
+    void lookup_start(detail::lookup_cursor& c) const noexcept { detail::stage_start(phf_, c); }
+
+    bool lookup_step(detail::lookup_cursor& c) const noexcept {
+        return detail::step_values(phf_, values_, c);
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return phf_.num_keys(); }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (phf_.num_keys() == 0) return 0.0;
+        return static_cast<double>(memory_bytes()) * 8.0
+             / static_cast<double>(phf_.num_keys());
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return phf_.memory_bytes() + values_.memory_bytes();
+    }
+
+    [[nodiscard]] const PHFView& phf() const noexcept { return phf_; }
+    [[nodiscard]] const packed_type& values() const noexcept { return values_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
+
+    /// Bind to bytes written by phf_value_array<PHF, M>::serialize().
+    /// Rejects a value array with fewer slots than the PHF's range.
+    [[nodiscard]] static result<phf_value_array_view>
+    deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint64_t phf_sz{};
+        if (!r.read(phf_sz)) return std::unexpected(error::invalid_format);
+        std::span<const std::byte> phf_span;
+        if (!r.read_span(phf_span, static_cast<size_t>(phf_sz))) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        auto phf_r = PHFView::deserialize(phf_span);
+        if (!phf_r) return std::unexpected(phf_r.error());
+
+        auto val_opt = packed_type::deserialize(bytes.subspan(r.offset()));
+        if (!val_opt || val_opt->num_slots() < phf_r->range_size()) {
+            return std::unexpected(error::invalid_format);
+        }
+
+        phf_value_array_view out{};
+        out.phf_ = std::move(*phf_r);
+        out.values_ = std::move(*val_opt);
+        out.bytes_ = bytes.first(r.offset() + out.values_.bytes().size());
+        return out;
+    }
+
+private:
+    PHFView phf_{};
+    packed_type values_{};
+    std::span<const std::byte> bytes_{};
+};
+
 } // namespace maph
@@ -8,12 +8,28 @@
  * The underlying machinery is identical: a banded matrix with bandwidth
  * w=64 solved by forward Gaussian elimination and back-substitution.
  *
- * Satisfies: retrieval<ribbon_retrieval<M>>
+ * Satisfies: retrieval<ribbon_retrieval<M>>. ribbon_retrieval_view<M>
+ * answers the same queries in place over the serialized bytes.
  *
- * Space:  ~1.04 * M bits per key (num_rows around 1.04 * num_keys, one
- *         value_type per row).
- * Query:  3 to ~32 XOR operations over solution entries inside a 64-slot
- *         window.
+ * The second template parameter picks the solution layout (see
+ * ribbon_solution.hpp): flat_solution (default) stores one value_type
+ * per row; interleaved_solution stores M column words per 64 rows and
+ * answers with M popcount parities instead of walking the set bits.
+ * The third, Storage, places the solution array (heap_storage, or a
+ * mapped_storage from page_allocator.hpp).
+ *
+ * Large key sets are built in shards: keys above builder::with_shard_keys
+ * (default 2^16) are split by hash into independent bands, each with its
+ * own rows and seed, solved in parallel with with_threads(n). A shard
+ * that fails retries alone instead of restarting the whole build, and
+ * each band stays small enough to keep the tight 0.08 slack. A query
+ * adds one shard-table lookup.
+ *
+ * Space:  ~1.04 * M bits per key (num_rows around 1.04 * num_keys);
+ *         flat rounds each row up to sizeof(value_type).
+ * Query:  flat: 3 to ~32 XOR operations over solution entries inside a
+ *         64-slot window. Interleaved: M popcounts over one or two
+ *         adjacent blocks.
  * Build:  O(n * w) with w=64 for banded elimination. Retries on failure
  *         (the sparse system is solvable with high probability).
  *
@@ -28,13 +44,22 @@
 
 #include "../concepts/retrieval.hpp"
 #include "../core.hpp"
+#include "../detail/build_report.hpp"
 #include "../detail/fingerprint_hash.hpp"
+#include "../detail/key_store.hpp"
+#include "../detail/memory_report.hpp"
 #include "../detail/packed_value_array.hpp"
+#include "../detail/prefetch.hpp"
+#include "../detail/radix_partition.hpp"
+#include "../detail/ribbon_solution.hpp"
 #include "../detail/serialization.hpp"
+#include "../detail/task_pool.hpp"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -43,18 +68,28 @@
 #include <span>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace maph {
 
-template <unsigned M>
+/// Set in the width field of ribbon_retrieval blobs built in shards.
+inline constexpr uint32_t SHARDED_RIBBON_FLAG = 1u << 18;
+
+template <unsigned M, ribbon_solution_layout Layout = flat_solution>
+    requires (M >= 1 && M <= 64)
+class ribbon_retrieval_view;
+
+template <unsigned M, ribbon_solution_layout Layout = flat_solution,
+          storage_policy Storage = heap_storage>
     requires (M >= 1 && M <= 64)
 class ribbon_retrieval {
 public:
     using packed_type = detail::packed_value_array<M>;
     using value_type = typename packed_type::value_type;
+    using layout_type = Layout;
 
     static constexpr unsigned value_bits_v = M;
 
@@ -63,10 +98,20 @@ private:
         (M == 64) ? ~uint64_t{0} : ((uint64_t{1} << M) - 1);
     static constexpr size_t W = 64;  // Band width = machine word size
 
-    std::vector<value_type> solution_{};
+    template <typename L, template <typename> class Array>
+    using table_for = typename L::template table<value_type, M, Array>;
+    using table_type = table_for<Layout, Storage::template array>;
+
+    table_type solution_{};
     size_t num_rows_{0};
     size_t num_keys_{0};
     uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
+    // Sharded builds only: shard s owns rows [shard_rows_[s],
+    // shard_rows_[s + 1]) and was solved with shard_seeds_[s]. Both are
+    // empty for a single band over all rows.
+    std::vector<uint64_t> shard_rows_{};
+    std::vector<uint64_t> shard_seeds_{};
 
     struct row {
         size_t start;
@@ -74,13 +119,14 @@ private:
         value_type value;
     };
 
-    // Computed from key alone: deterministic given (key, seed, num_rows).
-    // Used both at build and at query.
-    std::pair<size_t, uint64_t> row_spec_for(std::string_view key) const noexcept {
-        uint64_t h = membership_fingerprint(key) ^ seed_;
+    friend class ribbon_retrieval_view<M, Layout>;
+
+    // Band start and coefficients of a seeded fingerprint h over a band of
+    // num_rows rows. Used both at build and at query.
+    static std::pair<size_t, uint64_t> band(uint64_t h, size_t num_rows) noexcept {
         size_t start = 0;
-        if (num_rows_ > W) {
-            start = static_cast<size_t>((h >> 32) % (num_rows_ - W + 1));
+        if (num_rows > W) {
+            start = static_cast<size_t>((h >> 32) % (num_rows - W + 1));
         }
         uint64_t c = h * 0xbf58476d1ce4e5b9ULL;
         c ^= c >> 31;
@@ -88,15 +134,60 @@ private:
         return {start, c};
     }
 
+    // Shard of an (unseeded) fingerprint. Remixed so the shard does not
+    // constrain the bits band() reads.
+    static size_t shard_of(uint64_t fp, size_t shards) noexcept {
+        return static_cast<size_t>((static_cast<__uint128_t>(
+            phf_remix(fp ^ 0x6a09e667f3bcc909ULL)) * shards) >> 64);
+    }
+
+    // Global row window of fingerprint fp; shared with the view, whose
+    // shard arrays are array_views over the serialized bytes.
+    template <typename Rows, typename Seeds>
+    static std::pair<size_t, uint64_t> locate(uint64_t fp, uint64_t seed, size_t num_rows,
+                                              const Rows& shard_rows,
+                                              const Seeds& shard_seeds) noexcept {
+        if (shard_seeds.empty()) return band(fp ^ seed, num_rows);
+        const size_t s = shard_of(fp, shard_seeds.size());
+        const auto first = static_cast<size_t>(shard_rows[s]);
+        auto [start, coeffs] = band(fp ^ shard_seeds[s],
+                                    static_cast<size_t>(shard_rows[s + 1]) - first);
+        return {first + start, coeffs};
+    }
+
+    template <typename Key>
+    std::pair<size_t, uint64_t> row_spec_for(const Key& key) const noexcept {
+        return locate(membership_fingerprint(key, hash_rev_), seed_, num_rows_,
+                      shard_rows_, shard_seeds_);
+    }
+
     value_type query_row(size_t base, uint64_t coeffs) const noexcept {
-        value_type result = 0;
-        uint64_t c = coeffs;
-        while (c != 0) {
-            size_t bit = static_cast<size_t>(std::countr_zero(c));
-            result ^= solution_[base + bit];
-            c &= c - 1;
+        return solution_.query(base, coeffs);
+    }
+
+    // Width field check shared with the view; the layout and shard flags
+    // may be set.
+    static bool width_matches(uint32_t width) noexcept {
+        return (width & ~(WIDE_HASH_FLAG | INTERLEAVED_SOLUTION_FLAG | SHARDED_RIBBON_FLAG)) == M;
+    }
+
+    // A query window reads rows [start, start + W), so a non-empty solution
+    // needs at least W rows, and so does every shard.
+    static bool rows_fit(bool empty, size_t num_rows) noexcept {
+        return empty || num_rows >= W;
+    }
+
+    template <typename Rows, typename Seeds>
+    static bool shards_fit(const Rows& shard_rows, const Seeds& shard_seeds,
+                           size_t num_rows) noexcept {
+        if (shard_seeds.empty() || shard_rows.size() != shard_seeds.size() + 1) return false;
+        if (shard_rows[0] != 0 || shard_rows[shard_rows.size() - 1] != num_rows) return false;
+        for (size_t s = 0; s + 1 < shard_rows.size(); ++s) {
+            if (shard_rows[s + 1] < shard_rows[s] || shard_rows[s + 1] - shard_rows[s] < W) {
+                return false;
+            }
         }
-        return result;
+        return true;
     }
 
 public:
@@ -108,6 +199,31 @@ public:
         return query_row(start, coeffs);
     }
 
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept {
+        if (solution_.empty()) return value_type{0};
+        auto [start, coeffs] = row_spec_for(hk);
+        return query_row(start, coeffs);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] value_type lookup(const hash128& digest) const noexcept {
+        return lookup(hashed_key{digest});
+    }
+
+    /// Prefetch the first and last rows of lookup(hk)'s window.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (solution_.empty()) return;
+        const size_t start = row_spec_for(hk).first;
+        detail::prefetch_read(solution_.address(start));
+        detail::prefetch_read(solution_.address(start + W - 1));
+    }
+
     [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
     [[nodiscard]] size_t value_bits() const noexcept { return M; }
 
@@ -118,66 +234,188 @@ public:
     }
 
     [[nodiscard]] size_t memory_bytes() const noexcept {
-        return solution_.size() * sizeof(value_type);
+        return solution_.memory_bytes()
+             + (shard_rows_.size() + shard_seeds_.size()) * sizeof(uint64_t);
+    }
+
+    [[nodiscard]] size_t heap_bytes() const noexcept {
+        return solution_.heap_bytes()
+             + detail::allocated_bytes(shard_rows_) + detail::allocated_bytes(shard_seeds_);
     }
 
     [[nodiscard]] size_t num_rows() const noexcept { return num_rows_; }
     [[nodiscard]] uint64_t seed() const noexcept { return seed_; }
+    /// Independently solved shards; 1 for an unsharded build.
+    [[nodiscard]] size_t num_shards() const noexcept {
+        return shard_seeds_.empty() ? 1 : shard_seeds_.size();
+    }
+    [[nodiscard]] hash_revision revision() const noexcept { return hash_rev_; }
+    /// Shard s owns rows [shard_rows()[s], shard_rows()[s + 1]) and was
+    /// solved with shard_seeds()[s]; both empty for an unsharded build.
+    [[nodiscard]] std::span<const uint64_t> shard_rows() const noexcept { return shard_rows_; }
+    [[nodiscard]] std::span<const uint64_t> shard_seeds() const noexcept { return shard_seeds_; }
+    /// The solution as one value per row, whatever the layout; empty when
+    /// no keys were added (every lookup is then 0).
+    [[nodiscard]] std::vector<value_type> solution_rows() const {
+        if (solution_.empty()) return {};
+        return solution_.rows(num_rows_);
+    }
 
     [[nodiscard]] std::vector<std::byte> serialize() const {
         std::vector<std::byte> out;
-        phf_serial::append(out, static_cast<uint32_t>(M));
+        uint32_t width = M | Layout::layout_flag;
+        if (hash_rev_ == hash_revision::wide) width |= WIDE_HASH_FLAG;
+        if (!shard_seeds_.empty()) width |= SHARDED_RIBBON_FLAG;
+        phf_serial::append(out, width);
         phf_serial::append(out, seed_);
         phf_serial::append(out, static_cast<uint64_t>(num_rows_));
         phf_serial::append(out, static_cast<uint64_t>(num_keys_));
-        phf_serial::append_vector(out, solution_);
+        if (!shard_seeds_.empty()) {
+            phf_serial::append_vector(out, shard_rows_);
+            phf_serial::append_vector(out, shard_seeds_);
+        }
+        solution_.serialize(out);
         return out;
     }
 
+    /// Loads blobs of either solution layout; the other one is converted.
     [[nodiscard]] static result<ribbon_retrieval>
     deserialize(std::span<const std::byte> bytes) {
         phf_serial::reader r{bytes};
         uint32_t width{};
         uint64_t seed{}, nrows{}, nkeys{};
-        if (!r.read(width) || width != M) return std::unexpected(error::invalid_format);
+        if (!r.read(width) || !width_matches(width)) {
+            return std::unexpected(error::invalid_format);
+        }
         if (!r.read(seed) || !r.read(nrows) || !r.read(nkeys)) {
             return std::unexpected(error::invalid_format);
         }
         ribbon_retrieval out;
         out.seed_ = seed;
+        out.hash_rev_ = phf_serial::revision_for_width_field(width);
         out.num_rows_ = static_cast<size_t>(nrows);
         out.num_keys_ = static_cast<size_t>(nkeys);
-        if (!r.read_vector(out.solution_)) return std::unexpected(error::invalid_format);
+        if ((width & SHARDED_RIBBON_FLAG) != 0 &&
+            (!r.read_vector(out.shard_rows_) || !r.read_vector(out.shard_seeds_) ||
+             !shards_fit(out.shard_rows_, out.shard_seeds_, out.num_rows_))) {
+            return std::unexpected(error::invalid_format);
+        }
+        if ((width & INTERLEAVED_SOLUTION_FLAG) == Layout::layout_flag) {
+            if (!out.solution_.deserialize(r, out.num_rows_)) {
+                return std::unexpected(error::invalid_format);
+            }
+        } else {
+            using other = std::conditional_t<std::same_as<Layout, flat_solution>,
+                                             interleaved_solution, flat_solution>;
+            table_for<other, detail::owned_array> stored;
+            if (!stored.deserialize(r, out.num_rows_)) {
+                return std::unexpected(error::invalid_format);
+            }
+            if (!stored.empty()) out.solution_ = table_type{stored.rows(out.num_rows_)};
+        }
+        if (!rows_fit(out.solution_.empty(), out.num_rows_)) {
+            return std::unexpected(error::invalid_format);
+        }
         return out;
     }
 
     // ===== Builder =====
 
+    /// Keys at or below shard_keys (default DEFAULT_SHARD_KEYS) are solved
+    /// as one band, exactly as before sharding existed. Larger sets are
+    /// split by hash into ceil(n / shard_keys) shards with their own rows
+    /// and seed. Shards are solved on with_threads(n) workers and a
+    /// failed shard retries alone. The result does not depend on the
+    /// thread count.
+    static constexpr size_t DEFAULT_SHARD_KEYS = size_t{1} << 16;
+
     class builder {
-        std::vector<std::pair<std::string, value_type>> pairs_{};
+        // A key reduced to what the solver needs.
+        struct entry {
+            uint64_t fp;
+            value_type value;
+        };
+
+        struct shard_solution {
+            uint64_t seed{0};
+            std::vector<value_type> rows{};
+        };
+
+        detail::key_store keys_{};
+        std::vector<value_type> values_{};
+        std::vector<hash128> hashes_{};  // add_hashes(), values in hash_values_
+        std::vector<value_type> hash_values_{};
         uint64_t seed_{42};
         // 0 => auto: min-space at small N, more slack at large N so a
         // fixed band width (W=64) can always solve the linear system.
         // Users can override via with_epsilon().
         double epsilon_{0.0};
         size_t max_attempts_{50};
+        size_t shard_keys_{DEFAULT_SHARD_KEYS};
+        size_t threads_{1};  // 0 = auto (hardware_concurrency), 1 = sequential
+        executor* executor_{nullptr};
+        build_report* report_{nullptr};
 
     public:
         builder() = default;
 
         builder& add(std::string_view key, value_type value) {
-            pairs_.emplace_back(std::string{key},
-                static_cast<value_type>(value & value_mask_));
+            keys_.add(key);
+            values_.push_back(static_cast<value_type>(value & value_mask_));
             return *this;
         }
 
         builder& add_all(std::span<const std::string> keys,
                          std::span<const value_type> values) {
             size_t n = keys.size() < values.size() ? keys.size() : values.size();
-            pairs_.reserve(pairs_.size() + n);
-            for (size_t i = 0; i < n; ++i) {
-                pairs_.emplace_back(keys[i],
-                    static_cast<value_type>(values[i] & value_mask_));
+            keys_.add_all(keys.first(n));
+            append_values(values.first(n));
+            return *this;
+        }
+
+        builder& add_all(std::span<const std::string_view> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            append_values(values.first(n));
+            return *this;
+        }
+
+        // Integer keys stand for their little-endian bytes (integer_key).
+        template<integer_key K>
+        builder& add(const K& key, value_type value) {
+            keys_.add(key);
+            values_.push_back(static_cast<value_type>(value & value_mask_));
+            return *this;
+        }
+
+        builder& add_all(std::span<const uint64_t> keys,
+                         std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.add_all(keys.first(n));
+            append_values(values.first(n));
+            return *this;
+        }
+
+        // See key_store::borrow_all.
+        builder& borrow_all(std::span<const std::string_view> keys,
+                            std::span<const value_type> values) {
+            size_t n = keys.size() < values.size() ? keys.size() : values.size();
+            keys_.borrow_all(keys.first(n));
+            append_values(values.first(n));
+            return *this;
+        }
+
+        // Keys known only by their digest, phf_hash128(key); the key bytes
+        // are never stored. build() returns error::duplicate_key if two
+        // digests (or a digest and an added key's) are equal.
+        builder& add_hashes(std::span<const hash128> digests,
+                            std::span<const value_type> values) {
+            size_t n = digests.size() < values.size() ? digests.size() : values.size();
+            hashes_.insert(hashes_.end(), digests.begin(), digests.begin() + n);
+            hash_values_.reserve(hash_values_.size() + n);
+            for (value_type v : values.first(n)) {
+                hash_values_.push_back(static_cast<value_type>(v & value_mask_));
             }
             return *this;
         }
@@ -185,11 +423,11 @@ public:
         template <typename ValueFn>
             requires std::invocable<ValueFn, std::string_view>
         builder& add_all_with(std::span<const std::string> keys, ValueFn fn) {
-            pairs_.reserve(pairs_.size() + keys.size());
+            keys_.add_all(keys);
+            values_.reserve(values_.size() + keys.size());
             for (const auto& k : keys) {
-                value_type v = static_cast<value_type>(
-                    static_cast<uint64_t>(fn(std::string_view{k})) & value_mask_);
-                pairs_.emplace_back(k, v);
+                values_.push_back(static_cast<value_type>(
+                    static_cast<uint64_t>(fn(std::string_view{k})) & value_mask_));
             }
             return *this;
         }
@@ -197,43 +435,198 @@ public:
         builder& with_seed(uint64_t s) { seed_ = s; return *this; }
         builder& with_epsilon(double e) { epsilon_ = e; return *this; }
         builder& with_max_attempts(size_t a) { max_attempts_ = a; return *this; }
+        /// Target keys per shard; 0 always builds a single band.
+        builder& with_shard_keys(size_t k) { shard_keys_ = k; return *this; }
+        builder& with_threads(size_t n) { threads_ = n; return *this; }
+        // Solve shards on a shared pool; its size replaces with_threads.
+        builder& with_executor(executor& ex) { executor_ = &ex; return *this; }
+        // See build_report.hpp. Attempts and ribbon_retries count solves
+        // over every shard; seeds are kept for a single band only.
+        builder& with_report(build_report& report) { report_ = &report; return *this; }
 
         [[nodiscard]] result<ribbon_retrieval> build() {
-            if (pairs_.empty()) return std::unexpected(error::optimization_failed);
-
-            size_t n = pairs_.size();
-            // Auto-scale epsilon: fixed bandwidth W=64 cannot solve the
-            // sparse banded GF(2) system reliably at large N without
-            // some slack. 0.08 is near-optimal for N <= 1M; we add
-            // ~0.02 per 10x growth beyond that. Floor at 0.08 for
-            // small N to preserve tight packing.
-            double eps = epsilon_;
-            if (eps <= 0.0) {
-                double d = std::log10(static_cast<double>(n) + 1.0) - 6.0;  // log10(n/1M)
-                eps = 0.08 + 0.02 * std::max(0.0, d);
-                if (eps > 0.20) eps = 0.20;
+            if (keys_.empty() && hashes_.empty()) return std::unexpected(error::optimization_failed);
+            const detail::build_recorder rec{report_};
+
+            // Equal keys are only caught by the solver when their values
+            // differ; equal digests are refused outright.
+            if (!hashes_.empty()) {
+                std::vector<hash128> all(hashes_);
+                if (!detail::merge_digests(all, keys_.views())) {
+                    return std::unexpected(error::duplicate_key);
+                }
+            }
+
+            const size_t from_keys = keys_.size();
+            const size_t n = from_keys + hashes_.size();
+            size_t nthreads = executor_ != nullptr ? executor_->size() : threads_;
+            if (nthreads == 0) {
+                nthreads = std::max<size_t>(1u, std::thread::hardware_concurrency());
+            }
+            detail::executor_scope scope{executor_};
+
+            // Hash every key once; attempts only XOR in their seed.
+            std::vector<entry> entries(n);
+            {
+                auto timed = rec.time(build_report::phase::hash);
+                detail::parallel_chunks(n, detail::effective_threads(n, nthreads),
+                    [&](size_t, size_t lo, size_t hi) {
+                        const size_t mid = std::clamp(from_keys, lo, hi);
+                        detail::for_each_digest(keys_.views(), lo, mid, [&](size_t i, const hash128& d) {
+                            entries[i] = entry{membership_fingerprint(d), values_[i]};
+                        });
+                        for (size_t i = mid; i < hi; ++i) {
+                            entries[i] = entry{membership_fingerprint(hashes_[i - from_keys]),
+                                               hash_values_[i - from_keys]};
+                        }
+                    });
+            }
+
+            ribbon_retrieval out;
+            out.num_keys_ = n;
+            out.seed_ = seed_;
+            if (shard_keys_ == 0 || n <= shard_keys_) {
+                std::mt19937_64 rng{seed_};
+                size_t tries = 0;
+                auto searching = rec.time(build_report::phase::pilot_search);
+                auto solved = solve(entries, rng, tries, rec ? &rec->seeds : nullptr);
+                searching.stop();
+                if (rec) {
+                    rec->attempts = tries;
+                    rec->ribbon_retries = solved ? tries - 1 : tries;
+                    rec.scratch(entries.size() * sizeof(entry) + solve_bytes(n));
+                }
+                if (!solved) {
+                    rec.finish(n, 0);
+                    return std::unexpected(error::optimization_failed);
+                }
+                out.seed_ = solved->seed;
+                out.num_rows_ = solved->rows.size();
+                out.solution_ = table_type{std::move(solved->rows)};
+                rec.finish(n, out.num_rows_);
+                return out;
             }
-            std::mt19937_64 rng{seed_};
+
+            const size_t shards = (n + shard_keys_ - 1) / shard_keys_;
+            std::vector<size_t> offsets;
+            {
+                auto timed = rec.time(build_report::phase::sort);
+                offsets = detail::radix_partition(entries, shards,
+                    [&](size_t i) { return shard_of(entries[i].fp, shards); }, nthreads);
+            }
+
+            // Shards are claimed from a shared counter; shard s draws its
+            // seeds from its own generator, so any thread may solve it.
+            std::vector<shard_solution> solved(shards);
+            std::vector<size_t> tries(shards, 0);
+            std::atomic<size_t> next_shard{0};
+            std::atomic<bool> failed{false};
+            auto worker = [&]() {
+                while (!failed.load(std::memory_order_acquire)) {
+                    const size_t s = next_shard.fetch_add(1, std::memory_order_relaxed);
+                    if (s >= shards) break;
+                    std::mt19937_64 rng{seed_ + s * 0x9e3779b97f4a7c15ULL};
+                    auto part = solve(std::span<const entry>{entries}.subspan(
+                        offsets[s], offsets[s + 1] - offsets[s]), rng, tries[s]);
+                    if (!part) {
+                        failed.store(true, std::memory_order_release);
+                        return;
+                    }
+                    solved[s] = std::move(*part);
+                }
+            };
+            const size_t workers = std::min(nthreads, shards);
+            {
+                auto timed = rec.time(build_report::phase::pilot_search);
+                detail::run_workers(workers, worker);
+            }
+            if (rec) {
+                size_t largest = 0;
+                for (size_t s = 0; s < shards; ++s) {
+                    rec->attempts += tries[s];
+                    rec->ribbon_retries += tries[s] - (solved[s].rows.empty() ? 0 : 1);
+                    largest = std::max(largest, offsets[s + 1] - offsets[s]);
+                }
+                rec.scratch(entries.size() * sizeof(entry) + workers * solve_bytes(largest));
+            }
+            if (failed.load(std::memory_order_acquire)) {
+                rec.finish(n, 0);
+                return std::unexpected(error::optimization_failed);
+            }
+            auto encoding = rec.time(build_report::phase::encode);
+
+            out.shard_rows_.assign(shards + 1, 0);
+            out.shard_seeds_.resize(shards);
+            for (size_t s = 0; s < shards; ++s) {
+                out.shard_rows_[s + 1] = out.shard_rows_[s] + solved[s].rows.size();
+                out.shard_seeds_[s] = solved[s].seed;
+            }
+            out.num_rows_ = static_cast<size_t>(out.shard_rows_.back());
+            std::vector<value_type> rows(out.num_rows_);
+            for (size_t s = 0; s < shards; ++s) {
+                std::copy(solved[s].rows.begin(), solved[s].rows.end(),
+                          rows.begin() + static_cast<std::ptrdiff_t>(out.shard_rows_[s]));
+                std::vector<value_type>{}.swap(solved[s].rows);
+            }
+            out.solution_ = table_type{std::move(rows)};
+            encoding.stop();
+            rec.finish(n, out.num_rows_);
+            return out;
+        }
+
+    private:
+        void append_values(std::span<const value_type> values) {
+            values_.reserve(values_.size() + values.size());
+            for (value_type v : values) {
+                values_.push_back(static_cast<value_type>(v & value_mask_));
+            }
+        }
+
+        // Auto-scale epsilon: fixed bandwidth W=64 cannot solve the
+        // sparse banded GF(2) system reliably at large N without
+        // some slack. 0.08 is near-optimal for N <= 1M; we add
+        // ~0.02 per 10x growth beyond that. Floor at 0.08 for
+        // small N to preserve tight packing.
+        double epsilon_for(size_t n) const noexcept {
+            if (epsilon_ > 0.0) return epsilon_;
+            double d = std::log10(static_cast<double>(n) + 1.0) - 6.0;  // log10(n/1M)
+            return std::min(0.20, 0.08 + 0.02 * std::max(0.0, d));
+        }
+
+        // Rows and pivots solve() holds for a band of n entries.
+        size_t solve_bytes(size_t n) const noexcept {
+            const size_t num_rows = n + std::max(W, static_cast<size_t>(
+                static_cast<double>(n) * epsilon_for(n)));
+            return n * sizeof(row) + num_rows * (sizeof(uint64_t) + 2 * sizeof(value_type));
+        }
+
+        // Solve one band over `entries`, drawing a seed from rng per
+        // attempt. Returns the seed and the solved rows; tries counts the
+        // attempts, and their seeds go to `seeds` if given.
+        std::optional<shard_solution> solve(std::span<const entry> entries,
+                                            std::mt19937_64& rng, size_t& tries,
+                                            std::vector<uint64_t>* seeds = nullptr) const {
+            const size_t n = entries.size();
+            const double eps = epsilon_for(n);
+            const size_t num_rows = n + std::max(W, static_cast<size_t>(
+                static_cast<double>(n) * eps));
+            std::vector<row> rows(n);
+            std::vector<uint64_t> pivot_coeffs(num_rows);
+            std::vector<value_type> pivot_value(num_rows);
 
             for (size_t attempt = 0; attempt < max_attempts_; ++attempt) {
-                ribbon_retrieval out;
-                out.seed_ = rng();
-                out.num_keys_ = n;
-                size_t extra = std::max(W, static_cast<size_t>(
-                    static_cast<double>(n) * eps));
-                out.num_rows_ = n + extra;
-
-                std::vector<row> rows;
-                rows.reserve(n);
-                for (const auto& [k, v] : pairs_) {
-                    auto [start, coeffs] = out.row_spec_for(k);
-                    rows.push_back(row{start, coeffs, v});
+                const uint64_t seed = rng();
+                ++tries;
+                if (seeds != nullptr) seeds->push_back(seed);
+                for (size_t i = 0; i < n; ++i) {
+                    auto [start, coeffs] = band(entries[i].fp ^ seed, num_rows);
+                    rows[i] = row{start, coeffs, entries[i].value};
                 }
                 std::sort(rows.begin(), rows.end(),
                     [](const row& a, const row& b){ return a.start < b.start; });
 
-                std::vector<uint64_t> pivot_coeffs(out.num_rows_, 0);
-                std::vector<value_type> pivot_value(out.num_rows_, 0);
+                std::fill(pivot_coeffs.begin(), pivot_coeffs.end(), 0);
+                std::fill(pivot_value.begin(), pivot_value.end(), value_type{0});
                 bool ok = true;
 
                 for (auto& r : rows) {
@@ -243,7 +636,7 @@ public:
                     while (c != 0) {
                         size_t bit = static_cast<size_t>(std::countr_zero(c));
                         size_t col = base + bit;
-                        if (col >= out.num_rows_) { ok = false; break; }
+                        if (col >= num_rows) { ok = false; break; }
 
                         if (pivot_coeffs[col] == 0) {
                             pivot_coeffs[col] = c >> bit;
@@ -258,8 +651,9 @@ public:
                 }
                 if (!ok) continue;
 
-                out.solution_.assign(out.num_rows_, 0);
-                for (size_t col = out.num_rows_; col-- > 0;) {
+                shard_solution out{seed, std::vector<value_type>(num_rows, 0)};
+                auto& solution = out.rows;
+                for (size_t col = num_rows; col-- > 0;) {
                     if (pivot_coeffs[col] == 0) continue;
                     uint64_t c = pivot_coeffs[col];
                     value_type val = pivot_value[col];
@@ -268,25 +662,161 @@ public:
                     while (rest != 0) {
                         size_t bit = static_cast<size_t>(std::countr_zero(rest));
                         size_t ref = col + offset + bit;
-                        if (ref < out.num_rows_) {
-                            val = static_cast<value_type>(val ^ out.solution_[ref]);
+                        if (ref < num_rows) {
+                            val = static_cast<value_type>(val ^ solution[ref]);
                         }
                         rest >>= (bit + 1);
                         offset += bit + 1;
                     }
-                    out.solution_[col] = val;
+                    solution[col] = val;
                 }
 
+                // A key added twice with different values reduces to an
+                // empty row during elimination; it fails here.
                 bool verified = true;
-                for (const auto& [k, v] : pairs_) {
-                    auto [start, coeffs] = out.row_spec_for(k);
-                    if (out.query_row(start, coeffs) != v) { verified = false; break; }
+                for (const auto& e : entries) {
+                    auto [start, coeffs] = band(e.fp ^ seed, num_rows);
+                    value_type v = 0;
+                    for (uint64_t c = coeffs; c != 0; c &= c - 1) {
+                        v = static_cast<value_type>(
+                            v ^ solution[start + static_cast<size_t>(std::countr_zero(c))]);
+                    }
+                    if (v != e.value) { verified = false; break; }
                 }
                 if (verified) return out;
             }
-            return std::unexpected(error::optimization_failed);
+            return std::nullopt;
         }
     };
 };
 
+/**
+ * ribbon_retrieval_view: ribbon_retrieval queried in place over its
+ * serialized bytes. The solution array is read where it lies in the
+ * buffer, so the buffer (typically a mapped file) must outlive the view.
+ * Same format and same lookup() results as ribbon_retrieval<M, Layout>;
+ * bytes written with the other solution layout are rejected.
+ */
+template <unsigned M, ribbon_solution_layout Layout>
+    requires (M >= 1 && M <= 64)
+class ribbon_retrieval_view {
+    using owner = ribbon_retrieval<M, Layout>;
+
+public:
+    using value_type = typename owner::value_type;
+
+    static constexpr unsigned value_bits_v = M;
+
+private:
+    typename owner::template table_for<Layout, phf_serial::array_view> solution_{};
+    std::span<const std::byte> bytes_{};
+    size_t num_rows_{0};
+    size_t num_keys_{0};
+    uint64_t seed_{0};
+    hash_revision hash_rev_{hash_revision::wide};
+    phf_serial::array_view<uint64_t> shard_rows_{};
+    phf_serial::array_view<uint64_t> shard_seeds_{};
+
+    template <typename Key>
+    std::pair<size_t, uint64_t> row_spec_for(const Key& key) const noexcept {
+        return owner::locate(membership_fingerprint(key, hash_rev_), seed_,
+                             num_rows_, shard_rows_, shard_seeds_);
+    }
+
+    template <typename Key>
+    value_type lookup_impl(const Key& key) const noexcept {
+        if (solution_.empty()) return value_type{0};
+        auto [start, coeffs] = row_spec_for(key);
+        return solution_.query(start, coeffs);
+    }
+
+public:
+    ribbon_retrieval_view() = default;
+
+    [[nodiscard]] value_type lookup(std::string_view key) const noexcept {
+        return lookup_impl(key);
+    }
+
+    [[nodiscard]] value_type lookup(const hashed_key& hk) const noexcept {
+        return lookup_impl(hk);
+    }
+
+    template<integer_key K>
+    [[nodiscard]] value_type lookup(K key) const noexcept {
+        return lookup(hashed_key{key});
+    }
+
+    /// A key added by its digest (builder::add_hashes). Requires
+    /// hash_revision::wide; see hashed_key(const hash128&).
+    [[nodiscard]] value_type lookup(const hash128& digest) const noexcept {
+        return lookup(hashed_key{digest});
+    }
+
+    /// Prefetch the first and last rows of lookup(hk)'s window.
+    void prefetch(const hashed_key& hk) const noexcept {
+        if (solution_.empty()) return;
+        const size_t start = row_spec_for(hk).first;
+        detail::prefetch_read(solution_.address(start));
+        detail::prefetch_read(solution_.address(start + owner::W - 1));
+    }
+
+    [[nodiscard]] size_t num_keys() const noexcept { return num_keys_; }
+    [[nodiscard]] size_t value_bits() const noexcept { return M; }
+
+    [[nodiscard]] double bits_per_key() const noexcept {
+        if (num_keys_ == 0) return 0.0;
+        return static_cast<double>(num_rows_) * static_cast<double>(M)
+             / static_cast<double>(num_keys_);
+    }
+
+    [[nodiscard]] size_t memory_bytes() const noexcept {
+        return solution_.memory_bytes() + shard_rows_.size_bytes() + shard_seeds_.size_bytes();
+    }
+
+    [[nodiscard]] size_t num_rows() const noexcept { return num_rows_; }
+    [[nodiscard]] uint64_t seed() const noexcept { return seed_; }
+    [[nodiscard]] size_t num_shards() const noexcept {
+        return shard_seeds_.empty() ? 1 : shard_seeds_.size();
+    }
+
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return bytes_; }
+
+    [[nodiscard]] std::vector<std::byte> serialize() const {
+        return {bytes_.begin(), bytes_.end()};
+    }
+
+    /// Bind to bytes written by ribbon_retrieval<M, Layout>::serialize().
+    /// Rejects a solution sized for another row count, which the query
+    /// window would overrun.
+    [[nodiscard]] static result<ribbon_retrieval_view>
+    deserialize(std::span<const std::byte> bytes) {
+        phf_serial::reader r{bytes};
+        uint32_t width{};
+        uint64_t seed{}, nrows{}, nkeys{};
+        if (!r.read(width) || !owner::width_matches(width) ||
+            (width & INTERLEAVED_SOLUTION_FLAG) != Layout::layout_flag) {
+            return std::unexpected(error::invalid_format);
+        }
+        if (!r.read(seed) || !r.read(nrows) || !r.read(nkeys)) {
+            return std::unexpected(error::invalid_format);
+        }
+        ribbon_retrieval_view out;
+        out.seed_ = seed;
+        out.hash_rev_ = phf_serial::revision_for_width_field(width);
+        out.num_rows_ = static_cast<size_t>(nrows);
+        out.num_keys_ = static_cast<size_t>(nkeys);
+        if ((width & SHARDED_RIBBON_FLAG) != 0 &&
+            (!r.read_array(out.shard_rows_) || !r.read_array(out.shard_seeds_) ||
+             !owner::shards_fit(out.shard_rows_, out.shard_seeds_, out.num_rows_))) {
+            return std::unexpected(error::invalid_format);
+        }
+        if (!out.solution_.deserialize(r, out.num_rows_) ||
+            !owner::rows_fit(out.solution_.empty(), out.num_rows_)) {
+            return std::unexpected(error::invalid_format);
+        }
+        out.bytes_ = bytes.first(r.offset());
+        return out;
+    }
+};
+
 } // namespace maph
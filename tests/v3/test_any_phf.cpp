@@ -0,0 +1,168 @@
+/**
+ * @file test_any_phf.cpp
+ * @brief Tests for any_phf and any_retrieval, the type-erased handles.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/composition/any_phf.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 31) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Loads P's bytes as an any_phf and checks it is a P answering like p.
+template<typename P>
+void check_loads_as(const P& p, const std::vector<std::string>& keys,
+                    std::span<const std::byte> bytes) {
+    auto a = any_phf::deserialize(bytes);
+    REQUIRE(a.has_value());
+    REQUIRE(a->target<P>() != nullptr);
+    REQUIRE(a->num_keys() == p.num_keys());
+    REQUIRE(a->range_size() == p.range_size());
+    REQUIRE(a->algorithm_id() == detail::container_algorithm<P>());
+
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    std::vector<slot_index> out(queries.size());
+    a->slot_for_batch(queries, out);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const auto want = p.slot_for(keys[i]);
+        REQUIRE(a->slot_for(keys[i]) == want);
+        REQUIRE(a->slot_for(hashed_key{keys[i]}) == want);
+        REQUIRE(out[i] == want);
+    }
+}
+
+} // namespace
+
+TEST_CASE("any_phf: loads each algorithm from its serialized bytes", "[any_phf]") {
+    auto keys = make_keys(3000);
+
+    SECTION("phobic, by bucket size") {
+        auto p5 = phobic5::builder{}.add_all(keys).build();
+        auto p4 = phobic4::builder{}.add_all(keys).build();
+        REQUIRE(p5.has_value());
+        REQUIRE(p4.has_value());
+        check_loads_as(*p5, keys, p5->serialize());
+        check_loads_as(*p4, keys, p4->serialize());
+    }
+    SECTION("partitioned_phf, raw and as a container") {
+        auto p = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(3).build();
+        REQUIRE(p.has_value());
+        check_loads_as(*p, keys, p->serialize());
+        check_loads_as(*p, keys, to_container(*p));
+    }
+    SECTION("recsplit, bbhash, chd") {
+        auto r = recsplit8::builder{}.add_all(keys).build();
+        auto b = bbhash3::builder{}.add_all(keys).build();
+        auto c = chd_hasher::builder{}.add_all(keys).build();
+        REQUIRE(r.has_value());
+        REQUIRE(b.has_value());
+        REQUIRE(c.has_value());
+        check_loads_as(*r, keys, r->serialize());
+        check_loads_as(*b, keys, b->serialize());
+        check_loads_as(*c, keys, c->serialize());
+    }
+    SECTION("shock_hash, which has no standard header") {
+        auto s = shock_hash<64>::builder{}.add_all(keys).build();
+        REQUIRE(s.has_value());
+        check_loads_as(*s, keys, s->serialize());
+    }
+}
+
+TEST_CASE("any_phf: wraps a built PHF and refuses unknown bytes", "[any_phf]") {
+    auto keys = make_keys(2000);
+    auto p = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(p.has_value());
+    const auto bytes = p->serialize();
+
+    any_phf a{std::move(*p)};
+    static_assert(perfect_hash_function<any_phf>);
+    REQUIRE(a.has_value());
+    REQUIRE(a.serialize() == bytes);
+    REQUIRE(a.target<phobic4>() == nullptr);
+    REQUIRE(a.memory_bytes() > a.target<phobic5>()->memory_bytes());
+
+    // Copies share the structure.
+    any_phf b = a;
+    REQUIRE(b.target<phobic5>() == a.target<phobic5>());
+
+    // Only the listed types are candidates.
+    REQUIRE_FALSE(any_phf::deserialize<phf_types<phobic4, recsplit8>>(bytes).has_value());
+    REQUIRE(any_phf::deserialize<phf_types<phobic4, phobic5>>(bytes).has_value());
+
+    for (size_t cut : {size_t{0}, size_t{11}, bytes.size() / 2}) {
+        REQUIRE_FALSE(any_phf::deserialize(std::span<const std::byte>(bytes).first(cut)).has_value());
+    }
+    auto damaged = bytes;
+    damaged[8] = std::byte{99};  // an algorithm id nothing has
+    REQUIRE_FALSE(any_phf::deserialize(damaged).has_value());
+
+    any_phf empty;
+    REQUIRE_FALSE(empty.has_value());
+    REQUIRE(empty.num_keys() == 0);
+    REQUIRE(empty.serialize().empty());
+}
+
+TEST_CASE("any_retrieval: loads by value width and batches through one call", "[any_phf][retrieval]") {
+    auto keys = make_keys(4000);
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+
+    SECTION("ribbon_retrieval of two widths") {
+        std::vector<uint8_t> v8(keys.size());
+        std::vector<uint32_t> v32(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            v8[i] = static_cast<uint8_t>(i * 7);
+            v32[i] = static_cast<uint32_t>(i * 2654435761u);
+        }
+        auto r8 = ribbon_retrieval<8>::builder{}.add_all(keys, v8).build();
+        auto r32 = ribbon_retrieval<32>::builder{}.add_all(keys, v32).build();
+        REQUIRE(r8.has_value());
+        REQUIRE(r32.has_value());
+
+        auto a8 = any_retrieval::deserialize(r8->serialize());
+        auto a32 = any_retrieval::deserialize(r32->serialize());
+        REQUIRE(a8.has_value());
+        REQUIRE(a32.has_value());
+        REQUIRE(a8->target<ribbon_retrieval<8>>() != nullptr);
+        REQUIRE(a32->value_bits() == 32);
+
+        std::vector<uint64_t> out(keys.size());
+        a32->lookup_batch(queries, out);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(a8->lookup(keys[i]) == v8[i]);
+            REQUIRE(a32->lookup(hashed_key{keys[i]}) == v32[i]);
+            REQUIRE(out[i] == v32[i]);
+        }
+    }
+    SECTION("phf_value_array from a caller's type list, using its own batch") {
+        using M = phf_value_array<phobic5, 12>;
+        std::vector<uint16_t> values(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) values[i] = static_cast<uint16_t>(i & 0xfff);
+        auto m = M::builder{}.add_all(keys, values).build();
+        REQUIRE(m.has_value());
+
+        auto a = any_retrieval::deserialize<phf_types<ribbon_retrieval<12>, M>>(to_container(*m));
+        REQUIRE(a.has_value());
+        REQUIRE(a->target<M>() != nullptr);
+        std::vector<uint64_t> out(keys.size());
+        a->lookup_batch(queries, out);
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(out[i] == values[i]);
+    }
+}
@@ -0,0 +1,136 @@
+/**
+ * @file test_auto_builder.cpp
+ * @brief Tests for auto_builder / auto_retrieval_builder: the structure
+ *        returned is the best calibrated candidate within the limits.
+ *
+ * Timings vary from run to run, so the checks are on the choice given
+ * the report's own numbers, not on the numbers themselves.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/composition/auto_builder.hpp>
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 58) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+void require_minimal_perfect(const any_phf& phf, const std::vector<std::string>& keys) {
+    REQUIRE(phf.num_keys() == keys.size());
+    REQUIRE(phf.range_size() == keys.size());
+    std::set<size_t> slots;
+    for (const auto& k : keys) {
+        const size_t s = phf.slot_for(k).value;
+        REQUIRE(s < keys.size());
+        slots.insert(s);
+    }
+    CHECK(slots.size() == keys.size());
+}
+
+} // namespace
+
+TEST_CASE("auto_builder: picks the best candidate within the limits", "[auto_builder]") {
+    auto keys = make_keys(20000);
+
+    SECTION("fewest bits") {
+        tuning_report report;
+        auto phf = auto_builder{}.add_all(keys).with_sample_size(4000)
+            .with_goal(tuning_goal::space).with_report(report).build();
+        REQUIRE(phf.has_value());
+        require_minimal_perfect(*phf, keys);
+
+        REQUIRE(report.candidates.size() == auto_builder::options().size());
+        CHECK(report.keys == keys.size());
+        CHECK(report.sample_keys == 4000);
+        REQUIRE(report.chosen < report.candidates.size());
+        const auto& chosen = report.candidates[report.chosen];
+        for (const auto& c : report.candidates) {
+            if (c.fits) CHECK(chosen.bits_per_key <= c.bits_per_key);
+        }
+        for (const auto& c : report.candidates) {
+            if (!c.minimal) CHECK_FALSE(c.fits);
+        }
+        // The bytes load back without naming the type.
+        auto loaded = any_phf::deserialize(phf->serialize());
+        REQUIRE(loaded.has_value());
+        CHECK(loaded->algorithm_id() == phf->algorithm_id());
+        for (size_t i = 0; i < keys.size(); i += 97) {
+            REQUIRE(loaded->slot_for(keys[i]) == phf->slot_for(keys[i]));
+        }
+    }
+
+    SECTION("fastest query under a space cap") {
+        tuning_report report;
+        auto phf = auto_builder{}.add_all(keys).with_sample_size(4000)
+            .with_max_bits_per_key(3.0).with_report(report).build();
+        REQUIRE(phf.has_value());
+        require_minimal_perfect(*phf, keys);
+        const auto& chosen = report.candidates[report.chosen];
+        CHECK(chosen.bits_per_key <= 3.0);
+        for (const auto& c : report.candidates) {
+            if (c.fits) CHECK(chosen.query_ns <= c.query_ns);
+            if (c.built && c.bits_per_key > 3.0) CHECK_FALSE(c.fits);
+        }
+    }
+
+    SECTION("non-minimal admitted") {
+        tuning_report report;
+        auto phf = auto_builder{}.add_all(keys).with_sample_size(2000).with_minimal(false)
+            .with_goal(tuning_goal::space).with_report(report).build();
+        REQUIRE(phf.has_value());
+        CHECK(phf->range_size() >= keys.size());
+        for (const auto& c : report.candidates) CHECK(c.fits == c.built);
+    }
+
+    SECTION("nothing fits") {
+        tuning_report report;
+        auto phf = auto_builder{}.add_all(keys).with_sample_size(2000)
+            .with_max_bits_per_key(0.5).with_report(report).build();
+        REQUIRE_FALSE(phf.has_value());
+        CHECK(phf.error() == error::optimization_failed);
+        CHECK(report.chosen == SIZE_MAX);
+        for (const auto& c : report.candidates) CHECK_FALSE(c.fits);
+    }
+
+    SECTION("no keys") {
+        CHECK_FALSE(auto_builder{}.build().has_value());
+    }
+}
+
+TEST_CASE("auto_retrieval_builder: every key reads its value", "[auto_builder]") {
+    auto keys = make_keys(10000, 5);
+    std::vector<uint64_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = (i * 2654435761u) & 0xff;
+
+    tuning_report report;
+    auto_retrieval_builder<8> b;
+    b.add_all(keys, values).with_sample_size(3000).with_goal(tuning_goal::space).with_report(report);
+    b.add(keys[3], 0x1ff);  // masked to 8 bits; the last value wins
+    auto r = b.build();
+    REQUIRE(r.has_value());
+    CHECK(r->num_keys() == keys.size());
+    CHECK(r->value_bits() == 8);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(r->lookup(keys[i]) == (i == 3 ? 0xff : values[i]));
+    }
+    REQUIRE(report.chosen < report.candidates.size());
+    for (const auto& c : report.candidates) {
+        if (c.fits) CHECK(report.candidates[report.chosen].bits_per_key <= c.bits_per_key);
+    }
+}
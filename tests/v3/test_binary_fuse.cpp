@@ -8,6 +8,8 @@
 #include <maph/filters/binary_fuse_filter.hpp>
 
 #include <algorithm>
+#include <memory>
+#include <span>
 #include <random>
 #include <string>
 #include <vector>
@@ -135,3 +137,85 @@ TEST_CASE("binary_fuse_filter<8>: serialize/deserialize round-trip",
         REQUIRE(restored->verify(k) == f.verify(k));
     }
 }
+
+TEST_CASE("binary_fuse_filter<16>: threaded build matches the serial one",
+          "[binary_fuse][parallel]") {
+    auto keys = make_keys(60000);
+    binary_fuse_filter<16> serial, threaded;
+    REQUIRE(serial.build(keys));
+    REQUIRE(threaded.build(keys, 4));
+    REQUIRE(threaded.serialize() == serial.serialize());
+    for (const auto& k : keys) REQUIRE(threaded.verify(k));
+}
+
+TEST_CASE("binary_fuse_filter<8>: duplicate keys are accepted", "[binary_fuse]") {
+    auto keys = make_keys(3000);
+    auto doubled = keys;
+    doubled.insert(doubled.end(), keys.begin(), keys.end());
+    binary_fuse_filter<8> f;
+    REQUIRE(f.build(doubled));
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+}
+
+TEST_CASE("binary_fuse_filter: verify_batch matches verify at every width",
+          "[binary_fuse][batch]") {
+    auto keys = make_keys(5000);
+    auto probes = keys;
+    auto unknowns = make_unknowns(3000);
+    probes.insert(probes.end(), unknowns.begin(), unknowns.end());
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    auto check = [&](auto filter) {
+        REQUIRE(filter.build(keys));
+        auto out = std::make_unique<bool[]>(views.size());
+        filter.verify_batch(views, std::span<bool>{out.get(), views.size()});
+        for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i] == filter.verify(views[i]));
+    };
+    check(binary_fuse_filter<8>{});
+    check(binary_fuse_filter<16>{});
+    check(binary_fuse_filter<32>{});
+    check(binary_fuse_filter<8, 4>{});
+    check(binary_fuse_filter<16, 4>{});
+    check(binary_fuse_filter<32, 4>{});
+}
+
+TEST_CASE("binary_fuse_filter<16, 4>: accepts S, FPR near 2^-16, smaller than 3-wise",
+          "[binary_fuse][arity4]") {
+    auto keys = make_keys(200000);
+    binary_fuse_filter<16, 4> f;
+    binary_fuse_filter<16> three;
+    REQUIRE(f.build(keys));
+    REQUIRE(three.build(keys));
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+
+    auto unknowns = make_unknowns(200000);
+    size_t false_positives = 0;
+    for (const auto& u : unknowns) {
+        if (f.verify(u)) ++false_positives;
+    }
+    REQUIRE(false_positives <= 100);
+
+    // ~1.075 * 16 against ~1.125 * 16, plus the segment tails.
+    const double bpk = f.bits_per_key(keys.size());
+    REQUIRE(bpk < 18.0);
+    REQUIRE(bpk < three.bits_per_key(keys.size()) - 0.5);
+}
+
+TEST_CASE("binary_fuse_filter<8, 4>: threaded build, round trip, arity is checked",
+          "[binary_fuse][arity4][serialize]") {
+    auto keys = make_keys(60000);
+    binary_fuse_filter<8, 4> serial, threaded;
+    REQUIRE(serial.build(keys));
+    REQUIRE(threaded.build(keys, 4));
+    REQUIRE(threaded.serialize() == serial.serialize());
+
+    auto bytes = serial.serialize();
+    auto restored = binary_fuse_filter<8, 4>::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    for (const auto& k : keys) REQUIRE(restored->verify(k));
+    REQUIRE_FALSE(binary_fuse_filter<8>::deserialize(bytes).has_value());
+
+    binary_fuse_filter<8> three;
+    REQUIRE(three.build(keys));
+    REQUIRE_FALSE(binary_fuse_filter<8, 4>::deserialize(three.serialize()).has_value());
+}
@@ -0,0 +1,160 @@
+/**
+ * @file test_block_bloom_filter.cpp
+ * @brief Tests for block_bloom_filter.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/composition/bloomier.hpp>
+#include <maph/concepts/membership_oracle.hpp>
+#include <maph/detail/container.hpp>
+#include <maph/filters/block_bloom_filter.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 7) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(6, 24);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+} // namespace
+
+static_assert(membership_oracle<block_bloom_filter<>>);
+static_assert(hashed_membership_oracle<block_bloom_filter<>>);
+
+TEST_CASE("block_bloom_filter<10>: accepts all keys in S, ~1% false positives", "[block_bloom]") {
+    auto keys = make_keys(50000);
+    block_bloom_filter<10> f;
+    REQUIRE(f.build(keys));
+    REQUIRE(f.num_keys() == keys.size());
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+
+    size_t false_positives = 0;
+    for (size_t i = 0; i < 100000; ++i) {
+        if (f.verify("UNK_" + std::to_string(i))) ++false_positives;
+    }
+    REQUIRE(false_positives < 2000);
+    REQUIRE(f.bits_per_key() < 10.1);
+}
+
+TEST_CASE("block_bloom_filter: the AVX2 block test matches the scalar one", "[block_bloom]") {
+    std::mt19937_64 rng{11};
+    for (int trial = 0; trial < 20000; ++trial) {
+        detail::bloom_block b{};
+        // Sparse to dense blocks, so both outcomes occur.
+        const int density = trial % 4;
+        for (auto& w : b.words) {
+            w = static_cast<uint32_t>(rng());
+            for (int d = 0; d < density; ++d) w |= static_cast<uint32_t>(rng());
+        }
+        const auto h = static_cast<uint32_t>(rng());
+        REQUIRE(detail::bloom_block_contains(b, h) == detail::bloom_block_contains_scalar(b, h));
+    }
+}
+
+TEST_CASE("block_bloom_filter: threaded build matches the serial one", "[block_bloom][parallel]") {
+    auto keys = make_keys(60000);
+    block_bloom_filter<12> serial, threaded;
+    REQUIRE(serial.build(keys));
+    REQUIRE(threaded.build(keys, 4));
+    REQUIRE(threaded.serialize() == serial.serialize());
+}
+
+TEST_CASE("block_bloom_filter: incremental inserts", "[block_bloom]") {
+    auto keys = make_keys(20000);
+    std::span<const std::string> all{keys};
+
+    block_bloom_filter<10> f(keys.size());
+    REQUIRE(f.capacity() == keys.size());
+    f.insert_all(all.first(5000));
+    for (size_t i = 5000; i < 10000; ++i) f.insert(keys[i]);
+    f.insert_all(all.subspan(10000), 4);
+    REQUIRE(f.num_keys() == keys.size());
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+
+    // Same keys, same capacity, one build: same table.
+    block_bloom_filter<10> built;
+    REQUIRE(built.build(keys));
+    REQUIRE(built.serialize() == f.serialize());
+}
+
+TEST_CASE("block_bloom_filter: serialize and container round trips", "[block_bloom]") {
+    auto keys = make_keys(10000);
+    block_bloom_filter<16> f;
+    REQUIRE(f.build(keys));
+
+    auto restored = block_bloom_filter<16>::deserialize(f.serialize());
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->num_keys() == f.num_keys());
+    for (const auto& k : keys) REQUIRE(restored->verify(k));
+    REQUIRE_FALSE(block_bloom_filter<10>::deserialize(f.serialize()).has_value());
+
+    auto from = from_container<block_bloom_filter<16>>(to_container(f));
+    REQUIRE(from.has_value());
+    REQUIRE(from->serialize() == f.serialize());
+}
+
+TEST_CASE("block_bloom_filter: verify_batch and integer keys", "[block_bloom][batch]") {
+    auto keys = make_keys(5000);
+    std::vector<std::string> probes = keys;
+    for (size_t i = 0; i < 3000; ++i) probes.push_back("UNK_" + std::to_string(i));
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    block_bloom_filter<10> f;
+    REQUIRE(f.build(keys));
+    auto out = std::make_unique<bool[]>(views.size());
+    f.verify_batch(views, std::span<bool>{out.get(), views.size()});
+    for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i] == f.verify(views[i]));
+    for (size_t i = 0; i < views.size(); ++i) REQUIRE(f.verify(hashed_key{views[i]}) == out[i]);
+
+    std::mt19937_64 rng{34};
+    std::vector<uint64_t> ids(10000);
+    for (auto& id : ids) id = rng();
+    block_bloom_filter<10> g;
+    REQUIRE(g.build(std::span<const uint64_t>(ids)));
+    for (const auto& id : ids) {
+        REQUIRE(g.verify(id));
+        REQUIRE(g.verify(integer_key_bytes(id)));
+    }
+}
+
+TEST_CASE("block_bloom_filter as the bloomier oracle", "[block_bloom][bloomier]") {
+    auto keys = make_keys(10000);
+    using B = bloomier<ribbon_retrieval<8>, block_bloom_filter<10>>;
+    auto b = B::builder{};
+    b.add_all_with(std::span<const std::string>{keys},
+                   [](std::string_view k) { return static_cast<uint8_t>(k.size()); });
+    auto built = b.with_threads(2).build();
+    REQUIRE(built.has_value());
+    for (const auto& k : keys) {
+        auto v = built->lookup(k);
+        REQUIRE(v.has_value());
+        REQUIRE(*v == static_cast<uint8_t>(k.size()));
+    }
+    size_t rejected = 0;
+    for (size_t i = 0; i < 10000; ++i) rejected += built->lookup("UNK_" + std::to_string(i)) ? 0 : 1;
+    REQUIRE(rejected > 9700);
+}
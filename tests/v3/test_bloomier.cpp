@@ -15,8 +15,10 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <optional>
 #include <random>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 using namespace maph;
@@ -166,6 +168,70 @@ TEST_CASE("bloomier: contains() agrees with lookup().has_value()",
     }
 }
 
+TEST_CASE("bloomier: hashed lookup agrees with oracle and retrieval on raw keys",
+          "[bloomier][hashed]") {
+    auto keys = make_keys(1000);
+    std::vector<uint16_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(det_value<16>(k)));
+
+    using B = bloomier<phf_value_array<phobic5, 16>, binary_fuse_filter<8>>;
+    auto built = B::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    auto unknowns = make_unknowns(2000);
+    std::vector<std::string> mixed(keys.begin(), keys.end());
+    mixed.insert(mixed.end(), unknowns.begin(), unknowns.end());
+
+    const auto& o = built->get_oracle();
+    const auto& r = built->get_retrieval();
+    for (const auto& k : mixed) {
+        hashed_key hk{k};
+        std::optional<uint16_t> expected;
+        if (o.verify(k)) expected = r.lookup(k);
+        REQUIRE(built->lookup(hk) == expected);
+        REQUIRE(built->lookup(k) == expected);
+        REQUIRE(built->contains(hk) == o.verify(k));
+        REQUIRE(o.verify(hk) == o.verify(k));
+        REQUIRE(r.lookup(hk) == r.lookup(k));
+    }
+}
+
+TEST_CASE("bloomier: lookup_interleaved matches lookup", "[bloomier][interleaved]") {
+    auto keys = make_keys(2000);
+    auto unknowns = make_unknowns(2000);
+    std::vector<uint8_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint8_t>(det_value<8>(k)));
+
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.insert(queries.end(), unknowns.begin(), unknowns.end());
+
+    auto check = [&](const auto& b) {
+        using V = typename std::remove_cvref_t<decltype(b)>::value_type;
+        std::vector<std::optional<V>> out(queries.size());
+        b.template lookup_interleaved<5>(queries, out);
+        for (size_t i = 0; i < queries.size(); ++i) REQUIRE(out[i] == b.lookup(queries[i]));
+
+        size_t calls = 0;
+        b.lookup_interleaved(queries, [&](size_t i, std::optional<V> v) {
+            ++calls;
+            REQUIRE(v == out[i]);
+        });
+        REQUIRE(calls == queries.size());
+    };
+
+    auto staged = bloomier<phf_value_array<phobic5, 8>, ribbon_filter<8>>::builder{}
+                      .add_all(keys, values).build();
+    REQUIRE(staged.has_value());
+    check(*staged);
+
+    auto prefetched = bloomier<ribbon_retrieval<8>, xor_filter<8>>::builder{}
+                          .add_all(keys, values).build();
+    REQUIRE(prefetched.has_value());
+    check(*prefetched);
+}
+
 TEST_CASE("bloomier: bits_per_key is retrieval + oracle",
           "[bloomier][space]") {
     auto keys = make_keys(2000);
@@ -182,3 +248,29 @@ TEST_CASE("bloomier: bits_per_key is retrieval + oracle",
     REQUIRE(bpk > 20.0);
     REQUIRE(bpk < 40.0);
 }
+
+TEST_CASE("bloomier: with_threads reaches the sharded ribbon and the oracle",
+          "[bloomier][threads]") {
+    auto keys = make_keys(150000, 11);
+    std::vector<uint8_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint8_t>(det_value<8>(k)));
+
+    using B = bloomier<ribbon_retrieval<8>, binary_fuse_filter<8>>;
+    auto serial = B::builder{}.add_all(keys, values).build();
+    auto threaded = B::builder{}.add_all(keys, values).with_threads(4).build();
+    REQUIRE(serial.has_value());
+    REQUIRE(threaded.has_value());
+    REQUIRE(threaded->get_retrieval().num_shards() > 1);
+    REQUIRE(threaded->serialize() == serial->serialize());
+
+    executor pool{4};
+    auto pooled = B::builder{}.add_all(keys, values).with_executor(pool).build();
+    REQUIRE(pooled.has_value());
+    REQUIRE(pooled->serialize() == serial->serialize());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto r = threaded->lookup(keys[i]);
+        REQUIRE(r.has_value());
+        REQUIRE(*r == values[i]);
+    }
+}
@@ -0,0 +1,196 @@
+/**
+ * @file test_build_report.cpp
+ * @brief Tests for build_report: what the builders record, and that
+ *        recording does not change what they build.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <maph/detail/build_report.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/pthash.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/algorithms/shock_hash.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) keys.push_back("k" + std::to_string(rng()));
+    return keys;
+}
+
+double phase_sum(const build_report& r) {
+    double sum = 0;
+    for (double ms : r.phase_ms) sum += ms;
+    return sum;
+}
+
+}  // namespace
+
+TEST_CASE("build_report: phobic records attempts, seeds, phases and pilots", "[build_report][phobic]") {
+    auto keys = make_keys(20000);
+    build_report report;
+    auto phf = phobic5::builder{}.add_all(keys).with_seed(7).with_report(report).build();
+    REQUIRE(phf.has_value());
+
+    REQUIRE(report.keys == keys.size());
+    REQUIRE(report.range_size == phf->range_size());
+    REQUIRE(report.alpha() >= 1.0);
+    REQUIRE(report.attempts >= 1);
+    REQUIRE(report.seeds.size() == report.attempts);
+    REQUIRE(report.seeds.front() == 7);
+
+    REQUIRE(report.ms(build_report::phase::pilot_search) > 0.0);
+    REQUIRE(phase_sum(report) <= report.total_ms + 1e-6);
+    REQUIRE(report.max_pilot > 0);
+    REQUIRE(report.avg_pilot > 0.0);
+    REQUIRE(report.avg_pilot <= report.max_pilot);
+    REQUIRE(report.peak_scratch_bytes > keys.size() * sizeof(uint64_t));
+    REQUIRE(report.shards.empty());
+}
+
+TEST_CASE("build_report: reporting does not change the result", "[build_report][phobic]") {
+    auto keys = make_keys(10000);
+    for (size_t threads : {size_t{1}, size_t{4}}) {
+        build_report report;
+        auto plain = phobic5::builder{}.add_all(keys).with_threads(threads).build();
+        auto reported = phobic5::builder{}.add_all(keys).with_threads(threads)
+                            .with_report(report).build();
+        REQUIRE(plain.has_value());
+        REQUIRE(reported.has_value());
+        REQUIRE(plain->serialize() == reported->serialize());
+        if (threads == 1) REQUIRE(report.resumed_searches == 0);
+    }
+}
+
+TEST_CASE("build_report: a builder reused with one report starts it afresh", "[build_report]") {
+    auto keys = make_keys(2000);
+    build_report report;
+    report.attempts = 99;
+    report.shards.resize(3);
+    auto phf = pthash98::builder{}.add_all(keys).with_report(report).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(report.attempts == report.seeds.size());
+    REQUIRE(report.attempts < 99);
+    REQUIRE(report.shards.empty());
+    REQUIRE(report.ms(build_report::phase::hash) >= 0.0);
+}
+
+TEST_CASE("build_report: recsplit and shock_hash", "[build_report][recsplit][shock_hash]") {
+    auto keys = make_keys(5000);
+
+    build_report rs;
+    auto r = recsplit8::builder{}.add_all(keys).with_report(rs).build();
+    REQUIRE(r.has_value());
+    REQUIRE(rs.attempts >= 1);
+    REQUIRE(rs.keys == keys.size());
+
+    build_report sh;
+    auto s = shock_hash<64>::builder{}.add_all(keys).with_report(sh).build();
+    REQUIRE(s.has_value());
+    REQUIRE(sh.attempts == sh.seeds.size());
+    REQUIRE(sh.range_size == s->range_size());
+    REQUIRE(sh.ms(build_report::phase::pilot_search) > 0.0);
+    REQUIRE(sh.ms(build_report::phase::encode) > 0.0);
+    REQUIRE(sh.avg_pilot <= sh.max_pilot);
+}
+
+TEST_CASE("build_report: ribbon retries add up over shards", "[build_report][ribbon]") {
+    auto keys = make_keys(30000);
+    std::vector<uint8_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint8_t>(i);
+
+    build_report report;
+    auto r = ribbon_retrieval<8>::builder{}
+                 .add_all(std::span<const std::string>{keys}, std::span<const uint8_t>{values})
+                 .with_shard_keys(4096)
+                 .with_threads(2)
+                 .with_report(report)
+                 .build();
+    REQUIRE(r.has_value());
+    // One successful solve per shard; every other attempt was a retry.
+    const size_t shards = (keys.size() + 4095) / 4096;
+    REQUIRE(report.attempts == shards + report.ribbon_retries);
+    REQUIRE(report.seeds.empty());
+    REQUIRE(report.range_size == r->num_rows());
+
+    build_report single;
+    auto one = ribbon_retrieval<8>::builder{}
+                   .add_all(std::span<const std::string>{keys}, std::span<const uint8_t>{values})
+                   .with_shard_keys(0)
+                   .with_report(single)
+                   .build();
+    REQUIRE(one.has_value());
+    REQUIRE(single.seeds.size() == single.attempts);
+    REQUIRE(single.attempts == single.ribbon_retries + 1);
+}
+
+TEST_CASE("build_report: partitioned_phf keeps and sums shard reports", "[build_report][partitioned]") {
+    auto keys = make_keys(40000);
+    build_report report;
+    auto phf = partitioned_phf<phobic5>::builder{}
+                   .add_all(keys).with_shards(8).with_threads(2)
+                   .with_report(report).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(report.shards.size() == 8);
+    REQUIRE(report.keys == keys.size());
+    REQUIRE(report.range_size == phf->range_size());
+
+    size_t attempts = 0;
+    size_t keys_in_shards = 0;
+    uint32_t max_pilot = 0;
+    for (const auto& s : report.shards) {
+        REQUIRE(s.attempts >= 1);
+        attempts += s.attempts;
+        keys_in_shards += s.keys;
+        max_pilot = std::max(max_pilot, s.max_pilot);
+    }
+    REQUIRE(report.attempts == attempts);
+    REQUIRE(keys_in_shards == keys.size());
+    REQUIRE(report.max_pilot == max_pilot);
+    REQUIRE(report.slowest_shard() < report.shards.size());
+    REQUIRE(report.ms(build_report::phase::pilot_search) > 0.0);
+}
+
+TEST_CASE("build_report: a failed build still finishes its report", "[build_report]") {
+    auto keys = make_keys(5000);
+    std::vector<hash128> digests;
+    for (const auto& k : keys) digests.push_back(phf_hash128(k));
+
+    // Each build fails on a digest that is also added as a key.
+    build_report pr;
+    auto phf = phobic5::builder{}.add_hashes(digests).add(keys[0]).with_report(pr).build();
+    REQUIRE_FALSE(phf.has_value());
+    REQUIRE(pr.total_ms > 0);
+    REQUIRE(pr.range_size == 0);
+
+    build_report parts;
+    auto part = partitioned_phf<phobic5>::builder{}
+        .add_hashes(digests).add(keys[0]).with_shards(2).with_report(parts).build();
+    REQUIRE_FALSE(part.has_value());
+    REQUIRE(parts.total_ms > 0);
+    REQUIRE(parts.range_size == 0);
+}
+
+TEST_CASE("build_report: phf_value_array forwards to its PHF", "[build_report][retrieval]") {
+    auto keys = make_keys(3000);
+    std::vector<uint32_t> values(keys.size(), 5);
+    build_report report;
+    auto pva = phf_value_array<phobic5, 32>::builder{}
+                   .add_all(keys, values).with_report(report).build();
+    REQUIRE(pva.has_value());
+    REQUIRE(report.keys == keys.size());
+    REQUIRE(report.attempts >= 1);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file test_bulk_query.cpp
+ * @brief Tests for bulk_slot_for / bulk_lookup: the same answers as
+ *        per-key queries for every thread count and query path, and from
+ *        the owning structures and their views of the same bytes.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/chd.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/bulk_query.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 60) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Members then non-members, shuffled together.
+std::vector<std::string_view> probes_of(const std::vector<std::string>& keys,
+                                        const std::vector<std::string>& others) {
+    std::vector<std::string_view> probes(keys.begin(), keys.end());
+    probes.insert(probes.end(), others.begin(), others.end());
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64{3});
+    return probes;
+}
+
+template<typename P>
+void require_slots(const P& phf, std::span<const std::string_view> probes) {
+    for (size_t threads : {1, 4, 0}) {
+        std::vector<slot_index> out(probes.size());
+        bulk_slot_for(phf, probes, out, threads);
+        for (size_t i = 0; i < probes.size(); ++i) REQUIRE(out[i] == phf.slot_for(probes[i]));
+    }
+}
+
+template<typename R>
+std::vector<typename R::value_type> require_values(const R& r, std::span<const std::string_view> probes) {
+    std::vector<typename R::value_type> out(probes.size());
+    for (size_t threads : {1, 4, 0}) {
+        bulk_lookup(r, probes, out, threads);
+        for (size_t i = 0; i < probes.size(); ++i) REQUIRE(out[i] == r.lookup(probes[i]));
+    }
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("bulk_slot_for: per-key slots for every path and thread count", "[bulk_query]") {
+    auto keys = make_keys(40000);
+    auto others = make_keys(10000, 7);
+    auto probes = probes_of(keys, others);
+
+    auto phobic = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phobic.has_value());
+    require_slots(*phobic, probes);
+
+    // The view of the same bytes gives the same slots.
+    auto bytes = phobic->serialize();
+    auto view = phobic_phf_view<5>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    std::vector<slot_index> owned(probes.size()), viewed(probes.size());
+    bulk_slot_for(*phobic, probes, owned, 4);
+    bulk_slot_for(*view, probes, viewed, 4);
+    CHECK(viewed == owned);
+
+    // No slot_for_batch: one key at a time on each worker.
+    auto chd = chd_hasher::builder{}.add_all(keys).build();
+    REQUIRE(chd.has_value());
+    require_slots(*chd, probes);
+}
+
+TEST_CASE("bulk_lookup: per-key values from owners and views", "[bulk_query]") {
+    auto keys = make_keys(50000);
+    auto others = make_keys(8000, 9);
+    auto probes = probes_of(keys, others);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 40503u);
+
+    SECTION("phf_value_array") {
+        auto pva = phf_value_array<phobic5, 16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+        REQUIRE(pva.has_value());
+        auto owned = require_values(*pva, probes);
+        auto bytes = pva->serialize();
+        auto view = phf_value_array_view<phobic_phf_view<5>, 16>::deserialize(bytes);
+        REQUIRE(view.has_value());
+        CHECK(require_values(*view, probes) == owned);
+    }
+
+    SECTION("ribbon_retrieval, sharded") {
+        auto rr = ribbon_retrieval<16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values})
+            .with_shard_keys(1 << 14).build();
+        REQUIRE(rr.has_value());
+        REQUIRE(rr->num_shards() > 1);
+        auto owned = require_values(*rr, probes);
+        auto bytes = rr->serialize();
+        auto view = ribbon_retrieval_view<16>::deserialize(bytes);
+        REQUIRE(view.has_value());
+        CHECK(require_values(*view, probes) == owned);
+    }
+}
+
+TEST_CASE("bulk_lookup: short batches and short outputs", "[bulk_query]") {
+    auto keys = make_keys(3000);
+    std::vector<uint16_t> values(keys.size(), 7);
+    auto pva = phf_value_array<phobic5, 16>::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+    REQUIRE(pva.has_value());
+    std::vector<std::string_view> probes(keys.begin(), keys.end());
+
+    // Fewer outputs than keys: only those are written.
+    std::vector<uint16_t> out(100, 0);
+    bulk_lookup(*pva, probes, out, 8);
+    for (auto v : out) CHECK(v == 7);
+
+    std::vector<slot_index> none;
+    bulk_slot_for(pva->phf(), probes, none, 8);
+    bulk_lookup(*pva, std::span<const std::string_view>{}, out, 8);
+}
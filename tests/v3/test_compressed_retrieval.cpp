@@ -0,0 +1,190 @@
+/**
+ * @file test_compressed_retrieval.cpp
+ * @brief Tests for compressed_retrieval: prefix codewords in layered ribbons.
+ *
+ * Every key of the build set must read back its value however long its
+ * codeword, and the space must follow the mean codeword length rather
+ * than M: a column dominated by one label costs a little over one bit
+ * per key.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/concepts/retrieval.hpp>
+#include <maph/retrieval/compressed_retrieval.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(4, 16);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Label 0 for ~90% of keys, the rest spread over labels 1..40.
+std::vector<uint32_t> skewed_labels(size_t count, uint64_t seed = 7) {
+    std::mt19937_64 rng{seed};
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::uniform_int_distribution<uint32_t> rare(1, 40);
+    std::vector<uint32_t> values(count);
+    for (auto& v : values) v = u(rng) < 0.9 ? 0 : rare(rng);
+    return values;
+}
+
+using labels = compressed_retrieval<uint32_t, 8>;
+
+} // namespace
+
+TEST_CASE("compressed_retrieval satisfies retrieval", "[compressed_retrieval][concept]") {
+    STATIC_REQUIRE(retrieval<labels>);
+    STATIC_REQUIRE(hashed_retrieval<labels>);
+}
+
+TEST_CASE("compressed_retrieval: skewed labels round-trip in ~entropy bits",
+          "[compressed_retrieval]") {
+    auto keys = make_keys(50000);
+    auto values = skewed_labels(keys.size());
+
+    auto built = labels::builder{}.add_all(keys, values).with_threads(4).build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_keys() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(built->lookup(keys[i]) == values[i]);
+    }
+
+    // Huffman gives label 0 one bit; the rest share ~0.1 * 7 bits.
+    CHECK(built->mean_code_length() < 2.0);
+    CHECK(built->bits_per_key() < 1.2 * built->mean_code_length());
+
+    auto fixed = ribbon_retrieval<8, interleaved_solution>::builder{}
+        .add_all(keys, std::vector<uint8_t>(values.begin(), values.end()))
+        .build();
+    REQUIRE(fixed.has_value());
+    CHECK(built->bits_per_key() * 3.0 < fixed->bits_per_key());
+
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::vector<uint32_t> batch(views.size());
+    built->lookup_batch(views, batch);
+    REQUIRE(batch == values);
+}
+
+TEST_CASE("compressed_retrieval: explicit codec, non-members decode to the alphabet",
+          "[compressed_retrieval]") {
+    auto keys = make_keys(5000);
+    std::mt19937_64 rng{3};
+    std::uniform_int_distribution<uint32_t> pick(0, 3);
+    std::vector<uint32_t> values(keys.size());
+    for (auto& v : values) v = pick(rng);
+
+    // Lengths 1 to 4 and a surplus that decodes to 99.
+    prefix_codec<uint32_t, 8> c({{0, 1}, {1, 2}, {2, 3}, {3, 4}}, 99);
+    auto built = labels::builder{c}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_layers() == 4);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(built->lookup(keys[i]) == values[i]);
+    }
+
+    auto others = make_keys(2000, 1234);
+    std::vector<std::string_view> views(others.begin(), others.end());
+    std::vector<uint32_t> batch(views.size());
+    built->lookup_batch(views, batch);
+    std::vector<size_t> seen(100, 0);
+    for (size_t i = 0; i < others.size(); ++i) {
+        const uint32_t v = built->lookup(others[i]);
+        REQUIRE(v == batch[i]);
+        REQUIRE((v <= 3 || v == 99));
+        ++seen[v];
+    }
+    // Not every non-member lands on the first codeword.
+    CHECK(std::count_if(seen.begin(), seen.end(), [](size_t hits) { return hits > 0; }) > 1);
+}
+
+TEST_CASE("compressed_retrieval: duplicates, integer keys, single value",
+          "[compressed_retrieval]") {
+    SECTION("last duplicate wins") {
+        auto built = labels::builder{}
+            .add("a", 1).add("b", 2).add("a", 3).add("c", 3)
+            .build();
+        REQUIRE(built.has_value());
+        REQUIRE(built->num_keys() == 3);
+        CHECK(built->lookup("a") == 3);
+        CHECK(built->lookup("b") == 2);
+        CHECK(built->lookup("c") == 3);
+    }
+
+    SECTION("integer keys are their little-endian bytes") {
+        labels::builder b;
+        for (uint64_t k = 0; k < 1000; ++k) b.add(k, static_cast<uint32_t>(k % 5 == 0));
+        auto built = b.build();
+        REQUIRE(built.has_value());
+        for (uint64_t k = 0; k < 1000; ++k) {
+            REQUIRE(built->lookup(k) == static_cast<uint32_t>(k % 5 == 0));
+            REQUIRE(built->lookup(integer_key_bytes(k)) == static_cast<uint32_t>(k % 5 == 0));
+        }
+    }
+
+    SECTION("one distinct value needs one layer") {
+        auto keys = make_keys(1000);
+        std::vector<uint32_t> values(keys.size(), 17);
+        auto built = labels::builder{}.add_all(keys, values).build();
+        REQUIRE(built.has_value());
+        CHECK(built->num_layers() == 1);
+        for (const auto& k : keys) REQUIRE(built->lookup(k) == 17);
+    }
+
+    SECTION("too many values for M") {
+        auto built = compressed_retrieval<uint32_t, 2>::builder{}
+            .add("a", 0).add("b", 1).add("c", 2).add("d", 3).add("e", 4)
+            .build();
+        REQUIRE_FALSE(built.has_value());
+        CHECK(built.error() == error::value_too_large);
+    }
+
+    SECTION("empty build fails") {
+        CHECK_FALSE(labels::builder{}.build().has_value());
+    }
+}
+
+TEST_CASE("compressed_retrieval: serialize round trip", "[compressed_retrieval]") {
+    auto keys = make_keys(20000);
+    auto values = skewed_labels(keys.size(), 11);
+    auto built = labels::builder{}.add_all(keys, values).with_seed(5).build();
+    REQUIRE(built.has_value());
+
+    auto bytes = built->serialize();
+    auto loaded = labels::deserialize(bytes, built->encoder());
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->num_keys() == built->num_keys());
+    REQUIRE(loaded->num_layers() == built->num_layers());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(loaded->lookup(keys[i]) == values[i]);
+    }
+
+    CHECK_FALSE(labels::deserialize(std::span<const std::byte>(bytes).first(bytes.size() / 2),
+                                    built->encoder()).has_value());
+    CHECK_FALSE(compressed_retrieval<uint32_t, 16>::deserialize(
+        bytes, prefix_codec<uint32_t, 16>({{0, 1}}, 0)).has_value());
+}
@@ -0,0 +1,234 @@
+/**
+ * @file test_container.cpp
+ * @brief Tests for the sectioned container and the structures stored in it.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/bloomier.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/detail/container.hpp>
+#include <maph/detail/mapped_file.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 28) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+std::vector<std::byte> bytes_of(std::string_view s) {
+    std::vector<std::byte> out(s.size());
+    std::memcpy(out.data(), s.data(), s.size());
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("container: sections are aligned, sorted and found by tag and index", "[container]") {
+    std::vector<uint64_t> offsets{0, 10, 25, 40};
+    container_writer w{42};
+    w.add(section_tag::shard, 1, bytes_of("second shard"));
+    w.add(section_tag::meta, bytes_of("meta"));
+    w.add(section_tag::shard, 0, bytes_of("first"));
+    w.add_array(section_tag::offsets, 0, std::span<const uint64_t>(offsets));
+    w.add(section_tag::meta, bytes_of("replaced meta"));  // same (tag, index): last wins
+    REQUIRE(w.size() == 5);
+    auto bytes = w.finish();
+
+    auto v = container_view::open(bytes);
+    REQUIRE(v.has_value());
+    REQUIRE(v->algorithm() == 42);
+    REQUIRE(v->section_count() == 4);
+    REQUIRE(v->count(section_tag::shard) == 2);
+    for (size_t i = 0; i < v->section_count(); ++i) {
+        REQUIRE(v->entry(i).offset % CONTAINER_ALIGNMENT == 0);
+        REQUIRE(v->verify(i));
+    }
+    REQUIRE(v->verify_all(3).has_value());
+
+    auto meta = v->checked(section_tag::meta);
+    REQUIRE(meta.has_value());
+    REQUIRE(std::string_view(reinterpret_cast<const char*>(meta->data()), meta->size()) == "replaced meta");
+    auto s1 = v->checked(section_tag::shard, 1);
+    REQUIRE(s1.has_value());
+    REQUIRE(std::string_view(reinterpret_cast<const char*>(s1->data()), s1->size()) == "second shard");
+    REQUIRE_FALSE(v->find(section_tag::shard, 2).has_value());
+    REQUIRE_FALSE(v->checked(section_tag::values).has_value());
+
+    auto arr = v->array<uint64_t>(section_tag::offsets);
+    REQUIRE(arr.has_value());
+    REQUIRE(std::vector<uint64_t>(arr->begin(), arr->end()) == offsets);
+    REQUIRE_FALSE(v->array<uint64_t>(section_tag::shard, 0).has_value());  // 5 bytes
+
+    auto empty = container_writer{}.finish();
+    auto ev = container_view::open(empty);
+    REQUIRE(ev.has_value());
+    REQUIRE(ev->section_count() == 0);
+    REQUIRE(ev->verify_all().has_value());
+}
+
+TEST_CASE("container: damage is caught at open or when the section is read", "[container]") {
+    container_writer w;
+    w.add(section_tag::meta, bytes_of("header fields"));
+    w.add(section_tag::values, std::vector<std::byte>(1000, std::byte{7}));
+    const auto good = w.finish();
+    REQUIRE(container_view::open(good).has_value());
+
+    // A flipped section byte opens (sections are checked lazily) but fails
+    // when that section is read; the other section still reads.
+    auto bad_section = good;
+    const auto values_at = container_view::open(good)->entry(1).offset;
+    bad_section[values_at + 500] ^= std::byte{1};
+    auto v = container_view::open(bad_section);
+    REQUIRE(v.has_value());
+    REQUIRE_FALSE(v->checked(section_tag::values).has_value());
+    REQUIRE(v->checked(section_tag::meta).has_value());
+    REQUIRE_FALSE(v->verify_all(2).has_value());
+
+    auto bad_toc = good;
+    bad_toc[sizeof(detail::container_header) + 8] ^= std::byte{1};
+    REQUIRE_FALSE(container_view::open(bad_toc).has_value());
+
+    auto bad_header = good;
+    bad_header[12] ^= std::byte{1};
+    REQUIRE_FALSE(container_view::open(bad_header).has_value());
+
+    for (size_t cut : {size_t{0}, size_t{63}, size_t{100}, good.size() - 1}) {
+        REQUIRE_FALSE(container_view::open(std::span<const std::byte>(good).first(cut)).has_value());
+    }
+    // Serialized bytes of the older formats are not containers.
+    auto keys = make_keys(100);
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    REQUIRE_FALSE(container_view::open(phf->serialize()).has_value());
+}
+
+TEST_CASE("container: partitioned_phf writes one section per shard", "[container][partitioned]") {
+    auto keys = make_keys(40000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(6).build();
+    REQUIRE(phf.has_value());
+    auto bytes = to_container(*phf);
+
+    auto v = container_view::open(bytes);
+    REQUIRE(v.has_value());
+    REQUIRE(v->algorithm() == partitioned_phf<phobic5>::ALGORITHM_ID);
+    REQUIRE(v->count(section_tag::shard) == 6);
+    auto shard3 = v->checked(section_tag::shard, 3);
+    REQUIRE(shard3.has_value());
+    auto inner = phobic5::deserialize(*shard3);
+    REQUIRE(inner.has_value());
+    REQUIRE(inner->num_keys() == phf->shard(3).num_keys());
+
+    auto loaded = from_container<partitioned_phf<phobic5>>(bytes);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->serialize() == phf->serialize());
+    for (const auto& k : keys) REQUIRE(loaded->slot_for(k) == phf->slot_for(k));
+
+    // A container for another type is refused by its algorithm id.
+    REQUIRE_FALSE(from_container<phobic5>(bytes).has_value());
+}
+
+TEST_CASE("container: compositions nest their components", "[container]") {
+    auto keys = make_keys(5000);
+
+    SECTION("perfect_filter over partitioned_phf") {
+        using PF = perfect_filter<partitioned_phf<phobic5>, 16>;
+        auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(3).build();
+        REQUIRE(phf.has_value());
+        auto pf = PF::build(std::move(*phf), keys);
+        auto bytes = to_container(pf);
+        auto v = container_view::open(bytes);
+        REQUIRE(v.has_value());
+        auto nested = v->checked(section_tag::phf);
+        REQUIRE(nested.has_value());
+        auto inner = container_view::open(*nested);
+        REQUIRE(inner.has_value());
+        REQUIRE(inner->count(section_tag::shard) == 3);
+
+        auto loaded = from_container<PF>(bytes);
+        REQUIRE(loaded.has_value());
+        REQUIRE(loaded->serialize() == pf.serialize());
+        for (const auto& k : keys) REQUIRE(loaded->contains(k));
+    }
+
+    SECTION("phf_value_array and a payload PHF") {
+        std::vector<uint32_t> values(keys.size());
+        for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 31);
+        auto m = phf_value_array<phobic5, 32>::builder{}.add_all(keys, values).build();
+        REQUIRE(m.has_value());
+        auto bytes = to_container(*m);
+        auto v = container_view::open(bytes);
+        REQUIRE(v.has_value());
+        auto nested = container_view::open(*v->checked(section_tag::phf));
+        REQUIRE(nested.has_value());
+        REQUIRE(nested->find(section_tag::payload).has_value());
+
+        auto loaded = from_container<phf_value_array<phobic5, 32>>(bytes);
+        REQUIRE(loaded.has_value());
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(loaded->lookup(keys[i]) == values[i]);
+    }
+
+    SECTION("bloomier over ribbon_retrieval and xor_filter") {
+        using B = bloomier<ribbon_retrieval<16>, xor_filter<8>>;
+        std::vector<uint16_t> values(keys.size());
+        for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i);
+        auto b = B::builder{}.add_all(keys, values).build();
+        REQUIRE(b.has_value());
+        auto bytes = to_container(*b);
+        auto loaded = from_container<B>(bytes);
+        REQUIRE(loaded.has_value());
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(loaded->lookup(keys[i]) == values[i]);
+        size_t same = 0;
+        for (const auto& p : make_keys(2000, 99)) {
+            same += loaded->lookup(p) == b->lookup(p) ? 1 : 0;
+        }
+        REQUIRE(same == 2000);
+    }
+}
+
+TEST_CASE("container: xor_filter table loads from a mapped file", "[container][mapped_file]") {
+    auto keys = make_keys(20000);
+    xor_filter<16> f;
+    REQUIRE(f.build(keys));
+    auto bytes = to_container(f);
+
+    const auto path = (std::filesystem::temp_directory_path() / "maph_test_container.bin").string();
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+    auto mf = mapped_file::open(path);
+    REQUIRE(mf.has_value());
+    auto v = container_view::open(mf->bytes());
+    REQUIRE(v.has_value());
+    auto table = v->array<uint16_t>(section_tag::fingerprints);
+    REQUIRE(table.has_value());
+    REQUIRE(reinterpret_cast<uintptr_t>(table->data()) % CONTAINER_ALIGNMENT == 0);
+
+    auto loaded = from_container<xor_filter<16>>(*v);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->serialize() == f.serialize());
+    for (const auto& k : keys) REQUIRE(loaded->verify(k));
+    std::filesystem::remove(path);
+}
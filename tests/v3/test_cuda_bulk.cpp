@@ -0,0 +1,127 @@
+/**
+ * @file test_cuda_bulk.cpp
+ * @brief Tests for cuda_bulk.hpp (MAPH_ENABLE_CUDA builds only): device
+ *        bulk_slot_for / bulk_lookup give the CPU structure's answers for
+ *        the same serialized image. Passes without launching anything when
+ *        no device is present.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/device/cuda_bulk.hpp>
+#include <maph/device/device_image.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 62) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        // Lengths up to ~600 bytes reach the stripe loop on the device.
+        keys.push_back("key_" + std::to_string(rng()) + std::string(rng() % 600, 'x')
+                       + std::to_string(i));
+    }
+    return keys;
+}
+
+struct packed_keys {
+    std::vector<unsigned char> bytes;
+    std::vector<uint64_t> offsets{0};
+
+    explicit packed_keys(const std::vector<std::string>& keys) {
+        for (const auto& k : keys) {
+            bytes.insert(bytes.end(), k.begin(), k.end());
+            offsets.push_back(bytes.size());
+        }
+    }
+
+    [[nodiscard]] device::key_batch batch() const noexcept {
+        return {bytes.data(), offsets.data(), offsets.size() - 1};
+    }
+};
+
+// Uploads the probes, runs `query` into a device output and downloads it.
+template<typename Query>
+std::vector<uint64_t> run_on_device(const packed_keys& probes, Query query) {
+    device::device_keys keys;
+    REQUIRE(keys.upload(probes.batch()) == device::cuda_status::ok);
+    const size_t n = probes.offsets.size() - 1;
+    device::device_buffer out;
+    REQUIRE(out.allocate(n * sizeof(uint64_t)) == device::cuda_status::ok);
+    REQUIRE(query(keys.batch(), static_cast<uint64_t*>(out.data())) == device::cuda_status::ok);
+    std::vector<uint64_t> host(n);
+    REQUIRE(out.download(host.data(), n * sizeof(uint64_t)) == device::cuda_status::ok);
+    return host;
+}
+
+} // namespace
+
+TEST_CASE("cuda bulk queries match the CPU structures", "[device][cuda]") {
+    if (!device::cuda_available()) {
+        WARN("no CUDA device; skipping");
+        return;
+    }
+    auto keys = make_keys(20000);
+    auto others = make_keys(4000, 9);
+    auto all = keys;
+    all.insert(all.end(), others.begin(), others.end());
+    packed_keys probes{all};
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 40503u);
+
+    SECTION("phobic_phf") {
+        auto built = phobic5::builder{}.add_all(keys).build();
+        REQUIRE(built.has_value());
+        auto phf = phobic5::deserialize(built->serialize());
+        REQUIRE(phf.has_value());
+        auto table = device::make_table(*phf);
+        REQUIRE(table.has_value());
+        device::device_phobic d;
+        REQUIRE(d.upload(table->image()) == device::cuda_status::ok);
+        auto out = run_on_device(probes, [&](const device::key_batch& k, uint64_t* o) {
+            return device::bulk_slot_for(d, k, o);
+        });
+        for (size_t i = 0; i < all.size(); ++i) REQUIRE(out[i] == phf->slot_for(all[i]).value);
+    }
+
+    SECTION("phf_value_array") {
+        auto built = phf_value_array<phobic5, 16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+        REQUIRE(built.has_value());
+        auto pva = phf_value_array<phobic5, 16>::deserialize(built->serialize());
+        REQUIRE(pva.has_value());
+        auto table = device::make_table(*pva);
+        REQUIRE(table.has_value());
+        device::device_value_array d;
+        REQUIRE(d.upload(table->image()) == device::cuda_status::ok);
+        auto out = run_on_device(probes, [&](const device::key_batch& k, uint64_t* o) {
+            return device::bulk_lookup(d, k, o);
+        });
+        for (size_t i = 0; i < all.size(); ++i) REQUIRE(out[i] == pva->lookup(all[i]));
+    }
+
+    SECTION("ribbon_retrieval, sharded") {
+        auto built = ribbon_retrieval<16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values})
+            .with_shard_keys(1 << 13).build();
+        REQUIRE(built.has_value());
+        auto rr = ribbon_retrieval<16>::deserialize(built->serialize());
+        REQUIRE(rr.has_value());
+        auto table = device::make_table(*rr);
+        REQUIRE(table.has_value());
+        device::device_ribbon d;
+        REQUIRE(d.upload(table->image()) == device::cuda_status::ok);
+        auto out = run_on_device(probes, [&](const device::key_batch& k, uint64_t* o) {
+            return device::bulk_lookup(d, k, o);
+        });
+        for (size_t i = 0; i < all.size(); ++i) REQUIRE(out[i] == rr->lookup(all[i]));
+    }
+}
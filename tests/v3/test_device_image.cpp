@@ -0,0 +1,199 @@
+/**
+ * @file test_device_image.cpp
+ * @brief Tests for device_query.hpp over device_image.hpp tables on the
+ *        host: the portable hash and queries the CUDA kernels run agree
+ *        bit for bit with phf_hash128 and the CPU structures, including
+ *        structures loaded from their serialized bytes.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/device/device_image.hpp>
+#include <maph/device/device_query.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 61) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Keys packed end to end, as a key_batch reads them.
+struct packed_keys {
+    std::vector<unsigned char> bytes;
+    std::vector<uint64_t> offsets{0};
+
+    explicit packed_keys(const std::vector<std::string>& keys) {
+        for (const auto& k : keys) {
+            bytes.insert(bytes.end(), k.begin(), k.end());
+            offsets.push_back(bytes.size());
+        }
+    }
+
+    [[nodiscard]] device::key_batch batch() const noexcept {
+        return {bytes.data(), offsets.data(), offsets.size() - 1};
+    }
+};
+
+device::digest digest_of(std::string_view key) {
+    return device::hash128(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+}
+
+std::vector<uint16_t> values_for(const std::vector<std::string>& keys) {
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 40503u);
+    return values;
+}
+
+template<typename R>
+void require_ribbon_matches(const R& rr, const std::vector<std::string>& probes) {
+    auto table = device::make_table(rr);
+    REQUIRE(table.has_value());
+    const auto image = table->image();
+    for (const auto& k : probes) REQUIRE(device::lookup(image, digest_of(k)) == rr.lookup(k));
+}
+
+} // namespace
+
+TEST_CASE("device hash128 matches phf_hash128 at every length path", "[device]") {
+    std::mt19937_64 rng{5};
+    std::string key;
+    // Short reads, the 16/32-byte rounds, and stripe runs either side of
+    // a full 16-stripe block.
+    for (size_t len = 0; len <= 1200; ++len) {
+        const auto d = digest_of(key);
+        const auto expected = phf_hash128(key);
+        REQUIRE(d.lo == expected.lo);
+        REQUIRE(d.hi == expected.hi);
+        key.push_back(static_cast<char>(rng()));
+    }
+}
+
+TEST_CASE("device slot_for matches phobic_phf, owned and deserialized", "[device]") {
+    auto keys = make_keys(20000);
+    auto others = make_keys(2000, 7);
+    packed_keys probes{others};
+
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto loaded = phobic5::deserialize(phf->serialize());
+    REQUIRE(loaded.has_value());
+    auto table = device::make_table(*loaded);
+    REQUIRE(table.has_value());
+    const auto image = table->image();
+
+    for (const auto& k : keys) REQUIRE(device::slot_for(image, digest_of(k)) == phf->slot_for(k).value);
+
+    std::vector<uint64_t> out(others.size());
+    device::slot_for_all(image, probes.batch(), out.data());
+    for (size_t i = 0; i < others.size(); ++i) REQUIRE(out[i] == phf->slot_for(others[i]).value);
+
+    // Compact pilots are widened back to uint16_t.
+    auto compact = phobic5_compact::builder{}.add_all(keys).build();
+    REQUIRE(compact.has_value());
+    auto ctable = device::make_table(*compact);
+    REQUIRE(ctable.has_value());
+    for (const auto& k : others) {
+        REQUIRE(device::slot_for(ctable->image(), digest_of(k)) == compact->slot_for(k).value);
+    }
+}
+
+TEST_CASE("device lookup matches phf_value_array", "[device]") {
+    auto keys = make_keys(15000);
+    auto values = values_for(keys);
+
+    SECTION("16-bit values") {
+        auto pva = phf_value_array<phobic5, 16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+        REQUIRE(pva.has_value());
+        auto loaded = phf_value_array<phobic5, 16>::deserialize(pva->serialize());
+        REQUIRE(loaded.has_value());
+        auto table = device::make_table(*loaded);
+        REQUIRE(table.has_value());
+        packed_keys batch{keys};
+        std::vector<uint64_t> out(keys.size());
+        device::lookup_all(table->image(), batch.batch(), out.data());
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(out[i] == pva->lookup(keys[i]));
+    }
+
+    SECTION("values straddling words") {
+        std::vector<uint16_t> narrow(values.size());
+        for (size_t i = 0; i < narrow.size(); ++i) narrow[i] = values[i] & 0x7ff;
+        auto pva = phf_value_array<phobic5, 11>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{narrow}).build();
+        REQUIRE(pva.has_value());
+        auto table = device::make_table(*pva);
+        REQUIRE(table.has_value());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            REQUIRE(device::lookup(table->image(), digest_of(keys[i])) == narrow[i]);
+        }
+    }
+}
+
+TEST_CASE("device lookup matches ribbon_retrieval in every layout", "[device]") {
+    auto keys = make_keys(30000);
+    auto others = make_keys(3000, 9);
+    auto values = values_for(keys);
+    auto probes = keys;
+    probes.insert(probes.end(), others.begin(), others.end());
+
+    SECTION("flat") {
+        auto rr = ribbon_retrieval<16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+        REQUIRE(rr.has_value());
+        auto loaded = ribbon_retrieval<16>::deserialize(rr->serialize());
+        REQUIRE(loaded.has_value());
+        require_ribbon_matches(*loaded, probes);
+    }
+
+    SECTION("interleaved") {
+        auto rr = ribbon_retrieval<16, interleaved_solution>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values}).build();
+        REQUIRE(rr.has_value());
+        require_ribbon_matches(*rr, probes);
+    }
+
+    SECTION("sharded") {
+        auto rr = ribbon_retrieval<16>::builder{}
+            .add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values})
+            .with_shard_keys(1 << 13).build();
+        REQUIRE(rr.has_value());
+        REQUIRE(rr->num_shards() > 1);
+        auto loaded = ribbon_retrieval<16>::deserialize(rr->serialize());
+        REQUIRE(loaded.has_value());
+        require_ribbon_matches(*loaded, probes);
+    }
+
+    SECTION("no solution") {
+        require_ribbon_matches(ribbon_retrieval<16>{}, others);
+    }
+}
+
+TEST_CASE("make_table refuses format-v2 structures", "[device]") {
+    auto keys = make_keys(2000);
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+    const uint32_t v2 = 2;
+    std::memcpy(bytes.data() + 4, &v2, sizeof(v2));
+    auto loaded = phobic5::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->revision() == hash_revision::fnv1a);
+    auto table = device::make_table(*loaded);
+    REQUIRE_FALSE(table.has_value());
+    CHECK(table.error() == error::invalid_format);
+}
@@ -0,0 +1,271 @@
+/**
+ * @file test_dynamic_map.cpp
+ * @brief Tests for dynamic_map: overlay writes over a static structure, rebuilt.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/dynamic_map.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+using value_map = dynamic_map<phf_value_array<phobic5, 32>>;
+using filter_map = dynamic_map<perfect_filter<phobic5, 16>>;
+using slot_map = dynamic_map<partitioned_phf<phobic5>>;
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 25) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Every live key reaches its model value; every erased one misses.
+void check_against(const value_map& m, const std::unordered_map<std::string, uint32_t>& model,
+                   const std::vector<std::string>& erased) {
+    REQUIRE(m.size() == model.size());
+    for (const auto& [k, v] : model) {
+        auto got = m.lookup(k);
+        REQUIRE(got.has_value());
+        REQUIRE(*got == v);
+    }
+    for (const auto& k : erased) {
+        if (!model.contains(k)) REQUIRE_FALSE(m.lookup(k).has_value());
+    }
+}
+
+template<typename Map>
+void check_unique_slots(const Map& m, const std::set<std::string>& live) {
+    REQUIRE(m.size() == live.size());
+    std::set<uint64_t> seen;
+    for (const auto& k : live) {
+        auto s = m.lookup(k);
+        REQUIRE(s.has_value());
+        REQUIRE(seen.insert(s->value).second);
+    }
+}
+
+} // namespace
+
+TEST_CASE("dynamic_map: traits select the value mode", "[dynamic_map]") {
+    STATIC_REQUIRE_FALSE(value_map::assigns_slots);
+    STATIC_REQUIRE(std::same_as<value_map::value_type, uint32_t>);
+    STATIC_REQUIRE(filter_map::assigns_slots);
+    STATIC_REQUIRE(std::same_as<filter_map::value_type, slot_index>);
+    STATIC_REQUIRE(slot_map::assigns_slots);
+}
+
+TEST_CASE("dynamic_map: inserts, updates and erases match a model across rebuilds",
+          "[dynamic_map]") {
+    auto keys = make_keys(5000);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 2654435761u);
+
+    auto m = value_map::builder{}
+                 .add_all(keys, values)
+                 .with_min_rebuild(200)
+                 .with_background_rebuild(false)
+                 .build();
+    REQUIRE(m.has_value());
+
+    std::unordered_map<std::string, uint32_t> model;
+    for (size_t i = 0; i < keys.size(); ++i) model[keys[i]] = values[i];
+    check_against(*m, model, {});
+
+    auto fresh = make_keys(2000, 77);
+    std::vector<std::string> erased;
+    std::mt19937_64 rng{5};
+    for (size_t step = 0; step < 3000; ++step) {
+        const auto op = rng() % 3;
+        if (op == 0) {
+            const auto& k = fresh[rng() % fresh.size()];
+            const auto v = static_cast<uint32_t>(rng());
+            REQUIRE(m->insert(k, v).has_value());
+            model[k] = v;
+        } else if (op == 1) {
+            const auto& k = keys[rng() % keys.size()];
+            const auto v = static_cast<uint32_t>(rng());
+            REQUIRE(m->insert(k, v).has_value());
+            model[k] = v;
+        } else {
+            const auto& k = rng() % 2 ? keys[rng() % keys.size()] : fresh[rng() % fresh.size()];
+            REQUIRE(m->erase(k) == (model.erase(k) == 1));
+            erased.push_back(k);
+        }
+    }
+    REQUIRE(m->generation() > 0);
+    REQUIRE(m->last_rebuild_error() == error::success);
+    check_against(*m, model, erased);
+
+    REQUIRE(m->rebuild().has_value());
+    REQUIRE(m->overlay_size() == 0);
+    REQUIRE(m->tombstones() == 0);
+    REQUIRE(m->snapshot()->num_keys() == model.size());
+    check_against(*m, model, erased);
+}
+
+TEST_CASE("dynamic_map: erasing every key leaves an empty map that takes inserts",
+          "[dynamic_map]") {
+    auto keys = make_keys(300);
+    std::vector<uint32_t> values(keys.size(), 7);
+    auto m = value_map::builder{}.add_all(keys, values)
+                 .with_min_rebuild(50).with_background_rebuild(false).build();
+    REQUIRE(m.has_value());
+    for (const auto& k : keys) REQUIRE(m->erase(k));
+    for (const auto& k : keys) REQUIRE_FALSE(m->erase(k));
+    REQUIRE(m->rebuild().has_value());
+    REQUIRE(m->size() == 0);
+    REQUIRE(m->snapshot() == nullptr);
+    REQUIRE_FALSE(m->lookup(keys[0]).has_value());
+
+    REQUIRE(m->insert(keys[0], 11).has_value());
+    REQUIRE(m->lookup(keys[0]) == 11u);
+    REQUIRE(m->size() == 1);
+}
+
+TEST_CASE("dynamic_map: builder keeps the last value of a duplicate key", "[dynamic_map]") {
+    auto m = value_map::builder{}.add("a", 1).add("b", 2).add("a", 3).build();
+    REQUIRE(m.has_value());
+    REQUIRE(m->size() == 2);
+    REQUIRE(m->lookup("a") == 3u);
+    REQUIRE(m->lookup("b") == 2u);
+}
+
+TEST_CASE("dynamic_map: perfect_filter slots stay unique and lookups are exact",
+          "[dynamic_map][perfect_filter]") {
+    auto keys = make_keys(4000);
+    auto m = filter_map::builder{}.add_all(keys)
+                 .with_min_rebuild(300).with_background_rebuild(false).build();
+    REQUIRE(m.has_value());
+    std::set<std::string> live(keys.begin(), keys.end());
+    check_unique_slots(*m, live);
+
+    // A static key keeps its slot through erase and re-insert.
+    const auto before = m->lookup(keys[10]);
+    REQUIRE(m->erase(keys[10]));
+    REQUIRE_FALSE(m->lookup(keys[10]).has_value());
+    auto again = m->insert(keys[10]);
+    REQUIRE(again.has_value());
+    REQUIRE(*again == *before);
+
+    auto fresh = make_keys(1500, 91);
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        auto s = m->insert(fresh[i]);
+        REQUIRE(s.has_value());
+        REQUIRE(m->insert(fresh[i]) == s);  // idempotent
+        live.insert(fresh[i]);
+        if (i % 3 == 0) {
+            REQUIRE(m->erase(keys[i]));
+            live.erase(keys[i]);
+        }
+    }
+    REQUIRE(m->generation() > 0);
+    check_unique_slots(*m, live);
+
+    // Lookups compare the stored key: no fingerprint false positives.
+    for (const auto& p : make_keys(20000, 1234)) REQUIRE_FALSE(m->contains(p));
+}
+
+TEST_CASE("dynamic_map: partitioned_phf hands out unique slots", "[dynamic_map][partitioned]") {
+    auto keys = make_keys(20000);
+    auto m = slot_map::builder{}.add_all(keys).with_background_rebuild(false).build();
+    REQUIRE(m.has_value());
+    std::set<std::string> live(keys.begin(), keys.end());
+
+    auto fresh = make_keys(3000, 17);
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        auto s = m->insert(fresh[i]);
+        REQUIRE(s.has_value());
+        live.insert(fresh[i]);
+        if (i % 2 == 0) {
+            REQUIRE(m->erase(keys[i]));
+            live.erase(keys[i]);
+        }
+    }
+    REQUIRE(m->generation() > 0);
+    check_unique_slots(*m, live);
+}
+
+TEST_CASE("dynamic_map: readers see a consistent map during background rebuilds",
+          "[dynamic_map][concurrency]") {
+    auto keys = make_keys(20000);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i);
+    auto m = value_map::builder{}.add_all(keys, values).with_min_rebuild(256).build();
+    REQUIRE(m.has_value());
+
+    // The first half is never written: readers must always find it.
+    const size_t stable = keys.size() / 2;
+    std::atomic<bool> done{false};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> reads{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t] {
+            size_t i = static_cast<size_t>(t) * 7919;
+            while (!done.load(std::memory_order_relaxed)) {
+                const size_t k = i++ % stable;
+                auto v = m->lookup(keys[k]);
+                if (!v || *v != values[k]) misses.fetch_add(1, std::memory_order_relaxed);
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    auto fresh = make_keys(4000, 3);
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        REQUIRE(m->insert(fresh[i], static_cast<uint32_t>(i)).has_value());
+        REQUIRE(m->erase(keys[stable + i]));
+    }
+    m->wait_for_rebuild();
+    done = true;
+    for (auto& r : readers) r.join();
+
+    REQUIRE(misses.load() == 0);
+    REQUIRE(reads.load() > 0);
+    REQUIRE(m->generation() > 0);
+    REQUIRE(m->size() == keys.size());
+    for (size_t i = 0; i < fresh.size(); ++i) REQUIRE(m->lookup(fresh[i]) == static_cast<uint32_t>(i));
+    for (size_t i = 0; i < fresh.size(); ++i) REQUIRE_FALSE(m->lookup(keys[stable + i]).has_value());
+}
+
+TEST_CASE("dynamic_map: updating static keys during a background rebuild publishes it",
+          "[dynamic_map][concurrency]") {
+    auto keys = make_keys(100000);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i);
+    auto m = value_map::builder{}.add_all(keys, values).with_min_rebuild(20000).build();
+    REQUIRE(m.has_value());
+
+    // Updates past the threshold land on static keys while the rebuild
+    // gathers them; each key must be gathered once.
+    const size_t updates = 60000;
+    for (size_t i = 0; i < updates; ++i) {
+        values[i] = static_cast<uint32_t>(i) + 1000000;
+        REQUIRE(m->insert(keys[i], values[i]).has_value());
+    }
+    m->wait_for_rebuild();
+
+    REQUIRE(m->generation() > 0);
+    REQUIRE(m->last_rebuild_error() == error::success);
+    REQUIRE(m->size() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(m->lookup(keys[i]) == values[i]);
+}
@@ -25,6 +25,7 @@
 #include <cstdint>
 #include <random>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace maph;
@@ -141,6 +142,12 @@ TEST_CASE("encoded_retrieval<pva<phobic5,4>, padded<color,4>>: keys in S decode
     for (size_t i = 0; i < keys.size(); ++i) {
         REQUIRE(built->lookup(keys[i]) == values[i]);
     }
+
+    // lookup_batch goes through the pva's own batch.
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::vector<color> out(views.size());
+    built->lookup_batch(views, out);
+    REQUIRE(out == values);
 }
 
 // ===== Non-member distribution: pva with fill pattern =====
@@ -233,3 +240,21 @@ TEST_CASE("encoded_retrieval<ribbon<2>, dense<color,2>>: keys in S round-trip",
         REQUIRE(built->lookup(keys[i]) == values[i]);
     }
 }
+
+TEST_CASE("encoded_retrieval<ribbon<4>, padded<color,4>>: with_threads builds the same table",
+          "[encoded_retrieval][ribbon][threads]") {
+    auto keys = make_keys(150000);
+    std::vector<color> values;
+    values.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values.push_back(static_cast<color>(i % 3));
+
+    padded_codec<color, 4> cdc({color::A, color::B, color::C}, color::D);
+    using Enc = encoded_retrieval<ribbon_retrieval<4>, padded_codec<color, 4>>;
+    auto serial = Enc::builder(cdc).add_all(keys, values).build();
+    auto threaded = Enc::builder(cdc).add_all(keys, values).with_threads(4).build();
+    REQUIRE(serial.has_value());
+    REQUIRE(threaded.has_value());
+    REQUIRE(threaded->base().num_shards() > 1);
+    REQUIRE(threaded->base().serialize() == serial->base().serialize());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(threaded->lookup(keys[i]) == values[i]);
+}
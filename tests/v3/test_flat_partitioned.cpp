@@ -0,0 +1,100 @@
+/**
+ * @file test_flat_partitioned.cpp
+ * @brief Tests for flat_partitioned_phf, the flat query layout of partitioned_phf.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/flat_partitioned.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/detail/page_allocator.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 27) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+} // namespace
+
+static_assert(perfect_hash_function<flat_partitioned_phf<5>>);
+
+TEST_CASE("flat_partitioned: answers like the partitioned_phf it flattens", "[flat_partitioned]") {
+    auto keys = make_keys(60000);
+    auto probes = make_keys(5000, 91);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(7).build();
+    REQUIRE(phf.has_value());
+    auto flat = flat_partitioned_phf<5>::from(*phf);
+    REQUIRE(flat.has_value());
+    REQUIRE(flat->num_keys() == phf->num_keys());
+    REQUIRE(flat->range_size() == phf->range_size());
+    REQUIRE(flat->num_shards() == 7);
+
+    for (const auto& k : keys) REQUIRE(flat->slot_for(k) == phf->slot_for(k));
+    for (const auto& k : probes) REQUIRE(flat->slot_for(hashed_key{k}) == phf->slot_for(k));
+
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.insert(queries.end(), probes.begin(), probes.end());
+    std::vector<slot_index> out(queries.size());
+    slot_for_batch(*flat, queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) REQUIRE(out[i] == phf->slot_for(queries[i]));
+
+    size_t calls = 0;
+    detail::interleave_keys<16>(
+        *flat, queries,
+        [&](detail::lookup_cursor& c) { return flat->lookup_step(c); },
+        [&](size_t i, const detail::lookup_cursor& c) {
+            ++calls;
+            REQUIRE(c.slot == phf->slot_for(queries[i]).value);
+        });
+    REQUIRE(calls == queries.size());
+}
+
+TEST_CASE("flat_partitioned: serializes to the partitioned_phf format", "[flat_partitioned]") {
+    auto keys = make_keys(30000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(4)
+                   .with_stable_ranges(0.1).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    auto flat = flat_partitioned_phf<5>::deserialize(bytes);
+    REQUIRE(flat.has_value());
+    REQUIRE(flat->serialize() == bytes);
+    for (const auto& k : keys) REQUIRE(flat->slot_for(k) == phf->slot_for(k));
+
+    auto mapped = flat_partitioned_phf<5, huge_page_storage>::deserialize(bytes);
+    REQUIRE(mapped.has_value());
+    for (size_t i = 0; i < keys.size(); i += 7) REQUIRE(mapped->slot_for(keys[i]) == phf->slot_for(keys[i]));
+
+    for (size_t cut : {size_t{0}, size_t{40}, bytes.size() / 2}) {
+        REQUIRE_FALSE(flat_partitioned_phf<5>::deserialize(
+            std::span<const std::byte>(bytes).first(cut)).has_value());
+    }
+}
+
+TEST_CASE("flat_partitioned: a single shard and tiny key sets", "[flat_partitioned]") {
+    for (size_t n : {size_t{1}, size_t{2}, size_t{50}}) {
+        auto keys = make_keys(n, n);
+        auto phf = partitioned_phf<phobic4>::builder{}.add_all(keys).build();
+        REQUIRE(phf.has_value());
+        auto flat = flat_partitioned_phf<4>::from(*phf);
+        REQUIRE(flat.has_value());
+        for (const auto& k : keys) REQUIRE(flat->slot_for(k) == phf->slot_for(k));
+        REQUIRE(flat->serialize() == phf->serialize());
+    }
+}
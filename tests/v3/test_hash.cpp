@@ -0,0 +1,295 @@
+/**
+ * @file test_hash.cpp
+ * @brief Tests for the key hash in detail/hash.hpp and format-version-2 compatibility
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <maph/detail/hash.hpp>
+#include <maph/detail/fingerprint_hash.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/bbhash.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::string random_bytes(size_t len, std::mt19937_64& rng) {
+    std::string s(len, '\0');
+    for (auto& c : s) c = static_cast<char>(rng());
+    return s;
+}
+
+std::vector<std::string> legacy_keys() {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 12; ++i) keys.push_back("legacy-key-" + std::to_string(i));
+    return keys;
+}
+
+template<size_t N>
+std::span<const std::byte> as_bytes(const unsigned char (&a)[N]) {
+    return {reinterpret_cast<const std::byte*>(a), N};
+}
+
+uint32_t read_u32(std::span<const std::byte> bytes, size_t off) {
+    uint32_t v{};
+    std::memcpy(&v, bytes.data() + off, sizeof(v));
+    return v;
+}
+
+} // namespace
+
+// ===== DIGEST =====
+
+TEST_CASE("phf_hash128: scalar and SIMD stripe loops agree", "[hash]") {
+    std::mt19937_64 rng{7};
+    for (size_t len = 0; len <= 2100; len += (len < 300 ? 1 : 37)) {
+        auto s = random_bytes(len, rng);
+        REQUIRE(detail::phf_hash128_impl<false>(s) == detail::phf_hash128_impl<true>(s));
+    }
+}
+
+TEST_CASE("phf_hash128_batch: the digests of phf_hash128", "[hash][batch]") {
+    std::mt19937_64 rng{56};
+    // Every length class, shuffled, and the windows cut unevenly; keys
+    // are views into one buffer at odd offsets.
+    std::string blob = random_bytes(100000, rng);
+    std::vector<std::string_view> keys;
+    for (size_t len = 0; len <= 300; ++len) {
+        for (int copy = 0; copy < 5; ++copy) keys.emplace_back(blob.data() + rng() % 90000, len);
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    for (size_t n : {size_t{0}, size_t{1}, size_t{63}, size_t{64}, size_t{65}, keys.size()}) {
+        std::vector<hash128> out(n);
+        phf_hash128_batch(std::span<const std::string_view>(keys).first(n), out);
+        for (size_t i = 0; i < n; ++i) REQUIRE(out[i] == phf_hash128(keys[i]));
+    }
+
+    // for_each_digest: strings, integers and digests, over a sub-range.
+    std::vector<std::string> owned(keys.begin(), keys.begin() + 200);
+    size_t seen = 0;
+    detail::for_each_digest(std::span<const std::string>(owned), 10, 150, [&](size_t i, const hash128& d) {
+        REQUIRE(d == phf_hash128(owned[i]));
+        ++seen;
+    });
+    CHECK(seen == 140);
+    std::vector<uint64_t> ints{0, 1, 42, ~uint64_t{0}};
+    detail::for_each_digest(std::span<const uint64_t>(ints), 0, ints.size(), [&](size_t i, const hash128& d) {
+        REQUIRE(d == phf_hash128(integer_key_bytes(ints[i])));
+    });
+    std::vector<hash128> given{phf_hash128("a"), phf_hash128("b")};
+    detail::for_each_digest(std::span<const hash128>(given), 0, 2, [&](size_t i, const hash128& d) {
+        REQUIRE(d == given[i]);
+    });
+}
+
+TEST_CASE("phf_hash128: deterministic and sensitive to every byte", "[hash]") {
+    std::mt19937_64 rng{11};
+    for (size_t len : {1u, 3u, 4u, 7u, 8u, 15u, 16u, 17u, 31u, 32u, 33u,
+                       64u, 65u, 255u, 256u, 257u, 1024u, 1100u}) {
+        auto s = random_bytes(len, rng);
+        auto d = phf_hash128(s);
+        REQUIRE(phf_hash128(s) == d);
+        for (size_t i = 0; i < len; ++i) {
+            auto t = s;
+            t[i] = static_cast<char>(t[i] ^ 0x01);
+            REQUIRE_FALSE(phf_hash128(t) == d);
+        }
+    }
+}
+
+TEST_CASE("phf_hash128: length is part of the digest", "[hash]") {
+    // Zero-padded keys of different lengths must not collide.
+    std::set<std::pair<uint64_t, uint64_t>> seen;
+    for (size_t len = 0; len <= 300; ++len) {
+        auto d = phf_hash128(std::string(len, '\0'));
+        REQUIRE(seen.insert({d.lo, d.hi}).second);
+    }
+}
+
+TEST_CASE("phf_hash_with_seed: seeds give independent low bits", "[hash]") {
+    // Bucket 10k sequential keys into 64 bins under two seeds; each bin
+    // should be near 10000/64 and the two assignments should disagree
+    // on roughly 63/64 of the keys.
+    constexpr size_t n = 10000, bins = 64;
+    std::vector<size_t> counts(bins, 0);
+    size_t same = 0;
+    for (size_t i = 0; i < n; ++i) {
+        auto key = "key_" + std::to_string(i);
+        auto d = phf_hash128(key);
+        uint64_t h0 = phf_hash_with_seed(d, 1);
+        uint64_t h1 = phf_hash_with_seed(d, 2);
+        REQUIRE(h0 == phf_hash_with_seed(key, 1));
+        ++counts[h0 % bins];
+        if (h0 % bins == h1 % bins) ++same;
+    }
+    for (auto c : counts) {
+        REQUIRE(c > n / bins / 2);
+        REQUIRE(c < n / bins * 2);
+    }
+    REQUIRE(same < n / 16);
+}
+
+TEST_CASE("hash_revision dispatch selects the v2 FNV hashes", "[hash]") {
+    std::string key = "some-key";
+    uint64_t h = 99;
+    for (unsigned char c : key) { h ^= c; h *= 0x100000001b3ULL; }
+    REQUIRE(phf_hash_with_seed_fnv(key, 99) == phf_remix(h));
+    REQUIRE(phf_hash_with_seed(key, 99, hash_revision::fnv1a) == phf_remix(h));
+    REQUIRE(phf_hash_with_seed(key, 99, hash_revision::wide) == phf_hash_with_seed(key, 99));
+    REQUIRE(membership_fingerprint(key, hash_revision::fnv1a) == membership_fingerprint_fnv(key));
+    REQUIRE(membership_fingerprint(key, hash_revision::wide) == membership_fingerprint(key));
+    REQUIRE(membership_fingerprint(key) != phf_hash_with_seed(key, 0));
+}
+
+// ===== FORMAT VERSION 2 COMPATIBILITY =====
+//
+// Blobs written by the v2 (FNV-1a) code over legacy_keys(). They must keep
+// loading and answering exactly as they did when written.
+
+TEST_CASE("phobic: loads a format-version-2 blob", "[hash][compat][phobic]") {
+    static constexpr unsigned char blob[] = {
+        0x48,0x50,0x41,0x4d,0x02,0x00,0x00,0x00,0x06,0x00,0x00,0x00,
+        0xf0,0xde,0xbc,0x9a,0x78,0x56,0x34,0x12,0x0c,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x0c,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x05,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x02,0x00,0x02,0x00,0x37,0x00,
+    };
+    static constexpr uint64_t expected[] = {11, 2, 0, 7, 1, 5, 8, 4, 3, 9, 10, 6};
+
+    auto phf = phobic5::deserialize(as_bytes(blob));
+    REQUIRE(phf.has_value());
+    auto keys = legacy_keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(phf->slot_for(keys[i]).value == expected[i]);
+        REQUIRE(phf->slot_for(hashed_key{keys[i]}).value == expected[i]);
+    }
+
+    auto view = phobic_phf_view<5>::deserialize(as_bytes(blob));
+    REQUIRE(view.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(view->slot_for(keys[i]).value == expected[i]);
+    }
+
+    // Re-serializing keeps the v2 version so the hash stays FNV.
+    auto again = phf->serialize();
+    REQUIRE(read_u32(again, 4) == 2);
+    REQUIRE(again.size() == sizeof(blob));
+}
+
+TEST_CASE("bbhash: loads a format-version-2 blob", "[hash][compat][bbhash]") {
+    static constexpr unsigned char blob[] = {
+        0x48,0x50,0x41,0x4d,0x02,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
+        0x03,0x00,0x00,0x00,0x0c,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x18,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x40,0xf0,0xde,0xbc,0x9a,0x78,0x56,0x34,0x12,
+        0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x90,0xa2,0x52,0x00,
+        0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x08,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x05,0x1b,0xc9,0x90,0x23,0xfd,0x3e,0x40,
+        0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00,0x04,0x00,
+        0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0xa6,0x48,0xed,0xd1,0xc6,0x20,0xe3,0x88,
+        0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x00,0x20,0x00,
+        0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x72,0x62,0x94,0x7e,0x15,0x7b,0xea,0x07,
+    };
+    static constexpr uint64_t expected[] = {4, 8, 9, 5, 10, 2, 0, 1, 6, 11, 3, 7};
+
+    auto phf = bbhash3::deserialize(as_bytes(blob));
+    REQUIRE(phf.has_value());
+    auto keys = legacy_keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(phf->slot_for(keys[i]).value == expected[i]);
+        REQUIRE(phf->slot_for(hashed_key{keys[i]}).value == expected[i]);
+    }
+}
+
+TEST_CASE("xor_filter<8>: loads a v2 blob without the wide-hash flag", "[hash][compat][xor]") {
+    static constexpr unsigned char blob[] = {
+        0x08,0x00,0x00,0x00,0x61,0x7d,0x67,0x41,0xe0,0xca,0xe8,0x63,
+        0x05,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
+        0x00,0x00,0x00,0x00,0x86,0x00,0x35,0x00,0x40,0x92,0x7d,0xd1,
+        0xd9,0x00,0x73,0x60,0x75,0x31,0x35,
+    };
+    auto f = xor_filter<8>::deserialize(as_bytes(blob));
+    REQUIRE(f.has_value());
+    for (const auto& k : legacy_keys()) {
+        REQUIRE(f->verify(k));
+        REQUIRE(f->verify(hashed_key{k}));
+    }
+    REQUIRE(f->serialize().size() == sizeof(blob));
+    REQUIRE(read_u32(f->serialize(), 0) == 8);
+}
+
+TEST_CASE("freshly built structures are tagged with the wide hash", "[hash][compat]") {
+    auto keys = legacy_keys();
+
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+    REQUIRE(read_u32(bytes, 4) == PERFECT_HASH_VERSION);
+    auto loaded = phobic5::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (const auto& k : keys) REQUIRE(loaded->slot_for(k).value == phf->slot_for(k).value);
+
+    xor_filter<8> f;
+    REQUIRE(f.build(keys));
+    auto fbytes = f.serialize();
+    REQUIRE(read_u32(fbytes, 0) == (8u | WIDE_HASH_FLAG));
+    auto floaded = xor_filter<8>::deserialize(fbytes);
+    REQUIRE(floaded.has_value());
+    for (const auto& k : keys) REQUIRE(floaded->verify(k));
+}
+
+TEST_CASE("fastmod_u64 matches % for every divisor width", "[hash][fastmod]") {
+    std::mt19937_64 rng{2019};
+    const uint64_t divisors[] = {1, 2, 3, 7, 10, 15000, (uint64_t{1} << 32) + 1,
+                                 uint64_t{1} << 63, (uint64_t{1} << 63) + 1, ~uint64_t{0}};
+    for (uint64_t d : divisors) {
+        detail::fastmod_u64 mod{d};
+        for (uint64_t a : {uint64_t{0}, d - 1, d, ~uint64_t{0}}) REQUIRE(mod(a) == a % d);
+        for (int i = 0; i < 10000; ++i) {
+            const uint64_t a = rng();
+            REQUIRE(mod(a) == a % d);
+        }
+    }
+    for (int i = 0; i < 100000; ++i) {
+        const uint64_t d = (rng() >> (rng() % 64)) | 1;
+        const uint64_t a = rng();
+        REQUIRE(detail::fastmod_u64{d}(a) == a % d);
+    }
+}
+
+TEST_CASE("integer key digests equal phf_hash128 of their little-endian bytes", "[hash][integer_key]") {
+    std::mt19937_64 rng{64};
+    std::vector<uint64_t> words{0, 1, 0xff, 0xffffffff, uint64_t{1} << 32, ~uint64_t{0}};
+    for (int i = 0; i < 10000; ++i) words.push_back(rng() >> (rng() % 64));
+    for (const uint64_t& x : words) {
+        REQUIRE(phf_hash128_u64(x) == phf_hash128(integer_key_bytes(x)));
+        const hashed_key hk{x};
+        REQUIRE(hk.digest == phf_hash128(integer_key_bytes(x)));
+        REQUIRE(hk.key.size() == 8);
+        REQUIRE(membership_fingerprint(x, hash_revision::wide)
+                == membership_fingerprint(integer_key_bytes(x), hash_revision::wide));
+        REQUIRE(membership_fingerprint(x, hash_revision::fnv1a)
+                == membership_fingerprint(integer_key_bytes(x), hash_revision::fnv1a));
+
+        const __uint128_t w = (static_cast<__uint128_t>(rng()) << 64) | x;
+        REQUIRE(phf_hash128_u128(w) == phf_hash128(integer_key_bytes(w)));
+        REQUIRE(hashed_key{w}.digest == phf_hash128(integer_key_bytes(w)));
+    }
+    static_assert(!std::is_constructible_v<hashed_key, uint64_t&&>);
+    static_assert(std::is_constructible_v<hashed_key, const uint64_t&>);
+}
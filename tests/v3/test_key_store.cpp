@@ -0,0 +1,425 @@
+/**
+ * @file test_key_store.cpp
+ * @brief Tests for key_store, radix_partition and the builder ingestion paths.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <maph/detail/key_store.hpp>
+#include <maph/detail/radix_partition.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/bbhash.hpp>
+#include <maph/algorithms/chd.hpp>
+#include <maph/algorithms/fch.hpp>
+#include <maph/algorithms/pthash.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/algorithms/shock_hash.hpp>
+#include <maph/composition/bloomier.hpp>
+#include <maph/composition/padded_phf.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> ingest_keys(size_t n) {
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) keys.push_back("ingest_key_" + std::to_string(i));
+    return keys;
+}
+
+// All keys concatenated, with n+1 offsets.
+struct key_blob {
+    std::string bytes;
+    std::vector<uint64_t> offsets{0};
+};
+
+key_blob make_blob(const std::vector<std::string>& keys) {
+    key_blob b;
+    for (const auto& k : keys) {
+        b.bytes += k;
+        b.offsets.push_back(b.bytes.size());
+    }
+    return b;
+}
+
+std::vector<std::string_view> as_views(const std::vector<std::string>& keys) {
+    return {keys.begin(), keys.end()};
+}
+
+// Borrowed and blob ingestion must build exactly the PHF add_all builds.
+template<typename PHF>
+void require_same_phf_from_every_path(const std::vector<std::string>& keys) {
+    auto views = as_views(keys);
+    auto blob = make_blob(keys);
+
+    auto copied = typename PHF::builder{}.add_all(keys).build();
+    auto from_views = typename PHF::builder{}
+        .add_all(std::span<const std::string_view>{views}).build();
+    auto borrowed = typename PHF::builder{}
+        .borrow_all(std::span<const std::string_view>{views}).build();
+    REQUIRE(copied.has_value());
+    REQUIRE(from_views.has_value());
+    REQUIRE(borrowed.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(from_views->slot_for(k).value == copied->slot_for(k).value);
+        REQUIRE(borrowed->slot_for(k).value == copied->slot_for(k).value);
+    }
+    if constexpr (requires(typename PHF::builder b) { b.borrow_blob(blob.bytes, blob.offsets); }) {
+        auto from_blob = typename PHF::builder{}
+            .borrow_blob(blob.bytes, blob.offsets).build();
+        REQUIRE(from_blob.has_value());
+        for (const auto& k : keys) {
+            REQUIRE(from_blob->slot_for(k).value == copied->slot_for(k).value);
+        }
+    }
+}
+
+template<typename PHF>
+bool is_minimal_perfect(const PHF& phf, const std::vector<std::string>& keys) {
+    std::vector<bool> seen(phf.range_size(), false);
+    for (const auto& k : keys) {
+        auto slot = static_cast<size_t>(phf.slot_for(k).value);
+        if (slot >= seen.size() || seen[slot]) return false;
+        seen[slot] = true;
+    }
+    return true;
+}
+
+} // namespace
+
+// ===== KEY STORE =====
+
+TEST_CASE("key_store: copied keys stay valid as the arena grows", "[key_store]") {
+    detail::key_store store;
+    std::vector<std::string> keys;
+    // ~3 MiB of keys spans several arena chunks; one key is oversized.
+    for (int i = 0; i < 100000; ++i) keys.push_back(std::string(30, 'a') + std::to_string(i));
+    keys.push_back(std::string(size_t{1} << 19, 'z'));
+    for (const auto& k : keys) store.add(k);
+
+    REQUIRE(store.size() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(store[i] == keys[i]);
+        REQUIRE(store[i].data() != keys[i].data());
+    }
+}
+
+TEST_CASE("key_store: borrowed keys are not copied", "[key_store]") {
+    auto keys = ingest_keys(8);
+    auto views = as_views(keys);
+    auto blob = make_blob(keys);
+
+    detail::key_store store;
+    store.borrow_all(views);
+    store.borrow_blob(blob.bytes, blob.offsets);
+    REQUIRE(store.size() == 2 * keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(store[i].data() == keys[i].data());
+        REQUIRE(store[keys.size() + i] == keys[i]);
+        REQUIRE(store[keys.size() + i].data() == blob.bytes.data() + blob.offsets[i]);
+    }
+}
+
+TEST_CASE("key_store: borrow_blob stops at malformed offsets", "[key_store]") {
+    std::string bytes = "abcdef";
+    std::vector<uint64_t> offsets{0, 2, 4, 100, 6};
+    detail::key_store store;
+    store.borrow_blob(bytes, offsets);
+    REQUIRE(store.size() == 2);
+    REQUIRE(store[0] == "ab");
+    REQUIRE(store[1] == "cd");
+
+    detail::key_store backwards;
+    std::vector<uint64_t> down{0, 4, 2};
+    backwards.borrow_blob(bytes, down);
+    REQUIRE(backwards.size() == 1);
+}
+
+TEST_CASE("key_store: dedup sorts and removes duplicates", "[key_store]") {
+    detail::key_store store;
+    for (std::string_view k : {"b", "a", "c", "a", "", "b", ""}) store.add(k);
+    store.dedup();
+    REQUIRE(store.size() == 4);
+    REQUIRE(store[0].empty());
+    REQUIRE(store[1] == "a");
+    REQUIRE(store[3] == "c");
+}
+
+TEST_CASE("key_store: copies own their bytes, moves keep them", "[key_store]") {
+    detail::key_store copy;
+    std::vector<std::string> keys = ingest_keys(100);
+    {
+        detail::key_store src;
+        src.add_all(std::span<const std::string>{keys});
+        auto views = as_views(keys);
+        src.borrow_all(views);
+        copy = src;
+        REQUIRE(copy.size() == 200);
+        REQUIRE(copy[150].data() != keys[50].data());
+
+        detail::key_store moved = std::move(src);
+        REQUIRE(moved.size() == 200);
+        REQUIRE(moved[0] == keys[0]);
+        src.add("after-move");  // must not write into moved's arena
+        REQUIRE(moved[0] == keys[0]);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        REQUIRE(copy[i] == keys[i]);
+        REQUIRE(copy[100 + i] == keys[i]);
+    }
+}
+
+// ===== BUILDER INGESTION =====
+
+TEST_CASE("builders: borrowed and blob ingestion match add_all", "[key_store][builder]") {
+    auto keys = ingest_keys(3000);
+    require_same_phf_from_every_path<phobic5>(keys);
+    require_same_phf_from_every_path<phobic5_compact>(keys);
+    require_same_phf_from_every_path<bbhash3>(keys);
+    require_same_phf_from_every_path<chd_hasher>(keys);
+    require_same_phf_from_every_path<fch_hasher>(keys);
+    require_same_phf_from_every_path<pthash98>(keys);
+    require_same_phf_from_every_path<recsplit8>(keys);
+    require_same_phf_from_every_path<shock_hash<64>>(keys);
+    require_same_phf_from_every_path<partitioned_phf<phobic5>>(keys);
+    require_same_phf_from_every_path<padded_phf<phobic5>>(keys);
+}
+
+TEST_CASE("builders: borrowed keys may be duplicated", "[key_store][builder]") {
+    auto keys = ingest_keys(500);
+    auto views = as_views(keys);
+    auto phf = phobic5::builder{}
+        .borrow_all(std::span<const std::string_view>{views})
+        .borrow_all(std::span<const std::string_view>{views})
+        .build();
+    REQUIRE(phf.has_value());
+    REQUIRE(phf->num_keys() == keys.size());
+}
+
+TEST_CASE("phf_value_array: borrow_all matches add_all and last duplicate wins",
+          "[key_store][retrieval]") {
+    auto keys = ingest_keys(2000);
+    auto views = as_views(keys);
+    std::vector<uint8_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint8_t>(i * 31);
+
+    using pva = phf_value_array<phobic5, 8>;
+    auto copied = pva::builder{}.add_all(keys, values).build();
+    auto borrowed = pva::builder{}
+        .borrow_all(std::span<const std::string_view>{views}, values).build();
+    REQUIRE(copied.has_value());
+    REQUIRE(borrowed.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(copied->lookup(keys[i]) == values[i]);
+        REQUIRE(borrowed->lookup(keys[i]) == values[i]);
+    }
+
+    auto dup = pva::builder{}.add("k", 1).add("other", 2).add("k", 3).build();
+    REQUIRE(dup.has_value());
+    REQUIRE(dup->lookup("k") == 3);
+    REQUIRE(dup->lookup("other") == 2);
+}
+
+TEST_CASE("ribbon_retrieval: borrow_all matches add_all", "[key_store][retrieval][ribbon]") {
+    auto keys = ingest_keys(2000);
+    auto views = as_views(keys);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 7919);
+
+    auto copied = ribbon_retrieval<16>::builder{}.add_all(keys, values).build();
+    auto borrowed = ribbon_retrieval<16>::builder{}
+        .borrow_all(std::span<const std::string_view>{views}, values).build();
+    REQUIRE(copied.has_value());
+    REQUIRE(borrowed.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(copied->lookup(keys[i]) == values[i]);
+        REQUIRE(borrowed->lookup(keys[i]) == values[i]);
+    }
+}
+
+TEST_CASE("bloomier and filters: build from borrowed views", "[key_store][bloomier]") {
+    auto keys = ingest_keys(2000);
+    auto views = as_views(keys);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i);
+
+    auto b = bloomier<ribbon_retrieval<16>, xor_filter<8>>::builder{}
+        .borrow_all(std::span<const std::string_view>{views}, values).build();
+    REQUIRE(b.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(b->lookup(keys[i]) == values[i]);
+
+    xor_filter<8> f;
+    REQUIRE(f.build(std::span<const std::string_view>{views}));
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+}
+
+// ===== HASH DEDUP AND RADIX PARTITIONING =====
+
+TEST_CASE("hash_dedup: keeps exactly one copy of each key", "[key_store][dedup]") {
+    auto keys = ingest_keys(20000);
+    std::vector<std::string_view> views;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        views.push_back(keys[i]);
+        if (i % 3 == 0) views.push_back(keys[i]);
+        if (i % 7 == 0) views.push_back(keys[(i * 13) % keys.size()]);
+    }
+    views.push_back({});
+    views.push_back({});
+
+    for (size_t threads : {1u, 4u}) {
+        auto v = views;
+        detail::hash_dedup(v, threads);
+        REQUIRE(v.size() == keys.size() + 1);
+        std::set<std::string_view> unique(v.begin(), v.end());
+        REQUIRE(unique.size() == v.size());
+        // Digest order, independent of the thread count.
+        for (size_t i = 1; i < v.size(); ++i) {
+            REQUIRE(phf_hash128(v[i - 1]).hi <= phf_hash128(v[i]).hi);
+        }
+    }
+}
+
+TEST_CASE("hash_dedup: small inputs match the radix path's order", "[key_store][dedup]") {
+    auto keys = ingest_keys(300);
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    views.push_back(keys[5]);
+    views.push_back(keys[17]);
+
+    auto v = views;
+    detail::hash_dedup(v, 8);
+    REQUIRE(v.size() == keys.size());
+    std::set<std::string_view> unique(v.begin(), v.end());
+    REQUIRE(unique.size() == v.size());
+    for (size_t i = 1; i < v.size(); ++i) {
+        REQUIRE(phf_hash128(v[i - 1]).hi <= phf_hash128(v[i]).hi);
+    }
+}
+
+TEST_CASE("radix_partition: stable grouping for any thread count", "[key_store][dedup]") {
+    std::vector<uint32_t> items(50000);
+    for (size_t i = 0; i < items.size(); ++i) items[i] = static_cast<uint32_t>(i);
+    auto part_of = [](uint32_t x) { return static_cast<size_t>((x * 2654435761u) >> 27); };
+
+    for (size_t threads : {1u, 3u}) {
+        auto v = items;
+        auto offsets = detail::radix_partition(v, 32, [&](size_t i) { return part_of(v[i]); }, threads);
+        REQUIRE(offsets.size() == 33);
+        REQUIRE(offsets.back() == items.size());
+        for (size_t p = 0; p < 32; ++p) {
+            for (size_t i = offsets[p]; i < offsets[p + 1]; ++i) {
+                REQUIRE(part_of(v[i]) == p);
+                if (i > offsets[p]) REQUIRE(v[i - 1] < v[i]);
+            }
+        }
+    }
+}
+
+TEST_CASE("bucket_groups: lists each bucket's keys in index order", "[key_store][dedup]") {
+    std::vector<size_t> bucket_of{3, 0, 3, 1, 0, 3};
+    detail::bucket_groups groups(5, bucket_of.size(), [&](size_t i) { return bucket_of[i]; });
+    REQUIRE(groups.num_buckets() == 5);
+    REQUIRE(groups[0].size() == 2);
+    REQUIRE(groups[0][0] == 1);
+    REQUIRE(groups[0][1] == 4);
+    REQUIRE(groups[1].size() == 1);
+    REQUIRE(groups[2].empty());
+    REQUIRE(groups[3].size() == 3);
+    REQUIRE(groups[3][2] == 5);
+    REQUIRE(groups[4].empty());
+}
+
+TEST_CASE("bucket_groups: assign regroups in place", "[key_store][dedup]") {
+    std::vector<size_t> first{2, 2, 0, 1, 2, 0, 0, 1};
+    detail::bucket_groups groups(3, first.size(), [&](size_t i) { return first[i]; });
+    std::vector<size_t> second{1, 0, 1, 3};
+    groups.assign(4, second.size(), [&](size_t i) { return second[i]; });
+    detail::bucket_groups fresh(4, second.size(), [&](size_t i) { return second[i]; });
+    REQUIRE(groups.num_buckets() == 4);
+    for (size_t b = 0; b < 4; ++b) {
+        REQUIRE(std::ranges::equal(groups[b], fresh[b]));
+    }
+    REQUIRE(groups[1].size() == 2);
+    REQUIRE(groups[1][0] == 0);
+    REQUIRE(groups[1][1] == 2);
+    REQUIRE(groups[2].empty());
+}
+
+TEST_CASE("builders: key_dedup::hash builds valid PHFs from duplicated input",
+          "[key_store][dedup][builder]") {
+    auto keys = ingest_keys(5000);
+    auto doubled = keys;
+    doubled.insert(doubled.end(), keys.begin(), keys.begin() + 2000);
+
+    auto phobic = phobic5::builder{}.add_all(doubled).with_dedup(key_dedup::hash).build();
+    REQUIRE(phobic.has_value());
+    REQUIRE(phobic->num_keys() == keys.size());
+    REQUIRE(is_minimal_perfect(*phobic, keys));
+
+    auto bb = bbhash3::builder{}.add_all(doubled).with_dedup(key_dedup::hash).build();
+    REQUIRE(bb.has_value());
+    std::set<uint64_t> slots;
+    for (const auto& k : keys) slots.insert(bb->slot_for(k).value);
+    REQUIRE(slots.size() == keys.size());
+
+    auto shock = shock_hash<64>::builder{}.add_all(doubled).with_dedup(key_dedup::hash).build();
+    REQUIRE(shock.has_value());
+    REQUIRE(shock->num_keys() == keys.size());
+}
+
+TEST_CASE("partitioned: key_dedup::hash is bijective and thread-count independent",
+          "[key_store][dedup][partitioned]") {
+    auto keys = ingest_keys(40000);
+    auto doubled = keys;
+    doubled.insert(doubled.end(), keys.begin(), keys.end());
+
+    auto one = partitioned_phf<phobic5>::builder{}
+        .add_all(doubled).with_shards(8).with_threads(1).with_dedup(key_dedup::hash).build();
+    auto four = partitioned_phf<phobic5>::builder{}
+        .add_all(doubled).with_shards(8).with_threads(4).with_dedup(key_dedup::hash).build();
+    REQUIRE(one.has_value());
+    REQUIRE(four.has_value());
+    REQUIRE(one->num_keys() == keys.size());
+    REQUIRE(is_minimal_perfect(*one, keys));
+    for (const auto& k : keys) REQUIRE(one->slot_for(k).value == four->slot_for(k).value);
+}
+
+TEST_CASE("partitioned: default sort dedup is unchanged by radix sharding",
+          "[key_store][dedup][partitioned]") {
+    // Shards built from the stable radix split must equal shards built
+    // from the sorted keys directly.
+    auto keys = ingest_keys(20000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(4).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(is_minimal_perfect(*phf, keys));
+    auto bytes = phf->serialize();
+    auto view = partitioned_phf_view<phobic_phf_view<5>>::deserialize(bytes);
+    REQUIRE(view.has_value());
+
+    std::vector<std::string> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t s = 0; s < view->num_shards(); ++s) {
+        std::vector<std::string> shard_keys;
+        for (const auto& k : sorted) {
+            if (static_cast<size_t>(detail::partition_shard_hash(k, 0xac32e5f5b3a8a3d7ULL)
+                                    % view->num_shards()) == s) {
+                shard_keys.push_back(k);
+            }
+        }
+        auto inner = phobic5::builder{}.add_all(shard_keys)
+            .with_seed(0xac32e5f5b3a8a3d7ULL + s * 0x9e3779b97f4a7c15ULL).build();
+        REQUIRE(inner.has_value());
+        for (const auto& k : shard_keys) {
+            REQUIRE(view->shard(s).slot_for(k).value == inner->slot_for(k).value);
+        }
+    }
+}
@@ -0,0 +1,149 @@
+/**
+ * @file test_lazy_partitioned.cpp
+ * @brief Tests for lazy_partitioned_phf: shards decoded on first use.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/lazy_partitioned.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/detail/container.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 29) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+std::string write_temp(const std::string& name, const std::vector<std::byte>& bytes) {
+    auto path = (std::filesystem::temp_directory_path() / ("maph_test_" + name)).string();
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return path;
+}
+
+} // namespace
+
+static_assert(perfect_hash_function<lazy_partitioned_phf<phobic5>>);
+
+TEST_CASE("lazy_partitioned: decodes only the shards queries reach", "[lazy_partitioned]") {
+    auto keys = make_keys(30000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(10).build();
+    REQUIRE(phf.has_value());
+    auto path = write_temp("lazy.bin", to_container(*phf));
+
+    auto lazy = lazy_partitioned_phf<phobic5>::open(path);
+    REQUIRE(lazy.has_value());
+    REQUIRE(lazy->num_shards() == 10);
+    REQUIRE(lazy->num_keys() == phf->num_keys());
+    REQUIRE(lazy->range_size() == phf->range_size());
+    REQUIRE(lazy->loaded_shards() == 0);
+
+    // A key in one shard loads only that shard.
+    const size_t s = lazy->shard_of(keys[0]);
+    REQUIRE(s == phf->shard_of(keys[0]));
+    REQUIRE(lazy->slot_for(keys[0]) == phf->slot_for(keys[0]));
+    REQUIRE(lazy->loaded_shards() == 1);
+    REQUIRE(lazy->is_loaded(s));
+
+    for (const auto& k : keys) REQUIRE(lazy->slot_for(k) == phf->slot_for(k));
+    REQUIRE(lazy->loaded_shards() == 10);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("lazy_partitioned: prefault loads hot shards ahead of queries", "[lazy_partitioned]") {
+    auto keys = make_keys(20000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(8).build();
+    REQUIRE(phf.has_value());
+    auto bytes = to_container(*phf);
+    auto lazy = lazy_partitioned_phf<phobic5>::bind(bytes);
+    REQUIRE(lazy.has_value());
+
+    std::vector<size_t> hot{1, 5, 5, 99};  // duplicates and out-of-range shards are harmless
+    REQUIRE(lazy->prefault(hot, 3).has_value());
+    REQUIRE(lazy->loaded_shards() == 2);
+    REQUIRE(lazy->is_loaded(1));
+    REQUIRE(lazy->is_loaded(5));
+
+    std::vector<std::string_view> some{keys[0], keys[1]};
+    REQUIRE(lazy->prefault_keys(some).has_value());
+    REQUIRE(lazy->is_loaded(lazy->shard_of(keys[0])));
+    REQUIRE(lazy->prefault_all(4).has_value());
+    REQUIRE(lazy->loaded_shards() == 8);
+    REQUIRE(lazy->serialize() == bytes);
+}
+
+TEST_CASE("lazy_partitioned: concurrent first queries load each shard once",
+          "[lazy_partitioned][concurrency]") {
+    auto keys = make_keys(40000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(16).build();
+    REQUIRE(phf.has_value());
+    auto bytes = to_container(*phf);
+    auto lazy = lazy_partitioned_phf<phobic5>::bind(bytes);
+    REQUIRE(lazy.has_value());
+
+    std::vector<slot_index> expected(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) expected[i] = phf->slot_for(keys[i]);
+    std::atomic<size_t> wrong{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < keys.size(); i += 3) {
+                if (lazy->slot_for(keys[i]) != expected[i]) wrong.fetch_add(1);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    REQUIRE(wrong.load() == 0);
+    REQUIRE(lazy->loaded_shards() == 16);
+}
+
+TEST_CASE("lazy_partitioned: views query shards in place; damage stays in its shard",
+          "[lazy_partitioned]") {
+    auto keys = make_keys(20000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(4).build();
+    REQUIRE(phf.has_value());
+    auto bytes = to_container(*phf);
+
+    auto view = lazy_partitioned_phf<phobic_phf_view<5>>::bind(bytes);
+    REQUIRE(view.has_value());
+    for (const auto& k : keys) REQUIRE(view->slot_for(k) == phf->slot_for(k));
+
+    // Corrupt shard 2: the container still opens, shard 2 fails to load
+    // and answers range_size(); the other shards still answer.
+    auto v = container_view::open(bytes);
+    REQUIRE(v.has_value());
+    const auto e = v->entry(*v->find(section_tag::shard, 2));
+    auto damaged = bytes;
+    damaged[e.offset + e.size / 2] ^= std::byte{0x10};
+    auto lazy = lazy_partitioned_phf<phobic5>::bind(damaged);
+    REQUIRE(lazy.has_value());
+    REQUIRE_FALSE(lazy->prefault_all().has_value());
+    REQUIRE(lazy->loaded_shards() == 3);
+    for (const auto& k : keys) {
+        if (lazy->shard_of(k) == 2) REQUIRE(lazy->slot_for(k).value == lazy->range_size());
+        else REQUIRE(lazy->slot_for(k) == phf->slot_for(k));
+    }
+
+    // Legacy serialize() bytes and missing files are refused.
+    REQUIRE_FALSE(lazy_partitioned_phf<phobic5>::bind(phf->serialize()).has_value());
+    REQUIRE_FALSE(lazy_partitioned_phf<phobic5>::open("/nonexistent/maph_lazy.bin").has_value());
+}
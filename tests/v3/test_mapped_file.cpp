@@ -0,0 +1,81 @@
+/**
+ * @file test_mapped_file.cpp
+ * @brief Tests for mapped_file and querying views over a mapped file.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <maph/detail/mapped_file.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::string temp_path(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("maph_test_" + name)).string();
+}
+
+void write_file(const std::string& path, const std::vector<std::byte>& bytes) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(bytes.data()),
+            static_cast<std::streamsize>(bytes.size()));
+}
+
+} // namespace
+
+TEST_CASE("mapped_file: maps the file contents", "[mapped_file]") {
+    std::vector<std::byte> bytes(5000);
+    for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<std::byte>(i * 7);
+    auto path = temp_path("contents.bin");
+    write_file(path, bytes);
+
+    auto mf = mapped_file::open(path);
+    REQUIRE(mf.has_value());
+    REQUIRE(mf->size() == bytes.size());
+    REQUIRE(std::equal(bytes.begin(), bytes.end(), mf->bytes().begin()));
+
+    // Moving keeps the mapping alive and empties the source.
+    mapped_file moved = std::move(*mf);
+    REQUIRE(moved.size() == bytes.size());
+    REQUIRE(mf->empty());
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("mapped_file: empty and missing files", "[mapped_file]") {
+    auto path = temp_path("empty.bin");
+    write_file(path, {});
+    auto mf = mapped_file::open(path);
+    REQUIRE(mf.has_value());
+    REQUIRE(mf->empty());
+    std::filesystem::remove(path);
+
+    auto missing = mapped_file::open(temp_path("does_not_exist.bin"));
+    REQUIRE_FALSE(missing.has_value());
+    REQUIRE(missing.error() == error::io_error);
+}
+
+TEST_CASE("mapped_file: partitioned phobic view queried over a mapped file", "[mapped_file][view]") {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 30000; ++i) keys.push_back("mapped_key_" + std::to_string(i));
+    auto phf = partitioned_phf<phobic_phf<5>>::builder{}
+        .add_all(keys).with_shards(4).build();
+    REQUIRE(phf.has_value());
+    auto path = temp_path("partitioned.phf");
+    write_file(path, phf->serialize());
+
+    auto mf = mapped_file::open(path);
+    REQUIRE(mf.has_value());
+    auto view = partitioned_phf_view<phobic_phf_view<5>>::deserialize(mf->bytes());
+    REQUIRE(view.has_value());
+    REQUIRE(view->bytes().data() == mf->bytes().data());
+    for (const auto& k : keys) {
+        REQUIRE(view->slot_for(k).value == phf->slot_for(k).value);
+    }
+    std::filesystem::remove(path);
+}
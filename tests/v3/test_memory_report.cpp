@@ -0,0 +1,128 @@
+/**
+ * @file test_memory_report.cpp
+ * @brief Tests for measure_memory: resident bytes cover what is allocated,
+ *        serialized bytes match serialize(), and the lower bounds.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <maph/detail/memory_report.hpp>
+#include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) keys.push_back("k" + std::to_string(rng()));
+    return keys;
+}
+
+}  // namespace
+
+TEST_CASE("memory_report: allocated_bytes counts capacity and allocator rounding", "[memory_report]") {
+    std::vector<uint64_t> empty;
+    REQUIRE(detail::allocated_bytes(empty) == 0);
+
+    std::vector<uint64_t> v;
+    v.reserve(100);
+    v.push_back(1);
+    REQUIRE(detail::allocated_bytes(v) >= 100 * sizeof(uint64_t));
+    REQUIRE(detail::allocated_bytes(v) % 16 == 0);
+
+    REQUIRE(detail::heap_block_bytes(1) == 32);
+    const size_t big = size_t{1} << 20;
+    REQUIRE(detail::heap_block_bytes(big) > big);
+    REQUIRE(detail::heap_block_bytes(big) % detail::base_page_bytes == 0);
+
+#if MAPH_HAS_PAGE_CONTROL
+    std::vector<uint64_t, detail::page_allocator<uint64_t, page_size::huge_2m,
+                                                  numa_placement::first_touch>> mapped(
+        detail::min_mapped_bytes / sizeof(uint64_t) + 1);
+    REQUIRE(detail::allocated_bytes(mapped) % detail::huge_2m_bytes == 0);
+    REQUIRE(detail::allocated_bytes(mapped) >= mapped.size() * sizeof(uint64_t));
+#endif
+}
+
+TEST_CASE("memory_report: phf lower bound", "[memory_report]") {
+    REQUIRE(phf_lower_bound_bits(0, 0) == 0.0);
+    REQUIRE(std::abs(phf_lower_bound_bits(1000, 1000) - 1000 * std::numbers::log2e) < 1e-6);
+    // More slack, fewer bits; none needed as the range grows without bound.
+    REQUIRE(phf_lower_bound_bits(1000, 1250) < phf_lower_bound_bits(1000, 1000));
+    REQUIRE(phf_lower_bound_bits(1000, 1000000) < 1.0);
+}
+
+TEST_CASE("memory_report: phobic resident, encoded, serialized", "[memory_report][phobic]") {
+    auto keys = make_keys(20000);
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+
+    auto m = measure_memory(*phf);
+    REQUIRE(m.keys == keys.size());
+    REQUIRE(m.encoded_bytes == phf->memory_bytes());
+    REQUIRE(m.serialized_bytes == phf->serialize().size());
+    REQUIRE(m.resident_bytes >= sizeof(*phf) + phf->pilots().memory_bytes());
+    REQUIRE(std::abs(m.entropy_bits_per_key() - std::numbers::log2e) < 0.01);
+    REQUIRE(m.resident_bits_per_key() > m.entropy_bits_per_key());
+    REQUIRE(m.overhead() > 1.0);
+}
+
+TEST_CASE("memory_report: partitioned_phf counts each shard's object and heap", "[memory_report][partitioned]") {
+    auto keys = make_keys(40000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(16).build();
+    REQUIRE(phf.has_value());
+
+    size_t inner_heap = 0;
+    for (size_t i = 0; i < phf->num_shards(); ++i) inner_heap += phf->shard(i).heap_bytes();
+    auto m = measure_memory(*phf);
+    REQUIRE(m.resident_bytes >= sizeof(*phf) + inner_heap
+                                + phf->num_shards() * sizeof(phobic5));
+    REQUIRE(m.serialized_bytes == phf->serialize().size());
+}
+
+TEST_CASE("memory_report: filters, retrieval and approximate maps", "[memory_report]") {
+    auto keys = make_keys(10000);
+
+    xor_filter<8> f;
+    REQUIRE(f.build(keys));
+    auto fm = measure_memory(f, keys.size());
+    REQUIRE(std::abs(fm.entropy_bits_per_key() - 8.0) < 1e-9);
+    REQUIRE(fm.resident_bytes > f.memory_bytes());
+    REQUIRE(fm.resident_bits_per_key() > 8.0);
+
+    std::vector<uint8_t> values(keys.size(), 3);
+    auto r = ribbon_retrieval<8>::builder{}
+                 .add_all(std::span<const std::string>{keys}, std::span<const uint8_t>{values})
+                 .build();
+    REQUIRE(r.has_value());
+    auto rm = measure_memory(*r);
+    REQUIRE(std::abs(rm.entropy_bits_per_key() - 8.0) < 1e-9);
+    REQUIRE(rm.serialized_bytes == r->serialize().size());
+
+    auto pva = phf_value_array<recsplit8, 8>::builder{}.add_all(keys, values).build();
+    REQUIRE(pva.has_value());
+    auto pm = measure_memory(*pva);
+    REQUIRE(pm.resident_bytes >= sizeof(*pva) + pva->phf().heap_bytes() + pva->values().memory_bytes());
+
+    auto phf = phobic5::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto pf = perfect_filter<phobic5, 16>::build(std::move(*phf), keys);
+    auto am = measure_memory(pf);
+    REQUIRE(std::abs(am.entropy_bits_per_key() - (16.0 + std::numbers::log2e)) < 0.02);
+    REQUIRE(am.encoded_bytes == pf.memory_bytes());
+}
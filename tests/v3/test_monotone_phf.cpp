@@ -0,0 +1,161 @@
+/**
+ * @file test_monotone_phf.cpp
+ * @brief Tests for monotone_phf: slot_for(key) is the key's rank in
+ *        sorted order.
+ *
+ * Every build key must get exactly its position in the sorted, deduped
+ * key set, including keys that are prefixes of one another and key sets
+ * with long shared prefixes.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/monotone_phf.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 57) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Long shared prefixes, keys that are prefixes of others, an empty key.
+std::vector<std::string> make_paths(size_t count) {
+    std::vector<std::string> keys{"", "h", "https://", "https://example.com"};
+    std::mt19937_64 rng{11};
+    for (size_t i = 0; keys.size() < count; ++i) {
+        std::string k = "https://example.com/" + std::to_string(rng() % 97) + "/item/" + std::to_string(i);
+        keys.push_back(k);
+        if (i % 5 == 0) keys.push_back(k + "/");
+        if (i % 7 == 0) keys.push_back(k + std::string(1, '\0'));
+    }
+    return keys;
+}
+
+template<typename P>
+void require_ranks(const P& phf, std::vector<std::string> keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    REQUIRE(phf.num_keys() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(phf.slot_for(keys[i]).value == i);
+}
+
+} // namespace
+
+TEST_CASE("monotone_phf: slot_for is the sorted rank", "[monotone_phf]") {
+    SECTION("random keys") {
+        auto keys = make_keys(30000);
+        auto built = monotone_phf<>::builder{}.add_all(keys).build();
+        REQUIRE(built.has_value());
+        require_ranks(*built, keys);
+        CHECK(built->range_size() == keys.size());
+        CHECK(built->bucket_bits() >= 4);
+        // Against ~30 bits for a stored rank plus the PHF under it.
+        CHECK(built->bits_per_key() < 20.0);
+        CHECK(built->rank(keys[0]) == built->slot_for(keys[0]).value);
+    }
+
+    SECTION("shared prefixes and prefix keys") {
+        auto keys = make_paths(20000);
+        std::vector<std::string_view> views(keys.begin(), keys.end());
+        auto built = monotone_phf<>::builder{}.borrow_all(views).with_threads(2).build();
+        REQUIRE(built.has_value());
+        require_ranks(*built, keys);
+    }
+
+    SECTION("narrow fields") {
+        auto keys = make_keys(5000, 3);
+        auto built = monotone_phf<12>::builder{}.add_all(keys).build();
+        REQUIRE(built.has_value());
+        require_ranks(*built, keys);
+        CHECK(built->bits_per_key() < 16.0);
+    }
+}
+
+TEST_CASE("monotone_phf: small sets, duplicates, serialization", "[monotone_phf]") {
+    for (size_t n : {1, 2, 3, 65}) {
+        auto keys = make_keys(n, n);
+        auto built = monotone_phf<>::builder{}.add_all(keys).build();
+        REQUIRE(built.has_value());
+        require_ranks(*built, keys);
+    }
+
+    auto keys = make_keys(4000, 9);
+    monotone_phf<>::builder b;
+    for (const auto& k : keys) b.add(k);
+    b.add(keys[17]);
+    auto built = b.build();
+    REQUIRE(built.has_value());
+    require_ranks(*built, keys);
+
+    // A non-member still lands in range.
+    CHECK(built->slot_for("not a key").value < keys.size());
+    CHECK(built->slot_for("").value < keys.size());
+
+    auto bytes = built->serialize();
+    auto loaded = monotone_phf<>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->bucket_bits() == built->bucket_bits());
+    require_ranks(*loaded, keys);
+    CHECK_FALSE(monotone_phf<12>::deserialize(bytes).has_value());
+    CHECK_FALSE(monotone_phf<>::deserialize(std::span<const std::byte>(bytes).first(40)).has_value());
+
+    CHECK_FALSE(monotone_phf<>::builder{}.build().has_value());
+}
+
+TEST_CASE("monotone_phf: corrupt prefix length tables", "[monotone_phf]") {
+    // [16-byte header][u64 n][u32 bucket_bits][u32 lengths][u32 length...]
+    auto keys = make_keys(4000, 11);
+
+    // With no bucket bits the 32-bit values do not bound the count of
+    // lengths; the bytes left must.
+    auto wide = monotone_phf<32>::builder{}.add_all(keys).build();
+    REQUIRE(wide.has_value());
+    auto many = wide->serialize();
+    REQUIRE(monotone_phf<32>::deserialize(many).has_value());
+    const uint32_t no_bits = 0, count = ~uint32_t{0};
+    std::memcpy(many.data() + 24, &no_bits, sizeof(no_bits));
+    std::memcpy(many.data() + 28, &count, sizeof(count));
+    CHECK_FALSE(monotone_phf<32>::deserialize(many).has_value());
+
+    // Lengths must ascend. Eight bits force small buckets, and so
+    // several prefix lengths.
+    auto narrow = monotone_phf<8>::builder{}.add_all(keys).build();
+    REQUIRE(narrow.has_value());
+    REQUIRE(narrow->num_prefix_lengths() >= 2);
+    const auto bytes = narrow->serialize();
+    REQUIRE(monotone_phf<8>::deserialize(bytes).has_value());
+    auto swapped = bytes;
+    std::memcpy(swapped.data() + 32, bytes.data() + 36, 4);
+    std::memcpy(swapped.data() + 36, bytes.data() + 32, 4);
+    CHECK_FALSE(monotone_phf<8>::deserialize(swapped).has_value());
+}
+
+TEST_CASE("monotone_phf: prefix lengths that do not fit", "[monotone_phf]") {
+    // Two bits leave room for at most four prefix lengths, and keys of
+    // many lengths with no shared structure need more at every bucket size.
+    std::vector<std::string> keys;
+    std::mt19937_64 rng{5};
+    for (size_t i = 0; i < 2000; ++i) {
+        std::string k(1 + rng() % 12, ' ');
+        for (auto& c : k) c = static_cast<char>(rng());
+        keys.push_back(k);
+    }
+    auto built = monotone_phf<2>::builder{}.add_all(keys).build();
+    REQUIRE_FALSE(built.has_value());
+    CHECK(built.error() == error::value_too_large);
+}
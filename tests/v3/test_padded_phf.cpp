@@ -102,6 +102,19 @@ TEST_CASE("padded_phf: padding_factor=1 acts as pass-through",
     }
 }
 
+TEST_CASE("padded_phf: slot_for(hashed_key) matches slot_for",
+          "[padded_phf][hashed]") {
+    auto keys = make_keys(1000);
+    auto built = padded_phf<phobic5>::builder{}
+        .add_all(keys)
+        .with_padding(4)
+        .build();
+    REQUIRE(built.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(built->slot_for(hashed_key{k}).value == built->slot_for(k).value);
+    }
+}
+
 TEST_CASE("padded_phf: serialize/deserialize round-trip",
           "[padded_phf][serialize]") {
     auto keys = make_keys(400);
@@ -207,3 +220,61 @@ TEST_CASE("encoded_retrieval with padded_phf, large padding: default dominates",
     double frac_c = static_cast<double>(count_c) / N_unknown;
     REQUIRE(frac_c > 0.88);
 }
+
+TEST_CASE("padded_phf: data without the digest-offset flag keeps its offsets",
+          "[padded_phf][serialize]") {
+    auto keys = make_keys(2000);
+    auto built = padded_phf<phobic5>::builder{}.add_all(keys).with_padding(9).build();
+    REQUIRE(built.has_value());
+
+    // The earlier offset (finalizer and modulo) over the same inner PHF.
+    auto inner = phobic5::deserialize(built->inner().serialize());
+    REQUIRE(inner.has_value());
+    padded_phf<phobic5> legacy{std::move(*inner), 9, 0xa076'1d64'78bd'642fULL,
+                               hash_revision::wide, false};
+    auto restored = padded_phf<phobic5>::deserialize(legacy.serialize());
+    REQUIRE(restored.has_value());
+    CHECK(restored->padding_factor() == 9);
+
+    std::unordered_set<uint64_t> slots;
+    size_t moved = 0;
+    for (const auto& k : keys) {
+        const uint64_t s = restored->slot_for(k).value;
+        REQUIRE(s == legacy.slot_for(k).value);
+        REQUIRE(s / 9 == built->slot_for(k).value / 9);
+        slots.insert(built->slot_for(k).value);
+        if (s != built->slot_for(k).value) ++moved;
+    }
+    CHECK(slots.size() == keys.size());
+    CHECK(moved > keys.size() / 2);
+}
+
+TEST_CASE("phf_value_array<padded_phf>: threaded fill and scatter match one thread",
+          "[padded_phf][threads]") {
+    auto keys = make_keys(30000, 7);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 7919 & 0x1fff);
+
+    using PVA = phf_value_array<padded_phf<phobic5>, 13>;
+    auto build = [&](size_t threads) {
+        PVA::builder b;
+        b.add_all(std::span<const std::string>{keys}, std::span<const uint16_t>{values})
+            .with_padding(8).with_fill_pattern(0x1abc).with_threads(threads);
+        b.add(keys[11], 0x0123);  // a repeat: the last value wins
+        return b.build();
+    };
+    auto one = build(1);
+    auto four = build(4);
+    REQUIRE(one.has_value());
+    REQUIRE(four.has_value());
+    CHECK(four->serialize() == one->serialize());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(four->lookup(keys[i]) == (i == 11 ? 0x0123 : values[i]));
+    }
+    // Slots nobody maps to hold the fill pattern.
+    size_t filled = 0;
+    for (size_t i = 0; i < 2000; ++i) {
+        if (four->lookup("absent_" + std::to_string(i)) == 0x1abc) ++filled;
+    }
+    CHECK(filled > 1600);
+}
@@ -0,0 +1,187 @@
+/**
+ * @file test_page_allocator.cpp
+ * @brief Tests for page_allocator and the storage policies that use it.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/detail/page_allocator.hpp>
+#include <maph/filters/xor_filter.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 23) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+template<typename Alloc>
+void check_vector_roundtrip(size_t n, size_t alignment) {
+    std::vector<uint64_t, Alloc> v(n);
+    for (size_t i = 0; i < n; ++i) v[i] = i * 0x9e3779b97f4a7c15ULL;
+    REQUIRE(reinterpret_cast<uintptr_t>(v.data()) % alignment == 0);
+    for (size_t i = 0; i < n; ++i) REQUIRE(v[i] == i * 0x9e3779b97f4a7c15ULL);
+    v.resize(n * 2);  // reallocates through the same allocator
+    for (size_t i = 0; i < n; ++i) REQUIRE(v[i] == i * 0x9e3779b97f4a7c15ULL);
+}
+
+} // namespace
+
+static_assert(storage_policy<heap_storage>);
+static_assert(storage_policy<huge_page_storage>);
+static_assert(storage_policy<numa_interleaved_storage>);
+static_assert(std::same_as<heap_storage::array<int>, std::vector<int>>);
+static_assert(perfect_hash_function<phobic_phf<5, flat_pilots, huge_page_storage>>);
+
+TEST_CASE("page_allocator: mapping granule follows the page size", "[page_allocator]") {
+    using detail::mapping_granule;
+    constexpr size_t MiB = size_t{1} << 20;
+    REQUIRE(mapping_granule(page_size::base, 8 * MiB) == 4096);
+    REQUIRE(mapping_granule(page_size::transparent, 8 * MiB) == 2 * MiB);
+    REQUIRE(mapping_granule(page_size::huge_2m, 8 * MiB) == 2 * MiB);
+    REQUIRE(mapping_granule(page_size::huge_1g, 8 * MiB) == 2 * MiB);
+    REQUIRE(mapping_granule(page_size::huge_1g, 1024 * MiB) == 1024 * MiB);
+}
+
+TEST_CASE("page_allocator: small and large allocations hold their contents", "[page_allocator]") {
+    constexpr size_t small = 100;
+    constexpr size_t large = 3 * detail::min_mapped_bytes / sizeof(uint64_t);
+
+    SECTION("base pages") {
+        using A = detail::page_allocator<uint64_t, page_size::base, numa_placement::first_touch>;
+        check_vector_roundtrip<A>(small, alignof(uint64_t));
+        check_vector_roundtrip<A>(large, MAPH_HAS_PAGE_CONTROL ? 4096 : alignof(uint64_t));
+    }
+    SECTION("transparent huge pages") {
+        using A = detail::page_allocator<uint64_t, page_size::transparent, numa_placement::first_touch>;
+        check_vector_roundtrip<A>(small, alignof(uint64_t));
+        check_vector_roundtrip<A>(large, MAPH_HAS_PAGE_CONTROL ? detail::huge_2m_bytes : alignof(uint64_t));
+    }
+    SECTION("explicit huge pages fall back when none are reserved") {
+        using A2 = detail::page_allocator<uint64_t, page_size::huge_2m, numa_placement::first_touch>;
+        using A1 = detail::page_allocator<uint64_t, page_size::huge_1g, numa_placement::first_touch>;
+        check_vector_roundtrip<A2>(large, MAPH_HAS_PAGE_CONTROL ? detail::huge_2m_bytes : alignof(uint64_t));
+        check_vector_roundtrip<A1>(large, MAPH_HAS_PAGE_CONTROL ? detail::huge_2m_bytes : alignof(uint64_t));
+    }
+    SECTION("NUMA placement") {
+        using L = detail::page_allocator<uint64_t, page_size::transparent, numa_placement::local>;
+        using I = detail::page_allocator<uint64_t, page_size::transparent, numa_placement::interleave>;
+        check_vector_roundtrip<L>(large, alignof(uint64_t));
+        check_vector_roundtrip<I>(large, alignof(uint64_t));
+    }
+}
+
+TEST_CASE("page_allocator: rebound allocators compare equal", "[page_allocator]") {
+    detail::page_allocator<uint64_t, page_size::transparent, numa_placement::first_touch> a;
+    detail::page_allocator<uint16_t, page_size::transparent, numa_placement::first_touch> b{a};
+    REQUIRE(a == b);
+}
+
+TEST_CASE("storage: phobic_phf with mapped pilots matches the heap build", "[page_allocator][phobic]") {
+    auto keys = make_keys(20000);
+    auto heap = phobic_phf<5>::builder{}.add_all(keys).with_seed(3).build();
+    auto mapped = phobic_phf<5, flat_pilots, huge_page_storage>::builder{}
+                      .add_all(keys).with_seed(3).build();
+    auto compact = phobic_phf<5, compact_pilots, numa_local_storage>::builder{}
+                       .add_all(keys).with_seed(3).build();
+    REQUIRE(heap.has_value());
+    REQUIRE(mapped.has_value());
+    REQUIRE(compact.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(mapped->slot_for(k) == heap->slot_for(k));
+        REQUIRE(compact->slot_for(k) == heap->slot_for(k));
+    }
+
+    // Serialized bytes do not depend on the storage.
+    auto bytes = heap->serialize();
+    REQUIRE(mapped->serialize() == bytes);
+    auto loaded = phobic_phf<5, flat_pilots, huge_page_storage>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (const auto& k : keys) REQUIRE(loaded->slot_for(k) == heap->slot_for(k));
+}
+
+TEST_CASE("storage: phf_value_array with mapped values matches the heap build",
+          "[page_allocator][retrieval]") {
+    // 300k 32-bit values: past min_mapped_bytes, so the mapping path runs.
+    auto keys = make_keys(300000);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i * 2654435761u);
+
+    auto heap = phf_value_array<phobic_phf<5>, 32>::builder{}.add_all(keys, values).build();
+    using mapped_type = phf_value_array<phobic_phf<5, flat_pilots, huge_page_storage>, 32,
+                                        huge_page_storage>;
+    auto mapped = mapped_type::builder{}.add_all(keys, values).build();
+    REQUIRE(heap.has_value());
+    REQUIRE(mapped.has_value());
+    REQUIRE(mapped->memory_bytes() == heap->memory_bytes());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(mapped->lookup(keys[i]) == values[i]);
+
+    auto bytes = heap->serialize();
+    REQUIRE(mapped->serialize() == bytes);
+    auto loaded = mapped_type::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (size_t i = 0; i < keys.size(); i += 97) REQUIRE(loaded->lookup(keys[i]) == values[i]);
+}
+
+TEST_CASE("storage: ribbon_retrieval with a mapped solution matches the heap build",
+          "[page_allocator][retrieval]") {
+    auto keys = make_keys(20000);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint16_t>(i * 40503u);
+
+    auto heap = ribbon_retrieval<16>::builder{}.add_all(keys, values).build();
+    auto flat = ribbon_retrieval<16, flat_solution, numa_interleaved_storage>::builder{}
+                    .add_all(keys, values).build();
+    auto inter = ribbon_retrieval<16, interleaved_solution, huge_page_storage>::builder{}
+                     .add_all(keys, values).build();
+    REQUIRE(heap.has_value());
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(flat->lookup(keys[i]) == values[i]);
+        REQUIRE(inter->lookup(keys[i]) == values[i]);
+    }
+
+    auto bytes = heap->serialize();
+    REQUIRE(flat->serialize() == bytes);
+    // Owning structures convert between layouts on load, whatever the storage.
+    auto converted = ribbon_retrieval<16, interleaved_solution, huge_page_storage>::deserialize(bytes);
+    REQUIRE(converted.has_value());
+    for (size_t i = 0; i < keys.size(); i += 31) REQUIRE(converted->lookup(keys[i]) == values[i]);
+}
+
+TEST_CASE("storage: xor_filter with a mapped table matches the heap build",
+          "[page_allocator][xor_filter]") {
+    // ~1.23 * 300k 32-bit fingerprints: past min_mapped_bytes.
+    auto keys = make_keys(300000);
+    xor_filter<32> heap;
+    xor_filter<32, numa_interleaved_storage> mapped;
+    REQUIRE(heap.build(keys));
+    REQUIRE(mapped.build(keys));
+    for (const auto& k : keys) REQUIRE(mapped.verify(k));
+
+    auto probes = make_keys(20000, 99);
+    for (const auto& p : probes) REQUIRE(mapped.verify(p) == heap.verify(p));
+
+    auto bytes = heap.serialize();
+    REQUIRE(mapped.serialize() == bytes);
+    auto loaded = xor_filter<32, numa_interleaved_storage>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (size_t i = 0; i < keys.size(); i += 53) REQUIRE(loaded->verify(keys[i]));
+}
@@ -6,9 +6,14 @@
 #include <catch2/catch_test_macros.hpp>
 #include <maph/composition/partitioned.hpp>
 #include <maph/algorithms/phobic.hpp>
+#include <maph/algorithms/pthash.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+#include <maph/detail/container.hpp>
 #include <random>
 #include <set>
+#include <sstream>
 #include <algorithm>
+#include <cstring>
 
 using namespace maph;
 
@@ -70,6 +75,18 @@ TEST_CASE("partitioned: bijectivity across inner variants", "[partitioned]") {
     REQUIRE(verify_bijectivity(*p5, keys));
 }
 
+TEST_CASE("partitioned: pthash inner at scale", "[partitioned][pthash]") {
+    auto keys = make_keys(200000);
+    auto phf = partitioned_phf<pthash98>::builder{}.add_all(keys).with_threads(2).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(verify_bijectivity(*phf, keys));
+    auto restored = partitioned_phf<pthash98>::deserialize(phf->serialize());
+    REQUIRE(restored.has_value());
+    for (size_t i = 0; i < keys.size(); i += 101) {
+        REQUIRE(restored->slot_for(keys[i]).value == phf->slot_for(keys[i]).value);
+    }
+}
+
 TEST_CASE("partitioned: auto shard count", "[partitioned]") {
     auto keys = make_keys(50000);
     auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(0).build();
@@ -128,3 +145,400 @@ TEST_CASE("partitioned: single shard degenerate case", "[partitioned]") {
     REQUIRE(phf.has_value());
     REQUIRE(verify_bijectivity(*phf, keys));
 }
+
+TEST_CASE("partitioned: slot_for_batch matches slot_for", "[partitioned][batch]") {
+    auto keys = make_keys(5000);
+    auto phf = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(8).build();
+    REQUIRE(phf.has_value());
+
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    std::vector<slot_index> out(queries.size());
+    slot_for_batch(*phf, queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("partitioned: interleaved stages match slot_for", "[partitioned][interleaved]") {
+    auto keys = make_keys(20000);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i);
+    auto r = phf_value_array<partitioned_phf<phobic5>, 32>::builder{}
+        .add_all(keys, values).with_threads(2).build();
+    REQUIRE(r.has_value());
+
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::vector<uint32_t> out(views.size());
+    r->lookup_interleaved<8>(views, out);
+    REQUIRE(out == values);
+
+    size_t calls = 0;
+    detail::interleave_keys<16>(
+        r->phf(), views,
+        [&](detail::lookup_cursor& c) { return r->phf().lookup_step(c); },
+        [&](size_t i, const detail::lookup_cursor& c) {
+            ++calls;
+            REQUIRE(c.slot == r->phf().slot_for(views[i]).value);
+        });
+    REQUIRE(calls == views.size());
+}
+
+TEST_CASE("partitioned: slot_for(hashed_key) matches slot_for", "[partitioned][hashed]") {
+    auto keys = make_keys(5000);
+    auto phf = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(8).build();
+    REQUIRE(phf.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(phf->slot_for(hashed_key{k}).value == phf->slot_for(k).value);
+    }
+}
+
+TEST_CASE("partitioned_phf_view: answers like the owning partitioned_phf", "[partitioned][view]") {
+    auto keys = make_keys(20000);
+    auto phf = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(8).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    auto view = partitioned_phf_view<phobic_phf_view<5>>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_shards() == 8);
+    REQUIRE(view->num_keys() == phf->num_keys());
+    REQUIRE(view->range_size() == phf->range_size());
+    REQUIRE(view->serialize() == bytes);
+    for (const auto& k : keys) {
+        REQUIRE(view->slot_for(k).value == phf->slot_for(k).value);
+    }
+
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.push_back("not-a-member");
+    std::vector<slot_index> out(queries.size());
+    slot_for_batch(*view, queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("partitioned_phf_view: rejects truncated input", "[partitioned][view]") {
+    auto keys = make_keys(3000);
+    auto phf = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(3).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+    for (size_t cut : {size_t{0}, size_t{30}, bytes.size() / 2, bytes.size() - 1}) {
+        REQUIRE_FALSE(partitioned_phf_view<phobic_phf_view<5>>::deserialize(
+            std::span<const std::byte>(bytes).first(cut)).has_value());
+    }
+}
+
+TEST_CASE("partitioned stream_builder: matches the in-memory builder", "[partitioned][stream]") {
+    auto keys = make_keys(30000);
+    auto in_memory = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(6).with_seed(7).build();
+    // A tiny budget forces many spills per shard.
+    auto streamed = partitioned_phf<phobic5>::stream_builder{}
+        .with_shards(6).with_seed(7).with_threads(2).with_memory_budget(4096)
+        .add_all(keys).build();
+    REQUIRE(in_memory.has_value());
+    REQUIRE(streamed.has_value());
+    REQUIRE(streamed->num_keys() == keys.size());
+    REQUIRE(streamed->serialize() == in_memory->serialize());
+}
+
+TEST_CASE("partitioned stream_builder: duplicates, lines and expected_keys", "[partitioned][stream]") {
+    auto keys = make_keys(20000);
+    std::string text;
+    for (const auto& k : keys) text += k + "\n";
+    for (size_t i = 0; i < keys.size(); i += 3) text += keys[i] + "\n";
+    std::istringstream in{text};
+
+    auto phf = partitioned_phf<phobic5>::stream_builder{}
+        .with_expected_keys(keys.size()).add_lines(in).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(phf->num_keys() == keys.size());
+    REQUIRE(verify_bijectivity(*phf, keys));
+}
+
+TEST_CASE("partitioned stream_builder: sizes shards from the streamed count", "[partitioned][stream]") {
+    auto keys = make_keys(40000);
+    auto in_memory = partitioned_phf<phobic5>::builder{}.add_all(keys).with_seed(3).build();
+    // Neither with_shards nor with_expected_keys: one spill file, split
+    // three ways at build().
+    auto streamed = partitioned_phf<phobic5>::stream_builder{}
+        .with_seed(3).with_memory_budget(1 << 16).add_all(keys).build();
+    REQUIRE(in_memory.has_value());
+    REQUIRE(streamed.has_value());
+    REQUIRE(streamed->num_shards() == 3);
+    REQUIRE(streamed->serialize() == in_memory->serialize());
+
+    auto tiny = partitioned_phf<phobic5>::stream_builder{}.add("a").add("b").build();
+    REQUIRE(tiny.has_value());
+    REQUIRE(tiny->num_shards() == 1);
+    REQUIRE(tiny->num_keys() == 2);
+}
+
+TEST_CASE("partitioned stream_builder: reports a bad temp directory", "[partitioned][stream]") {
+    auto phf = partitioned_phf<phobic5>::stream_builder{}
+        .with_temp_dir("/nonexistent/maph/spill").with_shards(2)
+        .add("a").add("b").build();
+    REQUIRE_FALSE(phf.has_value());
+    REQUIRE(phf.error() == error::io_error);
+}
+
+TEST_CASE("partitioned: with_previous rebuilds only the touched shards", "[partitioned][incremental]") {
+    auto keys = make_keys(40000);
+    auto old = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(16).build();
+    REQUIRE(old.has_value());
+
+    // Drop two keys and add three; at most five shards change.
+    std::vector<std::string> removed{keys[5], keys[900]};
+    std::vector<std::string> added{"added_one", "added_two", "added_three"};
+    std::vector<std::string> next;
+    for (const auto& k : keys) {
+        if (k != removed[0] && k != removed[1]) next.push_back(k);
+    }
+    next.insert(next.end(), added.begin(), added.end());
+
+    std::vector<std::string_view> next_v(next.begin(), next.end());
+    std::vector<std::string_view> added_v(added.begin(), added.end());
+    std::vector<std::string_view> removed_v(removed.begin(), removed.end());
+    auto phf = partitioned_phf<phobic5>::rebuild_shards(*old, next_v, added_v, removed_v);
+    REQUIRE(phf.has_value());
+    REQUIRE(phf->num_keys() == next.size());
+    REQUIRE(phf->num_shards() == old->num_shards());
+    REQUIRE(verify_bijectivity(*phf, next));
+
+    std::set<size_t> touched;
+    for (const auto& k : added) touched.insert(old->shard_of(k));
+    for (const auto& k : removed) touched.insert(old->shard_of(k));
+    for (size_t i = 0; i < phf->num_shards(); ++i) {
+        if (!touched.contains(i)) REQUIRE(phf->shard(i).serialize() == old->shard(i).serialize());
+    }
+}
+
+TEST_CASE("partitioned: a change missing from with_previous still rebuilds its shard",
+          "[partitioned][incremental]") {
+    auto keys = make_keys(20000);
+    auto old = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(8).build();
+    REQUIRE(old.has_value());
+    keys.push_back("unannounced");
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys)
+                   .with_previous(*old, {}, {}).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(verify_bijectivity(*phf, keys));
+}
+
+TEST_CASE("partitioned: an unannounced swap inside a shard is not reused",
+          "[partitioned][incremental]") {
+    auto keys = make_keys(20000);
+    auto old = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(8).build();
+    REQUIRE(old.has_value());
+    // Same shard, same key count: only the reuse check can catch it.
+    std::string swapped;
+    for (size_t i = 0; swapped.empty(); ++i) {
+        std::string candidate = "swapped_" + std::to_string(i);
+        if (old->shard_of(candidate) == old->shard_of(keys[0])) swapped = candidate;
+    }
+    keys[0] = swapped;
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys)
+                   .with_previous(*old, {}, {}).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(verify_bijectivity(*phf, keys));
+}
+
+TEST_CASE("partitioned: stable ranges keep shard offsets across rebuilds",
+          "[partitioned][incremental]") {
+    auto keys = make_keys(30000);
+    auto old = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(10)
+                   .with_stable_ranges(0.05).build();
+    REQUIRE(old.has_value());
+    REQUIRE(old->range_size() > old->num_keys());
+    for (size_t i = 0; i < old->num_shards(); ++i) {
+        REQUIRE(old->shard_offset(i + 1) - old->shard_offset(i) >= old->shard(i).range_size());
+    }
+    REQUIRE(verify_bijectivity(*old, keys));
+
+    std::vector<std::string> added;
+    for (int i = 0; i < 4; ++i) added.push_back("fresh_" + std::to_string(i));
+    auto next = keys;
+    next.insert(next.end(), added.begin(), added.end());
+    std::vector<std::string_view> added_v(added.begin(), added.end());
+
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(next)
+                   .with_stable_ranges(0.05).with_previous(*old, added_v, {}).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(verify_bijectivity(*phf, next));
+    for (size_t i = 0; i <= old->num_shards(); ++i) REQUIRE(phf->shard_offset(i) == old->shard_offset(i));
+
+    // Keys of untouched shards keep their slots.
+    std::set<size_t> touched;
+    for (const auto& k : added) touched.insert(old->shard_of(k));
+    size_t kept = 0;
+    for (const auto& k : keys) {
+        if (touched.contains(old->shard_of(k))) continue;
+        REQUIRE(phf->slot_for(k) == old->slot_for(k));
+        ++kept;
+    }
+    REQUIRE(kept > 0);
+
+    // Outgrowing a reservation lays the shards out afresh.
+    std::vector<std::string> many;
+    for (int i = 0; i < 4000; ++i) many.push_back("grow_" + std::to_string(i));
+    auto grown = next;
+    grown.insert(grown.end(), many.begin(), many.end());
+    std::vector<std::string_view> many_v(many.begin(), many.end());
+    auto relaid = partitioned_phf<phobic5>::builder{}.add_all(grown)
+                      .with_stable_ranges(0.05).with_previous(*phf, many_v, {}).build();
+    REQUIRE(relaid.has_value());
+    REQUIRE(verify_bijectivity(*relaid, grown));
+    REQUIRE(relaid->range_size() != phf->range_size());
+}
+
+TEST_CASE("partitioned: threaded serialize and deserialize match the sequential bytes",
+          "[partitioned][serialization]") {
+    auto keys = make_keys(40000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(13).build();
+    REQUIRE(phf.has_value());
+    const auto bytes = phf->serialize();
+
+    for (size_t threads : {size_t{1}, size_t{3}, size_t{8}}) {
+        REQUIRE(phf->serialize(threads) == bytes);
+        REQUIRE(phf->serialized_size(threads) == bytes.size());
+        auto back = partitioned_phf<phobic5>::deserialize(bytes, threads);
+        REQUIRE(back.has_value());
+        REQUIRE(back->serialize() == bytes);
+        auto sectioned = from_container<partitioned_phf<phobic5>>(to_container(*phf), threads);
+        REQUIRE(sectioned.has_value());
+        REQUIRE(sectioned->serialize() == bytes);
+    }
+    auto back = partitioned_phf<phobic5>::deserialize(bytes, 4);
+    for (const auto& k : keys) REQUIRE(back->slot_for(k) == phf->slot_for(k));
+
+    // A damaged shard is reported whichever worker meets it.
+    auto cut = bytes;
+    cut.resize(bytes.size() - 3);
+    REQUIRE_FALSE(partitioned_phf<phobic5>::deserialize(cut, 4).has_value());
+}
+
+TEST_CASE("partitioned: serialize_to streams the serialize() bytes",
+          "[partitioned][serialization]") {
+    auto keys = make_keys(30000);
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(keys).with_shards(21).build();
+    REQUIRE(phf.has_value());
+    const auto bytes = phf->serialize();
+
+    std::ostringstream os;
+    REQUIRE(phf->serialize_to(os, 4).has_value());
+    const auto streamed = os.str();
+    REQUIRE(streamed.size() == bytes.size());
+    REQUIRE(std::memcmp(streamed.data(), bytes.data(), bytes.size()) == 0);
+
+    // Chunks arrive in order and no chunk holds more than a window of shards.
+    size_t largest = 0;
+    std::vector<std::byte> joined;
+    auto sink = [&](std::span<const std::byte> chunk) {
+        largest = std::max(largest, chunk.size());
+        joined.insert(joined.end(), chunk.begin(), chunk.end());
+        return true;
+    };
+    REQUIRE(phf->serialize_to(sink, 2).has_value());
+    REQUIRE(joined == bytes);
+    REQUIRE(largest < bytes.size() / 2);
+
+    size_t calls = 0;
+    auto failing = [&](std::span<const std::byte>) { return ++calls < 3; };
+    auto r = phf->serialize_to(failing);
+    REQUIRE_FALSE(r.has_value());
+    REQUIRE(r.error() == error::io_error);
+
+    // Compositions over a partitioned_phf stream and decode it the same way.
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<uint32_t>(i);
+    auto pva = phf_value_array<partitioned_phf<phobic5>, 32>::builder{}.add_all(keys, values).build();
+    REQUIRE(pva.has_value());
+    const auto pva_bytes = pva->serialize();
+    REQUIRE(pva->serialize(3) == pva_bytes);
+    std::ostringstream pos;
+    REQUIRE(pva->serialize_to(pos, 3).has_value());
+    REQUIRE(pos.str().size() == pva_bytes.size());
+    REQUIRE(std::memcmp(pos.str().data(), pva_bytes.data(), pva_bytes.size()) == 0);
+    auto pva_back = phf_value_array<partitioned_phf<phobic5>, 32>::deserialize(pva_bytes, 3);
+    REQUIRE(pva_back.has_value());
+    for (size_t i = 0; i < keys.size(); i += 11) REQUIRE(pva_back->lookup(keys[i]) == values[i]);
+}
+
+TEST_CASE("partitioned: integer keys route and resolve like their bytes", "[partitioned][integer_key]") {
+    std::mt19937_64 rng{33};
+    std::vector<uint64_t> ids(30000);
+    for (auto& id : ids) id = rng();
+    auto phf = partitioned_phf<phobic5>::builder{}.add_all(ids).with_shards(4).build();
+    REQUIRE(phf.has_value());
+    std::set<uint64_t> slots;
+    for (const auto& id : ids) {
+        const auto s = phf->slot_for(id);
+        REQUIRE(s == phf->slot_for(integer_key_bytes(id)));
+        slots.insert(s.value);
+    }
+    REQUIRE(slots.size() == ids.size());
+}
+
+TEST_CASE("partitioned: builds from pre-hashed digests, routed like their keys", "[partitioned][add_hashes]") {
+    auto keys = make_keys(30000);
+    std::vector<hash128> digests;
+    for (const auto& k : keys) digests.push_back(phf_hash128(k));
+
+    auto phf = partitioned_phf<phobic5>::builder{}.add_hashes(digests).with_shards(4).build();
+    REQUIRE(phf.has_value());
+    REQUIRE(phf->num_keys() == keys.size());
+    std::set<uint64_t> slots;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const auto s = phf->slot_for(digests[i]);
+        REQUIRE(s == phf->slot_for(keys[i]));
+        slots.insert(s.value);
+    }
+    REQUIRE(slots.size() == keys.size());
+
+    digests.push_back(digests[17]);
+    auto twice = partitioned_phf<phobic5>::builder{}.add_hashes(digests).build();
+    REQUIRE_FALSE(twice.has_value());
+    REQUIRE(twice.error() == error::duplicate_key);
+}
+
+TEST_CASE("partitioned: a shared executor builds what with_threads builds", "[partitioned][executor]") {
+    auto keys = make_keys(40000);
+    auto want = partitioned_phf<phobic5>::builder{}
+        .add_all(keys).with_shards(6).with_seed(9).with_threads(1).build();
+    REQUIRE(want.has_value());
+
+    // More shards than threads: the pool's threads take shards. Fewer:
+    // shards build in turn and each runs its pilot search on the pool.
+    executor pool{4};
+    for (size_t shards : {size_t{6}, size_t{2}}) {
+        auto ref = partitioned_phf<phobic5>::builder{}
+            .add_all(keys).with_shards(shards).with_seed(9).build();
+        auto got = partitioned_phf<phobic5>::builder{}
+            .add_all(keys).with_shards(shards).with_seed(9).with_executor(pool).build();
+        REQUIRE(ref.has_value());
+        REQUIRE(got.has_value());
+        REQUIRE(got->serialize() == ref->serialize());
+    }
+
+    // Shards too small for their own parallel path keep the per-shard
+    // loop rather than building in turn.
+    auto small = make_keys(3000);
+    auto small_ref = partitioned_phf<phobic5>::builder{}.add_all(small).with_shards(2).build();
+    auto small_got = partitioned_phf<phobic5>::builder{}
+        .add_all(small).with_shards(2).with_executor(pool).build();
+    REQUIRE(small_ref.has_value());
+    REQUIRE(small_got.has_value());
+    REQUIRE(small_got->serialize() == small_ref->serialize());
+
+    // Forwarded through the value array to the partitioned builder.
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values[i] = static_cast<uint16_t>(i);
+    auto m = phf_value_array<partitioned_phf<phobic5>, 16>::builder{}
+        .add_all(keys, values).with_executor(pool).build();
+    REQUIRE(m.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(m->lookup(keys[i]) == values[i]);
+}
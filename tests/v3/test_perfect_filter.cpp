@@ -9,6 +9,10 @@
 #include <random>
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace maph;
 
@@ -75,6 +79,16 @@ TEST_CASE("perfect_filter: known keys accepted (8-bit)", "[perfect_filter]") {
     }
 }
 
+TEST_CASE("perfect_filter: borrowed views build the same filter", "[perfect_filter]") {
+    auto keys = make_keys(1000);
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto copy = phobic5::deserialize(phf.serialize()).value();
+    auto owned = perfect_filter<phobic5, 16>::build(std::move(phf), keys);
+    auto borrowed = perfect_filter<phobic5, 16>::build(std::move(copy), std::span<const std::string_view>{views});
+    REQUIRE(borrowed.serialize() == owned.serialize());
+}
+
 // Note: 10-bit test deferred to after Task 4 (relaxed width constraint)
 
 TEST_CASE("perfect_filter: FP rate within statistical bounds", "[perfect_filter]") {
@@ -109,6 +123,109 @@ TEST_CASE("perfect_filter: contains matches slot_for", "[perfect_filter]") {
     }
 }
 
+TEST_CASE("perfect_filter: hashed_key overloads match string lookups", "[perfect_filter][hashed]") {
+    auto keys = make_keys(500);
+    auto unknowns = make_unknowns(1000);
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto pf = perfect_filter<phobic5, 16>::build(std::move(phf), keys);
+
+    for (const auto& key : keys) {
+        hashed_key hk{key};
+        REQUIRE(pf.contains(hk));
+        REQUIRE(pf.slot_for(hk) == pf.slot_for(key));
+        REQUIRE(pf.slot_for(hk)->value == pf.phf().slot_for(key).value);
+    }
+    for (const auto& uk : unknowns) {
+        REQUIRE(pf.contains(hashed_key{uk}) == pf.contains(uk));
+    }
+}
+
+TEST_CASE("perfect_filter: contains_batch matches contains", "[perfect_filter][batch]") {
+    auto keys = make_keys(2000);
+    auto unknowns = make_unknowns(2000);
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto pf = perfect_filter<phobic5, 8>::build(std::move(phf), keys);
+
+    std::vector<std::string_view> batch(keys.begin(), keys.end());
+    batch.insert(batch.end(), unknowns.begin(), unknowns.end());
+    auto out = std::make_unique<bool[]>(batch.size());
+    pf.contains_batch(batch, std::span<bool>{out.get(), batch.size()});
+    for (size_t i = 0; i < batch.size(); ++i) REQUIRE(out[i] == pf.contains(batch[i]));
+}
+
+TEST_CASE("perfect_filter: contains_interleaved matches contains", "[perfect_filter][interleaved]") {
+    auto keys = make_keys(2000);
+    auto unknowns = make_unknowns(2000);
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto pf = perfect_filter<phobic5, 8>::build(std::move(phf), keys);
+
+    std::vector<std::string_view> batch(keys.begin(), keys.end());
+    batch.insert(batch.end(), unknowns.begin(), unknowns.end());
+    auto out = std::make_unique<bool[]>(batch.size());
+    pf.contains_interleaved<4>(batch, std::span<bool>{out.get(), batch.size()});
+    for (size_t i = 0; i < batch.size(); ++i) REQUIRE(out[i] == pf.contains(batch[i]));
+
+    size_t calls = 0;
+    pf.contains_interleaved(batch, [&](size_t i, bool hit) {
+        ++calls;
+        REQUIRE(hit == pf.contains(batch[i]));
+    });
+    REQUIRE(calls == batch.size());
+}
+
+TEST_CASE("perfect_filter: erase retires keys until rebuild", "[perfect_filter][erase]") {
+    auto keys = make_keys(4000);
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto pf = perfect_filter<phobic5, 16>::build(std::move(phf), keys);
+
+    size_t erased = 0;
+    for (size_t i = 0; i < keys.size(); i += 2) erased += pf.erase(keys[i]) ? 1 : 0;
+    CHECK(erased == (keys.size() + 1) / 2);
+
+    size_t still = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i % 2 == 1) {
+            REQUIRE(pf.contains(keys[i]));
+        } else {
+            still += pf.contains(keys[i]) ? 1 : 0;
+        }
+    }
+    // Only keys whose fingerprint was 0 survive: ~2000 / 65536.
+    CHECK(still <= 3);
+    CHECK(pf.num_keys() == keys.size());
+
+    // A second erase finds nothing; non-members are almost always refused.
+    CHECK_FALSE(pf.erase(keys[0]));
+    auto unknowns = make_unknowns(1000);
+    size_t false_erases = 0;
+    for (const auto& u : unknowns) false_erases += pf.erase(u) ? 1 : 0;
+    CHECK(false_erases <= 2);
+}
+
+TEST_CASE("perfect_filter: erase alongside concurrent contains", "[perfect_filter][erase]") {
+    auto keys = make_keys(4000);
+    auto phf = phobic5::builder{}.add_all(keys).build().value();
+    auto pf = perfect_filter<phobic5, 8>::build(std::move(phf), keys);
+
+    // Odd keys are never erased, so readers must always find them.
+    std::atomic<bool> done{false};
+    std::atomic<size_t> missing{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire)) {
+                for (size_t i = 1; i < keys.size(); i += 2) {
+                    if (!pf.contains_atomic(keys[i])) ++missing;
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < keys.size(); i += 2) pf.erase(keys[i]);
+    done.store(true, std::memory_order_release);
+    for (auto& r : readers) r.join();
+    CHECK(missing.load() == 0);
+}
+
 TEST_CASE("perfect_filter: underlying PHF accessible", "[perfect_filter]") {
     auto keys = make_keys(200);
     auto phf = phobic5::builder{}.add_all(keys).build().value();
@@ -149,3 +266,21 @@ TEST_CASE("perfect_filter: serialization round-trip", "[perfect_filter]") {
         REQUIRE(restored->slot_for(key)->value == pf.slot_for(key)->value);
     }
 }
+
+TEST_CASE("perfect_filter: built from integer keys", "[perfect_filter][integer_key]") {
+    std::mt19937_64 rng{36};
+    std::vector<uint64_t> ids(10000);
+    for (auto& id : ids) id = rng();
+    auto phf = phobic5::builder{}.add_all(ids).build();
+    REQUIRE(phf.has_value());
+    auto pf = perfect_filter<phobic5, 16>::build(std::move(*phf), ids);
+    size_t fp = 0;
+    for (const auto& id : ids) {
+        REQUIRE(pf.contains(id));
+        REQUIRE(pf.contains(integer_key_bytes(id)));
+        REQUIRE(pf.slot_for(id).has_value());
+        const uint64_t other = rng();
+        fp += pf.contains(other) ? 1 : 0;
+    }
+    REQUIRE(fp < 10);
+}
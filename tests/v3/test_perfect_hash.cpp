@@ -60,6 +60,19 @@ static_assert(perfect_hash_function<bbhash_hasher<3>>);
 static_assert(perfect_hash_function<fch_hasher>);
 static_assert(perfect_hash_function<pthash_hasher<98>>);
 
+namespace {
+
+template<typename PHF>
+bool hashed_matches_plain(const PHF& phf, const std::vector<std::string>& keys) {
+    for (const auto& key : keys) {
+        if (phf.slot_for(hashed_key{key}).value != phf.slot_for(key).value) return false;
+    }
+    return phf.slot_for(hashed_key{"not-a-member"}).value ==
+           phf.slot_for("not-a-member").value;
+}
+
+} // namespace
+
 // ===== RECSPLIT TESTS =====
 
 TEST_CASE("RecSplit: bijectivity", "[recsplit]") {
@@ -111,6 +124,19 @@ TEST_CASE("RecSplit: works with perfect_filter", "[recsplit]") {
     }
 }
 
+TEST_CASE("RecSplit: slot_for_batch matches slot_for", "[recsplit][batch]") {
+    auto keys = make_keys(2000);
+    auto phf = recsplit_hasher<8>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.push_back("not-a-member");
+    std::vector<slot_index> out(queries.size());
+    phf->slot_for_batch(queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
 // ===== CHD TESTS =====
 
 TEST_CASE("CHD: bijectivity", "[chd]") {
@@ -136,7 +162,7 @@ TEST_CASE("CHD: space efficiency", "[chd]") {
     REQUIRE(phf.has_value());
     INFO("CHD bits/key: " << phf->bits_per_key());
     REQUIRE(phf->bits_per_key() > 0.0);
-    REQUIRE(phf->bits_per_key() < 200.0);
+    REQUIRE(phf->bits_per_key() < 4.0);  // rank bit vector over 2n slots + coded displacements
 }
 
 TEST_CASE("CHD: serialization round-trip", "[chd]") {
@@ -151,6 +177,46 @@ TEST_CASE("CHD: serialization round-trip", "[chd]") {
     }
 }
 
+TEST_CASE("CHD and FCH: deserialize rejects damaged blobs", "[chd][fch]") {
+    auto keys = make_keys(2000);
+    auto chd = chd_hasher::builder{}.add_all(keys).build();
+    auto fch = fch_hasher::builder{}.add_all(keys).build();
+    REQUIRE(chd.has_value());
+    REQUIRE(fch.has_value());
+    auto chd_bytes = chd->serialize();
+    auto fch_bytes = fch->serialize();
+
+    REQUIRE(chd_hasher::deserialize(chd_bytes)->serialize() == chd_bytes);
+    REQUIRE_FALSE(chd_hasher::deserialize(std::span<const std::byte>{chd_bytes}.first(chd_bytes.size() - 8)).has_value());
+    REQUIRE_FALSE(fch_hasher::deserialize(std::span<const std::byte>{fch_bytes}.first(fch_bytes.size() - 8)).has_value());
+    REQUIRE_FALSE(chd_hasher::deserialize(fch_bytes).has_value());
+
+    // key count disagreeing with the occupied positions
+    auto bad = chd_bytes;
+    bad[12] = static_cast<std::byte>(static_cast<uint8_t>(bad[12]) ^ 1);
+    REQUIRE_FALSE(chd_hasher::deserialize(bad).has_value());
+}
+
+TEST_CASE("rank_bitvector: rank_if_set matches a prefix count", "[chd][fch]") {
+    std::mt19937_64 rng{3};
+    for (uint64_t size : {1u, 63u, 64u, 448u, 449u, 5000u}) {
+        std::vector<uint64_t> words((size + 63) / 64, 0);
+        for (uint64_t i = 0; i < size; ++i) {
+            if (rng() % 3 == 0) words[i / 64] |= uint64_t{1} << (i % 64);
+        }
+        detail::rank_bitvector bv{words, size};
+        uint64_t ones = 0;
+        for (uint64_t i = 0; i < size; ++i) {
+            const bool set = (words[i / 64] >> (i % 64)) & 1;
+            REQUIRE(bv.test(i) == set);
+            auto r = bv.rank_if_set(i);
+            REQUIRE(r.has_value() == set);
+            if (set) REQUIRE(*r == ones++);
+        }
+        REQUIRE(bv.count() == ones);
+    }
+}
+
 TEST_CASE("CHD: works with perfect_filter", "[chd]") {
     auto keys = make_keys(500);
     auto phf = chd_hasher::builder{}.add_all(keys).build();
@@ -211,6 +277,57 @@ TEST_CASE("BBHash: works with perfect_filter", "[bbhash]") {
     }
 }
 
+TEST_CASE("BBHash: slot_for_batch matches slot_for", "[bbhash][batch]") {
+    auto keys = make_keys(2000);
+    auto phf = bbhash_hasher<3>::builder{}.add_all(keys).with_gamma(2.0).build();
+    REQUIRE(phf.has_value());
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.push_back("not-a-member");
+    std::vector<slot_index> out(queries.size());
+    phf->slot_for_batch(queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("BBHash: with_threads builds the same function", "[bbhash][parallel]") {
+    auto keys = make_keys(50000);
+    auto serial = bbhash_hasher<3>::builder{}.add_all(keys).build();
+    REQUIRE(serial.has_value());
+    for (size_t t : {size_t{2}, size_t{4}, size_t{0}}) {
+        auto parallel = bbhash_hasher<3>::builder{}.add_all(keys).with_threads(t).build();
+        REQUIRE(parallel.has_value());
+        REQUIRE(parallel->serialize() == serial->serialize());
+    }
+    REQUIRE(verify_bijectivity(*serial, keys));
+}
+
+TEST_CASE("BBHash: rank blocks keep the wire format and stay compact", "[bbhash]") {
+    auto keys = make_keys(20000);
+    auto phf = bbhash_hasher<3>::builder{}.add_all(keys).with_gamma(2.0).build();
+    REQUIRE(phf.has_value());
+    // One 64-bit rank per 448 bits rather than a size_t per 64-bit word:
+    // about 1.14 bits per slot instead of 2.
+    INFO("BBHash bits/key: " << phf->bits_per_key());
+    REQUIRE(phf->bits_per_key() < 12.0);
+
+    auto bytes = phf->serialize();
+    auto restored = bbhash_hasher<3>::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->serialize() == bytes);
+    REQUIRE(verify_bijectivity(*restored, keys));
+
+    // A level whose popcount disagrees with its key count is rejected.
+    // Header (magic, version, algorithm, levels), then key count, total
+    // slots, gamma and seed, then level 0's word count and first word.
+    constexpr size_t header = 4 * sizeof(uint32_t);
+    constexpr size_t fields = 3 * sizeof(uint64_t) + sizeof(double);
+    constexpr size_t first_word = header + fields + sizeof(uint64_t);
+    auto corrupt = bytes;
+    corrupt[first_word] ^= std::byte{0x01};
+    REQUIRE_FALSE(bbhash_hasher<3>::deserialize(corrupt).has_value());
+}
+
 // ===== FCH TESTS =====
 
 TEST_CASE("FCH: bijectivity", "[fch]") {
@@ -236,7 +353,7 @@ TEST_CASE("FCH: space efficiency", "[fch]") {
     REQUIRE(phf.has_value());
     INFO("FCH bits/key: " << phf->bits_per_key());
     REQUIRE(phf->bits_per_key() > 0.0);
-    REQUIRE(phf->bits_per_key() < 250.0);  // FCH uses 3x table + displacements, ~200 bits/key
+    REQUIRE(phf->bits_per_key() < 6.0);  // rank bit vector over 3n slots + coded displacements
 }
 
 TEST_CASE("FCH: serialization round-trip", "[fch]") {
@@ -291,6 +408,49 @@ TEST_CASE("PTHash: serialization round-trip", "[pthash]") {
     }
 }
 
+TEST_CASE("PTHash: minimal at scale with both pilot encodings", "[pthash]") {
+    auto keys = make_keys(100000);
+    auto packed = pthash98::builder{}.add_all(keys).build();
+    auto dict = pthash98_dictionary::builder{}.add_all(keys).build();
+    auto loose = pthash_hasher<90>::builder{}.add_all(keys).with_bucket_size(3.0).build();
+    REQUIRE(packed.has_value());
+    REQUIRE(dict.has_value());
+    REQUIRE(loose.has_value());
+    REQUIRE(verify_bijectivity(*packed, keys));
+    REQUIRE(verify_bijectivity(*dict, keys));
+    REQUIRE(verify_bijectivity(*loose, keys));
+    INFO("packed " << packed->bits_per_key() << ", dictionary " << dict->bits_per_key());
+    REQUIRE(packed->bits_per_key() < 3.5);
+    REQUIRE(dict->bits_per_key() < 3.5);
+
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::vector<slot_index> out(views.size());
+    packed->slot_for_batch(views, out);
+    for (size_t i = 0; i < keys.size(); i += 97) {
+        REQUIRE(out[i].value == packed->slot_for(keys[i]).value);
+    }
+
+    auto restored = pthash98_dictionary::deserialize(dict->serialize());
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->serialize() == dict->serialize());
+}
+
+TEST_CASE("PTHash: deserialize rejects damaged blobs", "[pthash]") {
+    auto keys = make_keys(5000);
+    auto phf = pthash98::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    REQUIRE_FALSE(pthash98::deserialize(std::span<const std::byte>{bytes}.first(bytes.size() - 8)).has_value());
+    REQUIRE_FALSE(pthash95::deserialize(bytes).has_value());
+    REQUIRE_FALSE(pthash98_dictionary::deserialize(bytes).has_value());
+
+    // key count disagreeing with the remap
+    auto bad = bytes;
+    bad[16] = static_cast<std::byte>(static_cast<uint8_t>(bad[16]) ^ 1);
+    REQUIRE_FALSE(pthash98::deserialize(bad).has_value());
+}
+
 // ===== CROSS-ALGORITHM COMPARISON =====
 
 TEST_CASE("All algorithms: consistent bijectivity at 100 keys", "[comparison]") {
@@ -311,3 +471,25 @@ TEST_CASE("All algorithms: consistent bijectivity at 100 keys", "[comparison]")
     REQUIRE(verify_bijectivity(*bb, keys));
     REQUIRE(verify_bijectivity(*fch, keys));
 }
+
+TEST_CASE("All algorithms: slot_for(hashed_key) matches slot_for(key)", "[comparison][hashed]") {
+    auto keys = make_keys(1000);
+
+    auto rs = recsplit_hasher<8>::builder{}.add_all(keys).build();
+    auto chd = chd_hasher::builder{}.add_all(keys).build();
+    auto bb = bbhash_hasher<3>::builder{}.add_all(keys).with_gamma(2.0).build();
+    auto fch = fch_hasher::builder{}.add_all(keys).build();
+    auto pt = pthash_hasher<98>::builder{}.add_all(keys).build();
+
+    REQUIRE(rs.has_value());
+    REQUIRE(chd.has_value());
+    REQUIRE(bb.has_value());
+    REQUIRE(fch.has_value());
+    REQUIRE(pt.has_value());
+
+    REQUIRE(hashed_matches_plain(*rs, keys));
+    REQUIRE(hashed_matches_plain(*chd, keys));
+    REQUIRE(hashed_matches_plain(*bb, keys));
+    REQUIRE(hashed_matches_plain(*fch, keys));
+    REQUIRE(hashed_matches_plain(*pt, keys));
+}
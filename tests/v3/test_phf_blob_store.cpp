@@ -0,0 +1,254 @@
+/**
+ * @file test_phf_blob_store.cpp
+ * @brief Tests for phf_blob_store, its view, and the lz_block codec.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/padded_phf.hpp>
+#include <maph/detail/container.hpp>
+#include <maph/detail/lz_block.hpp>
+#include <maph/retrieval/phf_blob_store.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(4, 16);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Values of 0 to ~200 bytes with repeated structure, some empty.
+std::vector<std::string> make_values(const std::vector<std::string>& keys) {
+    std::vector<std::string> values;
+    values.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string v;
+        if (i % 7 != 0) {
+            v = "{\"key\":\"" + keys[i] + "\",\"id\":" + std::to_string(i) + ",\"tags\":[";
+            for (size_t t = 0; t < i % 5; ++t) v += "\"tag" + std::to_string(t) + "\",";
+            v += "]}";
+        }
+        values.push_back(std::move(v));
+    }
+    return values;
+}
+
+} // namespace
+
+TEST_CASE("lz_block: round trips and rejects corrupt input", "[blob_store][lz]") {
+    std::mt19937_64 rng{5};
+    for (size_t n : {0, 1, 3, 4, 17, 300, 5000}) {
+        std::vector<std::byte> raw(n);
+        for (size_t i = 0; i < n; ++i) {
+            raw[i] = static_cast<std::byte>(i % 3 == 0 ? rng() % 256 : i % 11);
+        }
+        std::vector<std::byte> packed;
+        detail::lz_compress(raw, packed);
+        std::vector<std::byte> back(n);
+        REQUIRE(detail::lz_decompress(packed, back));
+        REQUIRE(back == raw);
+        if (n > 0) {
+            std::vector<std::byte> shorter(n - 1);
+            REQUIRE_FALSE(detail::lz_decompress(packed, shorter));
+        }
+    }
+
+    // A long run compresses to a few bytes.
+    std::vector<std::byte> run(10000, std::byte{'x'});
+    std::vector<std::byte> packed;
+    detail::lz_compress(run, packed);
+    REQUIRE(packed.size() < 64);
+
+    // Truncations never read or write out of bounds.
+    std::vector<std::byte> out(run.size());
+    for (size_t cut = 0; cut < packed.size(); ++cut) {
+        (void)detail::lz_decompress(std::span<const std::byte>(packed).first(cut), out);
+    }
+}
+
+TEST_CASE("phf_blob_store: every key returns its value", "[blob_store]") {
+    auto keys = make_keys(20000);
+    auto values = make_values(keys);
+    auto built = phf_blob_store<phobic_phf<5>>::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_keys() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == values[i]);
+
+    size_t total = 0;
+    for (const auto& v : values) total += v.size();
+    REQUIRE(built->blob_bytes() == total);
+    REQUIRE(built->value_bytes() == total);
+
+    // Batched lookups agree.
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::vector<std::string_view> out(views.size());
+    built->lookup_batch(views, out);
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(out[i] == values[i]);
+
+    // The last of duplicate keys wins.
+    auto dup = phf_blob_store<phobic_phf<5>>::builder{}
+        .add("a", "first").add("b", "bee").add("a", "second").build();
+    REQUIRE(dup.has_value());
+    REQUIRE(dup->lookup("a") == "second");
+    REQUIRE(dup->lookup("b") == "bee");
+}
+
+TEST_CASE("phf_blob_store<lz_block_codec>: compressed blocks", "[blob_store][lz]") {
+    auto keys = make_keys(20000);
+    auto values = make_values(keys);
+    using S = phf_blob_store<phobic_phf<5>, lz_block_codec>;
+    auto built = S::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .with_block_slots(128)
+        .build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->block_slots() == 128);
+    REQUIRE(built->blob_bytes() < built->value_bytes() * 3 / 4);
+
+    std::string buffer;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(built->lookup(keys[i], buffer) == values[i]);
+    }
+
+    auto restored = S::deserialize(built->serialize());
+    REQUIRE(restored.has_value());
+    for (size_t i = 0; i < keys.size(); i += 13) {
+        REQUIRE(restored->lookup(keys[i], buffer) == values[i]);
+    }
+    // The codec is part of the format.
+    REQUIRE_FALSE(phf_blob_store<phobic_phf<5>>::deserialize(built->serialize()).has_value());
+}
+
+TEST_CASE("phf_blob_store: serialize, container and in-place view", "[blob_store][view]") {
+    auto keys = make_keys(8000);
+    auto values = make_values(keys);
+    auto built = phf_blob_store<phobic_phf<5>>::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .build();
+    REQUIRE(built.has_value());
+
+    auto bytes = built->serialize();
+    auto restored = phf_blob_store<phobic_phf<5>>::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->serialize() == bytes);
+
+    auto from = from_container<phf_blob_store<phobic_phf<5>>>(to_container(*built));
+    REQUIRE(from.has_value());
+    REQUIRE(from->serialize() == bytes);
+
+    auto view = phf_blob_store_view<phobic_phf_view<5>>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto v = view->lookup(keys[i]);
+        REQUIRE(v == values[i]);
+        // Uncompressed views point into the buffer itself.
+        if (!v.empty()) {
+            REQUIRE(reinterpret_cast<const std::byte*>(v.data()) >= bytes.data());
+            REQUIRE(reinterpret_cast<const std::byte*>(v.data()) < bytes.data() + bytes.size());
+        }
+    }
+    REQUIRE(view->serialize() == bytes);
+
+    // Truncated buffers are rejected, not read past.
+    for (size_t cut : {size_t{0}, size_t{9}, bytes.size() / 2, bytes.size() - 1}) {
+        auto partial = std::span<const std::byte>(bytes).first(cut);
+        REQUIRE_FALSE(phf_blob_store_view<phobic_phf_view<5>>::deserialize(partial).has_value());
+        REQUIRE_FALSE(phf_blob_store<phobic_phf<5>>::deserialize(partial).has_value());
+    }
+}
+
+TEST_CASE("phf_blob_store_view<lz_block_codec> answers like the owner", "[blob_store][view][lz]") {
+    auto keys = make_keys(5000);
+    auto values = make_values(keys);
+    auto built = phf_blob_store<phobic_phf<5>, lz_block_codec>::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .build();
+    REQUIRE(built.has_value());
+    auto bytes = built->serialize();
+    auto view = phf_blob_store_view<phobic_phf_view<5>, lz_block_codec>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    std::string buffer;
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(view->lookup(keys[i], buffer) == values[i]);
+}
+
+TEST_CASE("phf_blob_store over a non-minimal PHF leaves unused slots empty", "[blob_store]") {
+    auto keys = make_keys(3000);
+    auto values = make_values(keys);
+    using P = padded_phf<phobic_phf<5>>;
+    auto built = phf_blob_store<P>::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->phf().range_size() > keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == values[i]);
+    size_t nonempty = 0;
+    for (size_t s = 0; s < built->phf().range_size(); ++s) nonempty += !built->value_at(s).empty();
+    REQUIRE(nonempty <= keys.size());
+}
+
+TEST_CASE("phf_blob_store rejects a corrupt directory before reading it", "[blob_store][view][lz]") {
+    auto keys = make_keys(4000);
+    auto values = make_values(keys);
+    using S = phf_blob_store<phobic_phf<5>, lz_block_codec>;
+    using V = phf_blob_store_view<phobic_phf_view<5>, lz_block_codec>;
+    auto built = S::builder{}
+        .add_all(std::span<const std::string>{keys}, std::span<const std::string>{values})
+        .build();
+    REQUIRE(built.has_value());
+    const auto bytes = built->serialize();
+    uint64_t phf_sz{};
+    std::memcpy(&phf_sz, bytes.data(), sizeof(phf_sz));
+    const size_t max_at = 8 + static_cast<size_t>(phf_sz) + 8;
+
+    SECTION("a largest block beyond what the blob can decode to") {
+        auto bad = bytes;
+        const uint64_t huge = uint64_t{1} << 60;
+        std::memcpy(bad.data() + max_at, &huge, sizeof(huge));
+        REQUIRE_FALSE(S::deserialize(bad).has_value());
+        REQUIRE_FALSE(V::deserialize(bad).has_value());
+    }
+
+    SECTION("offsets whose high words hold an extra one") {
+        // [u64 count][u32 low bits][u64 n][n low words][u64 m][m high words]
+        const size_t ef_at = max_at + 8;
+        uint64_t nlow{}, nhigh{};
+        std::memcpy(&nlow, bytes.data() + ef_at + 12, sizeof(nlow));
+        const size_t high_at = ef_at + 20 + 8 * static_cast<size_t>(nlow);
+        std::memcpy(&nhigh, bytes.data() + high_at, sizeof(nhigh));
+        REQUIRE(nhigh > 0);
+        auto bad = bytes;
+        const size_t last = high_at + 8 + 8 * static_cast<size_t>(nhigh - 1);
+        uint64_t word{};
+        std::memcpy(&word, bad.data() + last, sizeof(word));
+        REQUIRE((word >> 63) == 0);
+        word |= uint64_t{1} << 63;
+        std::memcpy(bad.data() + last, &word, sizeof(word));
+        REQUIRE_FALSE(S::deserialize(bad).has_value());
+        REQUIRE_FALSE(V::deserialize(bad).has_value());
+    }
+}
@@ -32,6 +32,10 @@ struct mock_builder {
 } // namespace
 
 static_assert(perfect_hash_function<mock_phf>, "mock_phf must satisfy perfect_hash_function");
+static_assert(!batched_perfect_hash_function<mock_phf>,
+    "mock_phf has no slot_for_batch and must use the fallback");
+static_assert(!hashed_perfect_hash_function<mock_phf>,
+    "mock_phf has no hashed_key overload and must use the fallback");
 static_assert(phf_builder<mock_builder, mock_phf>, "mock_builder must satisfy phf_builder");
 
 TEST_CASE("perfect_hash_function concept: mock satisfies", "[phf_concept]") {
@@ -57,6 +61,33 @@ TEST_CASE("phf_builder concept: mock satisfies", "[phf_concept]") {
     REQUIRE(result.has_value());
 }
 
+TEST_CASE("slot_for_batch: fallback loops over slot_for", "[phf_concept][batch]") {
+    mock_phf phf;
+    std::vector<std::string_view> keys = {"a", "b", "c"};
+    std::vector<slot_index> out(keys.size(), slot_index{99});
+    slot_for_batch(phf, keys, out);
+    for (auto s : out) REQUIRE(s.value == 0);
+
+    // Output shorter than input: only min(keys, out) entries are written.
+    std::vector<slot_index> short_out(1, slot_index{99});
+    slot_for_batch(phf, keys, short_out);
+    REQUIRE(short_out[0].value == 0);
+}
+
+TEST_CASE("slot_for_hashed: falls back to the key bytes", "[phf_concept][hashed]") {
+    struct length_phf : mock_phf {
+        slot_index slot_for(std::string_view k) const noexcept { return slot_index{k.size()}; }
+    };
+    static_assert(perfect_hash_function<length_phf>);
+    static_assert(!hashed_perfect_hash_function<length_phf>);
+
+    length_phf phf;
+    REQUIRE(slot_for_hashed(phf, hashed_key{"abcde"}).value == 5);
+    hashed_key hk{"xyz"};
+    REQUIRE(hk.length() == 3);
+    REQUIRE(hk.digest == phf_hash128("xyz"));
+}
+
 // Negative concept checks: types missing required methods should NOT satisfy the concept.
 
 namespace {
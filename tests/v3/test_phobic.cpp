@@ -8,6 +8,7 @@
 #include <random>
 #include <algorithm>
 #include <set>
+#include <cstring>
 
 using namespace maph;
 
@@ -136,8 +137,16 @@ TEST_CASE("phobic: space efficiency", "[phobic]") {
 
     INFO("Bits per key: " << phf->bits_per_key());
     INFO("Memory bytes: " << phf->memory_bytes());
+    // memory_bytes() counts the uint16_t pilots actually allocated;
+    // compact_pilots is the sub-3-bit configuration.
     REQUIRE(phf->bits_per_key() > 0.0);
-    REQUIRE(phf->bits_per_key() < 3.0);
+    REQUIRE(phf->bits_per_key() < 3.5);
+
+    auto compact = phobic5_compact::builder{}.add_all(keys).build();
+    REQUIRE(compact.has_value());
+    INFO("Compact bits per key: " << compact->bits_per_key());
+    REQUIRE(compact->bits_per_key() < 3.0);
+    REQUIRE(compact->bits_per_key() < phf->bits_per_key());
 }
 
 TEST_CASE("phobic: deterministic with same seed", "[phobic]") {
@@ -274,18 +283,264 @@ TEST_CASE("phobic: serialization round-trip after parallel build", "[phobic][par
     }
 }
 
-TEST_CASE("phobic: fat-bucket cooperative path correctness", "[phobic][parallel]") {
-    // Large-enough scale that some buckets will be fat (>= 2K).
+TEST_CASE("phobic: parallel build over many windows", "[phobic][parallel]") {
+    // Enough buckets that the windowed pilot search commits many windows.
     auto keys = make_keys(50000);
     auto phf = phobic5::builder{}.add_all(keys).with_threads(4).build();
     REQUIRE(phf.has_value());
     REQUIRE(verify_bijectivity(*phf, keys));
 }
 
-TEST_CASE("phobic: parallel build with no fat buckets", "[phobic][parallel]") {
-    // Very small set; no bucket can exceed threshold.
-    auto keys = make_keys(2048);  // just above threshold
+TEST_CASE("phobic: parallel build at the smallest parallel size", "[phobic][parallel]") {
+    // Builds under 2048 keys stay on one thread; this one just qualifies.
+    auto keys = make_keys(2048);
     auto phf = phobic5::builder{}.add_all(keys).with_threads(4).build();
     REQUIRE(phf.has_value());
     REQUIRE(verify_bijectivity(*phf, keys));
 }
+
+TEST_CASE("phobic: parallel build is the sequential build", "[phobic][parallel]") {
+    // Windowed pilot search commits in order, so every thread count gives
+    // the bytes threads=1 gives, on any schedule.
+    auto keys = make_keys(30000);
+    auto serial = phobic5::builder{}.add_all(keys).with_seed(7).build();
+    REQUIRE(serial.has_value());
+    for (size_t threads : {size_t{2}, size_t{3}, size_t{8}, size_t{32}}) {
+        auto par = phobic5::builder{}.add_all(keys).with_seed(7).with_threads(threads).build();
+        REQUIRE(par.has_value());
+        REQUIRE(par->serialize() == serial->serialize());
+    }
+    auto s3 = phobic3::builder{}.add_all(keys).build();
+    auto p3 = phobic3::builder{}.add_all(keys).with_threads(6).build();
+    REQUIRE(s3.has_value());
+    REQUIRE(p3.has_value());
+    REQUIRE(p3->serialize() == s3->serialize());
+}
+
+TEST_CASE("phobic: slot_for(hashed_key) matches slot_for", "[phobic][hashed]") {
+    auto keys = make_keys(3000);
+    auto phf = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(phf->slot_for(hashed_key{k}).value == phf->slot_for(k).value);
+    }
+    REQUIRE(phf->slot_for(hashed_key{"not-a-member"}).value ==
+            phf->slot_for("not-a-member").value);
+}
+
+TEST_CASE("phobic: slot_for_batch matches slot_for", "[phobic][batch]") {
+    auto keys = make_keys(5000);
+    auto phf = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+
+    // Odd length exercises the partial trailing window; unknown keys must
+    // resolve to the same (arbitrary) slot as the scalar path.
+    std::vector<std::string_view> queries(keys.begin(), keys.begin() + 1001);
+    queries.push_back("not-a-member");
+    std::vector<slot_index> out(queries.size());
+    phf->slot_for_batch(queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("phobic_phf_view: answers like the owning phobic over its bytes", "[phobic][view]") {
+    auto keys = make_keys(5000);
+    auto phf = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    auto view = phobic_phf_view<5>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_keys() == phf->num_keys());
+    REQUIRE(view->range_size() == phf->range_size());
+    REQUIRE(view->bytes().data() == bytes.data());
+    REQUIRE(view->serialize() == bytes);
+    for (const auto& k : keys) {
+        REQUIRE(view->slot_for(k).value == phf->slot_for(k).value);
+        REQUIRE(view->slot_for(hashed_key{k}).value == phf->slot_for(k).value);
+    }
+    REQUIRE(view->slot_for("not-a-member").value == phf->slot_for("not-a-member").value);
+
+    std::vector<std::string_view> queries(keys.begin(), keys.begin() + 1001);
+    std::vector<slot_index> out(queries.size());
+    view->slot_for_batch(queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == phf->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("phobic_phf_view: works at an unaligned buffer offset", "[phobic][view]") {
+    auto keys = make_keys(1000);
+    auto phf = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    std::vector<std::byte> shifted(bytes.size() + 1);
+    std::copy(bytes.begin(), bytes.end(), shifted.begin() + 1);
+    auto view = phobic_phf_view<5>::deserialize(std::span<const std::byte>(shifted).subspan(1));
+    REQUIRE(view.has_value());
+    REQUIRE(verify_bijectivity(*view, keys));
+}
+
+TEST_CASE("phobic_phf_view: rejects truncated and mismatched input", "[phobic][view]") {
+    auto keys = make_keys(500);
+    auto phf = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    for (size_t cut : {size_t{0}, size_t{11}, size_t{40}, bytes.size() - 1}) {
+        REQUIRE_FALSE(phobic_phf_view<5>::deserialize(
+            std::span<const std::byte>(bytes).first(cut)).has_value());
+    }
+    REQUIRE_FALSE(phobic_phf_view<4>::deserialize(bytes).has_value());
+
+    // Pilot count disagreeing with num_buckets is caught up front.
+    auto bad = bytes;
+    uint64_t nbuckets{};
+    std::memcpy(&nbuckets, bad.data() + 36, sizeof(nbuckets));
+    ++nbuckets;
+    std::memcpy(bad.data() + 36, &nbuckets, sizeof(nbuckets));
+    REQUIRE_FALSE(phobic_phf_view<5>::deserialize(bad).has_value());
+}
+
+TEST_CASE("phobic compact_pilots: same slots as flat pilots", "[phobic][compact]") {
+    auto keys = make_keys(20000);
+    auto flat = phobic_phf<5>::builder{}.add_all(keys).with_seed(9).build();
+    auto compact = phobic5_compact::builder{}.add_all(keys).with_seed(9).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(compact.has_value());
+
+    // The escape path must actually be exercised.
+    REQUIRE(compact->pilots().width() < 16);
+    REQUIRE(compact->pilots().num_escapes() > 0);
+    REQUIRE(verify_bijectivity(*compact, keys));
+    for (const auto& k : keys) {
+        REQUIRE(compact->slot_for(k).value == flat->slot_for(k).value);
+    }
+
+    std::vector<std::string_view> queries(keys.begin(), keys.begin() + 777);
+    std::vector<slot_index> out(queries.size());
+    compact->slot_for_batch(queries, out);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(out[i].value == flat->slot_for(queries[i]).value);
+    }
+}
+
+TEST_CASE("phobic compact_pilots: serialization round-trip and view", "[phobic][compact][view]") {
+    auto keys = make_keys(5000);
+    auto phf = phobic5_compact::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    auto loaded = phobic5_compact::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->memory_bytes() == phf->memory_bytes());
+    auto view = phobic_phf_view<5, compact_pilots>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(loaded->slot_for(k).value == phf->slot_for(k).value);
+        REQUIRE(view->slot_for(k).value == phf->slot_for(k).value);
+    }
+
+    // The two pilot layouts have different algorithm ids.
+    REQUIRE_FALSE(phobic_phf<5>::deserialize(bytes).has_value());
+    auto flat = phobic_phf<5>::builder{}.add_all(keys).build();
+    REQUIRE(flat.has_value());
+    REQUIRE_FALSE(phobic5_compact::deserialize(flat->serialize()).has_value());
+    REQUIRE_FALSE(phobic5_compact::deserialize(
+        std::span<const std::byte>(bytes).first(bytes.size() - 1)).has_value());
+}
+
+TEST_CASE("phobic: builds in a shared build_scratch match fresh builds", "[phobic][scratch]") {
+    build_scratch scratch;
+    // Shrinking and growing sizes, sequential and parallel, flat and compact.
+    for (size_t count : {20000, 3000, 12000, 500}) {
+        auto keys = make_keys(count, 100 + count);
+        for (size_t threads : {size_t{1}, size_t{3}}) {
+            auto fresh = phobic5::builder{}.add_all(keys).with_threads(threads).build();
+            auto reused = phobic5::builder{}.add_all(keys).with_threads(threads)
+                              .with_scratch(scratch).build();
+            REQUIRE(fresh.has_value());
+            REQUIRE(reused.has_value());
+            if (threads == 1) REQUIRE(reused->serialize() == fresh->serialize());
+            REQUIRE(verify_bijectivity(*reused, keys));
+        }
+        auto compact = phobic5_compact::builder{}.add_all(keys).with_scratch(scratch).build();
+        auto compact_fresh = phobic5_compact::builder{}.add_all(keys).build();
+        REQUIRE(compact.has_value());
+        REQUIRE(compact_fresh.has_value());
+        REQUIRE(compact->serialize() == compact_fresh->serialize());
+    }
+    REQUIRE(scratch.capacity_bytes() > 0);
+}
+
+TEST_CASE("phobic: integer keys are the keys of their little-endian bytes", "[phobic][integer_key]") {
+    std::mt19937_64 rng{32};
+    std::vector<uint64_t> ids(20000);
+    for (auto& id : ids) id = rng();
+    std::vector<std::string> as_bytes;
+    for (const auto& id : ids) as_bytes.emplace_back(integer_key_bytes(id));
+
+    auto from_ints = phobic5::builder{}.add_all(ids).build();
+    auto from_strings = phobic5::builder{}.add_all(as_bytes).build();
+    REQUIRE(from_ints.has_value());
+    REQUIRE(from_strings.has_value());
+    REQUIRE(from_ints->serialize() == from_strings->serialize());
+
+    std::set<uint64_t> slots;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const auto s = from_ints->slot_for(ids[i]);
+        REQUIRE(s == from_ints->slot_for(as_bytes[i]));
+        slots.insert(s.value);
+    }
+    REQUIRE(slots.size() == ids.size());
+
+    // Borrowed in place, and 128-bit keys.
+    auto borrowed = phobic5::builder{}.borrow_all(std::span<const uint64_t>(ids)).build();
+    REQUIRE(borrowed.has_value());
+    REQUIRE(borrowed->serialize() == from_ints->serialize());
+
+    std::vector<__uint128_t> wide(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) wide[i] = (static_cast<__uint128_t>(ids[i]) << 64) | i;
+    auto w = phobic4::builder{}.add_all(wide).build();
+    REQUIRE(w.has_value());
+    slots.clear();
+    for (const auto& k : wide) slots.insert(w->slot_for(k).value);
+    REQUIRE(slots.size() == wide.size());
+}
+
+TEST_CASE("phobic: builds from pre-hashed digests alone", "[phobic][add_hashes]") {
+    auto keys = make_keys(20000);
+    std::vector<hash128> digests;
+    for (size_t i = 0; i < keys.size() / 2; ++i) digests.push_back(phf_hash128(keys[i]));
+
+    // Half by digest, half as keys.
+    phobic5::builder b;
+    b.add_hashes(digests);
+    for (size_t i = keys.size() / 2; i < keys.size(); ++i) b.add(keys[i]);
+    auto phf = b.build();
+    REQUIRE(phf.has_value());
+    REQUIRE(phf->num_keys() == keys.size());
+
+    std::set<uint64_t> slots;
+    for (const auto& k : keys) {
+        const auto s = phf->slot_for(k);
+        REQUIRE(s == phf->slot_for(phf_hash128(k)));
+        slots.insert(s.value);
+    }
+    REQUIRE(slots.size() == keys.size());
+
+    // build() merges into a copy: the builder still holds what was added.
+    auto again = b.build();
+    REQUIRE(again.has_value());
+    REQUIRE(again->serialize() == phf->serialize());
+
+    // A digest given twice, or equal to an added key's, is refused.
+    auto twice = phobic5::builder{}.add_hashes(digests).add_hashes(std::span(digests).first(1)).build();
+    REQUIRE_FALSE(twice.has_value());
+    REQUIRE(twice.error() == error::duplicate_key);
+    auto clash = phobic5::builder{}.add_hashes(digests).add(keys[0]).build();
+    REQUIRE_FALSE(clash.has_value());
+    REQUIRE(clash.error() == error::duplicate_key);
+}
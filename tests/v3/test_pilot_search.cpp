@@ -0,0 +1,129 @@
+/**
+ * @file test_pilot_search.cpp
+ * @brief Tests for detail::scan_free_pilots, the lane-parallel PHOBIC pilot
+ *        test. Without AVX2 only the scalar pilot hash is checked.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/detail/pilot_search.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <span>
+#include <vector>
+
+using namespace maph;
+
+TEST_CASE("pilot_search: phobic_pilot_mix is splitmix64 of h2 + pilot * phi", "[pilot_search]") {
+    static_assert(detail::phobic_pilot_mix(0, 0) == 0);
+    // splitmix64's first output for state 0 is its finalizer at phi.
+    REQUIRE(detail::phobic_pilot_mix(0, 1) == 0xe220a8397b1dcdafULL);
+}
+
+#if defined(__AVX2__)
+
+namespace {
+
+// The bits scan_free_pilots should return, one pilot at a time.
+uint32_t scalar_mask(const std::vector<uint64_t>& hashes, std::span<const size_t> keys,
+                     uint32_t from, uint32_t count, const std::vector<uint64_t>& occupied,
+                     uint64_t range) {
+    uint32_t mask = 0;
+    for (uint32_t j = 0; j < count; ++j) {
+        bool free = true;
+        for (size_t k : keys) {
+            const uint64_t slot = detail::phobic_pilot_mix(hashes[k], static_cast<uint16_t>(from + j)) % range;
+            if ((occupied[slot >> 6] >> (slot & 63)) & 1) { free = false; break; }
+        }
+        if (free) mask |= uint32_t{1} << j;
+    }
+    return mask;
+}
+
+} // namespace
+
+TEST_CASE("pilot_search: the vector slots are the exact remainders", "[pilot_search]") {
+    std::mt19937_64 rng{11};
+    std::vector<uint64_t> ranges{uint64_t{1} << 13, 8193, 10007, 3000017, uint64_t{1} << 31,
+                                 4294967291ULL, (uint64_t{1} << 32) - 1};
+    for (int i = 0; i < 200; ++i) ranges.push_back((uint64_t{1} << 13) + rng() % ((uint64_t{1} << 32) - (uint64_t{1} << 13)));
+    std::vector<uint64_t> out(detail::pilot_lanes);
+    for (uint64_t range : ranges) {
+        REQUIRE(detail::simd_pilot_search(range));
+        for (int t = 0; t < 200; ++t) {
+            const uint64_t h2 = rng();
+            const auto from = static_cast<uint32_t>(rng() % 65536);
+            detail::pilot_slots(h2, from, range, out.data());
+            for (uint32_t j = 0; j < detail::pilot_lanes; ++j) {
+                REQUIRE(out[j] == detail::phobic_pilot_mix(h2, static_cast<uint16_t>(from + j)) % range);
+            }
+        }
+    }
+    REQUIRE_FALSE(detail::simd_pilot_search(8191));
+    REQUIRE_FALSE(detail::simd_pilot_search(uint64_t{1} << 32));
+}
+
+TEST_CASE("pilot_search: scan_free_pilots matches the scalar test", "[pilot_search]") {
+    std::mt19937_64 rng{5};
+    for (uint64_t range : {uint64_t{1} << 13, uint64_t{10007}, uint64_t{1} << 20, uint64_t{3000017}}) {
+        for (double fill : {0.0, 0.3, 0.9, 1.0}) {
+            std::vector<uint64_t> occupied((range + 63) / 64, 0);
+            std::bernoulli_distribution taken(fill);
+            for (auto& w : occupied) {
+                for (int b = 0; b < 64; ++b) {
+                    if (taken(rng)) w |= uint64_t{1} << b;
+                }
+            }
+            std::vector<uint64_t> hashes(64);
+            for (auto& h : hashes) h = rng();
+            const std::vector<size_t> keys{3, 17, 40, 41, 63};
+            for (uint32_t from : {0u, 1u, 1000u, 65535u - detail::pilot_lanes, 65530u}) {
+                const uint32_t count = std::min<uint32_t>(detail::pilot_lanes, 65535u - from);
+                for (size_t m : {size_t{1}, size_t{2}, keys.size()}) {
+                    std::span<const size_t> ks{keys.data(), m};
+                    const auto run = detail::scan_free_pilots(hashes.data(), ks, from, from + count,
+                                                              occupied.data(), range);
+                    const uint32_t want = scalar_mask(hashes, ks, from, count, occupied, range);
+                    REQUIRE(run.mask == want);
+                    if (want != 0) REQUIRE(run.base == from);
+                }
+            }
+            // Across runs: the first free pilot is the scalar loop's.
+            for (size_t m : {size_t{1}, keys.size()}) {
+                std::span<const size_t> ks{keys.data(), m};
+                uint32_t first = 65535;
+                for (uint32_t p = 0; p < 65535 && first == 65535; ++p) {
+                    if (scalar_mask(hashes, ks, p, 1, occupied, range) != 0) first = p;
+                }
+                const auto run = detail::scan_free_pilots(hashes.data(), ks, 0, 65535, occupied.data(), range);
+                const uint32_t got = run.mask == 0 ? 65535 : run.base + static_cast<uint32_t>(std::countr_zero(run.mask));
+                REQUIRE(got == first);
+            }
+        }
+    }
+}
+
+#endif
+
+TEST_CASE("pilot_search: phobic builds place every key at any table size", "[pilot_search][phobic]") {
+    // Below and above the vector path's smallest range.
+    for (size_t n : {size_t{2000}, size_t{9000}, size_t{60000}}) {
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < n; ++i) keys.push_back("pilot_" + std::to_string(i * 2654435761u));
+        auto p3 = phobic3::builder{}.add_all(keys).build();
+        REQUIRE(p3.has_value());
+        std::vector<bool> seen(p3->range_size(), false);
+        for (const auto& k : keys) {
+            const auto s = p3->slot_for(k).value;
+            REQUIRE(s < seen.size());
+            REQUIRE_FALSE(seen[s]);
+            seen[s] = true;
+        }
+    }
+}
@@ -24,6 +24,8 @@
 #include <cstdint>
 #include <random>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 using namespace maph;
@@ -152,6 +154,109 @@ TEST_CASE("encoded_retrieval<ribbon, prefix_codec>: keys in S round-trip",
     }
 }
 
+// ===== Table decode =====
+
+namespace {
+
+// decode() by definition: the value whose codeword prefixes the pattern,
+// else the default.
+template <typename C>
+typename C::logical_value reference_decode(const C& c, uint64_t pattern) {
+    constexpr unsigned M = C::value_bits;
+    for (const auto& e : c.entries()) {
+        const unsigned low = M - e.length;
+        if ((pattern >> low) == (uint64_t{e.prefix_left_aligned} >> low)) return e.value;
+    }
+    return c.default_value();
+}
+
+// Kraft-complete lengths: every length 1..k-1 once, then k twice
+// (minus `drop`, which leaves surplus for the default).
+std::vector<std::pair<uint32_t, unsigned>> staircase(unsigned k, unsigned drop = 0) {
+    std::vector<std::pair<uint32_t, unsigned>> codes;
+    for (unsigned l = 1; l < k; ++l) codes.push_back({l, l});
+    for (unsigned i = drop; i < 2; ++i) codes.push_back({k + i, k});
+    return codes;
+}
+
+}  // namespace
+
+TEST_CASE("prefix_codec: table decode matches the prefix definition",
+          "[prefix_codec][decode]") {
+    SECTION("single table, every pattern") {
+        std::vector<std::pair<uint32_t, double>> freqs;
+        for (uint32_t v = 1; v <= 200; ++v) freqs.push_back({v, 1.0 / v});
+        auto c = prefix_codec<uint32_t, 12>::from_frequencies(freqs, 0);
+        for (uint64_t p = 0; p < (uint64_t{1} << 12); ++p) {
+            REQUIRE(c.decode(p) == reference_decode(c, p));
+        }
+        prefix_codec<uint32_t, 12> gap(staircase(9, 1), 999);
+        for (uint64_t p = 0; p < (uint64_t{1} << 12); ++p) {
+            REQUIRE(gap.decode(p) == reference_decode(gap, p));
+        }
+    }
+
+    SECTION("two-level, around every codeword") {
+        std::vector<std::pair<uint32_t, double>> freqs;
+        for (uint32_t v = 1; v <= 3000; ++v) freqs.push_back({v, 1.0 / v});
+        auto zipf = prefix_codec<uint32_t, 20>::from_frequencies(freqs, 0);
+        prefix_codec<uint32_t, 20> deep(staircase(20), 0);
+        prefix_codec<uint32_t, 32> deeper(staircase(32, 1), 777);
+        auto check = [](const auto& c) {
+            using C = std::remove_cvref_t<decltype(c)>;
+            constexpr uint64_t all = C::alphabet_size - 1;
+            std::mt19937_64 rng{3};
+            for (const auto& e : c.entries()) {
+                const uint64_t base = e.prefix_left_aligned;
+                const uint64_t span = uint64_t{1} << (C::value_bits - e.length);
+                for (uint64_t p : {base, base + span - 1, base + (rng() & (span - 1)),
+                                   (base - 1) & all, (base + span) & all}) {
+                    REQUIRE(c.decode(p) == reference_decode(c, p));
+                }
+            }
+            for (int i = 0; i < 20000; ++i) {
+                const uint64_t p = rng() & all;
+                REQUIRE(c.decode(p) == reference_decode(c, p));
+            }
+        };
+        check(zipf);
+        check(deep);
+        check(deeper);
+    }
+
+    SECTION("decode_batch") {
+        prefix_codec<uint32_t, 20> c(staircase(20, 1), 42);
+        std::mt19937_64 rng{9};
+        std::vector<uint64_t> patterns(1000);
+        for (auto& p : patterns) p = rng() >> 40;
+        std::vector<uint32_t> out(patterns.size());
+        c.decode_batch(patterns, out);
+        for (size_t i = 0; i < patterns.size(); ++i) REQUIRE(out[i] == c.decode(patterns[i]));
+    }
+}
+
+TEST_CASE("encoded_retrieval: lookup_batch matches lookup", "[prefix_codec][integration]") {
+    auto keys = make_keys(3000);
+    std::vector<std::pair<uint32_t, double>> freqs;
+    for (uint32_t v = 1; v <= 500; ++v) freqs.push_back({v, 1.0 / v});
+    auto c = prefix_codec<uint32_t, 16>::from_frequencies(freqs, 0);
+    std::vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values[i] = 1 + static_cast<uint32_t>(i % 500);
+
+    using Enc = encoded_retrieval<ribbon_retrieval<16>, prefix_codec<uint32_t, 16>>;
+    auto built = Enc::builder(c).add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    std::vector<std::string> absent;
+    for (int i = 0; i < 500; ++i) absent.push_back("absent" + std::to_string(i));
+    std::vector<std::string_view> queries(keys.begin(), keys.end());
+    queries.insert(queries.end(), absent.begin(), absent.end());
+    std::vector<uint32_t> out(queries.size());
+    built->lookup_batch(queries, out);
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(out[i] == values[i]);
+    for (size_t i = 0; i < queries.size(); ++i) REQUIRE(out[i] == built->lookup(queries[i]));
+}
+
 // ===== Empirical claim: non-member distribution =====
 //
 // The cipher-map framing claims that for a skewed value distribution,
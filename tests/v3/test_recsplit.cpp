@@ -0,0 +1,201 @@
+/**
+ * @file test_recsplit.cpp
+ * @brief Tests for recsplit_hasher's split tree and its Elias-Fano and
+ *        Golomb-Rice building blocks.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/recsplit.hpp>
+#include <maph/concepts/perfect_hash_function.hpp>
+#include <maph/detail/elias_fano.hpp>
+#include <maph/detail/golomb_rice.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(4, 16);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+template<typename PHF>
+bool is_minimal_perfect(const PHF& phf, const std::vector<std::string>& keys) {
+    std::vector<bool> used(keys.size(), false);
+    for (const auto& k : keys) {
+        uint64_t s = phf.slot_for(k).value;
+        if (s >= keys.size() || used[s]) return false;
+        used[s] = true;
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("elias_fano: access and pairs match the input", "[recsplit][elias_fano]") {
+    std::mt19937_64 rng{5};
+    for (uint64_t gap : {0u, 1u, 3u, 100u, 5000u}) {
+        std::vector<uint64_t> values(3000);
+        uint64_t v = 0;
+        for (auto& x : values) {
+            v += gap == 0 ? 0 : rng() % (2 * gap);
+            x = v;
+        }
+        detail::elias_fano ef{values};
+        REQUIRE(ef.size() == values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(ef[i] == values[i]);
+            if (i + 1 < values.size()) {
+                auto [a, b] = ef.pair(i);
+                REQUIRE(a == values[i]);
+                REQUIRE(b == values[i + 1]);
+            }
+        }
+
+        std::vector<std::byte> bytes;
+        ef.serialize(bytes);
+        phf_serial::reader r{bytes};
+        detail::elias_fano loaded;
+        REQUIRE(loaded.deserialize(r));
+        for (size_t i = 0; i < values.size(); i += 7) REQUIRE(loaded[i] == values[i]);
+    }
+}
+
+TEST_CASE("select_in_word matches clearing low bits", "[recsplit][elias_fano]") {
+    std::mt19937_64 rng{9};
+    for (int t = 0; t < 100000; ++t) {
+        uint64_t w = rng() & (t % 2 ? rng() : ~uint64_t{0});
+        if (w == 0) continue;
+        auto r = static_cast<unsigned>(rng() % static_cast<uint64_t>(std::popcount(w)));
+        uint64_t x = w;
+        for (unsigned i = 0; i < r; ++i) x &= x - 1;
+        REQUIRE(detail::select_in_word(w, r) == static_cast<unsigned>(std::countr_zero(x)));
+    }
+}
+
+TEST_CASE("rice_reader decodes and skips what bit_writer wrote", "[recsplit][golomb_rice]") {
+    std::mt19937_64 rng{11};
+    std::vector<uint64_t> values(2000);
+    std::vector<unsigned> widths(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        widths[i] = static_cast<unsigned>(rng() % 12);
+        values[i] = rng() % (uint64_t{1} << (widths[i] + 3));
+    }
+    detail::bit_writer w;
+    for (size_t i = 0; i < values.size(); ++i) w.append(values[i], widths[i]);
+    const uint64_t fixed_bits = w.size();
+    for (size_t i = 0; i < values.size(); ++i) w.append_unary(values[i] >> widths[i]);
+    auto words = std::move(w).take();
+    words.push_back(~uint64_t{0});
+
+    detail::rice_reader all{words.data(), 0, fixed_bits};
+    for (size_t i = 0; i < values.size(); ++i) REQUIRE(all.next(widths[i]) == values[i]);
+
+    // Skip the first 1000 codes in one step.
+    uint64_t skipped_fixed = 0;
+    for (size_t i = 0; i < 1000; ++i) skipped_fixed += widths[i];
+    detail::rice_reader rd{words.data(), 0, fixed_bits};
+    rd.skip(1000, skipped_fixed);
+    for (size_t i = 1000; i < values.size(); ++i) REQUIRE(rd.next(widths[i]) == values[i]);
+}
+
+TEST_CASE("recsplit8: minimal perfect at several sizes", "[recsplit]") {
+    for (size_t n : {1u, 2u, 7u, 8u, 9u, 97u, 100u, 250u, 5000u, 30000u}) {
+        auto keys = make_keys(n, n);
+        auto phf = recsplit8::builder{}.add_all(keys).build();
+        REQUIRE(phf.has_value());
+        REQUIRE(phf->num_keys() == keys.size());
+        REQUIRE(is_minimal_perfect(*phf, keys));
+    }
+}
+
+TEST_CASE("recsplit: leaf sizes and bucket sizes", "[recsplit]") {
+    auto keys = make_keys(6000);
+    REQUIRE(is_minimal_perfect(recsplit_hasher<4>::builder{}.add_all(keys).build().value(), keys));
+    REQUIRE(is_minimal_perfect(recsplit_hasher<10>::builder{}.add_all(keys).build().value(), keys));
+    for (size_t bs : {1u, 5u, 20u, 500u, 2000u}) {
+        auto phf = recsplit8::builder{}.add_all(keys).with_bucket_size(bs).build();
+        REQUIRE(phf.has_value());
+        REQUIRE(phf->bucket_size() == bs);
+        REQUIRE(is_minimal_perfect(*phf, keys));
+    }
+}
+
+TEST_CASE("recsplit8: about 1.8 bits per key", "[recsplit][space]") {
+    auto keys = make_keys(200000);
+    auto phf = recsplit8::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    INFO("bits/key: " << phf->bits_per_key());
+    REQUIRE(phf->bits_per_key() < 2.0);
+}
+
+TEST_CASE("recsplit8: threaded build matches serial", "[recsplit][threads]") {
+    auto keys = make_keys(50000);
+    auto serial = recsplit8::builder{}.add_all(keys).with_threads(1).build();
+    auto threaded = recsplit8::builder{}.add_all(keys).with_threads(4).build();
+    REQUIRE(serial.has_value());
+    REQUIRE(threaded.has_value());
+    REQUIRE(threaded->serialize() == serial->serialize());
+
+    executor pool{3};
+    auto pooled = recsplit8::builder{}.add_all(keys).with_executor(pool).build();
+    REQUIRE(pooled.has_value());
+    REQUIRE(pooled->serialize() == serial->serialize());
+}
+
+TEST_CASE("recsplit8: deserialize rejects damaged blobs", "[recsplit][serialize]") {
+    auto keys = make_keys(3000);
+    auto phf = recsplit8::builder{}.add_all(keys).build();
+    REQUIRE(phf.has_value());
+    auto bytes = phf->serialize();
+
+    auto restored = recsplit8::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->serialize() == bytes);
+    REQUIRE(is_minimal_perfect(*restored, keys));
+
+    REQUIRE_FALSE(recsplit8::deserialize(std::span<const std::byte>{bytes}.first(bytes.size() - 8)).has_value());
+    REQUIRE_FALSE(recsplit_hasher<10>::deserialize(bytes).has_value());
+
+    // Header (magic, version, algorithm, leaf size), then key count,
+    // bucket size, bucket count and seed, then the Rice parameters.
+    constexpr size_t key_count_at = 4 * sizeof(uint32_t);
+    constexpr size_t rice_at = key_count_at + 4 * sizeof(uint64_t);
+
+    // key count disagreeing with the directory
+    auto bad = bytes;
+    bad[key_count_at] = static_cast<std::byte>(static_cast<uint8_t>(bad[key_count_at]) ^ 1);
+    REQUIRE_FALSE(recsplit8::deserialize(bad).has_value());
+
+    // Wider Rice codes: every tree now overruns the next bucket's.
+    bad = bytes;
+    uint64_t rice_count{};
+    std::memcpy(&rice_count, bad.data() + rice_at, sizeof(rice_count));
+    for (size_t i = 0; i < rice_count; ++i) {
+        auto& k = bad[rice_at + sizeof(uint64_t) + i];
+        k = static_cast<std::byte>(static_cast<uint8_t>(k) + 8);
+    }
+    REQUIRE_FALSE(recsplit8::deserialize(bad).has_value());
+}
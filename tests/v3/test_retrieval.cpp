@@ -18,9 +18,12 @@
 #include <maph/retrieval/ribbon_retrieval.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace maph;
@@ -185,6 +188,66 @@ TEST_CASE("phf_value_array: per-key add(key, value) incremental", "[retrieval]")
     }
 }
 
+template<typename A>
+concept updatable = requires(A& a, std::string_view k) { a.update(k, typename A::value_type{}); };
+
+TEST_CASE("phf_value_array: update() rewrites values in place", "[retrieval][update]") {
+    auto keys = make_keys(2000);
+    std::vector<uint8_t> values(keys.size(), 7);
+    auto built = phf_value_array<phobic5, 4>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    // Every other key changes; sixteen 4-bit values share each word.
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        built->update(keys[i], static_cast<uint8_t>(i & 0xf));
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(built->lookup(keys[i]) == (i % 2 == 0 ? static_cast<uint8_t>(i & 0xf) : 7));
+    }
+
+    auto loaded = phf_value_array<phobic5, 4>::deserialize(built->serialize());
+    REQUIRE(loaded.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(loaded->lookup(keys[i]) == built->lookup(keys[i]));
+    }
+    // Widths whose values may straddle two words have no update().
+    STATIC_REQUIRE(updatable<phf_value_array<phobic5, 4>>);
+    STATIC_REQUIRE_FALSE(updatable<phf_value_array<phobic5, 13>>);
+}
+
+TEST_CASE("phf_value_array: update() alongside concurrent lookups", "[retrieval][update]") {
+    auto keys = make_keys(4000);
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values[i] = static_cast<uint16_t>(i);
+    auto built = phf_value_array<phobic5, 16>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    // The writer flips each key between i and ~i; readers must only ever
+    // see one of the two.
+    std::atomic<bool> done{false};
+    std::atomic<size_t> bad{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire)) {
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    const uint16_t v = built->lookup_atomic(keys[i]);
+                    if (v != static_cast<uint16_t>(i) && v != static_cast<uint16_t>(~i)) ++bad;
+                }
+            }
+        });
+    }
+    for (int round = 0; round < 20; ++round) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            built->update(keys[i], static_cast<uint16_t>(round % 2 == 0 ? ~i : i));
+        }
+    }
+    done.store(true, std::memory_order_release);
+    for (auto& r : readers) r.join();
+    CHECK(bad.load() == 0);
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == values[i]);
+}
+
 // ===== GIGO semantics =====
 
 TEST_CASE("phf_value_array: non-member lookups are well-defined (GIGO)", "[retrieval][gigo]") {
@@ -233,7 +296,7 @@ TEST_CASE("phf_value_array: bits_per_key is PHF cost + M", "[retrieval][space]")
     REQUIRE(built.has_value());
 
     double bpk = built->bits_per_key();
-    // phobic5 is around 2.7 bits/key; 16 bits for the value payload; plus
+    // phobic5 is around 3.2 bits/key; 16 bits for the value payload; plus
     // some slack for range_size > num_keys in non-minimal PHOBIC builds.
     REQUIRE(bpk > 16.0);
     REQUIRE(bpk < 25.0);
@@ -426,3 +489,413 @@ TEST_CASE("phf_value_array: serialize/deserialize round-trip", "[retrieval][seri
     REQUIRE(restored->num_keys() == built->num_keys());
     REQUIRE(restored->value_bits() == built->value_bits());
 }
+
+// ===== Zero-copy views =====
+
+TEST_CASE("ribbon_retrieval_view: answers like the owning ribbon_retrieval", "[retrieval][ribbon][view]") {
+    static_assert(retrieval<ribbon_retrieval_view<16>>);
+    static_assert(hashed_retrieval<ribbon_retrieval_view<16>>);
+
+    auto keys = make_keys(800);
+    std::vector<uint16_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<16>(k)));
+    auto built = ribbon_retrieval<16>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+    auto bytes = built->serialize();
+
+    auto view = ribbon_retrieval_view<16>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_keys() == built->num_keys());
+    REQUIRE(view->num_rows() == built->num_rows());
+    REQUIRE(view->serialize() == bytes);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(view->lookup(keys[i]) == values[i]);
+        REQUIRE(view->lookup(hashed_key{keys[i]}) == values[i]);
+    }
+    REQUIRE(view->lookup("not-a-member") == built->lookup("not-a-member"));
+
+    REQUIRE_FALSE(ribbon_retrieval_view<16>::deserialize(
+        std::span<const std::byte>(bytes).first(bytes.size() - 1)).has_value());
+    REQUIRE_FALSE(ribbon_retrieval_view<8>::deserialize(bytes).has_value());
+}
+
+namespace {
+
+// Builds both layouts from one seed, so they solve the same system and
+// must agree on every key, member or not.
+template <unsigned M>
+void check_interleaved_matches_flat(size_t n) {
+    using value_t = typename ribbon_retrieval<M>::value_type;
+    auto keys = make_keys(n, 7 + M);
+    std::vector<value_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<value_t>(deterministic_value_for<M>(k)));
+
+    auto flat = typename ribbon_retrieval<M>::builder{}.add_all(keys, values).build();
+    auto inter = typename ribbon_retrieval<M, interleaved_solution>::builder{}
+        .add_all(keys, values).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    REQUIRE(inter->num_rows() == flat->num_rows());
+    REQUIRE(inter->seed() == flat->seed());
+    REQUIRE(inter->memory_bytes() <= flat->memory_bytes() + M * sizeof(uint64_t));
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(inter->lookup(keys[i]) == values[i]);
+        REQUIRE(inter->lookup(hashed_key{keys[i]}) == values[i]);
+    }
+    for (size_t i = 0; i < 500; ++i) {
+        auto probe = "absent-" + std::to_string(i);
+        REQUIRE(inter->lookup(probe) == flat->lookup(probe));
+    }
+}
+
+} // namespace
+
+TEST_CASE("ribbon_retrieval: interleaved layout answers like flat", "[retrieval][ribbon][interleaved]") {
+    check_interleaved_matches_flat<1>(3000);
+    check_interleaved_matches_flat<13>(2000);
+    check_interleaved_matches_flat<64>(700);
+
+    // One bit per row instead of one byte.
+    auto keys = make_keys(4000);
+    std::vector<uint8_t> bits(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) bits[i] = static_cast<uint8_t>(i & 1);
+    auto flat = ribbon_retrieval<1>::builder{}.add_all(keys, bits).build();
+    auto inter = ribbon_retrieval<1, interleaved_solution>::builder{}.add_all(keys, bits).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    REQUIRE(inter->memory_bytes() * 6 < flat->memory_bytes());
+}
+
+TEST_CASE("ribbon_retrieval: layouts load each other's bytes", "[retrieval][ribbon][interleaved][serialize]") {
+    using flat_t = ribbon_retrieval<16>;
+    using inter_t = ribbon_retrieval<16, interleaved_solution>;
+    auto keys = make_keys(1500);
+    std::vector<uint16_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<16>(k)));
+    auto flat = flat_t::builder{}.add_all(keys, values).build();
+    auto inter = inter_t::builder{}.add_all(keys, values).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    auto flat_bytes = flat->serialize();
+    auto inter_bytes = inter->serialize();
+    REQUIRE(flat_bytes != inter_bytes);
+
+    auto a = inter_t::deserialize(flat_bytes);
+    auto b = flat_t::deserialize(inter_bytes);
+    REQUIRE(a.has_value());
+    REQUIRE(b.has_value());
+    REQUIRE(a->serialize() == inter_bytes);
+    REQUIRE(b->serialize() == flat_bytes);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(a->lookup(keys[i]) == values[i]);
+        REQUIRE(b->lookup(keys[i]) == values[i]);
+    }
+
+    // Views bind only to their own layout.
+    auto view = ribbon_retrieval_view<16, interleaved_solution>::deserialize(inter_bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->memory_bytes() == inter->memory_bytes());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(view->lookup(keys[i]) == values[i]);
+    REQUIRE(view->lookup("not-a-member") == flat->lookup("not-a-member"));
+    REQUIRE_FALSE(ribbon_retrieval_view<16, interleaved_solution>::deserialize(flat_bytes).has_value());
+    REQUIRE_FALSE(ribbon_retrieval_view<16>::deserialize(inter_bytes).has_value());
+    REQUIRE_FALSE(inter_t::deserialize(
+        std::span<const std::byte>(inter_bytes).first(inter_bytes.size() - 8)).has_value());
+}
+
+TEST_CASE("ribbon_retrieval: sharded build is exact and thread-independent", "[retrieval][ribbon][shards]") {
+    auto keys = make_keys(20000);
+    std::vector<uint16_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<16>(k)));
+
+    auto serial = ribbon_retrieval<16>::builder{}
+        .add_all(keys, values).with_shard_keys(2000).build();
+    auto threaded = ribbon_retrieval<16>::builder{}
+        .add_all(keys, values).with_shard_keys(2000).with_threads(4).build();
+    REQUIRE(serial.has_value());
+    REQUIRE(threaded.has_value());
+    REQUIRE(serial->num_shards() == 10);
+    REQUIRE(serial->num_keys() == keys.size());
+    auto bytes = serial->serialize();
+    REQUIRE(threaded->serialize() == bytes);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(serial->lookup(keys[i]) == values[i]);
+        REQUIRE(serial->lookup(hashed_key{keys[i]}) == values[i]);
+    }
+
+    auto restored = ribbon_retrieval<16>::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    REQUIRE(restored->num_shards() == 10);
+    REQUIRE(restored->serialize() == bytes);
+    auto view = ribbon_retrieval_view<16>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_shards() == 10);
+    REQUIRE(view->memory_bytes() == serial->memory_bytes());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(view->lookup(keys[i]) == values[i]);
+    REQUIRE(view->lookup("not-a-member") == serial->lookup("not-a-member"));
+
+    // Small sets keep the single-band format.
+    auto single = ribbon_retrieval<16>::builder{}.add_all(keys, values).build();
+    auto unsharded = ribbon_retrieval<16>::builder{}
+        .add_all(keys, values).with_shard_keys(0).build();
+    REQUIRE(single.has_value());
+    REQUIRE(unsharded.has_value());
+    REQUIRE(single->num_shards() == 1);
+    REQUIRE(single->serialize() == unsharded->serialize());
+
+    // Shard bounds that do not end at num_rows are rejected. The first
+    // bounds vector follows the 28-byte header and its 8-byte count.
+    auto bad = bytes;
+    const size_t last_bound = 28 + 8 + 10 * sizeof(uint64_t);
+    uint64_t bound{};
+    std::memcpy(&bound, bad.data() + last_bound, sizeof(bound));
+    REQUIRE(bound == serial->num_rows());
+    bound -= 1;
+    std::memcpy(bad.data() + last_bound, &bound, sizeof(bound));
+    REQUIRE_FALSE(ribbon_retrieval<16>::deserialize(bad).has_value());
+    REQUIRE_FALSE(ribbon_retrieval_view<16>::deserialize(bad).has_value());
+}
+
+TEST_CASE("ribbon_retrieval: sharded interleaved layout", "[retrieval][ribbon][shards][interleaved]") {
+    auto keys = make_keys(12000, 99);
+    std::vector<uint8_t> bits(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) bits[i] = static_cast<uint8_t>(deterministic_value_for<1>(keys[i]));
+    auto flat = ribbon_retrieval<1>::builder{}.add_all(keys, bits).with_shard_keys(1000).build();
+    auto inter = ribbon_retrieval<1, interleaved_solution>::builder{}
+        .add_all(keys, bits).with_shard_keys(1000).with_threads(3).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    REQUIRE(inter->num_shards() == flat->num_shards());
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(inter->lookup(keys[i]) == bits[i]);
+
+    auto converted = ribbon_retrieval<1, interleaved_solution>::deserialize(flat->serialize());
+    REQUIRE(converted.has_value());
+    REQUIRE(converted->serialize() == inter->serialize());
+}
+
+TEST_CASE("packed_value_array_view: reads the serialized words in place", "[retrieval][packed][view]") {
+    detail::packed_value_array<13> arr;
+    arr.resize(1000);
+    for (size_t i = 0; i < 1000; ++i) arr.set(i, static_cast<uint16_t>((i * 2654435761u) & 0x1fff));
+    auto bytes = arr.serialize();
+
+    auto view = detail::packed_value_array_view<13>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_slots() == 1000);
+    for (size_t i = 0; i < 1000; ++i) REQUIRE(view->get(i) == arr.get(i));
+
+    // Fewer words than num_slots needs must be rejected.
+    auto bad = bytes;
+    uint64_t slots = 5000;
+    std::memcpy(bad.data() + 4, &slots, sizeof(slots));
+    REQUIRE_FALSE(detail::packed_value_array_view<13>::deserialize(bad).has_value());
+}
+
+namespace {
+
+// Bulk operations against per-slot get/set for one width, with a table
+// large enough for the vector path and an odd size to exercise the tail.
+template <unsigned M>
+void check_packed_bulk() {
+    using arr_t = detail::packed_value_array<M>;
+    using value_type = typename arr_t::value_type;
+    const uint64_t mask = (M == 64) ? ~uint64_t{0} : ((uint64_t{1} << M) - 1);
+    constexpr size_t n = 1031;
+    std::mt19937_64 rng{M};
+
+    std::vector<value_type> vals(n);
+    for (auto& v : vals) v = static_cast<value_type>(rng() & mask);
+    arr_t bulk, single;
+    bulk.resize(n);
+    single.resize(n);
+    const auto fill_value = static_cast<value_type>(0xa5a5a5a5a5a5a5a5ULL & mask);
+    bulk.fill(0, n, fill_value);
+    for (size_t i = 0; i < n; ++i) single.set(i, fill_value);
+    REQUIRE(bulk.serialize() == single.serialize());
+    arr_t assigned;
+    assigned.assign(n, fill_value);
+    REQUIRE(assigned.serialize() == single.serialize());
+
+    // Unaligned runs on top of the fill, so both edges are merged.
+    bulk.set_range(3, std::span<const value_type>{vals}.subspan(3, 700));
+    bulk.fill(777, 100, static_cast<value_type>(1));
+    bulk.fill(901, 129, static_cast<value_type>(~uint64_t{0} & mask));
+    for (size_t i = 3; i < 703; ++i) single.set(i, vals[i]);
+    for (size_t i = 777; i < 877; ++i) single.set(i, 1);
+    for (size_t i = 901; i < 1030; ++i) single.set(i, static_cast<value_type>(mask));
+    REQUIRE(bulk.serialize() == single.serialize());
+
+    std::vector<size_t> slots(n);
+    for (size_t i = 0; i < n; ++i) slots[i] = static_cast<size_t>(rng() % n);
+    slots[5] = n - 1;  // last slot, inside a vector group
+    std::vector<value_type> got(n);
+    bulk.get_batch(slots, got.data());
+    for (size_t i = 0; i < n; ++i) REQUIRE(got[i] == single.get(slots[i]));
+
+    const auto bytes = bulk.serialize();
+    auto view = detail::packed_value_array_view<M>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    std::vector<value_type> via_view(n);
+    view->get_batch(slots, via_view.data());
+    REQUIRE(via_view == got);
+}
+
+} // namespace
+
+TEST_CASE("packed_value_array: bulk operations match per-slot get and set", "[retrieval][packed]") {
+    check_packed_bulk<1>();
+    check_packed_bulk<3>();
+    check_packed_bulk<8>();
+    check_packed_bulk<13>();
+    check_packed_bulk<16>();
+    check_packed_bulk<32>();
+    check_packed_bulk<56>();
+    check_packed_bulk<57>();
+    check_packed_bulk<64>();
+}
+
+TEST_CASE("phf_value_array: lookup_batch matches lookup", "[retrieval][batch]") {
+    auto keys = make_keys(3000);
+    std::vector<uint16_t> values;
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<13>(k)));
+
+    auto r = phf_value_array<phobic5, 13>::builder{}.add_all(keys, values).build();
+    REQUIRE(r.has_value());
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    views.push_back("not-a-member");
+    std::vector<uint16_t> out(views.size());
+    r->lookup_batch(views, out);
+    for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i] == r->lookup(views[i]));
+
+    auto bytes = r->serialize();
+    auto view = phf_value_array_view<phobic_phf_view<5>, 13>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    std::vector<uint16_t> via_view(views.size());
+    view->lookup_batch(views, via_view);
+    REQUIRE(via_view == out);
+}
+
+TEST_CASE("phf_value_array: lookup_interleaved matches lookup", "[retrieval][interleaved]") {
+    auto keys = make_keys(3000);
+    std::vector<uint16_t> values;
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<13>(k)));
+
+    auto r = phf_value_array<phobic5, 13>::builder{}.add_all(keys, values).build();
+    REQUIRE(r.has_value());
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    views.push_back("not-a-member");
+    std::vector<uint16_t> expected(views.size());
+    for (size_t i = 0; i < views.size(); ++i) expected[i] = r->lookup(views[i]);
+
+    std::vector<uint16_t> out(views.size());
+    r->lookup_interleaved<1>(views, out);
+    REQUIRE(out == expected);
+    std::fill(out.begin(), out.end(), uint16_t{0});
+    r->lookup_interleaved<7>(views, out);
+    REQUIRE(out == expected);
+    std::fill(out.begin(), out.end(), uint16_t{0});
+    r->lookup_interleaved(views, out);
+    REQUIRE(out == expected);
+
+    // The callback form sees every index exactly once.
+    std::vector<int> seen(views.size(), 0);
+    r->lookup_interleaved<32>(views, [&](size_t i, uint16_t v) {
+        ++seen[i];
+        out[i] = v;
+    });
+    REQUIRE(std::all_of(seen.begin(), seen.end(), [](int c) { return c == 1; }));
+    REQUIRE(out == expected);
+
+    // Fewer keys than the ring, and none at all.
+    std::vector<uint16_t> few(3);
+    r->lookup_interleaved<16>(std::span<const std::string_view>{views}.first(3), few);
+    for (size_t i = 0; i < 3; ++i) REQUIRE(few[i] == expected[i]);
+    r->lookup_interleaved(std::span<const std::string_view>{}, std::span<uint16_t>{});
+
+    auto bytes = r->serialize();
+    auto view = phf_value_array_view<phobic_phf_view<5>, 13>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    std::vector<uint16_t> via_view(views.size());
+    view->lookup_interleaved<8>(views, via_view);
+    REQUIRE(via_view == expected);
+}
+
+TEST_CASE("phf_value_array_view: answers like the owning phf_value_array", "[retrieval][view]") {
+    static_assert(retrieval<phf_value_array_view<phobic_phf_view<5>, 16>>);
+
+    auto keys = make_keys(1500);
+    std::vector<uint16_t> values;
+    values.reserve(keys.size());
+    for (const auto& k : keys) values.push_back(static_cast<uint16_t>(deterministic_value_for<16>(k)));
+    auto built = phf_value_array<phobic5, 16>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+    auto bytes = built->serialize();
+
+    auto view = phf_value_array_view<phobic_phf_view<5>, 16>::deserialize(bytes);
+    REQUIRE(view.has_value());
+    REQUIRE(view->num_keys() == built->num_keys());
+    REQUIRE(view->serialize() == bytes);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(view->lookup(keys[i]) == values[i]);
+        REQUIRE(view->lookup(hashed_key{keys[i]}) == values[i]);
+    }
+
+    REQUIRE_FALSE((phf_value_array_view<phobic_phf_view<5>, 16>::deserialize(
+        std::span<const std::byte>(bytes).first(bytes.size() - 1)).has_value()));
+}
+
+TEST_CASE("retrieval: integer keys through ribbon_retrieval and phf_value_array", "[retrieval][integer_key]") {
+    std::mt19937_64 rng{35};
+    std::vector<uint64_t> ids(8000);
+    for (auto& id : ids) id = rng();
+    std::vector<uint16_t> values(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) values[i] = static_cast<uint16_t>(i * 13);
+
+    auto rr = ribbon_retrieval<16>::builder{}.add_all(ids, values).build();
+    REQUIRE(rr.has_value());
+    auto pv = phf_value_array<phobic5, 16>::builder{}.add_all(ids, values).build();
+    REQUIRE(pv.has_value());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        REQUIRE(rr->lookup(ids[i]) == values[i]);
+        REQUIRE(rr->lookup(integer_key_bytes(ids[i])) == values[i]);
+        REQUIRE(pv->lookup(ids[i]) == values[i]);
+    }
+
+    ribbon_retrieval<8>::builder one;
+    const uint64_t id = 77;
+    one.add(id, 5);
+    auto single = one.build();
+    REQUIRE(single.has_value());
+    REQUIRE(single->lookup(id) == 5);
+}
+
+TEST_CASE("retrieval: ribbon_retrieval from pre-hashed digests", "[retrieval][add_hashes]") {
+    auto keys = make_keys(8000, 36);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    const size_t half = keys.size() / 2;
+    std::vector<hash128> digests;
+    std::vector<uint16_t> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) values[i] = static_cast<uint16_t>(i * 29);
+    for (size_t i = 0; i < half; ++i) digests.push_back(phf_hash128(keys[i]));
+
+    ribbon_retrieval<16>::builder b;
+    b.add_hashes(digests, std::span<const uint16_t>(values).first(half));
+    for (size_t i = half; i < keys.size(); ++i) b.add(keys[i], values[i]);
+    auto rr = b.build();
+    REQUIRE(rr.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(rr->lookup(keys[i]) == values[i]);
+        REQUIRE(rr->lookup(phf_hash128(keys[i])) == values[i]);
+    }
+
+    auto clash = ribbon_retrieval<16>::builder{}
+        .add_hashes(digests, std::span<const uint16_t>(values).first(half))
+        .add(keys[3], 1).build();
+    REQUIRE_FALSE(clash.has_value());
+    REQUIRE(clash.error() == error::duplicate_key);
+}
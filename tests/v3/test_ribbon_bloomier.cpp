@@ -0,0 +1,166 @@
+/**
+ * @file test_ribbon_bloomier.cpp
+ * @brief Tests for ribbon_bloomier<M, F>, the single-solve approximate function.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/composition/bloomier.hpp>
+#include <maph/composition/ribbon_bloomier.hpp>
+#include <maph/filters/ribbon_filter.hpp>
+#include <maph/retrieval/ribbon_retrieval.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+template <typename T>
+std::vector<T> make_values(size_t count, unsigned bits, uint64_t seed = 7) {
+    std::mt19937_64 rng{seed};
+    const uint64_t mask = bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+    std::vector<T> values(count);
+    for (auto& v : values) v = static_cast<T>(rng() & mask);
+    return values;
+}
+
+} // namespace
+
+TEST_CASE("ribbon_bloomier: members return their values", "[ribbon_bloomier]") {
+    auto keys = make_keys(5000);
+    auto values = make_values<uint8_t>(keys.size(), 8);
+
+    auto built = ribbon_bloomier<8, 8>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_keys() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto v = built->lookup(keys[i]);
+        REQUIRE(v.has_value());
+        REQUIRE(*v == values[i]);
+        REQUIRE(built->contains(keys[i]));
+    }
+}
+
+TEST_CASE("ribbon_bloomier: odd widths and the interleaved layout", "[ribbon_bloomier]") {
+    auto keys = make_keys(3000, 3);
+    auto values = make_values<uint16_t>(keys.size(), 12);
+
+    auto flat = ribbon_bloomier<12, 4>::builder{}.add_all(keys, values).build();
+    auto inter = ribbon_bloomier<12, 7, interleaved_solution>::builder{}
+                     .add_all(keys, values).build();
+    REQUIRE(flat.has_value());
+    REQUIRE(inter.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(flat->lookup(keys[i]) == std::optional<uint16_t>{values[i]});
+        REQUIRE(inter->lookup(keys[i]) == std::optional<uint16_t>{values[i]});
+    }
+    // Values wider than M are cut to M bits.
+    auto wide = ribbon_bloomier<4, 4>::builder{}.add("k", uint8_t{0xf3}).build();
+    REQUIRE(wide.has_value());
+    REQUIRE(wide->lookup("k") == std::optional<uint8_t>{3});
+}
+
+TEST_CASE("ribbon_bloomier: non-members pass at rate 2^-F", "[ribbon_bloomier][fpr]") {
+    auto keys = make_keys(20000);
+    auto values = make_values<uint8_t>(keys.size(), 8);
+    auto built = ribbon_bloomier<8, 8>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    size_t passed = 0;
+    constexpr size_t probes = 200000;
+    for (size_t i = 0; i < probes; ++i) {
+        if (built->lookup("absent_" + std::to_string(i))) ++passed;
+    }
+    const double fpr = static_cast<double>(passed) / probes;
+    REQUIRE(fpr > 0.5 / 256);
+    REQUIRE(fpr < 1.5 / 256);
+}
+
+TEST_CASE("ribbon_bloomier: smaller than bloomier over two ribbons", "[ribbon_bloomier]") {
+    auto keys = make_keys(20000);
+    auto values = make_values<uint8_t>(keys.size(), 8);
+
+    auto fused = ribbon_bloomier<8, 8>::builder{}.add_all(keys, values).build();
+    auto pair = bloomier<ribbon_retrieval<8>, ribbon_filter<8>>::builder{}
+                    .add_all(keys, values).build();
+    REQUIRE(fused.has_value());
+    REQUIRE(pair.has_value());
+    REQUIRE(fused->bits_per_key() < 1.1 * 16);
+    REQUIRE(fused->memory_bytes() <= pair->memory_bytes());
+}
+
+TEST_CASE("ribbon_bloomier: digests and threaded sharded builds", "[ribbon_bloomier]") {
+    auto keys = make_keys(40000, 11);
+    auto values = make_values<uint16_t>(keys.size(), 16);
+
+    auto one = ribbon_bloomier<16, 8>::builder{}
+                   .with_shard_keys(4096).add_all(keys, values).build();
+    auto four = ribbon_bloomier<16, 8>::builder{}
+                    .with_shard_keys(4096).with_threads(4).add_all(keys, values).build();
+    executor pool{3};
+    auto pooled = ribbon_bloomier<16, 8>::builder{}
+                      .with_shard_keys(4096).with_executor(pool).add_all(keys, values).build();
+    REQUIRE(one.has_value());
+    REQUIRE(four.has_value());
+    REQUIRE(pooled.has_value());
+    REQUIRE(one->get_retrieval().num_shards() > 1);
+    REQUIRE(one->serialize() == four->serialize());
+    REQUIRE(one->serialize() == pooled->serialize());
+
+    std::vector<hash128> digests;
+    for (const auto& k : keys) digests.push_back(phf_hash128(k));
+    auto hashed = ribbon_bloomier<16, 8>::builder{}
+                      .with_shard_keys(4096).add_hashes(digests, values).build();
+    REQUIRE(hashed.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(hashed->lookup(digests[i]) == std::optional<uint16_t>{values[i]});
+        REQUIRE(one->lookup(hashed_key{keys[i]}) == std::optional<uint16_t>{values[i]});
+    }
+
+    auto dup = ribbon_bloomier<16, 8>::builder{}
+                   .add("a", uint16_t{1}).add("a", uint16_t{2}).build();
+    REQUIRE(!dup.has_value());
+    REQUIRE(dup.error() == error::duplicate_key);
+}
+
+TEST_CASE("ribbon_bloomier: serialization round-trip", "[ribbon_bloomier][serialization]") {
+    auto keys = make_keys(3000);
+    auto values = make_values<uint8_t>(keys.size(), 8);
+    auto built = ribbon_bloomier<8, 8>::builder{}.add_all(keys, values).build();
+    REQUIRE(built.has_value());
+
+    auto bytes = built->serialize();
+    auto loaded = ribbon_bloomier<8, 8>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(loaded->lookup(keys[i]) == std::optional<uint8_t>{values[i]});
+    }
+    for (size_t i = 0; i < 2000; ++i) {
+        const auto k = "absent_" + std::to_string(i);
+        REQUIRE(loaded->lookup(k) == built->lookup(k));
+    }
+
+    // Same retrieval width, different split.
+    REQUIRE(!ribbon_bloomier<12, 4>::deserialize(bytes).has_value());
+    auto stored = from_container<ribbon_bloomier<8, 8>>(to_container(*built));
+    REQUIRE(stored.has_value());
+    REQUIRE(stored->serialize() == bytes);
+}
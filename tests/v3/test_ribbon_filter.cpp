@@ -0,0 +1,66 @@
+/**
+ * @file test_ribbon_filter.cpp
+ * @brief Tests for ribbon_filter.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/concepts/membership_oracle.hpp>
+#include <maph/filters/ribbon_filter.hpp>
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+TEST_CASE("ribbon_filter: verify_batch matches verify", "[ribbon_filter][batch]") {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 4000; ++i) keys.push_back("ribbon_key_" + std::to_string(i));
+    std::vector<std::string> probes = keys;
+    for (size_t i = 0; i < 4000; ++i) probes.push_back("other_" + std::to_string(i));
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    ribbon_filter<8> f;
+    REQUIRE(f.build(keys));
+    auto out = std::make_unique<bool[]>(views.size());
+    verify_batch(f, views, std::span<bool>{out.get(), views.size()});
+    for (size_t i = 0; i < views.size(); ++i) {
+        REQUIRE(out[i] == f.verify(views[i]));
+        if (i < keys.size()) REQUIRE(out[i]);
+    }
+}
+
+TEST_CASE("ribbon_filter: interleaved layout matches flat", "[ribbon_filter][interleaved]") {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 5000; ++i) keys.push_back("ribbon_key_" + std::to_string(i));
+
+    ribbon_filter<16> flat;
+    ribbon_filter<16, interleaved_solution> inter;
+    REQUIRE(flat.build(keys));
+    REQUIRE(inter.build(keys));
+    REQUIRE(inter.bits_per_key(keys.size()) == flat.bits_per_key(keys.size()));
+    for (const auto& k : keys) REQUIRE(inter.verify(k));
+    for (size_t i = 0; i < 5000; ++i) {
+        auto probe = "other_" + std::to_string(i);
+        REQUIRE(inter.verify(probe) == flat.verify(probe));
+    }
+
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    auto out = std::make_unique<bool[]>(views.size());
+    verify_batch(inter, views, std::span<bool>{out.get(), views.size()});
+    for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i]);
+
+    // Either layout loads the other's bytes.
+    auto inter_bytes = inter.serialize();
+    auto from_flat = ribbon_filter<16, interleaved_solution>::deserialize(flat.serialize());
+    auto to_flat = ribbon_filter<16>::deserialize(inter_bytes);
+    REQUIRE(from_flat.has_value());
+    REQUIRE(to_flat.has_value());
+    REQUIRE(from_flat->serialize() == inter_bytes);
+    for (const auto& k : keys) {
+        REQUIRE(from_flat->verify(k));
+        REQUIRE(to_flat->verify(k));
+    }
+}
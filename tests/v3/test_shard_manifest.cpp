@@ -0,0 +1,160 @@
+/**
+ * @file test_shard_manifest.cpp
+ * @brief Tests for partition_router, shard_manifest and
+ *        partitioned_shard_group: one partitioned_phf over several nodes.
+ *
+ * Every key routed by the manifest alone must land on a node whose shard
+ * group answers the same global slot as the whole structure.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/shard_manifest.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 55) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+using phf_t = partitioned_phf<phobic5>;
+
+} // namespace
+
+TEST_CASE("partition_router: routes as the structure does", "[shard_manifest]") {
+    auto keys = make_keys(20000);
+    auto phf = phf_t::builder{}.add_all(keys).with_shards(16).with_seed(7).build();
+    REQUIRE(phf.has_value());
+
+    const partition_router r = phf->router();
+    CHECK(r.num_shards() == 16);
+    // Rebuilt from the seed and count alone, members and non-members alike.
+    const partition_router client{r.seed(), 16};
+    CHECK(client == r);
+    for (const auto& k : keys) REQUIRE(client.shard_of(k) == phf->shard_of(k));
+    for (const auto& k : make_keys(1000, 9)) REQUIRE(client.shard_of(k) == phf->shard_of(k));
+    CHECK(client.shard_of(uint64_t{42}) < 16);
+
+    auto view = partitioned_phf_view<phobic_phf_view<5>>::deserialize(phf->serialize());
+    REQUIRE(view.has_value());
+    CHECK(view->router() == r);
+}
+
+TEST_CASE("shard_manifest: nodes serve their shards with global slots", "[shard_manifest]") {
+    auto keys = make_keys(30000);
+    auto phf = phf_t::builder{}.add_all(keys).with_shards(12).build();
+    REQUIRE(phf.has_value());
+
+    auto manifest = shard_manifest::assign(*phf, 3);
+    REQUIRE(manifest.has_value());
+    CHECK(manifest->num_nodes() == 3);
+    size_t total = 0;
+    for (uint32_t n = 0; n < 3; ++n) {
+        auto shards = manifest->shards_of(n);
+        CHECK(shards.size() >= 3);
+        CHECK(shards.size() <= 5);
+        total += shards.size();
+    }
+    CHECK(total == 12);
+
+    // Ship the manifest and one file per node.
+    auto client = shard_manifest::deserialize(manifest->serialize());
+    REQUIRE(client.has_value());
+    CHECK(client->router() == phf->router());
+    std::vector<std::vector<std::byte>> files;
+    std::vector<partitioned_shard_group<phobic5>> nodes;
+    for (uint32_t n = 0; n < 3; ++n) {
+        files.push_back(phf->serialize_shards(client->shards_of(n)));
+        auto g = partitioned_shard_group<phobic5>::deserialize(files.back());
+        REQUIRE(g.has_value());
+        nodes.push_back(std::move(*g));
+    }
+    CHECK(files[0].size() < phf->serialize().size() / 2);
+
+    size_t local = 0;
+    for (const auto& g : nodes) local += g.local_keys();
+    CHECK(local == keys.size());
+
+    for (const auto& k : keys) {
+        const auto& node = nodes[client->node_of(k)];
+        REQUIRE(node.owns(k));
+        REQUIRE(node.slot_for(k) == phf->slot_for(k));
+        const size_t s = client->shard_of(k);
+        REQUIRE(node.slot_for(k).value >= client->shard_offset(s));
+        REQUIRE(node.slot_for(k).value < client->shard_offset(s + 1));
+    }
+    // A key routed elsewhere gets range_size().
+    const auto& other = nodes[(client->node_of(keys[0]) + 1) % 3];
+    CHECK_FALSE(other.owns(keys[0]));
+    CHECK(other.slot_for(keys[0]).value == phf->range_size());
+}
+
+TEST_CASE("shard_manifest: explicit assignment, views, bad input", "[shard_manifest]") {
+    auto keys = make_keys(8000);
+    auto phf = phf_t::builder{}.add_all(keys).with_shards(6).build();
+    REQUIRE(phf.has_value());
+
+    // Shards 0, 2, 4 on node 1; the rest on node 0.
+    std::vector<uint32_t> nodes{1, 0, 1, 0, 1, 0};
+    auto manifest = shard_manifest::assign(*phf, nodes, 2);
+    REQUIRE(manifest.has_value());
+    CHECK(manifest->shards_of(1) == std::vector<size_t>{0, 2, 4});
+
+    // A view group binds the node's bytes in place.
+    auto bytes = phf->serialize_shards(manifest->shards_of(1));
+    auto group = partitioned_shard_group<phobic_phf_view<5>>::deserialize(bytes);
+    REQUIRE(group.has_value());
+    CHECK(group->shard_ids().size() == 3);
+    CHECK(group->owns_shard(2));
+    CHECK_FALSE(group->owns_shard(3));
+    for (const auto& k : keys) {
+        if (manifest->node_of(k) == 1) REQUIRE(group->slot_for(k) == phf->slot_for(k));
+    }
+
+    CHECK_FALSE(shard_manifest::assign(*phf, std::vector<uint32_t>{0, 1}, 2).has_value());
+    CHECK_FALSE(shard_manifest::assign(*phf, nodes, 1).has_value());
+    CHECK_FALSE(shard_manifest::assign(*phf, 0).has_value());
+
+    auto m_bytes = manifest->serialize();
+    CHECK_FALSE(shard_manifest::deserialize(std::span<const std::byte>(m_bytes).first(30)).has_value());
+    CHECK_FALSE(partitioned_shard_group<phobic5>::deserialize(std::span<const std::byte>(bytes).first(60)).has_value());
+    // Neither format is taken for the other, or for the whole structure.
+    CHECK_FALSE(shard_manifest::deserialize(bytes).has_value());
+    CHECK_FALSE(partitioned_shard_group<phobic5>::deserialize(phf->serialize()).has_value());
+
+    // [16-byte header][seed][keys][range][u64 shards][u64 6][7 offsets]...
+    using group5 = partitioned_shard_group<phobic5>;
+    auto patched = [&](size_t at, uint64_t v) {
+        auto out = bytes;
+        std::memcpy(out.data() + at, &v, sizeof(v));
+        return out;
+    };
+    // A shard count the offsets table does not back is not allocated.
+    CHECK_FALSE(group5::deserialize(patched(40, uint64_t{1} << 40)).has_value());
+    // Shard 0's range running into shard 1's is rejected.
+    uint64_t second{};
+    std::memcpy(&second, bytes.data() + 56 + 16, sizeof(second));
+    CHECK_FALSE(group5::deserialize(patched(56 + 8, second + 1)).has_value());
+
+    // An empty group routes every key elsewhere.
+    auto empty = partitioned_shard_group<phobic5>::deserialize(phf->serialize_shards({}));
+    REQUIRE(empty.has_value());
+    CHECK_FALSE(empty->owns(keys[0]));
+    CHECK(empty->slot_for(keys[0]).value == phf->range_size());
+}
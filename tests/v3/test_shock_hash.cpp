@@ -7,8 +7,11 @@
 
 #include <maph/algorithms/shock_hash.hpp>
 #include <maph/concepts/perfect_hash_function.hpp>
+#include <maph/detail/cuckoo_orient.hpp>
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <random>
 #include <string>
 #include <unordered_set>
@@ -43,6 +46,50 @@ TEST_CASE("shock_hash<64> concept: satisfies perfect_hash_function",
     STATIC_REQUIRE(perfect_hash_function<shock_hash<64>>);
 }
 
+TEST_CASE("shock_hash<64>: slot_for(hashed_key) matches slot_for", "[shock_hash][hashed]") {
+    auto keys = make_keys(2000);
+    auto built = shock_hash<64>::builder{}.add_all(keys).build();
+    REQUIRE(built.has_value());
+    for (const auto& k : keys) {
+        REQUIRE(built->slot_for(hashed_key{k}).value == built->slot_for(k).value);
+    }
+}
+
+TEST_CASE("cuckoo_orient_fixed: same orientation as cuckoo_orient", "[shock_hash][cuckoo_orient]") {
+    std::mt19937_64 rng{7};
+    size_t oriented = 0;
+    for (size_t trial = 0; trial < 20000; ++trial) {
+        const size_t m = 1 + rng() % 64;
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        std::vector<uint8_t> first, second;
+        for (size_t i = 0; i < m; ++i) {
+            // Self-loops now and then, as the general version allows them.
+            const auto a = static_cast<uint8_t>(rng() % 64);
+            const auto b = rng() % 16 == 0 ? a : static_cast<uint8_t>(rng() % 64);
+            edges.emplace_back(a, b);
+            first.push_back(a);
+            second.push_back(b);
+        }
+        std::vector<uint8_t> assignment(m);
+        auto expected = detail::cuckoo_orient(edges, 64);
+        const bool got = detail::cuckoo_orient_fixed<64>(first, second, assignment);
+        REQUIRE(got == expected.has_value());
+        if (got) {
+            REQUIRE(assignment == expected->assignment);
+            ++oriented;
+        }
+    }
+    REQUIRE(oriented > 1000);
+
+    // Out of range: a vertex past BucketSize, or more edges than vertices.
+    std::array<uint8_t, 2> a{0, 16}, b{1, 2}, out{};
+    REQUIRE_FALSE(detail::cuckoo_orient_fixed<16>(a, b, out));
+    std::array<uint8_t, 5> c{0, 1, 2, 3, 3}, d{1, 2, 3, 0, 1}, out5{};
+    REQUIRE_FALSE(detail::cuckoo_orient_fixed<4>(c, d, out5));
+    REQUIRE(detail::cuckoo_orient_fixed<4>(std::span{c}.first(3), std::span{d}.first(3),
+                                           std::span{out5}.first(3)));
+}
+
 TEST_CASE("shock_hash<64>: 500 keys map to distinct slots", "[shock_hash]") {
     auto keys = make_keys(500);
     auto built = shock_hash<64>::builder{}
@@ -58,6 +105,22 @@ TEST_CASE("shock_hash<64>: 500 keys map to distinct slots", "[shock_hash]") {
     }
 }
 
+TEST_CASE("shock_hash<64>: threaded build matches serial", "[shock_hash][threads]") {
+    auto keys = make_keys(20000);
+    auto serial = shock_hash<64>::builder{}.add_all(keys).with_threads(1).build();
+    auto threaded = shock_hash<64>::builder{}.add_all(keys).with_threads(4).build();
+    REQUIRE(serial.has_value());
+    REQUIRE(threaded.has_value());
+    REQUIRE(threaded->serialize() == serial->serialize());
+
+    std::unordered_set<uint64_t> slots;
+    for (const auto& k : keys) {
+        uint64_t s = threaded->slot_for(k).value;
+        REQUIRE(s < threaded->range_size());
+        REQUIRE(slots.insert(s).second);
+    }
+}
+
 TEST_CASE("shock_hash<64>: 5000 keys map to distinct slots", "[shock_hash]") {
     auto keys = make_keys(5000);
     auto built = shock_hash<64>::builder{}
@@ -96,7 +159,7 @@ TEST_CASE("shock_hash<64>: bits_per_key below 2.5", "[shock_hash][space]") {
     REQUIRE(built.has_value());
 
     double bpk = built->bits_per_key();
-    REQUIRE(bpk < 2.5);  // beats PHOBIC's 2.7
+    REQUIRE(bpk < 2.5);  // beats PHOBIC's 2.5-3.2
     REQUIRE(bpk > 1.0);  // below theoretical floor would be impossible
 }
 
@@ -118,3 +181,30 @@ TEST_CASE("shock_hash<64>: serialize/deserialize round-trip",
     REQUIRE(restored->num_keys() == built->num_keys());
     REQUIRE(restored->range_size() == built->range_size());
 }
+
+TEST_CASE("shock_hash<64>: loads blobs with a flat choice ribbon",
+          "[shock_hash][serialize]") {
+    auto keys = make_keys(3000);
+    auto built = shock_hash<64>::builder{}.add_all(keys).build();
+    REQUIRE(built.has_value());
+    auto bytes = built->serialize();
+
+    // Re-encode the embedded ribbon in the flat layout, as older
+    // serializers wrote it: header, bucket seeds, length, ribbon bytes.
+    size_t head = sizeof(uint32_t) + 3 * sizeof(uint64_t) + built->num_buckets() * sizeof(uint32_t);
+    auto ribbon = ribbon_retrieval<1>::deserialize(
+        std::span<const std::byte>(bytes).subspan(head + sizeof(uint64_t)));
+    REQUIRE(ribbon.has_value());
+    auto flat = ribbon->serialize();
+    std::vector<std::byte> old(bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(head));
+    uint64_t len = flat.size();
+    auto len_bytes = std::bit_cast<std::array<std::byte, sizeof(len)>>(len);
+    old.insert(old.end(), len_bytes.begin(), len_bytes.end());
+    old.insert(old.end(), flat.begin(), flat.end());
+    REQUIRE(old != bytes);
+
+    auto restored = shock_hash<64>::deserialize(old);
+    REQUIRE(restored.has_value());
+    for (const auto& k : keys) REQUIRE(restored->slot_for(k).value == built->slot_for(k).value);
+    REQUIRE(restored->serialize() == bytes);
+}
@@ -0,0 +1,233 @@
+/**
+ * @file test_snapshot.cpp
+ * @brief Tests for snapshot: epoch-based hot swap of rebuilt structures.
+ *
+ * A retired instance must stay alive while any guard taken before the
+ * swap is open and be destroyed once none is; readers racing a writer
+ * must only ever see whole instances.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/snapshot.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+// Counts live instances; a payload of `n` copies of `id` checks for tears.
+struct tracked {
+    static inline std::atomic<int> live{0};
+    uint64_t id{0};
+    std::vector<uint64_t> payload{};
+
+    explicit tracked(uint64_t i, size_t n = 1) : id(i), payload(n, i) { ++live; }
+    tracked(tracked&& o) noexcept : id(o.id), payload(std::move(o.payload)) { ++live; }
+    tracked(const tracked&) = delete;
+    ~tracked() { --live; }
+
+    bool whole() const {
+        for (auto v : payload) if (v != id) return false;
+        return true;
+    }
+};
+
+struct keep_flag {
+    std::shared_ptr<std::atomic<bool>> gone;
+    keep_flag(std::shared_ptr<std::atomic<bool>> g) : gone(std::move(g)) {}
+    keep_flag(keep_flag&&) = default;
+    ~keep_flag() { if (gone) *gone = true; }
+};
+
+} // namespace
+
+TEST_CASE("snapshot: publish and read", "[snapshot]") {
+    snapshot<std::string> s;
+    auto r = s.make_reader();
+    {
+        auto g = r.read();
+        CHECK_FALSE(g);
+        CHECK(g.get() == nullptr);
+    }
+    CHECK(s.version() == 0);
+
+    s.publish("first");
+    {
+        auto g = r.read();
+        REQUIRE(g);
+        CHECK(*g == "first");
+        CHECK(g->size() == 5);
+    }
+    s.publish("second");
+    CHECK(s.version() == 2);
+    CHECK(*r.read() == "second");
+    CHECK(s.pending() == 0);
+}
+
+TEST_CASE("snapshot: retired instances outlive open guards", "[snapshot]") {
+    tracked::live = 0;
+    {
+        snapshot<tracked> s{tracked{1}};
+        auto r1 = s.make_reader();
+        auto r2 = s.make_reader();
+        CHECK(tracked::live == 1);
+
+        auto g1 = r1.read();
+        REQUIRE(g1->id == 1);
+        s.publish(tracked{2});
+        CHECK(tracked::live == 2);
+        CHECK(s.pending() == 1);
+
+        // A reader entering after the swap sees the new instance and does
+        // not hold back the old one.
+        {
+            auto g2 = r2.read();
+            CHECK(g2->id == 2);
+            CHECK(g1->id == 1);
+            CHECK(s.reclaim() == 1);
+        }
+        CHECK(s.reclaim() == 1);
+
+        g1.release();
+        CHECK(s.reclaim() == 0);
+        CHECK(tracked::live == 1);
+
+        // No reader in between: the old instance goes during publish.
+        s.publish(tracked{3});
+        CHECK(s.pending() == 0);
+        CHECK(tracked::live == 1);
+        CHECK(r1.read()->id == 3);
+    }
+    CHECK(tracked::live == 0);
+}
+
+TEST_CASE("snapshot: nested guards, moved readers, keep-alive owner", "[snapshot]") {
+    tracked::live = 0;
+    snapshot<tracked> s{tracked{1}};
+
+    SECTION("an inner guard keeps the outer epoch") {
+        auto r = s.make_reader();
+        auto outer = r.read();
+        s.publish(tracked{2});
+        {
+            auto inner = r.read();
+            CHECK(inner->id == 2);
+        }
+        // The inner guard closing must not let the outer instance go.
+        CHECK(s.reclaim() == 1);
+        CHECK(outer->id == 1);
+        outer = {};
+        CHECK(s.reclaim() == 0);
+    }
+
+    SECTION("readers move and free their slots") {
+        auto r = s.make_reader();
+        auto moved = std::move(r);
+        auto g = moved.read();
+        s.publish(tracked{2});
+        CHECK(s.pending() == 1);
+        auto g2 = std::move(g);
+        CHECK(g2->id == 1);
+        g2.release();
+        s.synchronize();
+        CHECK(s.pending() == 0);
+        {
+            auto r2 = s.make_reader();
+            CHECK(r2.read()->id == 2);
+        }
+    }
+
+    SECTION("keep is destroyed after the value it backs") {
+        auto gone = std::make_shared<std::atomic<bool>>(false);
+        s.publish(tracked{2}, keep_flag{gone});
+        CHECK_FALSE(*gone);
+        s.publish(tracked{3});
+        CHECK(*gone);
+    }
+}
+
+TEST_CASE("snapshot: readers never see a destroyed instance under continuous swaps",
+          "[snapshot][concurrent]") {
+    tracked::live = 0;
+    {
+        snapshot<tracked> s{tracked{0, 256}};
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> torn{0};
+        std::atomic<size_t> reads{0};
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                auto r = s.make_reader();
+                uint64_t last = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    auto g = r.read();
+                    if (!g->whole() || g->id < last) ++torn;
+                    last = g->id;
+                    ++reads;
+                }
+            });
+        }
+
+        for (uint64_t v = 1; v <= 2000; ++v) s.publish(tracked{v, 256});
+        stop = true;
+        for (auto& t : readers) t.join();
+
+        CHECK(torn == 0);
+        CHECK(reads > 0);
+        s.synchronize();
+        CHECK(s.pending() == 0);
+        CHECK(tracked::live == 1);
+    }
+    CHECK(tracked::live == 0);
+}
+
+TEST_CASE("snapshot: swapping phf_value_array under lookups", "[snapshot][concurrent]") {
+    using pva = phf_value_array<phobic5, 32>;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; ++i) keys.push_back("k" + std::to_string(i));
+
+    auto build = [&](uint32_t offset) {
+        pva::builder b;
+        for (size_t i = 0; i < keys.size(); ++i) b.add(keys[i], static_cast<uint32_t>(i) + offset);
+        auto built = b.build();
+        REQUIRE(built.has_value());
+        return std::move(*built);
+    };
+
+    snapshot<pva> s{build(0)};
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> wrong{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t] {
+            auto r = s.make_reader();
+            size_t i = static_cast<size_t>(t);
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto g = r.read();
+                // Every value of one instance carries the same offset.
+                const uint32_t a = g->lookup(keys[i % keys.size()]);
+                const uint32_t b = g->lookup(keys[(i + 7) % keys.size()]);
+                if (a - static_cast<uint32_t>(i % keys.size())
+                    != b - static_cast<uint32_t>((i + 7) % keys.size())) ++wrong;
+                ++i;
+            }
+        });
+    }
+    for (uint32_t v = 1; v <= 20; ++v) s.publish(build(v * 100000));
+    stop = true;
+    for (auto& t : readers) t.join();
+
+    CHECK(wrong == 0);
+    auto r = s.make_reader();
+    CHECK(r.read()->lookup(keys[5]) == 20 * 100000 + 5);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file test_static_phf.cpp
+ * @brief Tests for static_phf / static_map: tables built at compile time.
+ *
+ * The tables are checked twice over: by static_assert, which proves the
+ * build and the queries run in constant evaluation, and at run time,
+ * where the query takes the fast hash path and must land on the same
+ * slots.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/static_phf.hpp>
+#include <maph/composition/perfect_filter.hpp>
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+constexpr auto methods = make_static_phf({
+    "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"});
+
+constexpr auto status = make_static_map<int>({
+    {"ok", 200}, {"created", 201}, {"no_content", 204}, {"moved", 301},
+    {"bad_request", 400}, {"not_found", 404}, {"teapot", 418}, {"unavailable", 503}});
+
+// Long keys take the 17..256 byte and striped paths of the hash.
+constexpr std::string_view long_a =
+    "a key long enough to go through the striped accumulator of phf_hash128, which starts "
+    "past two hundred and fifty six bytes, so this sentence keeps going for a while longer "
+    "than anyone would write a header name, just to be sure it reaches that path at all, "
+    "and a few more words.";
+constexpr auto long_keys = make_static_phf({long_a, "seventeen bytes!!", "short", "", "x"});
+
+constexpr bool all_slots_distinct() {
+    std::array<bool, 9> seen{};
+    for (auto k : {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"}) {
+        const size_t s = methods.slot_for(k);
+        if (s >= 9 || seen[s]) return false;
+        seen[s] = true;
+    }
+    return true;
+}
+
+static_assert(long_a.size() > 256);
+static_assert(perfect_hash_function<static_phf<9>>);
+static_assert(all_slots_distinct());
+static_assert(*status.find("teapot") == 418);
+static_assert(status.find("teapots") == nullptr);
+static_assert(status.value_or("moved", 0) == 301);
+static_assert(long_keys.slot_for(long_a) != long_keys.slot_for("short"));
+
+std::vector<std::string> make_keys(size_t count) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; ++i) keys.push_back("header-" + std::to_string(i * 7919));
+    return keys;
+}
+
+} // namespace
+
+TEST_CASE("static_phf: compile-time table answers at run time", "[static_phf]") {
+    // Runtime strings: the fast hash path must agree with the constexpr one.
+    std::set<size_t> slots;
+    for (std::string k : {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"}) {
+        const size_t s = methods.slot_for(k);
+        REQUIRE(s < methods.range_size());
+        slots.insert(s);
+        CHECK(methods.slot_for(hashed_key{k}) == s);
+    }
+    CHECK(slots.size() == 9);
+    CHECK(methods.num_keys() == 9);
+    CHECK(methods.bits_per_key() < 16.0);
+
+    std::string lk{long_a};
+    CHECK(long_keys.slot_for(lk) == long_keys.slot_for(long_a));
+    CHECK(phf_hash128(lk) == [] { constexpr auto d = phf_hash128(long_a); return d; }());
+}
+
+TEST_CASE("static_map: exact lookups", "[static_phf]") {
+    CHECK(status.size() == 8);
+    for (auto [k, v] : std::array<std::pair<std::string, int>, 3>{{{"ok", 200}, {"not_found", 404}, {"unavailable", 503}}}) {
+        const int* found = status.find(k);
+        REQUIRE(found != nullptr);
+        CHECK(*found == v);
+    }
+    CHECK_FALSE(status.contains("OK"));
+    CHECK_FALSE(status.contains(""));
+    CHECK(status.value_or("gone", -1) == -1);
+}
+
+TEST_CASE("static_phf: runtime build, errors, serialization", "[static_phf]") {
+    auto keys = make_keys(300);
+    std::array<std::string_view, 300> views{};
+    std::copy(keys.begin(), keys.end(), views.begin());
+
+    auto built = static_phf<300>::build(std::span<const std::string_view, 300>{views});
+    REQUIRE(built.has_value());
+    std::vector<bool> seen(300, false);
+    for (auto k : views) {
+        const size_t s = built->slot_for(k);
+        REQUIRE(s < 300);
+        REQUIRE_FALSE(seen[s]);
+        seen[s] = true;
+    }
+
+    auto bytes = built->serialize();
+    auto loaded = static_phf<300>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    for (auto k : views) REQUIRE(loaded->slot_for(k) == built->slot_for(k));
+    CHECK_FALSE(static_phf<299>::deserialize(bytes).has_value());
+    CHECK_FALSE(static_phf<300>::deserialize(std::span<const std::byte>(bytes).first(20)).has_value());
+
+    // Usable anywhere a PHF is: a filter over the same keys.
+    auto filter = perfect_filter<static_phf<300>, 16>::build(*built, keys);
+    for (const auto& k : keys) REQUIRE(filter.contains(k));
+
+    std::array<std::string_view, 3> dup{"a", "b", "a"};
+    auto failed = static_phf<3>::build(std::span<const std::string_view, 3>{dup});
+    REQUIRE_FALSE(failed.has_value());
+    CHECK(failed.error() == error::duplicate_key);
+}
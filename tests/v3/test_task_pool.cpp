@@ -0,0 +1,109 @@
+/**
+ * @file test_task_pool.cpp
+ * @brief Tests for detail::task_pool (maph::executor), the persistent
+ *        range-stealing pool.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/detail/task_pool.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using maph::detail::task_pool;
+
+TEST_CASE("task_pool: for_each runs every task exactly once", "[task_pool]") {
+    for (size_t threads : {size_t{1}, size_t{2}, size_t{5}, size_t{16}}) {
+        task_pool pool{threads};
+        REQUIRE(pool.size() == threads);
+        // Reused across calls, including ones smaller than the pool.
+        for (size_t n : {size_t{0}, size_t{1}, size_t{3}, size_t{1000}, size_t{40000}}) {
+            std::vector<std::atomic<uint32_t>> hits(n);
+            std::atomic<bool> worker_in_range{true};
+            pool.for_each(n, [&](size_t i, size_t w) {
+                hits[i].fetch_add(1, std::memory_order_relaxed);
+                if (w >= threads) worker_in_range = false;
+            });
+            for (size_t i = 0; i < n; ++i) REQUIRE(hits[i].load() == 1);
+            REQUIRE(worker_in_range);
+        }
+    }
+}
+
+TEST_CASE("task_pool: idle workers steal from a long range", "[task_pool]") {
+    task_pool pool{4};
+    // Worker 0's first task blocks until some other worker has run a task
+    // that started in worker 0's range, which only stealing makes possible.
+    const size_t n = 400;
+    std::atomic<bool> stolen{false};
+    pool.for_each(n, [&](size_t i, size_t w) {
+        if (i < n / 4 && w != 0) stolen = true;
+        if (i == 0) {
+            while (!stolen.load()) std::this_thread::yield();
+        }
+    });
+    REQUIRE(stolen);
+}
+
+TEST_CASE("task_pool: run calls every worker once", "[task_pool]") {
+    task_pool pool{6};
+    std::vector<std::atomic<int>> calls(6);
+    for (int round = 0; round < 50; ++round) {
+        pool.run([&](size_t w) { calls[w].fetch_add(1); });
+    }
+    for (auto& c : calls) REQUIRE(c.load() == 50);
+}
+
+TEST_CASE("task_pool: calls from its own tasks run inline on that worker", "[task_pool]") {
+    task_pool pool{4};
+    std::vector<std::atomic<uint32_t>> hits(64 * 50);
+    std::atomic<bool> same_worker{true};
+    pool.for_each(64, [&](size_t i, size_t w) {
+        if (pool.parallel()) same_worker = false;
+        pool.for_each(50, [&](size_t j, size_t inner) {
+            if (inner != w) same_worker = false;
+            hits[i * 50 + j].fetch_add(1, std::memory_order_relaxed);
+        });
+    });
+    for (auto& h : hits) REQUIRE(h.load() == 1);
+    REQUIRE(same_worker);
+    REQUIRE(pool.parallel());
+}
+
+TEST_CASE("task_pool: run_workers uses the scoped executor", "[task_pool]") {
+    task_pool pool{3};
+    std::atomic<size_t> fresh_threads{0}, on_pool{0};
+    const auto caller = std::this_thread::get_id();
+    {
+        maph::detail::executor_scope scope{&pool};
+        maph::detail::run_workers(8, [&] {
+            if (maph::detail::scoped_executor() == &pool) ++on_pool;
+        });
+    }
+    REQUIRE(on_pool.load() == pool.size());
+    REQUIRE(maph::detail::scoped_executor() == nullptr);
+
+    maph::detail::run_workers(2, [&] {
+        if (std::this_thread::get_id() != caller) ++fresh_threads;
+    });
+    REQUIRE(fresh_threads.load() == 2);
+}
+
+TEST_CASE("task_pool: callers on several threads take turns", "[task_pool]") {
+    task_pool pool{3};
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> callers;
+    for (int c = 0; c < 4; ++c) {
+        callers.emplace_back([&] {
+            for (int round = 0; round < 20; ++round) {
+                pool.for_each(100, [&](size_t i, size_t) { sum.fetch_add(i); });
+            }
+        });
+    }
+    for (auto& t : callers) t.join();
+    REQUIRE(sum.load() == 4 * 20 * 4950);
+}
@@ -0,0 +1,157 @@
+/**
+ * @file test_tiered.cpp
+ * @brief Tests for tiered_value_array / tiered_filter: heavy keys in a
+ *        small hot tier, the rest cold.
+ *
+ * Every build key must read back its own value whichever tier holds it,
+ * including the cold keys the hot tier's fingerprints would have
+ * accepted; the hot tier must respect its budget.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/partitioned.hpp>
+#include <maph/composition/tiered.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 53) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key_" + std::to_string(rng()) + "_" + std::to_string(i));
+    }
+    return keys;
+}
+
+// Zipf-like: key i has weight 1 / (i + 1).
+std::vector<double> zipf_weights(size_t count) {
+    std::vector<double> w(count);
+    for (size_t i = 0; i < count; ++i) w[i] = 1.0 / static_cast<double>(i + 1);
+    return w;
+}
+
+using values = tiered_value_array<phobic5, 32>;
+using filter = tiered_filter<phobic5, 16>;
+
+} // namespace
+
+TEST_CASE("tiered_value_array: every key reads its value, heaviest keys hot", "[tiered]") {
+    auto keys = make_keys(20000);
+    auto weights = zipf_weights(keys.size());
+    std::vector<uint32_t> vals(keys.size());
+    for (size_t i = 0; i < vals.size(); ++i) vals[i] = static_cast<uint32_t>(i * 2654435761u);
+
+    auto built = values::builder{}.add_all(keys, vals, weights).with_hot_fraction(0.05).build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_keys() == keys.size());
+    CHECK(built->hot_keys() >= 1000);
+    CHECK(built->hot_keys() < 1010);  // plus the rare promoted key
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(built->lookup(keys[i]) == vals[i]);
+    }
+    // The heaviest keys are answered by the hot tier.
+    for (size_t i = 0; i < 1000; ++i) {
+        REQUIRE(built->hot().lookup(keys[i]) == vals[i]);
+    }
+    CHECK(built->hot_bytes() < built->memory_bytes() / 10);
+
+    auto bytes = built->serialize();
+    auto loaded = values::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->hot_keys() == built->hot_keys());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        REQUIRE(loaded->lookup(keys[i]) == vals[i]);
+    }
+    CHECK_FALSE(values::deserialize(std::span<const std::byte>(bytes).first(12)).has_value());
+}
+
+TEST_CASE("tiered_value_array: hot budget, no weights, all hot", "[tiered]") {
+    auto keys = make_keys(5000);
+    std::vector<uint32_t> vals(keys.size());
+    for (size_t i = 0; i < vals.size(); ++i) vals[i] = static_cast<uint32_t>(i);
+
+    SECTION("the budget caps the hot tier") {
+        // 64 bits per hot record: 4 KiB holds 512.
+        auto built = values::builder{}
+            .add_all(keys, vals, zipf_weights(keys.size()))
+            .with_hot_fraction(1.0).with_hot_budget(4096)
+            .build();
+        REQUIRE(built.has_value());
+        CHECK(built->hot_keys() >= 512);
+        CHECK(built->hot_keys() < 520);
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == vals[i]);
+    }
+
+    SECTION("zero weights leave everything cold") {
+        values::builder b;
+        for (size_t i = 0; i < keys.size(); ++i) b.add(keys[i], vals[i]);
+        auto built = b.build();
+        REQUIRE(built.has_value());
+        CHECK(built->hot_keys() == 0);
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == vals[i]);
+    }
+
+    SECTION("every key hot") {
+        auto built = values::builder{}
+            .add_all(keys, vals, std::vector<double>(keys.size(), 1.0))
+            .with_hot_fraction(1.0).with_hot_budget(size_t{1} << 20)
+            .build();
+        REQUIRE(built.has_value());
+        CHECK(built->hot_keys() == keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == vals[i]);
+        auto loaded = values::deserialize(built->serialize());
+        REQUIRE(loaded.has_value());
+        CHECK(loaded->lookup(keys[7]) == 7);
+    }
+
+    SECTION("empty build fails") {
+        CHECK_FALSE(values::builder{}.build().has_value());
+    }
+}
+
+TEST_CASE("tiered_value_array: partitioned cold tier, phobic hot tier", "[tiered]") {
+    using narrow = tiered_value_array<partitioned_phf<phobic5>, 8, phobic5>;
+    auto keys = make_keys(50000, 9);
+    std::vector<uint8_t> vals(keys.size());
+    for (size_t i = 0; i < vals.size(); ++i) vals[i] = static_cast<uint8_t>(i * 31);
+    auto built = narrow::builder{}
+        .add_all(keys, vals, zipf_weights(keys.size()))
+        .with_threads(2).with_seed(3)
+        .build();
+    REQUIRE(built.has_value());
+    CHECK(built->hot_keys() >= 500);
+    for (size_t i = 0; i < keys.size(); ++i) REQUIRE(built->lookup(keys[i]) == vals[i]);
+    auto loaded = narrow::deserialize(built->serialize());
+    REQUIRE(loaded.has_value());
+    for (size_t i = 0; i < keys.size(); i += 7) REQUIRE(loaded->lookup(keys[i]) == vals[i]);
+}
+
+TEST_CASE("tiered_filter: no false negatives, hot keys in the hot tier", "[tiered]") {
+    auto keys = make_keys(20000);
+    auto built = filter::builder{}.add_all(keys, zipf_weights(keys.size())).build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->num_keys() == keys.size());
+    CHECK(built->hot_keys() == 200);
+    for (const auto& k : keys) REQUIRE(built->contains(k));
+    for (size_t i = 0; i < 200; ++i) REQUIRE(built->hot().contains(keys[i]));
+
+    auto others = make_keys(20000, 77);
+    size_t fp = 0;
+    for (const auto& k : others) fp += built->contains(k);
+    // Two 16-bit tiers: about 2 * 2^-16, so well under 0.1%.
+    CHECK(fp < 20);
+
+    auto loaded = filter::deserialize(built->serialize());
+    REQUIRE(loaded.has_value());
+    for (const auto& k : keys) REQUIRE(loaded->contains(k));
+}
@@ -0,0 +1,173 @@
+/**
+ * @file test_verified_value_array.cpp
+ * @brief Tests for verified_value_array: fingerprint and value in one record.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/algorithms/phobic.hpp>
+#include <maph/composition/padded_phf.hpp>
+#include <maph/composition/perfect_filter.hpp>
+#include <maph/composition/verified_value_array.hpp>
+#include <maph/concepts/approximate_map.hpp>
+#include <maph/retrieval/phf_value_array.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 42) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(4, 16);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+std::vector<std::string> make_unknowns(size_t count, uint64_t seed = 99999) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('A', 'Z');
+    for (size_t i = 0; i < count; ++i) {
+        std::string k = "UNK_";
+        for (int j = 0; j < 12; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    return keys;
+}
+
+uint64_t value_for(std::string_view key) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (char c : key) {
+        h ^= static_cast<uint64_t>(static_cast<unsigned char>(c));
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 31;
+    }
+    return h;
+}
+
+} // namespace
+
+TEST_CASE("verified_value_array: satisfies approximate_map", "[verified_value_array][concept]") {
+    static_assert(approximate_map<verified_value_array<phobic5, 8, 16>>);
+    static_assert(approximate_map<verified_value_array<phobic5, 16, 48>>);
+}
+
+TEST_CASE("verified_value_array<phobic5, 8, 16>: members return their values", "[verified_value_array]") {
+    auto keys = make_keys(3000);
+    auto built = verified_value_array<phobic5, 8, 16>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(built.has_value());
+    for (const auto& k : keys) {
+        auto v = built->lookup(k);
+        REQUIRE(v.has_value());
+        REQUIRE(*v == static_cast<uint16_t>(value_for(k)));
+        REQUIRE(built->contains(k));
+        REQUIRE(built->slot_for(k)->value == built->phf().slot_for(k).value);
+        REQUIRE(built->lookup(hashed_key{k}) == v);
+    }
+}
+
+TEST_CASE("verified_value_array: odd widths pack records across words", "[verified_value_array]") {
+    auto keys = make_keys(2000);
+    auto built = verified_value_array<phobic5, 11, 13>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(built.has_value());
+    for (const auto& k : keys) REQUIRE(built->lookup(k) == static_cast<uint16_t>(value_for(k) & 0x1fff));
+}
+
+TEST_CASE("verified_value_array: FP rate near 2^-FPBits", "[verified_value_array][fpr]") {
+    auto keys = make_keys(5000);
+    auto unknowns = make_unknowns(50000);
+    auto built = verified_value_array<phobic5, 8, 8>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(built.has_value());
+    size_t fp = 0;
+    for (const auto& u : unknowns) {
+        if (built->lookup(u).has_value()) ++fp;
+        REQUIRE(built->contains(u) == built->lookup(u).has_value());
+    }
+    double rate = static_cast<double>(fp) / static_cast<double>(unknowns.size());
+    REQUIRE(rate < 2.0 / 256.0);
+}
+
+TEST_CASE("verified_value_array: agrees with perfect_filter + phf_value_array", "[verified_value_array][compare]") {
+    auto keys = make_keys(4000);
+    auto unknowns = make_unknowns(4000);
+    auto fused = verified_value_array<phobic5, 16, 16>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    auto values = phf_value_array<phobic5, 16>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(fused.has_value());
+    REQUIRE(values.has_value());
+    auto pf = perfect_filter<phobic5, 16>::build(phobic5::builder{}.add_all(keys).build().value(), keys);
+
+    for (const auto* set : {&keys, &unknowns}) {
+        for (const auto& k : *set) {
+            auto slot = pf.slot_for(k);
+            REQUIRE(fused->slot_for(k) == slot);
+            if (slot) REQUIRE(*fused->lookup(k) == values->values().get(slot->value));
+        }
+    }
+    // Same bits as the two arrays side by side.
+    REQUIRE(fused->memory_bytes() * 8
+            <= values->memory_bytes() * 8 + pf.range_size() * 16 + 128);
+}
+
+TEST_CASE("verified_value_array: non-minimal PHF leaves unused slots rejecting", "[verified_value_array][padded]") {
+    auto keys = make_keys(2000);
+    auto unknowns = make_unknowns(20000);
+    auto built = verified_value_array<padded_phf<phobic5>, 16, 8>::builder{}
+        .with_padding(2)
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(built.has_value());
+    REQUIRE(built->range_size() > built->num_keys());
+    for (const auto& k : keys) REQUIRE(built->lookup(k) == static_cast<uint8_t>(value_for(k)));
+    size_t fp = 0;
+    for (const auto& u : unknowns) fp += built->contains(u) ? 1 : 0;
+    REQUIRE(fp < 10);
+}
+
+TEST_CASE("verified_value_array: serialize round-trip and width checks", "[verified_value_array][serialize]") {
+    auto keys = make_keys(1500);
+    auto unknowns = make_unknowns(1500);
+    auto built = verified_value_array<phobic5, 8, 16>::builder{}
+        .add_all_with(std::span<const std::string>{keys}, value_for)
+        .build();
+    REQUIRE(built.has_value());
+    auto bytes = built->serialize();
+
+    auto loaded = verified_value_array<phobic5, 8, 16>::deserialize(bytes);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->serialize() == bytes);
+    for (const auto& k : keys) REQUIRE(loaded->lookup(k) == built->lookup(k));
+    for (const auto& u : unknowns) REQUIRE(loaded->lookup(u) == built->lookup(u));
+
+    REQUIRE_FALSE(verified_value_array<phobic5, 16, 8>::deserialize(bytes).has_value());
+    REQUIRE_FALSE(verified_value_array<phobic5, 8, 16>::deserialize(
+        std::span<const std::byte>{bytes}.first(bytes.size() - 8)).has_value());
+    REQUIRE_FALSE(verified_value_array<phobic5, 8, 16>::deserialize({}).has_value());
+}
@@ -0,0 +1,109 @@
+/**
+ * @file test_xor_filter.cpp
+ * @brief Tests for xor_filter.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/concepts/membership_oracle.hpp>
+#include <maph/filters/xor_filter.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 7) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(6, 24);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+} // namespace
+
+TEST_CASE("xor_filter<8>: accepts all keys in S and rejects most others", "[xor_filter]") {
+    auto keys = make_keys(20000);
+    xor_filter<8> f;
+    REQUIRE(f.build(keys));
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+
+    size_t false_positives = 0;
+    for (size_t i = 0; i < 100000; ++i) {
+        if (f.verify("UNK_" + std::to_string(i))) ++false_positives;
+    }
+    // Expected ~1/256 of the probes.
+    REQUIRE(false_positives < 800);
+}
+
+TEST_CASE("xor_filter<16>: threaded build matches the serial one", "[xor_filter][parallel]") {
+    auto keys = make_keys(60000);
+    xor_filter<16> serial, threaded;
+    REQUIRE(serial.build(keys));
+    REQUIRE(threaded.build(keys, 4));
+    REQUIRE(threaded.serialize() == serial.serialize());
+
+    auto restored = xor_filter<16>::deserialize(threaded.serialize());
+    REQUIRE(restored.has_value());
+    for (const auto& k : keys) REQUIRE(restored->verify(k));
+}
+
+TEST_CASE("xor_filter<8>: duplicate keys are accepted", "[xor_filter]") {
+    std::vector<std::string> keys = {"a", "b", "c", "a", "b", "c", "d"};
+    xor_filter<8> f;
+    REQUIRE(f.build(keys));
+    for (const auto& k : keys) REQUIRE(f.verify(k));
+}
+
+TEST_CASE("xor_filter: verify_batch matches verify at every width", "[xor_filter][batch]") {
+    auto keys = make_keys(5000);
+    std::vector<std::string> probes = keys;
+    for (size_t i = 0; i < 3000; ++i) probes.push_back("UNK_" + std::to_string(i));
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    auto check = [&](auto filter) {
+        REQUIRE(filter.build(keys));
+        auto out = std::make_unique<bool[]>(views.size());
+        filter.verify_batch(views, std::span<bool>{out.get(), views.size()});
+        for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i] == filter.verify(views[i]));
+        // Ragged tails and the generic dispatcher.
+        verify_batch(filter, std::span{views}.first(37), std::span<bool>{out.get(), 37});
+        for (size_t i = 0; i < 37; ++i) REQUIRE(out[i] == filter.verify(views[i]));
+    };
+    check(xor_filter<8>{});
+    check(xor_filter<16>{});
+    check(xor_filter<32>{});
+}
+
+TEST_CASE("xor_filter: builds from and verifies integer keys", "[xor_filter][integer_key]") {
+    std::mt19937_64 rng{34};
+    std::vector<uint64_t> ids(10000);
+    for (auto& id : ids) id = rng();
+    xor_filter<16> f;
+    REQUIRE(f.build(std::span<const uint64_t>(ids)));
+    size_t fp = 0;
+    for (const auto& id : ids) {
+        REQUIRE(f.verify(id));
+        REQUIRE(f.verify(integer_key_bytes(id)));
+        const uint64_t other = rng();
+        fp += f.verify(other) ? 1 : 0;
+    }
+    REQUIRE(fp < 10);
+}
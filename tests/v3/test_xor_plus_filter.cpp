@@ -0,0 +1,104 @@
+/**
+ * @file test_xor_plus_filter.cpp
+ * @brief Tests for xor_plus_filter.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <maph/detail/container.hpp>
+#include <maph/filters/xor_plus_filter.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace maph;
+
+namespace {
+
+std::vector<std::string> make_keys(size_t count, uint64_t seed = 7) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    std::mt19937_64 rng{seed};
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::uniform_int_distribution<size_t> len_dist(6, 24);
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = len_dist(rng);
+        std::string k;
+        k.reserve(len);
+        for (size_t j = 0; j < len; ++j) k.push_back(static_cast<char>(char_dist(rng)));
+        keys.push_back(std::move(k));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+} // namespace
+
+TEST_CASE("xor_plus_filter answers exactly as the xor_filter it compresses", "[xor_plus]") {
+    auto keys = make_keys(50000);
+    xor_filter<16> full;
+    xor_plus_filter<16> plus;
+    REQUIRE(full.build(keys));
+    REQUIRE(plus.build(keys));
+    for (const auto& k : keys) REQUIRE(plus.verify(k));
+    for (size_t i = 0; i < 100000; ++i) {
+        const std::string probe = "UNK_" + std::to_string(i);
+        REQUIRE(plus.verify(probe) == full.verify(probe));
+    }
+
+    // About one slot in five is empty and dropped.
+    REQUIRE(plus.kept_slots() < plus.table_slots() * 85 / 100);
+    REQUIRE(plus.bits_per_key(keys.size()) < full.bits_per_key(keys.size()) - 1.5);
+}
+
+TEST_CASE("xor_plus_filter: threaded build matches the serial one", "[xor_plus][parallel]") {
+    auto keys = make_keys(60000);
+    xor_plus_filter<8> serial, threaded;
+    REQUIRE(serial.build(keys));
+    REQUIRE(threaded.build(keys, 4));
+    REQUIRE(threaded.serialize() == serial.serialize());
+}
+
+TEST_CASE("xor_plus_filter: serialize and container round trips", "[xor_plus]") {
+    auto keys = make_keys(10000);
+    xor_plus_filter<32> f;
+    REQUIRE(f.build(keys));
+
+    auto bytes = f.serialize();
+    auto restored = xor_plus_filter<32>::deserialize(bytes);
+    REQUIRE(restored.has_value());
+    for (const auto& k : keys) REQUIRE(restored->verify(k));
+    REQUIRE_FALSE(xor_filter<32>::deserialize(bytes).has_value());
+    REQUIRE_FALSE(xor_plus_filter<16>::deserialize(bytes).has_value());
+    bytes.resize(bytes.size() - 1);
+    REQUIRE_FALSE(xor_plus_filter<32>::deserialize(bytes).has_value());
+
+    auto from = from_container<xor_plus_filter<32>>(to_container(f));
+    REQUIRE(from.has_value());
+    REQUIRE(from->serialize() == f.serialize());
+}
+
+TEST_CASE("xor_plus_filter: verify_batch and integer keys", "[xor_plus][batch]") {
+    auto keys = make_keys(5000);
+    std::vector<std::string> probes = keys;
+    for (size_t i = 0; i < 3000; ++i) probes.push_back("UNK_" + std::to_string(i));
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    xor_plus_filter<16> f;
+    REQUIRE(f.build(keys));
+    auto out = std::make_unique<bool[]>(views.size());
+    f.verify_batch(views, std::span<bool>{out.get(), views.size()});
+    for (size_t i = 0; i < views.size(); ++i) REQUIRE(out[i] == f.verify(views[i]));
+
+    std::mt19937_64 rng{34};
+    std::vector<uint64_t> ids(10000);
+    for (auto& id : ids) id = rng();
+    xor_plus_filter<8> g;
+    REQUIRE(g.build(std::span<const uint64_t>(ids)));
+    for (const auto& id : ids) REQUIRE(g.verify(id));
+}